@@ -231,6 +231,34 @@ static void hvf_cpu_synchronize_pre_loadvm(CPUState *cpu)
     run_on_cpu(cpu, do_hvf_cpu_synchronize_set_dirty, RUN_ON_CPU_NULL);
 }
 
+/*
+ * Handle a write fault on a slot whose dirty pages are being logged:
+ * mark the host page that contains @gpa dirty and give write access back
+ * to that page only.  Further writes to the page then run without exits
+ * until the next dirty log sync protects the slot again, while writes to
+ * the other pages of the slot keep being tracked.
+ *
+ * Returns false if @gpa is not in a logged RAM slot, i.e. the fault has
+ * to be handled as an MMIO access.
+ */
+bool hvf_log_dirty_write(uint64_t gpa)
+{
+    hvf_slot *slot = hvf_find_overlap_slot(gpa, 1);
+    uint64_t page;
+
+    if (!slot || !(slot->flags & HVF_SLOT_LOG) ||
+        memory_region_is_rom(slot->region)) {
+        return false;
+    }
+
+    page = QEMU_ALIGN_DOWN(gpa, qemu_real_host_page_size);
+    memory_region_set_dirty(slot->region, page - slot->start,
+                            qemu_real_host_page_size);
+    hv_vm_protect((uintptr_t)page, qemu_real_host_page_size,
+                  HV_MEMORY_READ | HV_MEMORY_WRITE | HV_MEMORY_EXEC);
+    return true;
+}
+
 static void hvf_set_dirty_tracking(MemoryRegionSection *section, bool on)
 {
     hvf_slot *slot;
@@ -238,6 +266,9 @@ static void hvf_set_dirty_tracking(MemoryRegionSection *section, bool on)
     slot = hvf_find_overlap_slot(
             section->offset_within_address_space,
             int128_get64(section->size));
+    if (!slot) {
+        return;
+    }
 
     /* protect region against writes; begin tracking it */
     if (on) {
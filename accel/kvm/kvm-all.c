@@ -36,6 +36,7 @@
 #include "exec/ram_addr.h"
 #include "qemu/event_notifier.h"
 #include "qemu/main-loop.h"
+#include "qemu/stats.h"
 #include "trace.h"
 #include "hw/irq.h"
 #include "qapi/visitor.h"
@@ -149,6 +150,7 @@ struct KVMState
     uint64_t kvm_dirty_ring_bytes;  /* Size of the per-vcpu dirty ring */
     uint32_t kvm_dirty_ring_size;   /* Number of dirty GFNs per ring */
     struct KVMDirtyRingReaper reaper;
+    struct KVMStatsFd *stats_fd;    /* Binary statistics of the VM */
 };
 
 KVMState *kvm_state;
@@ -384,6 +386,211 @@ err:
     return ret;
 }
 
+/*
+ * Binary statistics exported by the kernel through KVM_GET_STATS_FD.  The
+ * descriptors do not change for the life of the fd, so they are read once
+ * and each value is read with pread() when query-stats asks for it.
+ * Histograms are skipped; other values are reported as the raw u64.
+ */
+typedef struct KVMStatsFd KVMStatsFd;
+
+typedef struct KVMStatsValue {
+    KVMStatsFd *stats;
+    uint32_t offset;
+} KVMStatsValue;
+
+struct KVMStatsFd {
+    int fd;
+    uint32_t data_offset;
+    KVMStatsValue *values;
+};
+
+static uint64_t kvm_stats_fd_get(void *opaque)
+{
+    KVMStatsValue *v = opaque;
+    uint64_t value;
+
+    if (pread(v->stats->fd, &value, sizeof(value),
+              v->stats->data_offset + v->offset) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+
+static KVMStatsFd *kvm_stats_fd_register(int fd, const char *provider,
+                                         const char *instance)
+{
+    struct kvm_stats_header header;
+    g_autofree char *descs = NULL;
+    size_t desc_size, descs_size;
+    KVMStatsFd *stats;
+    int i, n = 0;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        goto fail;
+    }
+
+    desc_size = sizeof(struct kvm_stats_desc) + header.name_size;
+    descs_size = desc_size * header.num_desc;
+    descs = g_malloc(descs_size);
+    if (pread(fd, descs, descs_size, header.desc_offset) != descs_size) {
+        goto fail;
+    }
+
+    stats = g_new0(KVMStatsFd, 1);
+    stats->fd = fd;
+    stats->data_offset = header.data_offset;
+    stats->values = g_new0(KVMStatsValue, header.num_desc);
+    for (i = 0; i < header.num_desc; i++) {
+        struct kvm_stats_desc *desc = (void *)(descs + i * desc_size);
+        KVMStatsValue *v;
+
+        if (desc->size != 1) {
+            continue;
+        }
+        v = &stats->values[n++];
+        v->stats = stats;
+        v->offset = desc->offset;
+        stats_register_func(provider, instance, desc->name,
+                            kvm_stats_fd_get, v);
+    }
+    return stats;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+/* The values must have been unregistered already */
+static void kvm_stats_fd_free(KVMStatsFd *stats)
+{
+    if (stats) {
+        close(stats->fd);
+        g_free(stats->values);
+        g_free(stats);
+    }
+}
+
+/* Exit reasons at or above this one are accounted together */
+#define KVM_EXIT_STATS_OTHER    (KVM_EXIT_XEN + 1)
+
+static const char *const kvm_exit_reason_names[KVM_EXIT_STATS_OTHER] = {
+    [KVM_EXIT_UNKNOWN] = "unknown",
+    [KVM_EXIT_EXCEPTION] = "exception",
+    [KVM_EXIT_IO] = "io",
+    [KVM_EXIT_HYPERCALL] = "hypercall",
+    [KVM_EXIT_DEBUG] = "debug",
+    [KVM_EXIT_HLT] = "hlt",
+    [KVM_EXIT_MMIO] = "mmio",
+    [KVM_EXIT_IRQ_WINDOW_OPEN] = "irq-window-open",
+    [KVM_EXIT_SHUTDOWN] = "shutdown",
+    [KVM_EXIT_FAIL_ENTRY] = "fail-entry",
+    [KVM_EXIT_INTR] = "intr",
+    [KVM_EXIT_SET_TPR] = "set-tpr",
+    [KVM_EXIT_TPR_ACCESS] = "tpr-access",
+    [KVM_EXIT_S390_SIEIC] = "s390-sieic",
+    [KVM_EXIT_S390_RESET] = "s390-reset",
+    [KVM_EXIT_DCR] = "dcr",
+    [KVM_EXIT_NMI] = "nmi",
+    [KVM_EXIT_INTERNAL_ERROR] = "internal-error",
+    [KVM_EXIT_OSI] = "osi",
+    [KVM_EXIT_PAPR_HCALL] = "papr-hcall",
+    [KVM_EXIT_S390_UCONTROL] = "s390-ucontrol",
+    [KVM_EXIT_WATCHDOG] = "watchdog",
+    [KVM_EXIT_S390_TSCH] = "s390-tsch",
+    [KVM_EXIT_EPR] = "epr",
+    [KVM_EXIT_SYSTEM_EVENT] = "system-event",
+    [KVM_EXIT_S390_STSI] = "s390-stsi",
+    [KVM_EXIT_IOAPIC_EOI] = "ioapic-eoi",
+    [KVM_EXIT_HYPERV] = "hyperv",
+    [KVM_EXIT_ARM_NISV] = "arm-nisv",
+    [KVM_EXIT_X86_RDMSR] = "x86-rdmsr",
+    [KVM_EXIT_X86_WRMSR] = "x86-wrmsr",
+    [KVM_EXIT_DIRTY_RING_FULL] = "dirty-ring-full",
+    [KVM_EXIT_AP_RESET_HOLD] = "ap-reset-hold",
+    [KVM_EXIT_X86_BUS_LOCK] = "x86-bus-lock",
+    [KVM_EXIT_XEN] = "xen",
+};
+
+/*
+ * Userspace accounting of the exits of one vCPU.  Each histogram samples
+ * the time from the return of KVM_RUN until the exit has been handled,
+ * i.e. the time the vCPU spent in QEMU instead of running the guest.
+ * Only the vCPU thread updates them; the histogram of a reason is
+ * registered the first time that reason is seen, so that query-stats
+ * does not list dozens of empty histograms per vCPU.
+ */
+typedef struct KVMExitStats {
+    char *instance;
+    StatsHistogram exits[KVM_EXIT_STATS_OTHER + 1];
+    bool registered[KVM_EXIT_STATS_OTHER + 1];
+    StatsHistogram bql_wait;
+    Stat64 signals;
+    KVMStatsFd *kernel;
+} KVMExitStats;
+
+static void kvm_exit_stats_init(CPUState *cpu)
+{
+    KVMExitStats *stats = g_new0(KVMExitStats, 1);
+    int i;
+
+    stats->instance = g_strdup_printf("%d", cpu->cpu_index);
+    for (i = 0; i <= KVM_EXIT_STATS_OTHER; i++) {
+        stats_histogram_reset(&stats->exits[i]);
+    }
+    stats_histogram_reset(&stats->bql_wait);
+    stats_register_histogram("kvm-vcpu", stats->instance, "bql-wait",
+                             &stats->bql_wait);
+    stats_register_counter("kvm-vcpu", stats->instance, "signals",
+                           &stats->signals);
+
+    if (kvm_vm_check_extension(kvm_state, KVM_CAP_BINARY_STATS_FD)) {
+        stats->kernel =
+            kvm_stats_fd_register(kvm_vcpu_ioctl(cpu, KVM_GET_STATS_FD, NULL),
+                                  "kvm-vcpu", stats->instance);
+    }
+    cpu->kvm_exit_stats = stats;
+}
+
+static void kvm_exit_stats_destroy(CPUState *cpu)
+{
+    KVMExitStats *stats = cpu->kvm_exit_stats;
+
+    if (!stats) {
+        return;
+    }
+    stats_unregister("kvm-vcpu", stats->instance);
+    kvm_stats_fd_free(stats->kernel);
+    g_free(stats->instance);
+    g_free(stats);
+    cpu->kvm_exit_stats = NULL;
+}
+
+static void kvm_exit_stats_record(CPUState *cpu, uint32_t reason, int64_t ns)
+{
+    KVMExitStats *stats = cpu->kvm_exit_stats;
+    unsigned int i = MIN(reason, KVM_EXIT_STATS_OTHER);
+
+    if (unlikely(!stats->registered[i])) {
+        g_autofree char *name = NULL;
+
+        if (i == KVM_EXIT_STATS_OTHER) {
+            name = g_strdup("exit-other");
+        } else if (kvm_exit_reason_names[i]) {
+            name = g_strdup_printf("exit-%s", kvm_exit_reason_names[i]);
+        } else {
+            name = g_strdup_printf("exit-%u", i);
+        }
+        stats_register_histogram("kvm-vcpu", stats->instance, name,
+                                 &stats->exits[i]);
+        stats->registered[i] = true;
+    }
+    stats_histogram_add(&stats->exits[i], MAX(ns, 0));
+}
+
 static int do_kvm_destroy_vcpu(CPUState *cpu)
 {
     KVMState *s = kvm_state;
@@ -393,6 +600,8 @@ static int do_kvm_destroy_vcpu(CPUState *cpu)
 
     DPRINTF("kvm_destroy_vcpu\n");
 
+    kvm_exit_stats_destroy(cpu);
+
     ret = kvm_arch_destroy_vcpu(cpu);
     if (ret < 0) {
         goto err;
@@ -511,7 +720,10 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
         error_setg_errno(errp, -ret,
                          "kvm_init_vcpu: kvm_arch_init_vcpu failed (%lu)",
                          kvm_arch_vcpu_id(cpu));
+        goto err;
     }
+
+    kvm_exit_stats_init(cpu);
 err:
     return ret;
 }
@@ -743,22 +955,29 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
         count++;
     }
     cpu->kvm_fetch_index = fetch;
+    cpu->dirty_pages += count;
 
     return count;
 }
 
-/* Must be with slots_lock held */
-static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
+/*
+ * Must be with slots_lock held.  If @cpu is NULL, the rings of all vcpus
+ * are collected, otherwise only the one of @cpu.
+ */
+static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState *cpu)
 {
     int ret;
-    CPUState *cpu;
     uint64_t total = 0;
     int64_t stamp;
 
     stamp = get_clock();
 
-    CPU_FOREACH(cpu) {
-        total += kvm_dirty_ring_reap_one(s, cpu);
+    if (cpu) {
+        total = kvm_dirty_ring_reap_one(s, cpu);
+    } else {
+        CPU_FOREACH(cpu) {
+            total += kvm_dirty_ring_reap_one(s, cpu);
+        }
     }
 
     if (total) {
@@ -776,10 +995,13 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
 }
 
 /*
- * Currently for simplicity, we must hold BQL before calling this.  We can
- * consider to drop the BQL if we're clear with all the race conditions.
+ * Currently for simplicity, we must hold BQL before calling this with a
+ * NULL @cpu, because the vcpu list is walked.  Reaping the ring of a
+ * single vcpu only needs the slots lock: it is the only thing that the
+ * ring harvesting state and the KVM_RESET_DIRTY_RINGS ioctl are
+ * serialized by.
  */
-static uint64_t kvm_dirty_ring_reap(KVMState *s)
+static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
     uint64_t total;
 
@@ -799,7 +1021,7 @@ static uint64_t kvm_dirty_ring_reap(KVMState *s)
      *     reset below.
      */
     kvm_slots_lock();
-    total = kvm_dirty_ring_reap_locked(s);
+    total = kvm_dirty_ring_reap_locked(s, cpu);
     kvm_slots_unlock();
 
     return total;
@@ -846,7 +1068,7 @@ static void kvm_dirty_ring_flush(void)
      * vcpus out in a synchronous way.
      */
     kvm_cpu_synchronize_kick_all();
-    kvm_dirty_ring_reap(kvm_state);
+    kvm_dirty_ring_reap(kvm_state, NULL);
     trace_kvm_dirty_ring_flush(1);
 }
 
@@ -1332,6 +1554,10 @@ void kvm_set_max_memslot_size(hwaddr max_slot_size)
     kvm_max_slot_size = max_slot_size;
 }
 
+/*
+ * Must be with slots_lock held.  When a slot with dirty logging is
+ * removed, the dirty rings must have been collected by the caller.
+ */
 static void kvm_set_phys_mem(KVMMemoryListener *kml,
                              MemoryRegionSection *section, bool add)
 {
@@ -1366,14 +1592,12 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     ram = memory_region_get_ram_ptr(mr) + mr_offset;
     ram_start_offset = memory_region_get_ram_addr(mr) + mr_offset;
 
-    kvm_slots_lock();
-
     if (!add) {
         do {
             slot_size = MIN(kvm_max_slot_size, size);
             mem = kvm_lookup_matching_slot(kml, start_addr, slot_size);
             if (!mem) {
-                goto out;
+                return;
             }
             if (mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
                 /*
@@ -1389,9 +1613,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                  *
                  * Not easy.  Let's cross the fingers until it's fixed.
                  */
-                if (kvm_state->kvm_dirty_ring_size) {
-                    kvm_dirty_ring_reap_locked(kvm_state);
-                } else {
+                if (!kvm_state->kvm_dirty_ring_size) {
                     kvm_slot_get_dirty_log(kvm_state, mem);
                 }
                 kvm_slot_sync_dirty_pages(mem);
@@ -1411,7 +1633,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
             start_addr += slot_size;
             size -= slot_size;
         } while (size);
-        goto out;
+        return;
     }
 
     /* register the new slot */
@@ -1436,9 +1658,6 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
         ram += slot_size;
         size -= slot_size;
     } while (size);
-
-out:
-    kvm_slots_unlock();
 }
 
 static void *kvm_dirty_ring_reaper_thread(void *data)
@@ -1462,7 +1681,7 @@ static void *kvm_dirty_ring_reaper_thread(void *data)
         r->reaper_state = KVM_DIRTY_RING_REAPER_REAPING;
 
         qemu_mutex_lock_iothread();
-        kvm_dirty_ring_reap(s);
+        kvm_dirty_ring_reap(s, NULL);
         qemu_mutex_unlock_iothread();
 
         r->reaper_iteration++;
@@ -1490,18 +1709,122 @@ static void kvm_region_add(MemoryListener *listener,
                            MemoryRegionSection *section)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *update = g_new0(KVMMemoryUpdate, 1);
 
-    memory_region_ref(section->mr);
-    kvm_set_phys_mem(kml, section, true);
+    update->section = memory_region_section_new_copy(section);
+    QSIMPLEQ_INSERT_TAIL(&kml->transaction_add, update, next);
 }
 
 static void kvm_region_del(MemoryListener *listener,
                            MemoryRegionSection *section)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *update = g_new0(KVMMemoryUpdate, 1);
+
+    update->section = memory_region_section_new_copy(section);
+    QSIMPLEQ_INSERT_TAIL(&kml->transaction_del, update, next);
+}
+
+static void kvm_memory_update_free(KVMMemoryUpdate *update)
+{
+    memory_region_section_free_copy(update->section);
+    g_free(update);
+}
+
+/*
+ * Like MemoryRegionSection_eq(), but ignoring the FlatView: the sections
+ * removed and added by a transaction always belong to different views.
+ * Only RAM is considered, because whether a ROM device is mapped does
+ * not show in the section.
+ */
+static bool kvm_section_unchanged(MemoryRegionSection *a,
+                                  MemoryRegionSection *b)
+{
+    return a->mr == b->mr &&
+           memory_region_is_ram(a->mr) &&
+           a->offset_within_region == b->offset_within_region &&
+           a->offset_within_address_space == b->offset_within_address_space &&
+           int128_eq(a->size, b->size) &&
+           a->readonly == b->readonly &&
+           a->nonvolatile == b->nonvolatile;
+}
+
+/*
+ * Drop the updates that remove a section and add it back unchanged in
+ * the same transaction, since they would only cost two ioctls and an
+ * MMU invalidation for nothing.  Returns the number of dropped pairs.
+ */
+static unsigned kvm_region_coalesce(KVMMemoryListener *kml)
+{
+    KVMMemoryUpdate *del, *del_next, *add, *add_next;
+    unsigned coalesced = 0;
+
+    QSIMPLEQ_FOREACH_SAFE(del, &kml->transaction_del, next, del_next) {
+        QSIMPLEQ_FOREACH_SAFE(add, &kml->transaction_add, next, add_next) {
+            if (kvm_section_unchanged(del->section, add->section)) {
+                QSIMPLEQ_REMOVE(&kml->transaction_del, del,
+                                KVMMemoryUpdate, next);
+                QSIMPLEQ_REMOVE(&kml->transaction_add, add,
+                                KVMMemoryUpdate, next);
+                kvm_memory_update_free(del);
+                kvm_memory_update_free(add);
+                coalesced++;
+                break;
+            }
+        }
+    }
+
+    return coalesced;
+}
+
+/*
+ * Apply all the slot changes of the transaction at once, with the slots
+ * lock taken only once.  Removals come first, so that slots are freed
+ * before the new ones are allocated.
+ */
+static void kvm_region_commit(MemoryListener *listener)
+{
+    KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *update;
+    unsigned nr_del = 0, nr_add = 0, coalesced;
+
+    if (QSIMPLEQ_EMPTY(&kml->transaction_add) &&
+        QSIMPLEQ_EMPTY(&kml->transaction_del)) {
+        return;
+    }
+
+    coalesced = kvm_region_coalesce(kml);
+
+    kvm_slots_lock();
+
+    /*
+     * Collect the dirty rings once for the whole batch, rather than
+     * once for every removed slot that has dirty logging enabled.
+     */
+    if (kvm_state->kvm_dirty_ring_size &&
+        !QSIMPLEQ_EMPTY(&kml->transaction_del)) {
+        kvm_dirty_ring_reap_locked(kvm_state, NULL);
+    }
+
+    while ((update = QSIMPLEQ_FIRST(&kml->transaction_del))) {
+        QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+        kvm_set_phys_mem(kml, update->section, false);
+        memory_region_unref(update->section->mr);
+        kvm_memory_update_free(update);
+        nr_del++;
+    }
+
+    while ((update = QSIMPLEQ_FIRST(&kml->transaction_add))) {
+        QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+        memory_region_ref(update->section->mr);
+        kvm_set_phys_mem(kml, update->section, true);
+        kvm_memory_update_free(update);
+        nr_add++;
+    }
+
+    kvm_slots_unlock();
 
-    kvm_set_phys_mem(kml, section, false);
-    memory_region_unref(section->mr);
+    trace_kvm_region_commit(kml->as_id, nr_del, nr_add, coalesced);
 }
 
 static void kvm_log_sync(MemoryListener *listener,
@@ -1645,8 +1968,12 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
         kml->slots[i].slot = i;
     }
 
+    QSIMPLEQ_INIT(&kml->transaction_add);
+    QSIMPLEQ_INIT(&kml->transaction_del);
+
     kml->listener.region_add = kvm_region_add;
     kml->listener.region_del = kvm_region_del;
+    kml->listener.commit = kvm_region_commit;
     kml->listener.log_start = kvm_log_start;
     kml->listener.log_stop = kvm_log_stop;
     kml->listener.priority = 10;
@@ -2605,6 +2932,12 @@ static int kvm_init(MachineState *ms)
         }
     }
 
+    if (kvm_vm_check_extension(s, KVM_CAP_BINARY_STATS_FD)) {
+        s->stats_fd =
+            kvm_stats_fd_register(kvm_vm_ioctl(s, KVM_GET_STATS_FD, NULL),
+                                  "kvm", NULL);
+    }
+
     return 0;
 
 err:
@@ -2808,6 +3141,8 @@ int kvm_cpu_exec(CPUState *cpu)
 {
     struct kvm_run *run = cpu->kvm_run;
     int ret, run_ret;
+    int64_t exit_start, bql_start;
+    uint32_t exit_reason;
 
     DPRINTF("kvm_cpu_exec()\n");
 
@@ -2844,6 +3179,7 @@ int kvm_cpu_exec(CPUState *cpu)
         smp_rmb();
 
         run_ret = kvm_vcpu_ioctl(cpu, KVM_RUN, 0);
+        exit_start = get_clock();
 
         attrs = kvm_arch_post_run(cpu, run);
 
@@ -2860,6 +3196,7 @@ int kvm_cpu_exec(CPUState *cpu)
         if (run_ret < 0) {
             if (run_ret == -EINTR || run_ret == -EAGAIN) {
                 DPRINTF("io window exit\n");
+                stat64_add(&cpu->kvm_exit_stats->signals, 1);
                 kvm_eat_signals(cpu);
                 ret = EXCP_INTERRUPT;
                 break;
@@ -2878,8 +3215,9 @@ int kvm_cpu_exec(CPUState *cpu)
             break;
         }
 
-        trace_kvm_run_exit(cpu->cpu_index, run->exit_reason);
-        switch (run->exit_reason) {
+        exit_reason = run->exit_reason;
+        trace_kvm_run_exit(cpu->cpu_index, exit_reason);
+        switch (exit_reason) {
         case KVM_EXIT_IO:
             DPRINTF("handle_io\n");
             /* Called outside BQL */
@@ -2923,9 +3261,13 @@ int kvm_cpu_exec(CPUState *cpu)
              * still full.  Got kicked by KVM_RESET_DIRTY_RINGS.
              */
             trace_kvm_dirty_ring_full(cpu->cpu_index);
-            qemu_mutex_lock_iothread();
-            kvm_dirty_ring_reap(kvm_state);
-            qemu_mutex_unlock_iothread();
+            /*
+             * Only this ring is full, so there is no need to take the BQL
+             * and collect the rings of all the other vcpus, which would
+             * serialize every vcpu hitting a full ring on the BQL.  The
+             * reaper thread keeps collecting the other rings as usual.
+             */
+            kvm_dirty_ring_reap(kvm_state, cpu);
             ret = 0;
             break;
         case KVM_EXIT_SYSTEM_EVENT:
@@ -2956,10 +3298,14 @@ int kvm_cpu_exec(CPUState *cpu)
             ret = kvm_arch_handle_exit(cpu, run);
             break;
         }
+        kvm_exit_stats_record(cpu, exit_reason, get_clock() - exit_start);
     } while (ret == 0);
 
     cpu_exec_end(cpu);
+    bql_start = get_clock();
     qemu_mutex_lock_iothread();
+    stats_histogram_add(&cpu->kvm_exit_stats->bql_wait,
+                        MAX(get_clock() - bql_start, 0));
 
     if (ret < 0) {
         cpu_dump_state(cpu, stderr, CPU_DUMP_CODE);
@@ -3098,6 +3444,11 @@ bool kvm_has_sync_mmu(void)
     return kvm_state->sync_mmu;
 }
 
+bool kvm_dirty_ring_enabled(void)
+{
+    return kvm_state->kvm_dirty_ring_size != 0;
+}
+
 int kvm_has_vcpu_events(void)
 {
     return kvm_state->vcpu_events;
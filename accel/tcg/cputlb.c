@@ -103,7 +103,7 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
     unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
 
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+        qatomic_set(&cpu->tb_jmp_cache[i0 + i].tb, NULL);
     }
 }
 
@@ -232,9 +232,16 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
+    int i;
+
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        desc->large_pages[i].vaddr = -1;
+        desc->large_pages[i].mask = 0;
+    }
+    desc->large_page_index = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -272,6 +279,18 @@ static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
     env_tlb(env)->d[mmu_idx].n_used_entries--;
 }
 
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} TLBFlushRangeData;
+
+typedef struct TLBPendingFlush {
+    TLBFlushRangeData d;
+    QSLIST_ENTRY(TLBPendingFlush) next;
+} TLBPendingFlush;
+
 void tlb_init(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -282,6 +301,9 @@ void tlb_init(CPUState *cpu)
 
     /* All tlbs are initialized flushed. */
     env_tlb(env)->c.dirty = 0;
+    env_tlb(env)->c.pending_full = 0;
+    env_tlb(env)->c.pending_queued = false;
+    QSLIST_INIT(&env_tlb(env)->c.pending_ranges);
 
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&env_tlb(env)->d[i], &env_tlb(env)->f[i], now);
@@ -291,8 +313,12 @@ void tlb_init(CPUState *cpu)
 void tlb_destroy(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
+    TLBPendingFlush *p, *p_next;
     int i;
 
+    QSLIST_FOREACH_SAFE(p, &env_tlb(env)->c.pending_ranges, next, p_next) {
+        g_free(p);
+    }
     qemu_spin_destroy(&env_tlb(env)->c.lock);
     for (i = 0; i < NB_MMU_MODES; i++) {
         CPUTLBDesc *desc = &env_tlb(env)->d[i];
@@ -303,25 +329,65 @@ void tlb_destroy(CPUState *cpu)
     }
 }
 
-/* flush_all_helper: run fn across all cpus
- *
- * If the wait flag is set then the src cpu's helper will be queued as
- * "safe" work and the loop exited creating a synchronisation point
- * where all queued work will be finished before execution starts
- * again.
+/*
+ * Past this number of queued page and range flushes, the vCPU flushes
+ * the whole TLB of the affected mmu_idx instead.
  */
-static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
-                             run_on_cpu_data d)
+#define TLB_PENDING_FLUSH_MAX 64
+
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data);
+
+static void tlb_schedule_pending(CPUState *cpu)
 {
-    CPUState *cpu;
+    CPUArchState *env = cpu->env_ptr;
 
-    CPU_FOREACH(cpu) {
-        if (cpu != src) {
-            async_run_on_cpu(cpu, fn, d);
-        }
+    if (!qatomic_xchg(&env_tlb(env)->c.pending_queued, true)) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
     }
 }
 
+/*
+ * tlb_queue_flush_full: ask @cpu to flush the mmu_idx in @idxmap
+ *
+ * Requests from several threads are merged until @cpu processes them.
+ */
+static void tlb_queue_flush_full(CPUState *cpu, uint16_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+
+    qatomic_or(&env_tlb(env)->c.pending_full, idxmap);
+    tlb_schedule_pending(cpu);
+}
+
+/*
+ * tlb_queue_flush_range: ask @cpu to flush the pages in @d
+ *
+ * The requests are added to a lock-free list, which @cpu processes
+ * under a single acquisition of its tlb_c.lock.
+ */
+static void tlb_queue_flush_range(CPUState *cpu, const TLBFlushRangeData *d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    TLBPendingFlush *p = g_new(TLBPendingFlush, 1);
+
+    p->d = *d;
+    QSLIST_INSERT_HEAD_ATOMIC(&env_tlb(env)->c.pending_ranges, p, next);
+    tlb_schedule_pending(cpu);
+}
+
+static void tlb_queue_flush_page(CPUState *cpu, target_ulong addr,
+                                 uint16_t idxmap)
+{
+    TLBFlushRangeData d = {
+        .addr = addr,
+        .len = TARGET_PAGE_SIZE,
+        .idxmap = idxmap,
+        .bits = TARGET_LONG_BITS,
+    };
+
+    tlb_queue_flush_range(cpu, &d);
+}
+
 void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
 {
     CPUState *cpu;
@@ -385,8 +451,7 @@ void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap)
     tlb_debug("mmu_idx: 0x%" PRIx16 "\n", idxmap);
 
     if (cpu->created && !qemu_cpu_is_self(cpu)) {
-        async_run_on_cpu(cpu, tlb_flush_by_mmuidx_async_work,
-                         RUN_ON_CPU_HOST_INT(idxmap));
+        tlb_queue_flush_full(cpu, idxmap);
     } else {
         tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(idxmap));
     }
@@ -399,12 +464,16 @@ void tlb_flush(CPUState *cpu)
 
 void tlb_flush_by_mmuidx_all_cpus(CPUState *src_cpu, uint16_t idxmap)
 {
-    const run_on_cpu_func fn = tlb_flush_by_mmuidx_async_work;
+    CPUState *dst_cpu;
 
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
-    fn(src_cpu, RUN_ON_CPU_HOST_INT(idxmap));
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush_full(dst_cpu, idxmap);
+        }
+    }
+    tlb_flush_by_mmuidx_async_work(src_cpu, RUN_ON_CPU_HOST_INT(idxmap));
 }
 
 void tlb_flush_all_cpus(CPUState *src_cpu)
@@ -414,12 +483,17 @@ void tlb_flush_all_cpus(CPUState *src_cpu)
 
 void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, uint16_t idxmap)
 {
-    const run_on_cpu_func fn = tlb_flush_by_mmuidx_async_work;
+    CPUState *dst_cpu;
 
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
-    async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush_full(dst_cpu, idxmap);
+        }
+    }
+    async_safe_run_on_cpu(src_cpu, tlb_flush_by_mmuidx_async_work,
+                          RUN_ON_CPU_HOST_INT(idxmap));
 }
 
 void tlb_flush_all_cpus_synced(CPUState *src_cpu)
@@ -597,22 +671,8 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_queue_flush_page(cpu, addr, idxmap);
     }
 }
 
@@ -624,32 +684,16 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
                                        uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush_page(dst_cpu, addr, idxmap);
         }
     }
 
@@ -665,36 +709,31 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               target_ulong addr,
                                               uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush_page(dst_cpu, addr, idxmap);
+        }
+    }
+
     /*
      * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Most targets have only a few mmu_idx.  In the case where
+     * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
+     * allocating memory for this operation.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -757,13 +796,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 }
 
-typedef struct {
-    target_ulong addr;
-    target_ulong len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -796,6 +828,79 @@ static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
     g_free(d);
 }
 
+/**
+ * tlb_flush_pending_async_work:
+ * @cpu: cpu on which to flush
+ *
+ * Perform the flushes queued for @cpu by tlb_queue_flush_full() and
+ * tlb_queue_flush_range().  Page and range flushes are done with a
+ * single acquisition of tlb_c.lock and skipped for the mmu_idx that
+ * are flushed entirely.  Too many of them turn into a full flush.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBCommon *c = &env_tlb(env)->c;
+    QSLIST_HEAD(, TLBPendingFlush) list;
+    TLBPendingFlush *p, *p_next;
+    unsigned int count = 0;
+    uint16_t full;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    /* Requests queued from now on schedule another work item */
+    qatomic_xchg(&c->pending_queued, false);
+    full = qatomic_xchg(&c->pending_full, 0);
+    QSLIST_MOVE_ATOMIC(&list, &c->pending_ranges);
+
+    QSLIST_FOREACH(p, &list, next) {
+        count++;
+    }
+    if (count > TLB_PENDING_FLUSH_MAX) {
+        QSLIST_FOREACH(p, &list, next) {
+            full |= p->d.idxmap;
+        }
+    }
+
+    tlb_debug("pending: %u mmu_map:0x%x\n", count, full);
+
+    if (count) {
+        qemu_spin_lock(&c->lock);
+        QSLIST_FOREACH(p, &list, next) {
+            uint16_t idxmap = p->d.idxmap & ~full;
+
+            for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+                if (!((idxmap >> mmu_idx) & 1)) {
+                    continue;
+                }
+                if (p->d.bits >= TARGET_LONG_BITS &&
+                    p->d.len <= TARGET_PAGE_SIZE) {
+                    tlb_flush_page_locked(env, mmu_idx, p->d.addr);
+                } else {
+                    tlb_flush_range_locked(env, mmu_idx, p->d.addr,
+                                           p->d.len, p->d.bits);
+                }
+            }
+        }
+        qemu_spin_unlock(&c->lock);
+    }
+
+    QSLIST_FOREACH_SAFE(p, &list, next, p_next) {
+        /* A full flush clears the whole jump cache below */
+        if (!full) {
+            for (target_ulong i = 0; i < p->d.len; i += TARGET_PAGE_SIZE) {
+                tb_flush_jmp_cache(cpu, p->d.addr + i);
+            }
+        }
+        g_free(p);
+    }
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+}
+
 void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
                                target_ulong len, uint16_t idxmap,
                                unsigned bits)
@@ -825,10 +930,7 @@ void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_range_by_mmuidx_async_0(cpu, d);
     } else {
-        /* Otherwise allocate a structure, freed by the worker.  */
-        TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
-                         RUN_ON_CPU_HOST_PTR(p));
+        tlb_queue_flush_range(cpu, &d);
     }
 }
 
@@ -865,13 +967,9 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
         if (dst_cpu != src_cpu) {
-            TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu,
-                             tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
+            tlb_queue_flush_range(dst_cpu, &d);
         }
     }
 
@@ -915,12 +1013,9 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
         if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
+            tlb_queue_flush_range(dst_cpu, &d);
         }
     }
 
@@ -1086,6 +1181,42 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/*
+ * Remember the large page of tlb_fill for tlb_fill_large_page().  It is
+ * forgotten when @mmu_idx is flushed; flushing any page of the region
+ * recorded by tlb_add_large_page() flushes the whole mmu_idx.
+ */
+static void tlb_record_large_page(CPUArchState *env, int mmu_idx,
+                                  target_ulong vaddr, hwaddr paddr,
+                                  MemTxAttrs attrs, int prot,
+                                  target_ulong size)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong mask = ~(size - 1);
+    CPUTLBLargePage *lp = NULL;
+    int i;
+
+    vaddr &= mask;
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        if (desc->large_pages[i].vaddr == vaddr &&
+            desc->large_pages[i].mask == mask) {
+            lp = &desc->large_pages[i];
+            break;
+        }
+    }
+    if (!lp) {
+        lp = &desc->large_pages[desc->large_page_index];
+        desc->large_page_index =
+            (desc->large_page_index + 1) % CPU_TLB_LARGE_PAGES;
+    }
+
+    lp->vaddr = vaddr;
+    lp->mask = mask;
+    lp->paddr = paddr & ~(hwaddr)(size - 1);
+    lp->attrs = attrs;
+    lp->prot = prot;
+}
+
 /* Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
  * supplied size is only used by tlb_flush_page.
@@ -1118,6 +1249,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
         sz = TARGET_PAGE_SIZE;
     } else {
         tlb_add_large_page(env, mmu_idx, vaddr, size);
+        tlb_record_large_page(env, mmu_idx, vaddr, paddr, attrs, prot, size);
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -1286,6 +1418,55 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
     return ram_addr;
 }
 
+/*
+ * tlb_fill_large_page: fill the TLB for @addr from a known large page
+ *
+ * Returns true if @addr is within a large page that the target's tlb_fill
+ * returned earlier with a protection allowing @access_type.  The entry
+ * for the TARGET_PAGE_SIZE page containing @addr has then been filled
+ * without walking the guest page tables again.
+ */
+static bool tlb_fill_large_page(CPUState *cpu, target_ulong addr,
+                                MMUAccessType access_type, int mmu_idx)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    int need;
+    int i;
+
+    if (desc->large_page_addr == (target_ulong)-1 ||
+        (addr & desc->large_page_mask) != desc->large_page_addr) {
+        return false;
+    }
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        need = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        need = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        need = PAGE_EXEC;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &desc->large_pages[i];
+
+        if ((addr & lp->mask) == lp->vaddr && (lp->prot & need)) {
+            tlb_set_page_with_attrs(cpu, page, lp->paddr + (page - lp->vaddr),
+                                    lp->attrs, lp->prot, mmu_idx,
+                                    TARGET_PAGE_SIZE);
+            return true;
+        }
+    }
+    return false;
+}
+
 /*
  * Note: tlb_fill() can trigger a resize of the TLB. This means that all of the
  * caller's prior references to the TLB table (e.g. CPUTLBEntry pointers) must
@@ -1297,6 +1478,10 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    if (tlb_fill_large_page(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1599,7 +1784,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
+            if (!tlb_fill_large_page(cs, addr, access_type, mmu_idx) &&
+                !cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
                                        mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
@@ -1748,9 +1934,9 @@ bool tlb_plugin_lookup(CPUState *cpu, target_ulong addr, int mmu_idx,
  *
  * @prot may be PAGE_READ, PAGE_WRITE, or PAGE_READ|PAGE_WRITE.
  */
-static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
-                               MemOpIdx oi, int size, int prot,
-                               uintptr_t retaddr)
+static void * __attribute__((noinline))
+atomic_mmu_lookup_slow(CPUArchState *env, target_ulong addr,
+                       MemOpIdx oi, int size, int prot, uintptr_t retaddr)
 {
     size_t mmu_idx = get_mmuidx(oi);
     MemOp mop = get_memop(oi);
@@ -1840,6 +2026,38 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     cpu_loop_exit_atomic(env_cpu(env), retaddr);
 }
 
+/*
+ * The common case for guest atomics under MTTCG is an aligned access
+ * to ordinary RAM that is already present in the TLB with all of the
+ * required permissions.  Handle exactly that case inline in each of the
+ * atomic helpers: an exact compare of the comparators against the page
+ * rejects invalid, MMIO, notdirty and watchpoint entries alike, and
+ * everything else is left to atomic_mmu_lookup_slow.
+ */
+static inline void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
+                                      MemOpIdx oi, int size, int prot,
+                                      uintptr_t retaddr)
+{
+    unsigned a_bits = get_alignment_bits(get_memop(oi));
+    target_ulong a_mask = (size - 1) | ((1u << a_bits) - 1);
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    CPUTLBEntry *tlbe = tlb_entry(env, get_mmuidx(oi), addr);
+    bool hit;
+
+    if (likely((addr & a_mask) == 0)) {
+        if (prot & PAGE_WRITE) {
+            hit = tlb_addr_write(tlbe) == page
+                  && (!(prot & PAGE_READ) || tlbe->addr_read == page);
+        } else {
+            hit = tlbe->addr_read == page;
+        }
+        if (likely(hit)) {
+            return (void *)((uintptr_t)addr + tlbe->addend);
+        }
+    }
+    return atomic_mmu_lookup_slow(env, addr, oi, size, prot, retaddr);
+}
+
 /*
  * Verify that we have passed the correct MemOp to the correct function.
  *
@@ -1894,6 +2112,37 @@ load_memop(const void *haddr, MemOp op)
     }
 }
 
+/*
+ * Loads that span two pages, or are misaligned on a page that needs
+ * special handling, are split into two aligned loads of the same size.
+ * This is rare enough that keeping it out of line, rather than expanding
+ * it into every specialization of load_helper, is the better trade.
+ */
+static uint64_t __attribute__((noinline))
+load_helper_unaligned(CPUArchState *env, target_ulong addr, MemOpIdx oi,
+                      uintptr_t retaddr, size_t size, bool big_endian,
+                      FullLoadHelper *full_load)
+{
+    target_ulong addr1, addr2;
+    uint64_t r1, r2, res;
+    unsigned shift;
+
+    addr1 = addr & ~((target_ulong)size - 1);
+    addr2 = addr1 + size;
+    r1 = full_load(env, addr1, oi, retaddr);
+    r2 = full_load(env, addr2, oi, retaddr);
+    shift = (addr & (size - 1)) * 8;
+
+    if (big_endian) {
+        /* Big-endian combine.  */
+        res = (r1 << shift) | (r2 >> ((size * 8) - shift));
+    } else {
+        /* Little-endian combine.  */
+        res = (r1 >> shift) | (r2 << ((size * 8) - shift));
+    }
+    return res & MAKE_64BIT_MASK(0, size * 8);
+}
+
 static inline uint64_t QEMU_ALWAYS_INLINE
 load_helper(CPUArchState *env, target_ulong addr, MemOpIdx oi,
             uintptr_t retaddr, MemOp op, bool code_read,
@@ -1909,7 +2158,6 @@ load_helper(CPUArchState *env, target_ulong addr, MemOpIdx oi,
         code_read ? MMU_INST_FETCH : MMU_DATA_LOAD;
     unsigned a_bits = get_alignment_bits(get_memop(oi));
     void *haddr;
-    uint64_t res;
     size_t size = memop_size(op);
 
     /* Handle CPU specific unaligned behaviour */
@@ -1975,24 +2223,9 @@ load_helper(CPUArchState *env, target_ulong addr, MemOpIdx oi,
     if (size > 1
         && unlikely((addr & ~TARGET_PAGE_MASK) + size - 1
                     >= TARGET_PAGE_SIZE)) {
-        target_ulong addr1, addr2;
-        uint64_t r1, r2;
-        unsigned shift;
     do_unaligned_access:
-        addr1 = addr & ~((target_ulong)size - 1);
-        addr2 = addr1 + size;
-        r1 = full_load(env, addr1, oi, retaddr);
-        r2 = full_load(env, addr2, oi, retaddr);
-        shift = (addr & (size - 1)) * 8;
-
-        if (memop_big_endian(op)) {
-            /* Big-endian combine.  */
-            res = (r1 << shift) | (r2 >> ((size * 8) - shift));
-        } else {
-            /* Little-endian combine.  */
-            res = (r1 >> shift) | (r2 << ((size * 8) - shift));
-        }
-        return res & MAKE_64BIT_MASK(0, size * 8);
+        return load_helper_unaligned(env, addr, oi, retaddr, size,
+                                     memop_big_endian(op), full_load);
     }
 
     haddr = (void *)((uintptr_t)addr + entry->addend);
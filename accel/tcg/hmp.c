@@ -2,6 +2,7 @@
 #include "qemu/error-report.h"
 #include "exec/exec-all.h"
 #include "monitor/monitor.h"
+#include "qapi/qmp/qdict.h"
 #include "sysemu/tcg.h"
 
 static void hmp_info_jit(Monitor *mon, const QDict *qdict)
@@ -15,6 +16,18 @@ static void hmp_info_jit(Monitor *mon, const QDict *qdict)
     dump_drift_info();
 }
 
+static void hmp_info_tb_hot(Monitor *mon, const QDict *qdict)
+{
+    int count = qdict_get_try_int(qdict, "count", 20);
+
+    if (!tcg_enabled()) {
+        error_report("JIT information is only available with accel=tcg");
+        return;
+    }
+
+    dump_tb_hot_info(count);
+}
+
 static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info();
@@ -23,6 +36,7 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp("jit", true, hmp_info_jit);
+    monitor_register_hmp("tb-hot", true, hmp_info_tb_hot);
     monitor_register_hmp("opcount", true, hmp_info_opcount);
 }
 
@@ -0,0 +1,53 @@
+/*
+ * Linux perf perf-<pid>.map integration.
+ *
+ * The map file lets "perf report" attribute samples taken in the code
+ * generation buffer to the guest code that was translated there.  See
+ * tools/perf/Documentation/jit-interface.txt in the Linux sources.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "exec/exec-all.h"
+#include "perf.h"
+
+static FILE *perfmap;
+
+static void perf_exit(void)
+{
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+}
+
+void perf_enable_perfmap(void)
+{
+    char map_file[32];
+
+    snprintf(map_file, sizeof(map_file), "/tmp/perf-%d.map", getpid());
+    perfmap = fopen(map_file, "w");
+    if (perfmap == NULL) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    map_file, strerror(errno));
+        return;
+    }
+    atexit(perf_exit);
+}
+
+void perf_report_code(const TranslationBlock *tb)
+{
+    if (!perfmap) {
+        return;
+    }
+
+    /*
+     * A single fprintf per TB: stdio takes the FILE lock, so lines from
+     * different vCPU threads are never interleaved.  Entries are not
+     * retracted when a TB is invalidated or the buffer is flushed.
+     */
+    fprintf(perfmap, "%" PRIxPTR " %zx guest-0x" TARGET_FMT_lx "\n",
+            (uintptr_t)tb->tc.ptr, tb->tc.size, tb->pc);
+}
@@ -0,0 +1,18 @@
+/*
+ * Linux perf perf-<pid>.map integration.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+#include "exec/exec-all.h"
+
+/* Start writing perf-<pid>.map.  */
+void perf_enable_perfmap(void);
+
+/* Add information about TCG-generated code to the map.  */
+void perf_report_code(const TranslationBlock *tb);
+
+#endif
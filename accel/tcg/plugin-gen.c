@@ -91,6 +91,18 @@ void HELPER(plugin_vcpu_mem_cb)(unsigned int vcpu_index,
                                 void *userdata)
 { }
 
+/*
+ * Never called either: only their helper info is used, so that callbacks
+ * registered with QEMU_PLUGIN_CB_R_REGS see the guest registers in env.
+ */
+void HELPER(plugin_vcpu_udata_cb_r)(uint32_t cpu_index, void *udata)
+{ }
+
+void HELPER(plugin_vcpu_mem_cb_r)(unsigned int vcpu_index,
+                                  qemu_plugin_meminfo_t info, uint64_t vaddr,
+                                  void *userdata)
+{ }
+
 static void do_gen_mem_cb(TCGv vaddr, uint32_t info)
 {
     TCGv_i32 cpu_index = tcg_temp_new_i32();
@@ -126,18 +138,32 @@ static void gen_empty_udata_cb(void)
 /*
  * For now we only support addi_i64.
  * When we support more ops, we can generate one empty inline cb for each.
+ *
+ * The address is ptr + cpu_index * stride, so that per-vCPU scoreboards
+ * can be updated without atomics.  Ops on a shared location skip the
+ * cpu_index computation when copied.
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
     TCGv_i64 val = tcg_temp_new_i64();
     TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
 
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* second operand will be replaced by the element size */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -272,6 +298,12 @@ static TCGOp *copy_op(TCGOp **begin_op, TCGOp *op, TCGOpcode opc)
     return op;
 }
 
+static void skip_op(TCGOp **begin_op, TCGOpcode opc)
+{
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert(*begin_op && (*begin_op)->opc == opc);
+}
+
 static TCGOp *copy_extu_i32_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -351,6 +383,33 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
 static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -411,6 +470,20 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
     return op;
 }
 
+/*
+ * The empty callbacks are generated with TCG_CALL_NO_RWG helpers, so the
+ * guest registers held in TCG globals are not synced before the call.
+ * Switch to the flags of @regs_helper if the callback reads them.
+ */
+static void set_call_regs(TCGOp *op, int cb_idx,
+                          const struct qemu_plugin_dyn_cb *cb,
+                          void *regs_helper)
+{
+    if (cb->flags != QEMU_PLUGIN_CB_NO_REGS) {
+        op->args[cb_idx + 1] = (uintptr_t)tcg_helper_info_lookup(regs_helper);
+    }
+}
+
 /*
  * When we append/replace ops here we are sensitive to changing patterns of
  * TCGOps generated by the tcg_gen_FOO calls when we generated the
@@ -434,6 +507,7 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     /* call */
     op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
                    cb->f.vcpu_udata, cb_idx);
+    set_call_regs(op, *cb_idx, cb, HELPER(plugin_vcpu_udata_cb_r));
 
     return op;
 }
@@ -442,8 +516,32 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    const qemu_plugin_u64 *entry = &cb->inline_insn.entry;
+    char *ptr = cb->userp;
+
+    if (entry->score) {
+        ptr = entry->score->data->data + entry->offset;
+    }
+
     /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_const_ptr(&begin_op, op, ptr);
+
+    if (entry->score) {
+        /* ld_i32 cpu_index, mul_i32 by the element size */
+        op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+        op = copy_mul_i32(&begin_op, op,
+                          g_array_get_element_size(entry->score->data));
+        /* ext_i32_ptr, add_ptr */
+        op = copy_ext_i32_ptr(&begin_op, op);
+        op = copy_add_ptr(&begin_op, op);
+    } else {
+        skip_op(&begin_op, INDEX_op_ld_i32);
+        skip_op(&begin_op, INDEX_op_mul_i32);
+        skip_op(&begin_op, UINTPTR_MAX == UINT32_MAX ?
+                INDEX_op_mov_i32 : INDEX_op_ext_i32_i64);
+        skip_op(&begin_op, UINTPTR_MAX == UINT32_MAX ?
+                INDEX_op_add_i32 : INDEX_op_add_i64);
+    }
 
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
@@ -485,6 +583,7 @@ static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
         /* call */
         op = copy_call(&begin_op, op, HELPER(plugin_vcpu_mem_cb),
                        cb->f.vcpu_udata, cb_idx);
+        set_call_regs(op, *cb_idx, cb, HELPER(plugin_vcpu_mem_cb_r));
     }
 
     return op;
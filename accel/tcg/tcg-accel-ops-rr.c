@@ -133,6 +133,16 @@ static void rr_deal_with_unplugged_cpus(void)
     }
 }
 
+/*
+ * A halted vCPU with nothing to wake it up.  cpu_exec only looks at
+ * interrupt_request and cpu_has_work for such a vCPU, so skipping it
+ * does not change what the guest observes, with or without icount.
+ */
+static bool rr_cpu_halted_idle(CPUState *cpu)
+{
+    return cpu->halted && !cpu->interrupt_request && !cpu_has_work(cpu);
+}
+
 /*
  * In the single-threaded case each vCPU is simulated in turn. If
  * there is more than a single vCPU we create a simple timer to kick
@@ -207,6 +217,17 @@ static void *rr_cpu_thread_fn(void *arg)
             if (cpu_can_run(cpu)) {
                 int r;
 
+                if (rr_cpu_halted_idle(cpu)) {
+                    /*
+                     * cpu_exec would return EXCP_HALTED straight away;
+                     * don't pay for the icount budget setup and the replay
+                     * lock round trip, which with many idle vCPUs is most
+                     * of the time spent in this loop.
+                     */
+                    cpu = CPU_NEXT(cpu);
+                    continue;
+                }
+
                 qemu_mutex_unlock_iothread();
                 if (icount_enabled()) {
                     icount_prepare_for_run(cpu);
@@ -37,6 +37,7 @@
 #include "hw/boards.h"
 #endif
 #include "internal.h"
+#include "perf.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -44,6 +45,8 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tb_exec_count;
+    bool perf_map;
 };
 typedef struct TCGState TCGState;
 
@@ -109,6 +112,7 @@ static void tcg_accel_instance_init(Object *obj)
 }
 
 bool mttcg_enabled;
+bool tb_exec_count_enabled;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -121,6 +125,10 @@ static int tcg_init_machine(MachineState *ms)
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_exec_count_enabled = s->tb_exec_count;
+    if (s->perf_map) {
+        perf_enable_perfmap();
+    }
 
     page_init();
     tb_htable_init();
@@ -208,6 +216,30 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_exec_count(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_exec_count;
+}
+
+static void tcg_set_tb_exec_count(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_exec_count = value;
+}
+
+static bool tcg_get_perf_map(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->perf_map;
+}
+
+static void tcg_set_perf_map(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->perf_map = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -229,6 +261,16 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "tb-exec-count",
+        tcg_get_tb_exec_count, tcg_set_tb_exec_count);
+    object_class_property_set_description(oc, "tb-exec-count",
+        "Count TB executions and report the hottest TBs in info jit");
+
+    object_class_property_add_bool(oc, "perf-map",
+        tcg_get_perf_map, tcg_set_perf_map);
+    object_class_property_set_description(oc, "perf-map",
+        "Write /tmp/perf-<pid>.map describing the translated code");
 }
 
 static const TypeInfo tcg_accel_type = {
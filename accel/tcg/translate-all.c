@@ -58,6 +58,7 @@
 #include "qapi/error.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "tb-hash.h"
+#include "perf.h"
 #include "tb-context.h"
 #include "internal.h"
 
@@ -1207,8 +1208,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* remove the TB from the hash list */
     h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        if (qatomic_read(&cpu->tb_jmp_cache[h].tb) == tb) {
+            qatomic_set(&cpu->tb_jmp_cache[h].tb, NULL);
         }
     }
 
@@ -1427,6 +1428,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1524,6 +1526,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     qatomic_set(&prof->search_out_len, prof->search_out_len + search_size);
 #endif
 
+    perf_report_code(tb);
+
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_OUT_ASM) &&
         qemu_log_in_addr_range(tb->pc)) {
@@ -2061,6 +2065,118 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+/* Number of TBs listed by "info jit" when execution counts are enabled */
+#define TB_EXEC_COUNT_TOP 10
+
+struct tb_exec_count {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint16_t size;
+    uint16_t icount;
+    size_t host_size;
+    uint64_t count;
+};
+
+static gboolean tb_exec_count_iter(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    GArray *counts = data;
+    struct tb_exec_count c = {
+        .pc = tb->pc,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+        .size = tb->size,
+        .icount = tb->icount,
+        .host_size = tb->tc.size,
+        .count = tb->exec_count,
+    };
+
+    if (c.count) {
+        g_array_append_val(counts, c);
+    }
+    return false;
+}
+
+static gint tb_exec_count_cmp(gconstpointer a, gconstpointer b)
+{
+    const struct tb_exec_count *ca = a, *cb = b;
+
+    return ca->count < cb->count ? 1 : ca->count > cb->count ? -1 : 0;
+}
+
+/*
+ * Collect the executed TBs, hottest first, and return the sum of their
+ * execution counts in @total.
+ */
+static GArray *tb_exec_counts(uint64_t *total)
+{
+    GArray *counts = g_array_new(false, false, sizeof(struct tb_exec_count));
+    guint i;
+
+    tcg_tb_foreach(tb_exec_count_iter, counts);
+    g_array_sort(counts, tb_exec_count_cmp);
+    *total = 0;
+    for (i = 0; i < counts->len; i++) {
+        *total += g_array_index(counts, struct tb_exec_count, i).count;
+    }
+    return counts;
+}
+
+static void dump_exec_count_info(void)
+{
+    uint64_t total, sum = 0;
+    GArray *counts = tb_exec_counts(&total);
+    guint i, hot;
+
+    for (hot = 0; hot < counts->len && sum < total - total / 10; hot++) {
+        sum += g_array_index(counts, struct tb_exec_count, hot).count;
+    }
+
+    qemu_printf("\nTB execution counts:\n");
+    qemu_printf("TB executions       %" PRIu64 "\n", total);
+    qemu_printf("executed TB count   %u\n", counts->len);
+    qemu_printf("TBs for 90%% of them %u\n", hot);
+    for (i = 0; i < MIN(counts->len, TB_EXEC_COUNT_TOP); i++) {
+        struct tb_exec_count *c = &g_array_index(counts,
+                                                 struct tb_exec_count, i);
+
+        qemu_printf("  pc " TARGET_FMT_lx " insns %3u count %" PRIu64
+                    " (%0.1f%%)\n", c->pc, c->icount, c->count,
+                    (double)c->count * 100 / total);
+    }
+    g_array_free(counts, true);
+}
+
+void dump_tb_hot_info(int count)
+{
+    uint64_t total;
+    GArray *counts;
+    guint i;
+
+    if (!tb_exec_count_enabled) {
+        qemu_printf("TB execution counts are not enabled, "
+                    "use -accel tcg,tb-exec-count=on\n");
+        return;
+    }
+
+    counts = tb_exec_counts(&total);
+    qemu_printf("%-18s %-18s %-10s %5s %5s %6s %20s %6s\n",
+                "pc", "cs_base", "flags", "insns", "size", "host",
+                "count", "share");
+    for (i = 0; i < MIN(counts->len, MAX(count, 0)); i++) {
+        struct tb_exec_count *c = &g_array_index(counts,
+                                                 struct tb_exec_count, i);
+
+        qemu_printf("0x%016" PRIx64 " 0x%016" PRIx64 " 0x%08x %5u %5u %6zu"
+                    " %20" PRIu64 " %5.1f%%\n",
+                    (uint64_t)c->pc, (uint64_t)c->cs_base, c->flags,
+                    c->icount, c->size, c->host_size, c->count,
+                    (double)c->count * 100 / total);
+    }
+    g_array_free(counts, true);
+}
+
 void dump_exec_info(void)
 {
     struct tb_tree_stats tst = {};
@@ -2107,6 +2223,9 @@ void dump_exec_info(void)
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+    if (tb_exec_count_enabled) {
+        dump_exec_count_info();
+    }
     tcg_dump_info();
 }
 
@@ -2253,6 +2372,7 @@ int page_get_flags(target_ulong address)
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
     target_ulong addr, len;
+    PageDesc *p = NULL;
     bool reset_target_data;
 
     /* This function should never be called with addresses outside the
@@ -2275,8 +2395,16 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
 
     for (addr = start, len = end - start;
          len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE, p++) {
+        /*
+         * The descriptors of V_L2_SIZE consecutive pages are contiguous,
+         * so only walk the radix tree when entering a new leaf; large
+         * mappings are then not dominated by the lookups, which keeps
+         * the mmap_lock hold time down.
+         */
+        if (!p || ((addr >> TARGET_PAGE_BITS) & (V_L2_SIZE - 1)) == 0) {
+            p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+        }
 
         /* If the write protection bit is set, then we invalidate
            the code inside.  */
@@ -2318,7 +2446,7 @@ void *page_alloc_target_data(target_ulong address, size_t size)
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
+    PageDesc *p = NULL;
     target_ulong end;
     target_ulong addr;
 
@@ -2343,10 +2471,13 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
 
     for (addr = start, len = end - start;
          len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
+         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE, p++) {
+        /* As in page_set_flags(), only look up the first page of a leaf */
+        if (!p || ((addr >> TARGET_PAGE_BITS) & (V_L2_SIZE - 1)) == 0) {
+            p = page_find(addr >> TARGET_PAGE_BITS);
+            if (!p) {
+                return -1;
+            }
         }
         if (!(p->flags & PAGE_VALID)) {
             return -1;
@@ -34,6 +34,8 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
     struct st_sample *istart, *iend;
     struct st_sample *ostart, *oend;
     struct st_sample ilast, icur, out;
+    uint64_t opos, opos_inc;
+    uint32_t ipos;
 #ifdef FLOAT_MIXENG
     mixeng_real t;
 #else
@@ -59,6 +61,15 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
         return;
     }
 
+    /*
+     * Work on local copies of the positions: the sample buffers may alias
+     * *rate as far as the compiler knows, which would otherwise force a
+     * reload and store of the positions around every output sample.
+     */
+    opos = rate->opos;
+    opos_inc = rate->opos_inc;
+    ipos = rate->ipos;
+
     while (obuf < oend) {
 
         /* Safety catch to make sure we have input samples.  */
@@ -68,14 +79,14 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
 
         /* read as many input samples so that ipos > opos */
 
-        while (rate->ipos <= (rate->opos >> 32)) {
+        while (ipos <= (opos >> 32)) {
             ilast = *ibuf++;
-            rate->ipos++;
+            ipos++;
 
             /* if ipos overflow, there is  a infinite loop */
-            if (rate->ipos == 0xffffffff) {
-                rate->ipos = 1;
-                rate->opos = rate->opos & 0xffffffff;
+            if (ipos == 0xffffffff) {
+                ipos = 1;
+                opos = opos & 0xffffffff;
             }
             /* See if we finished the input buffer yet */
             if (ibuf >= iend) {
@@ -88,14 +99,14 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
         /* interpolate */
 #ifdef FLOAT_MIXENG
 #ifdef RECIPROCAL
-        t = (rate->opos & UINT_MAX) * (1.f / UINT_MAX);
+        t = (opos & UINT_MAX) * (1.f / UINT_MAX);
 #else
-        t = (rate->opos & UINT_MAX) / (mixeng_real) UINT_MAX;
+        t = (opos & UINT_MAX) / (mixeng_real) UINT_MAX;
 #endif
         out.l = (ilast.l * (1.0 - t)) + icur.l * t;
         out.r = (ilast.r * (1.0 - t)) + icur.r * t;
 #else
-        t = rate->opos & 0xffffffff;
+        t = opos & 0xffffffff;
         out.l = (ilast.l * ((int64_t) UINT_MAX - t) + icur.l * t) >> 32;
         out.r = (ilast.r * ((int64_t) UINT_MAX - t) + icur.r * t) >> 32;
 #endif
@@ -104,13 +115,15 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
         OP (obuf->l, out.l);
         OP (obuf->r, out.r);
         obuf += 1;
-        rate->opos += rate->opos_inc;
+        opos += opos_inc;
     }
 
 the_end:
     *isamp = ibuf - istart;
     *osamp = obuf - ostart;
     rate->ilast = ilast;
+    rate->opos = opos;
+    rate->ipos = ipos;
 }
 
 #undef NAME
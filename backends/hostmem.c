@@ -28,6 +28,76 @@ QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_BIND != MPOL_BIND);
 QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_INTERLEAVE != MPOL_INTERLEAVE);
 #endif
 
+#ifdef CONFIG_NUMA
+/*
+ * Apply policy and host-nodes to the memory of @backend.  With
+ * MPOL_MF_MOVE, the pages that are already allocated are migrated to the
+ * new nodes, so this can also be used at runtime to move the memory of
+ * a guest between memory tiers, e.g. from DRAM to a CXL or PMEM node.
+ */
+static bool host_memory_backend_apply_policy(HostMemoryBackend *backend,
+                                             unsigned flags, Error **errp)
+{
+    void *ptr = memory_region_get_ram_ptr(&backend->mr);
+    uint64_t sz = memory_region_size(&backend->mr);
+    unsigned long lastbit = find_last_bit(backend->host_nodes, MAX_NODES);
+    /* lastbit == MAX_NODES means maxnode = 0 */
+    unsigned long maxnode = (lastbit + 1) % (MAX_NODES + 1);
+
+    /* check for invalid host-nodes and policies and give more verbose
+     * error messages than mbind(). */
+    if (maxnode && backend->policy == MPOL_DEFAULT) {
+        error_setg(errp, "host-nodes must be empty for policy default,"
+                   " or you should explicitly specify a policy other"
+                   " than default");
+        return false;
+    } else if (maxnode == 0 && backend->policy != MPOL_DEFAULT) {
+        error_setg(errp, "host-nodes must be set for policy %s",
+                   HostMemPolicy_str(backend->policy));
+        return false;
+    }
+
+    /* We can have up to MAX_NODES nodes, but we need to pass maxnode+1
+     * as argument to mbind() due to an old Linux bug (feature?) which
+     * cuts off the last specified node. This means backend->host_nodes
+     * must have MAX_NODES+1 bits available.
+     */
+    assert(sizeof(backend->host_nodes) >=
+           BITS_TO_LONGS(MAX_NODES + 1) * sizeof(unsigned long));
+    assert(maxnode <= MAX_NODES);
+
+    if (mbind(ptr, sz, backend->policy, maxnode ? backend->host_nodes : NULL,
+              maxnode ? maxnode + 1 : 0, flags)) {
+        if (backend->policy != MPOL_DEFAULT || errno != ENOSYS) {
+            error_setg_errno(errp, errno,
+                             "cannot bind memory to host NUMA nodes");
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Changing policy or host-nodes of a live backend rebinds its memory.
+ * The two properties are set one at a time, so nothing is done while
+ * they are inconsistent, e.g. between setting host-nodes and policy.
+ * Returns false if the memory could not be rebound; the caller then
+ * restores the previous value of the property.
+ */
+static bool host_memory_backend_rebind(HostMemoryBackend *backend,
+                                       Error **errp)
+{
+    bool has_nodes = !bitmap_empty(backend->host_nodes, MAX_NODES);
+
+    if (!host_memory_backend_mr_inited(backend) ||
+        has_nodes != (backend->policy != MPOL_DEFAULT)) {
+        return true;
+    }
+    /* Pages pinned e.g. by VFIO stay where they are */
+    return host_memory_backend_apply_policy(backend, MPOL_MF_MOVE, errp);
+}
+#endif
+
 char *
 host_memory_backend_get_name(HostMemoryBackend *backend)
 {
@@ -109,6 +179,7 @@ host_memory_backend_set_host_nodes(Object *obj, Visitor *v, const char *name,
 {
 #ifdef CONFIG_NUMA
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+    DECLARE_BITMAP(old_host_nodes, MAX_NODES + 1);
     uint16List *l, *host_nodes = NULL;
 
     visit_type_uint16List(v, name, &host_nodes, errp);
@@ -120,9 +191,14 @@ host_memory_backend_set_host_nodes(Object *obj, Visitor *v, const char *name,
         }
     }
 
+    bitmap_copy(old_host_nodes, backend->host_nodes, MAX_NODES);
+    bitmap_zero(backend->host_nodes, MAX_NODES);
     for (l = host_nodes; l; l = l->next) {
         bitmap_set(backend->host_nodes, l->value, 1);
     }
+    if (!host_memory_backend_rebind(backend, errp)) {
+        bitmap_copy(backend->host_nodes, old_host_nodes, MAX_NODES);
+    }
 
 out:
     qapi_free_uint16List(host_nodes);
@@ -142,11 +218,18 @@ static void
 host_memory_backend_set_policy(Object *obj, int policy, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+    HostMemPolicy old_policy = backend->policy;
+
     backend->policy = policy;
 
-#ifndef CONFIG_NUMA
+#ifdef CONFIG_NUMA
+    if (!host_memory_backend_rebind(backend, errp)) {
+        backend->policy = old_policy;
+    }
+#else
     if (policy != HOST_MEM_POLICY_DEFAULT) {
         error_setg(errp, "NUMA policies are not supported by this QEMU");
+        backend->policy = old_policy;
     }
 #endif
 }
@@ -203,6 +286,16 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     }
 }
 
+const unsigned long *
+host_memory_backend_get_prealloc_nodes(HostMemoryBackend *backend)
+{
+    /* Without a policy, host-nodes is empty and the kernel picks a node */
+    if (backend->policy == HOST_MEM_POLICY_DEFAULT) {
+        return NULL;
+    }
+    return backend->host_nodes;
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -231,7 +324,9 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
-        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads, &local_err);
+        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads,
+                        host_memory_backend_get_prealloc_nodes(backend),
+                        MAX_NODES, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -346,43 +441,18 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
         if (!backend->dump) {
             qemu_madvise(ptr, sz, QEMU_MADV_DONTDUMP);
         }
+        if (backend->thp == HOST_MEM_THP_POLICY_NEVER) {
+            qemu_madvise(ptr, sz, QEMU_MADV_NOHUGEPAGE);
+        }
 #ifdef CONFIG_NUMA
-        unsigned long lastbit = find_last_bit(backend->host_nodes, MAX_NODES);
-        /* lastbit == MAX_NODES means maxnode = 0 */
-        unsigned long maxnode = (lastbit + 1) % (MAX_NODES + 1);
         /* ensure policy won't be ignored in case memory is preallocated
          * before mbind(). note: MPOL_MF_STRICT is ignored on hugepages so
          * this doesn't catch hugepage case. */
-        unsigned flags = MPOL_MF_STRICT | MPOL_MF_MOVE;
-
-        /* check for invalid host-nodes and policies and give more verbose
-         * error messages than mbind(). */
-        if (maxnode && backend->policy == MPOL_DEFAULT) {
-            error_setg(errp, "host-nodes must be empty for policy default,"
-                       " or you should explicitly specify a policy other"
-                       " than default");
-            return;
-        } else if (maxnode == 0 && backend->policy != MPOL_DEFAULT) {
-            error_setg(errp, "host-nodes must be set for policy %s",
-                       HostMemPolicy_str(backend->policy));
-            return;
-        }
-
-        /* We can have up to MAX_NODES nodes, but we need to pass maxnode+1
-         * as argument to mbind() due to an old Linux bug (feature?) which
-         * cuts off the last specified node. This means backend->host_nodes
-         * must have MAX_NODES+1 bits available.
-         */
-        assert(sizeof(backend->host_nodes) >=
-               BITS_TO_LONGS(MAX_NODES + 1) * sizeof(unsigned long));
-        assert(maxnode <= MAX_NODES);
-
-        if (maxnode &&
-            mbind(ptr, sz, backend->policy, backend->host_nodes, maxnode + 1,
-                  flags)) {
-            if (backend->policy != MPOL_DEFAULT || errno != ENOSYS) {
-                error_setg_errno(errp, errno,
-                                 "cannot bind memory to host NUMA nodes");
+        if (!bitmap_empty(backend->host_nodes, MAX_NODES) ||
+            backend->policy != MPOL_DEFAULT) {
+            if (!host_memory_backend_apply_policy(backend,
+                                                  MPOL_MF_STRICT | MPOL_MF_MOVE,
+                                                  errp)) {
                 return;
             }
         }
@@ -393,7 +463,9 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          */
         if (backend->prealloc) {
             os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            backend->prealloc_threads, &local_err);
+                            backend->prealloc_threads,
+                            host_memory_backend_get_prealloc_nodes(backend),
+                            MAX_NODES, &local_err);
             if (local_err) {
                 goto out;
             }
@@ -413,6 +485,26 @@ host_memory_backend_can_be_deleted(UserCreatable *uc)
     }
 }
 
+static int
+host_memory_backend_get_thp(Object *obj, Error **errp G_GNUC_UNUSED)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    return backend->thp;
+}
+
+static void
+host_memory_backend_set_thp(Object *obj, int thp, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    backend->thp = thp;
+}
+
 static bool host_memory_backend_get_share(Object *o, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(o);
@@ -519,6 +611,12 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         host_memory_backend_set_policy);
     object_class_property_set_description(oc, "policy",
         "Set the NUMA policy");
+    object_class_property_add_enum(oc, "thp", "HostMemThpPolicy",
+        &HostMemThpPolicy_lookup,
+        host_memory_backend_get_thp,
+        host_memory_backend_set_thp);
+    object_class_property_set_description(oc, "thp",
+        "Set the transparent huge page policy");
     object_class_property_add_bool(oc, "share",
         host_memory_backend_get_share, host_memory_backend_set_share);
     object_class_property_set_description(oc, "share",
@@ -6046,6 +6046,24 @@ int bdrv_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     return 0;
 }
 
+/*
+ * Return a file descriptor that allows reading the data of @bs directly,
+ * bypassing the block layer, or -errno.  See the description of
+ * BlockDriver.bdrv_get_read_fd.
+ */
+int bdrv_get_read_fd(BlockDriverState *bs)
+{
+    BlockDriver *drv = bs->drv;
+
+    if (!drv) {
+        return -ENOMEDIUM;
+    }
+    if (!drv->bdrv_get_read_fd) {
+        return -ENOTSUP;
+    }
+    return drv->bdrv_get_read_fd(bs);
+}
+
 ImageInfoSpecific *bdrv_get_specific_info(BlockDriverState *bs,
                                           Error **errp)
 {
@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "block/accounting.h"
 #include "block/block_int.h"
+#include "qemu/host-utils.h"
 #include "qemu/timer.h"
 #include "sysemu/qtest.h"
 
@@ -182,6 +183,52 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+int64_t block_node_latency_start(void)
+{
+    return qemu_clock_get_ns(clock_type);
+}
+
+static unsigned block_node_latency_bin(uint64_t latency_ns)
+{
+    unsigned shift, sub;
+
+    if (latency_ns < (1ULL << BLOCK_NODE_LATENCY_MIN_SHIFT)) {
+        return 0;
+    }
+    if (latency_ns >= (1ULL << BLOCK_NODE_LATENCY_MAX_SHIFT)) {
+        return BLOCK_NODE_LATENCY_BINS - 1;
+    }
+
+    shift = 63 - clz64(latency_ns);
+    sub = (latency_ns >> (shift - BLOCK_NODE_LATENCY_SUB_BITS)) &
+          ((1 << BLOCK_NODE_LATENCY_SUB_BITS) - 1);
+    return 1 + ((shift - BLOCK_NODE_LATENCY_MIN_SHIFT) <<
+                BLOCK_NODE_LATENCY_SUB_BITS) + sub;
+}
+
+/* Lower bound in nanoseconds of @bin, for bin > 0 */
+uint64_t block_node_latency_boundary(unsigned bin)
+{
+    unsigned shift = BLOCK_NODE_LATENCY_MIN_SHIFT +
+                     ((bin - 1) >> BLOCK_NODE_LATENCY_SUB_BITS);
+    uint64_t sub = (bin - 1) & ((1 << BLOCK_NODE_LATENCY_SUB_BITS) - 1);
+
+    return (1ULL << shift) + (sub << (shift - BLOCK_NODE_LATENCY_SUB_BITS));
+}
+
+void block_node_latency_done(BlockNodeLatencyStats *stats,
+                             enum BlockAcctType type, int64_t start_ns)
+{
+    int64_t latency_ns = qemu_clock_get_ns(clock_type) - start_ns;
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    if (qtest_enabled()) {
+        latency_ns = qtest_latency_ns;
+    }
+    stat64_add(&stats->bins[type][block_node_latency_bin(MAX(latency_ns, 0))],
+               1);
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
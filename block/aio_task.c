@@ -124,3 +124,12 @@ bool aio_task_pool_empty(AioTaskPool *pool)
 {
     return pool->busy_tasks == 0;
 }
+
+int aio_task_pool_busy_tasks(AioTaskPool *pool)
+{
+    if (!pool) {
+        return 0;
+    }
+
+    return pool->busy_tasks;
+}
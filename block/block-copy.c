@@ -20,6 +20,7 @@
 #include "sysemu/block-backend.h"
 #include "qemu/units.h"
 #include "qemu/coroutine.h"
+#include "qemu/timer.h"
 #include "block/aio_task.h"
 #include "qemu/error-report.h"
 
@@ -30,6 +31,16 @@
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
+/*
+ * Copy-before-write requests stall a guest write, so they are never tuned
+ * and are split into buffer-sized chunks even when copy_range is used.
+ */
+#define BLOCK_COPY_CBW_MAX_CHUNK BLOCK_COPY_MAX_BUFFER
+
+/* Adaptive tuning of background calls, see block_copy_adapt() */
+#define BLOCK_COPY_ADAPT_INTERVAL (100 * SCALE_MS)
+#define BLOCK_COPY_ADAPT_INIT_WORKERS 4
+
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
     COPY_READ_WRITE,
@@ -47,6 +58,7 @@ typedef struct BlockCopyCallState {
     int64_t bytes;
     int max_workers;
     int64_t max_chunk;
+    bool adaptive;
     bool ignore_ratelimit;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
@@ -93,6 +105,9 @@ typedef struct BlockCopyTask {
      */
     BlockCopyMethod method;
 
+    /* Set in block_copy_task_entry() */
+    int64_t start_ns;
+
     /*
      * Fields whose state changes throughout the execution
      * Protected by lock in BlockCopyState.
@@ -138,6 +153,20 @@ typedef struct BlockCopyState {
     BlockCopyMethod method;
     QLIST_HEAD(, BlockCopyTask) tasks; /* All tasks from all block-copy calls */
     QLIST_HEAD(, BlockCopyCallState) calls;
+    int cbw_calls; /* Running block_copy() calls */
+    /*
+     * Adaptive tuning state, shared by all adaptive calls because it
+     * describes the source and target rather than a single call.
+     * The counters cover the current sampling interval.
+     */
+    int64_t adapt_chunk;
+    int adapt_workers;
+    int adapt_chunk_dir; /* 1 while growing chunks helps, -1 otherwise */
+    int64_t adapt_start_ns;
+    uint64_t adapt_bytes;
+    uint64_t adapt_busy_ns;
+    uint64_t adapt_throughput; /* bytes/s in the previous interval */
+    uint64_t adapt_min_cost; /* lowest request latency seen, in ns per KiB */
     /*
      * skip_unallocated:
      *
@@ -215,6 +244,93 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+/*
+ * Called with lock held at the end of each sampling interval.
+ *
+ * The number of workers follows an additive-increase/multiplicative-decrease
+ * scheme based on request latency: as long as requests are not much slower
+ * than the fastest ones seen so far, the devices are not saturated and one
+ * more worker is allowed; otherwise requests are just queueing up, and
+ * possibly delaying the guest's, so the number of workers is halved.
+ *
+ * The chunk size climbs in whatever direction improved throughput last time,
+ * and turns around as soon as throughput drops.
+ */
+static void block_copy_adapt(BlockCopyState *s, int64_t now)
+{
+    uint64_t throughput, cost;
+
+    throughput = s->adapt_bytes * (NANOSECONDS_PER_SECOND / SCALE_US) /
+                 MAX((now - s->adapt_start_ns) / SCALE_US, 1);
+    cost = s->adapt_busy_ns / MAX(s->adapt_bytes / KiB, 1);
+
+    /* Let the baseline drift up so that it follows changing conditions */
+    s->adapt_min_cost += s->adapt_min_cost / 16;
+    if (!s->adapt_min_cost || cost < s->adapt_min_cost) {
+        s->adapt_min_cost = cost;
+    }
+
+    if (cost > 2 * s->adapt_min_cost) {
+        s->adapt_workers = MAX(s->adapt_workers / 2, 1);
+    } else if (s->adapt_workers < BLOCK_COPY_MAX_WORKERS) {
+        s->adapt_workers++;
+    }
+
+    if (throughput < s->adapt_throughput - s->adapt_throughput / 8) {
+        s->adapt_chunk_dir = -s->adapt_chunk_dir;
+    }
+    if (s->adapt_chunk_dir > 0) {
+        s->adapt_chunk = MIN(s->adapt_chunk * 2, block_copy_chunk_size(s));
+    } else {
+        s->adapt_chunk = MAX(s->adapt_chunk / 2, s->cluster_size);
+    }
+
+    trace_block_copy_adapt(s, throughput, cost, s->adapt_workers,
+                           s->adapt_chunk);
+
+    /* The next interval starts with the next request */
+    s->adapt_throughput = throughput;
+    s->adapt_start_ns = 0;
+    s->adapt_bytes = 0;
+    s->adapt_busy_ns = 0;
+}
+
+/* Called with lock held */
+static void block_copy_adapt_account(BlockCopyTask *task)
+{
+    BlockCopyState *s = task->s;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    if (!s->adapt_start_ns) {
+        s->adapt_start_ns = task->start_ns;
+    }
+    s->adapt_bytes += task->bytes;
+    s->adapt_busy_ns += now - task->start_ns;
+
+    if (now - s->adapt_start_ns >= BLOCK_COPY_ADAPT_INTERVAL) {
+        block_copy_adapt(s, now);
+    }
+}
+
+/*
+ * Number of parallel requests an adaptive call may have in flight. While
+ * copy-before-write operations wait, keep a quarter of that for the
+ * background copy so that the guest's writes are not queued behind it.
+ */
+static int coroutine_fn block_copy_adapt_workers(BlockCopyCallState *call_state)
+{
+    BlockCopyState *s = call_state->s;
+    int workers;
+
+    QEMU_LOCK_GUARD(&s->lock);
+    workers = MIN(s->adapt_workers, call_state->max_workers);
+    if (s->cbw_calls) {
+        workers = MAX(workers / 4, 1);
+    }
+
+    return workers;
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
  * the beginning of it.
@@ -228,6 +344,9 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    if (call_state->adaptive) {
+        max_chunk = MIN(max_chunk, s->adapt_chunk);
+    }
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -431,6 +550,9 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
+        .adapt_chunk = cluster_size,
+        .adapt_workers = BLOCK_COPY_ADAPT_INIT_WORKERS,
+        .adapt_chunk_dir = 1,
     };
 
     block_copy_set_copy_opts(s, false, false);
@@ -583,6 +705,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     BlockCopyMethod method = t->method;
     int ret;
 
+    t->start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     ret = block_copy_do_copy(s, t->offset, t->bytes, &method, &error_is_read);
 
     WITH_QEMU_LOCK_GUARD(&s->lock) {
@@ -590,6 +713,11 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
             s->method = method;
         }
 
+        /* Zeroing says nothing about how fast data can be copied */
+        if (ret >= 0 && t->method != COPY_WRITE_ZEROES) {
+            block_copy_adapt_account(t);
+        }
+
         if (ret < 0) {
             if (!t->call_state->ret) {
                 t->call_state->ret = ret;
@@ -747,6 +875,16 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         BlockCopyTask *task;
         int64_t status_bytes;
 
+        if (call_state->adaptive) {
+            while (aio_task_pool_busy_tasks(aio) >=
+                   block_copy_adapt_workers(call_state)) {
+                aio_task_pool_wait_one(aio);
+            }
+            if (aio_task_pool_status(aio) < 0) {
+                break;
+            }
+        }
+
         task = block_copy_task_create(s, call_state, offset, bytes);
         if (!task) {
             /* No more dirty bits in the bitmap */
@@ -915,9 +1053,21 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
         .bytes = bytes,
         .ignore_ratelimit = ignore_ratelimit,
         .max_workers = BLOCK_COPY_MAX_WORKERS,
+        .max_chunk = BLOCK_COPY_CBW_MAX_CHUNK,
     };
+    int ret;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        s->cbw_calls++;
+    }
 
-    return block_copy_common(&call_state);
+    ret = block_copy_common(&call_state);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        s->cbw_calls--;
+    }
+
+    return ret;
 }
 
 static void coroutine_fn block_copy_async_co_entry(void *opaque)
@@ -928,6 +1078,7 @@ static void coroutine_fn block_copy_async_co_entry(void *opaque)
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -939,6 +1090,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .adaptive = adaptive,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -21,7 +21,9 @@
 #include "qemu/osdep.h"
 
 #include "block/block_int.h"
+#include "block/aio_task.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -31,8 +33,12 @@
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "crypto.h"
 
+/* number of ciphers, and so of request slices encrypted in parallel */
+#define BLOCK_CRYPTO_MAX_THREADS 4
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
@@ -294,7 +300,7 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
-                                       1,
+                                       BLOCK_CRYPTO_MAX_THREADS,
                                        errp);
 
     if (!crypto->block) {
@@ -396,6 +402,87 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+/*
+ * Large requests are split into slices of at least this size which are
+ * encrypted in parallel in the thread pool, one cipher per thread.
+ */
+#define BLOCK_CRYPTO_MIN_SLICE (64 * KiB)
+
+typedef int (*BlockCryptoEncDecFunc)(QCryptoBlock *block, uint64_t offset,
+                                     uint8_t *buf, size_t len, Error **errp);
+
+typedef struct BlockCryptoEncDecTask {
+    AioTask task;
+    BlockDriverState *bs;
+    BlockCryptoEncDecFunc func;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+} BlockCryptoEncDecTask;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoEncDecTask *t = opaque;
+    BlockCrypto *crypto = t->bs->opaque;
+
+    return t->func(crypto->block, t->offset, t->buf, t->len, NULL);
+}
+
+static coroutine_fn int block_crypto_encdec_task_entry(AioTask *task)
+{
+    BlockCryptoEncDecTask *t = container_of(task, BlockCryptoEncDecTask, task);
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(t->bs));
+
+    if (thread_pool_submit_co(pool, block_crypto_encdec_pool_func, t) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+static coroutine_fn int
+block_crypto_co_encdec(BlockDriverState *bs, uint64_t offset,
+                       uint8_t *buf, size_t len, BlockCryptoEncDecFunc func)
+{
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    size_t slice, cur;
+    AioTaskPool *aio;
+    BlockCryptoEncDecTask *t;
+    int ret;
+
+    slice = QEMU_ALIGN_UP(DIV_ROUND_UP(len, BLOCK_CRYPTO_MAX_THREADS),
+                          sector_size);
+    slice = MAX(slice, BLOCK_CRYPTO_MIN_SLICE);
+    if (len <= slice) {
+        /* not worth a trip to the thread pool */
+        return func(crypto->block, offset, buf, len, NULL) < 0 ? -EIO : 0;
+    }
+
+    aio = aio_task_pool_new(BLOCK_CRYPTO_MAX_THREADS);
+    while (len && aio_task_pool_status(aio) == 0) {
+        cur = MIN(len, slice);
+        t = g_new(BlockCryptoEncDecTask, 1);
+        *t = (BlockCryptoEncDecTask) {
+            .task.func = block_crypto_encdec_task_entry,
+            .bs = bs,
+            .func = func,
+            .offset = offset,
+            .buf = buf,
+            .len = cur,
+        };
+        aio_task_pool_start_task(aio, &t->task);
+
+        offset += cur;
+        buf += cur;
+        len -= cur;
+    }
+    aio_task_pool_wait_all(aio);
+    ret = aio_task_pool_status(aio);
+    aio_task_pool_free(aio);
+
+    return ret;
+}
+
 static coroutine_fn int
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -439,9 +526,9 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_decrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -495,9 +582,9 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_encrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
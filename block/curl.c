@@ -93,6 +93,8 @@ typedef struct CURLState
     char range[128];
     char errmsg[CURL_ERROR_SIZE];
     char in_use;
+    /* Value of lru_clock when the buffer was last filled or read */
+    uint64_t last_use;
 } CURLState;
 
 typedef struct BDRVCURLState {
@@ -100,6 +102,7 @@ typedef struct BDRVCURLState {
     QEMUTimer timer;
     uint64_t len;
     CURLState states[CURL_NUM_STATES];
+    uint64_t lru_clock;
     GHashTable *sockets; /* GINT_TO_POINTER(fd) -> socket */
     char *url;
     size_t readahead_size;
@@ -287,6 +290,7 @@ static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
         {
             char *buf = state->orig_buf + (start - state->buf_start);
 
+            state->last_use = ++s->lru_clock;
             qemu_iovec_from_buf(acb->qiov, 0, buf, clamped_len);
             if (clamped_len < len) {
                 qemu_iovec_memset(acb->qiov, clamped_len, 0, len - clamped_len);
@@ -434,19 +438,28 @@ static void curl_multi_timeout_do(void *arg)
     qemu_mutex_unlock(&s->mutex);
 }
 
-/* Called with s->mutex held.  */
+/*
+ * The buffers of the idle states are the only cache of the driver, so
+ * reuse the state whose buffer was used least recently.
+ *
+ * Called with s->mutex held.
+ */
 static CURLState *curl_find_state(BDRVCURLState *s)
 {
     CURLState *state = NULL;
     int i;
 
     for (i = 0; i < CURL_NUM_STATES; i++) {
-        if (!s->states[i].in_use) {
+        if (s->states[i].in_use) {
+            continue;
+        }
+        if (!state || s->states[i].last_use < state->last_use) {
             state = &s->states[i];
-            state->in_use = 1;
-            break;
         }
     }
+    if (state) {
+        state->in_use = 1;
+    }
     return state;
 }
 
@@ -502,6 +515,21 @@ static int curl_init_state(BDRVCURLState *s, CURLState *state)
         curl_easy_setopt(state->curl, CURLOPT_REDIR_PROTOCOLS, PROTOCOLS);
 #endif
 
+#ifdef CURLPIPE_MULTIPLEX
+        /*
+         * Wait for a connection that can be multiplexed rather than
+         * opening a new one, so that concurrent range requests share a
+         * single HTTP/2 connection when the server supports it.
+         *
+         * CURL_HTTP_VERSION_2TLS is only available from 7.47.0 upwards.
+         */
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        curl_easy_setopt(state->curl, CURLOPT_HTTP_VERSION,
+                         (long)CURL_HTTP_VERSION_2TLS);
+#endif
+        curl_easy_setopt(state->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+
 #ifdef DEBUG_VERBOSE
         curl_easy_setopt(state->curl, CURLOPT_VERBOSE, 1);
 #endif
@@ -576,6 +604,9 @@ static void curl_attach_aio_context(BlockDriverState *bs,
     curl_multi_setopt(s->multi, CURLMOPT_SOCKETFUNCTION, curl_sock_cb);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERDATA, s);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERFUNCTION, curl_timer_cb);
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(s->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+#endif
 }
 
 static QemuOptsList runtime_opts = {
@@ -865,6 +896,7 @@ static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
 
     state->buf_off = 0;
     g_free(state->orig_buf);
+    state->last_use = ++s->lru_clock;
     state->buf_start = start;
     state->buf_len = MIN(acb->end + s->readahead_size, s->len - start);
     end = start + state->buf_len - 1;
@@ -24,8 +24,10 @@
 #include "block/export.h"
 #include "block/fuse.h"
 #include "block/qapi.h"
+#include "block/thread-pool.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
+#include "qemu/lockable.h"
 #include "sysemu/block-backend.h"
 
 #include <fuse.h>
@@ -38,14 +40,38 @@
 /* Prevent overly long bounce buffer allocations */
 #define FUSE_MAX_BOUNCE_BYTES (MIN(BDRV_REQUEST_MAX_BYTES, 64 * 1024 * 1024))
 
+/*
+ * Number of asynchronous (readahead, writeback) requests the kernel may
+ * have outstanding; now that requests are processed concurrently, the
+ * kernel default of 12 would needlessly limit throughput.
+ */
+#define FUSE_MAX_BACKGROUND 64
+
 
-typedef struct FuseExport {
+typedef struct FuseExport FuseExport;
+
+/*
+ * A request read from the FUSE session.  Each request is processed in
+ * its own coroutine, so that requests waiting for I/O do not hold up the
+ * ones behind them.  Buffers are kept around for reuse when the request
+ * is done.
+ */
+typedef struct FuseRequest {
+    FuseExport *exp;
+    struct fuse_buf buf;
+    QSLIST_ENTRY(FuseRequest) next;
+} FuseRequest;
+
+struct FuseExport {
     BlockExport common;
 
     struct fuse_session *fuse_session;
-    struct fuse_buf fuse_buf;
+    QSLIST_HEAD(, FuseRequest) free_requests;
     bool mounted, fd_handler_set_up;
 
+    /* Serializes fuse_do_truncate(), which temporarily changes permissions */
+    CoMutex truncate_lock;
+
     char *mountpoint;
     bool writable;
     bool growable;
@@ -55,7 +81,7 @@ typedef struct FuseExport {
     mode_t st_mode;
     uid_t st_uid;
     gid_t st_gid;
-} FuseExport;
+};
 
 static GHashTable *exports;
 static const struct fuse_lowlevel_ops fuse_ops;
@@ -126,6 +152,8 @@ static int fuse_export_create(BlockExport *blk_exp,
     exp->mountpoint = g_strdup(args->mountpoint);
     exp->writable = blk_exp_args->writable;
     exp->growable = args->growable;
+    QSLIST_INIT(&exp->free_requests);
+    qemu_co_mutex_init(&exp->truncate_lock);
 
     /* set default */
     if (!args->has_allow_other) {
@@ -229,6 +257,20 @@ fail:
     return ret;
 }
 
+/**
+ * Process a single request.  Owns a reference to the export.
+ */
+static void coroutine_fn fuse_co_process_request(void *opaque)
+{
+    FuseRequest *req = opaque;
+    FuseExport *exp = req->exp;
+
+    fuse_session_process_buf(exp->fuse_session, &req->buf);
+
+    QSLIST_INSERT_HEAD(&exp->free_requests, req, next);
+    blk_exp_unref(&exp->common);
+}
+
 /**
  * Callback to be invoked when the FUSE session FD can be read from.
  * (This is basically the FUSE event loop.)
@@ -236,21 +278,29 @@ fail:
 static void read_from_fuse_export(void *opaque)
 {
     FuseExport *exp = opaque;
+    FuseRequest *req;
+    Coroutine *co;
     int ret;
 
-    blk_exp_ref(&exp->common);
+    req = QSLIST_FIRST(&exp->free_requests);
+    if (req) {
+        QSLIST_REMOVE_HEAD(&exp->free_requests, next);
+    } else {
+        req = g_new0(FuseRequest, 1);
+        req->exp = exp;
+    }
 
     do {
-        ret = fuse_session_receive_buf(exp->fuse_session, &exp->fuse_buf);
+        ret = fuse_session_receive_buf(exp->fuse_session, &req->buf);
     } while (ret == -EINTR);
     if (ret < 0) {
-        goto out;
+        QSLIST_INSERT_HEAD(&exp->free_requests, req, next);
+        return;
     }
 
-    fuse_session_process_buf(exp->fuse_session, &exp->fuse_buf);
-
-out:
-    blk_exp_unref(&exp->common);
+    blk_exp_ref(&exp->common);
+    co = qemu_coroutine_create(fuse_co_process_request, req);
+    qemu_coroutine_enter(co);
 }
 
 static void fuse_export_shutdown(BlockExport *blk_exp)
@@ -289,7 +339,13 @@ static void fuse_export_delete(BlockExport *blk_exp)
         fuse_session_destroy(exp->fuse_session);
     }
 
-    free(exp->fuse_buf.mem);
+    while (!QSLIST_EMPTY(&exp->free_requests)) {
+        FuseRequest *req = QSLIST_FIRST(&exp->free_requests);
+
+        QSLIST_REMOVE_HEAD(&exp->free_requests, next);
+        free(req->buf.mem);
+        g_free(req);
+    }
     g_free(exp->mountpoint);
 }
 
@@ -331,6 +387,11 @@ static void fuse_init(void *userdata, struct fuse_conn_info *conn)
     conn->max_read = FUSE_MAX_BOUNCE_BYTES;
 
     conn->max_write = MIN_NON_ZERO(BDRV_REQUEST_MAX_BYTES, conn->max_write);
+    conn->max_background = FUSE_MAX_BACKGROUND;
+
+    /* Let fuse_splice_read_worker() move page cache pages to the kernel */
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE |
+                                   FUSE_CAP_SPLICE_MOVE);
 }
 
 /**
@@ -383,17 +444,38 @@ static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
     fuse_reply_attr(req, &statbuf, 1.);
 }
 
-static int fuse_do_truncate(const FuseExport *exp, int64_t size,
-                            bool req_zero_write, PreallocMode prealloc)
+/*
+ * Resize the export to @size.  With @grow_only, do nothing if the export
+ * is already at least that large: requests run concurrently, so a length
+ * sampled before taking truncate_lock may be stale, and truncating to it
+ * could discard data that another request has just written past it.
+ */
+static int coroutine_fn fuse_do_truncate(FuseExport *exp, int64_t size,
+                                         bool req_zero_write,
+                                         PreallocMode prealloc,
+                                         bool grow_only)
 {
     uint64_t blk_perm, blk_shared_perm;
     BdrvRequestFlags truncate_flags = 0;
+    int64_t length;
     int ret;
 
     if (req_zero_write) {
         truncate_flags |= BDRV_REQ_ZERO_WRITE;
     }
 
+    QEMU_LOCK_GUARD(&exp->truncate_lock);
+
+    if (grow_only) {
+        length = blk_getlength(exp->common.blk);
+        if (length < 0) {
+            return length;
+        }
+        if (length >= size) {
+            return 0;
+        }
+    }
+
     /* Growable exports have a permanent RESIZE permission */
     if (!exp->growable) {
         blk_get_perm(exp->common.blk, &blk_perm, &blk_shared_perm);
@@ -424,8 +506,9 @@ static int fuse_do_truncate(const FuseExport *exp, int64_t size,
  * without allow_other cannot be given a different UID or GID, and
  * they cannot be given non-owner access.
  */
-static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
-                         int to_set, struct fuse_file_info *fi)
+static void coroutine_fn fuse_setattr(fuse_req_t req, fuse_ino_t inode,
+                                      struct stat *statbuf, int to_set,
+                                      struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int supported_attrs;
@@ -469,7 +552,8 @@ static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
             return;
         }
 
-        ret = fuse_do_truncate(exp, statbuf->st_size, true, PREALLOC_MODE_OFF);
+        ret = fuse_do_truncate(exp, statbuf->st_size, true, PREALLOC_MODE_OFF,
+                               false);
         if (ret < 0) {
             fuse_reply_err(req, -ret);
             return;
@@ -501,11 +585,84 @@ static void fuse_open(fuse_req_t req, fuse_ino_t inode,
     fuse_reply_open(req, fi);
 }
 
+#ifdef CONFIG_LINUX
+typedef struct FuseSpliceRead {
+    fuse_req_t req;
+    int fd;
+    off_t offset;
+    size_t size;
+} FuseSpliceRead;
+
+static int fuse_splice_read_worker(void *opaque)
+{
+    FuseSpliceRead *data = opaque;
+    struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(data->size);
+    struct stat st;
+
+    /*
+     * The export length may be rounded up from the file size, but a short
+     * read from the file would look like EOF to the client.
+     */
+    if (fstat(data->fd, &st) < 0 || data->offset + data->size > st.st_size) {
+        return -ENOTSUP;
+    }
+
+    bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    bufv.buf[0].fd = data->fd;
+    bufv.buf[0].pos = data->offset;
+
+    /* Errors reading the file are replied to the client by libfuse */
+    fuse_reply_data(data->req, &bufv, FUSE_BUF_SPLICE_MOVE);
+    return 0;
+}
+
+/*
+ * Reply to a read request with data spliced directly from the image file,
+ * if the export allows it (see nbd_export_read_fd() for the same
+ * conditions on the NBD side).  This saves both the bounce buffer and the
+ * copy through it, and the file access is done in the thread pool.
+ * Returns -errno if the request has not been replied to.
+ */
+static int coroutine_fn fuse_co_splice_read(FuseExport *exp, fuse_req_t req,
+                                            off_t offset, size_t size)
+{
+    BlockBackend *blk = exp->common.blk;
+    FuseSpliceRead data = {
+        .req = req,
+        .offset = offset,
+        .size = size,
+    };
+    int ret;
+
+    if (blk_get_public(blk)->throttle_group_member.throttle_state) {
+        return -ENOTSUP;
+    }
+    data.fd = bdrv_get_read_fd(blk_bs(blk));
+    if (data.fd < 0) {
+        return data.fd;
+    }
+
+    blk_inc_in_flight(blk);
+    ret = thread_pool_submit_co(aio_get_thread_pool(exp->common.ctx),
+                                fuse_splice_read_worker, &data);
+    blk_dec_in_flight(blk);
+
+    return ret;
+}
+#else
+static int coroutine_fn fuse_co_splice_read(FuseExport *exp, fuse_req_t req,
+                                            off_t offset, size_t size)
+{
+    return -ENOTSUP;
+}
+#endif
+
 /**
  * Handle client reads from the exported image.
  */
-static void fuse_read(fuse_req_t req, fuse_ino_t inode,
-                      size_t size, off_t offset, struct fuse_file_info *fi)
+static void coroutine_fn fuse_read(fuse_req_t req, fuse_ino_t inode,
+                                   size_t size, off_t offset,
+                                   struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t length;
@@ -532,6 +689,10 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
         size = length - offset;
     }
 
+    if (size && fuse_co_splice_read(exp, req, offset, size) == 0) {
+        return;
+    }
+
     buf = qemu_try_blockalign(blk_bs(exp->common.blk), size);
     if (!buf) {
         fuse_reply_err(req, ENOMEM);
@@ -551,8 +712,9 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
 /**
  * Handle client writes to the exported image.
  */
-static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
-                       size_t size, off_t offset, struct fuse_file_info *fi)
+static void coroutine_fn fuse_write(fuse_req_t req, fuse_ino_t inode,
+                                    const char *buf, size_t size, off_t offset,
+                                    struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t length;
@@ -581,7 +743,8 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
 
     if (offset + size > length) {
         if (exp->growable) {
-            ret = fuse_do_truncate(exp, offset + size, true, PREALLOC_MODE_OFF);
+            ret = fuse_do_truncate(exp, offset + size, true, PREALLOC_MODE_OFF,
+                                   true);
             if (ret < 0) {
                 fuse_reply_err(req, -ret);
                 return;
@@ -602,9 +765,9 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
 /**
  * Let clients perform various fallocate() operations.
  */
-static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
-                           off_t offset, off_t length,
-                           struct fuse_file_info *fi)
+static void coroutine_fn fuse_fallocate(fuse_req_t req, fuse_ino_t inode,
+                                        int mode, off_t offset, off_t length,
+                                        struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int64_t blk_len;
@@ -644,7 +807,7 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
         if (!(mode & FALLOC_FL_KEEP_SIZE) && offset + length > blk_len) {
             /* No need for zeroes, we are going to write them ourselves */
             ret = fuse_do_truncate(exp, offset + length, false,
-                                   PREALLOC_MODE_OFF);
+                                   PREALLOC_MODE_OFF, true);
             if (ret < 0) {
                 fuse_reply_err(req, -ret);
                 return;
@@ -670,7 +833,7 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
 
         if (offset > blk_len) {
             /* No preallocation needed here */
-            ret = fuse_do_truncate(exp, offset, true, PREALLOC_MODE_OFF);
+            ret = fuse_do_truncate(exp, offset, true, PREALLOC_MODE_OFF, true);
             if (ret < 0) {
                 fuse_reply_err(req, -ret);
                 return;
@@ -678,7 +841,7 @@ static void fuse_fallocate(fuse_req_t req, fuse_ino_t inode, int mode,
         }
 
         ret = fuse_do_truncate(exp, offset + length, true,
-                               PREALLOC_MODE_FALLOC);
+                               PREALLOC_MODE_FALLOC, true);
     } else {
         ret = -EOPNOTSUPP;
     }
@@ -783,6 +946,7 @@ static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
 }
 #endif
 
+/* Called in coroutine context, see fuse_co_process_request() */
 static const struct fuse_lowlevel_ops fuse_ops = {
     .init       = fuse_init,
     .lookup     = fuse_lookup,
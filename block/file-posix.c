@@ -174,6 +174,14 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+    /* SG_IO requests queued with write(2) on an sg device, see hdev_co_sg_io */
+    bool sg_async;
+    unsigned int sg_async_inflight;
+    QLIST_HEAD(, HdevSgRequest) sg_async_reqs;
+
+    /* Buffers from bdrv_register_buf(), registered with the io_uring ring */
+    QLIST_HEAD(, RawRegisteredBuf) registered_bufs;
 } BDRVRawState;
 
 typedef struct BDRVRawReopenState {
@@ -2126,6 +2134,49 @@ static void raw_aio_unplug(BlockDriverState *bs)
 #endif
 }
 
+typedef struct RawRegisteredBuf {
+    void *host;
+    size_t size;
+    QLIST_ENTRY(RawRegisteredBuf) next;
+} RawRegisteredBuf;
+
+static void raw_register_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState __attribute__((unused)) *s = bs->opaque;
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        RawRegisteredBuf *buf = g_new(RawRegisteredBuf, 1);
+
+        /* Remember the buffer so it can move along with the AioContext */
+        buf->host = host;
+        buf->size = size;
+        QLIST_INSERT_HEAD(&s->registered_bufs, buf, next);
+        luring_register_buf(aio, host, size);
+    }
+#endif
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host)
+{
+    BDRVRawState *s = bs->opaque;
+    RawRegisteredBuf *buf;
+
+    QLIST_FOREACH(buf, &s->registered_bufs, next) {
+        if (buf->host == host) {
+            QLIST_REMOVE(buf, next);
+            g_free(buf);
+            break;
+        }
+    }
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        luring_unregister_buf(aio, host);
+    }
+#endif
+}
+
 static int raw_co_flush_to_disk(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2152,6 +2203,21 @@ static int raw_co_flush_to_disk(BlockDriverState *bs)
     return raw_thread_pool_submit(bs, handle_aiocb_flush, &acb);
 }
 
+static void raw_aio_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVRawState __attribute__((unused)) *s = bs->opaque;
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        RawRegisteredBuf *buf;
+
+        QLIST_FOREACH(buf, &s->registered_bufs, next) {
+            luring_unregister_buf(aio, buf->host);
+        }
+    }
+#endif
+}
+
 static void raw_aio_attach_aio_context(BlockDriverState *bs,
                                        AioContext *new_context)
 {
@@ -2173,6 +2239,13 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
             error_reportf_err(local_err, "Unable to use linux io_uring, "
                                          "falling back to thread pool: ");
             s->use_linux_io_uring = false;
+        } else {
+            LuringState *aio = aio_get_linux_io_uring(new_context);
+            RawRegisteredBuf *buf;
+
+            QLIST_FOREACH(buf, &s->registered_bufs, next) {
+                luring_register_buf(aio, buf->host, buf->size);
+            }
         }
     }
 #endif
@@ -2181,6 +2254,12 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
+    RawRegisteredBuf *buf, *next_buf;
+
+    QLIST_FOREACH_SAFE(buf, &s->registered_bufs, next, next_buf) {
+        QLIST_REMOVE(buf, next);
+        g_free(buf);
+    }
 
     if (s->fd >= 0) {
         qemu_close(s->fd);
@@ -3203,6 +3282,17 @@ static void raw_abort_perm_update(BlockDriverState *bs)
     raw_handle_perm_lock(bs, RAW_PL_ABORT, 0, 0, NULL);
 }
 
+static int raw_get_read_fd(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+
+    /* Data read around O_DIRECT would not be coherent with the page cache */
+    if (s->open_flags & O_DIRECT) {
+        return -ENOTSUP;
+    }
+    return s->fd;
+}
+
 static int coroutine_fn raw_co_copy_range_from(
         BlockDriverState *bs, BdrvChild *src, int64_t src_offset,
         BdrvChild *dst, int64_t dst_offset, int64_t bytes,
@@ -3276,10 +3366,14 @@ BlockDriver bdrv_file = {
     .bdrv_co_pdiscard       = raw_co_pdiscard,
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
+    .bdrv_get_read_fd = raw_get_read_fd,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate = raw_co_truncate,
     .bdrv_getlength = raw_getlength,
@@ -3550,11 +3644,126 @@ hdev_open_Mac_error:
 
     /* Since this does ioctl the device must be already opened */
     bs->sg = hdev_is_sg(bs);
+#if defined(__linux__)
+    s->sg_async = bs->sg;
+#endif
 
     return ret;
 }
 
 #if defined(__linux__)
+typedef struct HdevSgRequest {
+    Coroutine *co;
+    struct sg_io_hdr *io_hdr;
+    int ret;
+    QLIST_ENTRY(HdevSgRequest) next;
+} HdevSgRequest;
+
+static void hdev_sg_io_complete_req(BlockDriverState *bs, HdevSgRequest *req,
+                                    int ret)
+{
+    BDRVRawState *s = bs->opaque;
+
+    req->ret = ret;
+    QLIST_REMOVE(req, next);
+    if (--s->sg_async_inflight == 0) {
+        aio_set_fd_handler(bdrv_get_aio_context(bs), s->fd, false,
+                           NULL, NULL, NULL, NULL);
+    }
+    trace_file_hdev_sg_io_completed(bs, req->io_hdr);
+    aio_co_wake(req->co);
+}
+
+/*
+ * Reap all SG_IO requests that the sg driver has completed.  The results
+ * land in a copy of the header, so transfer them to the caller's header.
+ */
+static void hdev_sg_io_completed(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVRawState *s = bs->opaque;
+    int waiting = 0;
+
+    while (ioctl(s->fd, SG_GET_NUM_WAITING, &waiting) == 0 && waiting > 0) {
+        while (waiting--) {
+            struct sg_io_hdr hdr;
+            HdevSgRequest *req;
+
+            if (read(s->fd, &hdr, sizeof(hdr)) < 0) {
+                if (errno != EINTR) {
+                    error_report("sg: cannot read SG_IO result: %s",
+                                 strerror(errno));
+                    /*
+                     * The results cannot be matched to their requests any
+                     * more, so fail them all and go back to the ioctl.
+                     */
+                    s->sg_async = false;
+                    while (!QLIST_EMPTY(&s->sg_async_reqs)) {
+                        hdev_sg_io_complete_req(bs,
+                                                QLIST_FIRST(&s->sg_async_reqs),
+                                                -EIO);
+                    }
+                    return;
+                }
+                waiting++;
+                continue;
+            }
+
+            req = hdr.usr_ptr;
+            req->io_hdr->status = hdr.status;
+            req->io_hdr->masked_status = hdr.masked_status;
+            req->io_hdr->msg_status = hdr.msg_status;
+            req->io_hdr->sb_len_wr = hdr.sb_len_wr;
+            req->io_hdr->host_status = hdr.host_status;
+            req->io_hdr->driver_status = hdr.driver_status;
+            req->io_hdr->resid = hdr.resid;
+            req->io_hdr->duration = hdr.duration;
+            req->io_hdr->info = hdr.info;
+            hdev_sg_io_complete_req(bs, req, 0);
+        }
+    }
+}
+
+/*
+ * Queue @io_hdr with the asynchronous sg interface (a write(2) of the
+ * header, with the result read back once the fd polls readable) instead
+ * of blocking a thread pool worker in ioctl(SG_IO) for the duration of the
+ * command.  The fd handler is only installed while requests are in flight,
+ * so that nothing needs to be done when the BDS changes AioContext.
+ *
+ * Returns -EAGAIN if the request could not be queued, for example because
+ * the sg driver's per-fd queue is full; the caller then uses the ioctl.
+ */
+static int coroutine_fn hdev_co_sg_io(BlockDriverState *bs,
+                                      struct sg_io_hdr *io_hdr)
+{
+    BDRVRawState *s = bs->opaque;
+    HdevSgRequest req = {
+        .co = qemu_coroutine_self(),
+        .io_hdr = io_hdr,
+        .ret = -EINPROGRESS,
+    };
+    struct sg_io_hdr hdr = *io_hdr;
+
+    hdr.usr_ptr = &req;
+    hdr.pack_id = 0;
+    if (write(s->fd, &hdr, sizeof(hdr)) < 0) {
+        trace_file_hdev_sg_io_fallback(bs, errno);
+        return -EAGAIN;
+    }
+
+    QLIST_INSERT_HEAD(&s->sg_async_reqs, &req, next);
+    if (s->sg_async_inflight++ == 0) {
+        aio_set_fd_handler(bdrv_get_aio_context(bs), s->fd, false,
+                           hdev_sg_io_completed, NULL, NULL, bs);
+    }
+
+    while (req.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return req.ret;
+}
+
 static int coroutine_fn
 hdev_co_ioctl(BlockDriverState *bs, unsigned long int req, void *buf)
 {
@@ -3576,6 +3785,13 @@ hdev_co_ioctl(BlockDriverState *bs, unsigned long int req, void *buf)
         }
     }
 
+    if (req == SG_IO && s->sg_async) {
+        ret = hdev_co_sg_io(bs, buf);
+        if (ret != -EAGAIN) {
+            return ret;
+        }
+    }
+
     acb = (RawPosixAIOData) {
         .bs         = bs,
         .aio_type   = QEMU_AIO_IOCTL,
@@ -3642,10 +3858,14 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_pdiscard       = hdev_co_pdiscard,
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
+    .bdrv_get_read_fd = raw_get_read_fd,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate       = raw_co_truncate,
     .bdrv_getlength	= raw_getlength,
@@ -1808,6 +1808,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     BlockDriverState *bs = child->bs;
     BdrvTrackedRequest req;
     BdrvRequestPadding pad;
+    int64_t start_ns;
     int ret;
 
     trace_bdrv_co_preadv_part(bs, offset, bytes, flags);
@@ -1834,6 +1835,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_ns = block_node_latency_start();
 
     /* Don't do copy-on-read if we read data before write operation */
     if (qatomic_read(&bs->copy_on_read)) {
@@ -1854,6 +1856,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     bdrv_padding_destroy(&pad);
 
 fail:
+    block_node_latency_done(&bs->latency_stats, BLOCK_ACCT_READ, start_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
@@ -2241,6 +2244,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     BdrvTrackedRequest req;
     uint64_t align = bs->bl.request_alignment;
     BdrvRequestPadding pad;
+    int64_t start_ns;
     int ret;
     bool padded = false;
 
@@ -2292,6 +2296,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_ns = block_node_latency_start();
     tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_WRITE);
 
     if (flags & BDRV_REQ_ZERO_WRITE) {
@@ -2318,6 +2323,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
 
 out:
     tracked_request_end(&req);
+    block_node_latency_done(&bs->latency_stats, BLOCK_ACCT_WRITE, start_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
@@ -2935,9 +2941,11 @@ int coroutine_fn bdrv_co_flush(BlockDriverState *bs)
     BdrvChild *primary_child = bdrv_primary_child(bs);
     BdrvChild *child;
     int current_gen;
+    int64_t start_ns;
     int ret = 0;
 
     bdrv_inc_in_flight(bs);
+    start_ns = block_node_latency_start();
 
     if (!bdrv_is_inserted(bs) || bdrv_is_read_only(bs) ||
         bdrv_is_sg(bs)) {
@@ -3049,6 +3057,7 @@ out:
     qemu_co_mutex_unlock(&bs->reqs_lock);
 
 early_exit:
+    block_node_latency_done(&bs->latency_stats, BLOCK_ACCT_FLUSH, start_ns);
     bdrv_dec_in_flight(bs);
     return ret;
 }
@@ -3058,6 +3067,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
 {
     BdrvTrackedRequest req;
     int ret;
+    int64_t start_ns;
     int64_t max_pdiscard;
     int head, tail, align;
     BlockDriverState *bs = child->bs;
@@ -3098,6 +3108,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
     tail = (offset + bytes) % align;
 
     bdrv_inc_in_flight(bs);
+    start_ns = block_node_latency_start();
     tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_DISCARD);
 
     ret = bdrv_co_write_req_prepare(child, offset, bytes, &req, 0);
@@ -3168,6 +3179,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
 out:
     bdrv_co_write_req_finish(child, req.offset, req.bytes, &req, ret);
     tracked_request_end(&req);
+    block_node_latency_done(&bs->latency_stats, BLOCK_ACCT_UNMAP, start_ns);
     bdrv_dec_in_flight(bs);
     return ret;
 }
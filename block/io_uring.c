@@ -22,6 +22,9 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Maximum number of buffers registered with bdrv_register_buf() */
+#define MAX_FIXED_BUFS 16
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -56,6 +59,13 @@ typedef struct LuringState {
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /*
+     * Buffers registered with the kernel.  Requests that fit in one of them
+     * use IORING_OP_READ_FIXED/WRITE_FIXED and skip page pinning.
+     */
+    struct iovec fixed_bufs[MAX_FIXED_BUFS];
+    unsigned int nb_fixed_bufs;
 } LuringState;
 
 /**
@@ -103,6 +113,10 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
                       remaining);
 
     /* Update sqe */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.opcode = IORING_OP_READV;
+        luringcb->sqeq.buf_index = 0;
+    }
     luringcb->sqeq.off = nread;
     luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
@@ -326,6 +340,35 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+/**
+ * luring_fixed_buf_index:
+ * @s: AIO state
+ * @qiov: I/O vector of the request
+ *
+ * Returns the index of the registered buffer that contains all of @qiov,
+ * or -1 if the request cannot use a fixed buffer.
+ */
+static int luring_fixed_buf_index(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t base, end;
+    unsigned int i;
+
+    if (!s->nb_fixed_bufs || qiov->niov != 1) {
+        return -1;
+    }
+
+    base = (uintptr_t)qiov->iov[0].iov_base;
+    end = base + qiov->iov[0].iov_len;
+    for (i = 0; i < s->nb_fixed_bufs; i++) {
+        uintptr_t buf = (uintptr_t)s->fixed_bufs[i].iov_base;
+
+        if (base >= buf && end <= buf + s->fixed_bufs[i].iov_len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -341,14 +384,31 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
     int ret;
+    int buf_index = -1;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
+    if (type == QEMU_AIO_WRITE || type == QEMU_AIO_READ) {
+        buf_index = luring_fixed_buf_index(s, luringcb->qiov);
+    }
+
     switch (type) {
     case QEMU_AIO_WRITE:
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->iov[0].iov_len, offset,
+                                      buf_index);
+            break;
+        }
         io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
                              luringcb->qiov->niov, offset);
         break;
     case QEMU_AIO_READ:
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->iov[0].iov_len, offset,
+                                     buf_index);
+            break;
+        }
         io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
                             luringcb->qiov->niov, offset);
         break;
@@ -416,6 +476,76 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
+/*
+ * The kernel only allows replacing the whole buffer table, so every change
+ * unregisters the old table and registers the new one.  Requests that are
+ * still waiting in submit_queue refer to the old buffer indices and are
+ * turned back into plain readv/writev requests first.
+ */
+static int luring_update_fixed_bufs(LuringState *s, unsigned int old_nb)
+{
+    LuringAIOCB *luringcb;
+    int ret;
+
+    QSIMPLEQ_FOREACH(luringcb, &s->io_q.submit_queue, next) {
+        struct io_uring_sqe *sqe = &luringcb->sqeq;
+
+        if (sqe->opcode == IORING_OP_READ_FIXED ||
+            sqe->opcode == IORING_OP_WRITE_FIXED) {
+            sqe->opcode = sqe->opcode == IORING_OP_READ_FIXED ?
+                          IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = (__u64)(uintptr_t)luringcb->qiov->iov;
+            sqe->len = luringcb->qiov->niov;
+            sqe->buf_index = 0;
+        }
+    }
+
+    if (old_nb) {
+        io_uring_unregister_buffers(&s->ring);
+    }
+    if (!s->nb_fixed_bufs) {
+        return 0;
+    }
+    ret = io_uring_register_buffers(&s->ring, s->fixed_bufs, s->nb_fixed_bufs);
+    trace_luring_update_fixed_bufs(s, s->nb_fixed_bufs, ret);
+    return ret;
+}
+
+void luring_register_buf(LuringState *s, void *host, size_t size)
+{
+    unsigned int old_nb = s->nb_fixed_bufs;
+
+    if (s->nb_fixed_bufs == MAX_FIXED_BUFS) {
+        return;
+    }
+
+    s->fixed_bufs[s->nb_fixed_bufs++] = (struct iovec) {
+        .iov_base = host,
+        .iov_len = size,
+    };
+    if (luring_update_fixed_bufs(s, old_nb) < 0) {
+        /* Fall back to plain readv/writev for this buffer */
+        s->nb_fixed_bufs--;
+        luring_update_fixed_bufs(s, 0);
+    }
+}
+
+void luring_unregister_buf(LuringState *s, void *host)
+{
+    unsigned int old_nb = s->nb_fixed_bufs;
+    unsigned int i;
+
+    for (i = 0; i < s->nb_fixed_bufs; i++) {
+        if (s->fixed_bufs[i].iov_base == host) {
+            memmove(&s->fixed_bufs[i], &s->fixed_bufs[i + 1],
+                    (s->nb_fixed_bufs - i - 1) * sizeof(s->fixed_bufs[0]));
+            s->nb_fixed_bufs--;
+            luring_update_fixed_bufs(s, old_nb);
+            return;
+        }
+    }
+}
+
 LuringState *luring_init(Error **errp)
 {
     int rc;
@@ -34,6 +34,7 @@
 #include "qemu/uri.h"
 #include "qemu/option.h"
 #include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/atomic.h"
 
@@ -50,9 +51,10 @@
 
 #define EN_OPTSTR ":exportname="
 #define MAX_NBD_REQUESTS    16
+#define MAX_NBD_CONNECTIONS 16
 
-#define HANDLE_TO_INDEX(bs, handle) ((handle) ^ (uint64_t)(intptr_t)(bs))
-#define INDEX_TO_HANDLE(bs, index)  ((index)  ^ (uint64_t)(intptr_t)(bs))
+#define HANDLE_TO_INDEX(c, handle) ((handle) ^ (uint64_t)(intptr_t)(c))
+#define INDEX_TO_HANDLE(c, index)  ((index)  ^ (uint64_t)(intptr_t)(c))
 
 typedef struct {
     Coroutine *coroutine;
@@ -68,9 +70,14 @@ typedef enum NBDClientState {
     NBD_CLIENT_QUIT
 } NBDClientState;
 
-typedef struct BDRVNBDState {
+typedef struct BDRVNBDState BDRVNBDState;
+
+/* A connection to the server, with its own requests and reconnect state */
+typedef struct NBDConnState {
+    BDRVNBDState *s;
+
     QIOChannel *ioc; /* The current I/O channel */
-    NBDExportInfo info;
+    NBDExportInfo info; /* What was negotiated on this connection */
 
     CoMutex send_mutex;
     CoQueue free_sema;
@@ -83,28 +90,43 @@ typedef struct BDRVNBDState {
 
     NBDClientRequest requests[MAX_NBD_REQUESTS];
     NBDReply reply;
+
+    NBDClientConnection *conn;
+} NBDConnState;
+
+struct BDRVNBDState {
+    /* Export properties, as negotiated on the first connection */
+    NBDExportInfo info;
     BlockDriverState *bs;
 
+    NBDConnState *conns;
+    unsigned int nr_conns;
+    unsigned int next_conn; /* Whose turn it is to get the next request */
+
     /* Connection parameters */
     uint32_t reconnect_delay;
+    uint32_t multi_conn;
     SocketAddress *saddr;
     char *export, *tlscredsid;
     QCryptoTLSCreds *tlscreds;
     const char *hostname;
     char *x_dirty_bitmap;
     bool alloc_depth;
-
-    NBDClientConnection *conn;
-} BDRVNBDState;
+};
 
 static void nbd_yank(void *opaque);
 
 static void nbd_clear_bdrvstate(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
 
-    nbd_client_connection_release(s->conn);
-    s->conn = NULL;
+    for (i = 0; i < s->nr_conns; i++) {
+        nbd_client_connection_release(s->conns[i].conn);
+    }
+    g_free(s->conns);
+    s->conns = NULL;
+    s->nr_conns = 0;
 
     yank_unregister_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name));
 
@@ -119,9 +141,9 @@ static void nbd_clear_bdrvstate(BlockDriverState *bs)
     s->x_dirty_bitmap = NULL;
 }
 
-static bool nbd_client_connected(BDRVNBDState *s)
+static bool nbd_client_connected(NBDConnState *c)
 {
-    return qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTED;
+    return qatomic_load_acquire(&c->state) == NBD_CLIENT_CONNECTED;
 }
 
 static bool nbd_recv_coroutine_wake_one(NBDClientRequest *req)
@@ -135,99 +157,97 @@ static bool nbd_recv_coroutine_wake_one(NBDClientRequest *req)
     return false;
 }
 
-static void nbd_recv_coroutines_wake(BDRVNBDState *s, bool all)
+static void nbd_recv_coroutines_wake(NBDConnState *c, bool all)
 {
     int i;
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (nbd_recv_coroutine_wake_one(&s->requests[i]) && !all) {
+        if (nbd_recv_coroutine_wake_one(&c->requests[i]) && !all) {
             return;
         }
     }
 }
 
-static void nbd_channel_error(BDRVNBDState *s, int ret)
+static void nbd_channel_error(NBDConnState *c, int ret)
 {
-    if (nbd_client_connected(s)) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    if (nbd_client_connected(c)) {
+        qio_channel_shutdown(c->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
     }
 
     if (ret == -EIO) {
-        if (nbd_client_connected(s)) {
-            s->state = s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
-                                            NBD_CLIENT_CONNECTING_NOWAIT;
+        if (nbd_client_connected(c)) {
+            c->state = c->s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
+                                               NBD_CLIENT_CONNECTING_NOWAIT;
         }
     } else {
-        s->state = NBD_CLIENT_QUIT;
+        c->state = NBD_CLIENT_QUIT;
     }
 
-    nbd_recv_coroutines_wake(s, true);
+    nbd_recv_coroutines_wake(c, true);
 }
 
-static void reconnect_delay_timer_del(BDRVNBDState *s)
+static void reconnect_delay_timer_del(NBDConnState *c)
 {
-    if (s->reconnect_delay_timer) {
-        timer_free(s->reconnect_delay_timer);
-        s->reconnect_delay_timer = NULL;
+    if (c->reconnect_delay_timer) {
+        timer_free(c->reconnect_delay_timer);
+        c->reconnect_delay_timer = NULL;
     }
 }
 
 static void reconnect_delay_timer_cb(void *opaque)
 {
-    BDRVNBDState *s = opaque;
+    NBDConnState *c = opaque;
 
-    if (qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-        nbd_co_establish_connection_cancel(s->conn);
-        while (qemu_co_enter_next(&s->free_sema, NULL)) {
+    if (qatomic_load_acquire(&c->state) == NBD_CLIENT_CONNECTING_WAIT) {
+        c->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        nbd_co_establish_connection_cancel(c->conn);
+        while (qemu_co_enter_next(&c->free_sema, NULL)) {
             /* Resume all queued requests */
         }
     }
 
-    reconnect_delay_timer_del(s);
+    reconnect_delay_timer_del(c);
 }
 
-static void reconnect_delay_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
+static void reconnect_delay_timer_init(NBDConnState *c, uint64_t expire_time_ns)
 {
-    if (qatomic_load_acquire(&s->state) != NBD_CLIENT_CONNECTING_WAIT) {
+    if (qatomic_load_acquire(&c->state) != NBD_CLIENT_CONNECTING_WAIT) {
         return;
     }
 
-    assert(!s->reconnect_delay_timer);
-    s->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(s->bs),
+    assert(!c->reconnect_delay_timer);
+    c->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(c->s->bs),
                                              QEMU_CLOCK_REALTIME,
                                              SCALE_NS,
-                                             reconnect_delay_timer_cb, s);
-    timer_mod(s->reconnect_delay_timer, expire_time_ns);
+                                             reconnect_delay_timer_cb, c);
+    timer_mod(c->reconnect_delay_timer, expire_time_ns);
 }
 
-static void nbd_teardown_connection(BlockDriverState *bs)
+static void nbd_teardown_connection(NBDConnState *c)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    assert(!c->in_flight);
 
-    assert(!s->in_flight);
-
-    if (s->ioc) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+    if (c->ioc) {
+        qio_channel_shutdown(c->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(c->s->bs->node_name),
+                                 nbd_yank, c);
+        object_unref(OBJECT(c->ioc));
+        c->ioc = NULL;
     }
 
-    s->state = NBD_CLIENT_QUIT;
+    c->state = NBD_CLIENT_QUIT;
 }
 
-static bool nbd_client_connecting(BDRVNBDState *s)
+static bool nbd_client_connecting(NBDConnState *c)
 {
-    NBDClientState state = qatomic_load_acquire(&s->state);
+    NBDClientState state = qatomic_load_acquire(&c->state);
     return state == NBD_CLIENT_CONNECTING_WAIT ||
         state == NBD_CLIENT_CONNECTING_NOWAIT;
 }
 
-static bool nbd_client_connecting_wait(BDRVNBDState *s)
+static bool nbd_client_connecting_wait(NBDConnState *c)
 {
-    return qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTING_WAIT;
+    return qatomic_load_acquire(&c->state) == NBD_CLIENT_CONNECTING_WAIT;
 }
 
 /*
@@ -275,65 +295,107 @@ static int nbd_handle_updated_info(BlockDriverState *bs, Error **errp)
     return 0;
 }
 
-int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
-                                                Error **errp)
+/*
+ * Requests may go to any of the connections, so all of them must talk to
+ * the same export, with the same features, as the first one.
+ */
+static int nbd_check_conn_info(NBDConnState *c, Error **errp)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDExportInfo *info = &c->s->info;
+
+    if (c->info.size != info->size || c->info.flags != info->flags ||
+        c->info.structured_reply != info->structured_reply ||
+        c->info.extended_headers != info->extended_headers ||
+        c->info.base_allocation != info->base_allocation ||
+        c->info.min_block != info->min_block ||
+        c->info.max_block != info->max_block)
+    {
+        error_setg(errp, "Server negotiated different export properties "
+                   "on connection %td", c - c->s->conns);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static coroutine_fn int nbd_co_establish_conn(NBDConnState *c, bool blocking,
+                                              Error **errp)
+{
+    BDRVNBDState *s = c->s;
+    BlockDriverState *bs = s->bs;
     int ret;
-    bool blocking = nbd_client_connecting_wait(s);
 
-    assert(!s->ioc);
+    assert(!c->ioc);
 
-    s->ioc = nbd_co_establish_connection(s->conn, &s->info, blocking, errp);
-    if (!s->ioc) {
+    c->ioc = nbd_co_establish_connection(c->conn, &c->info, blocking, errp);
+    if (!c->ioc) {
         return -ECONNREFUSED;
     }
 
-    yank_register_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name), nbd_yank,
-                           bs);
+    yank_register_function(BLOCKDEV_YANK_INSTANCE(bs->node_name), nbd_yank, c);
 
-    ret = nbd_handle_updated_info(s->bs, NULL);
+    if (c == &s->conns[0]) {
+        s->info = c->info;
+        ret = nbd_handle_updated_info(bs, NULL);
+    } else {
+        ret = nbd_check_conn_info(c, errp);
+    }
     if (ret < 0) {
         /*
          * We have connected, but must fail for other reasons.
          * Send NBD_CMD_DISC as a courtesy to the server.
          */
-        NBDRequest request = { .type = NBD_CMD_DISC };
+        NBDRequest request = {
+            .type = NBD_CMD_DISC,
+            .extended = c->info.extended_headers,
+        };
 
-        nbd_send_request(s->ioc, &request);
+        nbd_send_request(c->ioc, &request);
 
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(bs->node_name),
+                                 nbd_yank, c);
+        object_unref(OBJECT(c->ioc));
+        c->ioc = NULL;
 
         return ret;
     }
 
-    qio_channel_set_blocking(s->ioc, false, NULL);
-    qio_channel_attach_aio_context(s->ioc, bdrv_get_aio_context(bs));
+    qio_channel_set_blocking(c->ioc, false, NULL);
+    qio_channel_attach_aio_context(c->ioc, bdrv_get_aio_context(bs));
 
     /* successfully connected */
-    s->state = NBD_CLIENT_CONNECTED;
-    qemu_co_queue_restart_all(&s->free_sema);
+    c->state = NBD_CLIENT_CONNECTED;
+    qemu_co_queue_restart_all(&c->free_sema);
 
     return 0;
 }
 
-/* called under s->send_mutex */
-static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
+int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
+                                                unsigned int conn_index,
+                                                Error **errp)
+{
+    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *c = &s->conns[conn_index];
+
+    return nbd_co_establish_conn(c, nbd_client_connecting_wait(c), errp);
+}
+
+/* called under c->send_mutex */
+static coroutine_fn void nbd_reconnect_attempt(NBDConnState *c, bool blocking)
 {
-    assert(nbd_client_connecting(s));
-    assert(s->in_flight == 0);
+    BDRVNBDState *s = c->s;
 
-    if (nbd_client_connecting_wait(s) && s->reconnect_delay &&
-        !s->reconnect_delay_timer)
+    assert(nbd_client_connecting(c));
+    assert(c->in_flight == 0);
+
+    if (nbd_client_connecting_wait(c) && s->reconnect_delay &&
+        !c->reconnect_delay_timer)
     {
         /*
          * It's first reconnect attempt after switching to
          * NBD_CLIENT_CONNECTING_WAIT
          */
-        reconnect_delay_timer_init(s,
+        reconnect_delay_timer_init(c,
             qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
             s->reconnect_delay * NANOSECONDS_PER_SECOND);
     }
@@ -344,44 +406,85 @@ static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
      */
 
     /* Finalize previous connection if any */
-    if (s->ioc) {
-        qio_channel_detach_aio_context(QIO_CHANNEL(s->ioc));
+    if (c->ioc) {
+        qio_channel_detach_aio_context(QIO_CHANNEL(c->ioc));
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, c);
+        object_unref(OBJECT(c->ioc));
+        c->ioc = NULL;
+    }
+
+    nbd_co_establish_conn(c, blocking && nbd_client_connecting_wait(c), NULL);
+}
+
+/*
+ * Pick the connection for a new request: the connected one with the fewest
+ * requests in flight, preferring them in turn on a tie.  Connections that
+ * were lost are probed without waiting when it is their turn, so that they
+ * come back once the server can be reached again; they are only used for
+ * requests (and the reconnect waited for) if no connection is up.
+ */
+static coroutine_fn NBDConnState *nbd_co_choose_conn(BDRVNBDState *s)
+{
+    NBDConnState *c, *best = NULL;
+    unsigned int i;
+
+    if (s->nr_conns == 1) {
+        return &s->conns[0];
+    }
+
+    c = &s->conns[s->next_conn];
+    if (nbd_client_connecting(c) && c->in_flight == 0) {
+        qemu_co_mutex_lock(&c->send_mutex);
+        if (nbd_client_connecting(c) && c->in_flight == 0) {
+            nbd_reconnect_attempt(c, false);
+        }
+        qemu_co_mutex_unlock(&c->send_mutex);
     }
 
-    nbd_co_do_establish_connection(s->bs, NULL);
+    for (i = 0; i < s->nr_conns; i++) {
+        c = &s->conns[(s->next_conn + i) % s->nr_conns];
+        if (nbd_client_connected(c) &&
+            (!best || c->in_flight < best->in_flight))
+        {
+            best = c;
+        }
+    }
+    if (!best) {
+        best = &s->conns[s->next_conn];
+    }
+
+    s->next_conn = (s->next_conn + 1) % s->nr_conns;
+    return best;
 }
 
-static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
+static coroutine_fn int nbd_receive_replies(NBDConnState *c, uint64_t handle)
 {
     int ret;
-    uint64_t ind = HANDLE_TO_INDEX(s, handle), ind2;
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    uint64_t ind = HANDLE_TO_INDEX(c, handle), ind2;
+    QEMU_LOCK_GUARD(&c->receive_mutex);
 
     while (true) {
-        if (s->reply.handle == handle) {
+        if (c->reply.handle == handle) {
             /* We are done */
             return 0;
         }
 
-        if (!nbd_client_connected(s)) {
+        if (!nbd_client_connected(c)) {
             return -EIO;
         }
 
-        if (s->reply.handle != 0) {
+        if (c->reply.handle != 0) {
             /*
              * Some other request is being handled now. It should already be
-             * woken by whoever set s->reply.handle (or never wait in this
+             * woken by whoever set c->reply.handle (or never wait in this
              * yield). So, we should not wake it here.
              */
-            ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-            assert(!s->requests[ind2].receiving);
+            ind2 = HANDLE_TO_INDEX(c, c->reply.handle);
+            assert(!c->requests[ind2].receiving);
 
-            s->requests[ind].receiving = true;
-            qemu_co_mutex_unlock(&s->receive_mutex);
+            c->requests[ind].receiving = true;
+            qemu_co_mutex_unlock(&c->receive_mutex);
 
             qemu_coroutine_yield();
             /*
@@ -390,68 +493,69 @@ static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
              *    handle is received.
              * 2. From nbd_channel_error(), when connection is lost.
              * 3. From nbd_co_receive_one_chunk(), when previous request is
-             *    finished and s->reply.handle set to 0.
+             *    finished and c->reply.handle set to 0.
              * Anyway, it's OK to lock the mutex and go to the next iteration.
              */
 
-            qemu_co_mutex_lock(&s->receive_mutex);
-            assert(!s->requests[ind].receiving);
+            qemu_co_mutex_lock(&c->receive_mutex);
+            assert(!c->requests[ind].receiving);
             continue;
         }
 
         /* We are under mutex and handle is 0. We have to do the dirty work. */
-        assert(s->reply.handle == 0);
-        ret = nbd_receive_reply(s->bs, s->ioc, &s->reply, NULL);
+        assert(c->reply.handle == 0);
+        ret = nbd_receive_reply(c->s->bs, c->ioc, &c->reply, NULL);
         if (ret <= 0) {
             ret = ret ? ret : -EIO;
-            nbd_channel_error(s, ret);
+            nbd_channel_error(c, ret);
             return ret;
         }
-        if (nbd_reply_is_structured(&s->reply) && !s->info.structured_reply) {
-            nbd_channel_error(s, -EINVAL);
+        if ((nbd_reply_is_structured(&c->reply) &&
+             !c->info.structured_reply) ||
+            nbd_reply_is_extended(&c->reply) != c->info.extended_headers) {
+            nbd_channel_error(c, -EINVAL);
             return -EINVAL;
         }
-        if (s->reply.handle == handle) {
+        if (c->reply.handle == handle) {
             /* We are done */
             return 0;
         }
-        ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-        if (ind2 >= MAX_NBD_REQUESTS || !s->requests[ind2].reply_possible) {
-            nbd_channel_error(s, -EINVAL);
+        ind2 = HANDLE_TO_INDEX(c, c->reply.handle);
+        if (ind2 >= MAX_NBD_REQUESTS || !c->requests[ind2].reply_possible) {
+            nbd_channel_error(c, -EINVAL);
             return -EINVAL;
         }
-        nbd_recv_coroutine_wake_one(&s->requests[ind2]);
+        nbd_recv_coroutine_wake_one(&c->requests[ind2]);
     }
 }
 
-static int nbd_co_send_request(BlockDriverState *bs,
+static int nbd_co_send_request(NBDConnState *c,
                                NBDRequest *request,
                                QEMUIOVector *qiov)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     int rc, i = -1;
 
-    qemu_co_mutex_lock(&s->send_mutex);
+    qemu_co_mutex_lock(&c->send_mutex);
 
-    while (s->in_flight == MAX_NBD_REQUESTS ||
-           (!nbd_client_connected(s) && s->in_flight > 0))
+    while (c->in_flight == MAX_NBD_REQUESTS ||
+           (!nbd_client_connected(c) && c->in_flight > 0))
     {
-        qemu_co_queue_wait(&s->free_sema, &s->send_mutex);
+        qemu_co_queue_wait(&c->free_sema, &c->send_mutex);
     }
 
-    if (nbd_client_connecting(s)) {
-        nbd_reconnect_attempt(s);
+    if (nbd_client_connecting(c)) {
+        nbd_reconnect_attempt(c, true);
     }
 
-    if (!nbd_client_connected(s)) {
+    if (!nbd_client_connected(c)) {
         rc = -EIO;
         goto err;
     }
 
-    s->in_flight++;
+    c->in_flight++;
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (s->requests[i].coroutine == NULL) {
+        if (c->requests[i].coroutine == NULL) {
             break;
         }
     }
@@ -459,41 +563,42 @@ static int nbd_co_send_request(BlockDriverState *bs,
     g_assert(qemu_in_coroutine());
     assert(i < MAX_NBD_REQUESTS);
 
-    s->requests[i].coroutine = qemu_coroutine_self();
-    s->requests[i].offset = request->from;
-    s->requests[i].receiving = false;
-    s->requests[i].reply_possible = true;
+    c->requests[i].coroutine = qemu_coroutine_self();
+    c->requests[i].offset = request->from;
+    c->requests[i].receiving = false;
+    c->requests[i].reply_possible = true;
 
-    request->handle = INDEX_TO_HANDLE(s, i);
+    request->handle = INDEX_TO_HANDLE(c, i);
+    request->extended = c->info.extended_headers;
 
-    assert(s->ioc);
+    assert(c->ioc);
 
     if (qiov) {
-        qio_channel_set_cork(s->ioc, true);
-        rc = nbd_send_request(s->ioc, request);
-        if (nbd_client_connected(s) && rc >= 0) {
-            if (qio_channel_writev_all(s->ioc, qiov->iov, qiov->niov,
+        qio_channel_set_cork(c->ioc, true);
+        rc = nbd_send_request(c->ioc, request);
+        if (nbd_client_connected(c) && rc >= 0) {
+            if (qio_channel_writev_all(c->ioc, qiov->iov, qiov->niov,
                                        NULL) < 0) {
                 rc = -EIO;
             }
         } else if (rc >= 0) {
             rc = -EIO;
         }
-        qio_channel_set_cork(s->ioc, false);
+        qio_channel_set_cork(c->ioc, false);
     } else {
-        rc = nbd_send_request(s->ioc, request);
+        rc = nbd_send_request(c->ioc, request);
     }
 
 err:
     if (rc < 0) {
-        nbd_channel_error(s, rc);
+        nbd_channel_error(c, rc);
         if (i != -1) {
-            s->requests[i].coroutine = NULL;
-            s->in_flight--;
-            qemu_co_queue_next(&s->free_sema);
+            c->requests[i].coroutine = NULL;
+            c->in_flight--;
+            qemu_co_queue_next(&c->free_sema);
         }
     }
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_unlock(&c->send_mutex);
     return rc;
 }
 
@@ -515,7 +620,7 @@ static inline uint64_t payload_advance64(uint8_t **payload)
     return ldq_be_p(*payload - 8);
 }
 
-static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
+static int nbd_parse_offset_hole_payload(NBDConnState *c,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_offset,
                                          QEMUIOVector *qiov, Error **errp)
@@ -538,8 +643,8 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
                          " region");
         return -EINVAL;
     }
-    if (s->info.min_block &&
-        !QEMU_IS_ALIGNED(hole_size, s->info.min_block)) {
+    if (c->info.min_block &&
+        !QEMU_IS_ALIGNED(hole_size, c->info.min_block)) {
         trace_nbd_structured_read_compliance("hole");
     }
 
@@ -551,33 +656,49 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
 /*
  * nbd_parse_blockstatus_payload
  * Based on our request, we expect only one extent in reply, for the
- * base:allocation context.
+ * base:allocation context.  With extended headers, the extent is sent in
+ * a NBD_REPLY_TYPE_BLOCK_STATUS_EXT chunk and has a 64-bit length.
  */
-static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
+static int nbd_parse_blockstatus_payload(NBDConnState *c,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_length,
-                                         NBDExtent *extent, Error **errp)
+                                         NBDExtent64 *extent, Error **errp)
 {
+    const char *type = nbd_reply_type_lookup(chunk->type);
+    bool extended = chunk->type == NBD_REPLY_TYPE_BLOCK_STATUS_EXT;
+    size_t hdr_len = extended ? sizeof(NBDExtendedMeta) : sizeof(uint32_t);
+    size_t extent_len = extended ? sizeof(NBDExtent64) : sizeof(NBDExtent32);
     uint32_t context_id;
+    uint32_t count;
 
     /* The server succeeded, so it must have sent [at least] one extent */
-    if (chunk->length < sizeof(context_id) + sizeof(*extent)) {
-        error_setg(errp, "Protocol error: invalid payload for "
-                         "NBD_REPLY_TYPE_BLOCK_STATUS");
+    if (chunk->length < hdr_len + extent_len) {
+        error_setg(errp, "Protocol error: invalid payload for %s", type);
         return -EINVAL;
     }
 
     context_id = payload_advance32(&payload);
-    if (s->info.context_id != context_id) {
+    if (c->info.context_id != context_id) {
         error_setg(errp, "Protocol error: unexpected context id %d for "
-                         "NBD_REPLY_TYPE_BLOCK_STATUS, when negotiated context "
-                         "id is %d", context_id,
-                         s->info.context_id);
+                         "%s, when negotiated context id is %d", context_id,
+                         type, c->info.context_id);
         return -EINVAL;
     }
 
-    extent->length = payload_advance32(&payload);
-    extent->flags = payload_advance32(&payload);
+    if (extended) {
+        count = payload_advance32(&payload);
+        if (!count || count > (chunk->length - hdr_len) / extent_len) {
+            error_setg(errp, "Protocol error: invalid extent count %" PRIu32
+                       " for %s", count, type);
+            return -EINVAL;
+        }
+        extent->length = payload_advance64(&payload);
+        extent->flags = payload_advance64(&payload);
+    } else {
+        count = (chunk->length - hdr_len) / extent_len;
+        extent->length = payload_advance32(&payload);
+        extent->flags = payload_advance32(&payload);
+    }
 
     if (extent->length == 0) {
         error_setg(errp, "Protocol error: server sent status chunk with "
@@ -597,14 +718,14 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
      * up to the full block and change the status to fully-allocated
      * (always a safe status, even if it loses information).
      */
-    if (s->info.min_block && !QEMU_IS_ALIGNED(extent->length,
-                                                   s->info.min_block)) {
+    if (c->info.min_block && !QEMU_IS_ALIGNED(extent->length,
+                                                   c->info.min_block)) {
         trace_nbd_parse_blockstatus_compliance("extent length is unaligned");
-        if (extent->length > s->info.min_block) {
+        if (extent->length > c->info.min_block) {
             extent->length = QEMU_ALIGN_DOWN(extent->length,
-                                             s->info.min_block);
+                                             c->info.min_block);
         } else {
-            extent->length = s->info.min_block;
+            extent->length = c->info.min_block;
             extent->flags = 0;
         }
     }
@@ -617,7 +738,7 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
      * connection; just ignore trailing extents, and clamp things to
      * the length of our request.
      */
-    if (chunk->length > sizeof(context_id) + sizeof(*extent)) {
+    if (count > 1) {
         trace_nbd_parse_blockstatus_compliance("more than one extent");
     }
     if (extent->length > orig_length) {
@@ -631,7 +752,7 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
      * since nbd_client_co_block_status is only expecting the low two
      * bits to be set.
      */
-    if (s->alloc_depth && extent->flags > 2) {
+    if (c->s->alloc_depth && extent->flags > 2) {
         extent->flags = 2;
     }
 
@@ -680,7 +801,7 @@ static int nbd_parse_error_payload(NBDStructuredReplyChunk *chunk,
     return 0;
 }
 
-static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
+static int nbd_co_receive_offset_data_payload(NBDConnState *c,
                                               uint64_t orig_offset,
                                               QEMUIOVector *qiov, Error **errp)
 {
@@ -688,9 +809,9 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
     uint64_t offset;
     size_t data_size;
     int ret;
-    NBDStructuredReplyChunk *chunk = &s->reply.structured;
+    NBDStructuredReplyChunk *chunk = &c->reply.structured;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&c->reply));
 
     /* The NBD spec requires at least one byte of payload */
     if (chunk->length <= sizeof(offset)) {
@@ -699,7 +820,7 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
         return -EINVAL;
     }
 
-    if (nbd_read64(s->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
+    if (nbd_read64(c->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
         return -EIO;
     }
 
@@ -711,13 +832,13 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
                          " region");
         return -EINVAL;
     }
-    if (s->info.min_block && !QEMU_IS_ALIGNED(data_size, s->info.min_block)) {
+    if (c->info.min_block && !QEMU_IS_ALIGNED(data_size, c->info.min_block)) {
         trace_nbd_structured_read_compliance("data");
     }
 
     qemu_iovec_init(&sub_qiov, qiov->niov);
     qemu_iovec_concat(&sub_qiov, qiov, offset - orig_offset, data_size);
-    ret = qio_channel_readv_all(s->ioc, sub_qiov.iov, sub_qiov.niov, errp);
+    ret = qio_channel_readv_all(c->ioc, sub_qiov.iov, sub_qiov.niov, errp);
     qemu_iovec_destroy(&sub_qiov);
 
     return ret < 0 ? -EIO : 0;
@@ -725,14 +846,14 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
 
 #define NBD_MAX_MALLOC_PAYLOAD 1000
 static coroutine_fn int nbd_co_receive_structured_payload(
-        BDRVNBDState *s, void **payload, Error **errp)
+        NBDConnState *c, void **payload, Error **errp)
 {
     int ret;
     uint32_t len;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&c->reply));
 
-    len = s->reply.structured.length;
+    len = c->reply.structured.length;
 
     if (len == 0) {
         return 0;
@@ -749,7 +870,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
     }
 
     *payload = g_new(char, len);
-    ret = nbd_read(s->ioc, *payload, len, "structured payload", errp);
+    ret = nbd_read(c->ioc, *payload, len, "structured payload", errp);
     if (ret < 0) {
         g_free(*payload);
         *payload = NULL;
@@ -775,11 +896,11 @@ static coroutine_fn int nbd_co_receive_structured_payload(
  * corresponding to the server's error reply), and errp is unchanged.
  */
 static coroutine_fn int nbd_co_do_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *c, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, void **payload, Error **errp)
 {
     int ret;
-    int i = HANDLE_TO_INDEX(s, handle);
+    int i = HANDLE_TO_INDEX(c, handle);
     void *local_payload = NULL;
     NBDStructuredReplyChunk *chunk;
 
@@ -788,34 +909,34 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
     }
     *request_ret = 0;
 
-    nbd_receive_replies(s, handle);
-    if (!nbd_client_connected(s)) {
+    nbd_receive_replies(c, handle);
+    if (!nbd_client_connected(c)) {
         error_setg(errp, "Connection closed");
         return -EIO;
     }
-    assert(s->ioc);
+    assert(c->ioc);
 
-    assert(s->reply.handle == handle);
+    assert(c->reply.handle == handle);
 
-    if (nbd_reply_is_simple(&s->reply)) {
+    if (nbd_reply_is_simple(&c->reply)) {
         if (only_structured) {
             error_setg(errp, "Protocol error: simple reply when structured "
                              "reply chunk was expected");
             return -EINVAL;
         }
 
-        *request_ret = -nbd_errno_to_system_errno(s->reply.simple.error);
+        *request_ret = -nbd_errno_to_system_errno(c->reply.simple.error);
         if (*request_ret < 0 || !qiov) {
             return 0;
         }
 
-        return qio_channel_readv_all(s->ioc, qiov->iov, qiov->niov,
+        return qio_channel_readv_all(c->ioc, qiov->iov, qiov->niov,
                                      errp) < 0 ? -EIO : 0;
     }
 
     /* handle structured reply chunk */
-    assert(s->info.structured_reply);
-    chunk = &s->reply.structured;
+    assert(c->info.structured_reply);
+    chunk = &c->reply.structured;
 
     if (chunk->type == NBD_REPLY_TYPE_NONE) {
         if (!(chunk->flags & NBD_REPLY_FLAG_DONE)) {
@@ -837,7 +958,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
             return -EINVAL;
         }
 
-        return nbd_co_receive_offset_data_payload(s, s->requests[i].offset,
+        return nbd_co_receive_offset_data_payload(c, c->requests[i].offset,
                                                   qiov, errp);
     }
 
@@ -845,7 +966,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
         payload = &local_payload;
     }
 
-    ret = nbd_co_receive_structured_payload(s, payload, errp);
+    ret = nbd_co_receive_structured_payload(c, payload, errp);
     if (ret < 0) {
         return ret;
     }
@@ -865,23 +986,23 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
  * Return value is a fatal error code or normal nbd reply error code
  */
 static coroutine_fn int nbd_co_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *c, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, NBDReply *reply, void **payload,
         Error **errp)
 {
-    int ret = nbd_co_do_receive_one_chunk(s, handle, only_structured,
+    int ret = nbd_co_do_receive_one_chunk(c, handle, only_structured,
                                           request_ret, qiov, payload, errp);
 
     if (ret < 0) {
         memset(reply, 0, sizeof(*reply));
-        nbd_channel_error(s, ret);
+        nbd_channel_error(c, ret);
     } else {
         /* For assert at loop start in nbd_connection_entry */
-        *reply = s->reply;
+        *reply = c->reply;
     }
-    s->reply.handle = 0;
+    c->reply.handle = 0;
 
-    nbd_recv_coroutines_wake(s, false);
+    nbd_recv_coroutines_wake(c, false);
 
     return ret;
 }
@@ -922,16 +1043,16 @@ static void nbd_iter_request_error(NBDReplyChunkIter *iter, int ret)
  * NBD_FOREACH_REPLY_CHUNK
  * The pointer stored in @payload requires g_free() to free it.
  */
-#define NBD_FOREACH_REPLY_CHUNK(s, iter, handle, structured, \
+#define NBD_FOREACH_REPLY_CHUNK(c, iter, handle, structured, \
                                 qiov, reply, payload) \
     for (iter = (NBDReplyChunkIter) { .only_structured = structured }; \
-         nbd_reply_chunk_iter_receive(s, &iter, handle, qiov, reply, payload);)
+         nbd_reply_chunk_iter_receive(c, &iter, handle, qiov, reply, payload);)
 
 /*
  * nbd_reply_chunk_iter_receive
  * The pointer stored in @payload requires g_free() to free it.
  */
-static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
+static bool nbd_reply_chunk_iter_receive(NBDConnState *c,
                                          NBDReplyChunkIter *iter,
                                          uint64_t handle,
                                          QEMUIOVector *qiov, NBDReply *reply,
@@ -941,7 +1062,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     NBDReply local_reply;
     NBDStructuredReplyChunk *chunk;
     Error *local_err = NULL;
-    if (!nbd_client_connected(s)) {
+    if (!nbd_client_connected(c)) {
         error_setg(&local_err, "Connection closed");
         nbd_iter_channel_error(iter, -EIO, &local_err);
         goto break_loop;
@@ -956,7 +1077,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
         reply = &local_reply;
     }
 
-    ret = nbd_co_receive_one_chunk(s, handle, iter->only_structured,
+    ret = nbd_co_receive_one_chunk(c, handle, iter->only_structured,
                                    &request_ret, qiov, reply, payload,
                                    &local_err);
     if (ret < 0) {
@@ -966,7 +1087,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     }
 
     /* Do not execute the body of NBD_FOREACH_REPLY_CHUNK for simple reply. */
-    if (nbd_reply_is_simple(reply) || !nbd_client_connected(s)) {
+    if (nbd_reply_is_simple(reply) || !nbd_client_connected(c)) {
         goto break_loop;
     }
 
@@ -988,22 +1109,22 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     return true;
 
 break_loop:
-    s->requests[HANDLE_TO_INDEX(s, handle)].coroutine = NULL;
+    c->requests[HANDLE_TO_INDEX(c, handle)].coroutine = NULL;
 
-    qemu_co_mutex_lock(&s->send_mutex);
-    s->in_flight--;
-    qemu_co_queue_next(&s->free_sema);
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_lock(&c->send_mutex);
+    c->in_flight--;
+    qemu_co_queue_next(&c->free_sema);
+    qemu_co_mutex_unlock(&c->send_mutex);
 
     return false;
 }
 
-static int nbd_co_receive_return_code(BDRVNBDState *s, uint64_t handle,
+static int nbd_co_receive_return_code(NBDConnState *c, uint64_t handle,
                                       int *request_ret, Error **errp)
 {
     NBDReplyChunkIter iter;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, NULL, NULL) {
+    NBD_FOREACH_REPLY_CHUNK(c, iter, handle, false, NULL, NULL, NULL) {
         /* nbd_reply_chunk_iter_receive does all the work */
     }
 
@@ -1012,7 +1133,7 @@ static int nbd_co_receive_return_code(BDRVNBDState *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
+static int nbd_co_receive_cmdread_reply(NBDConnState *c, uint64_t handle,
                                         uint64_t offset, QEMUIOVector *qiov,
                                         int *request_ret, Error **errp)
 {
@@ -1021,7 +1142,7 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
     void *payload = NULL;
     Error *local_err = NULL;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, s->info.structured_reply,
+    NBD_FOREACH_REPLY_CHUNK(c, iter, handle, c->info.structured_reply,
                             qiov, &reply, &payload)
     {
         int ret;
@@ -1037,17 +1158,17 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
              */
             break;
         case NBD_REPLY_TYPE_OFFSET_HOLE:
-            ret = nbd_parse_offset_hole_payload(s, &reply.structured, payload,
+            ret = nbd_parse_offset_hole_payload(c, &reply.structured, payload,
                                                 offset, qiov, &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(c, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
                 /* not allowed reply type */
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(c, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) for CMD_READ",
                            chunk->type, nbd_reply_type_lookup(chunk->type));
@@ -1064,9 +1185,9 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
+static int nbd_co_receive_blockstatus_reply(NBDConnState *c,
                                             uint64_t handle, uint64_t length,
-                                            NBDExtent *extent,
+                                            NBDExtent64 *extent,
                                             int *request_ret, Error **errp)
 {
     NBDReplyChunkIter iter;
@@ -1076,7 +1197,7 @@ static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
     bool received = false;
 
     assert(!extent->length);
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, &reply, &payload) {
+    NBD_FOREACH_REPLY_CHUNK(c, iter, handle, false, NULL, &reply, &payload) {
         int ret;
         NBDStructuredReplyChunk *chunk = &reply.structured;
 
@@ -1084,24 +1205,34 @@ static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
 
         switch (chunk->type) {
         case NBD_REPLY_TYPE_BLOCK_STATUS:
+        case NBD_REPLY_TYPE_BLOCK_STATUS_EXT:
+            if ((chunk->type == NBD_REPLY_TYPE_BLOCK_STATUS_EXT) !=
+                c->info.extended_headers) {
+                nbd_channel_error(c, -EINVAL);
+                error_setg(&local_err, "Unexpected reply type: %d (%s) "
+                           "for the negotiated header size", chunk->type,
+                           nbd_reply_type_lookup(chunk->type));
+                nbd_iter_channel_error(&iter, -EINVAL, &local_err);
+                break;
+            }
             if (received) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(c, -EINVAL);
                 error_setg(&local_err, "Several BLOCK_STATUS chunks in reply");
                 nbd_iter_channel_error(&iter, -EINVAL, &local_err);
             }
             received = true;
 
-            ret = nbd_parse_blockstatus_payload(s, &reply.structured,
+            ret = nbd_parse_blockstatus_payload(c, &reply.structured,
                                                 payload, length, extent,
                                                 &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(c, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(c, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) "
                            "for CMD_BLOCK_STATUS",
@@ -1130,6 +1261,7 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *c;
 
     assert(request->type != NBD_CMD_READ);
     if (write_qiov) {
@@ -1140,12 +1272,13 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     }
 
     do {
-        ret = nbd_co_send_request(bs, request, write_qiov);
+        c = nbd_co_choose_conn(s);
+        ret = nbd_co_send_request(c, request, write_qiov);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_return_code(s, request->handle,
+        ret = nbd_co_receive_return_code(c, request->handle,
                                          &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request->from, request->len,
@@ -1156,7 +1289,7 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(c));
 
     return ret ? ret : request_ret;
 }
@@ -1168,6 +1301,7 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *c;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -1200,12 +1334,13 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
     }
 
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        c = nbd_co_choose_conn(s);
+        ret = nbd_co_send_request(c, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_cmdread_reply(s, request.handle, offset, qiov,
+        ret = nbd_co_receive_cmdread_reply(c, request.handle, offset, qiov,
                                            &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request.from, request.len, request.handle,
@@ -1215,7 +1350,7 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(c));
 
     return ret ? ret : request_ret;
 }
@@ -1320,18 +1455,23 @@ static int coroutine_fn nbd_client_co_block_status(
         int64_t *pnum, int64_t *map, BlockDriverState **file)
 {
     int ret, request_ret;
-    NBDExtent extent = { 0 };
+    NBDExtent64 extent = { 0 };
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *c;
     Error *local_err = NULL;
 
     NBDRequest request = {
         .type = NBD_CMD_BLOCK_STATUS,
         .from = offset,
-        .len = MIN(QEMU_ALIGN_DOWN(INT_MAX, bs->bl.request_alignment),
-                   MIN(bytes, s->info.size - offset)),
+        .len = MIN(bytes, s->info.size - offset),
         .flags = NBD_CMD_FLAG_REQ_ONE,
     };
 
+    if (!s->info.extended_headers) {
+        request.len = MIN(QEMU_ALIGN_DOWN(INT_MAX, bs->bl.request_alignment),
+                          request.len);
+    }
+
     if (!s->info.base_allocation) {
         *pnum = bytes;
         *map = offset;
@@ -1357,12 +1497,13 @@ static int coroutine_fn nbd_client_co_block_status(
         assert(QEMU_IS_ALIGNED(request.len, s->info.min_block));
     }
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        c = nbd_co_choose_conn(s);
+        ret = nbd_co_send_request(c, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_blockstatus_reply(s, request.handle, bytes,
+        ret = nbd_co_receive_blockstatus_reply(c, request.handle, bytes,
                                                &extent, &request_ret,
                                                &local_err);
         if (local_err) {
@@ -1373,7 +1514,7 @@ static int coroutine_fn nbd_client_co_block_status(
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(c));
 
     if (ret < 0 || request_ret < 0) {
         return ret ? ret : request_ret;
@@ -1402,23 +1543,28 @@ static int nbd_client_reopen_prepare(BDRVReopenState *state,
 
 static void nbd_yank(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *c = opaque;
 
-    qatomic_store_release(&s->state, NBD_CLIENT_QUIT);
-    qio_channel_shutdown(QIO_CHANNEL(s->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    qatomic_store_release(&c->state, NBD_CLIENT_QUIT);
+    qio_channel_shutdown(QIO_CHANNEL(c->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
 }
 
 static void nbd_client_close(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     NBDRequest request = { .type = NBD_CMD_DISC };
+    unsigned int i;
 
-    if (s->ioc) {
-        nbd_send_request(s->ioc, &request);
-    }
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *c = &s->conns[i];
 
-    nbd_teardown_connection(bs);
+        if (c->ioc) {
+            request.extended = c->info.extended_headers;
+            nbd_send_request(c->ioc, &request);
+        }
+
+        nbd_teardown_connection(c);
+    }
 }
 
 
@@ -1742,6 +1888,12 @@ static QemuOptsList nbd_runtime_opts = {
                     "future requests before a successful reconnect will "
                     "immediately fail. Default 0",
         },
+        {
+            .name = "multi-conn",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of connections to open to the server, if it "
+                    "allows several ones. Default 1",
+        },
         { /* end of list */ }
     },
 };
@@ -1798,6 +1950,13 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
 
     s->reconnect_delay = qemu_opt_get_number(opts, "reconnect-delay", 0);
 
+    s->multi_conn = qemu_opt_get_number(opts, "multi-conn", 1);
+    if (s->multi_conn < 1 || s->multi_conn > MAX_NBD_CONNECTIONS) {
+        error_setg(errp, "multi-conn must be between 1 and %d",
+                   MAX_NBD_CONNECTIONS);
+        goto error;
+    }
+
     ret = 0;
 
  error:
@@ -1805,16 +1964,30 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     return ret;
 }
 
+static void nbd_add_conn(BDRVNBDState *s)
+{
+    NBDConnState *c = &s->conns[s->nr_conns++];
+
+    c->s = s;
+    qemu_co_mutex_init(&c->send_mutex);
+    qemu_co_queue_init(&c->free_sema);
+    qemu_co_mutex_init(&c->receive_mutex);
+
+    c->conn = nbd_client_connection_new(s->saddr, true, s->export,
+                                        s->x_dirty_bitmap, s->tlscreds);
+
+    /* TODO: Configurable retry-until-timeout behaviour. */
+    c->state = NBD_CLIENT_CONNECTING_WAIT;
+}
+
 static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
 {
     int ret;
+    unsigned int i;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
 
     s->bs = bs;
-    qemu_co_mutex_init(&s->send_mutex);
-    qemu_co_queue_init(&s->free_sema);
-    qemu_co_mutex_init(&s->receive_mutex);
 
     if (!yank_register_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name), errp)) {
         return -EEXIST;
@@ -1825,20 +1998,41 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
-    s->conn = nbd_client_connection_new(s->saddr, true, s->export,
-                                        s->x_dirty_bitmap, s->tlscreds);
+    s->conns = g_new0(NBDConnState, s->multi_conn);
 
-    /* TODO: Configurable retry-until-timeout behaviour. */
-    s->state = NBD_CLIENT_CONNECTING_WAIT;
-    ret = nbd_do_establish_connection(bs, errp);
+    nbd_add_conn(s);
+    ret = nbd_do_establish_connection(bs, 0, errp);
     if (ret < 0) {
         goto fail;
     }
 
-    nbd_client_connection_enable_retry(s->conn);
+    /*
+     * Only a server that advertises NBD_FLAG_CAN_MULTI_CONN guarantees that
+     * a flush on one connection covers the writes completed on the others.
+     */
+    if (s->multi_conn > 1 && !(s->info.flags & NBD_FLAG_CAN_MULTI_CONN)) {
+        warn_report("NBD server does not support multiple connections, "
+                    "using a single one");
+        s->multi_conn = 1;
+    }
+
+    while (s->nr_conns < s->multi_conn) {
+        nbd_add_conn(s);
+        ret = nbd_do_establish_connection(bs, s->nr_conns - 1, errp);
+        if (ret < 0) {
+            goto fail_conns;
+        }
+    }
+
+    for (i = 0; i < s->nr_conns; i++) {
+        nbd_client_connection_enable_retry(s->conns[i].conn);
+    }
 
     return 0;
 
+fail_conns:
+    nbd_client_close(bs);
+
 fail:
     nbd_clear_bdrvstate(bs);
     return ret;
@@ -1982,15 +2176,20 @@ static const char *const nbd_strong_runtime_opts[] = {
 static void nbd_cancel_in_flight(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
 
-    reconnect_delay_timer_del(s);
+    for (i = 0; i < s->nr_conns; i++) {
+        NBDConnState *c = &s->conns[i];
 
-    if (s->state == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-        qemu_co_queue_restart_all(&s->free_sema);
-    }
+        reconnect_delay_timer_del(c);
 
-    nbd_co_establish_connection_cancel(s->conn);
+        if (c->state == NBD_CLIENT_CONNECTING_WAIT) {
+            c->state = NBD_CLIENT_CONNECTING_NOWAIT;
+            qemu_co_queue_restart_all(&c->free_sema);
+        }
+
+        nbd_co_establish_connection_cancel(c->conn);
+    }
 }
 
 static BlockDriver bdrv_nbd = {
@@ -121,6 +121,7 @@ struct BDRVNVMeState {
 
     bool supports_write_zeroes;
     bool supports_discard;
+    bool supports_sgl;
 
     CoMutex dma_map_lock;
     CoQueue dma_flush_queue;
@@ -560,6 +561,8 @@ static bool nvme_identify(BlockDriverState *bs, int namespace, Error **errp)
     oncs = le16_to_cpu(id->ctrl.oncs);
     s->supports_write_zeroes = !!(oncs & NVME_ONCS_WRITE_ZEROES);
     s->supports_discard = !!(oncs & NVME_ONCS_DSM);
+    s->supports_sgl = !!(le32_to_cpu(id->ctrl.sgls) &
+                         NVME_CTRL_SGLS_SUPPORT_MASK);
 
     memset(id, 0, id_size);
     cmd.cdw10 = 0;
@@ -1017,9 +1020,16 @@ static coroutine_fn int nvme_cmd_map_qiov(BlockDriverState *bs, NvmeCmd *cmd,
 {
     BDRVNVMeState *s = bs->opaque;
     uint64_t *pagelist = req->prp_list_page;
+    NvmeSglDescriptor *sgl = req->prp_list_page;
     int i, j, r;
     int entries = 0;
     Error *local_err = NULL, **errp = NULL;
+    /*
+     * With SGLs each iovec takes a single descriptor instead of one PRP
+     * entry per page, as long as the descriptors fit in the list page.
+     */
+    bool use_sgl = s->supports_sgl &&
+                   qiov->niov <= s->page_size / sizeof(NvmeSglDescriptor);
 
     assert(qiov->size);
     assert(QEMU_IS_ALIGNED(qiov->size, s->page_size));
@@ -1075,8 +1085,16 @@ try_map:
             goto fail;
         }
 
-        for (j = 0; j < qiov->iov[i].iov_len / s->page_size; j++) {
-            pagelist[entries++] = cpu_to_le64(iova + j * s->page_size);
+        if (use_sgl) {
+            sgl[entries++] = (NvmeSglDescriptor) {
+                .addr = cpu_to_le64(iova),
+                .len = cpu_to_le32(qiov->iov[i].iov_len),
+                .type = NVME_SGL_DESCR_TYPE_DATA_BLOCK << 4,
+            };
+        } else {
+            for (j = 0; j < qiov->iov[i].iov_len / s->page_size; j++) {
+                pagelist[entries++] = cpu_to_le64(iova + j * s->page_size);
+            }
         }
         trace_nvme_cmd_map_qiov_iov(s, i, qiov->iov[i].iov_base,
                                     qiov->iov[i].iov_len / s->page_size);
@@ -1084,6 +1102,21 @@ try_map:
 
     s->dma_map_count += qiov->size;
 
+    if (use_sgl) {
+        if (entries == 1) {
+            cmd->dptr.sgl = sgl[0];
+        } else {
+            cmd->dptr.sgl = (NvmeSglDescriptor) {
+                .addr = cpu_to_le64(req->prp_list_iova),
+                .len = cpu_to_le32(entries * sizeof(NvmeSglDescriptor)),
+                .type = NVME_SGL_DESCR_TYPE_LAST_SEGMENT << 4,
+            };
+        }
+        cmd->flags |= NVME_PSDT_SGL_MPTR_CONTIGUOUS << 6;
+        trace_nvme_cmd_map_qiov_sgl(s, cmd, req, qiov, entries);
+        return 0;
+    }
+
     assert(entries <= s->page_size / sizeof(uint64_t));
     switch (entries) {
     case 0:
@@ -30,6 +30,7 @@
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/units.h"
+#include "qemu/coroutine.h"
 #include "block/block_int.h"
 
 
@@ -74,6 +75,15 @@ typedef struct BDRVPreallocateState {
      * be invalid (< 0) when we don't have both exclusive BLK_PERM_RESIZE and
      * BLK_PERM_WRITE permissions on file child.
      */
+
+    /*
+     * True while a preallocation request is in flight, either in the write
+     * path or in the background.  Only one runs at a time, and @file_end is
+     * only changed when it completes; requests that need @file_end to move
+     * wait in @grow_queue.
+     */
+    bool growing;
+    CoQueue grow_queue;
 } BDRVPreallocateState;
 
 #define PREALLOCATE_OPT_PREALLOC_ALIGN "prealloc-align"
@@ -140,6 +150,7 @@ static int preallocate_open(BlockDriverState *bs, QDict *options, int flags,
      * For this to work, mark them invalid.
      */
     s->file_end = s->zero_start = s->data_end = -EINVAL;
+    qemu_co_queue_init(&s->grow_queue);
 
     bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
                                BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
@@ -162,11 +173,27 @@ static int preallocate_open(BlockDriverState *bs, QDict *options, int flags,
     return 0;
 }
 
+/* Wait until no preallocation request is in flight. */
+static void preallocate_wait_growth(BlockDriverState *bs)
+{
+    BDRVPreallocateState *s = bs->opaque;
+
+    if (qemu_in_coroutine()) {
+        while (s->growing) {
+            qemu_co_queue_wait(&s->grow_queue, NULL);
+        }
+    } else {
+        BDRV_POLL_WHILE(bs, s->growing);
+    }
+}
+
 static void preallocate_close(BlockDriverState *bs)
 {
     int ret;
     BDRVPreallocateState *s = bs->opaque;
 
+    preallocate_wait_growth(bs);
+
     if (s->data_end < 0) {
         return;
     }
@@ -261,6 +288,63 @@ static bool has_prealloc_perms(BlockDriverState *bs)
     return false;
 }
 
+/*
+ * Preallocate [@start, @end) and move s->file_end to @end.  @start must not
+ * be beyond s->file_end, and no other preallocation may be in flight.
+ */
+static int coroutine_fn preallocate_grow(BlockDriverState *bs,
+                                         int64_t start, int64_t end)
+{
+    BDRVPreallocateState *s = bs->opaque;
+    int ret;
+
+    assert(!s->growing && start <= s->file_end);
+    s->growing = true;
+
+    ret = bdrv_co_pwrite_zeroes(
+            bs->file, start, end - start,
+            BDRV_REQ_NO_FALLBACK | BDRV_REQ_SERIALISING | BDRV_REQ_NO_WAIT);
+    s->file_end = ret < 0 ? ret : end;
+
+    s->growing = false;
+    qemu_co_queue_restart_all(&s->grow_queue);
+
+    return ret;
+}
+
+static void coroutine_fn preallocate_grow_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVPreallocateState *s = bs->opaque;
+    int64_t end = QEMU_ALIGN_UP(s->data_end + s->opts.prealloc_size,
+                                s->opts.prealloc_align);
+
+    if (!s->growing && s->file_end >= 0 && end > s->file_end) {
+        preallocate_grow(bs, s->file_end, end);
+    }
+
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start growing the file in the background once writes get within half of
+ * prealloc-size of its end, so that a sequential writer finds the space
+ * already preallocated instead of waiting for it.
+ */
+static void preallocate_maybe_grow_ahead(BlockDriverState *bs, int64_t end)
+{
+    BDRVPreallocateState *s = bs->opaque;
+    Coroutine *co;
+
+    if (s->growing || end + s->opts.prealloc_size / 2 <= s->file_end) {
+        return;
+    }
+
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(preallocate_grow_entry, bs);
+    aio_co_enter(bdrv_get_aio_context(bs), co);
+}
+
 /*
  * Call on each write. Returns true if @want_merge_zero is true and the region
  * [offset, offset + bytes) is zeroed (as a result of this call or earlier
@@ -315,24 +399,36 @@ static bool coroutine_fn handle_write(BlockDriverState *bs, int64_t offset,
 
     if (end <= s->file_end) {
         /* No preallocation needed. */
+        preallocate_maybe_grow_ahead(bs, end);
         return want_merge_zero && offset >= s->zero_start;
     }
 
-    /* Now we want new preallocation, as request writes beyond s->file_end. */
+    /*
+     * Now we want new preallocation, as request writes beyond s->file_end.
+     * If the file is already being grown, that may cover this request.
+     */
+    if (s->growing) {
+        preallocate_wait_growth(bs);
+        if (s->file_end < 0) {
+            s->file_end = bdrv_getlength(bs->file->bs);
+            if (s->file_end < 0) {
+                return false;
+            }
+        }
+        if (end <= s->file_end) {
+            return want_merge_zero && offset >= s->zero_start;
+        }
+    }
 
     prealloc_start = want_merge_zero ? MIN(offset, s->file_end) : s->file_end;
     prealloc_end = QEMU_ALIGN_UP(end + s->opts.prealloc_size,
                                  s->opts.prealloc_align);
 
-    ret = bdrv_co_pwrite_zeroes(
-            bs->file, prealloc_start, prealloc_end - prealloc_start,
-            BDRV_REQ_NO_FALLBACK | BDRV_REQ_SERIALISING | BDRV_REQ_NO_WAIT);
+    ret = preallocate_grow(bs, prealloc_start, prealloc_end);
     if (ret < 0) {
-        s->file_end = ret;
         return false;
     }
 
-    s->file_end = prealloc_end;
     return want_merge_zero;
 }
 
@@ -370,6 +466,8 @@ preallocate_co_truncate(BlockDriverState *bs, int64_t offset,
     BDRVPreallocateState *s = bs->opaque;
     int ret;
 
+    preallocate_wait_growth(bs);
+
     if (s->data_end >= 0 && offset > s->data_end) {
         if (s->file_end < 0) {
             s->file_end = bdrv_getlength(bs->file->bs);
@@ -456,6 +554,8 @@ static int preallocate_check_perm(BlockDriverState *bs,
 {
     BDRVPreallocateState *s = bs->opaque;
 
+    preallocate_wait_growth(bs);
+
     if (s->data_end >= 0 && !can_write_resize(perm)) {
         /*
          * Lose permissions.
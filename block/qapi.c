@@ -661,6 +661,49 @@ BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
     return head;
 }
 
+static BlockLatencyHistogramInfo *
+bdrv_node_latency_histogram(BlockNodeLatencyStats *stats,
+                            enum BlockAcctType type)
+{
+    BlockLatencyHistogramInfo *info = g_new0(BlockLatencyHistogramInfo, 1);
+    uint64List **boundaries = &info->boundaries;
+    uint64List **bins = &info->bins;
+    unsigned i;
+
+    for (i = 0; i < BLOCK_NODE_LATENCY_BINS; i++) {
+        if (i > 0) {
+            QAPI_LIST_APPEND(boundaries, block_node_latency_boundary(i));
+        }
+        QAPI_LIST_APPEND(bins, stat64_get(&stats->bins[type][i]));
+    }
+    return info;
+}
+
+BlockNodeLatencyList *qmp_query_block_latency(Error **errp)
+{
+    BlockNodeLatencyList *head = NULL, **tail = &head;
+    BlockDriverState *bs;
+
+    for (bs = bdrv_next_node(NULL); bs; bs = bdrv_next_node(bs)) {
+        BlockNodeLatencyStats *stats = &bs->latency_stats;
+        BlockNodeLatency *info = g_new0(BlockNodeLatency, 1);
+
+        info->node_name = g_strdup(bdrv_get_node_name(bs));
+        info->in_flight = qatomic_read(&bs->in_flight);
+        info->rd_latency_histogram =
+            bdrv_node_latency_histogram(stats, BLOCK_ACCT_READ);
+        info->wr_latency_histogram =
+            bdrv_node_latency_histogram(stats, BLOCK_ACCT_WRITE);
+        info->flush_latency_histogram =
+            bdrv_node_latency_histogram(stats, BLOCK_ACCT_FLUSH);
+        info->discard_latency_histogram =
+            bdrv_node_latency_histogram(stats, BLOCK_ACCT_UNMAP);
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
+
 void bdrv_snapshot_dump(QEMUSnapshotInfo *sn)
 {
     char clock_buf[128];
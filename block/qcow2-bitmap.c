@@ -45,6 +45,12 @@
 /* Size of bitmap table entries */
 #define BME_TABLE_ENTRY_SIZE (sizeof(uint64_t))
 
+/*
+ * Bitmap data clusters that are contiguous in the image file are read and
+ * written with a single request of up to this size.
+ */
+#define BME_IO_MAX_SIZE (4 * MiB)
+
 QEMU_BUILD_BUG_ON(BME_MAX_NAME_SIZE != BDRV_BITMAP_MAX_NAME_SIZE);
 
 #if BME_MAX_TABLE_SIZE * 8ULL > INT_MAX
@@ -291,7 +297,7 @@ static int load_bitmap_data(BlockDriverState *bs,
     uint64_t offset, limit;
     uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
     uint8_t *buf = NULL;
-    uint64_t i, tab_size =
+    uint64_t i, j, n, max_clusters, tab_size =
             size_to_clusters(s,
                 bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
 
@@ -299,15 +305,17 @@ static int load_bitmap_data(BlockDriverState *bs,
         return -EINVAL;
     }
 
-    buf = g_malloc(s->cluster_size);
+    max_clusters = MAX(BME_IO_MAX_SIZE / s->cluster_size, 1);
+    buf = g_malloc(max_clusters * s->cluster_size);
     limit = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size, bitmap);
-    for (i = 0, offset = 0; i < tab_size; ++i, offset += limit) {
+    for (i = 0, offset = 0; i < tab_size; i += n, offset += n * limit) {
         uint64_t count = MIN(bm_size - offset, limit);
         uint64_t entry = bitmap_table[i];
         uint64_t data_offset = entry & BME_TABLE_ENTRY_OFFSET_MASK;
 
         assert(check_table_entry(entry, s->cluster_size) == 0);
 
+        n = 1;
         if (data_offset == 0) {
             if (entry & BME_TABLE_ENTRY_FLAG_ALL_ONES) {
                 bdrv_dirty_bitmap_deserialize_ones(bitmap, offset, count,
@@ -316,12 +324,27 @@ static int load_bitmap_data(BlockDriverState *bs,
                 /* No need to deserialize zeros because the dirty bitmap is
                  * already cleared */
             }
-        } else {
-            ret = bdrv_pread(bs->file, data_offset, buf, s->cluster_size);
-            if (ret < 0) {
-                goto finish;
-            }
-            bdrv_dirty_bitmap_deserialize_part(bitmap, buf, offset, count,
+            continue;
+        }
+
+        /* Gather the following clusters that are contiguous in the file */
+        while (n < max_clusters && i + n < tab_size &&
+               (bitmap_table[i + n] & BME_TABLE_ENTRY_OFFSET_MASK) ==
+               data_offset + n * s->cluster_size) {
+            assert(check_table_entry(bitmap_table[i + n],
+                                     s->cluster_size) == 0);
+            n++;
+        }
+
+        ret = bdrv_pread(bs->file, data_offset, buf, n * s->cluster_size);
+        if (ret < 0) {
+            goto finish;
+        }
+        for (j = 0; j < n; j++) {
+            count = MIN(bm_size - (offset + j * limit), limit);
+            bdrv_dirty_bitmap_deserialize_part(bitmap,
+                                               buf + j * s->cluster_size,
+                                               offset + j * limit, count,
                                                false);
         }
     }
@@ -1279,6 +1302,7 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
     const char *bm_name = bdrv_dirty_bitmap_name(bitmap);
     uint8_t *buf = NULL;
     uint64_t *tb;
+    uint64_t i, max_clusters;
     uint64_t tb_size =
             size_to_clusters(s,
                 bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
@@ -1296,7 +1320,8 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
         return NULL;
     }
 
-    buf = g_malloc(s->cluster_size);
+    max_clusters = MAX(BME_IO_MAX_SIZE / s->cluster_size, 1);
+    buf = g_malloc(max_clusters * s->cluster_size);
     limit = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size, bitmap);
     assert(DIV_ROUND_UP(bm_size, limit) == tb_size);
 
@@ -1305,6 +1330,7 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
            >= 0)
     {
         uint64_t cluster = offset / limit;
+        uint64_t nb_clusters = 1;
         uint64_t end, write_size;
         int64_t off;
 
@@ -1314,39 +1340,60 @@ static uint64_t *store_bitmap_data(BlockDriverState *bs,
          * including any leading zero bits.
          */
         offset = QEMU_ALIGN_DOWN(offset, limit);
-        end = MIN(bm_size, offset + limit);
-        write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
-                                                          end - offset);
-        assert(write_size <= s->cluster_size);
 
-        off = qcow2_alloc_clusters(bs, s->cluster_size);
+        /*
+         * Extend the run over the following clusters of the bitmap that
+         * are not all zeroes, so that they are allocated contiguously and
+         * written with one request.
+         */
+        while (nb_clusters < max_clusters && cluster + nb_clusters < tb_size &&
+               bdrv_dirty_bitmap_next_dirty(bitmap,
+                                            offset + nb_clusters * limit,
+                                            limit) >= 0) {
+            nb_clusters++;
+        }
+
+        off = qcow2_alloc_clusters(bs, nb_clusters * s->cluster_size);
         if (off < 0) {
             error_setg_errno(errp, -off,
                              "Failed to allocate clusters for bitmap '%s'",
                              bm_name);
             goto fail;
         }
-        tb[cluster] = off;
 
-        bdrv_dirty_bitmap_serialize_part(bitmap, buf, offset, end - offset);
-        if (write_size < s->cluster_size) {
-            memset(buf + write_size, 0, s->cluster_size - write_size);
+        for (i = 0; i < nb_clusters; i++) {
+            uint8_t *cluster_buf = buf + i * s->cluster_size;
+
+            tb[cluster + i] = off + i * s->cluster_size;
+
+            end = MIN(bm_size, offset + limit);
+            write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
+                                                              end - offset);
+            assert(write_size <= s->cluster_size);
+
+            bdrv_dirty_bitmap_serialize_part(bitmap, cluster_buf, offset,
+                                             end - offset);
+            if (write_size < s->cluster_size) {
+                memset(cluster_buf + write_size, 0,
+                       s->cluster_size - write_size);
+            }
+            offset = end;
         }
 
-        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size, false);
+        ret = qcow2_pre_write_overlap_check(bs, 0, off,
+                                            nb_clusters * s->cluster_size,
+                                            false);
         if (ret < 0) {
             error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
             goto fail;
         }
 
-        ret = bdrv_pwrite(bs->file, off, buf, s->cluster_size);
+        ret = bdrv_pwrite(bs->file, off, buf, nb_clusters * s->cluster_size);
         if (ret < 0) {
             error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
                              bm_name);
             goto fail;
         }
-
-        offset = end;
     }
 
     *bitmap_table_size = tb_size;
@@ -962,13 +962,71 @@ int qcow2_update_cluster_refcount(BlockDriverState *bs,
 
 
 
+/*
+ * Check up to @nb_clusters clusters starting at @cluster_index for being
+ * free, but only as far as the end of the refcount block that describes
+ * @cluster_index, so that the block has to be looked up only once.
+ *
+ * Returns the number of clusters that were checked, or -errno.  If one
+ * of them is in use, the scan stops there, that cluster is the last one
+ * counted and *@in_use is set to true.
+ */
+static int64_t scan_free_clusters(BlockDriverState *bs, uint64_t cluster_index,
+                                  uint64_t nb_clusters, bool *in_use)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t refcount_table_index = cluster_index >> s->refcount_block_bits;
+    uint64_t block_index = cluster_index & (s->refcount_block_size - 1);
+    uint64_t n = MIN(nb_clusters, s->refcount_block_size - block_index);
+    int64_t refcount_block_offset;
+    void *refcount_block;
+    uint64_t i;
+    int ret;
+
+    *in_use = false;
+
+    /* Clusters without a refcount block are free */
+    if (refcount_table_index >= s->refcount_table_size) {
+        return n;
+    }
+    refcount_block_offset =
+        s->refcount_table[refcount_table_index] & REFT_OFFSET_MASK;
+    if (!refcount_block_offset) {
+        return n;
+    }
+
+    if (offset_into_cluster(s, refcount_block_offset)) {
+        qcow2_signal_corruption(bs, true, -1, -1, "Refblock offset %#" PRIx64
+                                " unaligned (reftable index: %#" PRIx64 ")",
+                                refcount_block_offset, refcount_table_index);
+        return -EIO;
+    }
+
+    ret = qcow2_cache_get(bs, s->refcount_block_cache, refcount_block_offset,
+                          &refcount_block);
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (s->get_refcount(refcount_block, block_index + i) != 0) {
+            *in_use = true;
+            i++;
+            break;
+        }
+    }
+
+    qcow2_cache_put(s->refcount_block_cache, &refcount_block);
+
+    return i;
+}
+
 /* return < 0 if error */
 static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
                                     uint64_t max)
 {
     BDRVQcow2State *s = bs->opaque;
-    uint64_t i, nb_clusters, refcount;
-    int ret;
+    uint64_t i, nb_clusters;
 
     /* We can't allocate clusters if they may still be queued for discard. */
     if (s->cache_discards) {
@@ -976,16 +1034,22 @@ static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
     }
 
     nb_clusters = size_to_clusters(s, size);
-retry:
-    for(i = 0; i < nb_clusters; i++) {
-        uint64_t next_cluster_index = s->free_cluster_index++;
-        ret = qcow2_get_refcount(bs, next_cluster_index, &refcount);
 
-        if (ret < 0) {
-            return ret;
-        } else if (refcount != 0) {
-            goto retry;
+    /*
+     * Look for nb_clusters free clusters in a row from free_cluster_index,
+     * restarting the count after any cluster that is in use.
+     */
+    i = 0;
+    while (i < nb_clusters) {
+        bool in_use;
+        int64_t n = scan_free_clusters(bs, s->free_cluster_index,
+                                       nb_clusters - i, &in_use);
+
+        if (n < 0) {
+            return n;
         }
+        s->free_cluster_index += n;
+        i = in_use ? 0 : i + n;
     }
 
     /* Make sure that all offsets in the "allocated" range are representable
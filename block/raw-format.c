@@ -530,6 +530,15 @@ static int raw_probe_geometry(BlockDriverState *bs, HDGeometry *geo)
     return bdrv_probe_geometry(bs->file->bs, geo);
 }
 
+static int raw_get_read_fd(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+    if (s->offset) {
+        return -ENOTSUP;
+    }
+    return bdrv_get_read_fd(bs->file->bs);
+}
+
 static int coroutine_fn raw_co_copy_range_from(BlockDriverState *bs,
                                                BdrvChild *src,
                                                int64_t src_offset,
@@ -616,6 +625,7 @@ BlockDriver bdrv_raw = {
     .bdrv_co_block_status = &raw_co_block_status,
     .bdrv_co_copy_range_from = &raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = &raw_co_copy_range_to,
+    .bdrv_get_read_fd     = &raw_get_read_fd,
     .bdrv_co_truncate     = &raw_co_truncate,
     .bdrv_getlength       = &raw_getlength,
     .is_format            = true,
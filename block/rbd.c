@@ -88,6 +88,15 @@ typedef struct BDRVRBDState {
     char *namespace;
     uint64_t image_size;
     uint64_t object_size;
+
+    /*
+     * Requests completed by librbd, waiting for completion_bh to wake up
+     * their coroutine.  The lock also protects completion_bh against
+     * being deleted while a librbd thread schedules it.
+     */
+    QemuMutex completion_lock;
+    QSIMPLEQ_HEAD(, RBDTask) completed;
+    QEMUBH *completion_bh;
 } BDRVRBDState;
 
 typedef struct RBDTask {
@@ -95,6 +104,7 @@ typedef struct RBDTask {
     Coroutine *co;
     bool complete;
     int64_t ret;
+    QSIMPLEQ_ENTRY(RBDTask) next;
 } RBDTask;
 
 static int qemu_rbd_connect(rados_t *cluster, rados_ioctx_t *io_ctx,
@@ -888,6 +898,22 @@ static int qemu_rbd_attempt_legacy_options(QDict *options,
     return r;
 }
 
+static void qemu_rbd_finish_bh(void *opaque)
+{
+    BDRVRBDState *s = opaque;
+    QSIMPLEQ_HEAD(, RBDTask) completed = QSIMPLEQ_HEAD_INITIALIZER(completed);
+    RBDTask *task, *next;
+
+    qemu_mutex_lock(&s->completion_lock);
+    QSIMPLEQ_CONCAT(&completed, &s->completed);
+    qemu_mutex_unlock(&s->completion_lock);
+
+    QSIMPLEQ_FOREACH_SAFE(task, &completed, next, next) {
+        task->complete = true;
+        aio_co_wake(task->co);
+    }
+}
+
 static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
                          Error **errp)
 {
@@ -999,6 +1025,11 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
     /* When extending regular files, we get zeros from the OS */
     bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
 
+    qemu_mutex_init(&s->completion_lock);
+    QSIMPLEQ_INIT(&s->completed);
+    s->completion_bh = aio_bh_new(bdrv_get_aio_context(bs),
+                                  qemu_rbd_finish_bh, s);
+
     r = 0;
     goto out;
 
@@ -1041,6 +1072,8 @@ static void qemu_rbd_close(BlockDriverState *bs)
     BDRVRBDState *s = bs->opaque;
 
     rbd_close(s->image);
+    qemu_bh_delete(s->completion_bh);
+    qemu_mutex_destroy(&s->completion_lock);
     rados_ioctx_destroy(s->io_ctx);
     g_free(s->snap);
     g_free(s->image_name);
@@ -1063,13 +1096,6 @@ static int qemu_rbd_resize(BlockDriverState *bs, uint64_t size)
     return 0;
 }
 
-static void qemu_rbd_finish_bh(void *opaque)
-{
-    RBDTask *task = opaque;
-    task->complete = true;
-    aio_co_wake(task->co);
-}
-
 /*
  * This is the completion callback function for all rbd aio calls
  * started from qemu_rbd_start_co().
@@ -1077,14 +1103,43 @@ static void qemu_rbd_finish_bh(void *opaque)
  * Note: this function is being called from a non qemu thread so
  * we need to be careful about what we do here. Generally we only
  * schedule a BH, and do the rest of the io completion handling
- * from qemu_rbd_finish_bh() which runs in a qemu context.
+ * from qemu_rbd_finish_bh() which runs in a qemu context.  The BH is
+ * shared by all requests, so that a burst of completions only kicks
+ * the AioContext once.
  */
 static void qemu_rbd_completion_cb(rbd_completion_t c, RBDTask *task)
 {
+    BDRVRBDState *s = task->bs->opaque;
+
     task->ret = rbd_aio_get_return_value(c);
     rbd_aio_release(c);
-    aio_bh_schedule_oneshot(bdrv_get_aio_context(task->bs),
-                            qemu_rbd_finish_bh, task);
+
+    qemu_mutex_lock(&s->completion_lock);
+    QSIMPLEQ_INSERT_TAIL(&s->completed, task, next);
+    qemu_bh_schedule(s->completion_bh);
+    qemu_mutex_unlock(&s->completion_lock);
+}
+
+static void qemu_rbd_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    /* Requests have been drained, completion_bh has nothing left to do */
+    qemu_mutex_lock(&s->completion_lock);
+    assert(QSIMPLEQ_EMPTY(&s->completed));
+    qemu_bh_delete(s->completion_bh);
+    s->completion_bh = NULL;
+    qemu_mutex_unlock(&s->completion_lock);
+}
+
+static void qemu_rbd_attach_aio_context(BlockDriverState *bs,
+                                        AioContext *new_context)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    qemu_mutex_lock(&s->completion_lock);
+    s->completion_bh = aio_bh_new(new_context, qemu_rbd_finish_bh, s);
+    qemu_mutex_unlock(&s->completion_lock);
 }
 
 static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
@@ -1487,6 +1542,9 @@ static BlockDriver bdrv_rbd = {
     .bdrv_co_truncate       = qemu_rbd_co_truncate,
     .protocol_name          = "rbd",
 
+    .bdrv_detach_aio_context = qemu_rbd_detach_aio_context,
+    .bdrv_attach_aio_context = qemu_rbd_attach_aio_context,
+
     .bdrv_co_preadv         = qemu_rbd_co_preadv,
     .bdrv_co_pwritev        = qemu_rbd_co_pwritev,
     .bdrv_co_flush_to_disk  = qemu_rbd_co_flush,
@@ -77,6 +77,11 @@ struct ThrottleGroup {
     bool any_timer_armed[2];
     QEMUClockType clock_type;
 
+    /* Whether the limits leave each type of operation unthrottled.
+     * Written with the lock held, read without it by the fast path in
+     * throttle_group_co_io_limits_intercept(). */
+    bool unthrottled[2];
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
@@ -170,6 +175,23 @@ const char *throttle_group_get_name(ThrottleGroupMember *tgm)
     return tg->name;
 }
 
+/* Apply a throttle configuration to a group.
+ *
+ * This assumes that tg->lock is held, unless the group is not in use yet.
+ *
+ * @tg:  the ThrottleGroup
+ * @cfg: the configuration to set
+ */
+static void throttle_group_do_config(ThrottleGroup *tg, ThrottleConfig *cfg)
+{
+    int i;
+
+    throttle_config(&tg->ts, tg->clock_type, cfg);
+    for (i = 0; i < 2; i++) {
+        qatomic_set(&tg->unthrottled[i], !throttle_enabled_for(cfg, i));
+    }
+}
+
 /* Return the next ThrottleGroupMember in the round-robin sequence, simulating
  * a circular list.
  *
@@ -286,7 +308,7 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     /* If a timer just got armed, set tgm as the current token */
     if (must_wait) {
         tg->tokens[is_write] = tgm;
-        tg->any_timer_armed[is_write] = true;
+        qatomic_set(&tg->any_timer_armed[is_write], true);
     }
 
     return must_wait;
@@ -343,7 +365,7 @@ static void schedule_next_request(ThrottleGroupMember *tgm, bool is_write)
             ThrottleTimers *tt = &token->throttle_timers;
             int64_t now = qemu_clock_get_ns(tg->clock_type);
             timer_mod(tt->timers[is_write], now);
-            tg->any_timer_armed[is_write] = true;
+            qatomic_set(&tg->any_timer_armed[is_write], true);
         }
         tg->tokens[is_write] = token;
     }
@@ -367,6 +389,15 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     assert(bytes >= 0);
 
+    /* If this type of operation has no limits and nothing is waiting there
+     * is no accounting or scheduling to do, so don't touch the lock that
+     * all members of the group share. */
+    if (qatomic_read(&tg->unthrottled[is_write]) &&
+        !qatomic_read(&tgm->pending_reqs[is_write]) &&
+        !qatomic_read(&tg->any_timer_armed[is_write])) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -474,7 +505,7 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
-    throttle_config(ts, tg->clock_type, cfg);
+    throttle_group_do_config(tg, cfg);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -509,7 +540,7 @@ static void timer_cb(ThrottleGroupMember *tgm, bool is_write)
 
     /* The timer has just been fired, so we can update the flag */
     qemu_mutex_lock(&tg->lock);
-    tg->any_timer_armed[is_write] = false;
+    qatomic_set(&tg->any_timer_armed[is_write], false);
     qemu_mutex_unlock(&tg->lock);
 
     /* Run the request that was waiting for this timer */
@@ -642,7 +673,7 @@ void throttle_group_detach_aio_context(ThrottleGroupMember *tgm)
     WITH_QEMU_LOCK_GUARD(&tg->lock) {
         for (i = 0; i < 2; i++) {
             if (timer_pending(tt->timers[i])) {
-                tg->any_timer_armed[i] = false;
+                qatomic_set(&tg->any_timer_armed[i], false);
                 schedule_next_request(tgm, i);
             }
         }
@@ -788,7 +819,7 @@ static void throttle_group_obj_complete(UserCreatable *obj, Error **errp)
     if (!throttle_is_valid(&cfg, errp)) {
         return;
     }
-    throttle_config(&tg->ts, tg->clock_type, &cfg);
+    throttle_group_do_config(tg, &cfg);
     QTAILQ_INSERT_TAIL(&throttle_groups, tg, list);
     tg->is_initialized = true;
 }
@@ -899,7 +930,7 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
     if (local_err) {
         goto unlock;
     }
-    throttle_config(&tg->ts, tg->clock_type, &cfg);
+    throttle_group_do_config(tg, &cfg);
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
@@ -1900,7 +1900,6 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     uint64_t bytes_done = 0;
 
     qemu_iovec_init(&local_qiov, qiov->niov);
-    qemu_co_mutex_lock(&s->lock);
 
     while (bytes > 0) {
         extent = find_extent(s, offset >> BDRV_SECTOR_BITS, extent);
@@ -1908,8 +1907,16 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             ret = -EIO;
             goto fail;
         }
+        /*
+         * Only the L2 lookup needs the lock.  Clusters are never freed and
+         * a newly allocated cluster only becomes visible in the L2 table
+         * after its data has been written, so the data can be read without
+         * holding the lock.
+         */
+        qemu_co_mutex_lock(&s->lock);
         ret = get_cluster_offset(bs, extent, NULL,
                                  offset, false, &cluster_offset, 0, 0);
+        qemu_co_mutex_unlock(&s->lock);
         offset_in_cluster = vmdk_find_offset_in_cluster(extent, offset);
 
         n_bytes = MIN(bytes, extent->cluster_sectors * BDRV_SECTOR_SIZE
@@ -1918,10 +1925,13 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
         if (ret != VMDK_OK) {
             /* if not allocated, try to read from parent image, if exist */
             if (bs->backing && ret != VMDK_ZEROED) {
+                qemu_co_mutex_lock(&s->lock);
                 if (!vmdk_is_cid_valid(bs)) {
+                    qemu_co_mutex_unlock(&s->lock);
                     ret = -EINVAL;
                     goto fail;
                 }
+                qemu_co_mutex_unlock(&s->lock);
 
                 qemu_iovec_reset(&local_qiov);
                 qemu_iovec_concat(&local_qiov, qiov, bytes_done, n_bytes);
@@ -1953,7 +1963,6 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
     ret = 0;
 fail:
-    qemu_co_mutex_unlock(&s->lock);
     qemu_iovec_destroy(&local_qiov);
 
     return ret;
@@ -1967,11 +1976,14 @@ fail:
  *                with each cluster. By dry run we can find if the zero write
  *                is possible without modifying image data.
  *
+ * Called with s->lock held; the lock is dropped while data is written to
+ * already allocated clusters.
+ *
  * Returns: error code with 0 for success.
  */
-static int vmdk_pwritev(BlockDriverState *bs, uint64_t offset,
-                       uint64_t bytes, QEMUIOVector *qiov,
-                       bool zeroed, bool zero_dry_run)
+static int coroutine_fn vmdk_pwritev(BlockDriverState *bs, uint64_t offset,
+                                     uint64_t bytes, QEMUIOVector *qiov,
+                                     bool zeroed, bool zero_dry_run)
 {
     BDRVVmdkState *s = bs->opaque;
     VmdkExtent *extent = NULL;
@@ -2035,6 +2047,18 @@ static int vmdk_pwritev(BlockDriverState *bs, uint64_t offset,
             } else {
                 return -ENOTSUP;
             }
+        } else if (!m_data.new_allocation && !extent->compressed) {
+            /*
+             * Overwriting an allocated cluster does not touch metadata, so
+             * let other requests proceed while the data is written.
+             */
+            qemu_co_mutex_unlock(&s->lock);
+            ret = vmdk_write_extent(extent, cluster_offset, offset_in_cluster,
+                                    qiov, bytes_done, n_bytes, offset);
+            qemu_co_mutex_lock(&s->lock);
+            if (ret) {
+                return ret;
+            }
         } else {
             ret = vmdk_write_extent(extent, cluster_offset, offset_in_cluster,
                                     qiov, bytes_done, n_bytes, offset);
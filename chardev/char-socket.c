@@ -31,6 +31,7 @@
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "qapi/clone-visitor.h"
 #include "qapi/qapi-visit-sockets.h"
@@ -44,6 +45,13 @@
 
 #define TCP_MAX_FDS 16
 
+/*
+ * Frontends such as virtio-serial can take much more than
+ * CHR_READ_BUF_LEN at once; reading it in one go saves main loop
+ * iterations on high-rate streams.
+ */
+#define TCP_READ_BUF_LEN (64 * KiB)
+
 typedef struct {
     char buf[21];
     size_t buflen;
@@ -71,6 +79,7 @@ struct SocketChardev {
     size_t read_msgfds_num;
     int *write_msgfds;
     size_t write_msgfds_num;
+    uint8_t *read_buf;
     bool registered_yank;
 
     SocketAddress *addr;
@@ -541,14 +550,18 @@ static gboolean tcp_chr_read(QIOChannel *chan, GIOCondition cond, void *opaque)
 {
     Chardev *chr = CHARDEV(opaque);
     SocketChardev *s = SOCKET_CHARDEV(opaque);
-    uint8_t buf[CHR_READ_BUF_LEN];
+    uint8_t *buf;
     int len, size;
 
     if ((s->state != TCP_CHARDEV_STATE_CONNECTED) ||
         s->max_size <= 0) {
         return TRUE;
     }
-    len = sizeof(buf);
+    if (!s->read_buf) {
+        s->read_buf = g_malloc(TCP_READ_BUF_LEN);
+    }
+    buf = s->read_buf;
+    len = TCP_READ_BUF_LEN;
     if (len > s->max_size) {
         len = s->max_size;
     }
@@ -1116,6 +1129,7 @@ static void char_socket_finalize(Object *obj)
     qapi_free_SocketAddress(s->addr);
     tcp_chr_telnet_destroy(s);
     g_free(s->telnet_init);
+    g_free(s->read_buf);
     if (s->listener) {
         qio_net_listener_set_client_func_full(s->listener, NULL, NULL,
                                               NULL, chr->gcontext);
@@ -33,6 +33,17 @@
 
 #include <gnutls/x509.h>
 
+#if defined(CONFIG_LINUX) && defined(HAVE_LINUX_TLS_H)
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
 
 struct QCryptoTLSSession {
     QCryptoTLSCreds *creds;
@@ -40,6 +51,7 @@ struct QCryptoTLSSession {
     char *hostname;
     char *authzid;
     bool handshakeComplete;
+    bool ktlsTx;
     QCryptoTLSSessionWriteFunc writeFunc;
     QCryptoTLSSessionReadFunc readFunc;
     void *opaque;
@@ -549,6 +561,107 @@ qcrypto_tls_session_get_peer_name(QCryptoTLSSession *session)
 }
 
 
+#if defined(CONFIG_LINUX) && defined(HAVE_LINUX_TLS_H)
+#define QCRYPTO_TLS_KTLS_INFO(info, ver, alg, ivdata, keydata, seq)      \
+    do {                                                                \
+        (info).info.version = (ver);                                    \
+        (info).info.cipher_type = (alg);                                \
+        if ((ver) == TLS_1_2_VERSION) {                                 \
+            memcpy((info).iv, (seq), sizeof((info).iv));                \
+        } else {                                                        \
+            memcpy((info).iv, (ivdata)->data + sizeof((info).salt),     \
+                   sizeof((info).iv));                                  \
+        }                                                               \
+        memcpy((info).salt, (ivdata)->data, sizeof((info).salt));       \
+        memcpy((info).key, (keydata)->data, sizeof((info).key));        \
+        memcpy((info).rec_seq, (seq), sizeof((info).rec_seq));          \
+    } while (0)
+
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *session,
+                                   int fd)
+{
+    union {
+        struct tls12_crypto_info_aes_gcm_128 gcm128;
+        struct tls12_crypto_info_aes_gcm_256 gcm256;
+    } info;
+    gnutls_datum_t mac_key, iv, cipher_key;
+    unsigned char seq[8];
+    socklen_t len;
+    int version;
+
+    if (!session->creds->ktls || !session->handshakeComplete) {
+        return -1;
+    }
+
+    switch (gnutls_protocol_get_version(session->handle)) {
+    case GNUTLS_TLS1_2:
+        version = TLS_1_2_VERSION;
+        break;
+#ifdef TLS_1_3_VERSION
+    case GNUTLS_TLS1_3:
+        version = TLS_1_3_VERSION;
+        break;
+#endif
+    default:
+        return -1;
+    }
+
+    if (gnutls_record_get_state(session->handle, 0, &mac_key, &iv,
+                                &cipher_key, seq) < 0) {
+        return -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    switch (gnutls_cipher_get(session->handle)) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        QCRYPTO_TLS_KTLS_INFO(info.gcm128, version, TLS_CIPHER_AES_GCM_128,
+                              &iv, &cipher_key, seq);
+        len = sizeof(info.gcm128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        QCRYPTO_TLS_KTLS_INFO(info.gcm256, version, TLS_CIPHER_AES_GCM_256,
+                              &iv, &cipher_key, seq);
+        len = sizeof(info.gcm256);
+        break;
+    default:
+        return -1;
+    }
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0 ||
+        setsockopt(fd, SOL_TLS, TLS_TX, &info, len) < 0) {
+        trace_qcrypto_tls_session_ktls(session, fd, errno);
+        memset(&info, 0, sizeof(info));
+        return -1;
+    }
+    memset(&info, 0, sizeof(info));
+
+    /*
+     * From now on the kernel encrypts whatever is written to the socket,
+     * so outgoing records must bypass gnutls.  Records from the peer are
+     * still decrypted by gnutls.
+     */
+    session->ktlsTx = true;
+    trace_qcrypto_tls_session_ktls(session, fd, 0);
+    return 0;
+}
+#else
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *session G_GNUC_UNUSED,
+                                   int fd G_GNUC_UNUSED)
+{
+    return -1;
+}
+#endif
+
+
+bool
+qcrypto_tls_session_has_ktls_tx(QCryptoTLSSession *session)
+{
+    return session->ktlsTx;
+}
+
+
 #else /* ! CONFIG_GNUTLS */
 
 
@@ -640,4 +753,19 @@ qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess)
     return NULL;
 }
 
+
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *sess,
+                                   int fd)
+{
+    return -1;
+}
+
+
+bool
+qcrypto_tls_session_has_ktls_tx(QCryptoTLSSession *sess)
+{
+    return false;
+}
+
 #endif
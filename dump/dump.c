@@ -29,6 +29,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "hw/misc/vmcoreinfo.h"
+#include "qemu/thread.h"
 
 #ifdef TARGET_X86_64
 #include "win_dump.h"
@@ -1297,20 +1298,181 @@ static inline bool is_zero_page(const uint8_t *buf, size_t page_size)
     return buffer_is_zero(buf, page_size);
 }
 
+/*
+ * Pages are compressed in batches: the dump thread collects the guest
+ * pointers of DUMP_BATCH_PAGES pages, the compression threads and the
+ * dump thread itself each compress an interleaved subset of them, and
+ * the dump thread then writes the whole batch in order.
+ */
+#define DUMP_BATCH_PAGES 256
+
+typedef struct DumpPage {
+    uint8_t *buf;       /* the guest page */
+    uint8_t *out;       /* compressed data, NULL to write @buf as is */
+    size_t size;        /* size of the page data, 0 for a zero page */
+    uint32_t flags;     /* DUMP_DH_COMPRESSED_* format of @out */
+} DumpPage;
+
+typedef struct DumpBatch {
+    DumpPage pages[DUMP_BATCH_PAGES];
+    int npages;
+    int nthreads;
+    size_t len_buf_out;
+    uint8_t *buf_out;   /* len_buf_out bytes for each page */
+    QemuSemaphore done;
+} DumpBatch;
+
+typedef struct DumpCompressor {
+    DumpState *s;
+    DumpBatch *batch;
+    int index;
+    QemuThread thread;
+    QemuSemaphore start;
+    bool quit;
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+} DumpCompressor;
+
+static void dump_compress_page(DumpCompressor *c, DumpPage *page,
+                               uint8_t *buf_out)
+{
+    DumpState *s = c->s;
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = c->batch->len_buf_out;
+
+    /* check zero page */
+    if (is_zero_page(page->buf, page_size)) {
+        page->size = 0;
+        return;
+    }
+
+    /*
+     * only one compression format will be used here, for
+     * s->flag_compress is set. But when compression fails to work,
+     * we fall back to save in plaintext.
+     */
+    page->out = buf_out;
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+            (compress2(buf_out, (uLongf *)&size_out, page->buf,
+                       page_size, Z_BEST_SPEED) == Z_OK) &&
+            (size_out < page_size)) {
+        page->flags = DUMP_DH_COMPRESSED_ZLIB;
+#ifdef CONFIG_LZO
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+            (lzo1x_1_compress(page->buf, page_size, buf_out,
+                              (lzo_uint *)&size_out, c->wrkmem) == LZO_E_OK) &&
+            (size_out < page_size)) {
+        page->flags = DUMP_DH_COMPRESSED_LZO;
+#endif
+#ifdef CONFIG_SNAPPY
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+            (snappy_compress((char *)page->buf, page_size,
+                             (char *)buf_out, &size_out) == SNAPPY_OK) &&
+            (size_out < page_size)) {
+        page->flags = DUMP_DH_COMPRESSED_SNAPPY;
+#endif
+    } else {
+        /* fall back to save in plaintext */
+        page->out = NULL;
+        page->flags = 0;
+        size_out = page_size;
+    }
+    page->size = size_out;
+}
+
+static void dump_compress_pages(DumpCompressor *c)
+{
+    DumpBatch *b = c->batch;
+    int i;
+
+    for (i = c->index; i < b->npages; i += b->nthreads) {
+        dump_compress_page(c, &b->pages[i], b->buf_out + i * b->len_buf_out);
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressor *c = opaque;
+
+    for (;;) {
+        qemu_sem_wait(&c->start);
+        if (c->quit) {
+            break;
+        }
+        dump_compress_pages(c);
+        qemu_sem_post(&c->batch->done);
+    }
+    return NULL;
+}
+
+/* compressors[0] is the dump thread itself */
+static void dump_compress_batch(DumpCompressor *compressors)
+{
+    DumpBatch *b = compressors[0].batch;
+    int i;
+
+    for (i = 1; i < b->nthreads; i++) {
+        qemu_sem_post(&compressors[i].start);
+    }
+    dump_compress_pages(&compressors[0]);
+    for (i = 1; i < b->nthreads; i++) {
+        qemu_sem_wait(&b->done);
+    }
+}
+
+static int dump_write_batch(DumpState *s, DumpBatch *b, DataCache *page_desc,
+                            DataCache *page_data, PageDescriptor *pd_zero,
+                            off_t *offset_data, Error **errp)
+{
+    PageDescriptor pd, *desc;
+    int i, ret;
+
+    for (i = 0; i < b->npages; i++) {
+        DumpPage *page = &b->pages[i];
+
+        if (!page->size) {
+            /* zero pages all use the first page of the page section */
+            desc = pd_zero;
+        } else {
+            ret = write_cache(page_data, page->out ? page->out : page->buf,
+                              page->size, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                return ret;
+            }
+
+            pd.flags = cpu_to_dump32(s, page->flags);
+            pd.size = cpu_to_dump32(s, page->size);
+            pd.page_flags = cpu_to_dump64(s, 0);
+            pd.offset = cpu_to_dump64(s, *offset_data);
+            *offset_data += page->size;
+            desc = &pd;
+        }
+
+        ret = write_cache(page_desc, desc, sizeof(PageDescriptor), false);
+        if (ret < 0) {
+            error_setg(errp, "dump: failed to write page desc");
+            return ret;
+        }
+        s->written_size += s->dump_info.page_size;
+    }
+    b->npages = 0;
+    return 0;
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
+    DumpBatch *batch;
+    DumpCompressor *compressors;
+    int i;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1319,15 +1481,31 @@ static void write_dump_pages(DumpState *s, Error **errp)
     prepare_data_cache(&page_desc, s, offset_desc);
     prepare_data_cache(&page_data, s, offset_data);
 
-    /* prepare buffer to store compressed data */
-    len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
-    assert(len_buf_out != 0);
-
+    /* prepare buffers to store compressed data */
+    batch = g_new0(DumpBatch, 1);
+    batch->nthreads = MAX(s->compress_threads, 1);
+    batch->len_buf_out = get_len_buf_out(s->dump_info.page_size,
+                                         s->flag_compress);
+    assert(batch->len_buf_out != 0);
+    batch->buf_out = g_malloc(DUMP_BATCH_PAGES * batch->len_buf_out);
+    qemu_sem_init(&batch->done, 0);
+
+    compressors = g_new0(DumpCompressor, batch->nthreads);
+    for (i = 0; i < batch->nthreads; i++) {
+        DumpCompressor *c = &compressors[i];
+
+        c->s = s;
+        c->batch = batch;
+        c->index = i;
 #ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+        c->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
 #endif
-
-    buf_out = g_malloc(len_buf_out);
+        if (i) {
+            qemu_sem_init(&c->start, 0);
+            qemu_thread_create(&c->thread, "dump_compress",
+                               dump_compress_thread, c, QEMU_THREAD_JOINABLE);
+        }
+    }
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1352,96 +1530,23 @@ static void write_dump_pages(DumpState *s, Error **errp)
      * first page of page section
      */
     while (get_next_page(&block_iter, &pfn_iter, &buf, s)) {
-        /* check zero page */
-        if (is_zero_page(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-            }
-
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
-
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
+        batch->pages[batch->npages++] = (DumpPage) { .buf = buf };
+        if (batch->npages < DUMP_BATCH_PAGES) {
+            continue;
         }
-        s->written_size += s->dump_info.page_size;
+        dump_compress_batch(compressors);
+        ret = dump_write_batch(s, batch, &page_desc, &page_data, &pd_zero,
+                               &offset_data, errp);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
+    dump_compress_batch(compressors);
+    ret = dump_write_batch(s, batch, &page_desc, &page_data, &pd_zero,
+                           &offset_data, errp);
+    if (ret < 0) {
+        goto out;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1459,11 +1564,23 @@ out:
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
 
+    for (i = 0; i < batch->nthreads; i++) {
+        DumpCompressor *c = &compressors[i];
+
+        if (i) {
+            c->quit = true;
+            qemu_sem_post(&c->start);
+            qemu_thread_join(&c->thread);
+            qemu_sem_destroy(&c->start);
+        }
 #ifdef CONFIG_LZO
-    g_free(wrkmem);
+        g_free(c->wrkmem);
 #endif
-
-    g_free(buf_out);
+    }
+    g_free(compressors);
+    qemu_sem_destroy(&batch->done);
+    g_free(batch->buf_out);
+    g_free(batch);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1919,7 +2036,8 @@ void qmp_dump_guest_memory(bool paging, const char *file,
                            bool has_detach, bool detach,
                            bool has_begin, int64_t begin, bool has_length,
                            int64_t length, bool has_format,
-                           DumpGuestMemoryFormat format, Error **errp)
+                           DumpGuestMemoryFormat format, bool has_threads,
+                           int64_t threads, Error **errp)
 {
     const char *p;
     int fd = -1;
@@ -1960,6 +2078,11 @@ void qmp_dump_guest_memory(bool paging, const char *file,
     if (has_detach) {
         detach_p = detach;
     }
+    if (has_threads && (threads < 1 || threads > DUMP_MAX_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "threads",
+                   "a value between 1 and 64");
+        return;
+    }
 
     /* check whether lzo/snappy is supported */
 #ifndef CONFIG_LZO
@@ -2007,6 +2130,7 @@ void qmp_dump_guest_memory(bool paging, const char *file,
 
     s = &dump_state_global;
     dump_state_prepare(s);
+    s->compress_threads = has_threads ? threads : 1;
 
     dump_init(s, fd, has_format, format, paging, has_begin,
               begin, length, &local_err);
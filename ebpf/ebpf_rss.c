@@ -100,6 +100,29 @@ static bool ebpf_rss_set_indirections_table(struct EBPFRSSContext *ctx,
         return false;
     }
 
+#ifdef HAVE_BPF_MAP_UPDATE_BATCH
+    /*
+     * Guests rewrite the whole table when rebalancing, so update it with
+     * a single system call where the kernel supports batched updates of
+     * array maps (Linux 5.6+); otherwise fall back to one call per entry.
+     */
+    if (len) {
+        uint32_t keys[VIRTIO_NET_RSS_MAX_TABLE_LEN];
+        uint32_t count = len;
+
+        for (; i < len; ++i) {
+            keys[i] = i;
+        }
+        if (bpf_map_update_batch(ctx->map_indirections_table, keys,
+                                 indirections_table, &count, NULL) == 0) {
+            return true;
+        }
+        trace_ebpf_error("eBPF RSS", "batched indirection table update "
+                         "failed, updating entries one by one");
+        i = 0;
+    }
+#endif
+
     for (; i < len; ++i) {
         if (bpf_map_update_elem(ctx->map_indirections_table, &i,
                                 indirections_table + i, 0) < 0) {
@@ -241,6 +241,33 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Like can_use_fpu(), but without requiring the inexact flag to be set.
+ * The caller then has to find out itself whether the host result was
+ * rounded, see the f{32,64}_*_exact() helpers below.  This lets guests
+ * that clear the flags often (e.g. around every fetestexcept()) use the
+ * host FPU as well, without reading or clearing the host flags.
+ */
+static inline bool can_use_fpu_nearest(const float_status *s)
+{
+    /* The error computations need operations rounded to their own type */
+    if (QEMU_NO_HARDFLOAT || FLT_EVAL_METHOD != 0) {
+        return false;
+    }
+    return likely(s->float_rounding_mode == float_round_nearest_even);
+}
+
+/*
+ * QEMU_HARDFLOAT_FAST_FMA is set if fma() is a single host instruction,
+ * in which case it is cheap enough to compute the rounding error of
+ * float64 products.
+ */
+#ifdef __FP_FAST_FMA
+# define QEMU_HARDFLOAT_FAST_FMA 1
+#else
+# define QEMU_HARDFLOAT_FAST_FMA 0
+#endif
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -271,6 +298,12 @@ typedef float64 (*soft_f64_op2_fn)(float64 a, float64 b, float_status *s);
 typedef float   (*hard_f32_op2_fn)(float a, float b);
 typedef double  (*hard_f64_op2_fn)(double a, double b);
 
+/* Return whether @r is the exact result of the operation on @a and @b */
+typedef bool (*f32_exact_fn)(union_float32 a, union_float32 b,
+                             union_float32 r);
+typedef bool (*f64_exact_fn)(union_float64 a, union_float64 b,
+                             union_float64 r);
+
 /* 2-input is-zero-or-normal */
 static inline bool f32_is_zon2(union_float32 a, union_float32 b)
 {
@@ -342,15 +375,19 @@ static inline bool f64_is_inf(union_float64 a)
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
-             f32_check_fn pre, f32_check_fn post)
+             f32_check_fn pre, f32_check_fn post, f32_exact_fn exact)
 {
     union_float32 ua, ub, ur;
+    bool check_exact = false;
 
     ua.s = xa;
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
-        goto soft;
+        if (!exact || !can_use_fpu_nearest(s)) {
+            goto soft;
+        }
+        check_exact = true;
     }
 
     float32_input_flush2(&ua.s, &ub.s, s);
@@ -360,9 +397,16 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f32_is_inf(ur))) {
+        if (check_exact) {
+            goto soft;
+        }
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (unlikely(check_exact)) {
+        if (!exact(ua, ub, ur)) {
+            float_raise(float_flag_inexact, s);
+        }
     }
     return ur.s;
 
@@ -373,15 +417,19 @@ float32_gen2(float32 xa, float32 xb, float_status *s,
 static inline float64
 float64_gen2(float64 xa, float64 xb, float_status *s,
              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
-             f64_check_fn pre, f64_check_fn post)
+             f64_check_fn pre, f64_check_fn post, f64_exact_fn exact)
 {
     union_float64 ua, ub, ur;
+    bool check_exact = false;
 
     ua.s = xa;
     ub.s = xb;
 
     if (unlikely(!can_use_fpu(s))) {
-        goto soft;
+        if (!exact || !can_use_fpu_nearest(s)) {
+            goto soft;
+        }
+        check_exact = true;
     }
 
     float64_input_flush2(&ua.s, &ub.s, s);
@@ -391,9 +439,20 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
 
     ur.h = hard(ua.h, ub.h);
     if (unlikely(f64_is_inf(ur))) {
+        if (check_exact) {
+            goto soft;
+        }
         float_raise(float_flag_overflow, s);
     } else if (unlikely(fabs(ur.h) <= DBL_MIN) && post(ua, ub)) {
         goto soft;
+    } else if (unlikely(check_exact)) {
+        /* below this the rounding error may not be representable */
+        if (fabs(ur.h) < 0x1p-968) {
+            goto soft;
+        }
+        if (!exact(ua, ub, ur)) {
+            float_raise(float_flag_inexact, s);
+        }
     }
     return ur.s;
 
@@ -1878,6 +1937,38 @@ static double hard_f64_sub(double a, double b)
     return a - b;
 }
 
+/*
+ * The rounding error of a sum is exactly representable, and the TwoSum
+ * algorithm (Knuth, TAOCP vol. 2) computes it for round-to-nearest.
+ */
+static bool f32_add_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    float bv = r.h - a.h;
+    float av = r.h - bv;
+
+    return (a.h - av) + (b.h - bv) == 0;
+}
+
+static bool f32_sub_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    b.h = -b.h;
+    return f32_add_exact(a, b, r);
+}
+
+static bool f64_add_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    double bv = r.h - a.h;
+    double av = r.h - bv;
+
+    return (a.h - av) + (b.h - bv) == 0;
+}
+
+static bool f64_sub_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    b.h = -b.h;
+    return f64_add_exact(a, b, r);
+}
+
 static bool f32_addsubmul_post(union_float32 a, union_float32 b)
 {
     if (QEMU_HARDFLOAT_2F32_USE_FP) {
@@ -1896,41 +1987,47 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
 }
 
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
-                              hard_f32_op2_fn hard, soft_f32_op2_fn soft)
+                              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
+                              f32_exact_fn exact)
 {
     return float32_gen2(a, b, s, hard, soft,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, exact);
 }
 
 static float64 float64_addsub(float64 a, float64 b, float_status *s,
-                              hard_f64_op2_fn hard, soft_f64_op2_fn soft)
+                              hard_f64_op2_fn hard, soft_f64_op2_fn soft,
+                              f64_exact_fn exact)
 {
     return float64_gen2(a, b, s, hard, soft,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post, exact);
 }
 
 float32 QEMU_FLATTEN
 float32_add(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add);
+    return float32_addsub(a, b, s, hard_f32_add, soft_f32_add,
+                          f32_add_exact);
 }
 
 float32 QEMU_FLATTEN
 float32_sub(float32 a, float32 b, float_status *s)
 {
-    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub);
+    return float32_addsub(a, b, s, hard_f32_sub, soft_f32_sub,
+                          f32_sub_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_add(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add);
+    return float64_addsub(a, b, s, hard_f64_add, soft_f64_add,
+                          f64_add_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_sub(float64 a, float64 b, float_status *s)
 {
-    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
+    return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub,
+                          f64_sub_exact);
 }
 
 static bfloat16 QEMU_FLATTEN
@@ -2050,18 +2147,30 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+/* The product of two floats is exact in double precision */
+static bool f32_mul_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return (double)a.h * b.h == r.h;
+}
+
+static bool f64_mul_exact(union_float64 a, union_float64 b, union_float64 r)
+{
+    return fma(a.h, b.h, -r.h) == 0;
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_mul, soft_f32_mul,
-                        f32_is_zon2, f32_addsubmul_post);
+                        f32_is_zon2, f32_addsubmul_post, f32_mul_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_mul(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_mul, soft_f64_mul,
-                        f64_is_zon2, f64_addsubmul_post);
+                        f64_is_zon2, f64_addsubmul_post,
+                        QEMU_HARDFLOAT_FAST_FMA ? f64_mul_exact : NULL);
 }
 
 bfloat16 QEMU_FLATTEN
@@ -2400,18 +2509,24 @@ static bool f64_div_post(union_float64 a, union_float64 b)
     return !float64_is_zero(a.s);
 }
 
+/* r * b is exact in double precision, so it equals a iff r is exact */
+static bool f32_div_exact(union_float32 a, union_float32 b, union_float32 r)
+{
+    return (double)r.h * b.h == a.h;
+}
+
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
     return float32_gen2(a, b, s, hard_f32_div, soft_f32_div,
-                        f32_div_pre, f32_div_post);
+                        f32_div_pre, f32_div_post, f32_div_exact);
 }
 
 float64 QEMU_FLATTEN
 float64_div(float64 a, float64 b, float_status *s)
 {
     return float64_gen2(a, b, s, hard_f64_div, soft_f64_div,
-                        f64_div_pre, f64_div_post);
+                        f64_div_pre, f64_div_post, NULL);
 }
 
 bfloat16 QEMU_FLATTEN
@@ -2697,6 +2812,22 @@ float32 float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(can_use_fpu(s) && float64_is_zero_or_normal(a))) {
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        uf.h = ud.h;
+        /*
+         * Overflow and (possible) underflow need the flags computed by
+         * softfloat; see also f32_addsubmul_post().
+         */
+        if (likely((fabsf(uf.h) > FLT_MIN && !float32_is_infinity(uf.s)) ||
+                   float64_is_zero(a))) {
+            return uf.s;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2862,6 +2993,15 @@ float32 float32_round_to_int(float32 a, float_status *s)
 {
     FloatParts64 p;
 
+    /* can_use_fpu() implies round-to-nearest-even, i.e. rintf() */
+    if (likely(can_use_fpu(s) && float32_is_zero_or_normal(a))) {
+        union_float32 ua;
+
+        ua.s = a;
+        ua.h = rintf(ua.h);
+        return ua.s;
+    }
+
     float32_unpack_canonical(&p, a, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float32_params);
     return float32_round_pack_canonical(&p, s);
@@ -2871,6 +3011,14 @@ float64 float64_round_to_int(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(can_use_fpu(s) && float64_is_zero_or_normal(a))) {
+        union_float64 ua;
+
+        ua.s = a;
+        ua.h = rint(ua.h);
+        return ua.s;
+    }
+
     float64_unpack_canonical(&p, a, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float64_params);
     return float64_round_pack_canonical(&p, s);
@@ -2956,10 +3104,54 @@ int16_t float32_to_int16_scalbn(float32 a, FloatRoundMode rmode, int scale,
     return parts_float_to_sint(&p, rmode, scale, INT16_MIN, INT16_MAX, s);
 }
 
+/*
+ * Hardfloat conversion of a zero or normal number @d to an integer in
+ * [@lo, @hi).  Only the rounding modes that map to trunc() and rint()
+ * are handled, and inexact must already be raised, as for can_use_fpu();
+ * everything else, including out of range values, is left to softfloat.
+ */
+static inline bool hard_float_to_sint(double d, FloatRoundMode rmode,
+                                      int scale, double lo, double hi,
+                                      const float_status *s, int64_t *ret)
+{
+    double r;
+
+    if (QEMU_NO_HARDFLOAT || scale != 0 ||
+        !(s->float_exception_flags & float_flag_inexact)) {
+        return false;
+    }
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = rint(d);
+        break;
+    case float_round_to_zero:
+        r = trunc(d);
+        break;
+    default:
+        return false;
+    }
+
+    if (unlikely(!(r >= lo && r < hi))) {
+        return false;
+    }
+    *ret = r;
+    return true;
+}
+
 int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(float32_is_zero_or_normal(a))) {
+        union_float32 ua = { .s = a };
+
+        if (hard_float_to_sint(ua.h, rmode, scale, -0x1p31, 0x1p31, s, &r)) {
+            return r;
+        }
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -2969,6 +3161,15 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(float32_is_zero_or_normal(a))) {
+        union_float32 ua = { .s = a };
+
+        if (hard_float_to_sint(ua.h, rmode, scale, -0x1p63, 0x1p63, s, &r)) {
+            return r;
+        }
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -2987,6 +3188,15 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(float64_is_zero_or_normal(a))) {
+        union_float64 ua = { .s = a };
+
+        if (hard_float_to_sint(ua.h, rmode, scale, -0x1p31, 0x1p31, s, &r)) {
+            return r;
+        }
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -2996,6 +3206,15 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    int64_t r;
+
+    if (likely(float64_is_zero_or_normal(a))) {
+        union_float64 ua = { .s = a };
+
+        if (hard_float_to_sint(ua.h, rmode, scale, -0x1p63, 0x1p63, s, &r)) {
+            return r;
+        }
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3892,6 +4111,20 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    /*
+     * Without NaNs the isnum variants behave like the plain ones, and
+     * unless both are zeroes (whose sign matters) an ordinary comparison
+     * picks the result; no flags can be raised.
+     */
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag) &&
+        likely(float32_is_zero_or_normal(a) &&
+               float32_is_zero_or_normal(b) &&
+               !(float32_is_zero(a) && float32_is_zero(b)))) {
+        union_float32 ua = { .s = a }, ub = { .s = b };
+
+        return (flags & minmax_ismin) == (ua.h < ub.h) ? a : b;
+    }
+
     float32_unpack_canonical(&pa, a, s);
     float32_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3903,6 +4136,15 @@ static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag) &&
+        likely(float64_is_zero_or_normal(a) &&
+               float64_is_zero_or_normal(b) &&
+               !(float64_is_zero(a) && float64_is_zero(b)))) {
+        union_float64 ua = { .s = a }, ub = { .s = b };
+
+        return (flags & minmax_ismin) == (ua.h < ub.h) ? a : b;
+    }
+
     float64_unpack_canonical(&pa, a, s);
     float64_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -268,6 +268,23 @@ SRST
     Show memory tree.
 ERST
 
+    {
+        .name       = "mmio-stats",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the memory regions that took the most time "
+                      "handling accesses, up to max entries (default: 20)",
+        .cmd        = hmp_info_mmio_stats,
+    },
+
+SRST
+  ``info mmio-stats`` [*max*]
+    Show the number of reads and writes dispatched to each memory region,
+    and the time spent handling them, for up to *max* regions (default: 20)
+    sorted by total time.  The statistics must have been enabled with
+    ``mmio-stats on``.
+ERST
+
 #if defined(CONFIG_TCG)
     {
         .name       = "jit",
@@ -282,6 +299,22 @@ SRST
     Show dynamic compiler info.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-hot",
+        .args_type  = "count:i?",
+        .params     = "[count]",
+        .help       = "show the most executed translation blocks",
+    },
+#endif
+
+SRST
+  ``info tb-hot`` *[count]*
+    Show the *count* (default 20) most executed translation blocks, with
+    their guest and host code sizes.  Requires ``-accel
+    tcg,tb-exec-count=on``.
+ERST
+
 #if defined(CONFIG_TCG)
     {
         .name       = "opcount",
@@ -317,6 +350,10 @@ SRST
     ``-n``
       do not coalesce objects with the same call site
 
+    Entries of type "BQL hold" report how long the big QEMU lock was held
+    after being taken at the given call site, instead of the time spent
+    waiting for it.
+
     When different objects that share the same call site are coalesced,
     the "Object" field shows---enclosed in brackets---the number of objects
     being coalesced.
@@ -686,6 +723,22 @@ SRST
     Show iothread's identifiers.
 ERST
 
+    {
+        .name       = "stats",
+        .args_type  = "provider:s?",
+        .params     = "[provider]",
+        .help       = "show the statistics published by QEMU subsystems, "
+                      "in Prometheus text format",
+        .cmd        = hmp_info_stats,
+    },
+
+SRST
+  ``info stats`` [*provider*]
+    Show the statistics returned by ``query-stats``, optionally only those
+    of *provider*, in the Prometheus text exposition format.  Latency
+    histograms are converted to seconds.
+ERST
+
     {
         .name       = "rocker",
         .args_type  = "name:s",
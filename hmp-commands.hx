@@ -622,6 +622,22 @@ SRST
   whether profiling is on or off.
 ERST
 
+    {
+        .name       = "mmio-stats",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset per-region MMIO statistics. "
+                      "With no arguments, prints whether they are on or off.",
+        .cmd        = hmp_mmio_stats,
+    },
+
+SRST
+``mmio-stats [on|off|reset]``
+  Enable, disable or reset the counting of accesses dispatched to each
+  memory region, and of the time spent handling them. With no arguments,
+  prints whether the statistics are on or off.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
@@ -317,8 +317,8 @@ static V9fsFidState *alloc_fid(V9fsState *s, int32_t fid)
     f->flags |= FID_REFERENCED;
     QSIMPLEQ_INSERT_TAIL(&s->fid_list, f, next);
 
-    v9fs_readdir_init(s->proto_version, &f->fs.dir);
-    v9fs_readdir_init(s->proto_version, &f->fs_reclaim.dir);
+    v9fs_readdir_init(&f->fs.dir);
+    v9fs_readdir_init(&f->fs_reclaim.dir);
 
     return f;
 }
@@ -2196,6 +2196,18 @@ static int v9fs_xattr_read(V9fsState *s, V9fsPDU *pdu, V9fsFidState *fidp,
     return offset;
 }
 
+static void v9fs_free_dirents(struct V9fsDirEnt *e)
+{
+    struct V9fsDirEnt *next = NULL;
+
+    for (; e; e = next) {
+        next = e->next;
+        g_free(e->dent);
+        g_free(e->st);
+        g_free(e);
+    }
+}
+
 static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
                                                   V9fsFidState *fidp,
                                                   uint32_t max_count)
@@ -2204,9 +2216,8 @@ static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
     V9fsStat v9stat;
     int len, err = 0;
     int32_t count = 0;
-    struct stat stbuf;
     off_t saved_dir_pos;
-    struct dirent *dent;
+    struct V9fsDirEnt *entries = NULL, *e;
 
     /* save the directory position */
     saved_dir_pos = v9fs_co_telldir(pdu, fidp);
@@ -2214,57 +2225,55 @@ static int coroutine_fn v9fs_do_readdir_with_stat(V9fsPDU *pdu,
         return saved_dir_pos;
     }
 
-    while (1) {
-        v9fs_path_init(&path);
-
-        v9fs_readdir_lock(&fidp->fs.dir);
+    /*
+     * Read and stat the directory entries in one go on a background IO
+     * thread, rather than hopping there and back for each of them.  The
+     * size estimate of v9fs_co_readdir_many() is that of a 9P2000.L entry,
+     * which is smaller than a 9P2000.u stat, so at least as many entries as
+     * fit in the response are returned.
+     */
+    err = v9fs_co_readdir_many(pdu, fidp, &entries, saved_dir_pos, max_count,
+                               true);
+    if (err < 0) {
+        goto out;
+    }
+    err = 0;
 
-        err = v9fs_co_readdir(pdu, fidp, &dent);
-        if (err || !dent) {
-            break;
-        }
-        err = v9fs_co_name_to_path(pdu, &fidp->path, dent->d_name, &path);
-        if (err < 0) {
-            break;
-        }
-        err = v9fs_co_lstat(pdu, &path, &stbuf);
+    for (e = entries; e; e = e->next) {
+        v9fs_path_init(&path);
+        err = v9fs_co_name_to_path(pdu, &fidp->path, e->dent->d_name, &path);
         if (err < 0) {
+            v9fs_path_free(&path);
             break;
         }
-        err = stat_to_v9stat(pdu, &path, dent->d_name, &stbuf, &v9stat);
+        err = stat_to_v9stat(pdu, &path, e->dent->d_name, e->st, &v9stat);
+        v9fs_path_free(&path);
         if (err < 0) {
             break;
         }
         if ((count + v9stat.size + 2) > max_count) {
-            v9fs_readdir_unlock(&fidp->fs.dir);
-
-            /* Ran out of buffer. Set dir back to old position and return */
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
             v9fs_stat_free(&v9stat);
-            v9fs_path_free(&path);
-            return count;
+            break;
         }
 
         /* 11 = 7 + 4 (7 = start offset, 4 = space for storing count) */
         len = pdu_marshal(pdu, 11 + count, "S", &v9stat);
-
-        v9fs_readdir_unlock(&fidp->fs.dir);
-
+        v9fs_stat_free(&v9stat);
         if (len < 0) {
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
-            v9fs_stat_free(&v9stat);
-            v9fs_path_free(&path);
-            return len;
+            err = len;
+            break;
         }
         count += len;
-        v9fs_stat_free(&v9stat);
-        v9fs_path_free(&path);
-        saved_dir_pos = dent->d_off;
+        saved_dir_pos = e->dent->d_off;
     }
 
-    v9fs_readdir_unlock(&fidp->fs.dir);
+    /* Entries that were read ahead but not sent are read again next time */
+    if (e) {
+        v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
+    }
 
-    v9fs_path_free(&path);
+out:
+    v9fs_free_dirents(entries);
     if (err < 0) {
         return err;
     }
@@ -2322,16 +2331,27 @@ static void coroutine_fn v9fs_read(void *opaque)
         int32_t len;
 
         v9fs_init_qiov_from_pdu(&qiov_full, pdu, offset + 4, max_count, false);
-        qemu_iovec_init(&qiov, qiov_full.niov);
+        qemu_iovec_init(&qiov, 0);
         do {
-            qemu_iovec_reset(&qiov);
-            qemu_iovec_concat(&qiov, &qiov_full, count, qiov_full.size - count);
+            /*
+             * The file is read straight into the guest buffers of the
+             * request.  Only after a short read is a vector for the
+             * remaining part of them needed.
+             */
+            QEMUIOVector *cur = &qiov_full;
+
+            if (count) {
+                qemu_iovec_reset(&qiov);
+                qemu_iovec_concat(&qiov, &qiov_full, count,
+                                  qiov_full.size - count);
+                cur = &qiov;
+            }
             if (0) {
-                print_sg(qiov.iov, qiov.niov);
+                print_sg(cur->iov, cur->niov);
             }
             /* Loop in case of EINTR */
             do {
-                len = v9fs_co_preadv(pdu, fidp, qiov.iov, qiov.niov, off);
+                len = v9fs_co_preadv(pdu, fidp, cur->iov, cur->niov, off);
                 if (len >= 0) {
                     off   += len;
                     count += len;
@@ -2378,18 +2398,6 @@ size_t v9fs_readdir_response_size(V9fsString *name)
     return 24 + v9fs_string_size(name);
 }
 
-static void v9fs_free_dirents(struct V9fsDirEnt *e)
-{
-    struct V9fsDirEnt *next = NULL;
-
-    for (; e; e = next) {
-        next = e->next;
-        g_free(e->dent);
-        g_free(e->st);
-        g_free(e);
-    }
-}
-
 static int coroutine_fn v9fs_do_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
                                         off_t offset, int32_t max_count)
 {
@@ -2631,16 +2639,23 @@ static void coroutine_fn v9fs_write(void *opaque)
         err = -EINVAL;
         goto out;
     }
-    qemu_iovec_init(&qiov, qiov_full.niov);
+    qemu_iovec_init(&qiov, 0);
     do {
-        qemu_iovec_reset(&qiov);
-        qemu_iovec_concat(&qiov, &qiov_full, total, qiov_full.size - total);
+        /* As for Tread, only a short write needs a new vector */
+        QEMUIOVector *cur = &qiov_full;
+
+        if (total) {
+            qemu_iovec_reset(&qiov);
+            qemu_iovec_concat(&qiov, &qiov_full, total,
+                              qiov_full.size - total);
+            cur = &qiov;
+        }
         if (0) {
-            print_sg(qiov.iov, qiov.niov);
+            print_sg(cur->iov, cur->niov);
         }
         /* Loop in case of EINTR */
         do {
-            len = v9fs_co_pwritev(pdu, fidp, qiov.iov, qiov.niov, off);
+            len = v9fs_co_pwritev(pdu, fidp, cur->iov, cur->niov, off);
             if (len >= 0) {
                 off   += len;
                 total += len;
@@ -196,39 +196,26 @@ typedef struct V9fsXattr
 
 typedef struct V9fsDir {
     DIR *stream;
-    P9ProtoVersion proto_version;
-    /* readdir mutex type used for 9P2000.u protocol variant */
-    CoMutex readdir_mutex_u;
-    /* readdir mutex type used for 9P2000.L protocol variant */
-    QemuMutex readdir_mutex_L;
+    /*
+     * Taken by the background IO thread in v9fs_co_readdir_many(), for both
+     * the 9P2000.u and the 9P2000.L protocol variants.
+     */
+    QemuMutex readdir_mutex;
 } V9fsDir;
 
 static inline void v9fs_readdir_lock(V9fsDir *dir)
 {
-    if (dir->proto_version == V9FS_PROTO_2000U) {
-        qemu_co_mutex_lock(&dir->readdir_mutex_u);
-    } else {
-        qemu_mutex_lock(&dir->readdir_mutex_L);
-    }
+    qemu_mutex_lock(&dir->readdir_mutex);
 }
 
 static inline void v9fs_readdir_unlock(V9fsDir *dir)
 {
-    if (dir->proto_version == V9FS_PROTO_2000U) {
-        qemu_co_mutex_unlock(&dir->readdir_mutex_u);
-    } else {
-        qemu_mutex_unlock(&dir->readdir_mutex_L);
-    }
+    qemu_mutex_unlock(&dir->readdir_mutex);
 }
 
-static inline void v9fs_readdir_init(P9ProtoVersion proto_version, V9fsDir *dir)
+static inline void v9fs_readdir_init(V9fsDir *dir)
 {
-    dir->proto_version = proto_version;
-    if (proto_version == V9FS_PROTO_2000U) {
-        qemu_co_mutex_init(&dir->readdir_mutex_u);
-    } else {
-        qemu_mutex_init(&dir->readdir_mutex_L);
-    }
+    qemu_mutex_init(&dir->readdir_mutex);
 }
 
 /**
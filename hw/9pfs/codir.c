@@ -44,24 +44,6 @@ static int do_readdir(V9fsPDU *pdu, V9fsFidState *fidp, struct dirent **dent)
     return err;
 }
 
-/*
- * TODO: This will be removed for performance reasons.
- * Use v9fs_co_readdir_many() instead.
- */
-int coroutine_fn v9fs_co_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
-                                 struct dirent **dent)
-{
-    int err;
-
-    if (v9fs_request_cancelled(pdu)) {
-        return -EINTR;
-    }
-    v9fs_co_run_in_worker({
-        err = do_readdir(pdu, fidp, dent);
-    });
-    return err;
-}
-
 /*
  * This is solely executed on a background IO thread.
  *
@@ -202,7 +184,8 @@ out:
  * v9fs_co_readdir_many(), both on success and on error cases of this
  * function, to avoid memory leaks once @p entries are no longer needed.
  *
- * @param pdu - the causing 9p (T_readdir) client request
+ * @param pdu - the causing 9p (T_readdir, or T_read on a 9P2000.u directory)
+ *              client request
  * @param fidp - already opened directory where readdir shall be performed on
  * @param entries - output for directory entries (must not be NULL)
  * @param offset - initial position inside the directory the function shall
@@ -24,6 +24,8 @@
 #include "coth.h"
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio-access.h"
+#include "qapi/error.h"
+#include "qemu/host-utils.h"
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "sysemu/qtest.h"
@@ -211,13 +213,26 @@ static void virtio_9p_device_realize(DeviceState *dev, Error **errp)
         fse->export_flags |= V9FS_NO_PERF_WARN;
     }
 
+    /*
+     * A guest without indirect descriptors can't chain more buffers into a
+     * single request than there are ring entries, which caps its msize.
+     * Allow a larger ring so that large messages are mapped directly.
+     */
+    if (v->queue_size < MAX_REQ || v->queue_size > VIRTQUEUE_MAX_SIZE ||
+        !is_power_of_2(v->queue_size)) {
+        error_setg(errp, "invalid queue-size property (%" PRIu16 "), "
+                   "must be a power of 2 between %d and %d",
+                   v->queue_size, MAX_REQ, VIRTQUEUE_MAX_SIZE);
+        return;
+    }
+
     if (v9fs_device_realize_common(s, &virtio_9p_transport, errp)) {
         return;
     }
 
     v->config_size = sizeof(struct virtio_9p_config) + strlen(s->fsconf.tag);
     virtio_init(vdev, "virtio-9p", VIRTIO_ID_9P, v->config_size);
-    v->vq = virtio_add_queue(vdev, MAX_REQ, handle_9p_output);
+    v->vq = virtio_add_queue(vdev, v->queue_size, handle_9p_output);
 }
 
 static void virtio_9p_device_unrealize(DeviceState *dev)
@@ -246,6 +261,7 @@ static const VMStateDescription vmstate_virtio_9p = {
 static Property virtio_9p_properties[] = {
     DEFINE_PROP_STRING("mount_tag", V9fsVirtioState, state.fsconf.tag),
     DEFINE_PROP_STRING("fsdev", V9fsVirtioState, state.fsconf.fsdev_id),
+    DEFINE_PROP_UINT16("queue-size", V9fsVirtioState, queue_size, MAX_REQ),
     DEFINE_PROP_END_OF_LIST(),
 };
 
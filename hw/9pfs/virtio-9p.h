@@ -10,6 +10,7 @@ struct V9fsVirtioState {
     VirtIODevice parent_obj;
     VirtQueue *vq;
     size_t config_size;
+    uint16_t queue_size;
     VirtQueueElement *elems[MAX_REQ];
     V9fsState state;
 };
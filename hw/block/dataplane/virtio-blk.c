@@ -43,13 +43,29 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /*
+     * With iothread-vq-mapping, virtqueues are processed in these IOThreads
+     * and the BlockBackend lives in the first one.
+     */
+    IOThread **vq_iothreads;
+    unsigned num_vq_iothreads;
+    AioContext **vq_aio_context;    /* AioContext of each virtqueue */
+
+    /*
+     * Draining the BlockBackend only disables external event handlers in
+     * s->ctx, so virtqueues in the other IOThreads are quiesced by hand.
+     */
+    bool quiesced;
+    unsigned vq_handlers_running;
 };
 
 /* Raise an interrupt to signal guest, if necessary */
 void virtio_blk_data_plane_notify(VirtIOBlockDataPlane *s, VirtQueue *vq)
 {
     if (s->batch_notifications) {
-        set_bit(virtio_get_queue_index(vq), s->batch_notify_vqs);
+        /* requests can fail in the IOThread of their virtqueue */
+        set_bit_atomic(virtio_get_queue_index(vq), s->batch_notify_vqs);
         qemu_bh_schedule(s->bh);
     } else {
         virtio_notify_irqfd(s->vdev, vq);
@@ -63,8 +79,9 @@ static void notify_guest_bh(void *opaque)
     unsigned long bitmap[BITS_TO_LONGS(nvqs)];
     unsigned j;
 
-    memcpy(bitmap, s->batch_notify_vqs, sizeof(bitmap));
-    memset(s->batch_notify_vqs, 0, sizeof(bitmap));
+    for (j = 0; j < BITS_TO_LONGS(nvqs); j++) {
+        bitmap[j] = qatomic_xchg(&s->batch_notify_vqs[j], 0);
+    }
 
     for (j = 0; j < nvqs; j += BITS_PER_LONG) {
         unsigned long bits = bitmap[j / BITS_PER_LONG];
@@ -80,6 +97,43 @@ static void notify_guest_bh(void *opaque)
     }
 }
 
+/*
+ * Look up and take a reference to the IOThreads of iothread-vq-mapping.
+ *
+ * Context: QEMU global mutex held
+ */
+static IOThread **virtio_blk_iothread_vq_mapping(VirtIOBlkConf *conf,
+                                                 Error **errp)
+{
+    unsigned n = conf->num_iothread_vq_mapping;
+    IOThread **iothreads;
+    unsigned i;
+
+    if (n > conf->num_queues) {
+        error_setg(errp, "iothread-vq-mapping has %u entries, more than "
+                   "num-queues (%" PRIu16 ")", n, conf->num_queues);
+        return NULL;
+    }
+
+    iothreads = g_new0(IOThread *, n);
+    for (i = 0; i < n; i++) {
+        const char *id = conf->iothread_vq_mapping[i];
+
+        iothreads[i] = id ? iothread_by_id(id) : NULL;
+        if (!iothreads[i]) {
+            error_setg(errp, "iothread-vq-mapping: IOThread '%s' not found",
+                       id ? id : "");
+            while (i--) {
+                object_unref(OBJECT(iothreads[i]));
+            }
+            g_free(iothreads);
+            return NULL;
+        }
+        object_ref(OBJECT(iothreads[i]));
+    }
+    return iothreads;
+}
+
 /* Context: QEMU global mutex held */
 bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
                                   VirtIOBlockDataPlane **dataplane,
@@ -88,10 +142,18 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     VirtIOBlockDataPlane *s;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    IOThread **vq_iothreads = NULL;
+    unsigned i;
 
     *dataplane = NULL;
 
-    if (conf->iothread) {
+    if (conf->iothread && conf->num_iothread_vq_mapping) {
+        error_setg(errp, "iothread and iothread-vq-mapping properties "
+                   "cannot be set at the same time");
+        return false;
+    }
+
+    if (conf->iothread || conf->num_iothread_vq_mapping) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -115,6 +177,12 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     if (!virtio_device_ioeventfd_enabled(vdev)) {
         return false;
     }
+    if (conf->num_iothread_vq_mapping) {
+        vq_iothreads = virtio_blk_iothread_vq_mapping(conf, errp);
+        if (!vq_iothreads) {
+            return false;
+        }
+    }
 
     s = g_new0(VirtIOBlockDataPlane, 1);
     s->vdev = vdev;
@@ -124,9 +192,22 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
         s->iothread = conf->iothread;
         object_ref(OBJECT(s->iothread));
         s->ctx = iothread_get_aio_context(s->iothread);
+    } else if (vq_iothreads) {
+        s->ctx = iothread_get_aio_context(vq_iothreads[0]);
     } else {
         s->ctx = qemu_get_aio_context();
     }
+
+    /* Virtqueues are assigned round-robin to the IOThreads of the mapping */
+    s->vq_iothreads = vq_iothreads;
+    s->num_vq_iothreads = conf->num_iothread_vq_mapping;
+    s->vq_aio_context = g_new(AioContext *, conf->num_queues);
+    for (i = 0; i < conf->num_queues; i++) {
+        s->vq_aio_context[i] = vq_iothreads ?
+            iothread_get_aio_context(vq_iothreads[i % s->num_vq_iothreads]) :
+            s->ctx;
+    }
+
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
 
@@ -139,6 +220,7 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 {
     VirtIOBlock *vblk;
+    unsigned i;
 
     if (!s) {
         return;
@@ -146,11 +228,19 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 
     vblk = VIRTIO_BLK(s->vdev);
     assert(!vblk->dataplane_started);
+    if (s->quiesced) {
+        virtio_blk_data_plane_drained_end(s);
+    }
     g_free(s->batch_notify_vqs);
     qemu_bh_delete(s->bh);
     if (s->iothread) {
         object_unref(OBJECT(s->iothread));
     }
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        object_unref(OBJECT(s->vq_iothreads[i]));
+    }
+    g_free(s->vq_iothreads);
+    g_free(s->vq_aio_context);
     g_free(s);
 }
 
@@ -158,11 +248,84 @@ static bool virtio_blk_data_plane_handle_output(VirtIODevice *vdev,
                                                 VirtQueue *vq)
 {
     VirtIOBlock *s = (VirtIOBlock *)vdev;
+    VirtIOBlockDataPlane *dp = s->dataplane;
+    bool progress = false;
 
     assert(s->dataplane);
     assert(s->dataplane_started);
 
-    return virtio_blk_handle_vq(s, vq);
+    if (dp->vq_aio_context[virtio_get_queue_index(vq)] == dp->ctx) {
+        return virtio_blk_handle_vq(s, vq);
+    }
+
+    /*
+     * Pairs with the barrier in virtio_blk_data_plane_drained_begin(): either
+     * the drain sees this handler running, or the handler sees the drain.
+     * A kick consumed here is replayed by drained_end.
+     */
+    qatomic_inc(&dp->vq_handlers_running);
+    if (!qatomic_read(&dp->quiesced)) {
+        progress = virtio_blk_handle_vq(s, vq);
+    }
+    qatomic_dec(&dp->vq_handlers_running);
+    aio_wait_kick();
+    return progress;
+}
+
+/* Stop processing virtqueues in IOThreads other than the BlockBackend's */
+void virtio_blk_data_plane_drained_begin(VirtIOBlockDataPlane *s)
+{
+    unsigned i;
+
+    if (s->quiesced) {
+        return;
+    }
+    qatomic_set(&s->quiesced, true);
+    smp_mb();
+
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_disable_external(ctx);
+        }
+    }
+}
+
+/* Is a virtqueue handler still running in one of the other IOThreads? */
+bool virtio_blk_data_plane_drained_poll(VirtIOBlockDataPlane *s)
+{
+    return qatomic_read(&s->vq_handlers_running) > 0;
+}
+
+void virtio_blk_data_plane_drained_end(VirtIOBlockDataPlane *s)
+{
+    VirtIOBlock *vblk = VIRTIO_BLK(s->vdev);
+    unsigned i;
+
+    if (!s->quiesced) {
+        return;
+    }
+    qatomic_set(&s->quiesced, false);
+
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_enable_external(ctx);
+        }
+    }
+
+    /* Pick up requests whose kick arrived during the drained section */
+    if (vblk->dataplane_started && !vblk->dataplane_disabled) {
+        for (i = 0; i < s->conf->num_queues; i++) {
+            if (s->vq_aio_context[i] != s->ctx) {
+                VirtQueue *vq = virtio_get_queue(s->vdev, i);
+
+                event_notifier_set(virtio_queue_get_host_notifier(vq));
+            }
+        }
+    }
 }
 
 /* Context: QEMU global mutex held */
@@ -254,14 +417,15 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     }
 
     /* Get this show started by hooking up our callbacks */
-    aio_context_acquire(s->ctx);
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
+        AioContext *ctx = s->vq_aio_context[i];
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx,
+        aio_context_acquire(ctx);
+        virtio_queue_aio_set_host_notifier_handler(vq, ctx,
                 virtio_blk_data_plane_handle_output);
+        aio_context_release(ctx);
     }
-    aio_context_release(s->ctx);
     return 0;
 
   fail_aio_context:
@@ -297,12 +461,15 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
 static void virtio_blk_data_plane_stop_bh(void *opaque)
 {
     VirtIOBlockDataPlane *s = opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
     unsigned i;
 
     for (i = 0; i < s->conf->num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, NULL);
+        if (s->vq_aio_context[i] == ctx) {
+            virtio_queue_aio_set_host_notifier_handler(vq, ctx, NULL);
+        }
     }
 }
 
@@ -329,6 +496,20 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     s->stopping = true;
     trace_virtio_blk_data_plane_stop(s);
 
+    /*
+     * Stop the other IOThreads first: their virtqueue handlers take the
+     * AioContext lock of s->ctx to submit requests.
+     */
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_context_acquire(ctx);
+            aio_wait_bh_oneshot(ctx, virtio_blk_data_plane_stop_bh, s);
+            aio_context_release(ctx);
+        }
+    }
+
     aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_blk_data_plane_stop_bh, s);
 
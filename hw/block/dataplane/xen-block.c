@@ -60,6 +60,9 @@ struct XenBlockDataPlane {
     BlockBackend *blk;
     unsigned int sector_size;
     QEMUBH *bh;
+    /* Notifies the frontend once for all responses completed in a batch */
+    QEMUBH *notify_bh;
+    bool notify_pending;
     IOThread *iothread;
     AioContext *ctx;
 };
@@ -117,19 +120,42 @@ out:
     return request;
 }
 
+static void xen_block_notify(XenBlockDataPlane *dataplane)
+{
+    Error *local_err = NULL;
+
+    dataplane->notify_pending = false;
+    xen_device_notify_event_channel(dataplane->xendev,
+                                    dataplane->event_channel,
+                                    &local_err);
+    if (local_err) {
+        error_report_err(local_err);
+    }
+}
+
+static void xen_block_notify_bh(void *opaque)
+{
+    XenBlockDataPlane *dataplane = opaque;
+
+    aio_context_acquire(dataplane->ctx);
+    if (dataplane->notify_pending) {
+        xen_block_notify(dataplane);
+    }
+    aio_context_release(dataplane->ctx);
+}
+
 static void xen_block_complete_request(XenBlockRequest *request)
 {
     XenBlockDataPlane *dataplane = request->dataplane;
 
-    if (xen_block_send_response(request)) {
-        Error *local_err = NULL;
-
-        xen_device_notify_event_channel(dataplane->xendev,
-                                        dataplane->event_channel,
-                                        &local_err);
-        if (local_err) {
-            error_report_err(local_err);
-        }
+    /*
+     * The AIO engines complete many requests in one go; the responses are
+     * pushed to the ring right away but the event channel, which costs a
+     * hypercall, is only notified once they have all been pushed.
+     */
+    if (xen_block_send_response(request) && !dataplane->notify_pending) {
+        dataplane->notify_pending = true;
+        qemu_bh_schedule(dataplane->notify_bh);
     }
 
     QLIST_REMOVE(request, list);
@@ -633,6 +659,8 @@ XenBlockDataPlane *xen_block_dataplane_create(XenDevice *xendev,
     }
     dataplane->bh = aio_bh_new(dataplane->ctx, xen_block_dataplane_bh,
                                dataplane);
+    dataplane->notify_bh = aio_bh_new(dataplane->ctx, xen_block_notify_bh,
+                                      dataplane);
 
     return dataplane;
 }
@@ -654,6 +682,7 @@ void xen_block_dataplane_destroy(XenBlockDataPlane *dataplane)
     }
 
     qemu_bh_delete(dataplane->bh);
+    qemu_bh_delete(dataplane->notify_bh);
     if (dataplane->iothread) {
         object_unref(OBJECT(dataplane->iothread));
     }
@@ -687,10 +716,15 @@ void xen_block_dataplane_stop(XenBlockDataPlane *dataplane)
      * further processing.
      */
     qemu_bh_cancel(dataplane->bh);
+    qemu_bh_cancel(dataplane->notify_bh);
 
     if (dataplane->event_channel) {
         Error *local_err = NULL;
 
+        if (dataplane->notify_pending) {
+            xen_block_notify(dataplane);
+        }
+
         xen_device_unbind_event_channel(xendev, dataplane->event_channel,
                                         &local_err);
         dataplane->event_channel = NULL;
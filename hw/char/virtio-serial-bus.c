@@ -23,6 +23,7 @@
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "migration/qemu-file-types.h"
 #include "monitor/monitor.h"
 #include "qemu/error-report.h"
@@ -32,6 +33,13 @@
 #include "hw/virtio/virtio-serial.h"
 #include "hw/virtio/virtio-access.h"
 
+/*
+ * How much host data a port may take in one go, provided that the guest
+ * queued enough buffers.  A backend then needs a single read, and the
+ * guest a single notification, for up to this many bytes.
+ */
+#define VIRTIO_SERIAL_MAX_READ (64 * KiB)
+
 static struct VirtIOSerialDevices {
     QLIST_HEAD(, VirtIOSerial) devices;
 } vserdevices;
@@ -318,7 +326,7 @@ size_t virtio_serial_guest_ready(VirtIOSerialPort *port)
     if (use_multiport(port->vser) && !port->guest_connected) {
         return 0;
     }
-    virtqueue_get_avail_bytes(vq, &bytes, NULL, 4096, 0);
+    virtqueue_get_avail_bytes(vq, &bytes, NULL, VIRTIO_SERIAL_MAX_READ, 0);
     return bytes;
 }
 
@@ -514,6 +514,20 @@ static void machine_set_hmat(Object *obj, bool value, Error **errp)
     ms->numa_state->hmat_enabled = value;
 }
 
+static bool machine_get_numa_affinity(Object *obj, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    return ms->numa_state->host_affinity;
+}
+
+static void machine_set_numa_affinity(Object *obj, bool value, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    ms->numa_state->host_affinity = value;
+}
+
 static char *machine_get_nvdimm_persistence(Object *obj, Error **errp)
 {
     MachineState *ms = MACHINE(obj);
@@ -1099,6 +1113,13 @@ static void machine_initfn(Object *obj)
                                         "Set on/off to enable/disable "
                                         "ACPI Heterogeneous Memory Attribute "
                                         "Table (HMAT)");
+        object_property_add_bool(obj, "numa-affinity",
+                                 machine_get_numa_affinity,
+                                 machine_set_numa_affinity);
+        object_property_set_description(obj, "numa-affinity",
+                                        "Set on/off to bind vCPU threads to "
+                                        "the host nodes of their NUMA node's "
+                                        "memory backend");
     }
 
     /* Register notifier when init is done for sysbus sanity checks */
@@ -34,6 +34,7 @@
 #include "qapi/opts-visitor.h"
 #include "qapi/qapi-visit-machine.h"
 #include "sysemu/qtest.h"
+#include "sysemu/tcg.h"
 #include "hw/core/cpu.h"
 #include "hw/mem/pc-dimm.h"
 #include "migration/vmstate.h"
@@ -725,6 +726,59 @@ void numa_complete_configuration(MachineState *ms)
             complete_init_numa_distance(ms);
         }
     }
+
+    if (ms->numa_state->host_affinity) {
+        if (!ms->numa_state->num_nodes) {
+            error_report("'-machine numa-affinity=on' requires '-numa'"
+                         " nodes");
+            exit(1);
+        }
+        for (i = 0; i < ms->numa_state->num_nodes; i++) {
+            HostMemoryBackend *backend = numa_info[i].node_memdev;
+
+            if (!backend || !host_memory_backend_get_prealloc_nodes(backend)) {
+                error_report("'-machine numa-affinity=on' requires the memdev"
+                             " of NUMA node %d to be bound to host nodes"
+                             " ('host-nodes' and 'policy')", i);
+                exit(1);
+            }
+        }
+    }
+}
+
+void numa_set_vcpu_affinity(MachineState *ms, CPUState *cpu)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    CpuInstanceProperties props;
+    HostMemoryBackend *backend;
+    const unsigned long *host_nodes;
+    int ret;
+
+    if (!ms->numa_state || !ms->numa_state->host_affinity) {
+        return;
+    }
+
+    /*
+     * Round-robin TCG runs all vCPUs in one thread, which is created
+     * together with the first vCPU, so it cannot be bound to one node.
+     */
+    if (tcg_enabled() && !qemu_tcg_mttcg_enabled()) {
+        return;
+    }
+
+    props = mc->cpu_index_to_instance_props(ms, cpu->cpu_index);
+    if (!props.has_node_id) {
+        return;
+    }
+
+    backend = ms->numa_state->nodes[props.node_id].node_memdev;
+    host_nodes = host_memory_backend_get_prealloc_nodes(backend);
+    ret = os_thread_set_node_affinity(cpu->thread, host_nodes, MAX_NODES);
+    if (ret < 0) {
+        warn_report("numa: could not bind CPU %d to the host nodes of"
+                    " NUMA node %" PRId64 ": %s", cpu->cpu_index,
+                    props.node_id, strerror(-ret));
+    }
 }
 
 void parse_numa_opts(MachineState *ms)
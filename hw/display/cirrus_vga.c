@@ -2874,6 +2874,11 @@ void cirrus_init_common(CirrusVGAState *s, Object *owner,
     memory_region_init_io(&s->cirrus_vga_io, owner, &cirrus_vga_io_ops, s,
                           "cirrus-io", 0x30);
     memory_region_set_flush_coalesced(&s->cirrus_vga_io);
+    /* Index register writes can wait until the next data register access */
+    memory_region_add_coalescing(&s->cirrus_vga_io, 0x3b4 - 0x3b0, 1);
+    memory_region_add_coalescing(&s->cirrus_vga_io, 0x3c4 - 0x3b0, 1);
+    memory_region_add_coalescing(&s->cirrus_vga_io, 0x3ce - 0x3b0, 1);
+    memory_region_add_coalescing(&s->cirrus_vga_io, 0x3d4 - 0x3b0, 1);
     memory_region_add_subregion(system_io, 0x3b0, &s->cirrus_vga_io);
 
     memory_region_init(&s->low_mem_container, owner,
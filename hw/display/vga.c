@@ -1464,6 +1464,38 @@ void vga_dirty_log_stop(VGACommonState *s)
 /*
  * graphic modes
  */
+
+/*
+ * Narrow an updated scanline [page0, page1] of a linear (>= 8bpp) mode to
+ * the pixels [*x0, *x1) that are covered by dirty pages.  Leaves the range
+ * untouched if no page is dirty, i.e. the update had another cause.
+ */
+static void vga_dirty_span(VGACommonState *s, DirtyBitmapSnapshot *snap,
+                           ram_addr_t page0, ram_addr_t page1, int bypp,
+                           int *x0, int *x1)
+{
+    ram_addr_t p, start, end, first = 0, last = 0;
+    bool found = false;
+
+    for (p = page0 & TARGET_PAGE_MASK; p <= page1; p += TARGET_PAGE_SIZE) {
+        start = MAX(p, page0);
+        end = MIN(p + TARGET_PAGE_SIZE, page1 + 1);
+        if (memory_region_snapshot_get_dirty(&s->vram, snap,
+                                             start, end - start)) {
+            if (!found) {
+                first = start;
+                found = true;
+            }
+            last = end;
+        }
+    }
+    if (found) {
+        /* the 8bpp line helper converts groups of 8 pixels */
+        *x0 = QEMU_ALIGN_DOWN((first - page0) / bypp, 8);
+        *x1 = MIN(ROUND_UP(DIV_ROUND_UP(last - page0, bypp), 8), *x1);
+    }
+}
+
 static void vga_draw_graphic(VGACommonState *s, int full_update)
 {
     DisplaySurface *surface = qemu_console_surface(s->con);
@@ -1472,6 +1504,7 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
     ram_addr_t page0, page1, region_start, region_end;
     DirtyBitmapSnapshot *snap = NULL;
     int disp_width, multi_scan, multi_run;
+    int bypp, x0, x1, run_x0, run_x1;
     uint8_t *d;
     uint32_t v, addr1, addr;
     vga_draw_line_func *vga_draw_line = NULL;
@@ -1652,6 +1685,12 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
     addr1 = (s->start_addr * 4);
     bwidth = DIV_ROUND_UP(width * bits, 8);
     y_start = -1;
+    run_x0 = run_x1 = 0;
+    /*
+     * In the linear modes a pixel maps to a fixed byte range of the
+     * scanline, so updates can be narrowed to the dirty pages.
+     */
+    bypp = (bits >= 8 && disp_width == width) ? bits / 8 : 0;
     d = surface_data(surface);
     linesize = surface_stride(surface);
     y1 = 0;
@@ -1692,21 +1731,38 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
             update = memory_region_snapshot_get_dirty(&s->vram, snap,
                                                       page0, page1 - page0);
         }
+        x0 = 0;
+        x1 = disp_width;
+        if (update && !full_update && bypp && page1 >= page0 &&
+            !vga_scanline_invalidated(s, y)) {
+            vga_dirty_span(s, snap, page0, page1, bypp, &x0, &x1);
+        }
         /* explicit invalidation for the hardware cursor (cirrus only) */
         update |= vga_scanline_invalidated(s, y);
         if (update) {
-            if (y_start < 0)
+            if (y_start < 0) {
                 y_start = y;
+                run_x0 = x0;
+                run_x1 = x1;
+            } else {
+                run_x0 = MIN(run_x0, x0);
+                run_x1 = MAX(run_x1, x1);
+            }
             if (!(is_buffer_shared(surface))) {
-                vga_draw_line(s, d, addr, width);
+                if (bypp) {
+                    vga_draw_line(s, d + x0 * surface_bytes_per_pixel(surface),
+                                  addr + x0 * bypp, x1 - x0);
+                } else {
+                    vga_draw_line(s, d, addr, width);
+                }
                 if (s->cursor_draw_line)
                     s->cursor_draw_line(s, d, y);
             }
         } else {
             if (y_start >= 0) {
                 /* flush to display */
-                dpy_gfx_update(s->con, 0, y_start,
-                               disp_width, y - y_start);
+                dpy_gfx_update(s->con, run_x0, y_start,
+                               run_x1 - run_x0, y - y_start);
                 y_start = -1;
             }
         }
@@ -1726,8 +1782,8 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
     }
     if (y_start >= 0) {
         /* flush to display */
-        dpy_gfx_update(s->con, 0, y_start,
-                       disp_width, y - y_start);
+        dpy_gfx_update(s->con, run_x0, y_start,
+                       run_x1 - run_x0, y - y_start);
     }
     g_free(snap);
     memset(s->invalidated_y_table, 0, sizeof(s->invalidated_y_table));
@@ -2297,6 +2353,14 @@ void vga_init(VGACommonState *s, Object *obj, MemoryRegion *address_space,
         portio_list_init(&s->vga_port_list, obj, vga_ports, s, "vga");
         portio_list_set_flush_coalesced(&s->vga_port_list);
         portio_list_add(&s->vga_port_list, address_space_io, 0x3b0);
+        /*
+         * Writes to the index registers only latch the index of the next
+         * data register access, which flushes them, so they need not exit.
+         */
+        portio_list_add_coalescing(&s->vga_port_list, 0x3b4, 1);
+        portio_list_add_coalescing(&s->vga_port_list, 0x3c4, 1);
+        portio_list_add_coalescing(&s->vga_port_list, 0x3ce, 1);
+        portio_list_add_coalescing(&s->vga_port_list, 0x3d4, 1);
     }
     if (vbe_ports) {
         portio_list_init(&s->vbe_port_list, obj, vbe_ports, s, "vbe");
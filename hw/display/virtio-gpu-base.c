@@ -163,10 +163,16 @@ virtio_gpu_base_device_realize(DeviceState *qdev,
 
     if (virtio_gpu_virgl_enabled(g->conf)) {
         error_setg(&g->migration_blocker, "virgl is not yet migratable");
-        if (migrate_add_blocker(g->migration_blocker, errp) < 0) {
-            error_free(g->migration_blocker);
-            return false;
-        }
+    } else if (virtio_gpu_blob_enabled(g->conf)) {
+        /* virtio_gpu_save() only knows about pixman-backed resources */
+        error_setg(&g->migration_blocker,
+                   "blob resources are not yet migratable");
+    }
+    if (g->migration_blocker &&
+        migrate_add_blocker(g->migration_blocker, errp) < 0) {
+        error_free(g->migration_blocker);
+        g->migration_blocker = NULL;
+        return false;
     }
 
     g->virtio_config.num_scanouts = cpu_to_le32(g->conf.max_outputs);
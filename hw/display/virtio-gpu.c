@@ -1311,6 +1311,20 @@ void virtio_gpu_device_realize(DeviceState *qdev, Error **errp)
     VirtIODevice *vdev = VIRTIO_DEVICE(qdev);
     VirtIOGPU *g = VIRTIO_GPU(qdev);
 
+    /*
+     * Blob resources let the guest scan out straight from its own memory
+     * (through udmabuf), instead of copying every update into a host
+     * resource.  With blob-auto=on, offer them whenever the host can back
+     * them.  This makes the guest ABI depend on the host, so it is off
+     * by default.
+     */
+    if (!virtio_gpu_blob_enabled(g->parent_obj.conf) &&
+        virtio_gpu_blob_auto(g->parent_obj.conf) &&
+        !virtio_gpu_virgl_enabled(g->parent_obj.conf) &&
+        virtio_gpu_have_udmabuf()) {
+        g->parent_obj.conf.flags |= (1 << VIRTIO_GPU_FLAG_BLOB_ENABLED);
+    }
+
     if (virtio_gpu_blob_enabled(g->parent_obj.conf)) {
         if (!virtio_gpu_have_udmabuf()) {
             error_setg(errp, "cannot enable blob resources without udmabuf");
@@ -1418,6 +1432,8 @@ static Property virtio_gpu_properties[] = {
                      256 * MiB),
     DEFINE_PROP_BIT("blob", VirtIOGPU, parent_obj.conf.flags,
                     VIRTIO_GPU_FLAG_BLOB_ENABLED, false),
+    DEFINE_PROP_BIT("blob-auto", VirtIOGPU, parent_obj.conf.flags,
+                    VIRTIO_GPU_FLAG_BLOB_AUTO, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
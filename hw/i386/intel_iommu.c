@@ -256,11 +256,21 @@ static void vtd_reset_context_cache_locked(IntelIOMMUState *s)
     s->context_cache_gen = 1;
 }
 
+/*
+ * Invalidate the copies of IOTLB entries kept by the address spaces.
+ * Must be called with IOMMU lock held.
+ */
+static void vtd_iotlb_gen_bump_locked(IntelIOMMUState *s)
+{
+    s->iotlb_gen++;
+}
+
 /* Must be called with IOMMU lock held. */
 static void vtd_reset_iotlb_locked(IntelIOMMUState *s)
 {
     assert(s->iotlb);
     g_hash_table_remove_all(s->iotlb);
+    vtd_iotlb_gen_bump_locked(s);
 }
 
 static void vtd_reset_iotlb(IntelIOMMUState *s)
@@ -311,10 +321,40 @@ out:
     return entry;
 }
 
+/*
+ * Devices tend to DMA to the same page many times in a row, e.g. to the
+ * rings of a virtqueue, so check the entry of their last translation
+ * before hashing the address at every page table level.
+ *
+ * Must be called with IOMMU lock held
+ */
+static VTDIOTLBEntry *vtd_lookup_iotlb_last(VTDAddressSpace *vtd_as,
+                                            uint16_t source_id, hwaddr addr)
+{
+    VTDIOTLBEntry *entry = &vtd_as->iotlb_last;
+
+    if (vtd_as->iotlb_last_gen != vtd_as->iommu_state->iotlb_gen ||
+        vtd_as->iotlb_last_sid != source_id ||
+        ((addr & entry->mask) >> VTD_PAGE_SHIFT_4K) != entry->gfn) {
+        return NULL;
+    }
+    return entry;
+}
+
+/* Must be called with IOMMU lock held */
+static void vtd_remember_iotlb_last(VTDAddressSpace *vtd_as,
+                                    uint16_t source_id, VTDIOTLBEntry *entry)
+{
+    vtd_as->iotlb_last = *entry;
+    vtd_as->iotlb_last_sid = source_id;
+    vtd_as->iotlb_last_gen = vtd_as->iommu_state->iotlb_gen;
+}
+
 /* Must be with IOMMU lock held */
-static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
-                             uint16_t domain_id, hwaddr addr, uint64_t slpte,
-                             uint8_t access_flags, uint32_t level)
+static VTDIOTLBEntry *vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
+                                       uint16_t domain_id, hwaddr addr,
+                                       uint64_t slpte, uint8_t access_flags,
+                                       uint32_t level)
 {
     VTDIOTLBEntry *entry = g_malloc(sizeof(*entry));
     uint64_t *key = g_malloc(sizeof(*key));
@@ -333,6 +373,7 @@ static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
     entry->mask = vtd_slpt_level_page_mask(level);
     *key = vtd_get_iotlb_key(gfn, source_id, level);
     g_hash_table_replace(s->iotlb, key, entry);
+    return entry;
 }
 
 /* Given the reg addr of both the message data and address, generate an
@@ -1709,7 +1750,13 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
     cc_entry = &vtd_as->context_cache_entry;
 
     /* Try to fetch slpte form IOTLB */
-    iotlb_entry = vtd_lookup_iotlb(s, source_id, addr);
+    iotlb_entry = vtd_lookup_iotlb_last(vtd_as, source_id, addr);
+    if (!iotlb_entry) {
+        iotlb_entry = vtd_lookup_iotlb(s, source_id, addr);
+        if (iotlb_entry) {
+            vtd_remember_iotlb_last(vtd_as, source_id, iotlb_entry);
+        }
+    }
     if (iotlb_entry) {
         trace_vtd_iotlb_page_hit(source_id, addr, iotlb_entry->slpte,
                                  iotlb_entry->domain_id);
@@ -1776,8 +1823,9 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
 
     page_mask = vtd_slpt_level_page_mask(level);
     access_flags = IOMMU_ACCESS_FLAG(reads, writes);
-    vtd_update_iotlb(s, source_id, vtd_get_domain_id(s, &ce), addr, slpte,
-                     access_flags, level);
+    iotlb_entry = vtd_update_iotlb(s, source_id, vtd_get_domain_id(s, &ce),
+                                   addr, slpte, access_flags, level);
+    vtd_remember_iotlb_last(vtd_as, source_id, iotlb_entry);
 out:
     vtd_iommu_unlock(s);
     entry->iova = addr & page_mask;
@@ -1966,6 +2014,7 @@ static void vtd_iotlb_domain_invalidate(IntelIOMMUState *s, uint16_t domain_id)
     vtd_iommu_lock(s);
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_domain,
                                 &domain_id);
+    vtd_iotlb_gen_bump_locked(s);
     vtd_iommu_unlock(s);
 
     QLIST_FOREACH(vtd_as, &s->vtd_as_with_notifiers, next) {
@@ -2032,6 +2081,7 @@ static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
     info.mask = ~((1 << am) - 1);
     vtd_iommu_lock(s);
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_page, &info);
+    vtd_iotlb_gen_bump_locked(s);
     vtd_iommu_unlock(s);
     vtd_iotlb_page_invalidate_notify(s, domain_id, addr, am);
 }
@@ -3838,6 +3888,8 @@ static void vtd_realize(DeviceState *dev, Error **errp)
     /* No corresponding destroy */
     s->iotlb = g_hash_table_new_full(vtd_uint64_hash, vtd_uint64_equal,
                                      g_free, g_free);
+    /* A zeroed VTDAddressSpace must not match */
+    s->iotlb_gen = 1;
     s->vtd_as_by_busptr = g_hash_table_new_full(vtd_uint64_hash, vtd_uint64_equal,
                                               g_free, g_free);
     vtd_init(s);
@@ -42,6 +42,7 @@
 static void check_cmd(AHCIState *s, int port);
 static int handle_cmd(AHCIState *s, int port, uint8_t slot);
 static void ahci_reset_port(AHCIState *s, int port);
+static void ahci_cancel_fis_sdb(AHCIDevice *ad);
 static bool ahci_write_fis_d2h(AHCIDevice *ad);
 static void ahci_init_d2h(AHCIDevice *ad);
 static int ahci_dma_prepare_buf(const IDEDMA *dma, int32_t limit);
@@ -588,12 +589,21 @@ static void check_cmd(AHCIState *s, int port)
     uint8_t slot;
 
     if ((pr->cmd & PORT_CMD_START) && pr->cmd_issue) {
+        BlockBackend *blk = s->dev[port].port.ifs[0].blk;
+
+        /* Submit all the NCQ commands of one CI write as a batch */
+        if (blk) {
+            blk_io_plug(blk);
+        }
         for (slot = 0; (slot < 32) && pr->cmd_issue; slot++) {
             if ((pr->cmd_issue & (1U << slot)) &&
                 !handle_cmd(s, port, slot)) {
                 pr->cmd_issue &= ~(1U << slot);
             }
         }
+        if (blk) {
+            blk_io_unplug(blk);
+        }
     }
 }
 
@@ -658,6 +668,8 @@ static void ahci_reset_port(AHCIState *s, int port)
     pr->sig = 0xFFFFFFFF;
     d->busy_slot = -1;
     d->init_d2h_sent = false;
+    d->finished = 0;
+    ahci_cancel_fis_sdb(d);
 
     ide_state = &s->dev[port].port.ifs[0];
     if (!ide_state->blk) {
@@ -769,9 +781,8 @@ static void ahci_unmap_clb_address(AHCIDevice *ad)
     ad->lst = NULL;
 }
 
-static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
+static void ahci_write_fis_sdb(AHCIState *s, AHCIDevice *ad)
 {
-    AHCIDevice *ad = ncq_tfs->drive;
     AHCIPortRegs *pr = &ad->port_regs;
     IDEState *ide_state;
     SDBFIS *sdb_fis;
@@ -805,6 +816,37 @@ static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
     }
 }
 
+static void ahci_write_fis_sdb_bh(void *opaque)
+{
+    AHCIDevice *ad = opaque;
+
+    qemu_bh_delete(ad->sdb_bh);
+    ad->sdb_bh = NULL;
+
+    ahci_write_fis_sdb(ad->hba, ad);
+}
+
+/*
+ * The SActive field of the Set Device Bits FIS can report several finished
+ * NCQ commands at once, so commands that complete in the same main loop
+ * iteration share one FIS and one interrupt.
+ */
+static void ahci_schedule_fis_sdb(AHCIDevice *ad)
+{
+    if (!ad->sdb_bh) {
+        ad->sdb_bh = qemu_bh_new(ahci_write_fis_sdb_bh, ad);
+        qemu_bh_schedule(ad->sdb_bh);
+    }
+}
+
+static void ahci_cancel_fis_sdb(AHCIDevice *ad)
+{
+    if (ad->sdb_bh) {
+        qemu_bh_delete(ad->sdb_bh);
+        ad->sdb_bh = NULL;
+    }
+}
+
 static void ahci_write_fis_pio(AHCIDevice *ad, uint16_t len, bool pio_fis_i)
 {
     AHCIPortRegs *pr = &ad->port_regs;
@@ -920,6 +962,7 @@ static int ahci_populate_sglist(AHCIDevice *ad, QEMUSGList *sglist,
     uint64_t prdt_addr = cfis_addr + 0x80;
     dma_addr_t prdt_len = (prdtl * sizeof(AHCI_SG));
     dma_addr_t real_prdt_len = prdt_len;
+    bool mapped = false;
     uint8_t *prdt;
     int i;
     int r = 0;
@@ -937,11 +980,15 @@ static int ahci_populate_sglist(AHCIDevice *ad, QEMUSGList *sglist,
         return -1;
     }
 
-    /* map PRDT */
-    if (!(prdt = dma_memory_map(ad->hba->as, prdt_addr, &prdt_len,
-                                DMA_DIRECTION_TO_DEVICE))){
+    /* reuse the mapping of handle_cmd, or map PRDT */
+    if (ad->cur_prdt && cmd == ad->cur_cmd && prdtl == ad->cur_prdtl) {
+        prdt = (uint8_t *)ad->cur_prdt;
+    } else if (!(prdt = dma_memory_map(ad->hba->as, prdt_addr, &prdt_len,
+                                       DMA_DIRECTION_TO_DEVICE))) {
         trace_ahci_populate_sglist_no_map(ad->hba, ad->port_no);
         return -1;
+    } else {
+        mapped = true;
     }
 
     if (prdt_len < real_prdt_len) {
@@ -984,8 +1031,10 @@ static int ahci_populate_sglist(AHCIDevice *ad, QEMUSGList *sglist,
     }
 
 out:
-    dma_memory_unmap(ad->hba->as, prdt, prdt_len,
-                     DMA_DIRECTION_TO_DEVICE, prdt_len);
+    if (mapped) {
+        dma_memory_unmap(ad->hba->as, prdt, prdt_len,
+                         DMA_DIRECTION_TO_DEVICE, prdt_len);
+    }
     return r;
 }
 
@@ -1007,10 +1056,13 @@ static void ncq_finish(NCQTransferState *ncq_tfs)
      * clear the outstanding bit in scr_act (PxSACT). */
     if (!(ncq_tfs->drive->port_regs.scr_err & (1 << ncq_tfs->tag))) {
         ncq_tfs->drive->finished |= (1 << ncq_tfs->tag);
+        ahci_schedule_fis_sdb(ncq_tfs->drive);
+    } else {
+        /* Report errors right away, together with what finished before */
+        ahci_cancel_fis_sdb(ncq_tfs->drive);
+        ahci_write_fis_sdb(ncq_tfs->drive->hba, ncq_tfs->drive);
     }
 
-    ahci_write_fis_sdb(ncq_tfs->drive->hba, ncq_tfs);
-
     trace_ncq_finish(ncq_tfs->drive->hba, ncq_tfs->drive->port_no,
                      ncq_tfs->tag);
 
@@ -1275,7 +1327,8 @@ static int handle_cmd(AHCIState *s, int port, uint8_t slot)
     uint64_t tbl_addr;
     AHCICmdHdr *cmd;
     uint8_t *cmd_fis;
-    dma_addr_t cmd_len;
+    dma_addr_t cmd_len, tbl_len;
+    uint16_t prdtl;
 
     if (s->dev[port].port.ifs[0].status & (BUSY_STAT|DRQ_STAT)) {
         /* Engine currently busy, try again later */
@@ -1298,18 +1351,28 @@ static int handle_cmd(AHCIState *s, int port, uint8_t slot)
         return -1;
     }
 
+    /*
+     * Map the command FIS together with the PRDT that follows it, so that
+     * building the scatter-gather list does not need a mapping of its own.
+     */
     tbl_addr = le64_to_cpu(cmd->tbl_addr);
-    cmd_len = 0x80;
+    prdtl = le16_to_cpu(cmd->prdtl);
+    tbl_len = 0x80 + prdtl * sizeof(AHCI_SG);
+    cmd_len = tbl_len;
     cmd_fis = dma_memory_map(s->as, tbl_addr, &cmd_len,
                              DMA_DIRECTION_TO_DEVICE);
     if (!cmd_fis) {
         trace_handle_cmd_badfis(s, port);
         return -1;
-    } else if (cmd_len != 0x80) {
+    } else if (cmd_len < 0x80) {
         ahci_trigger_irq(s, &s->dev[port], AHCI_PORT_IRQ_BIT_HBFS);
         trace_handle_cmd_badmap(s, port, cmd_len);
         goto out;
     }
+    if (prdtl && cmd_len == tbl_len) {
+        s->dev[port].cur_prdt = (AHCI_SG *)(cmd_fis + 0x80);
+        s->dev[port].cur_prdtl = prdtl;
+    }
     if (trace_event_get_state_backends(TRACE_HANDLE_CMD_FIS_DUMP)) {
         char *pretty_fis = ahci_pretty_buffer_fis(cmd_fis, 0x80);
         trace_handle_cmd_fis_dump(s, port, pretty_fis);
@@ -1326,6 +1389,7 @@ static int handle_cmd(AHCIState *s, int port, uint8_t slot)
     }
 
 out:
+    s->dev[port].cur_prdt = NULL;
     dma_memory_unmap(s->as, cmd_fis, cmd_len, DMA_DIRECTION_TO_DEVICE,
                      cmd_len);
 
@@ -1567,6 +1631,7 @@ void ahci_uninit(AHCIState *s)
     for (i = 0; i < s->ports; i++) {
         AHCIDevice *ad = &s->dev[i];
 
+        ahci_cancel_fis_sdb(ad);
         for (j = 0; j < 2; j++) {
             IDEState *s = &ad->port.ifs[j];
 
@@ -1682,6 +1747,11 @@ static int ahci_state_post_load(void *opaque, int version_id)
             return -1;
         }
 
+        /* Completions that the source had not reported yet */
+        if (ad->finished) {
+            ahci_schedule_fis_sdb(ad);
+        }
+
         for (j = 0; j < AHCI_MAX_CMDS; j++) {
             ncq_tfs = &ad->ncq_tfs[j];
             ncq_tfs->drive = ad;
@@ -314,12 +314,16 @@ struct AHCIDevice {
     AHCIPortRegs port_regs;
     struct AHCIState *hba;
     QEMUBH *check_bh;
+    QEMUBH *sdb_bh;             /* coalesces Set Device Bits FISes */
     uint8_t *lst;
     uint8_t *res_fis;
     bool done_first_drq;
     int32_t busy_slot;
     bool init_d2h_sent;
     AHCICmdHdr *cur_cmd;
+    /* PRDT of cur_cmd, mapped together with its command FIS by handle_cmd */
+    AHCI_SG *cur_prdt;
+    uint16_t cur_prdtl;
     NCQTransferState ncq_tfs[AHCI_MAX_CMDS];
 };
 
@@ -7,7 +7,9 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/iov.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "trace.h"
 
 #include "hw/virtio/virtio.h"
@@ -20,53 +22,157 @@
 
 /* ----------------------------------------------------------------- */
 
-void virtio_input_send(VirtIOInput *vinput, virtio_input_event *event)
+static bool virtio_input_is_syn_report(virtio_input_event *event)
 {
+    return event->type == cpu_to_le16(EV_SYN) &&
+           event->code == cpu_to_le16(SYN_REPORT);
+}
+
+/*
+ * Merge consecutive reports that carry nothing but relative motion (or
+ * nothing but absolute positions) into one, like hid_pointer_sync() does
+ * for USB HID.  Reports with buttons or keys are never merged, so no press
+ * or release is lost or reordered.  Works on the @count events up to the
+ * last sync and returns how many are left.
+ */
+static uint32_t virtio_input_coalesce(VirtIOInput *vinput, uint32_t count)
+{
+    uint32_t in = 0, out = 0, end, i, j, last_start = 0;
+    uint16_t type, last_type = 0;
+    virtio_input_event ev, *tgt;
+    bool motion;
+
+    while (in < count) {
+        type = vinput->queue[in].event.type;
+        motion = type == cpu_to_le16(EV_REL) || type == cpu_to_le16(EV_ABS);
+        for (end = in; !virtio_input_is_syn_report(&vinput->queue[end].event);
+             end++) {
+            if (vinput->queue[end].event.type != type) {
+                motion = false;
+            }
+        }
+
+        if (motion && last_type == type) {
+            /* fold into the previous report, before its sync event */
+            for (i = in; i < end; i++) {
+                /* copy it, moving the sync event may overwrite queue[i] */
+                ev = vinput->queue[i].event;
+                for (j = last_start; j < out - 1; j++) {
+                    tgt = &vinput->queue[j].event;
+                    if (tgt->code == ev.code) {
+                        break;
+                    }
+                }
+                if (j == out - 1) {
+                    vinput->queue[out].event = vinput->queue[out - 1].event;
+                    vinput->queue[j].event = ev;
+                    out++;
+                } else if (type == cpu_to_le16(EV_REL)) {
+                    tgt->value = cpu_to_le32(le32_to_cpu(tgt->value) +
+                                             le32_to_cpu(ev.value));
+                } else {
+                    tgt->value = ev.value;
+                }
+            }
+        } else {
+            last_start = out;
+            last_type = motion ? type : 0;
+            for (i = in; i <= end; i++) {
+                vinput->queue[out++].event = vinput->queue[i].event;
+            }
+        }
+        in = end + 1;
+    }
+    return out;
+}
+
+static void virtio_input_flush(void *opaque)
+{
+    VirtIOInput *vinput = opaque;
     VirtQueueElement *elem;
+    uint32_t count, rest;
     int i, len;
 
-    if (!vinput->active) {
+    if (!vinput->qsync) {
         return;
     }
 
-    /* queue up events ... */
-    if (vinput->qindex == vinput->qsize) {
-        vinput->qsize++;
-        vinput->queue = g_realloc(vinput->queue, vinput->qsize *
-                                  sizeof(vinput->queue[0]));
-    }
-    vinput->queue[vinput->qindex++].event = *event;
-
-    /* ... until we see a report sync ... */
-    if (event->type != cpu_to_le16(EV_SYN) ||
-        event->code != cpu_to_le16(SYN_REPORT)) {
-        return;
+    count = virtio_input_coalesce(vinput, vinput->qsync);
+    rest = vinput->qindex - vinput->qsync;
+    if (count != vinput->qsync) {
+        memmove(&vinput->queue[count], &vinput->queue[vinput->qsync],
+                rest * sizeof(vinput->queue[0]));
     }
+    vinput->qindex = count + rest;
+    vinput->qsync = 0;
 
     /* ... then check available space ... */
-    for (i = 0; i < vinput->qindex; i++) {
+    for (i = 0; i < count; i++) {
         elem = virtqueue_pop(vinput->evt, sizeof(VirtQueueElement));
         if (!elem) {
             while (--i >= 0) {
                 virtqueue_unpop(vinput->evt, vinput->queue[i].elem, 0);
             }
-            vinput->qindex = 0;
-            trace_virtio_input_queue_full();
-            return;
+            goto out;
         }
         vinput->queue[i].elem = elem;
     }
 
     /* ... and finally pass them to the guest */
-    for (i = 0; i < vinput->qindex; i++) {
+    for (i = 0; i < count; i++) {
         elem = vinput->queue[i].elem;
         len = iov_from_buf(elem->in_sg, elem->in_num,
-                           0, &vinput->queue[i].event, sizeof(virtio_input_event));
+                           0, &vinput->queue[i].event,
+                           sizeof(virtio_input_event));
         virtqueue_push(vinput->evt, elem, len);
         g_free(elem);
     }
     virtio_notify(VIRTIO_DEVICE(vinput), vinput->evt);
-    vinput->qindex = 0;
+
+out:
+    if (i < count) {
+        trace_virtio_input_queue_full();
+    }
+    /* keep the events of the report that is still being built */
+    memmove(&vinput->queue[0], &vinput->queue[count],
+            rest * sizeof(vinput->queue[0]));
+    vinput->qindex = rest;
+    if (vinput->coalesce_ms) {
+        timer_mod(vinput->flush_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL) + vinput->coalesce_ms);
+    }
+}
+
+void virtio_input_send(VirtIOInput *vinput, virtio_input_event *event)
+{
+    if (!vinput->active) {
+        return;
+    }
+
+    /* queue up events ... */
+    if (vinput->qindex == vinput->qsize) {
+        vinput->qsize++;
+        vinput->queue = g_realloc(vinput->queue, vinput->qsize *
+                                  sizeof(vinput->queue[0]));
+    }
+    vinput->queue[vinput->qindex++].event = *event;
+
+    /* ... until we see a report sync ... */
+    if (!virtio_input_is_syn_report(event)) {
+        return;
+    }
+    vinput->qsync = vinput->qindex;
+
+    /*
+     * ... and hand all the reports that arrived meanwhile to the guest
+     * together, at the end of this main loop iteration or at most once per
+     * coalesce-ms, with a single notification.
+     */
+    if (!vinput->coalesce_ms) {
+        qemu_bh_schedule(vinput->flush_bh);
+    } else if (!timer_pending(vinput->flush_timer)) {
+        virtio_input_flush(vinput);
+    }
 }
 
 static void virtio_input_handle_evt(VirtIODevice *vdev, VirtQueue *vq)
@@ -215,6 +321,10 @@ static void virtio_input_reset(VirtIODevice *vdev)
             vic->change_active(vinput);
         }
     }
+    qemu_bh_cancel(vinput->flush_bh);
+    timer_del(vinput->flush_timer);
+    vinput->qindex = 0;
+    vinput->qsync = 0;
 }
 
 static int virtio_input_post_load(void *opaque, int version_id)
@@ -261,6 +371,9 @@ static void virtio_input_device_realize(DeviceState *dev, Error **errp)
                 vinput->cfg_size);
     vinput->evt = virtio_add_queue(vdev, 64, virtio_input_handle_evt);
     vinput->sts = virtio_add_queue(vdev, 64, virtio_input_handle_sts);
+    vinput->flush_bh = qemu_bh_new(virtio_input_flush, vinput);
+    vinput->flush_timer = timer_new_ms(QEMU_CLOCK_VIRTUAL,
+                                       virtio_input_flush, vinput);
 }
 
 static void virtio_input_finalize(Object *obj)
@@ -285,6 +398,8 @@ static void virtio_input_device_unrealize(DeviceState *dev)
     if (vic->unrealize) {
         vic->unrealize(dev);
     }
+    qemu_bh_delete(vinput->flush_bh);
+    timer_free(vinput->flush_timer);
     virtio_delete_queue(vinput->evt);
     virtio_delete_queue(vinput->sts);
     virtio_cleanup(vdev);
@@ -303,6 +418,7 @@ static const VMStateDescription vmstate_virtio_input = {
 
 static Property virtio_input_properties[] = {
     DEFINE_PROP_STRING("serial", VirtIOInput, serial),
+    DEFINE_PROP_UINT32("coalesce-ms", VirtIOInput, coalesce_ms, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
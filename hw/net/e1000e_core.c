@@ -53,6 +53,9 @@
                                      second according to spec 10.2.4.2 */
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of TX descriptors fetched from guest memory with one DMA read */
+#define E1000E_TX_DESC_BATCH (32)
+
 static inline void
 e1000e_set_interrupt_cause(E1000ECore *core, uint32_t val);
 
@@ -848,6 +851,26 @@ e1000e_ring_free_descr_num(E1000ECore *core, const E1000E_RingInfo *r)
     return 0;
 }
 
+/*
+ * Number of descriptors that can be fetched starting at the head without
+ * wrapping around the end of the ring.
+ */
+static inline uint32_t
+e1000e_ring_contig_descr_num(E1000ECore *core, const E1000E_RingInfo *r)
+{
+    uint32_t ring_size = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+
+    if (core->mac[r->dh] < core->mac[r->dt]) {
+        return core->mac[r->dt] - core->mac[r->dh];
+    }
+
+    if (core->mac[r->dh] < ring_size) {
+        return ring_size - core->mac[r->dh];
+    }
+
+    return 1;
+}
+
 static inline bool
 e1000e_ring_enabled(E1000ECore *core, const E1000E_RingInfo *r)
 {
@@ -906,7 +929,9 @@ static void
 e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 {
     dma_addr_t base;
-    struct e1000_tx_desc desc;
+    struct e1000_tx_desc descs[E1000E_TX_DESC_BATCH];
+    struct e1000_tx_desc *desc;
+    uint32_t i, n;
     bool ide = false;
     const E1000E_RingInfo *txi = txr->i;
     uint32_t cause = E1000_ICS_TXQE;
@@ -917,17 +942,27 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
     }
 
     while (!e1000e_ring_empty(core, txi)) {
-        base = e1000e_ring_head_descr(core, txi);
+        /*
+         * Like the hardware, prefetch the descriptors the guest made
+         * available instead of reading them from guest memory one by one.
+         */
+        n = MIN(e1000e_ring_contig_descr_num(core, txi), E1000E_TX_DESC_BATCH);
+        pci_dma_read(core->owner, e1000e_ring_head_descr(core, txi),
+                     descs, n * sizeof(descs[0]));
 
-        pci_dma_read(core->owner, base, &desc, sizeof(desc));
+        for (i = 0; i < n; i++) {
+            desc = &descs[i];
+            base = e1000e_ring_head_descr(core, txi);
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.buffer_addr,
-                              desc.lower.data, desc.upper.data);
+            trace_e1000e_tx_descr((void *)(intptr_t)desc->buffer_addr,
+                                  desc->lower.data, desc->upper.data);
 
-        e1000e_process_tx_desc(core, txr->tx, &desc, txi->idx);
-        cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
+            e1000e_process_tx_desc(core, txr->tx, desc, txi->idx);
+            cause |= e1000e_txdesc_writeback(core, base, desc, &ide,
+                                             txi->idx);
 
-        e1000e_ring_advance(core, txi, 1);
+            e1000e_ring_advance(core, txi, 1);
+        }
     }
 
     if (!ide || !e1000e_intrmgr_delay_tx_causes(core, &cause)) {
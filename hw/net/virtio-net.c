@@ -640,6 +640,23 @@ static int virtio_net_max_tx_queue_size(VirtIONet *n)
     return VIRTQUEUE_MAX_SIZE;
 }
 
+/*
+ * Changing the number of queue pairs walks every queue, but only the
+ * queues whose state actually changes need to hear about it: sending
+ * VHOST_USER_SET_VRING_ENABLE for a ring that is already enabled makes
+ * some backends quiesce and restart it, which stalls traffic on queues
+ * the guest never touched.  The cached state is replayed by
+ * vhost_net_start() when the backend reconnects, so it must still be
+ * updated even if the backend is currently gone.
+ */
+static void peer_set_vring_enable(NetClientState *peer, int enable)
+{
+    if (peer->vring_enable == enable) {
+        return;
+    }
+    vhost_set_vring_enable(peer, enable);
+}
+
 static int peer_attach(VirtIONet *n, int index)
 {
     NetClientState *nc = qemu_get_subqueue(n->nic, index);
@@ -649,7 +666,7 @@ static int peer_attach(VirtIONet *n, int index)
     }
 
     if (nc->peer->info->type == NET_CLIENT_DRIVER_VHOST_USER) {
-        vhost_set_vring_enable(nc->peer, 1);
+        peer_set_vring_enable(nc->peer, 1);
     }
 
     if (nc->peer->info->type != NET_CLIENT_DRIVER_TAP) {
@@ -672,7 +689,7 @@ static int peer_detach(VirtIONet *n, int index)
     }
 
     if (nc->peer->info->type == NET_CLIENT_DRIVER_VHOST_USER) {
-        vhost_set_vring_enable(nc->peer, 0);
+        peer_set_vring_enable(nc->peer, 0);
     }
 
     if (nc->peer->info->type !=  NET_CLIENT_DRIVER_TAP) {
@@ -9,12 +9,22 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/crc-t10dif.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
+#include "block/thread-pool.h"
 
 #include "nvme.h"
 #include "trace.h"
 
+/*
+ * Protection information for transfers of at least this size is generated
+ * or checked in the thread pool, so that the main loop keeps processing
+ * other queues meanwhile.
+ */
+#define NVME_DIF_OFFLOAD_LEN (128 * KiB)
+
 uint16_t nvme_check_prinfo(NvmeNamespace *ns, uint8_t prinfo, uint64_t slba,
                            uint32_t reftag)
 {
@@ -26,19 +36,6 @@ uint16_t nvme_check_prinfo(NvmeNamespace *ns, uint8_t prinfo, uint64_t slba,
     return NVME_SUCCESS;
 }
 
-/* from Linux kernel (crypto/crct10dif_common.c) */
-static uint16_t crc_t10dif(uint16_t crc, const unsigned char *buffer,
-                           size_t len)
-{
-    unsigned int i;
-
-    for (i = 0; i < len; i++) {
-        crc = (crc << 8) ^ t10_dif_crc_table[((crc >> 8) ^ buffer[i]) & 0xff];
-    }
-
-    return crc;
-}
-
 void nvme_dif_pract_generate_dif(NvmeNamespace *ns, uint8_t *buf, size_t len,
                                  uint8_t *mbuf, size_t mlen, uint16_t apptag,
                                  uint32_t *reftag)
@@ -240,39 +237,70 @@ static void nvme_dif_rw_cb(void *opaque, int ret)
     nvme_rw_complete_cb(req, ret);
 }
 
-static void nvme_dif_rw_check_cb(void *opaque, int ret)
+/*
+ * Check the protection information of a read, or generate or check that of
+ * a write. Only touches the bounce buffers, so may run in a worker thread.
+ */
+static uint16_t nvme_dif_rw_pi(NvmeBounceContext *ctx)
 {
-    NvmeBounceContext *ctx = opaque;
     NvmeRequest *req = ctx->req;
     NvmeNamespace *ns = req->ns;
-    NvmeCtrl *n = nvme_ctrl(req);
     NvmeRwCmd *rw = (NvmeRwCmd *)&req->cmd;
     uint64_t slba = le64_to_cpu(rw->slba);
     uint8_t prinfo = NVME_RW_PRINFO(le16_to_cpu(rw->control));
     uint16_t apptag = le16_to_cpu(rw->apptag);
     uint16_t appmask = le16_to_cpu(rw->appmask);
     uint32_t reftag = le32_to_cpu(rw->reftag);
-    uint16_t status;
 
-    trace_pci_nvme_dif_rw_check_cb(nvme_cid(req), prinfo, apptag, appmask,
-                                   reftag);
-
-    if (ret) {
-        goto out;
+    if (rw->opcode != NVME_CMD_READ && (prinfo & NVME_PRINFO_PRACT)) {
+        /* splice generated protection information into the buffer */
+        nvme_dif_pract_generate_dif(ns, ctx->data.bounce, ctx->data.iov.size,
+                                    ctx->mdata.bounce, ctx->mdata.iov.size,
+                                    apptag, &reftag);
+        return NVME_SUCCESS;
     }
 
-    status = nvme_dif_mangle_mdata(ns, ctx->mdata.bounce, ctx->mdata.iov.size,
-                                   slba);
-    if (status) {
-        req->status = status;
+    return nvme_dif_check(ns, ctx->data.bounce, ctx->data.iov.size,
+                          ctx->mdata.bounce, ctx->mdata.iov.size, prinfo,
+                          slba, apptag, appmask, &reftag);
+}
+
+static int nvme_dif_rw_pi_worker(void *opaque)
+{
+    NvmeBounceContext *ctx = opaque;
+
+    ctx->status = nvme_dif_rw_pi(ctx);
+
+    return 0;
+}
+
+static BlockAIOCB *nvme_dif_rw_pi_offload(NvmeBounceContext *ctx,
+                                          BlockCompletionFunc *cb)
+{
+    BlockBackend *blk = ctx->req->ns->blkconf.blk;
+    ThreadPool *pool = aio_get_thread_pool(blk_get_aio_context(blk));
+
+    trace_pci_nvme_dif_rw_pi_offload(nvme_cid(ctx->req), ctx->data.iov.size);
+
+    return thread_pool_submit_aio(pool, nvme_dif_rw_pi_worker, ctx, cb, ctx);
+}
+
+static void nvme_dif_rw_read_done_cb(void *opaque, int ret)
+{
+    NvmeBounceContext *ctx = opaque;
+    NvmeRequest *req = ctx->req;
+    NvmeNamespace *ns = req->ns;
+    NvmeCtrl *n = nvme_ctrl(req);
+    NvmeRwCmd *rw = (NvmeRwCmd *)&req->cmd;
+    uint8_t prinfo = NVME_RW_PRINFO(le16_to_cpu(rw->control));
+    uint16_t status;
+
+    if (ret) {
         goto out;
     }
 
-    status = nvme_dif_check(ns, ctx->data.bounce, ctx->data.iov.size,
-                            ctx->mdata.bounce, ctx->mdata.iov.size, prinfo,
-                            slba, apptag, appmask, &reftag);
-    if (status) {
-        req->status = status;
+    if (ctx->status) {
+        req->status = ctx->status;
         goto out;
     }
 
@@ -297,6 +325,42 @@ out:
     nvme_dif_rw_cb(ctx, ret);
 }
 
+static void nvme_dif_rw_check_cb(void *opaque, int ret)
+{
+    NvmeBounceContext *ctx = opaque;
+    NvmeRequest *req = ctx->req;
+    NvmeNamespace *ns = req->ns;
+    NvmeRwCmd *rw = (NvmeRwCmd *)&req->cmd;
+    uint64_t slba = le64_to_cpu(rw->slba);
+    uint8_t prinfo = NVME_RW_PRINFO(le16_to_cpu(rw->control));
+    uint16_t apptag = le16_to_cpu(rw->apptag);
+    uint16_t appmask = le16_to_cpu(rw->appmask);
+    uint32_t reftag = le32_to_cpu(rw->reftag);
+
+    trace_pci_nvme_dif_rw_check_cb(nvme_cid(req), prinfo, apptag, appmask,
+                                   reftag);
+
+    if (ret) {
+        goto out;
+    }
+
+    ctx->status = nvme_dif_mangle_mdata(ns, ctx->mdata.bounce,
+                                        ctx->mdata.iov.size, slba);
+    if (ctx->status) {
+        goto out;
+    }
+
+    if (ctx->data.iov.size >= NVME_DIF_OFFLOAD_LEN) {
+        req->aiocb = nvme_dif_rw_pi_offload(ctx, nvme_dif_rw_read_done_cb);
+        return;
+    }
+
+    ctx->status = nvme_dif_rw_pi(ctx);
+
+out:
+    nvme_dif_rw_read_done_cb(ctx, ret);
+}
+
 static void nvme_dif_rw_mdata_in_cb(void *opaque, int ret)
 {
     NvmeBounceContext *ctx = opaque;
@@ -352,6 +416,31 @@ out:
     nvme_dif_rw_cb(ctx, ret);
 }
 
+static void nvme_dif_rw_write_cb(void *opaque, int ret)
+{
+    NvmeBounceContext *ctx = opaque;
+    NvmeRequest *req = ctx->req;
+    NvmeNamespace *ns = req->ns;
+    NvmeRwCmd *rw = (NvmeRwCmd *)&req->cmd;
+    int64_t offset = nvme_l2b(ns, le64_to_cpu(rw->slba));
+
+    if (ret) {
+        goto out;
+    }
+
+    if (ctx->status) {
+        req->status = ctx->status;
+        goto out;
+    }
+
+    req->aiocb = blk_aio_pwritev(ns->blkconf.blk, offset, &ctx->data.iov, 0,
+                                 nvme_dif_rw_mdata_out_cb, ctx);
+    return;
+
+out:
+    nvme_dif_rw_cb(ctx, ret);
+}
+
 uint16_t nvme_dif_rw(NvmeCtrl *n, NvmeRequest *req)
 {
     NvmeRwCmd *rw = (NvmeRwCmd *)&req->cmd;
@@ -366,7 +455,6 @@ uint16_t nvme_dif_rw(NvmeCtrl *n, NvmeRequest *req)
     int64_t offset = nvme_l2b(ns, slba);
     uint8_t prinfo = NVME_RW_PRINFO(le16_to_cpu(rw->control));
     uint16_t apptag = le16_to_cpu(rw->apptag);
-    uint16_t appmask = le16_to_cpu(rw->appmask);
     uint32_t reftag = le32_to_cpu(rw->reftag);
     bool pract = !!(prinfo & NVME_PRINFO_PRACT);
     NvmeBounceContext *ctx;
@@ -474,25 +562,23 @@ uint16_t nvme_dif_rw(NvmeCtrl *n, NvmeRequest *req)
         goto err;
     }
 
-    if (pract) {
-        /* splice generated protection information into the buffer */
-        nvme_dif_pract_generate_dif(ns, ctx->data.bounce, ctx->data.iov.size,
-                                    ctx->mdata.bounce, ctx->mdata.iov.size,
-                                    apptag, &reftag);
-    } else {
-        status = nvme_dif_check(ns, ctx->data.bounce, ctx->data.iov.size,
-                                ctx->mdata.bounce, ctx->mdata.iov.size, prinfo,
-                                slba, apptag, appmask, &reftag);
-        if (status) {
-            goto err;
-        }
+    if (len >= NVME_DIF_OFFLOAD_LEN) {
+        block_acct_start(blk_get_stats(blk), &req->acct, ctx->data.iov.size,
+                         BLOCK_ACCT_WRITE);
+
+        req->aiocb = nvme_dif_rw_pi_offload(ctx, nvme_dif_rw_write_cb);
+        return NVME_NO_COMPLETE;
+    }
+
+    status = nvme_dif_rw_pi(ctx);
+    if (status) {
+        goto err;
     }
 
     block_acct_start(blk_get_stats(blk), &req->acct, ctx->data.iov.size,
                      BLOCK_ACCT_WRITE);
 
-    req->aiocb = blk_aio_pwritev(ns->blkconf.blk, offset, &ctx->data.iov, 0,
-                                 nvme_dif_rw_mdata_out_cb, ctx);
+    nvme_dif_rw_write_cb(ctx, 0);
 
     return NVME_NO_COMPLETE;
 
@@ -167,6 +167,10 @@ static void process_bar_write(QIOChannel *ioc, MPQemuMsg *msg, Error **errp)
     }
 
 fail:
+    if (bar_access->posted) {
+        return;
+    }
+
     ret.cmd = MPQEMU_CMD_RET;
     ret.size = sizeof(ret.data.u64);
 
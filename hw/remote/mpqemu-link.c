@@ -69,7 +69,7 @@ bool mpqemu_msg_send(MPQemuMsg *msg, QIOChannel *ioc, Error **errp)
     }
 
     if (!qio_channel_writev_full_all(ioc, send, G_N_ELEMENTS(send),
-                                    fds, nfds, errp)) {
+                                    fds, nfds, 0, errp)) {
         ret = true;
     } else {
         trace_mpqemu_send_io_error(msg->cmd, msg->size, nfds);
@@ -213,6 +213,20 @@ uint64_t mpqemu_msg_send_and_await_reply(MPQemuMsg *msg, PCIProxyDev *pdev,
     return msg_reply.data.u64;
 }
 
+/*
+ * Send msg without waiting for a reply; the remote process must not send
+ * one.  Messages on the channel are processed in order, so a later
+ * mpqemu_msg_send_and_await_reply() still observes the effect of msg.
+ * Called from VCPU thread in non-coroutine context.
+ */
+bool mpqemu_msg_send_posted(MPQemuMsg *msg, PCIProxyDev *pdev, Error **errp)
+{
+    assert(!qemu_in_coroutine());
+
+    QEMU_LOCK_GUARD(&pdev->io_mutex);
+    return mpqemu_msg_send(msg, pdev->ioc, errp);
+}
+
 bool mpqemu_msg_valid(MPQemuMsg *msg)
 {
     if (msg->cmd >= MPQEMU_CMD_MAX || msg->cmd < 0) {
@@ -250,6 +264,9 @@ bool mpqemu_msg_valid(MPQemuMsg *msg)
         if ((msg->size != sizeof(BarAccessMsg)) || (msg->num_fds != 0)) {
             return false;
         }
+        if (msg->cmd == MPQEMU_CMD_BAR_READ && msg->data.bar_access.posted) {
+            return false;
+        }
         break;
     case MPQEMU_CMD_SET_IRQFD:
         if (msg->size || (msg->num_fds != 2)) {
@@ -254,6 +254,19 @@ static void send_bar_access_msg(PCIProxyDev *pdev, MemoryRegion *mr,
         msg.cmd = MPQEMU_CMD_BAR_READ;
     }
 
+    /*
+     * Like on PCI, memory writes are posted: the vCPU does not wait for
+     * the remote process to complete them.  I/O port writes are not.
+     */
+    if (write && memory) {
+        msg.data.bar_access.posted = true;
+        mpqemu_msg_send_posted(&msg, pdev, &local_err);
+        if (local_err) {
+            error_report_err(local_err);
+        }
+        return;
+    }
+
     ret = mpqemu_msg_send_and_await_reply(&msg, pdev, &local_err);
     if (local_err) {
         error_report_err(local_err);
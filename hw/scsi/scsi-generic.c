@@ -680,6 +680,27 @@ static void scsi_generic_reset(DeviceState *dev)
     scsi_device_purge_requests(s, SENSE_CODE(RESET));
 }
 
+static void scsi_generic_drained_begin(void *opaque)
+{
+    scsi_device_drained_begin(opaque);
+}
+
+static bool scsi_generic_drained_poll(void *opaque)
+{
+    return scsi_device_drained_poll(opaque);
+}
+
+static void scsi_generic_drained_end(void *opaque)
+{
+    scsi_device_drained_end(opaque);
+}
+
+static const BlockDevOps scsi_generic_block_ops = {
+    .drained_begin = scsi_generic_drained_begin,
+    .drained_poll = scsi_generic_drained_poll,
+    .drained_end = scsi_generic_drained_end,
+};
+
 static void scsi_generic_realize(SCSIDevice *s, Error **errp)
 {
     int rc;
@@ -725,6 +746,7 @@ static void scsi_generic_realize(SCSIDevice *s, Error **errp)
                                        true, errp)) {
         return;
     }
+    blk_set_dev_ops(s->conf.blk, &scsi_generic_block_ops, s);
 
     /* define device state */
     s->type = scsiid.scsi_type;
@@ -20,6 +20,76 @@
 #include "scsi/constants.h"
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
+#include "qemu/bitmap.h"
+
+/* Raise the interrupts of the virtqueues completed since the last run */
+static void virtio_scsi_notify_guest_bh(void *opaque)
+{
+    VirtIOSCSI *s = opaque;
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    unsigned nvqs = vs->conf.num_queues + 2;
+    unsigned i, j;
+
+    for (j = 0; j < BITS_TO_LONGS(nvqs); j++) {
+        unsigned long bits = qatomic_xchg(&s->notify_vqs[j], 0);
+
+        while (bits != 0) {
+            i = j * BITS_PER_LONG + ctzl(bits);
+            virtio_notify_irqfd(vdev, virtio_get_queue(vdev, i));
+            bits &= bits - 1; /* clear right-most bit */
+        }
+    }
+}
+
+/*
+ * Requests that complete during one event loop iteration share a single
+ * interrupt per virtqueue.
+ */
+void virtio_scsi_dataplane_notify(VirtIOSCSI *s, VirtQueue *vq)
+{
+    set_bit_atomic(virtio_get_queue_index(vq), s->notify_vqs);
+    qemu_bh_schedule(s->notify_bh);
+}
+
+/*
+ * Look up the IOThreads of iothread-vq-mapping and assign the command queues
+ * to them round-robin.
+ *
+ * Context: QEMU global mutex held
+ */
+static bool virtio_scsi_iothread_vq_mapping(VirtIOSCSI *s, Error **errp)
+{
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    uint32_t n = vs->conf.num_iothread_vq_mapping;
+    uint32_t i;
+
+    if (n > vs->conf.num_queues) {
+        error_setg(errp, "iothread-vq-mapping has %" PRIu32 " entries, more "
+                   "than num_queues (%" PRIu32 ")", n, vs->conf.num_queues);
+        return false;
+    }
+
+    s->vq_iothreads = g_new0(IOThread *, n);
+    for (i = 0; i < n; i++) {
+        const char *id = vs->conf.iothread_vq_mapping[i];
+        IOThread *iothread = id ? iothread_by_id(id) : NULL;
+
+        if (!iothread) {
+            error_setg(errp, "iothread-vq-mapping: IOThread '%s' not found",
+                       id ? id : "");
+            return false;
+        }
+        object_ref(OBJECT(iothread));
+        s->vq_iothreads[s->num_vq_iothreads++] = iothread;
+    }
+
+    s->cmd_vq_ctx = g_new(AioContext *, vs->conf.num_queues);
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        s->cmd_vq_ctx[i] = iothread_get_aio_context(s->vq_iothreads[i % n]);
+    }
+    return true;
+}
 
 /* Context: QEMU global mutex held */
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
@@ -28,8 +98,15 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    uint32_t i;
 
-    if (vs->conf.iothread) {
+    if (vs->conf.iothread && vs->conf.num_iothread_vq_mapping) {
+        error_setg(errp, "iothread and iothread-vq-mapping properties "
+                   "cannot be set at the same time");
+        return;
+    }
+
+    if (vs->conf.iothread || vs->conf.num_iothread_vq_mapping) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -40,13 +117,50 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
             error_setg(errp, "ioeventfd is required for iothread");
             return;
         }
-        s->ctx = iothread_get_aio_context(vs->conf.iothread);
-    } else {
-        if (!virtio_device_ioeventfd_enabled(vdev)) {
+    } else if (!virtio_device_ioeventfd_enabled(vdev)) {
+        return;
+    }
+
+    if (vs->conf.num_iothread_vq_mapping) {
+        if (!virtio_scsi_iothread_vq_mapping(s, errp)) {
+            virtio_scsi_dataplane_cleanup(s);
             return;
         }
-        s->ctx = qemu_get_aio_context();
+        s->ctx = s->cmd_vq_ctx[0];
+    } else {
+        s->ctx = vs->conf.iothread ?
+                 iothread_get_aio_context(vs->conf.iothread) :
+                 qemu_get_aio_context();
+        s->cmd_vq_ctx = g_new(AioContext *, vs->conf.num_queues);
+        for (i = 0; i < vs->conf.num_queues; i++) {
+            s->cmd_vq_ctx[i] = s->ctx;
+        }
+    }
+
+    s->notify_bh = aio_bh_new(s->ctx, virtio_scsi_notify_guest_bh, s);
+    s->notify_vqs = bitmap_new(vs->conf.num_queues + 2);
+}
+
+/* Context: QEMU global mutex held */
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s)
+{
+    uint32_t i;
+
+    if (s->notify_bh) {
+        qemu_bh_delete(s->notify_bh);
+        s->notify_bh = NULL;
+    }
+    g_free(s->notify_vqs);
+    s->notify_vqs = NULL;
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        object_unref(OBJECT(s->vq_iothreads[i]));
     }
+    g_free(s->vq_iothreads);
+    s->vq_iothreads = NULL;
+    s->num_vq_iothreads = 0;
+    g_free(s->cmd_vq_ctx);
+    s->cmd_vq_ctx = NULL;
+    s->ctx = NULL;
 }
 
 static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
@@ -54,6 +168,19 @@ static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
 {
     bool progress = false;
     VirtIOSCSI *s = VIRTIO_SCSI(vdev);
+    bool other_ctx = qemu_get_current_aio_context() != s->ctx;
+
+    /*
+     * Pairs with virtio_scsi_dataplane_drained_begin(): either the drain
+     * sees this handler running, or the handler sees the drain.  A kick
+     * consumed here is replayed by drained_end.
+     */
+    if (other_ctx) {
+        qatomic_inc(&s->cmd_handlers_running);
+        if (qatomic_read(&s->drain_count)) {
+            goto out;
+        }
+    }
 
     virtio_scsi_acquire(s);
     if (!s->dataplane_fenced) {
@@ -61,6 +188,12 @@ static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
         progress = virtio_scsi_handle_cmd_vq(s, vq);
     }
     virtio_scsi_release(s);
+
+out:
+    if (other_ctx) {
+        qatomic_dec(&s->cmd_handlers_running);
+        aio_wait_kick();
+    }
     return progress;
 }
 
@@ -94,6 +227,58 @@ static bool virtio_scsi_data_plane_handle_event(VirtIODevice *vdev,
     return progress;
 }
 
+/* Stop processing command queues in IOThreads other than s->ctx */
+void virtio_scsi_dataplane_drained_begin(VirtIOSCSI *s)
+{
+    uint32_t i;
+
+    if (qatomic_fetch_inc(&s->drain_count) > 0) {
+        return;
+    }
+
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_disable_external(ctx);
+        }
+    }
+}
+
+/* Is a command queue handler still running in one of the other IOThreads? */
+bool virtio_scsi_dataplane_drained_poll(VirtIOSCSI *s)
+{
+    return qatomic_read(&s->cmd_handlers_running) > 0;
+}
+
+void virtio_scsi_dataplane_drained_end(VirtIOSCSI *s)
+{
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    uint32_t i;
+
+    if (qatomic_fetch_dec(&s->drain_count) > 1) {
+        return;
+    }
+
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_enable_external(ctx);
+        }
+    }
+
+    /* Pick up requests whose kick arrived during the drained section */
+    if (s->dataplane_started && !s->dataplane_fenced) {
+        for (i = 0; i < vs->conf.num_queues; i++) {
+            if (s->cmd_vq_ctx[i] != s->ctx) {
+                event_notifier_set(
+                    virtio_queue_get_host_notifier(vs->cmd_vqs[i]));
+            }
+        }
+    }
+}
+
 static int virtio_scsi_set_host_notifier(VirtIOSCSI *s, VirtQueue *vq, int n)
 {
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(s)));
@@ -116,12 +301,18 @@ static void virtio_scsi_dataplane_stop_bh(void *opaque)
 {
     VirtIOSCSI *s = opaque;
     VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    AioContext *ctx = qemu_get_current_aio_context();
     int i;
 
-    virtio_queue_aio_set_host_notifier_handler(vs->ctrl_vq, s->ctx, NULL);
-    virtio_queue_aio_set_host_notifier_handler(vs->event_vq, s->ctx, NULL);
+    if (ctx == s->ctx) {
+        virtio_queue_aio_set_host_notifier_handler(vs->ctrl_vq, ctx, NULL);
+        virtio_queue_aio_set_host_notifier_handler(vs->event_vq, ctx, NULL);
+    }
     for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], s->ctx, NULL);
+        if (s->cmd_vq_ctx[i] == ctx) {
+            virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], ctx,
+                                                       NULL);
+        }
     }
 }
 
@@ -187,9 +378,21 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
     virtio_queue_aio_set_host_notifier_handler(vs->event_vq, s->ctx,
                                            virtio_scsi_data_plane_handle_event);
 
+    /*
+     * Command queues in other IOThreads take s->ctx in their handler, so
+     * they cannot run before dataplane_started is set.
+     */
     for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], s->ctx,
+        AioContext *ctx = s->cmd_vq_ctx[i];
+
+        if (ctx != s->ctx) {
+            aio_context_acquire(ctx);
+        }
+        virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], ctx,
                                              virtio_scsi_data_plane_handle_cmd);
+        if (ctx != s->ctx) {
+            aio_context_release(ctx);
+        }
     }
 
     s->dataplane_starting = false;
@@ -240,12 +443,29 @@ void virtio_scsi_dataplane_stop(VirtIODevice *vdev)
     }
     s->dataplane_stopping = true;
 
+    /*
+     * Stop the other IOThreads first: their command queue handlers take the
+     * AioContext lock of s->ctx.
+     */
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        AioContext *ctx = iothread_get_aio_context(s->vq_iothreads[i]);
+
+        if (ctx != s->ctx) {
+            aio_context_acquire(ctx);
+            aio_wait_bh_oneshot(ctx, virtio_scsi_dataplane_stop_bh, s);
+            aio_context_release(ctx);
+        }
+    }
+
     aio_context_acquire(s->ctx);
     aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
     aio_context_release(s->ctx);
 
     blk_drain_all(); /* ensure there are no in-flight requests */
 
+    qemu_bh_cancel(s->notify_bh);
+    virtio_scsi_notify_guest_bh(s); /* final chance to notify guest */
+
     /*
      * Batch all the host notifiers in a single transaction to avoid
      * quadratic time complexity in address_space_update_ioeventfds().
@@ -54,7 +54,8 @@ void virtio_scsi_init_req(VirtIOSCSI *s, VirtQueue *vq, VirtIOSCSIReq *req)
     req->vq = vq;
     req->dev = s;
     qemu_sglist_init(&req->qsgl, DEVICE(s), 8, vdev->dma_as);
-    qemu_iovec_init(&req->resp_iov, 1);
+    qemu_iovec_init_storage(&req->resp_iov, req->resp_iov_storage,
+                            ARRAY_SIZE(req->resp_iov_storage));
     memset((uint8_t *)req + zero_skip, 0, sizeof(*req) - zero_skip);
 }
 
@@ -62,7 +63,7 @@ void virtio_scsi_free_req(VirtIOSCSIReq *req)
 {
     qemu_iovec_destroy(&req->resp_iov);
     qemu_sglist_destroy(&req->qsgl);
-    g_free(req);
+    virtqueue_element_free(req->vq, req);
 }
 
 static void virtio_scsi_complete_req(VirtIOSCSIReq *req)
@@ -74,7 +75,7 @@ static void virtio_scsi_complete_req(VirtIOSCSIReq *req)
     qemu_iovec_from_buf(&req->resp_iov, 0, &req->resp, req->resp_size);
     virtqueue_push(vq, &req->elem, req->qsgl.size + req->resp_iov.size);
     if (s->dataplane_started && !s->dataplane_fenced) {
-        virtio_notify_irqfd(vdev, vq);
+        virtio_scsi_dataplane_notify(s, vq);
     } else {
         virtio_notify(vdev, vq);
     }
@@ -946,6 +947,27 @@ static void virtio_scsi_hotunplug(HotplugHandler *hotplug_dev, DeviceState *dev,
     }
 }
 
+static void virtio_scsi_drained_begin(SCSIBus *bus)
+{
+    VirtIOSCSI *s = container_of(bus, VirtIOSCSI, bus);
+
+    virtio_scsi_dataplane_drained_begin(s);
+}
+
+static bool virtio_scsi_drained_poll(SCSIBus *bus)
+{
+    VirtIOSCSI *s = container_of(bus, VirtIOSCSI, bus);
+
+    return virtio_scsi_dataplane_drained_poll(s);
+}
+
+static void virtio_scsi_drained_end(SCSIBus *bus)
+{
+    VirtIOSCSI *s = container_of(bus, VirtIOSCSI, bus);
+
+    virtio_scsi_dataplane_drained_end(s);
+}
+
 static struct SCSIBusInfo virtio_scsi_scsi_info = {
     .tcq = true,
     .max_channel = VIRTIO_SCSI_MAX_CHANNEL,
@@ -960,6 +982,9 @@ static struct SCSIBusInfo virtio_scsi_scsi_info = {
     .get_sg_list = virtio_scsi_get_sg_list,
     .save_request = virtio_scsi_save_request,
     .load_request = virtio_scsi_load_request,
+    .drained_begin = virtio_scsi_drained_begin,
+    .drained_poll = virtio_scsi_drained_poll,
+    .drained_end = virtio_scsi_drained_end,
 };
 
 void virtio_scsi_common_realize(DeviceState *dev,
@@ -1003,11 +1028,19 @@ void virtio_scsi_common_realize(DeviceState *dev,
     }
 }
 
+/*
+ * Segments that pooled requests have room for: command, response and a few
+ * data segments.
+ */
+#define VIRTIO_SCSI_POOL_SG 8
+
 static void virtio_scsi_device_realize(DeviceState *dev, Error **errp)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(dev);
     VirtIOSCSI *s = VIRTIO_SCSI(dev);
     Error *err = NULL;
+    uint32_t i;
 
     virtio_scsi_common_realize(dev,
                                virtio_scsi_handle_ctrl,
@@ -1024,6 +1057,14 @@ static void virtio_scsi_device_realize(DeviceState *dev, Error **errp)
     /* override default SCSI bus hotplug-handler, with virtio-scsi's one */
     qbus_set_hotplug_handler(BUS(&s->bus), OBJECT(dev));
 
+    /* Recycle command requests, sized for the default CDB size */
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        virtio_queue_enable_element_pool(vs->cmd_vqs[i],
+                                         sizeof(VirtIOSCSIReq) +
+                                         VIRTIO_SCSI_CDB_DEFAULT_SIZE,
+                                         VIRTIO_SCSI_POOL_SG);
+    }
+
     virtio_scsi_dataplane_setup(s, errp);
 }
 
@@ -1047,6 +1088,7 @@ static void virtio_scsi_device_unrealize(DeviceState *dev)
     VirtIOSCSI *s = VIRTIO_SCSI(dev);
 
     qbus_set_hotplug_handler(BUS(&s->bus), NULL);
+    virtio_scsi_dataplane_cleanup(s);
     virtio_scsi_common_unrealize(dev);
 }
 
@@ -1067,6 +1109,10 @@ static Property virtio_scsi_properties[] = {
                                                 VIRTIO_SCSI_F_CHANGE, true),
     DEFINE_PROP_LINK("iothread", VirtIOSCSI, parent_obj.conf.iothread,
                      TYPE_IOTHREAD, IOThread *),
+    DEFINE_PROP_ARRAY("iothread-vq-mapping", VirtIOSCSI,
+                      parent_obj.conf.num_iothread_vq_mapping,
+                      parent_obj.conf.iothread_vq_mapping,
+                      qdev_prop_string, char *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
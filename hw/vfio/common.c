@@ -34,6 +34,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/range.h"
+#include "qemu/units.h"
 #include "sysemu/kvm.h"
 #include "sysemu/reset.h"
 #include "sysemu/runstate.h"
@@ -945,6 +946,43 @@ hostwin_from_range(VFIOContainer *container, hwaddr iova, hwaddr end)
     return NULL;
 }
 
+/*
+ * The type1 backend pins the pages inside VFIO_IOMMU_MAP_DMA, with the
+ * container lock held, so mapping a large section that was never touched
+ * faults in all of it on a single thread.  Fault it in with several
+ * threads first, the ioctl then only has to pin resident pages.
+ *
+ * os_mem_prealloc() writes every page back and temporarily installs its
+ * own SIGBUS handler, so this is only safe before the guest first runs,
+ * not when a device is hot-plugged and region_add is replayed for live RAM.
+ */
+#define VFIO_DMA_MAP_PREFAULT_MIN (1 * GiB)
+
+static void vfio_dma_map_prefault(MemoryRegionSection *section, void *vaddr,
+                                  hwaddr size)
+{
+    int fd = memory_region_get_fd(section->mr);
+    size_t pagesize = qemu_fd_getpagesize(fd);
+    Error *local_err = NULL;
+
+    /* Touching the pages writes to them */
+    if (!runstate_check(RUN_STATE_PRELAUNCH) ||
+        size < VFIO_DMA_MAP_PREFAULT_MIN || section->readonly ||
+        memory_region_is_ram_device(section->mr) ||
+        !QEMU_IS_ALIGNED((uintptr_t)vaddr, pagesize) ||
+        !QEMU_IS_ALIGNED(size, pagesize)) {
+        return;
+    }
+
+    trace_vfio_dma_map_prefault(vaddr, size);
+    os_mem_prealloc(fd, vaddr, size, g_get_num_processors(), NULL, 0,
+                    &local_err);
+    if (local_err) {
+        /* Not fatal, VFIO_IOMMU_MAP_DMA reports the real failure */
+        warn_report_err(local_err);
+    }
+}
+
 static int vfio_dma_map_ram_section(VFIOContainer *container,
                                     MemoryRegionSection *section, Error **err)
 {
@@ -1000,6 +1038,7 @@ static int vfio_dma_map_ram_section(VFIOContainer *container,
         }
     }
 
+    vfio_dma_map_prefault(section, vaddr, int128_get64(llsize));
     ret = vfio_dma_map(container, iova, int128_get64(llsize),
                        vaddr, section->readonly);
     if (ret) {
@@ -1389,6 +1428,27 @@ static void vfio_listener_log_global_stop(MemoryListener *listener)
     VFIOContainer *container = container_of(listener, VFIOContainer, listener);
 
     vfio_set_dirty_page_tracking(container, false);
+
+    g_free(container->dirty_bitmap);
+    container->dirty_bitmap = NULL;
+    container->dirty_bitmap_size = 0;
+}
+
+/*
+ * The bitmap of a large guest is tens of megabytes and is fetched at
+ * every dirty log sync, so allocate it once and only clear it afterwards.
+ */
+static void *vfio_dirty_bitmap_get_buffer(VFIOContainer *container,
+                                          uint64_t size)
+{
+    if (size > container->dirty_bitmap_size) {
+        g_free(container->dirty_bitmap);
+        container->dirty_bitmap = g_try_malloc0(size);
+        container->dirty_bitmap_size = container->dirty_bitmap ? size : 0;
+    } else {
+        memset(container->dirty_bitmap, 0, size);
+    }
+    return container->dirty_bitmap;
 }
 
 static int vfio_get_dirty_bitmap(VFIOContainer *container, uint64_t iova,
@@ -1417,7 +1477,8 @@ static int vfio_get_dirty_bitmap(VFIOContainer *container, uint64_t iova,
     pages = REAL_HOST_PAGE_ALIGN(range->size) / qemu_real_host_page_size;
     range->bitmap.size = ROUND_UP(pages, sizeof(__u64) * BITS_PER_BYTE) /
                                          BITS_PER_BYTE;
-    range->bitmap.data = g_try_malloc0(range->bitmap.size);
+    range->bitmap.data = vfio_dirty_bitmap_get_buffer(container,
+                                                      range->bitmap.size);
     if (!range->bitmap.data) {
         ret = -ENOMEM;
         goto err_out;
@@ -1437,7 +1498,6 @@ static int vfio_get_dirty_bitmap(VFIOContainer *container, uint64_t iova,
     trace_vfio_get_dirty_bitmap(container->fd, range->iova, range->size,
                                 range->bitmap.size, ram_addr);
 err_out:
-    g_free(range->bitmap.data);
     g_free(dbitmap);
 
     return ret;
@@ -2452,6 +2512,7 @@ static void vfio_disconnect_container(VFIOGroup *group)
 
         trace_vfio_disconnect_container(container->fd);
         close(container->fd);
+        g_free(container->dirty_bitmap);
         g_free(container);
 
         vfio_put_address_space(space);
@@ -193,6 +193,20 @@ static void *get_data_section_size(VFIORegion *region, uint64_t data_offset,
     return ptr;
 }
 
+/*
+ * Device state is moved in many iterations of the same size, so keep the
+ * bounce buffer around instead of allocating it for each of them.
+ */
+static void *vfio_mig_data_buffer(VFIOMigration *migration, uint64_t size)
+{
+    if (size > migration->data_buffer_size) {
+        g_free(migration->data_buffer);
+        migration->data_buffer = g_try_malloc(size);
+        migration->data_buffer_size = migration->data_buffer ? size : 0;
+    }
+    return migration->data_buffer;
+}
+
 static int vfio_save_buffer(QEMUFile *f, VFIODevice *vbasedev, uint64_t *size)
 {
     VFIOMigration *migration = vbasedev->migration;
@@ -221,31 +235,24 @@ static int vfio_save_buffer(QEMUFile *f, VFIODevice *vbasedev, uint64_t *size)
     while (sz) {
         void *buf;
         uint64_t sec_size;
-        bool buf_allocated = false;
 
         buf = get_data_section_size(region, data_offset, sz, &sec_size);
 
         if (!buf) {
-            buf = g_try_malloc(sec_size);
+            buf = vfio_mig_data_buffer(migration, sec_size);
             if (!buf) {
                 error_report("%s: Error allocating buffer ", __func__);
                 return -ENOMEM;
             }
-            buf_allocated = true;
 
             ret = vfio_mig_read(vbasedev, buf, sec_size,
                                 region->fd_offset + data_offset);
             if (ret < 0) {
-                g_free(buf);
                 return ret;
             }
         }
 
         qemu_put_buffer(f, buf, sec_size);
-
-        if (buf_allocated) {
-            g_free(buf);
-        }
         sz -= sec_size;
         data_offset += sec_size;
     }
@@ -298,7 +305,7 @@ static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
             buf = get_data_section_size(region, data_offset, size, &sec_size);
 
             if (!buf) {
-                buf = g_try_malloc(sec_size);
+                buf = vfio_mig_data_buffer(vbasedev->migration, sec_size);
                 if (!buf) {
                     error_report("%s: Error allocating buffer ", __func__);
                     return -ENOMEM;
@@ -311,8 +318,6 @@ static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
             if (buf_alloc) {
                 ret = vfio_mig_write(vbasedev, buf, sec_size,
                         region->fd_offset + data_offset);
-                g_free(buf);
-
                 if (ret < 0) {
                     return ret;
                 }
@@ -401,6 +406,9 @@ static void vfio_migration_cleanup(VFIODevice *vbasedev)
     if (migration->region.mmaps) {
         vfio_region_unmap(&migration->region);
     }
+    g_free(migration->data_buffer);
+    migration->data_buffer = NULL;
+    migration->data_buffer_size = 0;
 }
 
 /* ---------------------------------------------------------------------- */
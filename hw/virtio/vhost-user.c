@@ -721,35 +721,49 @@ static int send_remove_regions(struct vhost_dev *dev,
 {
     struct vhost_user *u = dev->opaque;
     struct vhost_memory_region *shadow_reg;
-    int i, fd, shadow_reg_idx, ret;
+    bool sent[VHOST_USER_MAX_RAM_SLOTS] = {};
+    int i, fd, shadow_reg_idx, ret = 0;
     ram_addr_t offset;
     VhostUserMemoryRegion region_buffer;
 
     /*
-     * The regions in remove_reg appear in the same order they do in the
-     * shadow table. Therefore we can minimize memory copies by iterating
-     * through remove_reg backwards.
+     * Send all the messages before waiting for the first reply, so that a
+     * memory hotplug event costs one round trip instead of one per region.
+     * The backend handles them in order, so the replies come back in the
+     * same order.
      */
+    msg->hdr.request = VHOST_USER_REM_MEM_REG;
     for (i = nr_rem_reg - 1; i >= 0; i--) {
         shadow_reg = remove_reg[i].region;
-        shadow_reg_idx = remove_reg[i].reg_idx;
 
         vhost_user_get_mr_data(shadow_reg->userspace_addr, &offset, &fd);
 
         if (fd > 0) {
-            msg->hdr.request = VHOST_USER_REM_MEM_REG;
             vhost_user_fill_msg_region(&region_buffer, shadow_reg, 0);
             msg->payload.mem_reg.region = region_buffer;
 
             if (vhost_user_write(dev, msg, &fd, 1) < 0) {
                 return -1;
             }
+            sent[i] = true;
+        }
+    }
 
-            if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+    /*
+     * The regions in remove_reg appear in the same order they do in the
+     * shadow table. Therefore we can minimize memory copies by iterating
+     * through remove_reg backwards.
+     */
+    for (i = nr_rem_reg - 1; i >= 0; i--) {
+        shadow_reg_idx = remove_reg[i].reg_idx;
+
+        /* Collect every reply even after a failure to keep the socket in sync */
+        if (sent[i] && reply_supported) {
+            int reply = process_message_reply(dev, msg);
+
+            if (reply) {
+                ret = reply;
+                continue;
             }
         }
 
@@ -764,7 +778,19 @@ static int send_remove_regions(struct vhost_dev *dev,
         u->num_shadow_regions--;
     }
 
-    return 0;
+    return ret;
+}
+
+static void vhost_user_add_shadow_region(struct vhost_user *u,
+                                         struct vhost_memory_region *reg)
+{
+    u->shadow_regions[u->num_shadow_regions].guest_phys_addr =
+        reg->guest_phys_addr;
+    u->shadow_regions[u->num_shadow_regions].userspace_addr =
+        reg->userspace_addr;
+    u->shadow_regions[u->num_shadow_regions].memory_size =
+        reg->memory_size;
+    u->num_shadow_regions++;
 }
 
 static int send_add_regions(struct vhost_dev *dev,
@@ -773,7 +799,8 @@ static int send_add_regions(struct vhost_dev *dev,
                             bool reply_supported, bool track_ramblocks)
 {
     struct vhost_user *u = dev->opaque;
-    int i, fd, ret, reg_idx, reg_fd_idx;
+    bool pending[VHOST_USER_MAX_RAM_SLOTS] = {};
+    int i, fd, ret = 0, reg_idx, reg_fd_idx;
     struct vhost_memory_region *reg;
     MemoryRegion *mr;
     ram_addr_t offset;
@@ -849,10 +876,8 @@ static int send_add_regions(struct vhost_dev *dev,
                     return -1;
                 }
             } else if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+                /* Replies are collected below, see send_remove_regions() */
+                pending[i] = true;
             }
         } else if (track_ramblocks) {
             u->region_rb_offset[reg_idx] = 0;
@@ -865,16 +890,28 @@ static int send_add_regions(struct vhost_dev *dev,
          *
          * The region should now be added to the shadow table.
          */
-        u->shadow_regions[u->num_shadow_regions].guest_phys_addr =
-            reg->guest_phys_addr;
-        u->shadow_regions[u->num_shadow_regions].userspace_addr =
-            reg->userspace_addr;
-        u->shadow_regions[u->num_shadow_regions].memory_size =
-            reg->memory_size;
-        u->num_shadow_regions++;
+        if (track_ramblocks) {
+            vhost_user_add_shadow_region(u, reg);
+        }
     }
 
-    return 0;
+    if (track_ramblocks) {
+        return 0;
+    }
+
+    for (i = 0; i < nr_add_reg; i++) {
+        if (pending[i]) {
+            int reply = process_message_reply(dev, msg);
+
+            if (reply) {
+                ret = reply;
+                continue;
+            }
+        }
+        vhost_user_add_shadow_region(u, add_reg[i].region);
+    }
+
+    return ret;
 }
 
 static int vhost_user_add_remove_regions(struct vhost_dev *dev,
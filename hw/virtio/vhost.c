@@ -20,6 +20,7 @@
 #include "qemu/range.h"
 #include "qemu/error-report.h"
 #include "qemu/memfd.h"
+#include "qemu/timer.h"
 #include "standard-headers/linux/vhost_types.h"
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
@@ -1740,11 +1741,14 @@ int vhost_dev_get_inflight(struct vhost_dev *dev, uint16_t queue_size,
 /* Host notifiers must be enabled at this point. */
 int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
 {
+    int64_t start_ns = get_clock();
+    int64_t mem_ns, vrings_ns;
     int i, r;
 
     /* should only be called after backend is connected */
     assert(hdev->vhost_ops);
 
+    trace_vhost_dev_start(hdev, hdev->nvqs);
     hdev->started = true;
     hdev->vdev = vdev;
 
@@ -1763,6 +1767,7 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
         r = -errno;
         goto fail_mem;
     }
+    mem_ns = get_clock();
     for (i = 0; i < hdev->nvqs; ++i) {
         r = vhost_virtqueue_start(hdev,
                                   vdev,
@@ -1772,6 +1777,7 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
             goto fail_vq;
         }
     }
+    vrings_ns = get_clock();
 
     if (hdev->log_enabled) {
         uint64_t log_base;
@@ -1806,6 +1812,8 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
             vhost_device_iotlb_miss(hdev, vq->used_phys, true);
         }
     }
+    trace_vhost_dev_start_done(hdev, mem_ns - start_ns, vrings_ns - mem_ns,
+                               get_clock() - start_ns);
     return 0;
 fail_log:
     vhost_log_put(hdev, false);
@@ -1827,6 +1835,7 @@ fail_features:
 /* Host notifiers must be enabled at this point. */
 void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev)
 {
+    int64_t start_ns = get_clock();
     int i;
 
     /* should only be called after backend is connected */
@@ -1851,6 +1860,7 @@ void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev)
     vhost_log_put(hdev, true);
     hdev->started = false;
     hdev->vdev = NULL;
+    trace_vhost_dev_stop_done(hdev, hdev->nvqs, get_clock() - start_ns);
 }
 
 int vhost_net_set_backend(struct vhost_dev *hdev,
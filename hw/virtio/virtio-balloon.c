@@ -325,10 +325,66 @@ static void balloon_stats_set_poll_interval(Object *obj, Visitor *v,
     balloon_stats_change_timer(s, 0);
 }
 
+/*
+ * Reported ranges frequently are physically contiguous, both within one
+ * element and across consecutive elements.  Collect them into one range
+ * so that the kernel has to walk and zap the page tables only once.
+ * Elements are completed in batches, because the guest may reuse the pages
+ * as soon as it sees an element in the used ring.
+ */
+#define VIRTIO_BALLOON_REPORT_BATCH 32
+
+typedef struct ReportedRange {
+    RAMBlock *rb;
+    ram_addr_t offset;
+    size_t size;
+} ReportedRange;
+
+static void virtio_balloon_report_flush(ReportedRange *range)
+{
+    if (range->size) {
+        trace_virtio_balloon_report_discard(range->offset, range->size);
+        ram_block_discard_range(range->rb, range->offset, range->size);
+        range->size = 0;
+    }
+}
+
+static void virtio_balloon_report_add(ReportedRange *range, RAMBlock *rb,
+                                      ram_addr_t offset, size_t size)
+{
+    if (range->size && range->rb == rb &&
+        range->offset + range->size == offset) {
+        range->size += size;
+        return;
+    }
+    virtio_balloon_report_flush(range);
+    range->rb = rb;
+    range->offset = offset;
+    range->size = size;
+}
+
+static void virtio_balloon_report_complete(VirtQueue *vq,
+                                           ReportedRange *range,
+                                           VirtQueueElement **batch,
+                                           unsigned int count)
+{
+    unsigned int i;
+
+    virtio_balloon_report_flush(range);
+    for (i = 0; i < count; i++) {
+        virtqueue_push(vq, batch[i], 0);
+        g_free(batch[i]);
+    }
+}
+
 static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
+    VirtQueueElement *batch[VIRTIO_BALLOON_REPORT_BATCH];
+    ReportedRange range = {};
     VirtQueueElement *elem;
+    unsigned int count = 0;
+    bool notify = false;
 
     while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
         unsigned int i;
@@ -376,13 +432,24 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            virtio_balloon_report_add(&range, rb, ram_offset, size);
         }
 
 skip_element:
-        virtqueue_push(vq, elem, 0);
+        batch[count++] = elem;
+        if (count == VIRTIO_BALLOON_REPORT_BATCH) {
+            virtio_balloon_report_complete(vq, &range, batch, count);
+            count = 0;
+            notify = true;
+        }
+    }
+
+    if (count) {
+        virtio_balloon_report_complete(vq, &range, batch, count);
+        notify = true;
+    }
+    if (notify) {
         virtio_notify(vdev, vq);
-        g_free(elem);
     }
 }
 
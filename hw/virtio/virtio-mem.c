@@ -397,10 +397,49 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
             return -EBUSY;
         }
         virtio_mem_notify_unplug(vmem, offset, size);
-    } else if (virtio_mem_notify_plug(vmem, offset, size)) {
-        /* Could be a mapping attempt resulted in memory getting populated. */
-        ram_block_discard_range(vmem->memdev->mr.ram_block, offset, size);
-        return -EBUSY;
+    } else {
+        int ret = 0;
+
+        if (vmem->prealloc) {
+            void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
+            int fd = memory_region_get_fd(&vmem->memdev->mr);
+            const unsigned long *nodes =
+                host_memory_backend_get_prealloc_nodes(vmem->memdev);
+            Error *local_err = NULL;
+
+            /*
+             * Populate the whole range of the request at once, so that the
+             * preallocation threads of the memory backend can work on it in
+             * parallel.
+             */
+            trace_virtio_mem_prealloc(start_gpa, size,
+                                      vmem->memdev->prealloc_threads);
+            os_mem_prealloc(fd, area, size, vmem->memdev->prealloc_threads,
+                            nodes, MAX_NODES, &local_err);
+            if (local_err) {
+                static bool warned;
+
+                /*
+                 * Warn only once, we don't want to fill the log with these
+                 * warnings.
+                 */
+                if (!warned) {
+                    warn_report_err(local_err);
+                    warned = true;
+                } else {
+                    error_free(local_err);
+                }
+                ret = -EBUSY;
+            }
+        }
+        if (!ret) {
+            ret = virtio_mem_notify_plug(vmem, offset, size);
+        }
+        if (ret) {
+            /* Could be preallocation or a notifier populated memory. */
+            ram_block_discard_range(vmem->memdev->mr.ram_block, offset, size);
+            return -EBUSY;
+        }
     }
     virtio_mem_set_bitmap(vmem, start_gpa, size, plug);
     return 0;
@@ -681,6 +720,13 @@ static void virtio_mem_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (vmem->prealloc && vmem->memdev->prealloc) {
+        warn_report("'%s' property is set, but memdev '%s' is preallocated "
+                    "already; memory will be discarded and preallocated again "
+                    "when plugged", VIRTIO_MEM_PREALLOC_PROP,
+                    object_get_canonical_path_component(OBJECT(vmem->memdev)));
+    }
+
     rb = vmem->memdev->mr.ram_block;
     page_size = qemu_ram_pagesize(rb);
 
@@ -1111,6 +1157,7 @@ static Property virtio_mem_properties[] = {
     DEFINE_PROP_UINT32(VIRTIO_MEM_NODE_PROP, VirtIOMEM, node, 0),
     DEFINE_PROP_LINK(VIRTIO_MEM_MEMDEV_PROP, VirtIOMEM, memdev,
                      TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_BOOL(VIRTIO_MEM_PREALLOC_PROP, VirtIOMEM, prealloc, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -131,6 +131,18 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /* Interrupt coalescing, see virtio_queue_set_notify_coalescing() */
+    QEMUTimer *notify_timer;
+    uint32_t notify_coalesce_usecs;
+    uint32_t notify_coalesce_frames;
+    uint32_t notify_pending;
+
+    /* Free elements, see virtio_queue_enable_element_pool() */
+    void **elem_pool;
+    unsigned int elem_pool_count;
+    size_t elem_pool_sz;        /* device request size the pool serves */
+    size_t elem_pool_block;     /* allocation size of each pooled element */
 };
 
 /* Called within call_rcu().  */
@@ -528,12 +540,13 @@ static void vring_packed_desc_read(VirtIODevice *vdev,
         smp_rmb();
     }
 
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, addr),
-                              &desc->addr, sizeof(desc->addr));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, id),
-                              &desc->id, sizeof(desc->id));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, len),
-                              &desc->len, sizeof(desc->len));
+    /* addr, len and id are contiguous and precede flags: read them at once */
+    QEMU_BUILD_BUG_ON(offsetof(VRingPackedDesc, addr) != 0 ||
+                      offsetof(VRingPackedDesc, len) != 8 ||
+                      offsetof(VRingPackedDesc, id) != 12 ||
+                      offsetof(VRingPackedDesc, flags) != 14);
+    address_space_read_cached(cache, off, desc,
+                              offsetof(VRingPackedDesc, flags));
     virtio_tswap64s(vdev, &desc->addr);
     virtio_tswap16s(vdev, &desc->id);
     virtio_tswap32s(vdev, &desc->len);
@@ -544,17 +557,15 @@ static void vring_packed_desc_write_data(VirtIODevice *vdev,
                                          MemoryRegionCache *cache,
                                          int i)
 {
-    hwaddr off_id = i * sizeof(VRingPackedDesc) +
-                    offsetof(VRingPackedDesc, id);
-    hwaddr off_len = i * sizeof(VRingPackedDesc) +
-                    offsetof(VRingPackedDesc, len);
+    /* len and id are contiguous, see vring_packed_desc_read() */
+    hwaddr off = i * sizeof(VRingPackedDesc) + offsetof(VRingPackedDesc, len);
+    hwaddr size = offsetof(VRingPackedDesc, flags) -
+                  offsetof(VRingPackedDesc, len);
 
     virtio_tswap32s(vdev, &desc->len);
     virtio_tswap16s(vdev, &desc->id);
-    address_space_write_cached(cache, off_id, &desc->id, sizeof(desc->id));
-    address_space_cache_invalidate(cache, off_id, sizeof(desc->id));
-    address_space_write_cached(cache, off_len, &desc->len, sizeof(desc->len));
-    address_space_cache_invalidate(cache, off_len, sizeof(desc->len));
+    address_space_write_cached(cache, off, &desc->len, size);
+    address_space_cache_invalidate(cache, off, size);
 }
 
 static void vring_packed_desc_write_flags(VirtIODevice *vdev,
@@ -1382,7 +1393,8 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
                                                                         false);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+static size_t virtqueue_element_size(size_t sz, unsigned out_num,
+                                     unsigned in_num)
 {
     VirtQueueElement *elem;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
@@ -1390,11 +1402,37 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
     size_t in_sg_ofs = QEMU_ALIGN_UP(out_addr_end, __alignof__(elem->in_sg[0]));
     size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
-    size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
+
+    return out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
+}
+
+/*
+ * Elements of devices that opted in with virtio_queue_enable_element_pool()
+ * come from @vq's pool when they are small enough.  @vq may be NULL.
+ */
+static void *virtqueue_alloc_element(VirtQueue *vq, size_t sz,
+                                     unsigned out_num, unsigned in_num)
+{
+    VirtQueueElement *elem;
+    size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
+    size_t out_addr_ofs = in_addr_ofs + in_num * sizeof(elem->in_addr[0]);
+    size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
+    size_t in_sg_ofs = QEMU_ALIGN_UP(out_addr_end, __alignof__(elem->in_sg[0]));
+    size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
+    size_t out_sg_end = virtqueue_element_size(sz, out_num, in_num);
+    bool pooled = vq && vq->elem_pool && sz == vq->elem_pool_sz &&
+                  out_sg_end <= vq->elem_pool_block;
 
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    if (pooled && vq->elem_pool_count) {
+        elem = vq->elem_pool[--vq->elem_pool_count];
+    } else if (pooled) {
+        elem = g_malloc(vq->elem_pool_block);
+    } else {
+        elem = g_malloc(out_sg_end);
+    }
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
+    elem->pooled = pooled;
     elem->out_num = out_num;
     elem->in_num = in_num;
     elem->in_addr = (void *)elem + in_addr_ofs;
@@ -1404,7 +1442,14 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/*
+ * Pop the element at vq->last_avail_idx.  The caller has checked that the
+ * guest made it available and issued the matching smp_rmb().  Updating the
+ * avail event is left to the caller as well.
+ *
+ * Called within rcu_read_lock().
+ */
+static void *virtqueue_split_pop_rcu(VirtQueue *vq, size_t sz)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -1419,14 +1464,6 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     VRingDesc desc;
     int rc;
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
@@ -1441,10 +1478,6 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
     caches = vring_get_region_caches(vq);
@@ -1516,7 +1549,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     elem->index = head;
     elem->ndescs = 1;
     for (i = 0; i < out_num; i++) {
@@ -1541,6 +1574,62 @@ err_undo_map:
     goto done;
 }
 
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+{
+    VirtQueueElement *elem;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_empty_rcu(vq)) {
+        return NULL;
+    }
+    /* Needed after virtio_queue_empty(), see comment in
+     * virtqueue_num_heads(). */
+    smp_rmb();
+
+    elem = virtqueue_split_pop_rcu(vq, sz);
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return elem;
+}
+
+/*
+ * Pop up to @max elements with a single read of the avail index and a
+ * single avail event update.
+ */
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
+{
+    unsigned int n = 0;
+    int num_heads;
+
+    RCU_READ_LOCK_GUARD();
+    if (unlikely(!vq->vring.avail)) {
+        return 0;
+    }
+
+    /* Also issues the smp_rmb() needed before reading the descriptors */
+    num_heads = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (num_heads <= 0) {
+        return 0;
+    }
+
+    while (n < MIN((unsigned int)num_heads, max)) {
+        void *elem = virtqueue_split_pop_rcu(vq, sz);
+
+        if (!elem) {
+            break;
+        }
+        elems[n++] = elem;
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return n;
+}
+
 static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 {
     unsigned int i, max;
@@ -1642,7 +1731,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1689,6 +1778,81 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 }
 
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int n = 0;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
+    }
+
+    while (n < max) {
+        void *elem = virtqueue_packed_pop(vq, sz);
+
+        if (!elem) {
+            break;
+        }
+        elems[n++] = elem;
+    }
+    return n;
+}
+
+/**
+ * virtqueue_element_free:
+ * @vq: the virtqueue @elem was popped from
+ * @elem: the element, as returned by virtqueue_pop()
+ *
+ * Release an element.  Devices that use virtio_queue_enable_element_pool()
+ * must free their elements with this function instead of g_free(), under
+ * the same locking as virtqueue_pop().
+ */
+void virtqueue_element_free(VirtQueue *vq, void *elem)
+{
+    VirtQueueElement *e = elem;
+
+    if (e && e->pooled && vq->elem_pool &&
+        vq->elem_pool_count < vq->vring.num) {
+        vq->elem_pool[vq->elem_pool_count++] = elem;
+        return;
+    }
+    g_free(elem);
+}
+
+/**
+ * virtio_queue_enable_element_pool:
+ * @vq: the virtqueue
+ * @sz: size of the device request structure passed to virtqueue_pop()
+ * @max_sg: number of in plus out scatter-gather entries that pooled
+ *          elements have room for
+ *
+ * Recycle elements popped from @vq instead of allocating a new one for
+ * every request.  Requests with more than @max_sg segments still get an
+ * element of their own.  Up to one element per ring entry is kept.
+ */
+void virtio_queue_enable_element_pool(VirtQueue *vq, size_t sz,
+                                      unsigned int max_sg)
+{
+    assert(!vq->elem_pool);
+    vq->elem_pool = g_new(void *, VIRTQUEUE_MAX_SIZE);
+    vq->elem_pool_count = 0;
+    vq->elem_pool_sz = sz;
+    vq->elem_pool_block = virtqueue_element_size(sz, max_sg, 0);
+}
+
+static void virtio_queue_free_element_pool(VirtQueue *vq)
+{
+    while (vq->elem_pool_count) {
+        g_free(vq->elem_pool[--vq->elem_pool_count]);
+    }
+    g_free(vq->elem_pool);
+    vq->elem_pool = NULL;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -1824,7 +1988,7 @@ void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz)
     assert(ARRAY_SIZE(data.in_addr) >= data.in_num);
     assert(ARRAY_SIZE(data.out_addr) >= data.out_num);
 
-    elem = virtqueue_alloc_element(sz, data.out_num, data.in_num);
+    elem = virtqueue_alloc_element(NULL, sz, data.out_num, data.in_num);
     elem->index = data.index;
 
     for (i = 0; i < elem->in_num; i++) {
@@ -2021,6 +2185,10 @@ void virtio_reset(void *opaque)
         vdev->vq[i].notification = true;
         vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
         vdev->vq[i].inuse = 0;
+        if (vdev->vq[i].notify_timer) {
+            timer_del(vdev->vq[i].notify_timer);
+        }
+        vdev->vq[i].notify_pending = 0;
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
 }
@@ -2407,6 +2575,9 @@ VirtQueue *virtio_add_queue(VirtIODevice *vdev, int queue_size,
     vdev->vq[i].handle_aio_output = NULL;
     vdev->vq[i].used_elems = g_malloc0(sizeof(VirtQueueElement) *
                                        queue_size);
+    virtio_queue_set_notify_coalescing(&vdev->vq[i],
+                                       vdev->notify_coalesce_usecs,
+                                       vdev->notify_coalesce_frames);
 
     return &vdev->vq[i];
 }
@@ -2419,6 +2590,12 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_aio_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    if (vq->notify_timer) {
+        timer_free(vq->notify_timer);
+        vq->notify_timer = NULL;
+    }
+    vq->notify_pending = 0;
+    virtio_queue_free_element_pool(vq);
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -2555,6 +2732,47 @@ static void virtio_irq(VirtQueue *vq)
     virtio_notify_vector(vq->vdev, vq->vector);
 }
 
+static void virtio_queue_notify_timer_cb(void *opaque)
+{
+    VirtQueue *vq = opaque;
+
+    trace_virtio_notify_coalesced(vq->vdev, vq, vq->notify_pending);
+    vq->notify_pending = 0;
+    virtio_irq(vq);
+}
+
+/**
+ * virtio_queue_set_notify_coalescing:
+ * @vq: the virtqueue
+ * @usecs: maximum time an interrupt is delayed, 0 disables coalescing
+ * @frames: inject the interrupt as soon as this many notifications are
+ *          pending; 0 means only @usecs applies
+ *
+ * Coalesce the interrupts that virtio_notify() raises for @vq.  Only
+ * notifications issued under the BQL are coalesced; virtio_notify_irqfd()
+ * is left alone, since dataplane devices batch their notifications in a
+ * bottom half already.
+ */
+void virtio_queue_set_notify_coalescing(VirtQueue *vq, uint32_t usecs,
+                                        uint32_t frames)
+{
+    if (vq->notify_timer) {
+        if (vq->notify_pending) {
+            virtio_queue_notify_timer_cb(vq);
+        }
+        timer_free(vq->notify_timer);
+        vq->notify_timer = NULL;
+    }
+
+    vq->notify_coalesce_usecs = usecs;
+    vq->notify_coalesce_frames = frames;
+    vq->notify_pending = 0;
+    if (usecs) {
+        vq->notify_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                        virtio_queue_notify_timer_cb, vq);
+    }
+}
+
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
     WITH_RCU_READ_LOCK_GUARD() {
@@ -2564,6 +2782,26 @@ void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
     }
 
     trace_virtio_notify(vdev, vq);
+    /*
+     * While the VM is stopped the virtual clock does not run, and requests
+     * completed by bdrv_drain_all() in do_vm_stop() would otherwise leave
+     * interrupts pending that are neither delivered nor migrated.
+     */
+    if (vq->notify_timer && vdev->vm_running &&
+        qemu_mutex_iothread_locked()) {
+        vq->notify_pending++;
+        if (!vq->notify_coalesce_frames ||
+            vq->notify_pending < vq->notify_coalesce_frames) {
+            if (!timer_pending(vq->notify_timer)) {
+                timer_mod(vq->notify_timer,
+                          qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                          vq->notify_coalesce_usecs * SCALE_US);
+            }
+            return;
+        }
+        timer_del(vq->notify_timer);
+        vq->notify_pending = 0;
+    }
     virtio_irq(vq);
 }
 
@@ -3209,8 +3447,23 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
     bool backend_run = running && virtio_device_started(vdev, vdev->status);
+    int i;
+
     vdev->vm_running = running;
 
+    /*
+     * The virtual clock stops with the VM; deliver coalesced interrupts now
+     * so that they are not lost if the VM is migrated.
+     */
+    for (i = 0; !running && i < VIRTIO_QUEUE_MAX; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+
+        if (vq->notify_timer && vq->notify_pending) {
+            timer_del(vq->notify_timer);
+            virtio_queue_notify_timer_cb(vq);
+        }
+    }
+
     if (backend_run) {
         virtio_set_status(vdev, vdev->status);
     }
@@ -3719,6 +3972,10 @@ static Property virtio_properties[] = {
     DEFINE_PROP_BOOL("use-disabled-flag", VirtIODevice, use_disabled_flag, true),
     DEFINE_PROP_BOOL("x-disable-legacy-check", VirtIODevice,
                      disable_legacy_check, false),
+    DEFINE_PROP_UINT32("x-notify-coalesce-usecs", VirtIODevice,
+                       notify_coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("x-notify-coalesce-frames", VirtIODevice,
+                       notify_coalesce_frames, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-builtin-types.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -93,6 +94,25 @@ struct BlockAcctStats {
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
 };
 
+/*
+ * Per-node latency histogram with fixed log-linear bins: below
+ * 2^BLOCK_NODE_LATENCY_MIN_SHIFT ns everything falls in the first bin,
+ * each power of two up to 2^BLOCK_NODE_LATENCY_MAX_SHIFT ns is split into
+ * 2^BLOCK_NODE_LATENCY_SUB_BITS linear bins, and everything slower lands
+ * in the last bin.  The bins need no configuration, so they are always
+ * collected for every BlockDriverState.
+ */
+#define BLOCK_NODE_LATENCY_MIN_SHIFT    10  /* ~1 us */
+#define BLOCK_NODE_LATENCY_MAX_SHIFT    34  /* ~17 s */
+#define BLOCK_NODE_LATENCY_SUB_BITS     2
+#define BLOCK_NODE_LATENCY_BINS \
+    (((BLOCK_NODE_LATENCY_MAX_SHIFT - BLOCK_NODE_LATENCY_MIN_SHIFT) << \
+      BLOCK_NODE_LATENCY_SUB_BITS) + 2)
+
+typedef struct BlockNodeLatencyStats {
+    Stat64 bins[BLOCK_MAX_IOTYPE][BLOCK_NODE_LATENCY_BINS];
+} BlockNodeLatencyStats;
+
 typedef struct BlockAcctCookie {
     int64_t bytes;
     int64_t start_time_ns;
@@ -119,5 +139,9 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+int64_t block_node_latency_start(void);
+void block_node_latency_done(BlockNodeLatencyStats *stats,
+                             enum BlockAcctType type, int64_t start_ns);
+uint64_t block_node_latency_boundary(unsigned bin);
 
 #endif
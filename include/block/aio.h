@@ -20,6 +20,7 @@
 #include "qemu/coroutine.h"
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
 
@@ -232,6 +233,14 @@ struct AioContext {
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
 
+    /*
+     * Polling statistics, updated by the event loop thread and read by
+     * query-iothreads.
+     */
+    Stat64 poll_hits;       /* polling rounds that found work */
+    Stat64 poll_misses;     /* polling rounds that ran out of time */
+    Stat64 poll_time_ns;    /* total time spent polling */
+
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
 
@@ -767,4 +776,16 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp);
 
+/**
+ * aio_context_register_stats:
+ * @ctx: the aio context
+ * @name: instance name under which the counters of @ctx are published
+ *
+ * Make the polling counters of @ctx visible through query-stats.  They
+ * must be unregistered with aio_context_unregister_stats() before @ctx
+ * is freed.
+ */
+void aio_context_register_stats(AioContext *ctx, const char *name);
+void aio_context_unregister_stats(const char *name);
+
 #endif
@@ -44,6 +44,9 @@ int aio_task_pool_status(AioTaskPool *pool);
 
 bool aio_task_pool_empty(AioTaskPool *pool);
 
+/* number of tasks started and not yet finished */
+int aio_task_pool_busy_tasks(AioTaskPool *pool);
+
 /* User provides filled @task, however task->pool will be set automatically */
 void coroutine_fn aio_task_pool_start_task(AioTaskPool *pool, AioTask *task);
 
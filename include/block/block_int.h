@@ -338,6 +338,15 @@ struct BlockDriver {
                                               BdrvRequestFlags read_flags,
                                               BdrvRequestFlags write_flags);
 
+    /*
+     * Return a file descriptor from which the guest visible data of @bs
+     * can be read with plain (buffered) read system calls at the same
+     * offsets, or -errno if there is none.  The descriptor is only valid
+     * as long as the node stays in use by a request, i.e. the caller must
+     * keep the node from being drained while it uses the descriptor.
+     */
+    int (*bdrv_get_read_fd)(BlockDriverState *bs);
+
     /*
      * Building block for bdrv_block_status[_above] and
      * bdrv_is_allocated[_above].  The driver should answer only
@@ -1008,6 +1017,9 @@ struct BlockDriverState {
     /* Offset after the highest byte written to */
     Stat64 wr_highest_offset;
 
+    /* Latency of the requests handled by this node, see query-block-latency */
+    BlockNodeLatencyStats latency_stats;
+
     /* If true, copy read backing sectors into image.  Can be >1 if more
      * than one client has requested copy-on-read.  Accessed with atomic
      * ops.
@@ -58,9 +58,10 @@ typedef struct NBDOptionReplyMetaContext {
 struct NBDRequest {
     uint64_t handle;
     uint64_t from;
-    uint32_t len;
+    uint64_t len; /* limited to 32 bits without extended headers */
     uint16_t flags; /* NBD_CMD_FLAG_* */
     uint16_t type; /* NBD_CMD_* */
+    bool extended; /* sent with an extended request header */
 };
 typedef struct NBDRequest NBDRequest;
 
@@ -79,6 +80,21 @@ typedef struct NBDStructuredReplyChunk {
     uint32_t length; /* length of payload */
 } QEMU_PACKED NBDStructuredReplyChunk;
 
+/*
+ * Header of all replies once extended headers are negotiated.  On the
+ * receiving side, the client converts it to a NBDStructuredReplyChunk
+ * (keeping NBD_EXTENDED_REPLY_MAGIC), since payloads of the replies it
+ * expects always fit in 32 bits.
+ */
+typedef struct NBDExtendedReplyChunk {
+    uint32_t magic;  /* NBD_EXTENDED_REPLY_MAGIC */
+    uint16_t flags;  /* combination of NBD_REPLY_FLAG_* */
+    uint16_t type;   /* NBD_REPLY_TYPE_* */
+    uint64_t handle; /* request handle */
+    uint64_t offset; /* request offset */
+    uint64_t length; /* length of payload */
+} QEMU_PACKED NBDExtendedReplyChunk;
+
 typedef union NBDReply {
     NBDSimpleReply simple;
     NBDStructuredReplyChunk structured;
@@ -93,39 +109,57 @@ typedef union NBDReply {
     } QEMU_PACKED;
 } NBDReply;
 
-/* Header of chunk for NBD_REPLY_TYPE_OFFSET_DATA */
+/*
+ * The following are the payloads of the structured reply chunks, which
+ * follow either a NBDStructuredReplyChunk or a NBDExtendedReplyChunk.
+ */
+
+/* Header of payload for NBD_REPLY_TYPE_OFFSET_DATA */
 typedef struct NBDStructuredReadData {
-    NBDStructuredReplyChunk h; /* h.length >= 9 */
+    /* header's .length >= 9 */
     uint64_t offset;
-    /* At least one byte of data payload follows, calculated from h.length */
+    /* At least one byte of data payload follows, calculated from length */
 } QEMU_PACKED NBDStructuredReadData;
 
-/* Complete chunk for NBD_REPLY_TYPE_OFFSET_HOLE */
+/* Complete payload for NBD_REPLY_TYPE_OFFSET_HOLE */
 typedef struct NBDStructuredReadHole {
-    NBDStructuredReplyChunk h; /* h.length == 12 */
+    /* header's .length == 12 */
     uint64_t offset;
     uint32_t length;
 } QEMU_PACKED NBDStructuredReadHole;
 
-/* Header of all NBD_REPLY_TYPE_ERROR* errors */
+/* Header of payload for all NBD_REPLY_TYPE_ERROR* errors */
 typedef struct NBDStructuredError {
-    NBDStructuredReplyChunk h; /* h.length >= 6 */
+    /* header's .length >= 6 */
     uint32_t error;
     uint16_t message_length;
 } QEMU_PACKED NBDStructuredError;
 
-/* Header of NBD_REPLY_TYPE_BLOCK_STATUS */
+/* Header of payload for NBD_REPLY_TYPE_BLOCK_STATUS */
 typedef struct NBDStructuredMeta {
-    NBDStructuredReplyChunk h; /* h.length >= 12 (at least one extent) */
+    /* header's .length >= 12 (at least one extent) */
     uint32_t context_id;
-    /* extents follows */
+    /* NBDExtent32 extents follow */
 } QEMU_PACKED NBDStructuredMeta;
 
-/* Extent chunk for NBD_REPLY_TYPE_BLOCK_STATUS */
-typedef struct NBDExtent {
+/* Header of payload for NBD_REPLY_TYPE_BLOCK_STATUS_EXT */
+typedef struct NBDExtendedMeta {
+    /* header's .length >= 24 (at least one extent) */
+    uint32_t context_id;
+    uint32_t count; /* number of NBDExtent64 extents that follow */
+} QEMU_PACKED NBDExtendedMeta;
+
+/* Extent array element for NBD_REPLY_TYPE_BLOCK_STATUS */
+typedef struct NBDExtent32 {
     uint32_t length;
     uint32_t flags; /* NBD_STATE_* */
-} QEMU_PACKED NBDExtent;
+} QEMU_PACKED NBDExtent32;
+
+/* Extent array element for NBD_REPLY_TYPE_BLOCK_STATUS_EXT */
+typedef struct NBDExtent64 {
+    uint64_t length;
+    uint64_t flags; /* NBD_STATE_* */
+} QEMU_PACKED NBDExtent64;
 
 /* Transmission (export) flags: sent from server to client during handshake,
    but describe what will happen during transmission */
@@ -179,6 +213,7 @@ enum {
 #define NBD_OPT_STRUCTURED_REPLY  (8)
 #define NBD_OPT_LIST_META_CONTEXT (9)
 #define NBD_OPT_SET_META_CONTEXT  (10)
+#define NBD_OPT_EXTENDED_HEADERS  (11)
 
 /* Option reply types. */
 #define NBD_REP_ERR(value) ((UINT32_C(1) << 31) | (value))
@@ -235,9 +270,10 @@ enum {
  */
 #define NBD_MAX_STRING_SIZE 4096
 
-/* Two types of reply structures */
+/* Three types of reply structures */
 #define NBD_SIMPLE_REPLY_MAGIC      0x67446698
 #define NBD_STRUCTURED_REPLY_MAGIC  0x668e33ef
+#define NBD_EXTENDED_REPLY_MAGIC    0x6e8a278c
 
 /* Structured reply flags */
 #define NBD_REPLY_FLAG_DONE          (1 << 0) /* This reply-chunk is last */
@@ -249,6 +285,7 @@ enum {
 #define NBD_REPLY_TYPE_OFFSET_DATA   1
 #define NBD_REPLY_TYPE_OFFSET_HOLE   2
 #define NBD_REPLY_TYPE_BLOCK_STATUS  5
+#define NBD_REPLY_TYPE_BLOCK_STATUS_EXT 6
 #define NBD_REPLY_TYPE_ERROR         NBD_REPLY_ERR(1)
 #define NBD_REPLY_TYPE_ERROR_OFFSET  NBD_REPLY_ERR(2)
 
@@ -293,6 +330,7 @@ struct NBDExportInfo {
     /* In-out fields, set by client before nbd_receive_negotiate() and
      * updated by server results during nbd_receive_negotiate() */
     bool structured_reply;
+    bool extended_headers; /* implies structured_reply */
     bool base_allocation; /* base:allocation context for NBD_CMD_BLOCK_STATUS */
 
     /* Set by server results during nbd_receive_negotiate() and
@@ -396,7 +434,13 @@ static inline bool nbd_reply_is_simple(NBDReply *reply)
 
 static inline bool nbd_reply_is_structured(NBDReply *reply)
 {
-    return reply->magic == NBD_STRUCTURED_REPLY_MAGIC;
+    return reply->magic == NBD_STRUCTURED_REPLY_MAGIC ||
+           reply->magic == NBD_EXTENDED_REPLY_MAGIC;
+}
+
+static inline bool nbd_reply_is_extended(NBDReply *reply)
+{
+    return reply->magic == NBD_EXTENDED_REPLY_MAGIC;
 }
 
 const char *nbd_reply_type_lookup(uint16_t type);
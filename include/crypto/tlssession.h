@@ -321,4 +321,35 @@ int qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
  */
 char *qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess);
 
+/**
+ * qcrypto_tls_session_enable_ktls_tx:
+ * @sess: the TLS session object
+ * @fd: the TCP socket carrying the session
+ *
+ * If the credentials have the "ktls" property set, try to
+ * hand the transmit direction of an established session
+ * over to the kernel TLS implementation, by installing the
+ * negotiated keys on @fd.  Only AES-GCM cipher suites with
+ * TLS 1.2 or 1.3 are supported.
+ *
+ * On success, data to be sent must be written to @fd
+ * directly instead of going through
+ * qcrypto_tls_session_write(), while received data must
+ * still be read with qcrypto_tls_session_read().
+ *
+ * Returns: 0 if the kernel is now encrypting outgoing
+ * data, -1 if the session must keep doing it in userspace
+ */
+int qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *sess,
+                                       int fd);
+
+/**
+ * qcrypto_tls_session_has_ktls_tx:
+ * @sess: the TLS session object
+ *
+ * Returns: true if qcrypto_tls_session_enable_ktls_tx()
+ * succeeded on @sess
+ */
+bool qcrypto_tls_session_has_ktls_tx(QCryptoTLSSession *sess);
+
 #endif /* QCRYPTO_TLSSESSION_H */
@@ -432,6 +432,7 @@ static inline bool tlb_hit(target_ulong tlb_addr, target_ulong addr)
 void dump_drift_info(void);
 /* accel/tcg/translate-all.c */
 void dump_exec_info(void);
+void dump_tb_hot_info(int count);
 void dump_opcount_info(void);
 #endif /* CONFIG_TCG */
 
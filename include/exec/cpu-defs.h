@@ -78,6 +78,8 @@ typedef uint64_t target_ulong;
 
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
+/* number of large pages remembered for each mmu_idx */
+#define CPU_TLB_LARGE_PAGES 4
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -150,6 +152,20 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A guest mapping larger than TARGET_PAGE_SIZE, as returned by tlb_fill.
+ * A miss on another page of the mapping is filled from it without
+ * walking the guest page tables again.  The entry is unused if
+ * (vaddr & mask) != vaddr.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong vaddr;
+    target_ulong mask;
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -163,6 +179,12 @@ typedef struct CPUTLBDesc {
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /*
+     * The large pages filled since the last flush, all within the
+     * region above, and the next one to replace.
+     */
+    CPUTLBLargePage large_pages[CPU_TLB_LARGE_PAGES];
+    size_t large_page_index;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -208,6 +230,16 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Flushes requested by other threads.  They are queued without
+     * taking the lock and performed in one go by the owning vCPU.
+     * pending_full has the mmu_idx to flush entirely, pending_ranges
+     * the page and range flushes, and pending_queued is set while a
+     * work item to process them is scheduled.
+     */
+    uint16_t pending_full;
+    bool pending_queued;
+    QSLIST_HEAD(, TLBPendingFlush) pending_ranges;
 } CPUTLBCommon;
 
 /*
@@ -559,8 +559,19 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Number of times the TB was entered, including through chained
+     * jumps.  Only updated when tb_exec_count_enabled is set, by the
+     * generated code and without atomics, so it is approximate with
+     * MTTCG.
+     */
+    uint64_t exec_count;
 };
 
+/* Set by "-accel tcg,tb-exec-count=on" */
+extern bool tb_exec_count_enabled;
+
 /* Hide the qatomic_read to make code a little easier on the eyes */
 static inline uint32_t tb_cflags(const TranslationBlock *tb)
 {
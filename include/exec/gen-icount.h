@@ -61,6 +61,17 @@ static inline void gen_tb_start(const TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    if (tb_exec_count_enabled) {
+        TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+        TCGv_i64 n = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(n, ptr, 0);
+        tcg_gen_addi_i64(n, n, 1);
+        tcg_gen_st_i64(n, ptr, 0);
+        tcg_temp_free_i64(n);
+        tcg_temp_free_ptr(ptr);
+    }
 }
 
 static inline void gen_tb_end(const TranslationBlock *tb, int num_insns)
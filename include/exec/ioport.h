@@ -70,6 +70,8 @@ void portio_list_destroy(PortioList *piolist);
 void portio_list_add(PortioList *piolist,
                      struct MemoryRegion *address_space,
                      uint32_t addr);
+void portio_list_add_coalescing(PortioList *piolist, uint32_t addr,
+                                uint32_t len);
 void portio_list_del(PortioList *piolist);
 
 #endif /* IOPORT_H */
@@ -27,6 +27,7 @@
 #include "qemu/notify.h"
 #include "qom/object.h"
 #include "qemu/rcu.h"
+#include "qemu/stats64.h"
 
 #define RAM_ADDR_INVALID (~(ram_addr_t)0)
 
@@ -232,6 +233,19 @@ typedef struct IOMMUTLBEvent {
 /* RAM that isn't accessible through normal means. */
 #define RAM_PROTECTED (1 << 8)
 
+/*
+ * Do not advise the host to use transparent huge pages for the RAM,
+ * leaving it to the system-wide policy or to the owner of the RAM.
+ */
+#define RAM_NO_THP_ADVICE (1 << 9)
+
+/*
+ * Open the backing file read-only, but map it private and writable: guest
+ * writes end up in anonymous copy-on-write pages and never reach the file.
+ * Incompatible with RAM_SHARED.
+ */
+#define RAM_READONLY_FD (1 << 10)
+
 static inline void iommu_notifier_init(IOMMUNotifier *n, IOMMUNotify fn,
                                        IOMMUNotifierFlag flags,
                                        hwaddr start, hwaddr end,
@@ -779,6 +793,11 @@ struct MemoryRegion {
     unsigned ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
     RamDiscardManager *rdm; /* Only for RAM */
+
+    /* Updated by memory_region_dispatch_*() if MMIO stats are enabled */
+    Stat64 mmio_reads;
+    Stat64 mmio_writes;
+    Stat64 mmio_time_ns;
 };
 
 struct IOMMUMemoryRegion {
@@ -1304,7 +1323,7 @@ void memory_region_init_resizeable_ram(MemoryRegion *mr,
  * @align: alignment of the region base address; if 0, the default alignment
  *         (getpagesize()) will be used.
  * @ram_flags: RamBlock flags. Supported flags: RAM_SHARED, RAM_PMEM,
- *             RAM_NORESERVE,
+ *             RAM_NORESERVE, RAM_READONLY_FD.
  * @path: the path in which to allocate the RAM.
  * @readonly: true to open @path for reading, false for read/write.
  * @errp: pointer to Error*, to store an error if it happens.
@@ -2460,6 +2479,33 @@ void memory_global_dirty_log_stop(void);
 
 void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled);
 
+/**
+ * mmio_stats_enable: start counting the accesses dispatched to each
+ * MemoryRegion, and the time spent handling them
+ */
+void mmio_stats_enable(void);
+
+/**
+ * mmio_stats_disable: stop counting MemoryRegion accesses
+ */
+void mmio_stats_disable(void);
+
+/**
+ * mmio_stats_is_enabled: return whether MemoryRegion accesses are counted
+ */
+bool mmio_stats_is_enabled(void);
+
+/**
+ * mmio_stats_reset: clear the counters of all regions in the memory tree
+ */
+void mmio_stats_reset(void);
+
+/**
+ * mmio_stats_info: print the @max regions of the memory tree that took
+ * the most time handling accesses
+ */
+void mmio_stats_info(int64_t max);
+
 /**
  * memory_region_dispatch_read: perform a read directly to the specified
  * MemoryRegion.
@@ -69,6 +69,16 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * With mapped-ram the pages of the block are stored at fixed offsets
+     * of the migration file.  file_bmap tracks which of them are present
+     * in the file (zero pages are not written), bitmap_offset is where
+     * file_bmap is stored and pages_offset is where page 0 is stored.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    off_t pages_offset;
 };
 #endif
 #endif
@@ -218,6 +218,7 @@ typedef struct SavedIOTLB {
 #endif
 
 struct KVMState;
+struct KVMExitStats;
 struct kvm_run;
 
 struct hax_vcpu_state;
@@ -226,6 +227,16 @@ struct hvf_vcpu_state;
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/*
+ * An entry of the TB jump cache is only valid while @gen matches the
+ * tb_jmp_cache_gen of its CPU, so that clearing the whole cache only
+ * needs to bump the generation.
+ */
+typedef struct TBJmpCacheEntry {
+    TranslationBlock *tb;
+    uint32_t gen;
+} TBJmpCacheEntry;
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -304,6 +315,9 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @kvm_exit_stats: Exit statistics of this vCPU, published by query-stats.
+ * @dirty_pages: Number of pages this CPU dirtied, as collected from its KVM
+ *    dirty ring.
  *
  * State of one CPU core or thread.
  */
@@ -355,7 +369,9 @@ struct CPUState {
     IcountDecr *icount_decr_ptr;
 
     /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    TBJmpCacheEntry tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Only changed from the vCPU thread or with all vCPUs stopped */
+    uint32_t tb_jmp_cache_gen;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -381,6 +397,8 @@ struct CPUState {
     struct kvm_run *kvm_run;
     struct kvm_dirty_gfn *kvm_dirty_gfns;
     uint32_t kvm_fetch_index;
+    struct KVMExitStats *kvm_exit_stats;
+    uint64_t dirty_pages;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -409,6 +427,8 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Throttle percentage for this vcpu only, see cpu_throttle_set_vcpu() */
+    int throttle_percentage;
 
     bool ignore_memory_transaction_failures;
 
@@ -433,11 +453,42 @@ extern __thread CPUState *current_cpu;
 
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
+    uint32_t gen = cpu->tb_jmp_cache_gen + 1;
     unsigned int i;
 
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
+    /*
+     * Entries of older generations can only come back to life when the
+     * counter wraps around, so that is the only time they are cleared.
+     */
+    if (unlikely(gen == 0)) {
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            qatomic_set(&cpu->tb_jmp_cache[i].tb, NULL);
+        }
     }
+    qatomic_set(&cpu->tb_jmp_cache_gen, gen);
+}
+
+/* Returns the TB cached in entry @hash, NULL if there is none */
+static inline TranslationBlock *tb_jmp_cache_get(CPUState *cpu,
+                                                 unsigned int hash)
+{
+    TBJmpCacheEntry *e = &cpu->tb_jmp_cache[hash];
+    TranslationBlock *tb = qatomic_rcu_read(&e->tb);
+
+    if (qatomic_read(&e->gen) != qatomic_read(&cpu->tb_jmp_cache_gen)) {
+        return NULL;
+    }
+    return tb;
+}
+
+/* Must be called from the vCPU thread of @cpu */
+static inline void tb_jmp_cache_set(CPUState *cpu, unsigned int hash,
+                                    TranslationBlock *tb)
+{
+    TBJmpCacheEntry *e = &cpu->tb_jmp_cache[hash];
+
+    qatomic_set(&e->gen, cpu->tb_jmp_cache_gen);
+    qatomic_set(&e->tb, tb);
 }
 
 /**
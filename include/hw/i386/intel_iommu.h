@@ -95,6 +95,14 @@ struct VTDPASIDEntry {
     uint64_t val[8];
 };
 
+struct VTDIOTLBEntry {
+    uint64_t gfn;
+    uint16_t domain_id;
+    uint64_t slpte;
+    uint64_t mask;
+    uint8_t access_flags;
+};
+
 struct VTDAddressSpace {
     PCIBus *bus;
     uint8_t devfn;
@@ -105,6 +113,13 @@ struct VTDAddressSpace {
     MemoryRegion iommu_ir;      /* Interrupt region: 0xfeeXXXXX */
     IntelIOMMUState *iommu_state;
     VTDContextCacheEntry context_cache_entry;
+    /*
+     * Copy of the IOTLB entry used by the last translation of the
+     * device, valid while iotlb_last_gen == IntelIOMMUState.iotlb_gen
+     */
+    VTDIOTLBEntry iotlb_last;
+    uint16_t iotlb_last_sid;
+    uint64_t iotlb_last_gen;
     QLIST_ENTRY(VTDAddressSpace) next;
     /* Superset of notifier flags that this address space has */
     IOMMUNotifierFlag notifier_flags;
@@ -117,14 +132,6 @@ struct VTDBus {
     VTDAddressSpace *dev_as[];
 };
 
-struct VTDIOTLBEntry {
-    uint64_t gfn;
-    uint16_t domain_id;
-    uint64_t slpte;
-    uint64_t mask;
-    uint8_t access_flags;
-};
-
 /* VT-d Source-ID Qualifier types */
 enum {
     VTD_SQ_FULL = 0x00,     /* Full SID verification */
@@ -251,6 +258,7 @@ struct IntelIOMMUState {
 
     uint32_t context_cache_gen;     /* Should be in [1,MAX] */
     GHashTable *iotlb;              /* IOTLB */
+    uint64_t iotlb_gen;             /* Bumped when IOTLB entries go away */
 
     GHashTable *vtd_as_by_busptr;   /* VTDBus objects indexed by PCIBus* reference */
     VTDBus *vtd_as_by_bus_num[VTD_PCI_BUS_MAX]; /* VTDBus objects indexed by bus number */
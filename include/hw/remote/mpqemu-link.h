@@ -56,11 +56,17 @@ typedef struct {
     int len;
 } PciConfDataMsg;
 
+/*
+ * BarAccessMsg:
+ * @posted: for MPQEMU_CMD_BAR_WRITE only; the remote process does not send
+ *          a MPQEMU_CMD_RET reply, so the proxy need not wait for one.
+ */
 typedef struct {
     hwaddr addr;
     uint64_t val;
     unsigned size;
     bool memory;
+    bool posted;
 } BarAccessMsg;
 
 /**
@@ -94,6 +100,7 @@ bool mpqemu_msg_recv(MPQemuMsg *msg, QIOChannel *ioc, Error **errp);
 
 uint64_t mpqemu_msg_send_and_await_reply(MPQemuMsg *msg, PCIProxyDev *pdev,
                                          Error **errp);
+bool mpqemu_msg_send_posted(MPQemuMsg *msg, PCIProxyDev *pdev, Error **errp);
 bool mpqemu_msg_valid(MPQemuMsg *msg);
 
 #endif
@@ -66,6 +66,9 @@ typedef struct VFIOMigration {
     int vm_running;
     Notifier migration_state;
     uint64_t pending_bytes;
+    /* Bounce buffer for the parts of the data section that are not mmapped */
+    void *data_buffer;
+    uint64_t data_buffer_size;
 } VFIOMigration;
 
 typedef struct VFIOAddressSpace {
@@ -89,6 +92,9 @@ typedef struct VFIOContainer {
     bool dirty_pages_supported;
     uint64_t dirty_pgsizes;
     uint64_t max_dirty_bitmap_size;
+    /* Reused by every dirty bitmap query while logging is enabled */
+    void *dirty_bitmap;
+    uint64_t dirty_bitmap_size;
     unsigned long pgsizes;
     unsigned int dma_max_mappings;
     QLIST_HEAD(, VFIOGuestIOMMU) giommu_list;
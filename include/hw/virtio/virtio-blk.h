@@ -36,6 +36,8 @@ struct VirtIOBlkConf
 {
     BlockConf conf;
     IOThread *iothread;
+    char **iothread_vq_mapping;
+    uint32_t num_iothread_vq_mapping;
     char *serial;
     uint32_t request_merging;
     uint16_t num_queues;
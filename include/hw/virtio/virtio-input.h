@@ -64,6 +64,12 @@ struct VirtIOInput {
         VirtQueueElement *elem;
     }                                 *queue;
     uint32_t                          qindex, qsize;
+    uint32_t                          qsync; /* events up to the last sync */
+
+    /* reports are handed to the guest in batches, see virtio_input_send */
+    QEMUBH                            *flush_bh;
+    QEMUTimer                         *flush_timer;
+    uint32_t                          coalesce_ms;
 
     bool                              active;
 };
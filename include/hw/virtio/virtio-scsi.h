@@ -62,6 +62,8 @@ struct VirtIOSCSIConf {
     CharBackend chardev;
     uint32_t boot_tpgt;
     IOThread *iothread;
+    char **iothread_vq_mapping;
+    uint32_t num_iothread_vq_mapping;
 };
 
 struct VirtIOSCSI;
@@ -85,7 +87,25 @@ struct VirtIOSCSI {
     bool events_dropped;
 
     /* Fields for dataplane below */
-    AioContext *ctx; /* one iothread per virtio-scsi-pci for now */
+    AioContext *ctx; /* AioContext of the SCSI devices and control queues */
+
+    /*
+     * With iothread-vq-mapping, command queues are processed in these
+     * IOThreads; ctx is the AioContext of the first one.
+     */
+    IOThread **vq_iothreads;
+    uint32_t num_vq_iothreads;
+    AioContext **cmd_vq_ctx;        /* AioContext of each command queue */
+
+    /*
+     * Draining a SCSI device only disables external event handlers in ctx,
+     * so command queues in the other IOThreads are quiesced by hand.
+     */
+    unsigned drain_count;
+    unsigned cmd_handlers_running;
+
+    QEMUBH *notify_bh;              /* batched guest notification */
+    unsigned long *notify_vqs;
 
     bool dataplane_started;
     bool dataplane_starting;
@@ -104,6 +124,7 @@ typedef struct VirtIOSCSIReq {
     VirtIOSCSI *dev;
     VirtQueue *vq;
     QEMUSGList qsgl;
+    struct iovec resp_iov_storage[2];
     QEMUIOVector resp_iov;
 
     union {
@@ -160,6 +181,11 @@ void virtio_scsi_push_event(VirtIOSCSI *s, SCSIDevice *dev,
                             uint32_t event, uint32_t reason);
 
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp);
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s);
+void virtio_scsi_dataplane_notify(VirtIOSCSI *s, VirtQueue *vq);
+void virtio_scsi_dataplane_drained_begin(VirtIOSCSI *s);
+bool virtio_scsi_dataplane_drained_poll(VirtIOSCSI *s);
+void virtio_scsi_dataplane_drained_end(VirtIOSCSI *s);
 int virtio_scsi_dataplane_start(VirtIODevice *s);
 void virtio_scsi_dataplane_stop(VirtIODevice *s);
 
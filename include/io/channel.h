@@ -32,12 +32,16 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 
 #define QIO_CHANNEL_ERR_BLOCK -2
 
+#define QIO_CHANNEL_WRITE_FLAG_ZERO_COPY 0x1
+#define QIO_CHANNEL_WRITE_FLAG_MORE 0x2
+
 typedef enum QIOChannelFeature QIOChannelFeature;
 
 enum QIOChannelFeature {
     QIO_CHANNEL_FEATURE_FD_PASS,
     QIO_CHANNEL_FEATURE_SHUTDOWN,
     QIO_CHANNEL_FEATURE_LISTEN,
+    QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY,
 };
 
 
@@ -78,6 +82,10 @@ struct QIOChannel {
     AioContext *ctx;
     Coroutine *read_coroutine;
     Coroutine *write_coroutine;
+    uint8_t *wbuf; /* see qio_channel_set_write_buffer() */
+    size_t wbuf_size;
+    size_t wbuf_len;
+    size_t wbuf_off;
 #ifdef _WIN32
     HANDLE event; /* For use with GSource on Win32 */
 #endif
@@ -104,6 +112,7 @@ struct QIOChannelClass {
                          size_t niov,
                          int *fds,
                          size_t nfds,
+                         int flags,
                          Error **errp);
     ssize_t (*io_readv)(QIOChannel *ioc,
                         const struct iovec *iov,
@@ -136,6 +145,8 @@ struct QIOChannelClass {
                                   IOHandler *io_read,
                                   IOHandler *io_write,
                                   void *opaque);
+    int (*io_flush)(QIOChannel *ioc,
+                    Error **errp);
 };
 
 /* General I/O handling functions */
@@ -228,6 +239,7 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  * Write data to the IO channel, reading it from the
@@ -251,6 +263,20 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * unless qio_channel_has_feature() returns a true
  * value for the QIO_CHANNEL_FEATURE_FD_PASS constant.
  *
+ * If @flags contains QIO_CHANNEL_WRITE_FLAG_ZERO_COPY,
+ * the data may still be referenced by the kernel after
+ * the call returns, so the memory regions in @iov must
+ * not be modified or freed until qio_channel_flush()
+ * has completed. It is an error to pass this flag unless
+ * qio_channel_has_feature() returns a true value for the
+ * QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY constant.
+ *
+ * If @flags contains QIO_CHANNEL_WRITE_FLAG_MORE, the
+ * caller is about to write more data, so the channel
+ * may hold this data back to send it together with the
+ * next write (MSG_MORE on sockets). Channels that cannot
+ * do that ignore the flag.
+ *
  * Returns: the number of bytes sent, or -1 on error,
  * or QIO_CHANNEL_ERR_BLOCK if no data is can be sent
  * and the channel is non-blocking
@@ -260,6 +286,7 @@ ssize_t qio_channel_writev_full(QIOChannel *ioc,
                                 size_t niov,
                                 int *fds,
                                 size_t nfds,
+                                int flags,
                                 Error **errp);
 
 /**
@@ -837,6 +864,7 @@ int qio_channel_readv_full_all(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  *
@@ -846,6 +874,11 @@ int qio_channel_readv_full_all(QIOChannel *ioc,
  * to be written, yielding from the current coroutine
  * if required.
  *
+ * If QIO_CHANNEL_WRITE_FLAG_ZERO_COPY is passed in @flags,
+ * the buffers must not be changed until qio_channel_flush()
+ * returns, as the kernel may read them after this function
+ * has completed.
+ *
  * Returns: 0 if all bytes were written, or -1 on error
  */
 
@@ -853,6 +886,47 @@ int qio_channel_writev_full_all(QIOChannel *ioc,
                                 const struct iovec *iov,
                                 size_t niov,
                                 int *fds, size_t nfds,
-                                Error **errp);
+                                int flags, Error **errp);
+
+/**
+ * qio_channel_flush:
+ * @ioc: the channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Will block until the data held in the write buffer
+ * (see qio_channel_set_write_buffer()) and every packet
+ * queued with QIO_CHANNEL_WRITE_FLAG_ZERO_COPY is sent.
+ * Returns immediately if there is nothing buffered and
+ * the channel does not implement zero copy writes.
+ *
+ * Once this returns, the memory regions passed to
+ * zero copy writes may be reused or modified again.
+ *
+ * Returns: -1 if any error is found,
+ *          1 if every send failed to use zero copy,
+ *          0 otherwise.
+ */
+
+int qio_channel_flush(QIOChannel *ioc,
+                      Error **errp);
+
+/**
+ * qio_channel_set_write_buffer:
+ * @ioc: the channel object
+ * @size: the size of the buffer, or 0 to disable it
+ *
+ * Combine small writes on @ioc: instead of being sent
+ * right away, data passed to qio_channel_writev_full()
+ * is copied into a buffer of @size bytes, which is only
+ * written out once it would overflow, or when
+ * qio_channel_flush() or qio_channel_close() are called.
+ * Writes carrying file descriptors or using zero copy
+ * first push out the buffered data and then bypass it.
+ *
+ * Callers must flush the channel before waiting for
+ * the peer to act on the data they wrote.
+ */
+void qio_channel_set_write_buffer(QIOChannel *ioc,
+                                  size_t size);
 
 #endif /* QIO_CHANNEL_H */
@@ -23,6 +23,12 @@ typedef struct SaveVMHandlers {
     void (*save_cleanup)(void *opaque);
     int (*save_live_complete_postcopy)(QEMUFile *f, void *opaque);
     int (*save_live_complete_precopy)(QEMUFile *f, void *opaque);
+    /*
+     * Called with the source stopped, before the switch to postcopy,
+     * for data that must reach the destination before its discard
+     * requests are sent.
+     */
+    int (*save_postcopy_prepare)(QEMUFile *f, void *opaque);
 
     /* This runs both outside and inside the iothread lock.  */
     bool (*is_active)(void *opaque);
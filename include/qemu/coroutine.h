@@ -122,6 +122,21 @@ bool qemu_in_coroutine(void);
  */
 bool qemu_coroutine_entered(Coroutine *co);
 
+/**
+ * Grow the coroutine pool by @additional_pool_size coroutines
+ *
+ * Devices that keep many requests in flight, each in its own coroutine,
+ * should call this when they are realized so that the pool is sized for
+ * their queue depth.  Otherwise coroutines that do not fit in the pool are
+ * freed and reallocated all the time, which is expensive.
+ */
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
+
+/**
+ * Undo a previous qemu_coroutine_inc_pool_size() call
+ */
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size);
+
 /**
  * Provides a mutex that can be used to synchronise coroutines
  */
@@ -158,8 +173,15 @@ void qemu_co_mutex_init(CoMutex *mutex);
 /**
  * Locks the mutex. If the lock cannot be taken immediately, control is
  * transferred to the caller of the current coroutine.
- */
-void coroutine_fn qemu_co_mutex_lock(CoMutex *mutex);
+ *
+ * When the synchronization profiler is enabled, the time spent waiting
+ * for a contended mutex is accounted to the calling @file and @line.
+ */
+void coroutine_fn qemu_co_mutex_lock_impl(CoMutex *mutex,
+                                          const char *file, int line);
+void coroutine_fn (qemu_co_mutex_lock)(CoMutex *mutex);
+#define qemu_co_mutex_lock(mutex) \
+        qemu_co_mutex_lock_impl(mutex, __FILE__, __LINE__)
 
 /**
  * Unlocks the mutex and schedules the next coroutine that was waiting for this
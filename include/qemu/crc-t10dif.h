@@ -0,0 +1,30 @@
+/*
+ * CRC16 (T10 DIF) Checksum Algorithm
+ *
+ * Copyright (c) 2021 Samsung Electronics Co., Ltd.
+ *
+ * Authors:
+ *   Klaus Jensen           <k.jensen@samsung.com>
+ *   Gollu Appalanaidu      <anaidu.gollu@samsung.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_CRC_T10DIF_H
+#define QEMU_CRC_T10DIF_H
+
+extern uint16_t const crc_t10dif_table[256];
+
+/*
+ * Uses carry-less multiplication where the host supports it, so that
+ * protection information can be computed for large buffers at a time.
+ */
+uint16_t crc_t10dif(uint16_t crc, const uint8_t *buffer, size_t len);
+
+static inline uint16_t crc_t10dif_byte(uint16_t crc, const uint8_t c)
+{
+    return (crc << 8) ^ crc_t10dif_table[(crc >> 8) ^ c];
+}
+
+#endif /* QEMU_CRC_T10DIF_H */
@@ -75,6 +75,15 @@ iov_to_buf(const struct iovec *iov, const unsigned int iov_cnt,
 size_t iov_memset(const struct iovec *iov, const unsigned int iov_cnt,
                   size_t offset, int fillc, size_t bytes);
 
+/**
+ * Check whether the `bytes' data bytes of iovec `iov' of size `iov_cnt'
+ * elements, starting at byte offset `offset', are all zero.  Stops at
+ * the first element containing a non-zero byte, or at the end of the
+ * iovec.
+ */
+bool iov_is_zero(const struct iovec *iov, const unsigned int iov_cnt,
+                 size_t offset, size_t bytes);
+
 /*
  * Send/recv data from/to iovec buffers directly
  *
@@ -162,6 +171,10 @@ typedef struct QEMUIOVector {
      * (qemu_iovec_init()), @size is the cumulative size of iovecs and
      * @local_iov is invalid and unused.
      *
+     * For allocated @iov, @local_iov.iov_base is the caller-provided array
+     * passed to qemu_iovec_init_storage(), or NULL.  @iov only needs to be
+     * freed if it is not equal to that array.
+     *
      * For embedded @iov (QEMU_IOVEC_INIT_BUF() or qemu_iovec_init_buf()),
      * @iov is equal to &@local_iov, and @size is valid, as it has same
      * offset and type as @local_iov.iov_len, which is guaranteed by
@@ -221,6 +234,17 @@ static inline void *qemu_iovec_buf(QEMUIOVector *qiov)
 }
 
 void qemu_iovec_init(QEMUIOVector *qiov, int alloc_hint);
+
+/*
+ * qemu_iovec_init_storage
+ *
+ * Like qemu_iovec_init(), but the first @nstorage elements are kept in
+ * @storage instead of being allocated from the heap; only growing past
+ * them with qemu_iovec_add() allocates.  @storage must stay valid until
+ * qemu_iovec_destroy() is called.
+ */
+void qemu_iovec_init_storage(QEMUIOVector *qiov,
+                             struct iovec *storage, int nstorage);
 void qemu_iovec_init_external(QEMUIOVector *qiov, struct iovec *iov, int niov);
 int qemu_iovec_init_extended(
         QEMUIOVector *qiov,
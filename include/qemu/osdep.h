@@ -687,9 +687,38 @@ unsigned long qemu_getauxval(unsigned long type);
 
 void qemu_set_tty_echo(int fd, bool echo);
 
+/**
+ * os_mem_prealloc:
+ * @fd: file descriptor backing @area, or -1
+ * @area: start of the memory to preallocate
+ * @sz: size of the memory to preallocate
+ * @smp_cpus: maximum number of threads to use
+ * @host_nodes: bitmap of the host NUMA nodes @area is bound to, or NULL
+ * @max_node: number of bits in @host_nodes
+ * @errp: pointer to an error
+ *
+ * Touch all pages of @area so that they are allocated.  If @host_nodes
+ * is given, the threads doing so run on the CPUs of those nodes.
+ */
 void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
+                     const unsigned long *host_nodes, unsigned long max_node,
                      Error **errp);
 
+/**
+ * os_thread_set_node_affinity:
+ * @thread: the thread to pin
+ * @host_nodes: bitmap of host NUMA nodes
+ * @max_node: number of bits in @host_nodes
+ *
+ * Restrict @thread to the host CPUs of the NUMA nodes in @host_nodes.
+ *
+ * Returns 0 on success, -ENOENT if the nodes have no CPUs or -errno
+ * on other failures (-ENOSYS if the host does not support it).
+ */
+int os_thread_set_node_affinity(struct QemuThread *thread,
+                                const unsigned long *host_nodes,
+                                unsigned long max_node);
+
 /**
  * qemu_get_pid_name:
  * @pid: pid of a process
@@ -100,17 +100,31 @@ struct qemu_plugin_dyn_cb {
     union qemu_plugin_cb_sig f;
     void *userp;
     enum plugin_dyn_cb_subtype type;
+    /* @flags applies to regular callbacks only */
+    enum qemu_plugin_cb_flags flags;
     /* @rw applies to mem callbacks only (both regular and inline) */
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
         struct {
+            /* @entry.score is NULL for ops on the shared location @userp */
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
     };
 };
 
+/*
+ * Per-vCPU storage for inline ops.  @data holds one element per vCPU
+ * index and is only resized while all vCPUs are stopped, followed by a
+ * flush of the code cache since translated code embeds its address.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
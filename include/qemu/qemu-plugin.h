@@ -50,7 +50,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -217,8 +217,11 @@ struct qemu_plugin_insn;
  * @QEMU_PLUGIN_CB_R_REGS: callback reads the CPU's regs
  * @QEMU_PLUGIN_CB_RW_REGS: callback reads and writes the CPU's regs
  *
- * Note: currently unused, plugins cannot read or change system
- * register state.
+ * Callbacks that use qemu_plugin_read_register() must be registered
+ * with QEMU_PLUGIN_CB_R_REGS, otherwise the values may be stale.
+ * The program counter is the exception: it is only updated at the end
+ * of a translation block, so it is stale even then.  Plugins cannot
+ * change register state.
  */
 enum qemu_plugin_cb_flags {
     QEMU_PLUGIN_CB_NO_REGS,
@@ -281,6 +284,96 @@ enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
 };
 
+/**
+ * struct qemu_plugin_scoreboard - opaque per-vCPU storage
+ *
+ * A scoreboard holds one element of a plugin-chosen size for each vCPU.
+ * Inline ops registered with the *_inline_per_vcpu() functions operate
+ * on the element of the vCPU executing the code, so counters kept there
+ * are exact under MTTCG without any locking.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of the scoreboard elements
+ * @score: the scoreboard
+ * @offset: offset of the uint64_t within each element
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a new scoreboard
+ * @element_size: size of the per-vCPU element, in bytes
+ *
+ * Elements are zero-initialised.  Returns: the new scoreboard, to be
+ * released with qemu_plugin_scoreboard_free().
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * Must not be called while translated code may still refer to it, e.g.
+ * only from the atexit callback or after qemu_plugin_reset().
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get the element of a vCPU
+ * @score: scoreboard to query
+ * @vcpu_index: index of the vCPU
+ *
+ * Returns: pointer to the element of @vcpu_index.  The pointer is only
+ * valid until the next vCPU is created.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* Make a qemu_plugin_u64 for the uint64_t @member of the element @type */
+#define qemu_plugin_scoreboard_u64_in_struct(sb, type, member) \
+    ((qemu_plugin_u64) { .score = (sb), .offset = offsetof(type, member) })
+
+/* Make a qemu_plugin_u64 for a scoreboard of plain uint64_t elements */
+#define qemu_plugin_scoreboard_u64(sb) \
+    ((qemu_plugin_u64) { .score = (sb), .offset = 0 })
+
+/**
+ * qemu_plugin_u64_add() - add a value to a per-vCPU counter
+ * @entry: counter
+ * @vcpu_index: index of the vCPU
+ * @added: value to add
+ */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - read a per-vCPU counter
+ * @entry: counter
+ * @vcpu_index: index of the vCPU
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - write a per-vCPU counter
+ * @entry: counter
+ * @vcpu_index: index of the vCPU
+ * @val: new value
+ */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - sum a counter over all vCPUs
+ * @entry: counter
+ *
+ * Returns: the sum of @entry over every vCPU that has been created.
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -299,6 +392,23 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the per-vCPU counter the op applies to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies to
+ * the element of @entry belonging to the executing vCPU, which makes the
+ * result exact in multi-threaded/multi-smp situations.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -327,6 +437,22 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the per-vCPU counter the op applies to
+ * @imm: the op data (e.g. 1)
+ *
+ * Insert an inline op on the executing vCPU's element of @entry every
+ * time an instruction executes.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -496,6 +622,13 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 
 
 typedef void
@@ -571,6 +704,46 @@ int qemu_plugin_n_vcpus(void);
 /* returns -1 in user-mode */
 int qemu_plugin_n_max_vcpus(void);
 
+/**
+ * qemu_plugin_n_registers() - number of readable registers
+ *
+ * Only valid from a vCPU callback.  Registers use the numbering of the
+ * target's GDB description.  Returns: the number of registers of the
+ * current vCPU.
+ */
+int qemu_plugin_n_registers(void);
+
+/**
+ * qemu_plugin_read_register() - read a register of the current vCPU
+ * @reg: register number, as used by GDB for this target
+ * @buf: buffer receiving the value, in target byte order
+ * @size: size of @buf; longer values are truncated
+ *
+ * Only valid from a vCPU callback registered with QEMU_PLUGIN_CB_R_REGS.
+ *
+ * The program counter is not synced before the callback and may hold the
+ * address of an earlier instruction or translation block.  Callbacks that
+ * need it should take it from qemu_plugin_insn_vaddr() or
+ * qemu_plugin_tb_vaddr() at translation time and pass it as userdata.
+ *
+ * Returns: the size of the register, or -1 if @reg does not exist.
+ */
+int qemu_plugin_read_register(unsigned int reg, void *buf, size_t size);
+
+/**
+ * qemu_plugin_read_memory_vaddr() - read guest memory of the current vCPU
+ * @addr: guest virtual address
+ * @buf: buffer receiving the data
+ * @len: number of bytes to read
+ *
+ * Only valid from a vCPU callback.  The access uses the current address
+ * space of the vCPU, does not raise guest faults and is not seen by
+ * memory callbacks.
+ *
+ * Returns: true on success, false if part of the range is not mapped.
+ */
+bool qemu_plugin_read_memory_vaddr(uint64_t addr, void *buf, size_t len);
+
 /**
  * qemu_plugin_outs() - output string via QEMU's logging system
  * @string: a string
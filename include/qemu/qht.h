@@ -117,6 +117,25 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
  */
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash);
 
+/**
+ * qht_lookup_batch - Look up several pointers in a QHT
+ * @ht: QHT to be looked up
+ * @userps: array of @n pointers to pass to the comparison function
+ * @hashes: array of @n hashes, one per element of @userps
+ * @results: array of @n pointers, filled in with the lookup results
+ * @n: number of lookups
+ *
+ * Equivalent to calling qht_lookup() for each element, except that the
+ * buckets of all lookups are prefetched first, so that their cache misses
+ * overlap instead of being paid one after the other.
+ *
+ * Needs to be called under an RCU read-critical section.
+ *
+ * Returns the number of lookups that found a match.
+ */
+size_t qht_lookup_batch(const struct qht *ht, const void *const *userps,
+                        const uint32_t *hashes, void **results, size_t n);
+
 /**
  * qht_remove - remove a pointer from the hash table
  * @ht: QHT to remove from
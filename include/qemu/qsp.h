@@ -24,4 +24,18 @@ void qsp_enable(void);
 void qsp_disable(void);
 void qsp_reset(void);
 
+/*
+ * Account @ns of waiting for a contended CoMutex to the @file:@line call
+ * site.  Only call this while the profiler is enabled.
+ */
+void qsp_co_mutex_record(const void *mutex, const char *file, int line,
+                         int64_t ns);
+
+/*
+ * Account @ns of holding the BQL to the @file:@line call site that took it.
+ * Only call this while the profiler is enabled.
+ */
+void qsp_bql_hold_record(const void *mutex, const char *file, int line,
+                         int64_t ns);
+
 #endif /* QEMU_QSP_H */
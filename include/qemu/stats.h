@@ -0,0 +1,78 @@
+/*
+ * Registry of performance counters
+ *
+ * Subsystems keep their counters in Stat64 fields next to the data they
+ * describe, and update them without taking any lock.  Registering a
+ * counter only makes it visible to the query-stats QMP command and to
+ * "info stats"; registration and lookup are rare and use a mutex.
+ *
+ * Counters are identified by a provider (the subsystem, e.g.
+ * "aio-context"), an optional instance (e.g. an IOThread id) and a name.
+ *
+ * query-stats may run out-of-band in the monitor I/O thread, without the
+ * BQL.  The registry therefore must not rely on the BQL, and the
+ * registry lock must only protect short critical sections.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_STATS_H
+#define QEMU_STATS_H
+
+#include "qemu/stats64.h"
+
+/* Bucket 0 is for samples below 1us, the last one for samples above ~36min */
+#define STATS_HISTOGRAM_BUCKETS 32
+
+/*
+ * Latency histogram with power of two buckets: bucket i counts the
+ * samples between 2^(i-1) and 2^i microseconds.  Samples are in
+ * nanoseconds.
+ */
+typedef struct StatsHistogram {
+    Stat64 count;
+    Stat64 total;
+    Stat64 min;
+    Stat64 max;
+    Stat64 buckets[STATS_HISTOGRAM_BUCKETS];
+} StatsHistogram;
+
+/* Clear @hist.  Not atomic with respect to concurrent stats_histogram_add. */
+void stats_histogram_reset(StatsHistogram *hist);
+void stats_histogram_add(StatsHistogram *hist, uint64_t ns);
+
+/*
+ * Make @counter or @hist visible under @provider, @instance and @name.
+ * @instance may be NULL.  The strings are copied; the counter must stay
+ * valid until it is unregistered.
+ */
+void stats_register_counter(const char *provider, const char *instance,
+                            const char *name, Stat64 *counter);
+void stats_register_histogram(const char *provider, const char *instance,
+                              const char *name, StatsHistogram *hist);
+
+/*
+ * For counters that are not kept in a Stat64, such as the ones exported
+ * by the kernel: @get is called with @opaque whenever the value is read.
+ * It is called with the registry lock held and possibly without the
+ * BQL, so it must not block or take the BQL.
+ */
+typedef uint64_t StatsGetFunc(void *opaque);
+void stats_register_func(const char *provider, const char *instance,
+                         const char *name, StatsGetFunc *get, void *opaque);
+
+/* Remove all counters registered with @provider and @instance. */
+void stats_unregister(const char *provider, const char *instance);
+
+/*
+ * Called for each registered statistic; exactly one of @value and @hist
+ * is non-NULL.  The registry is locked during the walk, so @fn must not
+ * register or unregister statistics.
+ */
+typedef void StatsForeachFunc(const char *provider, const char *instance,
+                              const char *name, const uint64_t *value,
+                              const StatsHistogram *hist, void *opaque);
+void stats_foreach(StatsForeachFunc *fn, void *opaque);
+
+#endif
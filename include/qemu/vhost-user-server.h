@@ -47,6 +47,10 @@ typedef struct {
     QIOChannelSocket *sioc; /* The underlying data channel with the client */
     QTAILQ_HEAD(, VuFdWatch) vu_fd_watches;
 
+    /* Queues with used buffers that the client has not been notified about */
+    QEMUBH *notify_bh;
+    unsigned long *notify_vqs;
+
     Coroutine *co_trip; /* coroutine for processing VhostUserMsg */
 } VuServer;
 
@@ -59,6 +63,13 @@ bool vhost_user_server_start(VuServer *server,
 
 void vhost_user_server_stop(VuServer *server);
 
+/*
+ * Notify the client of used buffers in @vq.  The notification is sent from
+ * a BH, so that all completions in one event loop iteration only cost a
+ * single call fd write (subject to the guest's event index).
+ */
+void vhost_user_server_queue_notify(VuServer *server, VuVirtq *vq);
+
 void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx);
 void vhost_user_server_detach_aio_context(VuServer *server);
 
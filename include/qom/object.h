@@ -117,7 +117,13 @@ typedef void (ObjectUnparent)(Object *obj);
  */
 typedef void (ObjectFree)(void *obj);
 
-#define OBJECT_CLASS_CAST_CACHE 4
+/*
+ * Number of type names whose casts are remembered per class.  A device
+ * is typically cast to its own type, to a few of its ancestors (e.g.
+ * DEVICE, SYS_BUS_DEVICE or PCI_DEVICE) and to one or two interfaces;
+ * the cache must hold all of them or MMIO handlers keep missing it.
+ */
+#define OBJECT_CLASS_CAST_CACHE 8
 
 /**
  * struct ObjectClass:
@@ -42,10 +42,22 @@ void cpu_throttle_init(void);
  */
 void cpu_throttle_set(int new_throttle_pct);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vcpu to throttle.
+ * @new_throttle_pct: Percent of sleep time. Valid range is 0 to 99.
+ *
+ * Like cpu_throttle_set, but only for @cpu.  The vcpu sleeps for the higher
+ * of this and of the global throttle percentage; 0 drops its own throttle.
+ * It is reset by cpu_throttle_stop as well.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
 /**
  * cpu_throttle_stop:
  *
- * Stops the vcpu throttling started by cpu_throttle_set.
+ * Stops the vcpu throttling started by cpu_throttle_set and
+ * cpu_throttle_set_vcpu.
  */
 void cpu_throttle_stop(void);
 
@@ -65,4 +77,20 @@ bool cpu_throttle_active(void);
  */
 int cpu_throttle_get_percentage(void);
 
+/**
+ * cpu_throttle_get_vcpu_percentage:
+ * @cpu: The vcpu to query.
+ *
+ * Returns: The throttle percentage set for @cpu with cpu_throttle_set_vcpu,
+ * 0 if there is none.
+ */
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu);
+
+/**
+ * cpu_throttle_vcpu_active:
+ *
+ * Returns: %true if any vcpu has a throttle of its own, %false otherwise.
+ */
+bool cpu_throttle_vcpu_active(void);
+
 #endif /* SYSEMU_CPU_THROTTLE_H */
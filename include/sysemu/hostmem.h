@@ -68,6 +68,7 @@ struct HostMemoryBackend {
     uint32_t prealloc_threads;
     DECLARE_BITMAP(host_nodes, MAX_NODES + 1);
     HostMemPolicy policy;
+    HostMemThpPolicy thp;
 
     MemoryRegion mr;
 };
@@ -80,4 +81,15 @@ bool host_memory_backend_is_mapped(HostMemoryBackend *backend);
 size_t host_memory_backend_pagesize(HostMemoryBackend *memdev);
 char *host_memory_backend_get_name(HostMemoryBackend *backend);
 
+/**
+ * host_memory_backend_get_prealloc_nodes:
+ * @backend: the memory backend
+ *
+ * Returns the bitmap (of MAX_NODES bits) of host nodes that the
+ * preallocation threads for @backend should run on, or NULL if the
+ * memory is not bound to any node.
+ */
+const unsigned long *
+host_memory_backend_get_prealloc_nodes(HostMemoryBackend *backend);
+
 #endif
@@ -86,6 +86,9 @@ struct NumaState {
     /* Detect if HMAT support is enabled. */
     bool hmat_enabled;
 
+    /* Bind vCPU threads to the host nodes of their node's memdev */
+    bool host_affinity;
+
     /* NUMA nodes information */
     NodeInfo nodes[MAX_NODES];
 
@@ -110,4 +113,15 @@ void numa_cpu_pre_plug(const struct CPUArchId *slot, DeviceState *dev,
                        Error **errp);
 bool numa_uses_legacy_mem(void);
 
+/**
+ * numa_set_vcpu_affinity:
+ * @ms: the machine
+ * @cpu: a vCPU whose thread has been created
+ *
+ * If the "numa-affinity" machine property is set, restrict the thread
+ * of @cpu to the host CPUs of the host nodes that the memory of its
+ * guest NUMA node is bound to.
+ */
+void numa_set_vcpu_affinity(MachineState *ms, CPUState *cpu);
+
 #endif
@@ -1001,6 +1001,13 @@ bool tcg_op_supported(TCGOpcode op);
 
 void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args);
 
+/*
+ * Return the helper description of @func, which must have been declared
+ * with DEF_HELPER_*, in the form stored in the arguments of a call op.
+ */
+struct TCGHelperInfo;
+const struct TCGHelperInfo *tcg_helper_info_lookup(void *func);
+
 TCGOp *tcg_emit_op(TCGOpcode opc);
 void tcg_op_remove(TCGContext *s, TCGOp *op);
 TCGOp *tcg_op_insert_before(TCGContext *s, TCGOp *op, TCGOpcode opc);
@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "io/channel-socket.h"
 #include "io/channel-tls.h"
 #include "trace.h"
 #include "qemu/atomic.h"
@@ -175,6 +176,12 @@ static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
             qio_task_set_error(task, err);
         } else {
             trace_qio_channel_tls_credentials_allow(ioc);
+            if (object_dynamic_cast(OBJECT(ioc->master),
+                                    TYPE_QIO_CHANNEL_SOCKET) &&
+                qcrypto_tls_session_enable_ktls_tx(
+                    ioc->session, QIO_CHANNEL_SOCKET(ioc->master)->fd) == 0) {
+                trace_qio_channel_tls_ktls_tx(ioc);
+            }
         }
         qio_task_complete(task);
     } else {
@@ -301,12 +308,19 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
                                       size_t niov,
                                       int *fds,
                                       size_t nfds,
+                                      int flags,
                                       Error **errp)
 {
     QIOChannelTLS *tioc = QIO_CHANNEL_TLS(ioc);
     size_t i;
     ssize_t done = 0;
 
+    if (qcrypto_tls_session_has_ktls_tx(tioc->session)) {
+        /* the kernel builds the records, pass the whole vector down */
+        return qio_channel_writev_full(tioc->master, iov, niov,
+                                       NULL, 0, flags, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
@@ -67,14 +67,43 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
 }
 
 
+/*
+ * Try to send out the write buffer; @more tells whether the caller has
+ * more data to send right after it.  Returns 0 once the buffer is empty.
+ */
+static int qio_channel_write_buffer_drain(QIOChannel *ioc, bool more,
+                                          Error **errp)
+{
+    QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+    struct iovec iov;
+    ssize_t len;
+
+    while (ioc->wbuf_off < ioc->wbuf_len) {
+        iov.iov_base = ioc->wbuf + ioc->wbuf_off;
+        iov.iov_len = ioc->wbuf_len - ioc->wbuf_off;
+        len = klass->io_writev(ioc, &iov, 1, NULL, 0,
+                               more ? QIO_CHANNEL_WRITE_FLAG_MORE : 0, errp);
+        if (len < 0) {
+            return len;
+        }
+        ioc->wbuf_off += len;
+    }
+    ioc->wbuf_off = ioc->wbuf_len = 0;
+    return 0;
+}
+
+
 ssize_t qio_channel_writev_full(QIOChannel *ioc,
                                 const struct iovec *iov,
                                 size_t niov,
                                 int *fds,
                                 size_t nfds,
+                                int flags,
                                 Error **errp)
 {
     QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+    size_t size;
+    int ret;
 
     if ((fds || nfds) &&
         !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS)) {
@@ -83,7 +112,35 @@ ssize_t qio_channel_writev_full(QIOChannel *ioc,
         return -1;
     }
 
-    return klass->io_writev(ioc, iov, niov, fds, nfds, errp);
+    if ((flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        error_setg_errno(errp, EINVAL,
+                         "Requested Zero Copy feature is not available");
+        return -1;
+    }
+
+    if (ioc->wbuf_size) {
+        size = iov_size(iov, niov);
+        if (!nfds && !(flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+            ioc->wbuf_len + size <= ioc->wbuf_size) {
+            iov_to_buf(iov, niov, 0, ioc->wbuf + ioc->wbuf_len, size);
+            ioc->wbuf_len += size;
+            return size;
+        }
+
+        ret = qio_channel_write_buffer_drain(ioc, true, errp);
+        if (ret < 0) {
+            return ret;
+        }
+        if (!nfds && !(flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+            size <= ioc->wbuf_size) {
+            iov_to_buf(iov, niov, 0, ioc->wbuf, size);
+            ioc->wbuf_len = size;
+            return size;
+        }
+    }
+
+    return klass->io_writev(ioc, iov, niov, fds, nfds, flags, errp);
 }
 
 
@@ -217,14 +274,14 @@ int qio_channel_writev_all(QIOChannel *ioc,
                            size_t niov,
                            Error **errp)
 {
-    return qio_channel_writev_full_all(ioc, iov, niov, NULL, 0, errp);
+    return qio_channel_writev_full_all(ioc, iov, niov, NULL, 0, 0, errp);
 }
 
 int qio_channel_writev_full_all(QIOChannel *ioc,
                                 const struct iovec *iov,
                                 size_t niov,
                                 int *fds, size_t nfds,
-                                Error **errp)
+                                int flags, Error **errp)
 {
     int ret = -1;
     struct iovec *local_iov = g_new(struct iovec, niov);
@@ -238,7 +295,7 @@ int qio_channel_writev_full_all(QIOChannel *ioc,
     while (nlocal_iov > 0) {
         ssize_t len;
         len = qio_channel_writev_full(ioc, local_iov, nlocal_iov, fds, nfds,
-                                      errp);
+                                      flags, errp);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(ioc, G_IO_OUT);
@@ -277,7 +334,7 @@ ssize_t qio_channel_writev(QIOChannel *ioc,
                            size_t niov,
                            Error **errp)
 {
-    return qio_channel_writev_full(ioc, iov, niov, NULL, 0, errp);
+    return qio_channel_writev_full(ioc, iov, niov, NULL, 0, 0, errp);
 }
 
 
@@ -297,7 +354,7 @@ ssize_t qio_channel_write(QIOChannel *ioc,
                           Error **errp)
 {
     struct iovec iov = { .iov_base = (char *)buf, .iov_len = buflen };
-    return qio_channel_writev_full(ioc, &iov, 1, NULL, 0, errp);
+    return qio_channel_writev_full(ioc, &iov, 1, NULL, 0, 0, errp);
 }
 
 
@@ -344,6 +401,11 @@ int qio_channel_close(QIOChannel *ioc,
                       Error **errp)
 {
     QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+
+    if (ioc->wbuf_len) {
+        /* best effort, the data is lost anyway if the peer is gone */
+        qio_channel_write_buffer_drain(ioc, false, NULL);
+    }
     return klass->io_close(ioc, errp);
 }
 
@@ -473,6 +535,44 @@ off_t qio_channel_io_seek(QIOChannel *ioc,
     return klass->io_seek(ioc, offset, whence, errp);
 }
 
+int qio_channel_flush(QIOChannel *ioc,
+                      Error **errp)
+{
+    QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+    int ret;
+
+    while (ioc->wbuf_len) {
+        ret = qio_channel_write_buffer_drain(ioc, false, errp);
+        if (ret == QIO_CHANNEL_ERR_BLOCK) {
+            if (qemu_in_coroutine()) {
+                qio_channel_yield(ioc, G_IO_OUT);
+            } else {
+                qio_channel_wait(ioc, G_IO_OUT);
+            }
+        } else if (ret < 0) {
+            return -1;
+        }
+    }
+
+    if (!klass->io_flush ||
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        return 0;
+    }
+
+    return klass->io_flush(ioc, errp);
+}
+
+
+void qio_channel_set_write_buffer(QIOChannel *ioc,
+                                  size_t size)
+{
+    assert(!ioc->wbuf_len);
+
+    g_free(ioc->wbuf);
+    ioc->wbuf = size ? g_malloc(size) : NULL;
+    ioc->wbuf_size = size;
+}
+
 
 static void qio_channel_restart_read(void *opaque)
 {
@@ -596,6 +696,7 @@ static void qio_channel_finalize(Object *obj)
     QIOChannel *ioc = QIO_CHANNEL(obj);
 
     g_free(ioc->name);
+    g_free(ioc->wbuf);
 
 #ifdef _WIN32
     if (ioc->event) {
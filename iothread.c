@@ -129,6 +129,8 @@ static void iothread_instance_finalize(Object *obj)
      * GSources first before destroying any GMainContext.
      */
     if (iothread->ctx) {
+        aio_context_unregister_stats(iothread->stats_name);
+        g_free(iothread->stats_name);
         aio_context_unref(iothread->ctx);
         iothread->ctx = NULL;
     }
@@ -197,6 +199,9 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
         return;
     }
 
+    iothread->stats_name = iothread_get_id(iothread);
+    aio_context_register_stats(iothread->ctx, iothread->stats_name);
+
     /* This assumes we are called from a thread with useful CPU affinity for us
      * to inherit.
      */
@@ -384,6 +389,11 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->aio_max_batch;
+    if (iothread->ctx) {
+        info->poll_hits = stat64_get(&iothread->ctx->poll_hits);
+        info->poll_misses = stat64_get(&iothread->ctx->poll_misses);
+        info->poll_time_ns = stat64_get(&iothread->ctx->poll_time_ns);
+    }
 
     QAPI_LIST_APPEND(*tail, info);
     return 0;
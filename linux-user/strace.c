@@ -3771,6 +3771,76 @@ static const struct syscallname scnames[] = {
 
 static int nsyscalls = ARRAY_SIZE(scnames);
 
+/*
+ * Syscall numbers are dense per target (possibly from an offset, as for
+ * MIPS), so print_syscall() and print_syscall_ret() index a table built
+ * on first use instead of scanning scnames twice for every syscall.
+ */
+#define SYSCALL_INDEX_MAX_SPAN 8192
+
+typedef struct SyscallIndex {
+    int base;
+    int span;
+    const struct syscallname *entry[];
+} SyscallIndex;
+
+static SyscallIndex *syscall_index;
+
+static SyscallIndex *build_syscall_index(void)
+{
+    SyscallIndex *idx;
+    int i, lo = INT_MAX, hi = INT_MIN;
+
+    for (i = 0; i < nsyscalls; i++) {
+        lo = MIN(lo, scnames[i].nr);
+        hi = MAX(hi, scnames[i].nr);
+    }
+    if (nsyscalls == 0 || hi - lo >= SYSCALL_INDEX_MAX_SPAN) {
+        /* too sparse, leave span at 0 so that lookups scan scnames */
+        return g_new0(SyscallIndex, 1);
+    }
+
+    idx = g_malloc0(sizeof(*idx) + (hi - lo + 1) * sizeof(idx->entry[0]));
+    idx->base = lo;
+    idx->span = hi - lo + 1;
+    /* Keep the first entry for a number, like the linear scan did */
+    for (i = nsyscalls - 1; i >= 0; i--) {
+        idx->entry[scnames[i].nr - lo] = &scnames[i];
+    }
+    return idx;
+}
+
+static const struct syscallname *find_syscall(int num)
+{
+    SyscallIndex *idx = qatomic_load_acquire(&syscall_index);
+    int i;
+
+    if (!idx) {
+        SyscallIndex *old;
+
+        idx = build_syscall_index();
+        old = qatomic_cmpxchg(&syscall_index, NULL, idx);
+        if (old) {
+            g_free(idx);
+            idx = old;
+        }
+    }
+
+    if (idx->span) {
+        if (num < idx->base || num - idx->base >= idx->span) {
+            return NULL;
+        }
+        return idx->entry[num - idx->base];
+    }
+
+    for (i = 0; i < nsyscalls; i++) {
+        if (scnames[i].nr == num) {
+            return &scnames[i];
+        }
+    }
+    return NULL;
+}
+
 /*
  * The public interface to this module.
  */
@@ -3779,27 +3849,25 @@ print_syscall(void *cpu_env, int num,
               abi_long arg1, abi_long arg2, abi_long arg3,
               abi_long arg4, abi_long arg5, abi_long arg6)
 {
-    int i;
+    const struct syscallname *sc = find_syscall(num);
     const char *format="%s(" TARGET_ABI_FMT_ld "," TARGET_ABI_FMT_ld "," TARGET_ABI_FMT_ld "," TARGET_ABI_FMT_ld "," TARGET_ABI_FMT_ld "," TARGET_ABI_FMT_ld ")";
 
     qemu_log("%d ", getpid());
 
-    for(i=0;i<nsyscalls;i++)
-        if( scnames[i].nr == num ) {
-            if( scnames[i].call != NULL ) {
-                scnames[i].call(
-                    cpu_env, &scnames[i], arg1, arg2, arg3, arg4, arg5, arg6);
-            } else {
-                /* XXX: this format system is broken because it uses
-                   host types and host pointers for strings */
-                if( scnames[i].format != NULL )
-                    format = scnames[i].format;
-                qemu_log(format,
-                         scnames[i].name, arg1, arg2, arg3, arg4, arg5, arg6);
-            }
-            return;
+    if (!sc) {
+        qemu_log("Unknown syscall %d\n", num);
+        return;
+    }
+    if (sc->call != NULL) {
+        sc->call(cpu_env, sc, arg1, arg2, arg3, arg4, arg5, arg6);
+    } else {
+        /* XXX: this format system is broken because it uses
+           host types and host pointers for strings */
+        if (sc->format != NULL) {
+            format = sc->format;
         }
-    qemu_log("Unknown syscall %d\n", num);
+        qemu_log(format, sc->name, arg1, arg2, arg3, arg4, arg5, arg6);
+    }
 }
 
 
@@ -3808,22 +3876,19 @@ print_syscall_ret(void *cpu_env, int num, abi_long ret,
                   abi_long arg1, abi_long arg2, abi_long arg3,
                   abi_long arg4, abi_long arg5, abi_long arg6)
 {
-    int i;
+    const struct syscallname *sc = find_syscall(num);
 
-    for(i=0;i<nsyscalls;i++)
-        if( scnames[i].nr == num ) {
-            if( scnames[i].result != NULL ) {
-                scnames[i].result(cpu_env, &scnames[i], ret,
-                                  arg1, arg2, arg3,
-                                  arg4, arg5, arg6);
-            } else {
-                if (!print_syscall_err(ret)) {
-                    qemu_log(TARGET_ABI_FMT_ld, ret);
-                }
-                qemu_log("\n");
-            }
-            break;
+    if (!sc) {
+        return;
+    }
+    if (sc->result != NULL) {
+        sc->result(cpu_env, sc, ret, arg1, arg2, arg3, arg4, arg5, arg6);
+    } else {
+        if (!print_syscall_err(ret)) {
+            qemu_log(TARGET_ABI_FMT_ld, ret);
         }
+        qemu_log("\n");
+    }
 }
 
 void print_taken_signal(int target_signum, const target_siginfo_t *tinfo)
@@ -11,10 +11,10 @@
  */
 
 #include "qemu/osdep.h"
-#include <zlib.h>
 #include "qapi/error.h"
 #include "cpu.h"
 #include "exec/ramblock.h"
+#include "qemu/crc32c.h"
 #include "qemu/rcu_queue.h"
 #include "qapi/qapi-commands-migration.h"
 #include "ram.h"
@@ -131,8 +131,8 @@ static uint32_t get_ramblock_vfn_hash(struct RamblockDirtyInfo *info,
 {
     uint32_t crc;
 
-    crc = crc32(0, (info->ramblock_addr +
-                vfn * TARGET_PAGE_SIZE), TARGET_PAGE_SIZE);
+    crc = crc32c(0xffffffff, (info->ramblock_addr +
+                 vfn * TARGET_PAGE_SIZE), TARGET_PAGE_SIZE);
 
     trace_get_ramblock_vfn_hash(info->idstr, vfn, crc);
     return crc;
@@ -0,0 +1,81 @@
+/*
+ * Latency statistics of the migration hot path
+ *
+ * Each MigrationPhase has a histogram with power of two buckets.  The
+ * samples are taken by the migration thread, and for vmstate-load by
+ * the incoming migration coroutine, while query-migrate-stats reads
+ * them from the main loop; Stat64 keeps 64-bit counters consistent on
+ * all hosts without taking a lock in the hot path.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/stats.h"
+#include "latency.h"
+
+static StatsHistogram migration_latency[MIGRATION_PHASE__MAX];
+
+uint64_t migration_latency_record(MigrationPhase phase, int64_t start)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t ns = MAX(now - start, 0);
+
+    stats_histogram_add(&migration_latency[phase], ns);
+    return ns;
+}
+
+void migration_latency_reset(void)
+{
+    int i;
+
+    for (i = 0; i < MIGRATION_PHASE__MAX; i++) {
+        stats_histogram_reset(&migration_latency[i]);
+    }
+}
+
+MigrationPhaseStatsList *migration_latency_query(void)
+{
+    MigrationPhaseStatsList *head = NULL, **tail = &head;
+    int i, j, last;
+
+    for (i = 0; i < MIGRATION_PHASE__MAX; i++) {
+        StatsHistogram *lat = &migration_latency[i];
+        MigrationPhaseStats *stats = g_new0(MigrationPhaseStats, 1);
+        uint64List **bucket_tail = &stats->buckets;
+
+        stats->phase = i;
+        stats->count = stat64_get(&lat->count);
+        stats->total = stat64_get(&lat->total);
+        stats->min = stats->count ? stat64_get(&lat->min) : 0;
+        stats->max = stat64_get(&lat->max);
+
+        for (last = STATS_HISTOGRAM_BUCKETS - 1; last >= 0; last--) {
+            if (stat64_get(&lat->buckets[last])) {
+                break;
+            }
+        }
+        for (j = 0; j <= last; j++) {
+            QAPI_LIST_APPEND(bucket_tail, stat64_get(&lat->buckets[j]));
+        }
+        QAPI_LIST_APPEND(tail, stats);
+    }
+
+    return head;
+}
+
+void migration_latency_register(void)
+{
+    int i;
+
+    for (i = 0; i < MIGRATION_PHASE__MAX; i++) {
+        stats_register_histogram("migration", NULL, MigrationPhase_str(i),
+                                 &migration_latency[i]);
+    }
+}
+
+static void __attribute__((__constructor__)) migration_latency_init(void)
+{
+    migration_latency_reset();
+}
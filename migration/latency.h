@@ -0,0 +1,32 @@
+/*
+ * Latency statistics of the migration hot path
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_LATENCY_H
+#define QEMU_MIGRATION_LATENCY_H
+
+#include "qapi/qapi-types-migration.h"
+#include "qemu/timer.h"
+
+/* Returns the start time of a sample, to be passed to the functions below */
+static inline int64_t migration_latency_start(void)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+/*
+ * Account the time since @start to @phase.  Returns the elapsed time
+ * in nanoseconds.
+ */
+uint64_t migration_latency_record(MigrationPhase phase, int64_t start);
+
+void migration_latency_reset(void);
+MigrationPhaseStatsList *migration_latency_query(void);
+
+/* Publish the histograms through query-stats */
+void migration_latency_register(void);
+
+#endif
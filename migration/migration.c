@@ -20,16 +20,19 @@
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/kvm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
 #include "migration/misc.h"
 #include "migration.h"
 #include "savevm.h"
+#include "latency.h"
 #include "qemu-file-channel.h"
 #include "qemu-file.h"
 #include "migration/vmstate.h"
@@ -100,6 +103,11 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+/* 0: merge the dirty log into the migration bitmap in the migration thread */
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 0
+#define MAX_DIRTY_SYNC_THREADS 64
+/* Don't flush any dirty subpages of huge pages at postcopy switchover */
+#define DEFAULT_MIGRATE_POSTCOPY_SUBPAGE_BUDGET 0
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -213,6 +221,7 @@ void migration_object_init(void)
     blk_mig_init();
     ram_mig_init();
     dirty_bitmap_mig_init();
+    migration_latency_register();
 }
 
 void migration_cancel(void)
@@ -273,6 +282,7 @@ void migration_incoming_state_destroy(void)
         qemu_fclose(mis->from_src_file);
         mis->from_src_file = NULL;
     }
+    postcopy_preempt_incoming_stop(mis);
     if (mis->postcopy_remote_fds) {
         g_array_free(mis->postcopy_remote_fds, TRUE);
         mis->postcopy_remote_fds = NULL;
@@ -468,6 +478,8 @@ static void qemu_start_incoming_migration(const char *uri, Error **errp)
         exec_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -708,14 +720,22 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
          * right now.  Multifd needs more than one channel, we wait.
          */
         start_migration = !migrate_use_multifd();
-    } else {
+    } else if (migrate_use_multifd() &&
+               !multifd_recv_all_channels_created()) {
         /* Multiple connections */
-        assert(migrate_use_multifd());
         start_migration = multifd_recv_new_channel(ioc, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
         }
+    } else {
+        /*
+         * The postcopy preempt channel is only connected once postcopy
+         * starts, after all the other channels.
+         */
+        assert(migrate_postcopy_preempt());
+        postcopy_preempt_new_channel(mis, qemu_fopen_channel_input(ioc));
+        return;
     }
 
     if (start_migration) {
@@ -736,6 +756,10 @@ bool migration_has_all_channels(void)
 
     all_channels = multifd_recv_all_channels_created();
 
+    if (migrate_postcopy_preempt()) {
+        all_channels = all_channels && mis->postcopy_qemufile_dst != NULL;
+    }
+
     return all_channels && mis->from_src_file != NULL;
 }
 
@@ -895,6 +919,10 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->announce_rounds = s->parameters.announce_rounds;
     params->has_announce_step = true;
     params->announce_step = s->parameters.announce_step;
+    params->has_dirty_sync_threads = true;
+    params->dirty_sync_threads = s->parameters.dirty_sync_threads;
+    params->has_postcopy_subpage_budget = true;
+    params->postcopy_subpage_budget = s->parameters.postcopy_subpage_budget;
 
     if (s->parameters.has_block_bitmap_mapping) {
         params->has_block_bitmap_mapping = true;
@@ -1001,6 +1029,15 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->page_size = qemu_target_page_size();
     info->ram->multifd_bytes = ram_counters.multifd_bytes;
     info->ram->pages_per_second = s->pages_per_second;
+    info->ram->dirty_sync_missed_zero_copy =
+        ram_counters.dirty_sync_missed_zero_copy;
+    info->ram->dirty_sync_log_time = ram_counters.dirty_sync_log_time;
+    info->ram->dirty_sync_bitmap_time = ram_counters.dirty_sync_bitmap_time;
+
+    if (migrate_use_multifd()) {
+        info->multifd_channels = multifd_query_send_channels();
+        info->has_multifd_channels = !!info->multifd_channels;
+    }
 
     if (migrate_use_xbzrle()) {
         info->has_xbzrle_cache = true;
@@ -1031,6 +1068,16 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->cpu_throttle_percentage = cpu_throttle_get_percentage();
     }
 
+    if (cpu_throttle_vcpu_active()) {
+        intList **tail = &info->vcpu_throttle_percentage;
+        CPUState *cpu;
+
+        info->has_vcpu_throttle_percentage = true;
+        CPU_FOREACH(cpu) {
+            QAPI_LIST_APPEND(tail, cpu_throttle_get_vcpu_percentage(cpu));
+        }
+    }
+
     if (s->state != MIGRATION_STATUS_COMPLETED) {
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate = ram_counters.dirty_pages_rate;
@@ -1237,6 +1284,62 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+#ifdef CONFIG_LINUX
+    if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND] &&
+        (!cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+         migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE ||
+         migrate_use_tls())) {
+        error_setg(errp,
+                   "Zero copy only available for non-compressed non-TLS multifd migration");
+        return false;
+    }
+#endif
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
+        if (!cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Postcopy preempt requires postcopy-ram");
+            return false;
+        }
+
+        /*
+         * Compressed pages are sent by the compression threads in their
+         * own order, that doesn't fit the channel assignment of preempt.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
+            error_setg(errp, "Postcopy preempt not compatible with compress");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_PER_VCPU_THROTTLE]) {
+        if (!cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "Per-vCPU throttle requires auto-converge");
+            return false;
+        }
+        if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+            error_setg(errp, "Per-vCPU throttle requires the KVM dirty ring");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        if (cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+            cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Mapped-ram is not compatible with xbzrle, "
+                       "compress, multifd or postcopy-ram");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Zero page detection in multifd threads "
+                   "requires multifd");
+        return false;
+    }
+
     /* incoming side only */
     if (runstate_check(RUN_STATE_INMIGRATE) &&
         !migrate_multifd_is_allowed() &&
@@ -1290,6 +1393,16 @@ MigrationInfo *qmp_query_migrate(Error **errp)
     return info;
 }
 
+MigrationLatencyStats *qmp_query_migrate_stats(Error **errp)
+{
+    MigrationLatencyStats *stats = g_new0(MigrationLatencyStats, 1);
+
+    stats->phases = migration_latency_query();
+    stats->devices = qemu_savevm_query_device_stats();
+
+    return stats;
+}
+
 void qmp_migrate_set_capabilities(MigrationCapabilityStatusList *params,
                                   Error **errp)
 {
@@ -1406,6 +1519,26 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+#ifdef CONFIG_LINUX
+    if (migrate_use_zero_copy_send() &&
+        ((params->has_multifd_compression &&
+          params->multifd_compression != MULTIFD_COMPRESSION_NONE) ||
+         (params->tls_creds && *params->tls_creds))) {
+        error_setg(errp,
+                   "Zero copy only available for non-compressed non-TLS multifd migration");
+        return false;
+    }
+#endif
+
+    if (params->has_dirty_sync_threads &&
+        (params->dirty_sync_threads > MAX_DIRTY_SYNC_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "dirty_sync_threads",
+                   "a value between 0 and "
+                   stringify(MAX_DIRTY_SYNC_THREADS));
+        return false;
+    }
+
     if (params->has_xbzrle_cache_size &&
         (params->xbzrle_cache_size < qemu_target_page_size() ||
          !is_power_of_2(params->xbzrle_cache_size))) {
@@ -1554,6 +1687,12 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_announce_step) {
         dest->announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_postcopy_subpage_budget) {
+        dest->postcopy_subpage_budget = params->postcopy_subpage_budget;
+    }
 
     if (params->has_block_bitmap_mapping) {
         dest->has_block_bitmap_mapping = true;
@@ -1671,6 +1810,12 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_announce_step) {
         s->parameters.announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_postcopy_subpage_budget) {
+        s->parameters.postcopy_subpage_budget = params->postcopy_subpage_budget;
+    }
 
     if (params->has_block_bitmap_mapping) {
         qapi_free_BitmapMigrationNodeAliasList(
@@ -1801,6 +1946,7 @@ static void migrate_fd_cleanup(MigrationState *s)
         qemu_mutex_lock_iothread();
 
         multifd_save_cleanup();
+        postcopy_preempt_close_src(s);
         qemu_mutex_lock(&s->qemu_file_lock);
         tmp = s->to_dst_file;
         s->to_dst_file = NULL;
@@ -1883,6 +2029,9 @@ static void migrate_fd_cancel(MigrationState *s)
             /* shutdown the rp socket, so causing the rp thread to shutdown */
             qemu_file_shutdown(s->rp_state.from_dst_file);
         }
+        if (s->postcopy_qemufile_src) {
+            qemu_file_shutdown(s->postcopy_qemufile_src);
+        }
     }
 
     do {
@@ -2304,6 +2453,8 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         exec_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         if (!(has_resume && resume)) {
             yank_unregister_instance(MIGRATION_YANK_INSTANCE);
@@ -2360,6 +2511,33 @@ bool migrate_postcopy_ram(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_RAM];
 }
 
+bool migrate_postcopy_preempt(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
+}
+
+bool migrate_per_vcpu_throttle(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PER_VCPU_THROTTLE];
+}
+
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
 bool migrate_postcopy(void)
 {
     return migrate_postcopy_ram() || migrate_dirty_bitmaps();
@@ -2482,6 +2660,15 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2528,6 +2715,24 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
+uint64_t migrate_postcopy_subpage_budget(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_subpage_budget;
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -2582,6 +2787,26 @@ bool migrate_use_block_incremental(void)
     return s->parameters.block_incremental;
 }
 
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_COPY_SEND];
+}
+#endif
+
+bool migrate_use_tls(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.tls_creds && *s->parameters.tls_creds;
+}
+
 bool migrate_background_snapshot(void)
 {
     MigrationState *s;
@@ -2930,6 +3155,17 @@ static int postcopy_start(MigrationState *ms)
     int64_t bandwidth = migrate_max_postcopy_bandwidth();
     bool restart_block = false;
     int cur_state = MIGRATION_STATUS_ACTIVE;
+    Error *err = NULL;
+
+    /*
+     * Connect the preempt channel while the VM is still running, so that
+     * it doesn't add to the downtime.
+     */
+    if (postcopy_preempt_setup(ms, &err)) {
+        error_report_err(err);
+        return -1;
+    }
+
     if (!migrate_pause_before_switchover()) {
         migrate_set_state(&ms->state, MIGRATION_STATUS_ACTIVE,
                           MIGRATION_STATUS_POSTCOPY_ACTIVE);
@@ -2971,6 +3207,15 @@ static int postcopy_start(MigrationState *ms)
      * that are dirty
      */
     if (migrate_postcopy_ram()) {
+        /*
+         * Give the iterative devices a chance to send data that makes
+         * some of the discards unnecessary, see postcopy-subpage-budget.
+         */
+        if (migrate_postcopy_subpage_budget() &&
+            qemu_savevm_state_postcopy_prepare(ms->to_dst_file)) {
+            error_report("postcopy prepare failed");
+            goto fail;
+        }
         if (ram_postcopy_send_discard_bitmap(ms)) {
             error_report("postcopy send discard bitmap failed");
             goto fail;
@@ -3364,6 +3609,8 @@ static MigThrError postcopy_pause(MigrationState *s)
          * taking more mutex (yank_lock) within qemu_file_lock.  TL;DR: we make
          * the qemu_file_lock critical section as small as possible.
          */
+        postcopy_preempt_close_src(s);
+
         assert(s->to_dst_file);
         migration_ioc_unregister_yank_from_file(s->to_dst_file);
         qemu_mutex_lock(&s->qemu_file_lock);
@@ -3399,6 +3646,13 @@ static MigThrError postcopy_pause(MigrationState *s)
 
             /* Do the resume logic */
             if (postcopy_do_resume(s) == 0) {
+                Error *local_err = NULL;
+
+                /* Urgent pages use the main channel if this fails */
+                if (postcopy_preempt_setup(s, &local_err)) {
+                    error_report_err(local_err);
+                }
+
                 /* Let's continue! */
                 trace_postcopy_pause_continued();
                 return MIG_THR_ERR_RECOVERED;
@@ -3431,6 +3685,9 @@ static MigThrError migration_detect_error(MigrationState *s)
 
     /* Try to detect any file errors */
     ret = qemu_file_get_error_obj(s->to_dst_file, &local_error);
+    if (!ret && s->postcopy_qemufile_src) {
+        ret = qemu_file_get_error_obj(s->postcopy_qemufile_src, &local_error);
+    }
     if (!ret) {
         /* Everything is fine */
         assert(!local_error);
@@ -3772,6 +4029,11 @@ static void *migration_thread(void *opaque)
     object_ref(OBJECT(s));
     update_iteration_initial_status(s);
 
+    /* postcopy and COLO switch the stream around, keep them synchronous */
+    if (s->async_writer && !migrate_postcopy() && !migrate_colo_enabled()) {
+        qemu_file_start_writer(s->to_dst_file);
+    }
+
     qemu_savevm_state_header(s->to_dst_file);
 
     /*
@@ -4128,6 +4390,8 @@ static Property migration_properties[] = {
                      send_configuration, true),
     DEFINE_PROP_BOOL("send-section-footer", MigrationState,
                      send_section_footer, true),
+    DEFINE_PROP_BOOL("x-async-writer", MigrationState,
+                     async_writer, false),
     DEFINE_PROP_BOOL("decompress-error-check", MigrationState,
                       decompress_error_check, true),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
@@ -4176,6 +4440,12 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("multifd-zstd-level", MigrationState,
                       parameters.multifd_zstd_level,
                       DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_SIZE("postcopy-subpage-budget", MigrationState,
+                      parameters.postcopy_subpage_budget,
+                      DEFAULT_MIGRATE_POSTCOPY_SUBPAGE_BUDGET),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -4213,6 +4483,17 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+#ifdef CONFIG_LINUX
+    DEFINE_PROP_MIG_CAP("x-zero-copy-send",
+            MIGRATION_CAPABILITY_ZERO_COPY_SEND),
+#endif
+    DEFINE_PROP_MIG_CAP("x-multifd-zero-page",
+            MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE),
+    DEFINE_PROP_MIG_CAP("x-postcopy-preempt",
+            MIGRATION_CAPABILITY_POSTCOPY_PREEMPT),
+    DEFINE_PROP_MIG_CAP("x-per-vcpu-throttle",
+            MIGRATION_CAPABILITY_PER_VCPU_THROTTLE),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
 
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -4280,6 +4561,8 @@ static void migration_instance_init(Object *obj)
     params->has_announce_max = true;
     params->has_announce_rounds = true;
     params->has_announce_step = true;
+    params->has_dirty_sync_threads = true;
+    params->has_postcopy_subpage_budget = true;
 
     qemu_sem_init(&ms->postcopy_pause_sem, 0);
     qemu_sem_init(&ms->postcopy_pause_rp_sem, 0);
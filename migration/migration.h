@@ -83,6 +83,14 @@ struct MigrationIncomingState {
     RAMBlock *last_rb;
     void     *postcopy_tmp_page;
     void     *postcopy_tmp_zero_page;
+    /*
+     * Postcopy preempt channel, its loading thread and the temporary
+     * page used by that thread
+     */
+    QEMUFile *postcopy_qemufile_dst;
+    bool      have_preempt_thread;
+    QemuThread preempt_thread;
+    void     *postcopy_preempt_tmp_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
     GArray   *postcopy_remote_fds;
 
@@ -156,6 +164,12 @@ struct MigrationState {
     QEMUBH *cleanup_bh;
     /* Protected by qemu_file_lock */
     QEMUFile *to_dst_file;
+    /*
+     * Channel used for the pages requested by the destination during
+     * postcopy, when postcopy-preempt is enabled.  Only set by the
+     * migration thread.  Protected by qemu_file_lock.
+     */
+    QEMUFile *postcopy_qemufile_src;
     QIOChannelBuffer *bioc;
     /*
      * Protects to_dst_file/from_dst_file pointers.  We need to make sure we
@@ -282,6 +296,13 @@ struct MigrationState {
      */
     bool decompress_error_check;
 
+    /*
+     * Write the main migration stream from a separate thread, so that
+     * producing the data and sending it overlap (see
+     * qemu_file_start_writer()).
+     */
+    bool async_writer;
+
     /*
      * This decides the size of guest memory chunk that will be used
      * to track dirty bitmap clearing.  The size of memory chunk will
@@ -326,6 +347,9 @@ bool migrate_postcopy(void);
 
 bool migrate_release_ram(void);
 bool migrate_postcopy_ram(void);
+bool migrate_postcopy_preempt(void);
+bool migrate_per_vcpu_throttle(void);
+bool migrate_mapped_ram(void);
 bool migrate_zero_blocks(void);
 bool migrate_dirty_bitmaps(void);
 bool migrate_ignore_shared(void);
@@ -333,11 +357,20 @@ bool migrate_validate_uuid(void);
 
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
+bool migrate_multifd_zero_page(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+int migrate_dirty_sync_threads(void);
+uint64_t migrate_postcopy_subpage_budget(void);
+
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void);
+#else
+#define migrate_use_zero_copy_send() (false)
+#endif
 
 int migrate_use_xbzrle(void);
 uint64_t migrate_xbzrle_cache_size(void);
@@ -345,6 +378,7 @@ bool migrate_colo_enabled(void);
 
 bool migrate_use_block(void);
 bool migrate_use_block_incremental(void);
+bool migrate_use_tls(void);
 int migrate_max_cpu_throttle(void);
 bool migrate_use_return_path(void);
 
@@ -11,6 +11,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
 #include "qemu/rcu.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
@@ -24,6 +25,7 @@
 #include "qemu-file.h"
 #include "trace.h"
 #include "multifd.h"
+#include "latency.h"
 
 #include "qemu/yank.h"
 #include "io/channel-socket.h"
@@ -95,7 +97,10 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
 /**
  * nocomp_send_write: do the actual write of the data
  *
- * For no compression we just have to write the data.
+ * For no compression we just have to write the data.  When zero copy
+ * is enabled the pages are handed to the kernel without being copied;
+ * multifd_send_sync_main() is then responsible for waiting until the
+ * kernel is done with them.
  *
  * Returns 0 for success or -1 for error
  *
@@ -105,7 +110,8 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used, NULL, 0,
+                                       p->write_flags, errp);
 }
 
 /**
@@ -177,6 +183,90 @@ void multifd_register_ops(int method, MultiFDMethods *ops)
     multifd_ops[method] = ops;
 }
 
+/**
+ * multifd_send_zero_page_detect: split the zero pages out of a packet
+ *
+ * Sorts the offset array of the pages of @p so that the pages with
+ * data come first and the zero pages come last.  Only pages with
+ * data are left in the iov, so they are the only ones handed to the
+ * send methods.  Must be called with p->mutex held.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    RAMBlock *block = pages->block;
+    size_t page_size = qemu_target_page_size();
+    uint32_t i = 0;
+    uint32_t normal = pages->used;
+
+    while (i < normal) {
+        ram_addr_t offset = pages->offset[i];
+
+        if (!buffer_is_zero(block->host + offset, page_size)) {
+            i++;
+            continue;
+        }
+        /* swap with the last page that has not been checked yet */
+        normal--;
+        pages->offset[i] = pages->offset[normal];
+        pages->offset[normal] = offset;
+    }
+
+    for (i = 0; i < normal; i++) {
+        pages->iov[i].iov_base = block->host + pages->offset[i];
+        pages->iov[i].iov_len = page_size;
+    }
+
+    pages->zero_num = pages->used - normal;
+    pages->used = normal;
+    p->pending_zero_pages += pages->zero_num;
+}
+
+/**
+ * multifd_send_account_zero_pages: account the zero pages of a channel
+ *
+ * Pages are accounted as normal pages when they are queued.  Fix the
+ * counters for the ones that the channel thread found to be zero.
+ * Must be called from the migration thread with p->mutex held.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_account_zero_pages(MultiFDSendParams *p)
+{
+    uint64_t zero_bytes = p->pending_zero_pages * qemu_target_page_size();
+
+    ram_counters.duplicate += p->pending_zero_pages;
+    ram_counters.normal -= p->pending_zero_pages;
+    ram_counters.multifd_bytes -= zero_bytes;
+    ram_counters.transferred -= zero_bytes;
+    p->pending_zero_pages = 0;
+}
+
+/**
+ * multifd_recv_zero_pages: clear the zero pages of a received packet
+ *
+ * Memory that was never written on the destination already reads as
+ * zero, so only pages that have data are cleared.  This avoids
+ * faulting in memory for pages that are zero on both sides.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_recv_zero_pages(MultiFDRecvParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    uint32_t i;
+
+    for (i = pages->used; i < pages->used + pages->zero_num; i++) {
+        struct iovec *iov = &pages->iov[i];
+
+        if (!buffer_is_zero(iov->iov_base, iov->iov_len)) {
+            memset(iov->iov_base, 0, iov->iov_len);
+        }
+    }
+}
+
 static int multifd_send_initial_packet(MultiFDSendParams *p, Error **errp)
 {
     MultiFDInit_t msg = {};
@@ -253,6 +343,7 @@ static MultiFDPages_t *multifd_pages_init(size_t size)
 static void multifd_pages_clear(MultiFDPages_t *pages)
 {
     pages->used = 0;
+    pages->zero_num = 0;
     pages->allocated = 0;
     pages->packet_num = 0;
     pages->block = NULL;
@@ -271,6 +362,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->pages_used = cpu_to_be32(p->pages->used);
+    packet->zero_pages = cpu_to_be32(p->pages->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -278,7 +370,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
     }
 
-    for (i = 0; i < p->pages->used; i++) {
+    for (i = 0; i < p->pages->used + p->pages->zero_num; i++) {
         /* there are architectures where ram_addr_t is 32 bit */
         uint64_t temp = p->pages->offset[i];
 
@@ -339,10 +431,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->pages->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->pages->zero_num > packet->pages_alloc - p->pages->used) {
+        error_setg(errp, "multifd: received packet "
+                   "with %d zero pages and expected maximum zero pages are %d",
+                   p->pages->zero_num, packet->pages_alloc - p->pages->used) ;
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->pages->used == 0) {
+    if (p->pages->used + p->pages->zero_num == 0) {
         return 0;
     }
 
@@ -355,7 +455,7 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
-    for (i = 0; i < p->pages->used; i++) {
+    for (i = 0; i < p->pages->used + p->pages->zero_num; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
 
         if (offset > (block->used_length - qemu_target_page_size())) {
@@ -437,6 +537,7 @@ static int multifd_send_pages(QEMUFile *f)
         }
         if (!p->pending_job) {
             p->pending_job++;
+            multifd_send_account_zero_pages(p);
             next_channel = (i + 1) % migrate_multifd_channels();
             break;
         }
@@ -489,6 +590,31 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
     return 1;
 }
 
+MultiFDChannelStatsList *multifd_query_send_channels(void)
+{
+    MultiFDChannelStatsList *head = NULL, **tail = &head;
+    int i;
+
+    if (!multifd_send_state) {
+        return NULL;
+    }
+
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        MultiFDChannelStats *stats = g_new0(MultiFDChannelStats, 1);
+
+        qemu_mutex_lock(&p->mutex);
+        stats->id = p->id;
+        stats->packets = p->num_packets;
+        stats->pages = p->num_pages;
+        stats->bytes = p->num_bytes;
+        qemu_mutex_unlock(&p->mutex);
+        QAPI_LIST_APPEND(tail, stats);
+    }
+
+    return head;
+}
+
 static void multifd_send_terminate_threads(Error *err)
 {
     int i;
@@ -578,13 +704,33 @@ void multifd_save_cleanup(void)
     multifd_send_state = NULL;
 }
 
+static int multifd_zero_copy_flush(QIOChannel *c)
+{
+    int ret;
+    Error *err = NULL;
+
+    ret = qio_channel_flush(c, &err);
+    if (ret < 0) {
+        error_report_err(err);
+        return -1;
+    }
+    if (ret == 1) {
+        ram_counters.dirty_sync_missed_zero_copy++;
+    }
+
+    return ret;
+}
+
 void multifd_send_sync_main(QEMUFile *f)
 {
     int i;
+    bool flush_zero_copy;
+    int64_t start;
 
     if (!migrate_use_multifd()) {
         return;
     }
+    start = migration_latency_start();
     if (multifd_send_state->pages->used) {
         if (multifd_send_pages(f) < 0) {
             error_report("%s: multifd_send_pages fail", __func__);
@@ -613,12 +759,40 @@ void multifd_send_sync_main(QEMUFile *f)
         qemu_mutex_unlock(&p->mutex);
         qemu_sem_post(&p->sem);
     }
+
+    /*
+     * When using zero-copy, it's necessary to flush the pages before any of
+     * the pages can be sent again, so we'll make sure the new version of the
+     * pages will always arrive _later_ than the old pages.
+     *
+     * Currently we achieve this by flushing the zero-copy requested writes
+     * per ram iteration, but in the future we could potentially optimize it
+     * to be less frequent, e.g. only after we finished one whole scanning of
+     * all the dirty bitmaps.
+     */
+    flush_zero_copy = migrate_use_zero_copy_send();
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_send_account_zero_pages(p);
+        qemu_mutex_unlock(&p->mutex);
+
+        if (flush_zero_copy && p->c && (multifd_zero_copy_flush(p->c) < 0)) {
+            Error *local_err = NULL;
+
+            error_setg(&local_err, "multifd %d: zero copy flush failed",
+                       p->id);
+            multifd_send_terminate_threads(local_err);
+            error_free(local_err);
+            return;
+        }
     }
+    migration_latency_record(MIGRATION_PHASE_MULTIFD_FLUSH, start);
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
@@ -649,9 +823,16 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint32_t used = p->pages->used;
+            uint32_t zero_num;
             uint64_t packet_num = p->packet_num;
             flags = p->flags;
 
+            if (used && migrate_multifd_zero_page()) {
+                multifd_send_zero_page_detect(p);
+                used = p->pages->used;
+            }
+            zero_num = p->pages->zero_num;
+
             if (used) {
                 ret = multifd_send_state->ops->send_prepare(p, used,
                                                             &local_err);
@@ -665,10 +846,11 @@ static void *multifd_send_thread(void *opaque)
             p->num_packets++;
             p->num_pages += used;
             p->pages->used = 0;
+            p->pages->zero_num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, used, flags,
+            trace_multifd_send(p->id, packet_num, used, zero_num, flags,
                                p->next_packet_size);
 
             ret = qio_channel_write_all(p->c, (void *)p->packet,
@@ -686,6 +868,7 @@ static void *multifd_send_thread(void *opaque)
 
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
+            p->num_bytes += p->packet_len + (used ? p->next_packet_size : 0);
             qemu_mutex_unlock(&p->mutex);
 
             if (flags & MULTIFD_FLAG_SYNC) {
@@ -855,6 +1038,13 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
     if (qio_task_propagate_error(task, &local_err)) {
         goto cleanup;
     } else {
+        if (migrate_use_zero_copy_send() &&
+            !qio_channel_has_feature(sioc,
+                                     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&local_err, "multifd %d: zero copy send is not "
+                       "supported by the host", p->id);
+            goto cleanup;
+        }
         p->c = QIO_CHANNEL(sioc);
         qio_channel_set_delay(p->c, false);
         p->running = true;
@@ -920,6 +1110,11 @@ int multifd_save_setup(Error **errp)
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
         p->name = g_strdup_printf("multifdsend_%d", i);
         p->tls_hostname = g_strdup(s->hostname);
+        if (migrate_use_zero_copy_send()) {
+            p->write_flags = QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+        } else {
+            p->write_flags = 0;
+        }
         socket_send_channel_create(multifd_new_send_channel_async, p);
     }
 
@@ -1068,6 +1263,7 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t zero_num;
         uint32_t flags;
 
         if (p->quit) {
@@ -1091,10 +1287,11 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->used;
+        zero_num = p->pages->zero_num;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, used, flags,
+        trace_multifd_recv(p->id, p->packet_num, used, zero_num, flags,
                            p->next_packet_size);
         p->num_packets++;
         p->num_pages += used;
@@ -1107,6 +1304,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        if (zero_num) {
+            multifd_recv_zero_pages(p);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -21,9 +21,12 @@
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
+#include "qemu-file-channel.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
 #include "ram.h"
+#include "socket.h"
+#include "yank_functions.h"
 #include "qapi/error.h"
 #include "qemu/notify.h"
 #include "qemu/rcu.h"
@@ -532,6 +535,15 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
 {
     trace_postcopy_ram_incoming_cleanup_entry();
 
+    if (mis->have_preempt_thread) {
+        /*
+         * The source ends the preempt channel once it has sent every
+         * page, wait for the thread to place the last ones.
+         */
+        qemu_thread_join(&mis->preempt_thread);
+        mis->have_preempt_thread = false;
+    }
+
     if (mis->have_fault_thread) {
         Error *local_err = NULL;
 
@@ -574,6 +586,10 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         munmap(mis->postcopy_tmp_zero_page, mis->largest_page_size);
         mis->postcopy_tmp_zero_page = NULL;
     }
+    if (mis->postcopy_preempt_tmp_page) {
+        munmap(mis->postcopy_preempt_tmp_page, mis->largest_page_size);
+        mis->postcopy_preempt_tmp_page = NULL;
+    }
     trace_postcopy_ram_incoming_cleanup_blocktime(
             get_postcopy_total_blocktime());
 
@@ -1128,6 +1144,22 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     }
     memset(mis->postcopy_tmp_zero_page, '\0', mis->largest_page_size);
 
+    if (migrate_postcopy_preempt()) {
+        mis->postcopy_preempt_tmp_page = mmap(NULL, mis->largest_page_size,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS,
+                                              -1, 0);
+        if (mis->postcopy_preempt_tmp_page == MAP_FAILED) {
+            int e = errno;
+            mis->postcopy_preempt_tmp_page = NULL;
+            error_report("%s: Failed to map postcopy_preempt_tmp_page %s",
+                         __func__, strerror(e));
+            return -e;
+        }
+        /* The preempt channel may have been connected already */
+        postcopy_preempt_thread_start(mis);
+    }
+
     trace_postcopy_ram_enable_notify();
 
     return 0;
@@ -1443,3 +1475,170 @@ void postcopy_unregister_shared_ufd(struct PostCopyFD *pcfd)
         }
     }
 }
+
+/*
+ * Postcopy preempt channel
+ *
+ * The pages requested by the destination page faults are sent over a
+ * separate socket, so that they don't have to wait behind the
+ * background pages already queued on the main channel.  The source
+ * connects it when postcopy starts, that is after the main channel and
+ * all the multifd channels have been accepted, so that the destination
+ * can tell it apart from the others.  The destination loads it from a
+ * dedicated thread, concurrently with the listen thread.
+ */
+
+/**
+ * postcopy_preempt_setup: connect the postcopy preempt channel
+ *
+ * Returns 0 for success (or if there is nothing to do) and -1 for
+ * error
+ *
+ * @s: current migration state
+ * @errp: pointer to an error
+ */
+int postcopy_preempt_setup(MigrationState *s, Error **errp)
+{
+    QIOChannel *ioc;
+    QEMUFile *file;
+
+    if (!migrate_postcopy_preempt() || s->postcopy_qemufile_src) {
+        return 0;
+    }
+
+    if (migrate_use_tls()) {
+        error_setg(errp, "Postcopy preempt does not support TLS");
+        return -1;
+    }
+
+    ioc = socket_send_channel_create_sync(errp);
+    if (!ioc) {
+        return -1;
+    }
+
+    qio_channel_set_name(ioc, "migration-postcopy-preempt");
+    migration_ioc_register_yank(ioc);
+    file = qemu_fopen_channel_output(ioc);
+    object_unref(OBJECT(ioc));
+
+    qemu_mutex_lock(&s->qemu_file_lock);
+    s->postcopy_qemufile_src = file;
+    qemu_mutex_unlock(&s->qemu_file_lock);
+
+    trace_postcopy_preempt_new_channel();
+    return 0;
+}
+
+/**
+ * postcopy_preempt_close_src: close the source side preempt channel
+ *
+ * Called by the migration thread when the channels are broken, or
+ * once it has finished.
+ *
+ * @s: current migration state
+ */
+void postcopy_preempt_close_src(MigrationState *s)
+{
+    QEMUFile *file;
+
+    if (!s->postcopy_qemufile_src) {
+        return;
+    }
+
+    migration_ioc_unregister_yank_from_file(s->postcopy_qemufile_src);
+    qemu_mutex_lock(&s->qemu_file_lock);
+    file = s->postcopy_qemufile_src;
+    s->postcopy_qemufile_src = NULL;
+    qemu_mutex_unlock(&s->qemu_file_lock);
+
+    qemu_file_shutdown(file);
+    qemu_fclose(file);
+}
+
+static void *postcopy_preempt_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    int ret;
+
+    trace_postcopy_preempt_thread_entry();
+    rcu_register_thread();
+
+    /* The source terminates the channel with RAM_SAVE_FLAG_EOS */
+    WITH_RCU_READ_LOCK_GUARD() {
+        ret = ram_load_postcopy(mis->postcopy_qemufile_dst,
+                                RAM_CHANNEL_POSTCOPY);
+    }
+
+    rcu_unregister_thread();
+    trace_postcopy_preempt_thread_exit(ret);
+    return NULL;
+}
+
+/**
+ * postcopy_preempt_thread_start: start loading the preempt channel
+ *
+ * The thread can only start once both the channel is connected and
+ * the postcopy RAM setup is done; this is called when either of them
+ * happens, from the main thread.
+ *
+ * @mis: current incoming migration state
+ */
+void postcopy_preempt_thread_start(MigrationIncomingState *mis)
+{
+    if (mis->have_preempt_thread || !mis->postcopy_qemufile_dst ||
+        !mis->postcopy_preempt_tmp_page) {
+        return;
+    }
+
+    qemu_thread_create(&mis->preempt_thread, "postcopy/preempt",
+                       postcopy_preempt_thread, mis, QEMU_THREAD_JOINABLE);
+    mis->have_preempt_thread = true;
+}
+
+/**
+ * postcopy_preempt_new_channel: the preempt channel has been accepted
+ *
+ * @mis: current incoming migration state
+ * @file: QEMUFile for the new channel
+ */
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file)
+{
+    if (mis->postcopy_qemufile_dst) {
+        error_report("%s: postcopy preempt channel already set up; ignoring",
+                     __func__);
+        migration_ioc_unregister_yank_from_file(file);
+        qemu_fclose(file);
+        return;
+    }
+
+    /* The preempt thread does blocking reads */
+    qemu_file_set_blocking(file, true);
+    mis->postcopy_qemufile_dst = file;
+    trace_postcopy_preempt_new_channel();
+
+    postcopy_preempt_thread_start(mis);
+}
+
+/**
+ * postcopy_preempt_incoming_stop: drop the destination preempt channel
+ *
+ * Used when the channels are broken and when the incoming migration is
+ * torn down.  The source connects a new one when postcopy resumes.
+ *
+ * @mis: current incoming migration state
+ */
+void postcopy_preempt_incoming_stop(MigrationIncomingState *mis)
+{
+    if (!mis->postcopy_qemufile_dst) {
+        return;
+    }
+
+    qemu_file_shutdown(mis->postcopy_qemufile_dst);
+    if (mis->have_preempt_thread) {
+        qemu_thread_join(&mis->preempt_thread);
+        mis->have_preempt_thread = false;
+    }
+    migration_ioc_unregister_yank_from_file(mis->postcopy_qemufile_dst);
+    qemu_fclose(mis->postcopy_qemufile_dst);
+    mis->postcopy_qemufile_dst = NULL;
+}
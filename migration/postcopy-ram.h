@@ -179,4 +179,23 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd, uint64_t client_addr,
 int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                  uint64_t client_addr, uint64_t offset);
 
+/*
+ * Channels that carry RAM pages.  With postcopy-preempt, the pages
+ * requested by the destination use their own channel.
+ */
+enum PostcopyChannels {
+    RAM_CHANNEL_PRECOPY = 0,
+    RAM_CHANNEL_POSTCOPY = 1,
+    RAM_CHANNEL_MAX,
+};
+
+/* Source side of the postcopy preempt channel */
+int postcopy_preempt_setup(MigrationState *s, Error **errp);
+void postcopy_preempt_close_src(MigrationState *s);
+
+/* Destination side of the postcopy preempt channel */
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file);
+void postcopy_preempt_thread_start(MigrationIncomingState *mis);
+void postcopy_preempt_incoming_stop(MigrationIncomingState *mis);
+
 #endif
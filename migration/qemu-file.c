@@ -25,14 +25,40 @@
 #include <zlib.h>
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
+#include "qemu/thread.h"
 #include "migration.h"
 #include "qemu-file.h"
 #include "trace.h"
 #include "qapi/error.h"
+#include "io/channel-file.h"
 
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN_CONST(IOV_MAX, 64)
 
+/*
+ * Second buffer of a QEMUFile whose full buffers are written out by a
+ * separate thread, see qemu_file_start_writer().
+ */
+typedef struct QEMUFileWriter {
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    /* a batch was handed over and is not written yet */
+    bool busy;
+    bool quit;
+
+    uint8_t buf[IO_BUF_SIZE];
+    DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
+    struct iovec iov[MAX_IOV_SIZE];
+    unsigned int iovcnt;
+    int64_t pos;
+
+    /* result of the last batch */
+    ssize_t expect;
+    ssize_t ret;
+    Error *err;
+} QEMUFileWriter;
+
 struct QEMUFile {
     const QEMUFileOps *ops;
     const QEMUFileHooks *hooks;
@@ -57,6 +83,8 @@ struct QEMUFile {
     bool shutdown;
     /* Whether opaque points to a QIOChannel */
     bool has_ioc;
+
+    QEMUFileWriter *writer;
 };
 
 /*
@@ -176,39 +204,161 @@ bool qemu_file_is_writable(QEMUFile *f)
     return f->ops->writev_buffer;
 }
 
-static void qemu_iovec_release_ram(QEMUFile *f)
+static void qemu_iovec_release_ram(struct iovec *f_iov, unsigned int iovcnt,
+                                   unsigned long *may_free)
 {
     struct iovec iov;
     unsigned long idx;
 
     /* Find and release all the contiguous memory ranges marked as may_free. */
-    idx = find_next_bit(f->may_free, f->iovcnt, 0);
-    if (idx >= f->iovcnt) {
+    idx = find_next_bit(may_free, iovcnt, 0);
+    if (idx >= iovcnt) {
         return;
     }
-    iov = f->iov[idx];
+    iov = f_iov[idx];
 
     /* The madvise() in the loop is called for iov within a continuous range and
      * then reinitialize the iov. And in the end, madvise() is called for the
      * last iov.
      */
-    while ((idx = find_next_bit(f->may_free, f->iovcnt, idx + 1)) < f->iovcnt) {
+    while ((idx = find_next_bit(may_free, iovcnt, idx + 1)) < iovcnt) {
         /* check for adjacent buffer and coalesce them */
-        if (iov.iov_base + iov.iov_len == f->iov[idx].iov_base) {
-            iov.iov_len += f->iov[idx].iov_len;
+        if (iov.iov_base + iov.iov_len == f_iov[idx].iov_base) {
+            iov.iov_len += f_iov[idx].iov_len;
             continue;
         }
         if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
         }
-        iov = f->iov[idx];
+        iov = f_iov[idx];
     }
     if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
     }
-    memset(f->may_free, 0, sizeof(f->may_free));
+    bitmap_zero(may_free, MAX_IOV_SIZE);
+}
+
+static void *qemu_file_writer_thread(void *opaque)
+{
+    QEMUFile *f = opaque;
+    QEMUFileWriter *w = f->writer;
+
+    qemu_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->busy && !w->quit) {
+            qemu_cond_wait(&w->cond, &w->lock);
+        }
+        if (!w->busy) {
+            break;
+        }
+        qemu_mutex_unlock(&w->lock);
+
+        w->ret = f->ops->writev_buffer(f->opaque, w->iov, w->iovcnt, w->pos,
+                                       &w->err);
+        qemu_iovec_release_ram(w->iov, w->iovcnt, w->may_free);
+
+        qemu_mutex_lock(&w->lock);
+        w->busy = false;
+        qemu_cond_signal(&w->cond);
+    }
+    qemu_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+/* Wait for the batch in flight, and pick up its result */
+static void qemu_file_writer_wait(QEMUFile *f)
+{
+    QEMUFileWriter *w = f->writer;
+
+    qemu_mutex_lock(&w->lock);
+    while (w->busy) {
+        qemu_cond_wait(&w->cond, &w->lock);
+    }
+    qemu_mutex_unlock(&w->lock);
+
+    if (w->ret != w->expect) {
+        qemu_file_set_error_obj(f, w->ret < 0 ? w->ret : -EIO, w->err);
+    }
+    w->err = NULL;
+    w->expect = w->ret = 0;
+}
+
+/*
+ * Hand the buffer over to the writer thread, so that the caller can
+ * fill it again while the data is being sent.
+ */
+static void qemu_file_writer_submit(QEMUFile *f)
+{
+    QEMUFileWriter *w = f->writer;
+    uint8_t *base;
+    unsigned int i;
+
+    qemu_file_writer_wait(f);
+    if (f->last_error) {
+        return;
+    }
+
+    memcpy(w->buf, f->buf, f->buf_index);
+    for (i = 0; i < f->iovcnt; i++) {
+        base = f->iov[i].iov_base;
+        if (base >= f->buf && base < f->buf + IO_BUF_SIZE) {
+            base = w->buf + (base - f->buf);
+        }
+        w->iov[i].iov_base = base;
+        w->iov[i].iov_len = f->iov[i].iov_len;
+    }
+    bitmap_copy(w->may_free, f->may_free, MAX_IOV_SIZE);
+    w->iovcnt = f->iovcnt;
+    w->pos = f->pos;
+    w->expect = iov_size(w->iov, w->iovcnt);
+    f->pos += w->expect;
+
+    qemu_mutex_lock(&w->lock);
+    w->busy = true;
+    qemu_cond_signal(&w->cond);
+    qemu_mutex_unlock(&w->lock);
+}
+
+/*
+ * Write out full buffers of @f from a separate thread, overlapping the
+ * writes with the production of more data.  Explicit qemu_fflush()
+ * calls still return only once everything has been written.
+ */
+void qemu_file_start_writer(QEMUFile *f)
+{
+    QEMUFileWriter *w;
+
+    /* RDMA hooks send pages on their own and need a synchronous stream */
+    if (f->writer || f->hooks || !qemu_file_is_writable(f)) {
+        return;
+    }
+
+    w = g_new0(QEMUFileWriter, 1);
+    qemu_mutex_init(&w->lock);
+    qemu_cond_init(&w->cond);
+    f->writer = w;
+    qemu_thread_create(&w->thread, "mig/writer", qemu_file_writer_thread,
+                       f, QEMU_THREAD_JOINABLE);
+}
+
+static void qemu_file_stop_writer(QEMUFile *f)
+{
+    QEMUFileWriter *w = f->writer;
+
+    qemu_mutex_lock(&w->lock);
+    w->quit = true;
+    qemu_cond_signal(&w->cond);
+    qemu_mutex_unlock(&w->lock);
+    qemu_thread_join(&w->thread);
+
+    qemu_file_writer_wait(f);
+    qemu_cond_destroy(&w->cond);
+    qemu_mutex_destroy(&w->lock);
+    g_free(w);
+    f->writer = NULL;
 }
 
 /**
@@ -227,6 +377,9 @@ void qemu_fflush(QEMUFile *f)
         return;
     }
 
+    if (f->writer) {
+        qemu_file_writer_wait(f);
+    }
     if (f->shutdown) {
         return;
     }
@@ -235,7 +388,7 @@ void qemu_fflush(QEMUFile *f)
         ret = f->ops->writev_buffer(f->opaque, f->iov, f->iovcnt, f->pos,
                                     &local_error);
 
-        qemu_iovec_release_ram(f);
+        qemu_iovec_release_ram(f->iov, f->iovcnt, f->may_free);
     }
 
     if (ret >= 0) {
@@ -251,6 +404,20 @@ void qemu_fflush(QEMUFile *f)
     f->iovcnt = 0;
 }
 
+/* Flush a full buffer, in the background if there is a writer thread */
+static void qemu_fflush_full(QEMUFile *f)
+{
+    if (!f->writer || f->shutdown) {
+        qemu_fflush(f);
+        return;
+    }
+
+    qemu_file_writer_submit(f);
+    f->buf_index = 0;
+    f->iovcnt = 0;
+    bitmap_zero(f->may_free, MAX_IOV_SIZE);
+}
+
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags)
 {
     int ret = 0;
@@ -381,6 +548,9 @@ int qemu_fclose(QEMUFile *f)
 {
     int ret;
     qemu_fflush(f);
+    if (f->writer) {
+        qemu_file_stop_writer(f);
+    }
     ret = qemu_file_get_error(f);
 
     if (f->ops->close) {
@@ -432,7 +602,7 @@ static int add_to_iovec(QEMUFile *f, const uint8_t *buf, size_t size,
     }
 
     if (f->iovcnt >= MAX_IOV_SIZE) {
-        qemu_fflush(f);
+        qemu_fflush_full(f);
         return 1;
     }
 
@@ -444,7 +614,7 @@ static void add_buf_to_iovec(QEMUFile *f, size_t len)
     if (!add_to_iovec(f, f->buf + f->buf_index, len, false)) {
         f->buf_index += len;
         if (f->buf_index == IO_BUF_SIZE) {
-            qemu_fflush(f);
+            qemu_fflush_full(f);
         }
     }
 }
@@ -866,3 +1036,128 @@ QIOChannel *qemu_file_get_ioc(QEMUFile *file)
 {
     return file->has_ioc ? QIO_CHANNEL(file->opaque) : NULL;
 }
+
+/*
+ * Positioned I/O, used when RAM pages live at fixed offsets of a file
+ * (mapped-ram capability).  Only a QIOChannelFile on a seekable file
+ * supports it.
+ */
+static int qemu_file_get_seekable_fd(QEMUFile *f)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    int fd;
+
+    if (!ioc || !object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE)) {
+        return -1;
+    }
+    fd = QIO_CHANNEL_FILE(ioc)->fd;
+    if (lseek(fd, 0, SEEK_CUR) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+bool qemu_file_is_seekable(QEMUFile *f)
+{
+    return qemu_file_get_seekable_fd(f) >= 0;
+}
+
+/*
+ * Offset in the underlying file of the next byte the stream will write
+ * or read, taking the buffer into account.
+ */
+int64_t qemu_get_offset(QEMUFile *f)
+{
+    int fd = qemu_file_get_seekable_fd(f);
+    off_t pos;
+
+    assert(fd >= 0);
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+        return lseek(fd, 0, SEEK_CUR);
+    }
+    pos = lseek(fd, 0, SEEK_CUR);
+    return pos - (f->buf_size - f->buf_index);
+}
+
+/*
+ * Move the stream to @offset in the underlying file; whatever was left
+ * in the buffer is written out (writing) or dropped (reading).
+ */
+void qemu_set_offset(QEMUFile *f, int64_t offset)
+{
+    int fd = qemu_file_get_seekable_fd(f);
+
+    assert(fd >= 0);
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+    if (lseek(fd, offset, SEEK_SET) < 0) {
+        qemu_file_set_error(f, -errno);
+    }
+}
+
+/*
+ * Write @buflen bytes at @pos of the underlying file, bypassing the
+ * buffer.  The data counts against the rate limit like the rest of the
+ * stream.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        int64_t pos)
+{
+    int fd = qemu_file_get_seekable_fd(f);
+    size_t done = 0;
+
+    if (qemu_file_get_error(f)) {
+        return;
+    }
+    assert(fd >= 0);
+
+    while (done < buflen) {
+        ssize_t ret = pwrite(fd, buf + done, buflen - done, pos + done);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qemu_file_set_error(f, -errno);
+            return;
+        }
+        done += ret;
+    }
+    f->bytes_xfer += buflen;
+}
+
+/*
+ * Read @buflen bytes at @pos of the underlying file, bypassing the
+ * buffer.  It doesn't touch the state of @f, so several threads can
+ * use it at the same time.
+ *
+ * Returns 0 on success, negative errno on failure
+ */
+int qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen, int64_t pos)
+{
+    int fd = qemu_file_get_seekable_fd(f);
+    size_t done = 0;
+
+    assert(fd >= 0);
+
+    while (done < buflen) {
+        ssize_t ret = pread(fd, buf + done, buflen - done, pos + done);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            return -EIO;
+        }
+        done += ret;
+    }
+    return 0;
+}
@@ -161,6 +161,7 @@ void qemu_file_set_error(QEMUFile *f, int ret);
 int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 void qemu_fflush(QEMUFile *f);
+void qemu_file_start_writer(QEMUFile *f);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
 
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags);
@@ -181,5 +182,11 @@ size_t ram_control_save_page(QEMUFile *f, ram_addr_t block_offset,
                              ram_addr_t offset, size_t size,
                              uint64_t *bytes_sent);
 QIOChannel *qemu_file_get_ioc(QEMUFile *file);
+bool qemu_file_is_seekable(QEMUFile *f);
+int64_t qemu_get_offset(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, int64_t offset);
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        int64_t pos);
+int qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen, int64_t pos);
 
 #endif
@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -51,9 +52,11 @@
 #include "migration/colo.h"
 #include "block.h"
 #include "sysemu/cpu-throttle.h"
+#include "hw/core/cpu.h"
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "latency.h"
 #include "sysemu/runstate.h"
 
 #if defined(__linux__)
@@ -79,6 +82,20 @@
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/*
+ * mapped-ram: after the usual block description, the setup section has
+ * a header per block (be32 version, be64 page size, be64 bitmap offset,
+ * be64 pages offset).  The little endian bitmap of the pages present in
+ * the file and the pages themselves live at those offsets, out of the
+ * stream, which carries on after the pages of the block.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+#define MAPPED_RAM_HDR_SIZE (sizeof(uint32_t) + 3 * sizeof(uint64_t))
+/* Keep the pages region aligned so that the file can be mmap'ed */
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+/* Smallest part of a block worth a load thread of its own */
+#define MAPPED_RAM_LOAD_CHUNK (256 * MiB)
+
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
     return buffer_is_zero(p, size);
@@ -320,6 +337,10 @@ struct RAMState {
     uint64_t bytes_xfer_prev;
     /* number of dirty pages since start_time */
     uint64_t num_dirty_pages_period;
+    /* CPUState::dirty_pages at the last bitmap sync, by cpu index */
+    uint64_t *vcpu_dirty_pages_prev;
+    /* number of entries in vcpu_dirty_pages_prev */
+    int nr_vcpu_dirty_pages_prev;
     /* xbzrle misses since the beginning of the period */
     uint64_t xbzrle_cache_miss_prev;
     /* Amount of xbzrle pages since the beginning of the period */
@@ -350,6 +371,10 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /* Channel that f currently points to, see postcopy-preempt */
+    unsigned int postcopy_channel;
+    /* Set once the final dirty sync before postcopy has been done */
+    bool postcopy_bitmap_synced;
 };
 typedef struct RAMState RAMState;
 
@@ -397,6 +422,8 @@ struct PageSearchStatus {
     unsigned long page;
     /* Set once we wrap around */
     bool         complete_round;
+    /* Whether the page was requested by the destination during postcopy */
+    bool         postcopy_requested;
 };
 typedef struct PageSearchStatus PageSearchStatus;
 
@@ -639,6 +666,92 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
     }
 }
 
+/**
+ * mig_throttle_vcpus: adjust the throttle of each vCPU
+ *
+ * Per-vCPU flavour of mig_throttle_guest_down(), driven by the pages
+ * each vCPU pushed to its KVM dirty ring since the last bitmap sync.
+ * Every vCPU gets an equal share of @bytes_dirty_threshold; the ones
+ * that dirtied more than that are throttled (or throttled harder), and
+ * the ones that dropped well below it are released one step at a time,
+ * so that only the vCPUs that keep the migration from converging are
+ * slowed down.
+ *
+ * @rs: current RAM state
+ * @bytes_dirty_threshold: dirty bytes the whole guest may produce per
+ *                         period for the migration to make progress
+ */
+static void mig_throttle_vcpus(RAMState *rs, uint64_t bytes_dirty_threshold)
+{
+    MigrationState *s = migrate_get_current();
+    int pct_initial = s->parameters.cpu_throttle_initial;
+    int pct_increment = s->parameters.cpu_throttle_increment;
+    bool pct_tailslow = s->parameters.cpu_throttle_tailslow;
+    int pct_max = s->parameters.max_cpu_throttle;
+    uint64_t share;
+    CPUState *cpu;
+    int nr_cpus = 0, max_index = 0;
+
+    CPU_FOREACH(cpu) {
+        nr_cpus++;
+        max_index = MAX(max_index, cpu->cpu_index);
+    }
+    if (!nr_cpus) {
+        return;
+    }
+    share = bytes_dirty_threshold / nr_cpus;
+
+    if (max_index >= rs->nr_vcpu_dirty_pages_prev) {
+        int old = rs->nr_vcpu_dirty_pages_prev;
+
+        rs->vcpu_dirty_pages_prev = g_renew(uint64_t,
+                                            rs->vcpu_dirty_pages_prev,
+                                            max_index + 1);
+        rs->nr_vcpu_dirty_pages_prev = max_index + 1;
+        CPU_FOREACH(cpu) {
+            /* A vCPU we haven't seen yet has no previous period */
+            if (cpu->cpu_index >= old) {
+                rs->vcpu_dirty_pages_prev[cpu->cpu_index] = cpu->dirty_pages;
+            }
+        }
+    }
+
+    CPU_FOREACH(cpu) {
+        uint64_t pages = cpu->dirty_pages;
+        uint64_t bytes_dirty = (pages -
+                                rs->vcpu_dirty_pages_prev[cpu->cpu_index]) *
+                               TARGET_PAGE_SIZE;
+        int throttle_now = cpu_throttle_get_vcpu_percentage(cpu);
+        int throttle_new = throttle_now;
+
+        rs->vcpu_dirty_pages_prev[cpu->cpu_index] = pages;
+
+        if (bytes_dirty > share) {
+            if (!throttle_now) {
+                throttle_new = pct_initial;
+            } else if (!pct_tailslow) {
+                throttle_new = throttle_now + pct_increment;
+            } else {
+                /* Aim at the CPU time that would dirty just our share */
+                int cpu_now = 100 - throttle_now;
+                int cpu_ideal = cpu_now * (share * 1.0 / bytes_dirty);
+
+                throttle_new = throttle_now + MIN(cpu_now - cpu_ideal,
+                                                  pct_increment);
+            }
+            throttle_new = MIN(throttle_new, pct_max);
+        } else if (throttle_now && bytes_dirty < share / 2) {
+            throttle_new = MAX(throttle_now - pct_increment, 0);
+        }
+
+        if (throttle_new != throttle_now) {
+            trace_mig_throttle_vcpus(cpu->cpu_index, bytes_dirty, share,
+                                     throttle_new);
+            cpu_throttle_set_vcpu(cpu, throttle_new);
+        }
+    }
+}
+
 /**
  * xbzrle_cache_zero_page: insert a zero page in the XBZRLE cache
  *
@@ -858,11 +971,227 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
     return ret;
 }
 
+/*
+ * Dirty bitmap sync threads
+ *
+ * On big guests merging the dirty log into the migration bitmap is a
+ * linear walk over all of guest memory, done with the iothread lock
+ * held.  With the dirty-sync-threads parameter set, the word aligned
+ * head of each large RAMBlock is cut in shards that a pool of threads
+ * merge in parallel, while the migration thread takes care of the
+ * small blocks and of the unaligned tails.
+ *
+ * Shards never share a word of the destination bitmap, and the source
+ * bitmap is only touched with atomic operations, so the threads don't
+ * need any locking between them.  Only blocks with a clear_bmap are
+ * split: for those the clear of the dirty log is postponed and only
+ * recorded atomically in clear_bmap, so the threads never call into
+ * the memory API or the accelerator.
+ */
+#define DIRTY_SYNC_SHARD_SIZE (1ULL << 30)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncShard;
+
+typedef struct {
+    QemuThread thread;
+    /* pages that became dirty since the last dirty_sync_finish() */
+    uint64_t num_dirty;
+} DirtySyncParam;
+
+typedef struct {
+    DirtySyncParam *params;
+    int thread_count;
+    /* posted once for each thread when there is work to do */
+    QemuSemaphore work_sem;
+    /* posted by each thread when it has finished its round */
+    QemuSemaphore done_sem;
+    bool quit;
+    DirtySyncShard *shards;
+    unsigned int shards_allocated;
+    unsigned int nr_shards;
+    /* index of the next shard to process */
+    unsigned int next_shard;
+} DirtySyncState;
+
+static DirtySyncState *dirty_sync;
+
+/* Called with RCU critical section */
+static uint64_t dirty_sync_process_shards(void)
+{
+    uint64_t num_dirty = 0;
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&dirty_sync->next_shard)) <
+           dirty_sync->nr_shards) {
+        DirtySyncShard *shard = &dirty_sync->shards[i];
+
+        num_dirty += cpu_physical_memory_sync_dirty_bitmap(shard->block,
+                                                           shard->start,
+                                                           shard->length);
+    }
+
+    return num_dirty;
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    DirtySyncParam *param = opaque;
+
+    rcu_register_thread();
+
+    while (true) {
+        qemu_sem_wait(&dirty_sync->work_sem);
+        if (qatomic_read(&dirty_sync->quit)) {
+            break;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            param->num_dirty += dirty_sync_process_shards();
+        }
+        qemu_sem_post(&dirty_sync->done_sem);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void dirty_sync_cleanup(void)
+{
+    int i;
+
+    if (!dirty_sync) {
+        return;
+    }
+
+    qatomic_set(&dirty_sync->quit, true);
+    for (i = 0; i < dirty_sync->thread_count; i++) {
+        qemu_sem_post(&dirty_sync->work_sem);
+    }
+    for (i = 0; i < dirty_sync->thread_count; i++) {
+        qemu_thread_join(&dirty_sync->params[i].thread);
+    }
+    qemu_sem_destroy(&dirty_sync->work_sem);
+    qemu_sem_destroy(&dirty_sync->done_sem);
+    g_free(dirty_sync->shards);
+    g_free(dirty_sync->params);
+    g_free(dirty_sync);
+    dirty_sync = NULL;
+}
+
+static void dirty_sync_setup(void)
+{
+    int i, thread_count = migrate_dirty_sync_threads();
+
+    if (!thread_count || dirty_sync) {
+        return;
+    }
+
+    dirty_sync = g_new0(DirtySyncState, 1);
+    dirty_sync->params = g_new0(DirtySyncParam, thread_count);
+    dirty_sync->thread_count = thread_count;
+    qemu_sem_init(&dirty_sync->work_sem, 0);
+    qemu_sem_init(&dirty_sync->done_sem, 0);
+    for (i = 0; i < thread_count; i++) {
+        qemu_thread_create(&dirty_sync->params[i].thread, "dirtysync",
+                           dirty_sync_thread, &dirty_sync->params[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+/**
+ * dirty_sync_block_split: how much of a RAMBlock the threads sync
+ *
+ * Returns the size of the head of @rb that is handed to the dirty sync
+ * threads, 0 if the whole block is synced by the migration thread.
+ *
+ * @rb: RAMBlock to check
+ */
+static ram_addr_t dirty_sync_block_split(RAMBlock *rb)
+{
+    ram_addr_t word_size = (ram_addr_t)BITS_PER_LONG << TARGET_PAGE_BITS;
+
+    if (!dirty_sync || !rb->clear_bmap ||
+        rb->used_length < 2 * DIRTY_SYNC_SHARD_SIZE ||
+        (rb->offset & (word_size - 1))) {
+        return 0;
+    }
+
+    return QEMU_ALIGN_DOWN(rb->used_length, word_size);
+}
+
+/* Called with RCU critical section */
+static void dirty_sync_start(void)
+{
+    RAMBlock *block;
+    int i;
+
+    dirty_sync->nr_shards = 0;
+    dirty_sync->next_shard = 0;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t split = dirty_sync_block_split(block);
+        ram_addr_t start;
+
+        for (start = 0; start < split; start += DIRTY_SYNC_SHARD_SIZE) {
+            DirtySyncShard *shard;
+
+            if (dirty_sync->nr_shards == dirty_sync->shards_allocated) {
+                dirty_sync->shards_allocated =
+                    MAX(dirty_sync->shards_allocated * 2, 16);
+                dirty_sync->shards = g_renew(DirtySyncShard,
+                                             dirty_sync->shards,
+                                             dirty_sync->shards_allocated);
+            }
+            shard = &dirty_sync->shards[dirty_sync->nr_shards++];
+            shard->block = block;
+            shard->start = start;
+            shard->length = MIN(DIRTY_SYNC_SHARD_SIZE, split - start);
+        }
+    }
+
+    for (i = 0; i < dirty_sync->thread_count; i++) {
+        qemu_sem_post(&dirty_sync->work_sem);
+    }
+}
+
+/* Called with RCU critical section */
+static void dirty_sync_finish(RAMState *rs)
+{
+    uint64_t new_dirty_pages;
+    int i;
+
+    /* Help with whatever the threads have not picked up yet */
+    new_dirty_pages = dirty_sync_process_shards();
+
+    for (i = 0; i < dirty_sync->thread_count; i++) {
+        qemu_sem_wait(&dirty_sync->done_sem);
+    }
+    for (i = 0; i < dirty_sync->thread_count; i++) {
+        new_dirty_pages += dirty_sync->params[i].num_dirty;
+        dirty_sync->params[i].num_dirty = 0;
+    }
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+}
+
 /* Called with RCU critical section */
 static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 {
-    uint64_t new_dirty_pages =
-        cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+    /* The dirty sync threads take care of the head of big blocks */
+    ram_addr_t start = dirty_sync_block_split(rb);
+    uint64_t new_dirty_pages;
+
+    if (start == rb->used_length) {
+        return;
+    }
+
+    new_dirty_pages = cpu_physical_memory_sync_dirty_bitmap(rb, start,
+                                                            rb->used_length -
+                                                            start);
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
@@ -966,8 +1295,10 @@ static void migration_trigger_throttle(RAMState *rs)
            we were in this routine reaches the threshold. If that happens
            twice, start or increase throttling. */
 
-        if ((bytes_dirty_period > bytes_dirty_threshold) &&
-            (++rs->dirty_rate_high_cnt >= 2)) {
+        if (migrate_per_vcpu_throttle()) {
+            mig_throttle_vcpus(rs, bytes_dirty_threshold);
+        } else if ((bytes_dirty_period > bytes_dirty_threshold) &&
+                   (++rs->dirty_rate_high_cnt >= 2)) {
             trace_migration_throttle();
             rs->dirty_rate_high_cnt = 0;
             mig_throttle_guest_down(bytes_dirty_period,
@@ -980,6 +1311,8 @@ static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
     int64_t end_time;
+    int64_t log_start, log_end, sync_end;
+    int64_t start = migration_latency_start();
 
     ram_counters.dirty_sync_count++;
 
@@ -988,19 +1321,32 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 
     trace_migration_bitmap_sync_start();
+    log_start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     memory_global_dirty_log_sync();
+    log_end = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
+        if (dirty_sync) {
+            dirty_sync_start();
+        }
         RAMBLOCK_FOREACH_NOT_IGNORED(block) {
             ramblock_sync_dirty_bitmap(rs, block);
         }
+        if (dirty_sync) {
+            dirty_sync_finish(rs);
+        }
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    sync_end = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    ram_counters.dirty_sync_log_time = log_end - log_start;
+    ram_counters.dirty_sync_bitmap_time = sync_end - log_end;
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    ram_counters.dirty_sync_log_time,
+                                    ram_counters.dirty_sync_bitmap_time);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -1020,6 +1366,7 @@ static void migration_bitmap_sync(RAMState *rs)
     if (migrate_use_events()) {
         qapi_event_send_migration_pass(ram_counters.dirty_sync_count);
     }
+    migration_latency_record(MIGRATION_PHASE_BITMAP_SYNC, start);
 }
 
 static void migration_bitmap_sync_precopy(RAMState *rs)
@@ -1163,6 +1510,49 @@ static int save_normal_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
     return 1;
 }
 
+/*
+ * mapped_ram_bitmap_size: bytes used by the bitmap of a block in the file
+ *
+ * Rounded up to 64 bits so that the layout doesn't depend on the size
+ * of long.
+ */
+static size_t mapped_ram_bitmap_size(unsigned long num_pages)
+{
+    return DIV_ROUND_UP(num_pages, 64) * sizeof(uint64_t);
+}
+
+/**
+ * save_mapped_ram_page: write a page at its offset in the file
+ *
+ * Zero pages are not written at all: they are simply left out of the
+ * file bitmap, and the destination RAM is already zero.
+ *
+ * Returns the number of pages written.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_mapped_ram_page(RAMState *rs, RAMBlock *block,
+                                ram_addr_t offset)
+{
+    uint8_t *p = block->host + offset;
+    unsigned long page = offset >> TARGET_PAGE_BITS;
+
+    if (is_zero_range(p, TARGET_PAGE_SIZE)) {
+        clear_bit(page, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    qemu_put_buffer_at(rs->f, p, TARGET_PAGE_SIZE,
+                       block->pages_offset + offset);
+    set_bit(page, block->file_bmap);
+    ram_counters.transferred += TARGET_PAGE_SIZE;
+    ram_counters.normal++;
+    return 1;
+}
+
 /**
  * ram_save_page: send the given page to the stream
  *
@@ -1405,6 +1795,31 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
     }
 }
 
+/**
+ * ram_queue_page: queue a range of pages to be sent before the
+ * background scan continues
+ *
+ * @rs: current RAM state
+ * @block: RAMBlock the pages belong to
+ * @start: starting address from the start of the RAMBlock
+ * @len: length (in bytes) to send
+ */
+static void ram_queue_page(RAMState *rs, RAMBlock *block, ram_addr_t start,
+                           ram_addr_t len)
+{
+    struct RAMSrcPageRequest *new_entry =
+        g_malloc0(sizeof(struct RAMSrcPageRequest));
+    new_entry->rb = block;
+    new_entry->offset = start;
+    new_entry->len = len;
+
+    memory_region_ref(block->mr);
+    qemu_mutex_lock(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+    migration_make_urgent_request();
+    qemu_mutex_unlock(&rs->src_page_req_mutex);
+}
+
 /**
  * unqueue_page: gets a page of the queue
  *
@@ -1445,6 +1860,9 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 }
 
 #if defined(__linux__)
+/* Maximum number of write faults read from the UFFD at once */
+#define UFFD_FAULT_BATCH 64
+
 /**
  * poll_fault_page: try to get next UFFD write fault page and, if pending fault
  *   is found, return RAM block pointer and page offset
@@ -1457,24 +1875,45 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
  */
 static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
 {
-    struct uffd_msg uffd_msg;
-    void *page_address;
-    RAMBlock *block;
-    int res;
+    struct uffd_msg uffd_msg[UFFD_FAULT_BATCH];
+    RAMBlock *first = NULL;
+    int res, i;
 
     if (!migrate_background_snapshot()) {
         return NULL;
     }
 
-    res = uffd_read_events(rs->uffdio_fd, &uffd_msg, 1);
-    if (res <= 0) {
-        return NULL;
+    /*
+     * Several vCPUs may be blocked at the same time.  Read all pending
+     * faults at once and queue the ones we do not return, so that they
+     * are served before the background scan resumes instead of one per
+     * host page saved.
+     */
+    res = uffd_read_events(rs->uffdio_fd, uffd_msg, UFFD_FAULT_BATCH);
+    for (i = 0; i < res; i++) {
+        void *page_address;
+        ram_addr_t page_offset;
+        RAMBlock *block;
+
+        if (uffd_msg[i].event != UFFD_EVENT_PAGEFAULT) {
+            continue;
+        }
+        page_address = (void *)(uintptr_t) uffd_msg[i].arg.pagefault.address;
+        block = qemu_ram_block_from_host(page_address, false, &page_offset);
+        assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
+
+        if (!first) {
+            first = block;
+            *offset = page_offset;
+            continue;
+        }
+
+        page_offset = QEMU_ALIGN_DOWN(page_offset, block->page_size);
+        trace_poll_fault_page_queue(block->idstr, page_offset);
+        ram_queue_page(rs, block, page_offset, block->page_size);
     }
 
-    page_address = (void *)(uintptr_t) uffd_msg.arg.pagefault.address;
-    block = qemu_ram_block_from_host(page_address, false, offset);
-    assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
-    return block;
+    return first;
 }
 
 /**
@@ -1819,6 +2258,7 @@ static bool get_queued_page(RAMState *rs, PageSearchStatus *pss)
          * really rare.
          */
         pss->complete_round = false;
+        pss->postcopy_requested = true;
     }
 
     return !!block;
@@ -1896,18 +2336,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
         return -1;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_malloc0(sizeof(struct RAMSrcPageRequest));
-    new_entry->rb = ramblock;
-    new_entry->offset = start;
-    new_entry->len = len;
-
-    memory_region_ref(ramblock->mr);
-    qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
-    qemu_mutex_unlock(&rs->src_page_req_mutex);
-
+    ram_queue_page(rs, ramblock, start, len);
     return 0;
 }
 
@@ -1977,16 +2406,38 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
     if (control_save_page(rs, block, offset, &res)) {
         return res;
     }
 
+    if (migrate_mapped_ram()) {
+        return save_mapped_ram_page(rs, block, offset);
+    }
+
     if (save_compress_page(rs, block, offset)) {
         return 1;
     }
 
+    /*
+     * Do not use multifd for:
+     * 1. Compression as the first page in the new block should be posted out
+     *    before sending the compressed page
+     * 2. In postcopy as one whole host page should be placed
+     */
+    use_multifd = !save_page_use_compression(rs) && migrate_use_multifd()
+        && !migration_in_postcopy();
+
+    /*
+     * With multifd-zero-page the channel threads look for zero pages
+     * themselves, so don't scan the page on the migration thread.
+     */
+    if (use_multifd && migrate_multifd_zero_page()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -2001,20 +2452,63 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
-    /*
-     * Do not use multifd for:
-     * 1. Compression as the first page in the new block should be posted out
-     *    before sending the compressed page
-     * 2. In postcopy as one whole host page should be placed
-     */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
     return ram_save_page(rs, pss, last_stage);
 }
 
+/**
+ * postcopy_preempt_switch_channel: select the channel used to send pages
+ *
+ * With postcopy-preempt the pages requested by the destination go on
+ * their own channel, while the background pages stay on the main one.
+ *
+ * @rs: current RAM state
+ * @channel: RAM_CHANNEL_PRECOPY or RAM_CHANNEL_POSTCOPY
+ */
+static void postcopy_preempt_switch_channel(RAMState *rs,
+                                            unsigned int channel)
+{
+    MigrationState *s = migrate_get_current();
+
+    if (channel == rs->postcopy_channel) {
+        return;
+    }
+
+    if (channel == RAM_CHANNEL_POSTCOPY) {
+        rs->f = s->postcopy_qemufile_src;
+    } else {
+        rs->f = s->to_dst_file;
+    }
+    rs->postcopy_channel = channel;
+
+    /*
+     * The destination remembers the last block per channel, so the
+     * first page on the new channel has to carry the block name.
+     */
+    rs->last_sent_block = NULL;
+
+    trace_postcopy_preempt_switch_channel(channel);
+}
+
+/**
+ * postcopy_preempt_shutdown_file: terminate the postcopy preempt channel
+ *
+ * Tells the preempt thread on the destination that there are no more
+ * pages coming on that channel.
+ */
+static void postcopy_preempt_shutdown_file(void)
+{
+    QEMUFile *f = migrate_get_current()->postcopy_qemufile_src;
+
+    if (f) {
+        qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
+        qemu_fflush(f);
+    }
+}
+
 /**
  * ram_save_host_page: save a whole host page
  *
@@ -2049,6 +2543,12 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
         return 0;
     }
 
+    if (migrate_get_current()->postcopy_qemufile_src) {
+        postcopy_preempt_switch_channel(rs, pss->postcopy_requested ?
+                                        RAM_CHANNEL_POSTCOPY :
+                                        RAM_CHANNEL_PRECOPY);
+    }
+
     do {
         /* Check the pages is dirty and if it is send it */
         if (migration_bitmap_clear_dirty(rs, pss->block, pss->page)) {
@@ -2073,6 +2573,11 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     /* The offset we leave with is the min boundary of host page and block */
     pss->page = MIN(pss->page, hostpage_boundary) - 1;
 
+    /* Don't let the requested page sit in the buffer */
+    if (rs->postcopy_channel == RAM_CHANNEL_POSTCOPY) {
+        qemu_fflush(rs->f);
+    }
+
     res = ram_save_release_protection(rs, pss, start_page);
     return (res < 0 ? res : pages);
 }
@@ -2097,15 +2602,19 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     PageSearchStatus pss;
     int pages = 0;
     bool again, found;
+    int64_t start;
 
     /* No dirty page as there is zero RAM */
     if (!ram_bytes_total()) {
         return pages;
     }
 
+    start = migration_latency_start();
+
     pss.block = rs->last_seen_block;
     pss.page = rs->last_page;
     pss.complete_round = false;
+    pss.postcopy_requested = false;
 
     if (!pss.block) {
         pss.block = QLIST_FIRST_RCU(&ram_list.blocks);
@@ -2128,6 +2637,7 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     rs->last_seen_block = pss.block;
     rs->last_page = pss.page;
 
+    migration_latency_record(MIGRATION_PHASE_FIND_AND_SAVE_BLOCK, start);
     return pages;
 }
 
@@ -2185,6 +2695,7 @@ static void ram_state_cleanup(RAMState **rsp)
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
+        g_free((*rsp)->vcpu_dirty_pages_prev);
         g_free(*rsp);
         *rsp = NULL;
     }
@@ -2224,10 +2735,13 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    dirty_sync_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -2466,6 +2980,117 @@ static int postcopy_chunk_hostpages(MigrationState *ms, RAMBlock *block)
     return 0;
 }
 
+/**
+ * postcopy_flush_block_subpages: send the dirty subpages of huge pages
+ *
+ * Returns zero on success, negative on error
+ *
+ * @rs: current RAM state
+ * @block: block we want to work with
+ * @budget: remaining number of bytes we are allowed to send
+ */
+static int postcopy_flush_block_subpages(RAMState *rs, RAMBlock *block,
+                                         uint64_t *budget)
+{
+    unsigned long *bitmap = block->bmap;
+    unsigned int host_ratio = block->page_size / TARGET_PAGE_SIZE;
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    PageSearchStatus pss = { .block = block };
+    unsigned long run_start;
+
+    if (block->page_size == TARGET_PAGE_SIZE) {
+        /* Nothing to do, every host page can be placed on its own */
+        return 0;
+    }
+
+    run_start = find_next_bit(bitmap, pages, 0);
+
+    while (run_start < pages) {
+        unsigned long host_start = QEMU_ALIGN_DOWN(run_start, host_ratio);
+        unsigned long host_end = MIN(host_start + host_ratio, pages);
+        unsigned long dirty = bitmap_count_one_with_offset(bitmap, host_start,
+                                                           host_end -
+                                                           host_start);
+        uint64_t size = (uint64_t)dirty << TARGET_PAGE_BITS;
+
+        /*
+         * Resending the whole host page is cheap enough if most of
+         * it is dirty anyway.
+         */
+        if (dirty <= host_ratio / 2 && size <= *budget) {
+            for (pss.page = run_start; pss.page < host_end;
+                 pss.page = find_next_bit(bitmap, host_end, pss.page + 1)) {
+                int ret;
+
+                if (!migration_bitmap_clear_dirty(rs, block, pss.page)) {
+                    continue;
+                }
+                ret = ram_save_target_page(rs, &pss, false);
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+            *budget -= size;
+            trace_postcopy_flush_block_subpages(block->idstr, host_start,
+                                                dirty);
+        }
+
+        run_start = find_next_bit(bitmap, pages, host_end);
+    }
+
+    return 0;
+}
+
+/**
+ * ram_save_postcopy_prepare: complete partially dirty huge pages
+ *
+ * Called with the source stopped, before the discard bitmap is built.
+ * During postcopy a host page can only be placed on the destination as
+ * a whole, so a huge page with a few dirty subpages would be discarded
+ * and resent in full.  Up to the postcopy-subpage-budget limit, send
+ * those subpages now through the precopy path instead; the destination
+ * writes them in place and the host page is clean by the time
+ * postcopy_chunk_hostpages() looks at it.
+ *
+ * Returns zero on success, negative on error
+ *
+ * @f: QEMUFile where to send the data
+ * @opaque: RAMState pointer
+ */
+static int ram_save_postcopy_prepare(QEMUFile *f, void *opaque)
+{
+    RAMState **temp = opaque;
+    RAMState *rs = *temp;
+    uint64_t budget = migrate_postcopy_subpage_budget();
+    uint64_t total = budget;
+    RAMBlock *block;
+    int ret = 0;
+
+    if (migrate_postcopy_ram() && budget) {
+        WITH_RCU_READ_LOCK_GUARD() {
+            migration_bitmap_sync(rs);
+            rs->postcopy_bitmap_synced = true;
+
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ret = postcopy_flush_block_subpages(rs, block, &budget);
+                if (ret < 0) {
+                    break;
+                }
+            }
+        }
+        flush_compressed_data(rs);
+        trace_ram_save_postcopy_prepare(total - budget);
+    }
+
+    if (ret >= 0) {
+        multifd_send_sync_main(rs->f);
+        qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
+        qemu_fflush(f);
+    }
+
+    return ret;
+}
+
 /**
  * ram_postcopy_send_discard_bitmap: transmit the discard bitmap
  *
@@ -2489,8 +3114,13 @@ int ram_postcopy_send_discard_bitmap(MigrationState *ms)
 
     RCU_READ_LOCK_GUARD();
 
-    /* This should be our last sync, the src is now paused */
-    migration_bitmap_sync(rs);
+    /*
+     * This should be our last sync, the src is now paused.  It may have
+     * been done already by ram_save_postcopy_prepare().
+     */
+    if (!rs->postcopy_bitmap_synced) {
+        migration_bitmap_sync(rs);
+    }
 
     /* Easiest way to make sure we don't resume in the middle of a host-page */
     rs->last_seen_block = NULL;
@@ -2725,6 +3355,7 @@ static void ram_state_resume_prepare(RAMState *rs, QEMUFile *out)
 
     /* Update RAMState cache of output QEMUFile */
     rs->f = out;
+    rs->postcopy_channel = RAM_CHANNEL_PRECOPY;
 
     trace_ram_state_resume_prepare(pages);
 }
@@ -2783,6 +3414,56 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
+/**
+ * mapped_ram_setup_ramblock: reserve room for a block in the file
+ *
+ * Write the mapped-ram header of @block and move the stream past the
+ * bitmap and pages regions.
+ *
+ * @f: QEMUFile where to send the data
+ * @block: block we want to work with
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long num_pages = block->used_length >> TARGET_PAGE_BITS;
+
+    block->file_bmap = bitmap_new(num_pages);
+    block->bitmap_offset = qemu_get_offset(f) + MAPPED_RAM_HDR_SIZE;
+    block->pages_offset = QEMU_ALIGN_UP(block->bitmap_offset +
+                                        mapped_ram_bitmap_size(num_pages),
+                                        MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    qemu_put_be32(f, MAPPED_RAM_HDR_VERSION);
+    qemu_put_be64(f, TARGET_PAGE_SIZE);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+}
+
+/**
+ * mapped_ram_save_bitmaps: write the file bitmap of every block
+ *
+ * Called once all the pages have been written, so that the bitmaps
+ * describe the final content of the file.
+ *
+ * @f: QEMUFile where to send the data
+ */
+static void mapped_ram_save_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long num_pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t size = mapped_ram_bitmap_size(num_pages);
+        g_autofree unsigned long *le_bitmap = g_malloc0(size);
+
+        bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+        qemu_put_buffer_at(f, (uint8_t *)le_bitmap, size,
+                           block->bitmap_offset);
+    }
+}
+
 /*
  * Each of ram_save_setup, ram_save_iterate and ram_save_complete has
  * long-running RCU critical section.  When rcu-reclaims in the code
@@ -2803,14 +3484,21 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMState **rsp = opaque;
     RAMBlock *block;
 
+    if (migrate_mapped_ram() && !qemu_file_is_seekable(f)) {
+        error_report("mapped-ram requires a seekable migration file");
+        return -1;
+    }
+
     if (compress_threads_save_setup()) {
         return -1;
     }
+    dirty_sync_setup();
 
     /* migration has already setup the bitmap, reuse it. */
     if (!migration_in_colo_state()) {
         if (ram_init_all(rsp) != 0) {
             compress_threads_save_cleanup();
+            dirty_sync_cleanup();
             return -1;
         }
     }
@@ -2830,6 +3518,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -2943,6 +3634,7 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
     ram_control_after_iterate(f, RAM_CONTROL_ROUND);
 
 out:
+    postcopy_preempt_switch_channel(rs, RAM_CHANNEL_PRECOPY);
     if (ret >= 0
         && migration_is_setup_or_active(migrate_get_current()->state)) {
         multifd_send_sync_main(rs->f);
@@ -3001,9 +3693,15 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
         flush_compressed_data(rs);
         ram_control_after_iterate(f, RAM_CONTROL_FINISH);
+
+        if (ret >= 0 && migrate_mapped_ram()) {
+            mapped_ram_save_bitmaps(f);
+        }
     }
 
+    postcopy_preempt_switch_channel(rs, RAM_CHANNEL_PRECOPY);
     if (ret >= 0) {
+        postcopy_preempt_shutdown_file();
         multifd_send_sync_main(rs->f);
         qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
         qemu_fflush(f);
@@ -3084,19 +3782,23 @@ static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
  *
  * @f: QEMUFile where to read the data from
  * @flags: Page flags (mostly to see if it's a continuation of previous block)
+ * @channel: the channel we're using, the source keeps track of the last
+ *           block separately for each channel
  */
-static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
+static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags,
+                                              int channel)
 {
-    static RAMBlock *block;
+    static RAMBlock *last_block[RAM_CHANNEL_MAX];
+    RAMBlock *block;
     char id[256];
     uint8_t len;
 
     if (flags & RAM_SAVE_FLAG_CONTINUE) {
-        if (!block) {
+        if (!last_block[channel]) {
             error_report("Ack, bad migration stream!");
             return NULL;
         }
-        return block;
+        return last_block[channel];
     }
 
     len = qemu_get_byte(f);
@@ -3104,6 +3806,7 @@ static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
     id[len] = 0;
 
     block = qemu_ram_block_by_name(id);
+    last_block[channel] = block;
     if (!block) {
         error_report("Can't find block %s", id);
         return NULL;
@@ -3523,19 +4226,22 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis)
  *
  * Returns 0 for success or -errno in case of error
  *
- * Called in postcopy mode by ram_load().
+ * Called in postcopy mode by ram_load(), and by the postcopy preempt
+ * thread for the preempt channel.
  * rcu_read_lock is taken prior to this being called.
  *
  * @f: QEMUFile where to send the data
+ * @channel: the channel to use for loading
  */
-static int ram_load_postcopy(QEMUFile *f)
+int ram_load_postcopy(QEMUFile *f, int channel)
 {
     int flags = 0, ret = 0;
     bool place_needed = false;
     bool matches_target_page_size = false;
     MigrationIncomingState *mis = migration_incoming_get_current();
     /* Temporary page that is later 'placed' */
-    void *postcopy_host_page = mis->postcopy_tmp_page;
+    void *postcopy_host_page = channel == RAM_CHANNEL_POSTCOPY ?
+        mis->postcopy_preempt_tmp_page : mis->postcopy_tmp_page;
     void *host_page = NULL;
     bool all_zero = true;
     int target_pages = 0;
@@ -3565,7 +4271,7 @@ static int ram_load_postcopy(QEMUFile *f)
         trace_ram_load_postcopy_loop((uint64_t)addr, flags);
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE)) {
-            block = ram_block_from_stream(f, flags);
+            block = ram_block_from_stream(f, flags, channel);
             if (!block) {
                 ret = -EINVAL;
                 break;
@@ -3664,7 +4370,9 @@ static int ram_load_postcopy(QEMUFile *f)
 
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
-            multifd_recv_sync_main();
+            if (channel == RAM_CHANNEL_PRECOPY) {
+                multifd_recv_sync_main();
+            }
             break;
         default:
             error_report("Unknown combination of migration flags: 0x%x"
@@ -3712,6 +4420,79 @@ static bool postcopy_is_running(void)
     return ps >= POSTCOPY_INCOMING_LISTENING && ps < POSTCOPY_INCOMING_END;
 }
 
+/*
+ * The dirty pages of large blocks are copied out of the COLO cache by
+ * up to multifd-channels threads, each on its own part of the block.
+ */
+#define COLO_FLUSH_CHUNK (256 * MiB)
+
+typedef struct ColoFlushParam {
+    QemuThread thread;
+    RAMBlock *block;
+    /* range of pages [start, end) that this thread copies */
+    unsigned long start;
+    unsigned long end;
+    unsigned long pages;
+} ColoFlushParam;
+
+static void *colo_flush_ram_cache_thread(void *opaque)
+{
+    ColoFlushParam *p = opaque;
+    RAMBlock *block = p->block;
+    unsigned long set = find_next_bit(block->bmap, p->end, p->start);
+
+    while (set < p->end) {
+        unsigned long clear = find_next_zero_bit(block->bmap, p->end, set + 1);
+        ram_addr_t offset = (ram_addr_t)set << TARGET_PAGE_BITS;
+
+        memcpy(block->host + offset, block->colo_cache + offset,
+               (size_t)(clear - set) << TARGET_PAGE_BITS);
+        p->pages += clear - set;
+        set = find_next_bit(block->bmap, p->end, clear);
+    }
+    bitmap_clear(block->bmap, p->start, p->end - p->start);
+    return NULL;
+}
+
+static void colo_flush_ramblock(RAMState *rs, RAMBlock *block)
+{
+    unsigned long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    g_autofree ColoFlushParam *params = NULL;
+    int nr_threads, i;
+
+    if (find_next_bit(block->bmap, num_pages, 0) >= num_pages) {
+        return;
+    }
+    migration_clear_memory_region_dirty_bitmap_range(block, 0, num_pages);
+
+    nr_threads = MIN(MAX(migrate_multifd_channels(), 1),
+                     DIV_ROUND_UP(block->used_length, COLO_FLUSH_CHUNK));
+    params = g_new0(ColoFlushParam, nr_threads);
+    for (i = 0; i < nr_threads; i++) {
+        ColoFlushParam *p = &params[i];
+
+        /* Threads must not share a word of the bitmap */
+        p->block = block;
+        p->start = QEMU_ALIGN_DOWN(num_pages * i / nr_threads, BITS_PER_LONG);
+        p->end = i == nr_threads - 1 ? num_pages :
+            QEMU_ALIGN_DOWN(num_pages * (i + 1) / nr_threads, BITS_PER_LONG);
+        if (i) {
+            qemu_thread_create(&p->thread, "colo-flush",
+                               colo_flush_ram_cache_thread, p,
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+    /* This thread takes the first part itself */
+    colo_flush_ram_cache_thread(&params[0]);
+
+    rs->migration_dirty_pages -= params[0].pages;
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_join(&params[i].thread);
+        rs->migration_dirty_pages -= params[i].pages;
+    }
+    trace_colo_flush_ramblock(block->idstr, nr_threads);
+}
+
 /*
  * Flush content of RAM cache into SVM's memory.
  * Only flush the pages that be dirtied by PVM or SVM or both.
@@ -3719,9 +4500,6 @@ static bool postcopy_is_running(void)
 void colo_flush_ram_cache(void)
 {
     RAMBlock *block = NULL;
-    void *dst_host;
-    void *src_host;
-    unsigned long offset = 0;
 
     memory_global_dirty_log_sync();
     qemu_mutex_lock(&ram_state->bitmap_mutex);
@@ -3733,29 +4511,132 @@ void colo_flush_ram_cache(void)
 
     trace_colo_flush_ram_cache_begin(ram_state->migration_dirty_pages);
     WITH_RCU_READ_LOCK_GUARD() {
-        block = QLIST_FIRST_RCU(&ram_list.blocks);
-
-        while (block) {
-            offset = migration_bitmap_find_dirty(ram_state, block, offset);
-
-            if (!offset_in_ramblock(block,
-                                    ((ram_addr_t)offset) << TARGET_PAGE_BITS)) {
-                offset = 0;
-                block = QLIST_NEXT_RCU(block, next);
-            } else {
-                migration_bitmap_clear_dirty(ram_state, block, offset);
-                dst_host = block->host
-                         + (((ram_addr_t)offset) << TARGET_PAGE_BITS);
-                src_host = block->colo_cache
-                         + (((ram_addr_t)offset) << TARGET_PAGE_BITS);
-                memcpy(dst_host, src_host, TARGET_PAGE_SIZE);
-            }
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            colo_flush_ramblock(ram_state, block);
         }
     }
     trace_colo_flush_ram_cache_end();
     qemu_mutex_unlock(&ram_state->bitmap_mutex);
 }
 
+typedef struct MappedRamLoadParam {
+    QemuThread thread;
+    QEMUFile *f;
+    RAMBlock *block;
+    unsigned long *bitmap;
+    off_t pages_offset;
+    /* range of pages [start, end) that this thread reads */
+    unsigned long start;
+    unsigned long end;
+    int ret;
+} MappedRamLoadParam;
+
+static void *mapped_ram_load_thread(void *opaque)
+{
+    MappedRamLoadParam *p = opaque;
+    unsigned long set = find_next_bit(p->bitmap, p->end, p->start);
+
+    while (set < p->end && !p->ret) {
+        unsigned long clear = find_next_zero_bit(p->bitmap, p->end, set + 1);
+        ram_addr_t offset = (ram_addr_t)set << TARGET_PAGE_BITS;
+        size_t len = (size_t)(clear - set) << TARGET_PAGE_BITS;
+
+        p->ret = qemu_get_buffer_at(p->f, p->block->host + offset, len,
+                                    p->pages_offset + offset);
+        set = find_next_bit(p->bitmap, p->end, clear);
+    }
+    return NULL;
+}
+
+/**
+ * mapped_ram_load_ramblock: read the pages of a block from the file
+ *
+ * The pages are read straight into guest memory, with up to
+ * multifd-channels threads working on different parts of the block.
+ *
+ * Returns zero on success, negative on error
+ *
+ * @f: QEMUFile where to receive the data
+ * @block: block we want to work with
+ * @length: length of the block on the source
+ */
+static int mapped_ram_load_ramblock(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length)
+{
+    uint32_t version = qemu_get_be32(f);
+    uint64_t page_size = qemu_get_be64(f);
+    uint64_t bitmap_offset = qemu_get_be64(f);
+    uint64_t pages_offset = qemu_get_be64(f);
+    unsigned long num_pages = length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = mapped_ram_bitmap_size(num_pages);
+    g_autofree unsigned long *le_bitmap = NULL;
+    g_autofree unsigned long *bitmap = NULL;
+    g_autofree MappedRamLoadParam *params = NULL;
+    int nr_threads, i, ret;
+
+    if (version != MAPPED_RAM_HDR_VERSION) {
+        error_report("mapped-ram: unsupported header version %u for block %s",
+                     version, block->idstr);
+        return -EINVAL;
+    }
+    if (page_size != TARGET_PAGE_SIZE) {
+        error_report("mapped-ram: mismatched page size %" PRIu64
+                     " for block %s", page_size, block->idstr);
+        return -EINVAL;
+    }
+    if (length != block->used_length) {
+        return -EINVAL;
+    }
+
+    le_bitmap = g_malloc0(bitmap_size);
+    ret = qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                             bitmap_offset);
+    if (ret < 0) {
+        error_report("mapped-ram: failed to read the bitmap of block %s: %s",
+                     block->idstr, strerror(-ret));
+        return ret;
+    }
+    bitmap = bitmap_new(num_pages);
+    bitmap_from_le(bitmap, le_bitmap, num_pages);
+
+    nr_threads = MIN(MAX(migrate_multifd_channels(), 1),
+                     DIV_ROUND_UP(length, MAPPED_RAM_LOAD_CHUNK));
+    params = g_new0(MappedRamLoadParam, nr_threads);
+    for (i = 0; i < nr_threads; i++) {
+        MappedRamLoadParam *p = &params[i];
+
+        p->f = f;
+        p->block = block;
+        p->bitmap = bitmap;
+        p->pages_offset = pages_offset;
+        p->start = num_pages * i / nr_threads;
+        p->end = num_pages * (i + 1) / nr_threads;
+        if (i) {
+            qemu_thread_create(&p->thread, "mapped-ram-load",
+                               mapped_ram_load_thread, p,
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+    /* This thread takes the first part itself */
+    mapped_ram_load_thread(&params[0]);
+
+    ret = params[0].ret;
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_join(&params[i].thread);
+        ret = ret ? ret : params[i].ret;
+    }
+    if (ret < 0) {
+        error_report("mapped-ram: failed to read the pages of block %s: %s",
+                     block->idstr, strerror(-ret));
+        return ret;
+    }
+    trace_mapped_ram_load_ramblock(block->idstr, nr_threads);
+
+    /* The stream carries on after the pages of the block */
+    qemu_set_offset(f, pages_offset + length);
+    return qemu_file_get_error(f);
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -3806,7 +4687,8 @@ static int ram_load_precopy(QEMUFile *f)
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
-            RAMBlock *block = ram_block_from_stream(f, flags);
+            RAMBlock *block = ram_block_from_stream(f, flags,
+                                                    RAM_CHANNEL_PRECOPY);
 
             host = host_from_ram_block_offset(block, addr);
             /*
@@ -3895,6 +4777,15 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_mapped_ram()) {
+                        if (!qemu_file_is_seekable(f)) {
+                            error_report("mapped-ram requires a seekable "
+                                         "migration file");
+                            ret = -EINVAL;
+                        } else {
+                            ret = mapped_ram_load_ramblock(f, block, length);
+                        }
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -3983,7 +4874,7 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
      */
     WITH_RCU_READ_LOCK_GUARD() {
         if (postcopy_running) {
-            ret = ram_load_postcopy(f);
+            ret = ram_load_postcopy(f, RAM_CHANNEL_PRECOPY);
         } else {
             ret = ram_load_precopy(f);
         }
@@ -4147,6 +5038,7 @@ static SaveVMHandlers savevm_ram_handlers = {
     .save_live_complete_postcopy = ram_save_complete,
     .save_live_complete_precopy = ram_save_complete,
     .has_postcopy = ram_has_postcopy,
+    .save_postcopy_prepare = ram_save_postcopy_prepare,
     .save_live_pending = ram_save_pending,
     .load_state = ram_load,
     .save_cleanup = ram_save_cleanup,
@@ -55,6 +55,7 @@
 #include "qemu/main-loop.h"
 #include "block/snapshot.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "io/channel-buffer.h"
 #include "io/channel-file.h"
 #include "sysemu/replay.h"
@@ -63,9 +64,11 @@
 #include "sysemu/xen.h"
 #include "migration/colo.h"
 #include "qemu/bitmap.h"
+#include "qemu/stats64.h"
 #include "net/announce.h"
 #include "qemu/yank.h"
 #include "yank_functions.h"
+#include "latency.h"
 
 const unsigned int postcopy_ram_discard_version;
 
@@ -130,48 +133,244 @@ static struct mig_cmd_args {
 /***********************************************************/
 /* savevm/loadvm support */
 
+/*
+ * The VM state is read in large chunks, and the chunk that follows the
+ * one being parsed is read in the background, so that the image I/O
+ * overlaps with restoring the devices and RAM.  Saving works the other
+ * way round: the state is collected in a chunk while the previous one
+ * is written in the background.
+ */
+#define VMSTATE_READ_CHUNK (1 * MiB)
+#define VMSTATE_WRITE_CHUNK VMSTATE_READ_CHUNK
+
+typedef struct VMStateChunk {
+    BlockDriverState *bs;
+    uint8_t *buf;
+    int64_t pos;
+    size_t len;         /* bytes filled, when writing */
+    int ret;
+    bool in_flight;
+} VMStateChunk;
+
+typedef struct VMStateWriter {
+    VMStateChunk chunk[2];
+    /* Index of the chunk being filled; the other one may be in flight */
+    int cur;
+} VMStateWriter;
+
+static void coroutine_fn vmstate_chunk_write_entry(void *opaque)
+{
+    VMStateChunk *c = opaque;
+    QEMUIOVector qiov;
+
+    qemu_iovec_init_buf(&qiov, c->buf, c->len);
+    c->ret = bdrv_co_writev_vmstate(c->bs, &qiov, c->pos);
+    qatomic_set(&c->in_flight, false);
+    aio_wait_kick();
+}
+
+/* Start writing the current chunk and switch to the other one */
+static int vmstate_writer_submit(VMStateWriter *w)
+{
+    VMStateChunk *c = &w->chunk[w->cur];
+    VMStateChunk *next = &w->chunk[!w->cur];
+    Coroutine *co;
+
+    /* Wait for the previous write, the next chunk is filled from scratch */
+    BDRV_POLL_WHILE(next->bs, qatomic_read(&next->in_flight));
+    if (next->ret < 0) {
+        return next->ret;
+    }
+
+    if (c->len) {
+        co = qemu_coroutine_create(vmstate_chunk_write_entry, c);
+        c->in_flight = true;
+        aio_co_enter(bdrv_get_aio_context(c->bs), co);
+    }
+
+    next->pos = c->pos + c->len;
+    next->len = 0;
+    w->cur = !w->cur;
+    return 0;
+}
+
 static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
                                    int64_t pos, Error **errp)
 {
-    int ret;
-    QEMUIOVector qiov;
+    VMStateWriter *w = opaque;
+    VMStateChunk *c = &w->chunk[w->cur];
+    size_t total = iov_size(iov, iovcnt);
+    size_t done = 0, len;
+    int i, ret;
+
+    assert(!qemu_in_coroutine());
+
+    if (pos != c->pos + c->len) {
+        /* Not sequential, start a new chunk at @pos */
+        ret = vmstate_writer_submit(w);
+        if (ret < 0) {
+            return ret;
+        }
+        c = &w->chunk[w->cur];
+        c->pos = pos;
+    }
+
+    for (i = 0; i < iovcnt; ) {
+        len = MIN(iov[i].iov_len - done, VMSTATE_WRITE_CHUNK - c->len);
+        memcpy(c->buf + c->len, iov[i].iov_base + done, len);
+        c->len += len;
+        done += len;
+        if (done == iov[i].iov_len) {
+            done = 0;
+            i++;
+        }
+        if (c->len == VMSTATE_WRITE_CHUNK) {
+            ret = vmstate_writer_submit(w);
+            if (ret < 0) {
+                return ret;
+            }
+            c = &w->chunk[w->cur];
+        }
+    }
+
+    return total;
+}
+
+static int block_write_fclose(void *opaque, Error **errp)
+{
+    VMStateWriter *w = opaque;
+    BlockDriverState *bs = w->chunk[0].bs;
+    int i, ret;
+
+    ret = vmstate_writer_submit(w);
+    for (i = 0; i < ARRAY_SIZE(w->chunk); i++) {
+        BDRV_POLL_WHILE(bs, qatomic_read(&w->chunk[i].in_flight));
+        if (ret >= 0) {
+            ret = w->chunk[i].ret;
+        }
+        qemu_vfree(w->chunk[i].buf);
+    }
+    g_free(w);
 
-    qemu_iovec_init_external(&qiov, iov, iovcnt);
-    ret = bdrv_writev_vmstate(opaque, &qiov, pos);
     if (ret < 0) {
         return ret;
     }
+    return bdrv_flush(bs);
+}
+
+typedef struct VMStateReader {
+    VMStateChunk chunk[2];
+    /* Index of the chunk being consumed; the other one is prefetched */
+    int cur;
+} VMStateReader;
+
+static void coroutine_fn vmstate_chunk_read_entry(void *opaque)
+{
+    VMStateChunk *c = opaque;
+    QEMUIOVector qiov;
+
+    qemu_iovec_init_buf(&qiov, c->buf, VMSTATE_READ_CHUNK);
+    c->ret = bdrv_co_readv_vmstate(c->bs, &qiov, c->pos);
+    qatomic_set(&c->in_flight, false);
+    aio_wait_kick();
+}
+
+static void vmstate_chunk_start(VMStateChunk *c, int64_t pos)
+{
+    Coroutine *co = qemu_coroutine_create(vmstate_chunk_read_entry, c);
+
+    assert(!c->in_flight);
+    c->pos = pos;
+    c->in_flight = true;
+    aio_co_enter(bdrv_get_aio_context(c->bs), co);
+}
 
-    return qiov.size;
+static void vmstate_chunk_wait(VMStateChunk *c)
+{
+    BDRV_POLL_WHILE(c->bs, qatomic_read(&c->in_flight));
 }
 
 static ssize_t block_get_buffer(void *opaque, uint8_t *buf, int64_t pos,
                                 size_t size, Error **errp)
 {
-    return bdrv_load_vmstate(opaque, buf, pos, size);
+    VMStateReader *r = opaque;
+    VMStateChunk *c = &r->chunk[r->cur];
+    VMStateChunk *next = &r->chunk[!r->cur];
+
+    assert(!qemu_in_coroutine());
+
+    if (c->pos < 0 || pos < c->pos || pos >= c->pos + VMSTATE_READ_CHUNK) {
+        vmstate_chunk_wait(next);
+        if (next->pos < 0 || pos != next->pos) {
+            /* Not a sequential read, the prefetched chunk is of no use */
+            vmstate_chunk_start(next, QEMU_ALIGN_DOWN(pos, VMSTATE_READ_CHUNK));
+            vmstate_chunk_wait(next);
+        }
+        r->cur = !r->cur;
+        c = next;
+        next = &r->chunk[!r->cur];
+
+        if (c->ret >= 0) {
+            vmstate_chunk_start(next, c->pos + VMSTATE_READ_CHUNK);
+        }
+    }
+
+    if (c->ret < 0) {
+        /* Do not return stale data if the same chunk is requested again */
+        c->pos = -1;
+        return c->ret;
+    }
+
+    size = MIN(size, c->pos + VMSTATE_READ_CHUNK - pos);
+    memcpy(buf, c->buf + (pos - c->pos), size);
+    return size;
 }
 
-static int bdrv_fclose(void *opaque, Error **errp)
+static int block_read_fclose(void *opaque, Error **errp)
 {
-    return bdrv_flush(opaque);
+    VMStateReader *r = opaque;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(r->chunk); i++) {
+        vmstate_chunk_wait(&r->chunk[i]);
+        qemu_vfree(r->chunk[i].buf);
+    }
+    g_free(r);
+    return 0;
 }
 
 static const QEMUFileOps bdrv_read_ops = {
     .get_buffer = block_get_buffer,
-    .close =      bdrv_fclose
+    .close =      block_read_fclose
 };
 
 static const QEMUFileOps bdrv_write_ops = {
     .writev_buffer  = block_writev_buffer,
-    .close          = bdrv_fclose
+    .close          = block_write_fclose
 };
 
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
+    VMStateReader *r;
+    VMStateWriter *w;
+    int i;
+
     if (is_writable) {
-        return qemu_fopen_ops(bs, &bdrv_write_ops, false);
+        w = g_new0(VMStateWriter, 1);
+        for (i = 0; i < ARRAY_SIZE(w->chunk); i++) {
+            w->chunk[i].bs = bs;
+            w->chunk[i].buf = qemu_blockalign(bs, VMSTATE_WRITE_CHUNK);
+        }
+        return qemu_fopen_ops(w, &bdrv_write_ops, false);
     }
-    return qemu_fopen_ops(bs, &bdrv_read_ops, false);
+
+    r = g_new0(VMStateReader, 1);
+    for (i = 0; i < ARRAY_SIZE(r->chunk); i++) {
+        r->chunk[i].bs = bs;
+        r->chunk[i].buf = qemu_blockalign(bs, VMSTATE_READ_CHUNK);
+        r->chunk[i].pos = -1;
+    }
+    return qemu_fopen_ops(r, &bdrv_read_ops, false);
 }
 
 
@@ -249,6 +448,13 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /* Time spent in the handlers of this entry, for query-migrate-stats */
+    Stat64 saves;
+    Stat64 save_time;
+    Stat64 save_time_max;
+    Stat64 loads;
+    Stat64 load_time;
+    Stat64 load_time_max;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -902,13 +1108,80 @@ void vmstate_unregister(VMStateIf *obj, const VMStateDescription *vmsd,
     }
 }
 
+static void savevm_account_save(SaveStateEntry *se, uint64_t ns)
+{
+    stat64_add(&se->saves, 1);
+    stat64_add(&se->save_time, ns);
+    stat64_max(&se->save_time_max, ns);
+}
+
+static void savevm_account_save_since(SaveStateEntry *se, int64_t start)
+{
+    savevm_account_save(se, migration_latency_start() - start);
+}
+
+static void savevm_reset_stats(bool load)
+{
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (load) {
+            stat64_init(&se->loads, 0);
+            stat64_init(&se->load_time, 0);
+            stat64_init(&se->load_time_max, 0);
+        } else {
+            stat64_init(&se->saves, 0);
+            stat64_init(&se->save_time, 0);
+            stat64_init(&se->save_time_max, 0);
+        }
+    }
+}
+
+MigrationDeviceStatsList *qemu_savevm_query_device_stats(void)
+{
+    MigrationDeviceStatsList *head = NULL, **tail = &head;
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        MigrationDeviceStats *stats;
+
+        if (!stat64_get(&se->saves) && !stat64_get(&se->loads)) {
+            continue;
+        }
+        stats = g_new0(MigrationDeviceStats, 1);
+        stats->idstr = g_strdup(se->idstr);
+        stats->instance_id = se->instance_id;
+        stats->saves = stat64_get(&se->saves);
+        stats->save_time = stat64_get(&se->save_time);
+        stats->save_time_max = stat64_get(&se->save_time_max);
+        stats->loads = stat64_get(&se->loads);
+        stats->load_time = stat64_get(&se->load_time);
+        stats->load_time_max = stat64_get(&se->load_time_max);
+        QAPI_LIST_APPEND(tail, stats);
+    }
+
+    return head;
+}
+
 static int vmstate_load(QEMUFile *f, SaveStateEntry *se)
 {
+    int64_t start = migration_latency_start();
+    uint64_t ns;
+    int ret;
+
     trace_vmstate_load(se->idstr, se->vmsd ? se->vmsd->name : "(old)");
     if (!se->vmsd) {         /* Old style */
-        return se->ops->load_state(f, se->opaque, se->load_version_id);
+        ret = se->ops->load_state(f, se->opaque, se->load_version_id);
+    } else {
+        ret = vmstate_load_state(f, se->vmsd, se->opaque,
+                                 se->load_version_id);
     }
-    return vmstate_load_state(f, se->vmsd, se->opaque, se->load_version_id);
+
+    ns = migration_latency_record(MIGRATION_PHASE_VMSTATE_LOAD, start);
+    stat64_add(&se->loads, 1);
+    stat64_add(&se->load_time, ns);
+    stat64_max(&se->load_time_max, ns);
+    return ret;
 }
 
 static void vmstate_save_old_style(QEMUFile *f, SaveStateEntry *se,
@@ -935,12 +1208,19 @@ static void vmstate_save_old_style(QEMUFile *f, SaveStateEntry *se,
 static int vmstate_save(QEMUFile *f, SaveStateEntry *se,
                         JSONWriter *vmdesc)
 {
+    int64_t start = migration_latency_start();
+    int ret = 0;
+
     trace_vmstate_save(se->idstr, se->vmsd ? se->vmsd->name : "(old)");
     if (!se->vmsd) {
         vmstate_save_old_style(f, se, vmdesc);
-        return 0;
+    } else {
+        ret = vmstate_save_state(f, se->vmsd, se->opaque, vmdesc);
     }
-    return vmstate_save_state(f, se->vmsd, se->opaque, vmdesc);
+
+    savevm_account_save(se, migration_latency_record(
+                                MIGRATION_PHASE_VMSTATE_SAVE, start));
+    return ret;
 }
 
 /*
@@ -1200,8 +1480,12 @@ void qemu_savevm_state_setup(QEMUFile *f)
 {
     SaveStateEntry *se;
     Error *local_err = NULL;
+    int64_t start;
     int ret;
 
+    migration_latency_reset();
+    savevm_reset_stats(false);
+
     trace_savevm_state_setup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (!se->ops || !se->ops->save_setup) {
@@ -1214,7 +1498,9 @@ void qemu_savevm_state_setup(QEMUFile *f)
         }
         save_section_header(f, se, QEMU_VM_SECTION_START);
 
+        start = migration_latency_start();
         ret = se->ops->save_setup(f, se->opaque);
+        savevm_account_save_since(se, start);
         save_section_footer(f, se);
         if (ret < 0) {
             qemu_file_set_error(f, ret);
@@ -1261,6 +1547,7 @@ int qemu_savevm_state_resume_prepare(MigrationState *s)
 int qemu_savevm_state_iterate(QEMUFile *f, bool postcopy)
 {
     SaveStateEntry *se;
+    int64_t start;
     int ret = 1;
 
     trace_savevm_state_iterate();
@@ -1293,7 +1580,9 @@ int qemu_savevm_state_iterate(QEMUFile *f, bool postcopy)
 
         save_section_header(f, se, QEMU_VM_SECTION_PART);
 
+        start = migration_latency_start();
         ret = se->ops->save_live_iterate(f, se->opaque);
+        savevm_account_save_since(se, start);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
         save_section_footer(f, se);
 
@@ -1320,6 +1609,41 @@ static bool should_send_vmdesc(void)
     return !machine->suppress_vmdesc && !in_postcopy;
 }
 
+/*
+ * Calls the save_postcopy_prepare methods, with the source stopped and
+ * before the discard bitmap is sent.  Each handler gets a section of its
+ * own on the main migration stream.
+ */
+int qemu_savevm_state_postcopy_prepare(QEMUFile *f)
+{
+    SaveStateEntry *se;
+    int ret;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (!se->ops || !se->ops->save_postcopy_prepare) {
+            continue;
+        }
+        if (se->ops->is_active) {
+            if (!se->ops->is_active(se->opaque)) {
+                continue;
+            }
+        }
+        trace_savevm_section_start(se->idstr, se->section_id);
+
+        save_section_header(f, se, QEMU_VM_SECTION_PART);
+
+        ret = se->ops->save_postcopy_prepare(f, se->opaque);
+        trace_savevm_section_end(se->idstr, se->section_id, ret);
+        save_section_footer(f, se);
+        if (ret < 0) {
+            qemu_file_set_error(f, ret);
+            return ret;
+        }
+    }
+
+    return qemu_file_get_error(f);
+}
+
 /*
  * Calls the save_live_complete_postcopy methods
  * causing the last few pages to be sent immediately and doing any associated
@@ -1330,6 +1654,7 @@ static bool should_send_vmdesc(void)
 void qemu_savevm_state_complete_postcopy(QEMUFile *f)
 {
     SaveStateEntry *se;
+    int64_t start;
     int ret;
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
@@ -1346,7 +1671,9 @@ void qemu_savevm_state_complete_postcopy(QEMUFile *f)
         qemu_put_byte(f, QEMU_VM_SECTION_END);
         qemu_put_be32(f, se->section_id);
 
+        start = migration_latency_start();
         ret = se->ops->save_live_complete_postcopy(f, se->opaque);
+        savevm_account_save_since(se, start);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
         save_section_footer(f, se);
         if (ret < 0) {
@@ -1363,6 +1690,7 @@ static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
     SaveStateEntry *se;
+    int64_t start;
     int ret;
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
@@ -1382,7 +1710,9 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 
         save_section_header(f, se, QEMU_VM_SECTION_END);
 
+        start = migration_latency_start();
         ret = se->ops->save_live_complete_precopy(f, se->opaque);
+        savevm_account_save_since(se, start);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
         save_section_footer(f, se);
         if (ret < 0) {
@@ -1470,6 +1800,7 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     int ret;
     Error *local_err = NULL;
     bool in_postcopy = migration_in_postcopy();
+    int64_t start = migration_latency_start();
 
     if (precopy_notify(PRECOPY_NOTIFY_COMPLETE, &local_err)) {
         error_report_err(local_err);
@@ -1498,6 +1829,7 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
 
 flush:
     qemu_fflush(f);
+    migration_latency_record(MIGRATION_PHASE_COMPLETE_PRECOPY, start);
     return 0;
 }
 
@@ -1907,6 +2239,9 @@ static void *postcopy_ram_listen_thread(void *opaque)
          * state yet; wait for the end of the main thread.
          */
         qemu_event_wait(&mis->main_thread_load_event);
+    } else if (mis->postcopy_qemufile_dst) {
+        /* The source won't terminate the preempt channel, do it here */
+        qemu_file_shutdown(mis->postcopy_qemufile_dst);
     }
     postcopy_ram_incoming_cleanup(mis);
 
@@ -2580,6 +2915,9 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
     qemu_fclose(mis->from_src_file);
     mis->from_src_file = NULL;
 
+    /* The source connects a new preempt channel when it resumes */
+    postcopy_preempt_incoming_stop(mis);
+
     assert(mis->to_src_file);
     qemu_file_shutdown(mis->to_src_file);
     qemu_mutex_lock(&mis->rp_mutex);
@@ -2691,6 +3029,9 @@ int qemu_loadvm_state(QEMUFile *f)
         return -EINVAL;
     }
 
+    migration_latency_reset();
+    savevm_reset_stats(true);
+
     ret = qemu_loadvm_state_header(f);
     if (ret) {
         return ret;
@@ -39,6 +39,24 @@ void socket_send_channel_create(QIOTaskFunc f, void *data)
                                      f, data, NULL, NULL);
 }
 
+QIOChannel *socket_send_channel_create_sync(Error **errp)
+{
+    QIOChannelSocket *sioc;
+
+    if (!outgoing_args.saddr) {
+        error_setg(errp, "Additional channels need a socket migration URI");
+        return NULL;
+    }
+
+    sioc = qio_channel_socket_new();
+    if (qio_channel_socket_connect_sync(sioc, outgoing_args.saddr, errp) < 0) {
+        object_unref(OBJECT(sioc));
+        return NULL;
+    }
+
+    return QIO_CHANNEL(sioc);
+}
+
 int socket_send_channel_destroy(QIOChannel *send)
 {
     /* Remove channel */
@@ -159,6 +177,9 @@ socket_start_incoming_migration_internal(SocketAddress *saddr,
     if (migrate_use_multifd()) {
         num = migrate_multifd_channels();
     }
+    if (migrate_postcopy_preempt()) {
+        num++;
+    }
 
     if (qio_net_listener_open_sync(listener, saddr, num, errp) < 0) {
         object_unref(OBJECT(listener));
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,17 +25,14 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
     long res;
     uint8_t *nzrun_start = NULL;
 
-    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
-               sizeof(long)));
-
     while (i < slen) {
         /* overflow */
         if (d + 2 > dlen) {
@@ -126,6 +124,316 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT) || \
+    defined(__aarch64__)
+/*
+ * The vector encoders produce exactly the same stream as the scalar one;
+ * only the search for the end of each run is done a vector at a time.
+ * @skip_equal returns the first index from @i where the buffers differ,
+ * @skip_diff the first index from @i where they are equal, or @slen.
+ */
+static inline int xbzrle_skip_equal_int(uint8_t *old_buf, uint8_t *new_buf,
+                                        int i, int slen)
+{
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int xbzrle_skip_diff_int(uint8_t *old_buf, uint8_t *new_buf,
+                                       int i, int slen)
+{
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+#define XBZRLE_ENCODE_BODY(skip_equal, skip_diff)                       \
+    int d = 0, i = 0;                                                   \
+                                                                        \
+    while (i < slen) {                                                  \
+        int run_start = i;                                              \
+        uint32_t run_len;                                               \
+                                                                        \
+        /* overflow */                                                  \
+        if (d + 2 > dlen) {                                             \
+            return -1;                                                  \
+        }                                                               \
+                                                                        \
+        i = skip_equal(old_buf, new_buf, i, slen);                      \
+        run_len = i - run_start;                                        \
+                                                                        \
+        /* buffer unchanged */                                          \
+        if (run_len == slen) {                                          \
+            return 0;                                                   \
+        }                                                               \
+                                                                        \
+        /* skip last zero run */                                        \
+        if (i == slen) {                                                \
+            return d;                                                   \
+        }                                                               \
+                                                                        \
+        d += uleb128_encode_small(dst + d, run_len);                    \
+                                                                        \
+        /* overflow */                                                  \
+        if (d + 2 > dlen) {                                             \
+            return -1;                                                  \
+        }                                                               \
+                                                                        \
+        run_start = i;                                                  \
+        i = skip_diff(old_buf, new_buf, i, slen);                       \
+        run_len = i - run_start;                                        \
+                                                                        \
+        d += uleb128_encode_small(dst + d, run_len);                    \
+        /* overflow */                                                  \
+        if (d + run_len > dlen) {                                       \
+            return -1;                                                  \
+        }                                                               \
+        memcpy(dst + d, new_buf + run_start, run_len);                  \
+        d += run_len;                                                   \
+    }                                                                   \
+                                                                        \
+    return d;
+#endif
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+/*
+ * NEON has no movemask; narrowing the 16 byte compare result by 4 bits
+ * gives a 64 bit mask with one nibble per byte.
+ */
+static inline uint64_t xbzrle_eq_mask_neon(uint8_t *old_buf, uint8_t *new_buf)
+{
+    uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf), vld1q_u8(new_buf));
+
+    return vget_lane_u64(vreinterpret_u64_u8(
+                             vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+static inline int xbzrle_skip_equal_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                         int i, int slen)
+{
+    for (; i + 16 <= slen; i += 16) {
+        uint64_t mask = xbzrle_eq_mask_neon(old_buf + i, new_buf + i);
+
+        if (mask != UINT64_MAX) {
+            return i + ctz64(~mask) / 4;
+        }
+    }
+    return xbzrle_skip_equal_int(old_buf, new_buf, i, slen);
+}
+
+static inline int xbzrle_skip_diff_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                        int i, int slen)
+{
+    for (; i + 16 <= slen; i += 16) {
+        uint64_t mask = xbzrle_eq_mask_neon(old_buf + i, new_buf + i);
+
+        if (mask) {
+            return i + ctz64(mask) / 4;
+        }
+    }
+    return xbzrle_skip_diff_int(old_buf, new_buf, i, slen);
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    XBZRLE_ENCODE_BODY(xbzrle_skip_equal_neon, xbzrle_skip_diff_neon)
+}
+#endif /* __aarch64__ */
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline uint32_t xbzrle_eq_mask_avx2(uint8_t *old_buf, uint8_t *new_buf)
+{
+    __m256i old_v = _mm256_loadu_si256((__m256i *)old_buf);
+    __m256i new_v = _mm256_loadu_si256((__m256i *)new_buf);
+
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(old_v, new_v));
+}
+
+static inline int xbzrle_skip_equal_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                         int i, int slen)
+{
+    for (; i + 32 <= slen; i += 32) {
+        uint32_t mask = xbzrle_eq_mask_avx2(old_buf + i, new_buf + i);
+
+        if (mask != UINT32_MAX) {
+            return i + ctz32(~mask);
+        }
+    }
+    return xbzrle_skip_equal_int(old_buf, new_buf, i, slen);
+}
+
+static inline int xbzrle_skip_diff_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                        int i, int slen)
+{
+    for (; i + 32 <= slen; i += 32) {
+        uint32_t mask = xbzrle_eq_mask_avx2(old_buf + i, new_buf + i);
+
+        if (mask) {
+            return i + ctz32(mask);
+        }
+    }
+    return xbzrle_skip_diff_int(old_buf, new_buf, i, slen);
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    XBZRLE_ENCODE_BODY(xbzrle_skip_equal_avx2, xbzrle_skip_diff_avx2)
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512bw")
+#include <immintrin.h>
+
+static inline uint64_t xbzrle_eq_mask_avx512(uint8_t *old_buf,
+                                             uint8_t *new_buf)
+{
+    __m512i old_v = _mm512_loadu_si512(old_buf);
+    __m512i new_v = _mm512_loadu_si512(new_buf);
+
+    return _mm512_cmpeq_epi8_mask(old_v, new_v);
+}
+
+static inline int xbzrle_skip_equal_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                           int i, int slen)
+{
+    for (; i + 64 <= slen; i += 64) {
+        uint64_t mask = xbzrle_eq_mask_avx512(old_buf + i, new_buf + i);
+
+        if (mask != UINT64_MAX) {
+            return i + ctz64(~mask);
+        }
+    }
+    return xbzrle_skip_equal_int(old_buf, new_buf, i, slen);
+}
+
+static inline int xbzrle_skip_diff_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                          int i, int slen)
+{
+    for (; i + 64 <= slen; i += 64) {
+        uint64_t mask = xbzrle_eq_mask_avx512(old_buf + i, new_buf + i);
+
+        if (mask) {
+            return i + ctz64(mask);
+        }
+    }
+    return xbzrle_skip_diff_int(old_buf, new_buf, i, slen);
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    XBZRLE_ENCODE_BODY(xbzrle_skip_equal_avx512, xbzrle_skip_diff_avx512)
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512F_OPT */
+
+/*
+ * Note that for test_xbzrle_encode_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX512BW 1
+#define CACHE_AVX2     2
+#define CACHE_NEON     4
+
+typedef int (*xbzrle_encode_fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
+
+#ifdef __aarch64__
+/* NEON is part of the base ISA, no need to look for it at runtime */
+static unsigned cpuid_cache = CACHE_NEON;
+static xbzrle_encode_fn encode_accel = xbzrle_encode_buffer_neon;
+#else
+static unsigned cpuid_cache;
+static xbzrle_encode_fn encode_accel = xbzrle_encode_buffer_int;
+#endif
+
+static void init_accel(unsigned cache)
+{
+    xbzrle_encode_fn fn = xbzrle_encode_buffer_int;
+
+#ifdef __aarch64__
+    if (cache & CACHE_NEON) {
+        fn = xbzrle_encode_buffer_neon;
+    }
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = xbzrle_encode_buffer_avx2;
+    }
+#endif
+#ifdef CONFIG_AVX512F_OPT
+    if (cache & CACHE_AVX512BW) {
+        fn = xbzrle_encode_buffer_avx512;
+    }
+#endif
+    encode_accel = fn;
+}
+
+#if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+            /* Opmask, ZMM and YMM/XMM state, see util/bufferiszero.c */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512BW)) {
+                cache |= CACHE_AVX512BW;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    /* If no bits set, we just tested the scalar encoder */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
+               sizeof(long)));
+
+    return encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
@@ -40,6 +40,7 @@
 #include "qapi/qapi-commands-pci.h"
 #include "qapi/qapi-commands-rocker.h"
 #include "qapi/qapi-commands-run-state.h"
+#include "qapi/qapi-commands-stats.h"
 #include "qapi/qapi-commands-tpm.h"
 #include "qapi/qapi-commands-ui.h"
 #include "qapi/qapi-visit-net.h"
@@ -52,6 +53,7 @@
 #include "ui/console.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "exec/memory.h"
 #include "exec/ramlist.h"
 #include "hw/intc/intc.h"
 #include "hw/rdma/rdma.h"
@@ -289,10 +291,21 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
                            info->ram->dirty_pages_rate);
         }
+        if (info->ram->dirty_sync_count) {
+            monitor_printf(mon, "dirty sync time: log %" PRIu64
+                           " us, bitmap %" PRIu64 " us\n",
+                           info->ram->dirty_sync_log_time,
+                           info->ram->dirty_sync_bitmap_time);
+        }
         if (info->ram->postcopy_requests) {
             monitor_printf(mon, "postcopy request count: %" PRIu64 "\n",
                            info->ram->postcopy_requests);
         }
+        if (info->ram->dirty_sync_missed_zero_copy) {
+            monitor_printf(mon,
+                           "Zero-copy-send fallbacks happened: %" PRIu64 " times\n",
+                           info->ram->dirty_sync_missed_zero_copy);
+        }
     }
 
     if (info->has_disk) {
@@ -339,6 +352,16 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->cpu_throttle_percentage);
     }
 
+    if (info->has_vcpu_throttle_percentage) {
+        intList *item;
+
+        monitor_printf(mon, "vcpu throttle percentage:");
+        for (item = info->vcpu_throttle_percentage; item; item = item->next) {
+            monitor_printf(mon, " %" PRId64, item->value);
+        }
+        monitor_printf(mon, "\n");
+    }
+
     if (info->has_postcopy_blocktime) {
         monitor_printf(mon, "postcopy blocktime: %u\n",
                        info->postcopy_blocktime);
@@ -373,6 +396,19 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->vfio->transferred >> 10);
     }
 
+    if (info->has_multifd_channels) {
+        MultiFDChannelStatsList *chan;
+
+        monitor_printf(mon, "multifd channels: [\n");
+        for (chan = info->multifd_channels; chan; chan = chan->next) {
+            monitor_printf(mon, "\t%" PRId64 ": packets %" PRIu64
+                           " pages %" PRIu64 " bytes %" PRIu64 "\n",
+                           chan->value->id, chan->value->packets,
+                           chan->value->pages, chan->value->bytes);
+        }
+        monitor_printf(mon, "]\n");
+    }
+
     qapi_free_MigrationInfo(info);
 }
 
@@ -478,6 +514,12 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_COMPRESSION),
             MultiFDCompression_str(params->multifd_compression));
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
+        monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_SUBPAGE_BUDGET),
+            params->postcopy_subpage_budget);
         monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -987,6 +1029,30 @@ void hmp_sync_profile(Monitor *mon, const QDict *qdict)
     }
 }
 
+void hmp_mmio_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+
+    if (op == NULL) {
+        bool on = mmio_stats_is_enabled();
+
+        monitor_printf(mon, "mmio-stats is %s\n", on ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        mmio_stats_enable();
+    } else if (!strcmp(op, "off")) {
+        mmio_stats_disable();
+    } else if (!strcmp(op, "reset")) {
+        mmio_stats_reset();
+    } else {
+        Error *err = NULL;
+
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+        hmp_handle_error(mon, err);
+    }
+}
+
 void hmp_system_reset(Monitor *mon, const QDict *qdict)
 {
     qmp_system_reset(NULL);
@@ -1364,6 +1430,14 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_multifd_zstd_level = true;
         visit_type_uint8(v, param, &p->multifd_zstd_level, &err);
         break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_SUBPAGE_BUDGET:
+        p->has_postcopy_subpage_budget = true;
+        visit_type_size(v, param, &p->postcopy_subpage_budget, &err);
+        break;
     case MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE:
         p->has_xbzrle_cache_size = true;
         if (!visit_type_size(v, param, &cache_size, &err)) {
@@ -1905,11 +1979,75 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-misses=%" PRIu64 "\n", value->poll_misses);
+        monitor_printf(mon, "  poll-time-ns=%" PRIu64 "\n",
+                       value->poll_time_ns);
     }
 
     qapi_free_IOThreadInfoList(info_list);
 }
 
+/* Prometheus metric names only allow [a-zA-Z0-9_:] */
+static char *hmp_stats_metric_name(StatsValue *value)
+{
+    char *name = g_strdup_printf("qemu_%s_%s%s", value->provider,
+                                 value->name,
+                                 value->has_histogram ? "_seconds" : "");
+    char *p;
+
+    for (p = name; *p; p++) {
+        if (!g_ascii_isalnum(*p)) {
+            *p = '_';
+        }
+    }
+    return name;
+}
+
+void hmp_info_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *provider = qdict_get_try_str(qdict, "provider");
+    StatsValueList *list = qmp_query_stats(!!provider, provider, NULL);
+    StatsValueList *elem;
+
+    for (elem = list; elem; elem = elem->next) {
+        StatsValue *value = elem->value;
+        g_autofree char *name = hmp_stats_metric_name(value);
+        g_autofree char *label = NULL;
+        uint64List *bucket;
+        uint64_t cumulative = 0;
+        int i = 0;
+
+        if (value->has_instance) {
+            label = g_strdup_printf("instance=\"%s\"", value->instance);
+        }
+
+        if (value->has_value) {
+            monitor_printf(mon, "%s{%s} %" PRIu64 "\n", name,
+                           label ? label : "", value->value);
+            continue;
+        }
+
+        /* Bucket i holds samples below 2^i microseconds */
+        for (bucket = value->histogram->buckets; bucket;
+             bucket = bucket->next, i++) {
+            cumulative += bucket->value;
+            monitor_printf(mon, "%s_bucket{%s%sle=\"%g\"} %" PRIu64 "\n",
+                           name, label ? label : "", label ? "," : "",
+                           (double)(1ULL << i) / 1e6, cumulative);
+        }
+        monitor_printf(mon, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n",
+                       name, label ? label : "", label ? "," : "",
+                       value->histogram->count);
+        monitor_printf(mon, "%s_sum{%s} %.9f\n", name, label ? label : "",
+                       value->histogram->total / 1e9);
+        monitor_printf(mon, "%s_count{%s} %" PRIu64 "\n", name,
+                       label ? label : "", value->histogram->count);
+    }
+
+    qapi_free_StatsValueList(list);
+}
+
 void hmp_rocker(Monitor *mon, const QDict *qdict)
 {
     const char *name = qdict_get_str(qdict, "name");
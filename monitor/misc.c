@@ -929,6 +929,17 @@ static void hmp_info_mtree(Monitor *mon, const QDict *qdict)
     mtree_info(flatview, dispatch_tree, owner, disabled);
 }
 
+static void hmp_info_mmio_stats(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 20);
+
+    if (!mmio_stats_is_enabled()) {
+        monitor_printf(mon, "mmio-stats is off, "
+                       "use \"mmio-stats on\" to enable it\n");
+    }
+    mmio_stats_info(max);
+}
+
 #ifdef CONFIG_PROFILER
 
 int64_t dev_time;
@@ -35,10 +35,12 @@
 #include "qapi/qapi-commands-control.h"
 #include "qapi/qapi-commands-machine.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qapi/qapi-commands-stats.h"
 #include "qapi/qapi-commands-ui.h"
 #include "qapi/qmp/qerror.h"
 #include "hw/mem/memory-device.h"
 #include "hw/acpi/acpi_dev_interface.h"
+#include "qemu/stats.h"
 
 NameInfo *qmp_query_name(Error **errp)
 {
@@ -350,3 +352,66 @@ void qmp_display_reload(DisplayReloadOptions *arg, Error **errp)
         abort();
     }
 }
+
+typedef struct QueryStatsState {
+    const char *provider;
+    StatsValueList **tail;
+} QueryStatsState;
+
+static void query_stats_one(const char *provider, const char *instance,
+                            const char *name, const uint64_t *counter,
+                            const StatsHistogram *hist, void *opaque)
+{
+    QueryStatsState *s = opaque;
+    StatsValue *value;
+    int i, last;
+
+    if (s->provider && !g_str_equal(s->provider, provider)) {
+        return;
+    }
+
+    value = g_new0(StatsValue, 1);
+    value->provider = g_strdup(provider);
+    value->has_instance = instance != NULL;
+    value->instance = g_strdup(instance);
+    value->name = g_strdup(name);
+
+    if (counter) {
+        value->has_value = true;
+        value->value = *counter;
+    } else {
+        StatsHistogramInfo *info = g_new0(StatsHistogramInfo, 1);
+        uint64List **bucket_tail = &info->buckets;
+
+        info->count = stat64_get(&hist->count);
+        info->total = stat64_get(&hist->total);
+        info->min = info->count ? stat64_get(&hist->min) : 0;
+        info->max = stat64_get(&hist->max);
+
+        for (last = STATS_HISTOGRAM_BUCKETS - 1; last >= 0; last--) {
+            if (stat64_get(&hist->buckets[last])) {
+                break;
+            }
+        }
+        for (i = 0; i <= last; i++) {
+            QAPI_LIST_APPEND(bucket_tail, stat64_get(&hist->buckets[i]));
+        }
+        value->has_histogram = true;
+        value->histogram = info;
+    }
+
+    QAPI_LIST_APPEND(s->tail, value);
+}
+
+StatsValueList *qmp_query_stats(bool has_provider, const char *provider,
+                                Error **errp)
+{
+    StatsValueList *head = NULL;
+    QueryStatsState s = {
+        .provider = has_provider ? provider : NULL,
+        .tail = &head,
+    };
+
+    stats_foreach(query_stats_one, &s);
+    return head;
+}
@@ -878,12 +878,13 @@ static int nbd_list_meta_contexts(QIOChannel *ioc,
  *          1: server is newstyle, but can only accept EXPORT_NAME
  *          2: server is newstyle, but lacks structured replies
  *          3: server is newstyle and set up for structured replies
+ *          4: server is newstyle and set up for extended headers
  */
 static int nbd_start_negotiate(AioContext *aio_context, QIOChannel *ioc,
                                QCryptoTLSCreds *tlscreds,
                                const char *hostname, QIOChannel **outioc,
-                               bool structured_reply, bool *zeroes,
-                               Error **errp)
+                               bool structured_reply, bool extended_headers,
+                               bool *zeroes, Error **errp)
 {
     ERRP_GUARD();
     uint64_t magic;
@@ -960,6 +961,17 @@ static int nbd_start_negotiate(AioContext *aio_context, QIOChannel *ioc,
         if (fixedNewStyle) {
             int result = 0;
 
+            if (extended_headers) {
+                result = nbd_request_simple_option(ioc,
+                                                   NBD_OPT_EXTENDED_HEADERS,
+                                                   false, errp);
+                if (result < 0) {
+                    return -EINVAL;
+                }
+                if (result) {
+                    return 4;
+                }
+            }
             if (structured_reply) {
                 result = nbd_request_simple_option(ioc,
                                                    NBD_OPT_STRUCTURED_REPLY,
@@ -1030,15 +1042,21 @@ int nbd_receive_negotiate(AioContext *aio_context, QIOChannel *ioc,
     trace_nbd_receive_negotiate_name(info->name);
 
     result = nbd_start_negotiate(aio_context, ioc, tlscreds, hostname, outioc,
-                                 info->structured_reply, &zeroes, errp);
+                                 info->structured_reply,
+                                 info->structured_reply &&
+                                 info->extended_headers, &zeroes, errp);
 
     info->structured_reply = false;
+    info->extended_headers = false;
     info->base_allocation = false;
     if (tlscreds && *outioc) {
         ioc = *outioc;
     }
 
     switch (result) {
+    case 4: /* newstyle, with extended headers */
+        info->extended_headers = true;
+        /* fall through */
     case 3: /* newstyle, with structured replies */
         info->structured_reply = true;
         if (base_allocation) {
@@ -1150,7 +1168,7 @@ int nbd_receive_export_list(QIOChannel *ioc, QCryptoTLSCreds *tlscreds,
 
     *info = NULL;
     result = nbd_start_negotiate(NULL, ioc, tlscreds, hostname, &sioc, true,
-                                 NULL, errp);
+                                 false, NULL, errp);
     if (tlscreds && sioc) {
         ioc = sioc;
     }
@@ -1347,20 +1365,29 @@ int nbd_disconnect(int fd)
 
 int nbd_send_request(QIOChannel *ioc, NBDRequest *request)
 {
-    uint8_t buf[NBD_REQUEST_SIZE];
+    uint8_t buf[NBD_EXTENDED_REQUEST_SIZE];
+    size_t len;
 
     trace_nbd_send_request(request->from, request->len, request->handle,
                            request->flags, request->type,
                            nbd_cmd_lookup(request->type));
 
-    stl_be_p(buf, NBD_REQUEST_MAGIC);
     stw_be_p(buf + 4, request->flags);
     stw_be_p(buf + 6, request->type);
     stq_be_p(buf + 8, request->handle);
     stq_be_p(buf + 16, request->from);
-    stl_be_p(buf + 24, request->len);
+    if (request->extended) {
+        stl_be_p(buf, NBD_EXTENDED_REQUEST_MAGIC);
+        stq_be_p(buf + 24, request->len);
+        len = NBD_EXTENDED_REQUEST_SIZE;
+    } else {
+        assert(request->len <= UINT32_MAX);
+        stl_be_p(buf, NBD_REQUEST_MAGIC);
+        stl_be_p(buf + 24, request->len);
+        len = NBD_REQUEST_SIZE;
+    }
 
-    return nbd_write(ioc, buf, sizeof(buf), NULL);
+    return nbd_write(ioc, buf, len, NULL);
 }
 
 /* nbd_receive_simple_reply
@@ -1415,6 +1442,41 @@ static int nbd_receive_structured_reply_chunk(QIOChannel *ioc,
     return 0;
 }
 
+/* nbd_receive_extended_reply_chunk
+ * Read extended reply header except magic field (which should be already
+ * read), and store it in @chunk.
+ * Payload is not read.
+ */
+static int nbd_receive_extended_reply_chunk(QIOChannel *ioc,
+                                            NBDStructuredReplyChunk *chunk,
+                                            Error **errp)
+{
+    NBDExtendedReplyChunk ext;
+    int ret;
+
+    assert(chunk->magic == NBD_EXTENDED_REPLY_MAGIC);
+
+    ret = nbd_read(ioc, (uint8_t *)&ext + sizeof(ext.magic),
+                   sizeof(ext) - sizeof(ext.magic), "extended chunk",
+                   errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* None of the payloads of the replies that we expect needs 64 bits */
+    if (be64_to_cpu(ext.length) > UINT32_MAX) {
+        error_setg(errp, "Extended reply chunk payload too large");
+        return -EINVAL;
+    }
+
+    chunk->flags = be16_to_cpu(ext.flags);
+    chunk->type = be16_to_cpu(ext.type);
+    chunk->handle = be64_to_cpu(ext.handle);
+    chunk->length = be64_to_cpu(ext.length);
+
+    return 0;
+}
+
 /* nbd_read_eof
  * Tries to read @size bytes from @ioc.
  * Returns 1 on success
@@ -1489,7 +1551,14 @@ int coroutine_fn nbd_receive_reply(BlockDriverState *bs, QIOChannel *ioc,
                                        reply->handle);
         break;
     case NBD_STRUCTURED_REPLY_MAGIC:
-        ret = nbd_receive_structured_reply_chunk(ioc, &reply->structured, errp);
+    case NBD_EXTENDED_REPLY_MAGIC:
+        if (reply->magic == NBD_EXTENDED_REPLY_MAGIC) {
+            ret = nbd_receive_extended_reply_chunk(ioc, &reply->structured,
+                                                   errp);
+        } else {
+            ret = nbd_receive_structured_reply_chunk(ioc, &reply->structured,
+                                                     errp);
+        }
         if (ret < 0) {
             break;
         }
@@ -79,6 +79,8 @@ const char *nbd_opt_lookup(uint32_t opt)
         return "list meta context";
     case NBD_OPT_SET_META_CONTEXT:
         return "set meta context";
+    case NBD_OPT_EXTENDED_HEADERS:
+        return "extended headers";
     default:
         return "<unknown>";
     }
@@ -171,6 +173,8 @@ const char *nbd_reply_type_lookup(uint16_t type)
         return "hole";
     case NBD_REPLY_TYPE_BLOCK_STATUS:
         return "block status";
+    case NBD_REPLY_TYPE_BLOCK_STATUS_EXT:
+        return "block status ext";
     case NBD_REPLY_TYPE_ERROR:
         return "generic error";
     case NBD_REPLY_TYPE_ERROR_OFFSET:
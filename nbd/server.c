@@ -26,6 +26,12 @@
 #include "nbd-internal.h"
 #include "qemu/units.h"
 
+#ifdef CONFIG_LINUX
+#include <poll.h>
+#include <sys/sendfile.h>
+#include "block/thread-pool.h"
+#endif
+
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
 /* Dirty bitmaps use 'NBD_META_ID_DIRTY_BITMAP + i', so keep this id last. */
@@ -142,6 +148,7 @@ struct NBDClient {
     uint32_t check_align; /* If non-zero, check for aligned client requests */
 
     bool structured_reply;
+    bool extended_headers; /* implies structured_reply */
     NBDExportMetaContexts export_meta;
 
     uint32_t opt; /* Current option being negotiated */
@@ -1254,6 +1261,10 @@ static int nbd_negotiate_options(NBDClient *client, Error **errp)
             case NBD_OPT_STRUCTURED_REPLY:
                 if (length) {
                     ret = nbd_reject_length(client, false, errp);
+                } else if (client->extended_headers) {
+                    ret = nbd_negotiate_send_rep_err(
+                        client, NBD_REP_ERR_INVALID, errp,
+                        "extended headers already negotiated");
                 } else if (client->structured_reply) {
                     ret = nbd_negotiate_send_rep_err(
                         client, NBD_REP_ERR_INVALID, errp,
@@ -1264,6 +1275,20 @@ static int nbd_negotiate_options(NBDClient *client, Error **errp)
                 }
                 break;
 
+            case NBD_OPT_EXTENDED_HEADERS:
+                if (length) {
+                    ret = nbd_reject_length(client, false, errp);
+                } else if (client->extended_headers) {
+                    ret = nbd_negotiate_send_rep_err(
+                        client, NBD_REP_ERR_INVALID, errp,
+                        "extended headers already negotiated");
+                } else {
+                    ret = nbd_negotiate_send_rep(client, NBD_REP_ACK, errp);
+                    client->extended_headers = true;
+                    client->structured_reply = true;
+                }
+                break;
+
             case NBD_OPT_LIST_META_CONTEXT:
             case NBD_OPT_SET_META_CONTEXT:
                 ret = nbd_negotiate_meta_queries(client, &client->export_meta,
@@ -1405,11 +1430,14 @@ nbd_read_eof(NBDClient *client, void *buffer, size_t size, Error **errp)
 static int nbd_receive_request(NBDClient *client, NBDRequest *request,
                                Error **errp)
 {
-    uint8_t buf[NBD_REQUEST_SIZE];
-    uint32_t magic;
+    uint8_t buf[NBD_EXTENDED_REQUEST_SIZE];
+    uint32_t magic, expected_magic;
+    size_t size;
     int ret;
 
-    ret = nbd_read_eof(client, buf, sizeof(buf), errp);
+    size = client->extended_headers ? NBD_EXTENDED_REQUEST_SIZE
+                                    : NBD_REQUEST_SIZE;
+    ret = nbd_read_eof(client, buf, size, errp);
     if (ret < 0) {
         return ret;
     }
@@ -1421,6 +1449,11 @@ static int nbd_receive_request(NBDClient *client, NBDRequest *request,
        [ 8 .. 15]   handle
        [16 .. 23]   from
        [24 .. 27]   len
+
+       Extended request
+       [ 0 ..  3]   magic   (NBD_EXTENDED_REQUEST_MAGIC)
+       [ 4 .. 23]   as above
+       [24 .. 31]   len
      */
 
     magic = ldl_be_p(buf);
@@ -1428,12 +1461,19 @@ static int nbd_receive_request(NBDClient *client, NBDRequest *request,
     request->type   = lduw_be_p(buf + 6);
     request->handle = ldq_be_p(buf + 8);
     request->from   = ldq_be_p(buf + 16);
-    request->len    = ldl_be_p(buf + 24);
+    if (client->extended_headers) {
+        request->len = ldq_be_p(buf + 24);
+        expected_magic = NBD_EXTENDED_REQUEST_MAGIC;
+    } else {
+        request->len = ldl_be_p(buf + 24);
+        expected_magic = NBD_REQUEST_MAGIC;
+    }
+    request->extended = client->extended_headers;
 
     trace_nbd_receive_request(magic, request->flags, request->type,
                               request->from, request->len);
 
-    if (magic != NBD_REQUEST_MAGIC) {
+    if (magic != expected_magic) {
         error_setg(errp, "invalid magic (got 0x%" PRIx32 ")", magic);
         return -EINVAL;
     }
@@ -1844,16 +1884,23 @@ const BlockExportDriver blk_exp_nbd = {
     .request_shutdown   = nbd_export_request_shutdown,
 };
 
+/*
+ * Send @iov to the client.  @more tells that another chunk of the same
+ * structured reply follows right away, so that the socket can coalesce
+ * them into fewer packets.
+ */
 static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
-                                        unsigned niov, Error **errp)
+                                        unsigned niov, bool more, Error **errp)
 {
+    int flags = more ? QIO_CHANNEL_WRITE_FLAG_MORE : 0;
     int ret;
 
     g_assert(qemu_in_coroutine());
     qemu_co_mutex_lock(&client->send_lock);
     client->send_coroutine = qemu_coroutine_self();
 
-    ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ? -EIO : 0;
+    ret = qio_channel_writev_full_all(client->ioc, iov, niov, NULL, 0, flags,
+                                      errp) < 0 ? -EIO : 0;
 
     client->send_coroutine = NULL;
     qemu_co_mutex_unlock(&client->send_lock);
@@ -1861,6 +1908,151 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+#ifdef CONFIG_LINUX
+typedef struct NBDSendFileData {
+    int sockfd;
+    int fd;
+    off_t offset;
+    size_t size;
+} NBDSendFileData;
+
+static const uint8_t nbd_sendfile_zeroes[4096];
+
+static int nbd_sendfile_wait(int sockfd)
+{
+    struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+    int ret;
+
+    do {
+        ret = poll(&pfd, 1, -1);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? -errno : 0;
+}
+
+/*
+ * Runs in a worker thread.  The socket is non-blocking because the
+ * coroutine side of the channel uses it, so wait for it here if needed.
+ */
+static int nbd_sendfile_worker(void *opaque)
+{
+    NBDSendFileData *data = opaque;
+    bool eof = false;
+    int ret;
+
+    while (data->size) {
+        ssize_t len;
+
+        if (!eof) {
+            len = sendfile(data->sockfd, data->fd, &data->offset, data->size);
+            if (len == 0) {
+                /* The export extends past the end of the file */
+                eof = true;
+                continue;
+            }
+        } else {
+            len = send(data->sockfd, nbd_sendfile_zeroes,
+                       MIN(data->size, sizeof(nbd_sendfile_zeroes)),
+                       MSG_NOSIGNAL);
+        }
+
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return -errno;
+            }
+            ret = nbd_sendfile_wait(data->sockfd);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+        data->size -= len;
+    }
+
+    return 0;
+}
+
+/*
+ * Return a file descriptor from which the export data can be sent to the
+ * client without going through a bounce buffer, or -errno.  This bypasses
+ * the block layer, so it is only possible if nothing in the I/O path would
+ * have to look at the data (TLS) or the request (throttling, filters).
+ */
+static int nbd_export_read_fd(NBDClient *client)
+{
+    BlockBackend *blk = client->exp->common.blk;
+
+    if (client->tlscreds || client->ioc != QIO_CHANNEL(client->sioc)) {
+        return -ENOTSUP;
+    }
+    if (blk_get_public(blk)->throttle_group_member.throttle_state) {
+        return -ENOTSUP;
+    }
+    return bdrv_get_read_fd(blk_bs(blk));
+}
+
+/*
+ * Send @iov followed by @size bytes read from @fd at @offset, leaving the
+ * copy from the page cache to the socket to the kernel.  Errors while
+ * reading the file can only be reported by dropping the connection, since
+ * the reply header has already been sent at that point.
+ */
+static int coroutine_fn nbd_co_send_iov_file(NBDClient *client,
+                                             struct iovec *iov, unsigned niov,
+                                             int fd, uint64_t offset,
+                                             size_t size, Error **errp)
+{
+    BlockBackend *blk = client->exp->common.blk;
+    ThreadPool *pool = aio_get_thread_pool(qemu_get_current_aio_context());
+    NBDSendFileData data = {
+        .sockfd = client->sioc->fd,
+        .fd = fd,
+        .offset = offset,
+        .size = size,
+    };
+    int ret;
+
+    trace_nbd_co_send_iov_file(offset, size);
+
+    g_assert(qemu_in_coroutine());
+    blk_inc_in_flight(blk);
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    /* The payload follows the header */
+    ret = qio_channel_writev_full_all(client->ioc, iov, niov, NULL, 0,
+                                      QIO_CHANNEL_WRITE_FLAG_MORE, errp);
+    if (ret == 0) {
+        ret = thread_pool_submit_co(pool, nbd_sendfile_worker, &data);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "sending file data failed");
+        }
+    }
+
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+    blk_dec_in_flight(blk);
+
+    return ret < 0 ? -EIO : 0;
+}
+#else
+static int nbd_export_read_fd(NBDClient *client)
+{
+    return -ENOTSUP;
+}
+
+static int coroutine_fn nbd_co_send_iov_file(NBDClient *client,
+                                             struct iovec *iov, unsigned niov,
+                                             int fd, uint64_t offset,
+                                             size_t size, Error **errp)
+{
+    g_assert_not_reached();
+}
+#endif
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t handle)
 {
@@ -1870,7 +2062,7 @@ static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
 }
 
 static int nbd_co_send_simple_reply(NBDClient *client,
-                                    uint64_t handle,
+                                    NBDRequest *request,
                                     uint32_t error,
                                     void *data,
                                     size_t len,
@@ -1883,84 +2075,123 @@ static int nbd_co_send_simple_reply(NBDClient *client,
         {.iov_base = data, .iov_len = len}
     };
 
-    trace_nbd_co_send_simple_reply(handle, nbd_err, nbd_err_lookup(nbd_err),
-                                   len);
-    set_be_simple_reply(&reply, nbd_err, handle);
+    assert(!client->extended_headers);
+    trace_nbd_co_send_simple_reply(request->handle, nbd_err,
+                                   nbd_err_lookup(nbd_err), len);
+    set_be_simple_reply(&reply, nbd_err, request->handle);
 
-    return nbd_co_send_iov(client, iov, len ? 2 : 1, errp);
+    return nbd_co_send_iov(client, iov, len ? 2 : 1, false, errp);
 }
 
-static inline void set_be_chunk(NBDStructuredReplyChunk *chunk, uint16_t flags,
-                                uint16_t type, uint64_t handle, uint32_t length)
-{
-    stl_be_p(&chunk->magic, NBD_STRUCTURED_REPLY_MAGIC);
-    stw_be_p(&chunk->flags, flags);
-    stw_be_p(&chunk->type, type);
-    stq_be_p(&chunk->handle, handle);
-    stl_be_p(&chunk->length, length);
+/* Chunk header, in the layout that was negotiated with the client */
+typedef union NBDReplyChunkHeader {
+    NBDStructuredReplyChunk structured;
+    NBDExtendedReplyChunk extended;
+} NBDReplyChunkHeader;
+
+/*
+ * Fill in the chunk header in @iov for a reply to @request, with @length
+ * bytes of payload following it.
+ */
+static inline void set_be_chunk(NBDClient *client, struct iovec *iov,
+                                uint16_t flags, uint16_t type,
+                                NBDRequest *request, uint64_t length)
+{
+    NBDReplyChunkHeader *chunk = iov->iov_base;
+
+    if (client->extended_headers) {
+        iov->iov_len = sizeof(chunk->extended);
+        stl_be_p(&chunk->extended.magic, NBD_EXTENDED_REPLY_MAGIC);
+        stw_be_p(&chunk->extended.flags, flags);
+        stw_be_p(&chunk->extended.type, type);
+        stq_be_p(&chunk->extended.handle, request->handle);
+        stq_be_p(&chunk->extended.offset, request->from);
+        stq_be_p(&chunk->extended.length, length);
+    } else {
+        assert(length <= UINT32_MAX);
+        iov->iov_len = sizeof(chunk->structured);
+        stl_be_p(&chunk->structured.magic, NBD_STRUCTURED_REPLY_MAGIC);
+        stw_be_p(&chunk->structured.flags, flags);
+        stw_be_p(&chunk->structured.type, type);
+        stq_be_p(&chunk->structured.handle, request->handle);
+        stl_be_p(&chunk->structured.length, length);
+    }
 }
 
 static int coroutine_fn nbd_co_send_structured_done(NBDClient *client,
-                                                    uint64_t handle,
+                                                    NBDRequest *request,
                                                     Error **errp)
 {
-    NBDStructuredReplyChunk chunk;
+    NBDReplyChunkHeader hdr;
     struct iovec iov[] = {
-        {.iov_base = &chunk, .iov_len = sizeof(chunk)},
+        {.iov_base = &hdr},
     };
 
-    trace_nbd_co_send_structured_done(handle);
-    set_be_chunk(&chunk, NBD_REPLY_FLAG_DONE, NBD_REPLY_TYPE_NONE, handle, 0);
+    trace_nbd_co_send_structured_done(request->handle);
+    set_be_chunk(client, &iov[0], NBD_REPLY_FLAG_DONE, NBD_REPLY_TYPE_NONE,
+                 request, 0);
 
-    return nbd_co_send_iov(client, iov, 1, errp);
+    return nbd_co_send_iov(client, iov, 1, false, errp);
 }
 
+/*
+ * Send a data chunk.  The payload is taken from @data, unless @fd is not
+ * negative, in which case it is sent directly from the file (see
+ * nbd_export_read_fd()).
+ */
 static int coroutine_fn nbd_co_send_structured_read(NBDClient *client,
-                                                    uint64_t handle,
+                                                    NBDRequest *request,
                                                     uint64_t offset,
                                                     void *data,
+                                                    int fd,
                                                     size_t size,
                                                     bool final,
                                                     Error **errp)
 {
+    NBDReplyChunkHeader hdr;
     NBDStructuredReadData chunk;
     struct iovec iov[] = {
+        {.iov_base = &hdr},
         {.iov_base = &chunk, .iov_len = sizeof(chunk)},
         {.iov_base = data, .iov_len = size}
     };
 
     assert(size);
-    trace_nbd_co_send_structured_read(handle, offset, data, size);
-    set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
-                 NBD_REPLY_TYPE_OFFSET_DATA, handle,
-                 sizeof(chunk) - sizeof(chunk.h) + size);
+    trace_nbd_co_send_structured_read(request->handle, offset, data, size);
+    set_be_chunk(client, &iov[0], final ? NBD_REPLY_FLAG_DONE : 0,
+                 NBD_REPLY_TYPE_OFFSET_DATA, request, sizeof(chunk) + size);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 2, errp);
+    if (fd >= 0) {
+        return nbd_co_send_iov_file(client, iov, 2, fd, offset, size, errp);
+    }
+    return nbd_co_send_iov(client, iov, 3, !final, errp);
 }
 
 static int coroutine_fn nbd_co_send_structured_error(NBDClient *client,
-                                                     uint64_t handle,
+                                                     NBDRequest *request,
                                                      uint32_t error,
                                                      const char *msg,
                                                      Error **errp)
 {
+    NBDReplyChunkHeader hdr;
     NBDStructuredError chunk;
     int nbd_err = system_errno_to_nbd_errno(error);
     struct iovec iov[] = {
+        {.iov_base = &hdr},
         {.iov_base = &chunk, .iov_len = sizeof(chunk)},
         {.iov_base = (char *)msg, .iov_len = msg ? strlen(msg) : 0},
     };
 
     assert(nbd_err);
-    trace_nbd_co_send_structured_error(handle, nbd_err,
+    trace_nbd_co_send_structured_error(request->handle, nbd_err,
                                        nbd_err_lookup(nbd_err), msg ? msg : "");
-    set_be_chunk(&chunk.h, NBD_REPLY_FLAG_DONE, NBD_REPLY_TYPE_ERROR, handle,
-                 sizeof(chunk) - sizeof(chunk.h) + iov[1].iov_len);
+    set_be_chunk(client, &iov[0], NBD_REPLY_FLAG_DONE, NBD_REPLY_TYPE_ERROR,
+                 request, sizeof(chunk) + iov[2].iov_len);
     stl_be_p(&chunk.error, nbd_err);
-    stw_be_p(&chunk.message_length, iov[1].iov_len);
+    stw_be_p(&chunk.message_length, iov[2].iov_len);
 
-    return nbd_co_send_iov(client, iov, 1 + !!iov[1].iov_len, errp);
+    return nbd_co_send_iov(client, iov, 2 + !!iov[2].iov_len, false, errp);
 }
 
 /* Do a sparse read and send the structured reply to the client.
@@ -1968,7 +2199,7 @@ static int coroutine_fn nbd_co_send_structured_error(NBDClient *client,
  * reported to the client, at which point this function succeeds.
  */
 static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
-                                                uint64_t handle,
+                                                NBDRequest *request,
                                                 uint64_t offset,
                                                 uint8_t *data,
                                                 size_t size,
@@ -1977,6 +2208,7 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
     int ret = 0;
     NBDExport *exp = client->exp;
     size_t progress = 0;
+    int fd = nbd_export_read_fd(client);
 
     while (progress < size) {
         int64_t pnum;
@@ -1990,7 +2222,7 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             char *msg = g_strdup_printf("unable to check for holes: %s",
                                         strerror(-status));
 
-            ret = nbd_co_send_structured_error(client, handle, -status, msg,
+            ret = nbd_co_send_structured_error(client, request, -status, msg,
                                                errp);
             g_free(msg);
             return ret;
@@ -1998,19 +2230,24 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
         assert(pnum && pnum <= size - progress);
         final = progress + pnum == size;
         if (status & BDRV_BLOCK_ZERO) {
+            NBDReplyChunkHeader hdr;
             NBDStructuredReadHole chunk;
             struct iovec iov[] = {
+                {.iov_base = &hdr},
                 {.iov_base = &chunk, .iov_len = sizeof(chunk)},
             };
 
-            trace_nbd_co_send_structured_read_hole(handle, offset + progress,
-                                                   pnum);
-            set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
-                         NBD_REPLY_TYPE_OFFSET_HOLE,
-                         handle, sizeof(chunk) - sizeof(chunk.h));
+            trace_nbd_co_send_structured_read_hole(request->handle,
+                                                   offset + progress, pnum);
+            set_be_chunk(client, &iov[0], final ? NBD_REPLY_FLAG_DONE : 0,
+                         NBD_REPLY_TYPE_OFFSET_HOLE, request, sizeof(chunk));
             stq_be_p(&chunk.offset, offset + progress);
             stl_be_p(&chunk.length, pnum);
-            ret = nbd_co_send_iov(client, iov, 1, errp);
+            ret = nbd_co_send_iov(client, iov, 2, !final, errp);
+        } else if (fd >= 0) {
+            ret = nbd_co_send_structured_read(client, request,
+                                              offset + progress, NULL, fd,
+                                              pnum, final, errp);
         } else {
             ret = blk_pread(exp->common.blk, offset + progress,
                             data + progress, pnum);
@@ -2018,8 +2255,9 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
                 error_setg_errno(errp, -ret, "reading from file failed");
                 break;
             }
-            ret = nbd_co_send_structured_read(client, handle, offset + progress,
-                                              data + progress, pnum, final,
+            ret = nbd_co_send_structured_read(client, request,
+                                              offset + progress,
+                                              data + progress, -1, pnum, final,
                                               errp);
         }
 
@@ -2031,21 +2269,29 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
     return ret;
 }
 
+/*
+ * Extents are collected in the 64-bit layout.  Without extended headers
+ * each extent is limited to 32 bits, and the array is narrowed when it is
+ * sent.
+ */
 typedef struct NBDExtentArray {
-    NBDExtent *extents;
+    NBDExtent64 *extents;
     unsigned int nb_alloc;
     unsigned int count;
     uint64_t total_length;
+    uint64_t max_length;
     bool can_add;
     bool converted_to_be;
 } NBDExtentArray;
 
-static NBDExtentArray *nbd_extent_array_new(unsigned int nb_alloc)
+static NBDExtentArray *nbd_extent_array_new(unsigned int nb_alloc,
+                                            bool extended)
 {
     NBDExtentArray *ea = g_new0(NBDExtentArray, 1);
 
     ea->nb_alloc = nb_alloc;
-    ea->extents = g_new(NBDExtent, nb_alloc);
+    ea->extents = g_new(NBDExtent64, nb_alloc);
+    ea->max_length = extended ? UINT64_MAX : UINT32_MAX;
     ea->can_add = true;
 
     return ea;
@@ -2068,9 +2314,29 @@ static void nbd_extent_array_convert_to_be(NBDExtentArray *ea)
     ea->converted_to_be = true;
 
     for (i = 0; i < ea->count; i++) {
-        ea->extents[i].flags = cpu_to_be32(ea->extents[i].flags);
-        ea->extents[i].length = cpu_to_be32(ea->extents[i].length);
+        ea->extents[i].flags = cpu_to_be64(ea->extents[i].flags);
+        ea->extents[i].length = cpu_to_be64(ea->extents[i].length);
+    }
+}
+
+/*
+ * Return a copy of @ea in the 32-bit layout, converted to BE.
+ * Further modifications of the array are abandoned.
+ */
+static NBDExtent32 *nbd_extent_array_to_be32(NBDExtentArray *ea)
+{
+    NBDExtent32 *extents = g_new(NBDExtent32, ea->count);
+    int i;
+
+    assert(!ea->converted_to_be && ea->max_length <= UINT32_MAX);
+    ea->can_add = false;
+
+    for (i = 0; i < ea->count; i++) {
+        extents[i].flags = cpu_to_be32(ea->extents[i].flags);
+        extents[i].length = cpu_to_be32(ea->extents[i].length);
     }
+
+    return extents;
 }
 
 /*
@@ -2084,23 +2350,21 @@ static void nbd_extent_array_convert_to_be(NBDExtentArray *ea)
  * have invalid array with skipped extent)
  */
 static int nbd_extent_array_add(NBDExtentArray *ea,
-                                uint32_t length, uint32_t flags)
+                                uint64_t length, uint32_t flags)
 {
     assert(ea->can_add);
+    assert(length <= ea->max_length);
 
     if (!length) {
         return 0;
     }
 
     /* Extend previous extent if flags are the same */
-    if (ea->count > 0 && flags == ea->extents[ea->count - 1].flags) {
-        uint64_t sum = (uint64_t)length + ea->extents[ea->count - 1].length;
-
-        if (sum <= UINT32_MAX) {
-            ea->extents[ea->count - 1].length = sum;
-            ea->total_length += length;
-            return 0;
-        }
+    if (ea->count > 0 && flags == ea->extents[ea->count - 1].flags &&
+        length <= ea->max_length - ea->extents[ea->count - 1].length) {
+        ea->extents[ea->count - 1].length += length;
+        ea->total_length += length;
+        return 0;
     }
 
     if (ea->count >= ea->nb_alloc) {
@@ -2109,7 +2373,7 @@ static int nbd_extent_array_add(NBDExtentArray *ea,
     }
 
     ea->total_length += length;
-    ea->extents[ea->count] = (NBDExtent) {.length = length, .flags = flags};
+    ea->extents[ea->count] = (NBDExtent64) {.length = length, .flags = flags};
     ea->count++;
 
     return 0;
@@ -2171,38 +2435,61 @@ static int blockalloc_to_extents(BlockDriverState *bs, uint64_t offset,
  * @ea is converted to BE by the function
  * @last controls whether NBD_REPLY_FLAG_DONE is sent.
  */
-static int nbd_co_send_extents(NBDClient *client, uint64_t handle,
+static int nbd_co_send_extents(NBDClient *client, NBDRequest *request,
                                NBDExtentArray *ea,
                                bool last, uint32_t context_id, Error **errp)
 {
-    NBDStructuredMeta chunk;
+    NBDReplyChunkHeader hdr;
+    NBDStructuredMeta meta;
+    NBDExtendedMeta meta_ext;
+    g_autofree NBDExtent32 *extents = NULL;
+    uint16_t type;
     struct iovec iov[] = {
-        {.iov_base = &chunk, .iov_len = sizeof(chunk)},
-        {.iov_base = ea->extents, .iov_len = ea->count * sizeof(ea->extents[0])}
+        {.iov_base = &hdr},
+        {0},
+        {0}
     };
 
-    nbd_extent_array_convert_to_be(ea);
-
-    trace_nbd_co_send_extents(handle, ea->count, context_id, ea->total_length,
-                              last);
-    set_be_chunk(&chunk.h, last ? NBD_REPLY_FLAG_DONE : 0,
-                 NBD_REPLY_TYPE_BLOCK_STATUS,
-                 handle, sizeof(chunk) - sizeof(chunk.h) + iov[1].iov_len);
-    stl_be_p(&chunk.context_id, context_id);
+    trace_nbd_co_send_extents(request->handle, ea->count, context_id,
+                              ea->total_length, last);
+    if (client->extended_headers) {
+        nbd_extent_array_convert_to_be(ea);
+        type = NBD_REPLY_TYPE_BLOCK_STATUS_EXT;
+        stl_be_p(&meta_ext.context_id, context_id);
+        stl_be_p(&meta_ext.count, ea->count);
+        iov[1] = (struct iovec) {
+            .iov_base = &meta_ext, .iov_len = sizeof(meta_ext)
+        };
+        iov[2] = (struct iovec) {
+            .iov_base = ea->extents,
+            .iov_len = ea->count * sizeof(ea->extents[0])
+        };
+    } else {
+        extents = nbd_extent_array_to_be32(ea);
+        type = NBD_REPLY_TYPE_BLOCK_STATUS;
+        stl_be_p(&meta.context_id, context_id);
+        iov[1] = (struct iovec) {.iov_base = &meta, .iov_len = sizeof(meta)};
+        iov[2] = (struct iovec) {
+            .iov_base = extents, .iov_len = ea->count * sizeof(extents[0])
+        };
+    }
+    set_be_chunk(client, &iov[0], last ? NBD_REPLY_FLAG_DONE : 0, type,
+                 request, iov[1].iov_len + iov[2].iov_len);
 
-    return nbd_co_send_iov(client, iov, 2, errp);
+    return nbd_co_send_iov(client, iov, 3, !last, errp);
 }
 
 /* Get block status from the exported device and send it to the client */
-static int nbd_co_send_block_status(NBDClient *client, uint64_t handle,
+static int nbd_co_send_block_status(NBDClient *client, NBDRequest *request,
                                     BlockDriverState *bs, uint64_t offset,
-                                    uint32_t length, bool dont_fragment,
+                                    uint64_t length, bool dont_fragment,
                                     bool last, uint32_t context_id,
                                     Error **errp)
 {
     int ret;
     unsigned int nb_extents = dont_fragment ? 1 : NBD_MAX_BLOCK_STATUS_EXTENTS;
-    g_autoptr(NBDExtentArray) ea = nbd_extent_array_new(nb_extents);
+    g_autoptr(NBDExtentArray) ea =
+        nbd_extent_array_new(nb_extents, client->extended_headers);
 
     if (context_id == NBD_META_ID_BASE_ALLOCATION) {
         ret = blockstatus_to_extents(bs, offset, length, ea);
@@ -2211,10 +2498,10 @@ static int nbd_co_send_block_status(NBDClient *client, uint64_t handle,
     }
     if (ret < 0) {
         return nbd_co_send_structured_error(
-                client, handle, -ret, "can't get block status", errp);
+                client, request, -ret, "can't get block status", errp);
     }
 
-    return nbd_co_send_extents(client, handle, ea, last, context_id, errp);
+    return nbd_co_send_extents(client, request, ea, last, context_id, errp);
 }
 
 /* Populate @ea from a dirty bitmap. */
@@ -2224,12 +2511,14 @@ static void bitmap_to_extents(BdrvDirtyBitmap *bitmap,
 {
     int64_t start, dirty_start, dirty_count;
     int64_t end = offset + length;
+    int64_t max_dirty_count = es->max_length > UINT32_MAX ? INT64_MAX
+                                                          : INT32_MAX;
     bool full = false;
 
     bdrv_dirty_bitmap_lock(bitmap);
 
     for (start = offset;
-         bdrv_dirty_bitmap_next_dirty_area(bitmap, start, end, INT32_MAX,
+         bdrv_dirty_bitmap_next_dirty_area(bitmap, start, end, max_dirty_count,
                                            &dirty_start, &dirty_count);
          start = dirty_start + dirty_count)
     {
@@ -2249,17 +2538,18 @@ static void bitmap_to_extents(BdrvDirtyBitmap *bitmap,
     bdrv_dirty_bitmap_unlock(bitmap);
 }
 
-static int nbd_co_send_bitmap(NBDClient *client, uint64_t handle,
+static int nbd_co_send_bitmap(NBDClient *client, NBDRequest *request,
                               BdrvDirtyBitmap *bitmap, uint64_t offset,
-                              uint32_t length, bool dont_fragment, bool last,
+                              uint64_t length, bool dont_fragment, bool last,
                               uint32_t context_id, Error **errp)
 {
     unsigned int nb_extents = dont_fragment ? 1 : NBD_MAX_BLOCK_STATUS_EXTENTS;
-    g_autoptr(NBDExtentArray) ea = nbd_extent_array_new(nb_extents);
+    g_autoptr(NBDExtentArray) ea =
+        nbd_extent_array_new(nb_extents, client->extended_headers);
 
     bitmap_to_extents(bitmap, offset, length, ea);
 
-    return nbd_co_send_extents(client, handle, ea, last, context_id, errp);
+    return nbd_co_send_extents(client, request, ea, last, context_id, errp);
 }
 
 /* nbd_co_receive_request
@@ -2301,7 +2591,7 @@ static int nbd_co_receive_request(NBDRequestData *req, NBDRequest *request,
         request->type == NBD_CMD_CACHE)
     {
         if (request->len > NBD_MAX_BUFFER_SIZE) {
-            error_setg(errp, "len (%" PRIu32" ) is larger than max len (%u)",
+            error_setg(errp, "len (%" PRIu64 ") is larger than max len (%u)",
                        request->len, NBD_MAX_BUFFER_SIZE);
             return -EINVAL;
         }
@@ -2338,7 +2628,7 @@ static int nbd_co_receive_request(NBDRequestData *req, NBDRequest *request,
     }
     if (request->from > client->exp->size ||
         request->len > client->exp->size - request->from) {
-        error_setg(errp, "operation past EOF; From: %" PRIu64 ", Len: %" PRIu32
+        error_setg(errp, "operation past EOF; From: %" PRIu64 ", Len: %" PRIu64
                    ", Size: %" PRIu64, request->from, request->len,
                    client->exp->size);
         return (request->type == NBD_CMD_WRITE ||
@@ -2374,19 +2664,23 @@ static int nbd_co_receive_request(NBDRequestData *req, NBDRequest *request,
 
 /* Send simple reply without a payload, or a structured error
  * @error_msg is ignored if @ret >= 0
+ * With extended headers, simple replies are not allowed and a final
+ * structured chunk without payload is sent instead.
  * Returns 0 if connection is still live, -errno on failure to talk to client
  */
 static coroutine_fn int nbd_send_generic_reply(NBDClient *client,
-                                               uint64_t handle,
+                                               NBDRequest *request,
                                                int ret,
                                                const char *error_msg,
                                                Error **errp)
 {
     if (client->structured_reply && ret < 0) {
-        return nbd_co_send_structured_error(client, handle, -ret, error_msg,
+        return nbd_co_send_structured_error(client, request, -ret, error_msg,
                                             errp);
+    } else if (client->extended_headers) {
+        return nbd_co_send_structured_done(client, request, errp);
     } else {
-        return nbd_co_send_simple_reply(client, handle, ret < 0 ? -ret : 0,
+        return nbd_co_send_simple_reply(client, request, ret < 0 ? -ret : 0,
                                         NULL, 0, errp);
     }
 }
@@ -2398,6 +2692,7 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                         uint8_t *data, Error **errp)
 {
     int ret;
+    int fd;
     NBDExport *exp = client->exp;
 
     assert(request->type == NBD_CMD_READ);
@@ -2406,7 +2701,7 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
     if (request->flags & NBD_CMD_FLAG_FUA) {
         ret = blk_co_flush(exp->common.blk);
         if (ret < 0) {
-            return nbd_send_generic_reply(client, request->handle, ret,
+            return nbd_send_generic_reply(client, request, ret,
                                           "flush failed", errp);
         }
     }
@@ -2414,26 +2709,42 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
     if (client->structured_reply && !(request->flags & NBD_CMD_FLAG_DF) &&
         request->len)
     {
-        return nbd_co_send_sparse_read(client, request->handle, request->from,
+        return nbd_co_send_sparse_read(client, request, request->from,
                                        data, request->len, errp);
     }
 
+    fd = request->len ? nbd_export_read_fd(client) : -ENOTSUP;
+    if (fd >= 0 && client->structured_reply) {
+        return nbd_co_send_structured_read(client, request,
+                                           request->from, NULL, fd,
+                                           request->len, true, errp);
+    } else if (fd >= 0) {
+        NBDSimpleReply reply;
+        struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+
+        trace_nbd_co_send_simple_reply(request->handle, 0, nbd_err_lookup(0),
+                                       request->len);
+        set_be_simple_reply(&reply, 0, request->handle);
+        return nbd_co_send_iov_file(client, &iov, 1, fd, request->from,
+                                    request->len, errp);
+    }
+
     ret = blk_pread(exp->common.blk, request->from, data, request->len);
     if (ret < 0) {
-        return nbd_send_generic_reply(client, request->handle, ret,
+        return nbd_send_generic_reply(client, request, ret,
                                       "reading from file failed", errp);
     }
 
     if (client->structured_reply) {
         if (request->len) {
-            return nbd_co_send_structured_read(client, request->handle,
-                                               request->from, data,
+            return nbd_co_send_structured_read(client, request,
+                                               request->from, data, -1,
                                                request->len, true, errp);
         } else {
-            return nbd_co_send_structured_done(client, request->handle, errp);
+            return nbd_co_send_structured_done(client, request, errp);
         }
     } else {
-        return nbd_co_send_simple_reply(client, request->handle, 0,
+        return nbd_co_send_simple_reply(client, request, 0,
                                         data, request->len, errp);
     }
 }
@@ -2456,7 +2767,7 @@ static coroutine_fn int nbd_do_cmd_cache(NBDClient *client, NBDRequest *request,
     ret = blk_co_preadv(exp->common.blk, request->from, request->len,
                         NULL, BDRV_REQ_COPY_ON_READ | BDRV_REQ_PREFETCH);
 
-    return nbd_send_generic_reply(client, request->handle, ret,
+    return nbd_send_generic_reply(client, request, ret,
                                   "caching data failed", errp);
 }
 
@@ -2470,6 +2781,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
     int ret;
     int flags;
     NBDExport *exp = client->exp;
+    uint64_t from, len;
     char *msg;
     size_t i;
 
@@ -2487,7 +2799,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
         }
         ret = blk_pwrite(exp->common.blk, request->from, data, request->len,
                          flags);
-        return nbd_send_generic_reply(client, request->handle, ret,
+        return nbd_send_generic_reply(client, request, ret,
                                       "writing to file failed", errp);
 
     case NBD_CMD_WRITE_ZEROES:
@@ -2502,16 +2814,18 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
             flags |= BDRV_REQ_NO_FALLBACK;
         }
         ret = 0;
+        from = request->from;
+        len = request->len;
         /* FIXME simplify this when blk_pwrite_zeroes switches to 64-bit */
-        while (ret >= 0 && request->len) {
+        while (ret >= 0 && len) {
             int align = client->check_align ?: 1;
-            int len = MIN(request->len, QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
-                                                        align));
-            ret = blk_pwrite_zeroes(exp->common.blk, request->from, len, flags);
-            request->len -= len;
-            request->from += len;
+            int bytes = MIN(len, QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
+                                                 align));
+            ret = blk_pwrite_zeroes(exp->common.blk, from, bytes, flags);
+            len -= bytes;
+            from += bytes;
         }
-        return nbd_send_generic_reply(client, request->handle, ret,
+        return nbd_send_generic_reply(client, request, ret,
                                       "writing to file failed", errp);
 
     case NBD_CMD_DISC:
@@ -2520,29 +2834,31 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
 
     case NBD_CMD_FLUSH:
         ret = blk_co_flush(exp->common.blk);
-        return nbd_send_generic_reply(client, request->handle, ret,
+        return nbd_send_generic_reply(client, request, ret,
                                       "flush failed", errp);
 
     case NBD_CMD_TRIM:
         ret = 0;
+        from = request->from;
+        len = request->len;
         /* FIXME simplify this when blk_co_pdiscard switches to 64-bit */
-        while (ret >= 0 && request->len) {
+        while (ret >= 0 && len) {
             int align = client->check_align ?: 1;
-            int len = MIN(request->len, QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
-                                                        align));
-            ret = blk_co_pdiscard(exp->common.blk, request->from, len);
-            request->len -= len;
-            request->from += len;
+            int bytes = MIN(len, QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
+                                                 align));
+            ret = blk_co_pdiscard(exp->common.blk, from, bytes);
+            len -= bytes;
+            from += bytes;
         }
         if (ret >= 0 && request->flags & NBD_CMD_FLAG_FUA) {
             ret = blk_co_flush(exp->common.blk);
         }
-        return nbd_send_generic_reply(client, request->handle, ret,
+        return nbd_send_generic_reply(client, request, ret,
                                       "discard failed", errp);
 
     case NBD_CMD_BLOCK_STATUS:
         if (!request->len) {
-            return nbd_send_generic_reply(client, request->handle, -EINVAL,
+            return nbd_send_generic_reply(client, request, -EINVAL,
                                           "need non-zero length", errp);
         }
         if (client->export_meta.count) {
@@ -2550,7 +2866,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
             int contexts_remaining = client->export_meta.count;
 
             if (client->export_meta.base_allocation) {
-                ret = nbd_co_send_block_status(client, request->handle,
+                ret = nbd_co_send_block_status(client, request,
                                                blk_bs(exp->common.blk),
                                                request->from,
                                                request->len, dont_fragment,
@@ -2563,7 +2879,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
             }
 
             if (client->export_meta.allocation_depth) {
-                ret = nbd_co_send_block_status(client, request->handle,
+                ret = nbd_co_send_block_status(client, request,
                                                blk_bs(exp->common.blk),
                                                request->from, request->len,
                                                dont_fragment,
@@ -2579,7 +2895,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
                 if (!client->export_meta.bitmaps[i]) {
                     continue;
                 }
-                ret = nbd_co_send_bitmap(client, request->handle,
+                ret = nbd_co_send_bitmap(client, request,
                                          client->exp->export_bitmaps[i],
                                          request->from, request->len,
                                          dont_fragment, !--contexts_remaining,
@@ -2593,7 +2909,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
 
             return 0;
         } else {
-            return nbd_send_generic_reply(client, request->handle, -EINVAL,
+            return nbd_send_generic_reply(client, request, -EINVAL,
                                           "CMD_BLOCK_STATUS not negotiated",
                                           errp);
         }
@@ -2601,7 +2917,7 @@ static coroutine_fn int nbd_handle_request(NBDClient *client,
     default:
         msg = g_strdup_printf("invalid request type (%" PRIu32 ") received",
                               request->type);
-        ret = nbd_send_generic_reply(client, request->handle, -EINVAL, msg,
+        ret = nbd_send_generic_reply(client, request, -EINVAL, msg,
                                      errp);
         g_free(msg);
         return ret;
@@ -2662,7 +2978,7 @@ static coroutine_fn void nbd_trip(void *opaque)
         Error *export_err = local_err;
 
         local_err = NULL;
-        ret = nbd_send_generic_reply(client, request.handle, -EINVAL,
+        ret = nbd_send_generic_reply(client, &request, -EINVAL,
                                      error_get_pretty(export_err), &local_err);
         error_free(export_err);
     } else {
@@ -19,24 +19,105 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
-uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+/*
+ * Sum of the host-endian 32-bit words of @buf; @len is a multiple of 4.
+ * Since 2^16 == 1 in ones' complement arithmetic, folding the result
+ * gives the sum of the host-endian 16-bit words, and the ones' complement
+ * sum is byte order independent (RFC 1071), so no swapping is needed
+ * until the end.
+ */
+static uint64_t net_checksum_words_generic(const uint8_t *buf, int len)
 {
-    uint32_t sum1 = 0, sum2 = 0;
+    uint64_t sum = 0;
     int i;
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+    for (i = 0; i < len; i += 4) {
+        sum += ldl_he_p(buf + i);
+    }
+    return sum;
+}
+
+static uint64_t (*net_checksum_words)(const uint8_t *, int) =
+    net_checksum_words_generic;
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+#include "qemu/cpuid.h"
+
+static uint64_t net_checksum_words_avx2(const uint8_t *buf, int len)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero, v;
+    uint64_t lanes[4];
+    int i;
+
+    /* widen each 32-bit word to 64 bits, so that no carry is lost */
+    for (i = 0; i + 32 <= len; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           net_checksum_words_generic(buf + i, len - i);
+}
+
+static void __attribute__((constructor)) net_checksum_init_accel(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d, bv;
+
+    if (max < 7) {
+        return;
+    }
+
+    __cpuid(1, a, b, c, d);
+    /* We must check that AVX is not just available, but usable.  */
+    if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+        __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+        __cpuid_count(7, 0, a, b, c, d);
+        if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+            net_checksum_words = net_checksum_words_avx2;
+        }
+    }
+}
+
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+{
+    uint64_t sum;
+    int i = len & ~3;
+
+    sum = net_checksum_words(buf, i);
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+#ifndef HOST_WORDS_BIGENDIAN
+    sum = bswap16(sum);
+#endif
+
+    for (; i + 2 <= len; i += 2) {
+        sum += lduw_be_p(buf + i);
     }
     if (i < len) {
-        sum1 += (uint32_t)buf[i];
+        sum += (uint32_t)buf[i] << 8;
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
     }
 
+    /* Data starting at an odd offset contributes byte-swapped (RFC 1071) */
     if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+        sum = bswap16(sum);
     }
+
+    return sum;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
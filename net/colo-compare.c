@@ -598,11 +598,9 @@ static int colo_packet_compare_other(Packet *spkt, Packet *ppkt)
                                        ppkt->size - offset);
 }
 
-static int colo_old_packet_check_one(Packet *pkt, int64_t *check_time)
+static int colo_old_packet_check_one(Packet *pkt, int64_t *deadline)
 {
-    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_HOST);
-
-    if ((now - pkt->creation_ms) > (*check_time)) {
+    if (pkt->creation_ms < *deadline) {
         trace_colo_old_packet_check_found(pkt->creation_ms);
         return 0;
     } else {
@@ -620,19 +618,25 @@ void colo_compare_unregister_notifier(Notifier *notify)
     notifier_remove(notify);
 }
 
+typedef struct OldPacketCheck {
+    CompareState *s;
+    /* packets created before this time (in ms) are too old */
+    int64_t deadline;
+} OldPacketCheck;
+
 static int colo_old_packet_check_one_conn(Connection *conn,
-                                          CompareState *s)
+                                          OldPacketCheck *check)
 {
     if (!g_queue_is_empty(&conn->primary_list)) {
         if (g_queue_find_custom(&conn->primary_list,
-                                &s->compare_timeout,
+                                &check->deadline,
                                 (GCompareFunc)colo_old_packet_check_one))
             goto out;
     }
 
     if (!g_queue_is_empty(&conn->secondary_list)) {
         if (g_queue_find_custom(&conn->secondary_list,
-                                &s->compare_timeout,
+                                &check->deadline,
                                 (GCompareFunc)colo_old_packet_check_one))
             goto out;
     }
@@ -641,7 +645,7 @@ static int colo_old_packet_check_one_conn(Connection *conn,
 
 out:
     /* Do checkpoint will flush old packet */
-    colo_compare_inconsistency_notify(s);
+    colo_compare_inconsistency_notify(check->s);
     return 0;
 }
 
@@ -653,12 +657,18 @@ out:
 static void colo_old_packet_check(void *opaque)
 {
     CompareState *s = opaque;
+    /* Read the clock once rather than for every queued packet */
+    OldPacketCheck check = {
+        .s = s,
+        .deadline = qemu_clock_get_ms(QEMU_CLOCK_HOST) -
+                    (int64_t)s->compare_timeout,
+    };
 
     /*
      * If we find one old packet, stop finding job and notify
      * COLO frame do checkpoint.
      */
-    g_queue_find_custom(&s->conn_list, s,
+    g_queue_find_custom(&s->conn_list, &check,
                         (GCompareFunc)colo_old_packet_check_one_conn);
 }
 
@@ -30,6 +30,7 @@
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
+#include "qemu/thread.h"
 #include "qapi/visitor.h"
 #include "net/filter.h"
 #include "qom/object.h"
@@ -38,6 +39,26 @@ typedef struct DumpState {
     int64_t start_ts;
     int fd;
     int pcap_caplen;
+
+    /* dump only one out of every @sample packets */
+    uint32_t sample;
+    uint32_t sample_count;
+
+    /*
+     * If @ring_size is not zero, records are copied into a ring buffer and
+     * written to @fd by a separate thread, so that the packet path never
+     * waits for the disk.  Records that do not fit are dropped.
+     */
+    size_t ring_size;
+    uint8_t *ring;
+    size_t ring_head;
+    size_t ring_used;
+    bool ring_stop;
+    bool ring_error;
+    uint64_t ring_dropped;
+    QemuMutex ring_lock;
+    QemuCond ring_cond;
+    QemuThread ring_thread;
 } DumpState;
 
 #define PCAP_MAGIC 0xa1b2c3d4
@@ -61,6 +82,84 @@ struct pcap_sf_pkthdr {
     uint32_t len;
 };
 
+static void dump_ring_write(DumpState *s, const void *buf, size_t len)
+{
+    size_t first = MIN(len, s->ring_size - s->ring_head);
+
+    memcpy(s->ring + s->ring_head, buf, first);
+    memcpy(s->ring, (const uint8_t *)buf + first, len - first);
+    s->ring_head = (s->ring_head + len) % s->ring_size;
+}
+
+static void dump_ring_push(DumpState *s, const struct pcap_sf_pkthdr *hdr,
+                           const struct iovec *iov, int cnt)
+{
+    size_t len = sizeof(*hdr) + hdr->caplen;
+    size_t left = hdr->caplen;
+    int i;
+
+    qemu_mutex_lock(&s->ring_lock);
+    if (s->ring_error) {
+        goto out;
+    }
+    if (len > s->ring_size - s->ring_used) {
+        s->ring_dropped++;
+        goto out;
+    }
+
+    dump_ring_write(s, hdr, sizeof(*hdr));
+    for (i = 0; i < cnt && left; i++) {
+        size_t n = MIN(iov[i].iov_len, left);
+
+        dump_ring_write(s, iov[i].iov_base, n);
+        left -= n;
+    }
+    s->ring_used += len;
+    qemu_cond_signal(&s->ring_cond);
+out:
+    qemu_mutex_unlock(&s->ring_lock);
+}
+
+static void *dump_ring_thread(void *opaque)
+{
+    DumpState *s = opaque;
+
+    qemu_mutex_lock(&s->ring_lock);
+    for (;;) {
+        size_t tail, len;
+        ssize_t ret;
+
+        while (!s->ring_used && !s->ring_stop) {
+            qemu_cond_wait(&s->ring_cond, &s->ring_lock);
+        }
+        if (!s->ring_used) {
+            break;
+        }
+
+        /*
+         * The producer only ever writes to the free part of the ring, so
+         * the used part can be written out without holding the lock.
+         */
+        tail = (s->ring_head + s->ring_size - s->ring_used) % s->ring_size;
+        len = MIN(s->ring_used, s->ring_size - tail);
+        qemu_mutex_unlock(&s->ring_lock);
+
+        ret = qemu_write_full(s->fd, s->ring + tail, len);
+
+        qemu_mutex_lock(&s->ring_lock);
+        s->ring_used -= len;
+        if (ret != len) {
+            error_report("network dump write error - stopping dump");
+            s->ring_error = true;
+            s->ring_used = 0;
+            break;
+        }
+    }
+    qemu_mutex_unlock(&s->ring_lock);
+
+    return NULL;
+}
+
 static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
 {
     struct pcap_sf_pkthdr hdr;
@@ -74,6 +173,10 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
         return size;
     }
 
+    if (s->sample > 1 && s->sample_count++ % s->sample) {
+        return size;
+    }
+
     ts = qemu_clock_get_us(QEMU_CLOCK_VIRTUAL);
     caplen = size > s->pcap_caplen ? s->pcap_caplen : size;
 
@@ -82,6 +185,11 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
     hdr.caplen = caplen;
     hdr.len = size;
 
+    if (s->ring) {
+        dump_ring_push(s, &hdr, iov, cnt);
+        return size;
+    }
+
     dumpiov[0].iov_base = &hdr;
     dumpiov[0].iov_len = sizeof(hdr);
     cnt = iov_copy(&dumpiov[1], cnt, iov, cnt, 0, caplen);
@@ -97,6 +205,22 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
 
 static void dump_cleanup(DumpState *s)
 {
+    if (s->ring) {
+        qemu_mutex_lock(&s->ring_lock);
+        s->ring_stop = true;
+        qemu_cond_signal(&s->ring_cond);
+        qemu_mutex_unlock(&s->ring_lock);
+        qemu_thread_join(&s->ring_thread);
+
+        if (s->ring_dropped) {
+            warn_report("network dump: %" PRIu64 " packets dropped because "
+                        "the buffer was full", s->ring_dropped);
+        }
+        qemu_mutex_destroy(&s->ring_lock);
+        qemu_cond_destroy(&s->ring_cond);
+        g_free(s->ring);
+        s->ring = NULL;
+    }
     close(s->fd);
     s->fd = -1;
 }
@@ -134,6 +258,19 @@ static int net_dump_state_init(DumpState *s, const char *filename,
     qemu_get_timedate(&tm, 0);
     s->start_ts = mktime(&tm);
 
+    if (s->ring_size) {
+        s->ring = g_malloc(s->ring_size);
+        s->ring_head = 0;
+        s->ring_used = 0;
+        s->ring_stop = false;
+        s->ring_error = false;
+        s->ring_dropped = 0;
+        qemu_mutex_init(&s->ring_lock);
+        qemu_cond_init(&s->ring_cond);
+        qemu_thread_create(&s->ring_thread, "net-dump", dump_ring_thread, s,
+                           QEMU_THREAD_JOINABLE);
+    }
+
     return 0;
 }
 
@@ -146,6 +283,8 @@ struct NetFilterDumpState {
     DumpState ds;
     char *filename;
     uint32_t maxlen;
+    uint32_t sample;
+    uint64_t buffer_size;
 };
 
 static ssize_t filter_dump_receive_iov(NetFilterState *nf, NetClientState *sndr,
@@ -174,6 +313,15 @@ static void filter_dump_setup(NetFilterState *nf, Error **errp)
         return;
     }
 
+    if (nfds->buffer_size &&
+        nfds->buffer_size < sizeof(struct pcap_sf_pkthdr) + nfds->maxlen) {
+        error_setg(errp, "dump filter 'buffer-size' must be able to hold "
+                   "at least one packet of 'maxlen' bytes");
+        return;
+    }
+
+    nfds->ds.sample = nfds->sample;
+    nfds->ds.ring_size = nfds->buffer_size;
     net_dump_state_init(&nfds->ds, nfds->filename, nfds->maxlen, errp);
 }
 
@@ -203,6 +351,60 @@ static void filter_dump_set_maxlen(Object *obj, Visitor *v, const char *name,
     nfds->maxlen = value;
 }
 
+static void filter_dump_get_sample(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+    uint32_t value = nfds->sample;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void filter_dump_set_sample(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value == 0) {
+        error_setg(errp, "Property '%s.%s' doesn't take value '%u'",
+                   object_get_typename(obj), name, value);
+        return;
+    }
+    nfds->sample = value;
+}
+
+static void filter_dump_get_buffer_size(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+    uint64_t value = nfds->buffer_size;
+
+    visit_type_size(v, name, &value, errp);
+}
+
+static void filter_dump_set_buffer_size(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+    uint64_t value;
+
+    if (!visit_type_size(v, name, &value, errp)) {
+        return;
+    }
+    if (value > SIZE_MAX / 2) {
+        error_setg(errp, "Property '%s.%s' doesn't take value '%" PRIu64 "'",
+                   object_get_typename(obj), name, value);
+        return;
+    }
+    nfds->buffer_size = value;
+}
+
 static char *file_dump_get_filename(Object *obj, Error **errp)
 {
     NetFilterDumpState *nfds = FILTER_DUMP(obj);
@@ -223,6 +425,7 @@ static void filter_dump_instance_init(Object *obj)
     NetFilterDumpState *nfds = FILTER_DUMP(obj);
 
     nfds->maxlen = 65536;
+    nfds->sample = 1;
 }
 
 static void filter_dump_instance_finalize(Object *obj)
@@ -240,6 +443,11 @@ static void filter_dump_class_init(ObjectClass *oc, void *data)
                               filter_dump_set_maxlen, NULL, NULL);
     object_class_property_add_str(oc, "file", file_dump_get_filename,
                                   file_dump_set_filename);
+    object_class_property_add(oc, "sample", "uint32", filter_dump_get_sample,
+                              filter_dump_set_sample, NULL, NULL);
+    object_class_property_add(oc, "buffer-size", "size",
+                              filter_dump_get_buffer_size,
+                              filter_dump_set_buffer_size, NULL, NULL);
 
     nfc->setup = filter_dump_setup;
     nfc->cleanup = filter_dump_cleanup;
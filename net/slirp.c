@@ -355,6 +355,10 @@ static SaveVMHandlers savevm_slirp_state = {
     .load_state = net_slirp_state_load,
 };
 
+/* Limits of the interface MTU/MRU accepted by libslirp */
+#define SLIRP_MTU_MIN 68
+#define SLIRP_MTU_MAX 65521
+
 static int net_slirp_init(NetClientState *peer, const char *model,
                           const char *name, int restricted,
                           bool ipv4, const char *vnetwork, const char *vhost,
@@ -365,7 +369,7 @@ static int net_slirp_init(NetClientState *peer, const char *model,
                           const char *vnameserver, const char *vnameserver6,
                           const char *smb_export, const char *vsmbserver,
                           const char **dnssearch, const char *vdomainname,
-                          const char *tftp_server_name,
+                          const char *tftp_server_name, int mtu,
                           Error **errp)
 {
     /* default settings according to historic slirp */
@@ -398,6 +402,19 @@ static int net_slirp_init(NetClientState *peer, const char *model,
         return -1;
     }
 
+#if SLIRP_CHECK_VERSION(4, 1, 0)
+    if (mtu && (mtu < SLIRP_MTU_MIN || mtu > SLIRP_MTU_MAX)) {
+        error_setg(errp, "mtu must be between %d and %d",
+                   SLIRP_MTU_MIN, SLIRP_MTU_MAX);
+        return -1;
+    }
+#else
+    if (mtu) {
+        error_setg(errp, "Setting the mtu requires libslirp 4.1.0 or newer");
+        return -1;
+    }
+#endif
+
     if (!ipv4 && !ipv6) {
         /* It doesn't make sense to disable both */
         error_setg(errp, "IPv4 and IPv6 disabled");
@@ -568,12 +585,42 @@ static int net_slirp_init(NetClientState *peer, const char *model,
 
     s = DO_UPCAST(SlirpState, nc, nc);
 
+#if SLIRP_CHECK_VERSION(4, 1, 0)
+    {
+        SlirpConfig cfg = {
+            .version = 1,
+            .restricted = restricted,
+            .in_enabled = ipv4,
+            .vnetwork = net,
+            .vnetmask = mask,
+            .vhost = host,
+            .in6_enabled = ipv6,
+            .vprefix_addr6 = ip6_prefix,
+            .vprefix_len = vprefix6_len,
+            .vhost6 = ip6_host,
+            .vhostname = vhostname,
+            .tftp_server_name = tftp_server_name,
+            .tftp_path = tftp_export,
+            .bootfile = bootfile,
+            .vdhcp_start = dhcp,
+            .vnameserver = dns,
+            .vnameserver6 = ip6_dns,
+            .vdnssearch = dnssearch,
+            .vdomainname = vdomainname,
+            .if_mtu = mtu,
+            .if_mru = mtu,
+        };
+
+        s->slirp = slirp_new(&cfg, &slirp_cb, s);
+    }
+#else
     s->slirp = slirp_init(restricted, ipv4, net, mask, host,
                           ipv6, ip6_prefix, vprefix6_len, ip6_host,
                           vhostname, tftp_server_name,
                           tftp_export, bootfile, dhcp,
                           dns, ip6_dns, dnssearch, vdomainname,
                           &slirp_cb, s);
+#endif
     QTAILQ_INSERT_TAIL(&slirp_stacks, s, entry);
 
     /*
@@ -1109,7 +1156,8 @@ int net_init_slirp(const Netdev *netdev, const char *name,
                          user->bootfile, user->dhcpstart,
                          user->dns, user->ipv6_dns, user->smb,
                          user->smbserver, dnssearch, user->domainname,
-                         user->tftp_server_name, errp);
+                         user->tftp_server_name,
+                         user->has_mtu ? user->mtu : 0, errp);
 
     while (slirp_configs) {
         config = slirp_configs;
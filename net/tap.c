@@ -43,10 +43,29 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/sockets.h"
+#include "qemu/iov.h"
+#include "qemu/units.h"
 
 #include "net/tap.h"
 
 #include "net/vhost_net.h"
+#include "trace.h"
+
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+
+/*
+ * With tx-batch=on, guest to host packets are copied into a per-device
+ * buffer and written to the tap device by a bottom half with a single
+ * io_uring submission.  A burst flushed by the frontend then costs one
+ * system call instead of one writev() per packet.  Packets that the kernel
+ * refuses with EAGAIN stay in the buffer and are resubmitted when the tap
+ * device becomes writable; until then new packets are queued by the net
+ * layer, just like with writev().
+ */
+#define TAP_TX_BATCH_PACKETS 64
+#define TAP_TX_BATCH_BYTES (256 * KiB)
+#endif
 
 typedef struct TAPState {
     NetClientState nc;
@@ -62,6 +81,15 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+#ifdef CONFIG_LINUX_IO_URING
+    struct io_uring *tx_ring;
+    QEMUBH *tx_bh;
+    uint8_t *tx_buf;
+    size_t tx_buf_used;
+    unsigned tx_pending;
+    size_t tx_len[TAP_TX_BATCH_PACKETS];
+    bool tx_blocked;
+#endif
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -69,6 +97,9 @@ static void launch_script(const char *setup_script, const char *ifname,
 
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
+#ifdef CONFIG_LINUX_IO_URING
+static void tap_tx_flush(TAPState *s);
+#endif
 
 static void tap_update_fd_handler(TAPState *s)
 {
@@ -96,10 +127,21 @@ static void tap_writable(void *opaque)
 
     tap_write_poll(s, false);
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->tx_blocked) {
+        s->tx_blocked = false;
+        tap_tx_flush(s);
+        if (s->tx_blocked) {
+            return;
+        }
+    }
+#endif
+
     qemu_flush_queued_packets(&s->nc);
 }
 
-static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
+static ssize_t tap_writev_packet(TAPState *s, const struct iovec *iov,
+                                 int iovcnt)
 {
     ssize_t len;
 
@@ -115,6 +157,168 @@ static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt
     return len;
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Submit all batched packets and wait until the kernel has consumed them.
+ * Packets that fail with EAGAIN are kept, in order, and the device waits
+ * for the tap file descriptor to become writable.
+ */
+static void tap_tx_flush(TAPState *s)
+{
+    unsigned pending = s->tx_pending;
+    unsigned completed = 0;
+    int res[TAP_TX_BATCH_PACKETS];
+    struct io_uring_cqe *cqe;
+    size_t offset = 0;
+    unsigned i, kept;
+    int ret;
+
+    if (!pending) {
+        return;
+    }
+
+    for (i = 0; i < pending; i++) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(s->tx_ring);
+
+        /* The ring has room for TAP_TX_BATCH_PACKETS submissions */
+        assert(sqe);
+        io_uring_prep_write(sqe, s->fd, s->tx_buf + offset, s->tx_len[i], 0);
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+        offset += s->tx_len[i];
+    }
+
+    while (completed < pending) {
+        ret = io_uring_submit_and_wait(s->tx_ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            error_report("tap: io_uring submission failed: %s",
+                         strerror(-ret));
+            abort();
+        }
+        while (io_uring_peek_cqe(s->tx_ring, &cqe) == 0) {
+            /* Like writev() errors other than EAGAIN, failed packets drop */
+            if (cqe->res < 0 && cqe->res != -EAGAIN) {
+                trace_tap_tx_batch_error(s, cqe->res);
+            }
+            res[(uintptr_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+            io_uring_cqe_seen(s->tx_ring, cqe);
+            completed++;
+        }
+    }
+
+    trace_tap_tx_batch_flush(s, pending, s->tx_buf_used);
+
+    /* Move the packets to retry to the front of the buffer */
+    offset = 0;
+    s->tx_buf_used = 0;
+    for (i = 0, kept = 0; i < pending; i++) {
+        size_t len = s->tx_len[i];
+
+        if (res[i] == -EAGAIN) {
+            memmove(s->tx_buf + s->tx_buf_used, s->tx_buf + offset, len);
+            s->tx_len[kept++] = len;
+            s->tx_buf_used += len;
+        }
+        offset += len;
+    }
+    s->tx_pending = kept;
+
+    if (kept) {
+        s->tx_blocked = true;
+        tap_write_poll(s, true);
+    }
+}
+
+static void tap_tx_bh(void *opaque)
+{
+    TAPState *s = opaque;
+
+    /* tap_writable() resubmits the packets of a blocked device */
+    if (!s->tx_blocked) {
+        tap_tx_flush(s);
+    }
+}
+
+static ssize_t tap_write_packet_batched(TAPState *s, const struct iovec *iov,
+                                        int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+
+    /* Let the net layer queue the packet until tap_writable() */
+    if (s->tx_blocked) {
+        return 0;
+    }
+
+    if (size > TAP_TX_BATCH_BYTES - s->tx_buf_used ||
+        s->tx_pending == TAP_TX_BATCH_PACKETS) {
+        tap_tx_flush(s);
+        if (s->tx_blocked) {
+            return 0;
+        }
+    }
+    if (size > TAP_TX_BATCH_BYTES) {
+        return tap_writev_packet(s, iov, iovcnt);
+    }
+
+    iov_to_buf(iov, iovcnt, 0, s->tx_buf + s->tx_buf_used, size);
+    s->tx_len[s->tx_pending] = size;
+    s->tx_buf_used += size;
+    if (s->tx_pending++ == 0) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+
+    return size;
+}
+
+static int tap_tx_batch_init(TAPState *s, Error **errp)
+{
+    int ret;
+
+    s->tx_ring = g_new0(struct io_uring, 1);
+    ret = io_uring_queue_init(TAP_TX_BATCH_PACKETS, s->tx_ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "failed to initialize io_uring for tap");
+        g_free(s->tx_ring);
+        s->tx_ring = NULL;
+        return -1;
+    }
+    s->tx_buf = g_malloc(TAP_TX_BATCH_BYTES);
+    s->tx_bh = qemu_bh_new(tap_tx_bh, s);
+
+    return 0;
+}
+
+static void tap_tx_batch_cleanup(TAPState *s)
+{
+    if (!s->tx_ring) {
+        return;
+    }
+
+    /* Packets still blocked by a full tap device are dropped */
+    tap_tx_flush(s);
+    s->tx_blocked = false;
+    s->tx_pending = 0;
+    s->tx_buf_used = 0;
+    qemu_bh_delete(s->tx_bh);
+    s->tx_bh = NULL;
+    g_free(s->tx_buf);
+    s->tx_buf = NULL;
+    io_uring_queue_exit(s->tx_ring);
+    g_free(s->tx_ring);
+    s->tx_ring = NULL;
+}
+#endif
+
+static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->tx_ring) {
+        return tap_write_packet_batched(s, iov, iovcnt);
+    }
+#endif
+
+    return tap_writev_packet(s, iov, iovcnt);
+}
+
 static ssize_t tap_receive_iov(NetClientState *nc, const struct iovec *iov,
                                int iovcnt)
 {
@@ -331,6 +535,10 @@ static void tap_cleanup(NetClientState *nc)
 
     qemu_purge_queued_packets(nc);
 
+#ifdef CONFIG_LINUX_IO_URING
+    tap_tx_batch_cleanup(s);
+#endif
+
     tap_exit_notify(&s->exit, NULL);
     qemu_remove_exit_notifier(&s->exit);
 
@@ -687,6 +895,17 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
         return;
     }
 
+    if (tap->has_tx_batch && tap->tx_batch) {
+#ifdef CONFIG_LINUX_IO_URING
+        if (tap_tx_batch_init(s, errp) < 0) {
+            return;
+        }
+#else
+        error_setg(errp, "tx-batch=on requires io_uring support");
+        return;
+#endif
+    }
+
     if (tap->has_fd || tap->has_fds) {
         snprintf(s->nc.info_str, sizeof(s->nc.info_str), "fd=%d", fd);
     } else if (tap->has_helper) {
@@ -1045,6 +1264,11 @@ int tap_disable(NetClientState *nc)
     if (s->enabled == 0) {
         return 0;
     } else {
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->tx_ring) {
+            tap_tx_flush(s);
+        }
+#endif
         ret = tap_fd_disable(s->fd);
         if (ret == 0) {
             qemu_purge_queued_packets(nc);
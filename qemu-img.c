@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include <getopt.h>
+#include <math.h>
 
 #include "qemu-common.h"
 #include "qemu-version.h"
@@ -33,6 +34,7 @@
 #include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qnum.h"
 #include "qemu/cutils.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
@@ -41,6 +43,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/sockets.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
@@ -83,6 +86,10 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_RANDOM = 278,
+    OPTION_ZIPF = 279,
+    OPTION_RW_MIX = 280,
+    OPTION_SEED = 281,
 };
 
 typedef enum OutputFormat {
@@ -1251,6 +1258,16 @@ static int compare_buffers(const uint8_t *buf1, const uint8_t *buf2,
     assert(bytes > 0);
 
     res = !!memcmp(buf1, buf2, i);
+
+    /*
+     * Matching buffers are the common case: check the rest in one go
+     * rather than sector by sector.
+     */
+    if (!res && i < bytes && !memcmp(buf1 + i, buf2 + i, bytes - i)) {
+        *pnum = bytes;
+        return 0;
+    }
+
     while (i < bytes) {
         int64_t len = MIN(bytes - i, BDRV_SECTOR_SIZE);
 
@@ -1621,8 +1638,17 @@ enum ImgConvertBlockStatus {
 };
 
 #define MAX_COROUTINES 16
+/* Size of the ranges into which the block status scan is split */
+#define CONVERT_SCAN_CHUNK_SECTORS (1 * GiB / BDRV_SECTOR_SIZE)
+#define MAX_BUF_SECTORS 32768
+#define MAX_COMPRESS_THREADS 64
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+typedef struct ConvertExtent {
+    int64_t end; /* first sector after the extent */
+    enum ImgConvertBlockStatus status;
+} ConvertExtent;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1649,14 +1675,25 @@ typedef struct ImgConvertState {
     int alignment;
     size_t cluster_sectors;
     size_t buf_sectors;
+    int compress_threads;
     long num_coroutines;
     int running_coroutines;
     Coroutine *co[MAX_COROUTINES];
     int64_t wait_sector_num[MAX_COROUTINES];
     CoMutex lock;
     int ret;
+    /* Map of ConvertExtent covering the whole source, once scanned */
+    GArray *extents;
 } ImgConvertState;
 
+typedef struct ConvertScanState {
+    ImgConvertState *s;
+    int64_t next_chunk;
+    GArray **chunks;
+    int running;
+    int ret;
+} ConvertScanState;
+
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
                                 int *src_cur, int64_t *src_cur_offset)
 {
@@ -1669,20 +1706,23 @@ static void convert_select_part(ImgConvertState *s, int64_t sector_num,
     }
 }
 
-static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
+/*
+ * Return the maximum length of the extent starting at @sector_num, and
+ * in @post_backing_zero whether it lies beyond the end of the target's
+ * backing file.
+ */
+static int convert_extent_limit(ImgConvertState *s, int64_t sector_num,
+                                bool *post_backing_zero)
 {
-    int64_t src_cur_offset;
-    int ret, n, src_cur;
-    bool post_backing_zero = false;
-
-    convert_select_part(s, sector_num, &src_cur, &src_cur_offset);
+    int n;
 
     assert(s->total_sectors > sector_num);
     n = MIN(s->total_sectors - sector_num, BDRV_REQUEST_MAX_SECTORS);
 
+    *post_backing_zero = false;
     if (s->target_backing_sectors >= 0) {
         if (sector_num >= s->target_backing_sectors) {
-            post_backing_zero = true;
+            *post_backing_zero = true;
         } else if (sector_num + n > s->target_backing_sectors) {
             /* Split requests around target_backing_sectors (because
              * starting from there, zeros are handled differently) */
@@ -1690,68 +1730,125 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
         }
     }
 
-    if (s->sector_next_status <= sector_num) {
-        uint64_t offset = (sector_num - src_cur_offset) * BDRV_SECTOR_SIZE;
-        int64_t count;
-        int tail;
-        BlockDriverState *src_bs = blk_bs(s->src[src_cur]);
-        BlockDriverState *base;
-
-        if (s->target_has_backing) {
-            base = bdrv_cow_bs(bdrv_skip_filters(src_bs));
-        } else {
-            base = NULL;
-        }
+    return n;
+}
 
-        do {
-            count = n * BDRV_SECTOR_SIZE;
+/*
+ * Query the block status of at most @n sectors at @sector_num and store
+ * it in @status.  Returns the number of sectors with that status, or
+ * -errno on failure.
+ */
+static int convert_block_status(ImgConvertState *s, int64_t sector_num,
+                                int n, bool post_backing_zero,
+                                enum ImgConvertBlockStatus *status)
+{
+    int64_t src_cur_offset, count;
+    uint64_t offset;
+    int ret, src_cur, tail;
+    BlockDriverState *src_bs, *base;
 
-            ret = bdrv_block_status_above(src_bs, base, offset, count, &count,
-                                          NULL, NULL);
+    convert_select_part(s, sector_num, &src_cur, &src_cur_offset);
+    offset = (sector_num - src_cur_offset) * BDRV_SECTOR_SIZE;
+    src_bs = blk_bs(s->src[src_cur]);
 
-            if (ret < 0) {
-                if (s->salvage) {
-                    if (n == 1) {
-                        if (!s->quiet) {
-                            warn_report("error while reading block status at "
-                                        "offset %" PRIu64 ": %s", offset,
-                                        strerror(-ret));
-                        }
-                        /* Just try to read the data, then */
-                        ret = BDRV_BLOCK_DATA;
-                        count = BDRV_SECTOR_SIZE;
-                    } else {
-                        /* Retry on a shorter range */
-                        n = DIV_ROUND_UP(n, 4);
+    if (s->target_has_backing) {
+        base = bdrv_cow_bs(bdrv_skip_filters(src_bs));
+    } else {
+        base = NULL;
+    }
+
+    do {
+        count = n * BDRV_SECTOR_SIZE;
+
+        ret = bdrv_block_status_above(src_bs, base, offset, count, &count,
+                                      NULL, NULL);
+
+        if (ret < 0) {
+            if (s->salvage) {
+                if (n == 1) {
+                    if (!s->quiet) {
+                        warn_report("error while reading block status at "
+                                    "offset %" PRIu64 ": %s", offset,
+                                    strerror(-ret));
                     }
+                    /* Just try to read the data, then */
+                    ret = BDRV_BLOCK_DATA;
+                    count = BDRV_SECTOR_SIZE;
                 } else {
-                    error_report("error while reading block status at offset "
-                                 "%" PRIu64 ": %s", offset, strerror(-ret));
-                    return ret;
+                    /* Retry on a shorter range */
+                    n = DIV_ROUND_UP(n, 4);
                 }
+            } else {
+                error_report("error while reading block status at offset "
+                             "%" PRIu64 ": %s", offset, strerror(-ret));
+                return ret;
             }
-        } while (ret < 0);
+        }
+    } while (ret < 0);
 
-        n = DIV_ROUND_UP(count, BDRV_SECTOR_SIZE);
+    n = DIV_ROUND_UP(count, BDRV_SECTOR_SIZE);
 
-        /*
-         * Avoid that s->sector_next_status becomes unaligned to the source
-         * request alignment and/or cluster size to avoid unnecessary read
-         * cycles.
-         */
-        tail = (sector_num - src_cur_offset + n) % s->src_alignment[src_cur];
-        if (n > tail) {
-            n -= tail;
-        }
+    /*
+     * Avoid that s->sector_next_status becomes unaligned to the source
+     * request alignment and/or cluster size to avoid unnecessary read
+     * cycles.
+     */
+    tail = (sector_num - src_cur_offset + n) % s->src_alignment[src_cur];
+    if (n > tail) {
+        n -= tail;
+    }
 
-        if (ret & BDRV_BLOCK_ZERO) {
-            s->status = post_backing_zero ? BLK_BACKING_FILE : BLK_ZERO;
-        } else if (ret & BDRV_BLOCK_DATA) {
-            s->status = BLK_DATA;
+    if (ret & BDRV_BLOCK_ZERO) {
+        *status = post_backing_zero ? BLK_BACKING_FILE : BLK_ZERO;
+    } else if (ret & BDRV_BLOCK_DATA) {
+        *status = BLK_DATA;
+    } else {
+        *status = s->target_has_backing ? BLK_BACKING_FILE : BLK_DATA;
+    }
+
+    return n;
+}
+
+/* Return the extent of the map that contains @sector_num */
+static const ConvertExtent *convert_find_extent(ImgConvertState *s,
+                                                int64_t sector_num)
+{
+    const ConvertExtent *extents = (const ConvertExtent *)s->extents->data;
+    guint lo = 0, hi = s->extents->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (extents[mid].end <= sector_num) {
+            lo = mid + 1;
         } else {
-            s->status = s->target_has_backing ? BLK_BACKING_FILE : BLK_DATA;
+            hi = mid;
         }
+    }
+    assert(lo < s->extents->len);
+    return &extents[lo];
+}
+
+static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
+{
+    bool post_backing_zero;
+    int n;
+
+    n = convert_extent_limit(s, sector_num, &post_backing_zero);
 
+    if (s->sector_next_status <= sector_num) {
+        if (s->extents) {
+            const ConvertExtent *extent = convert_find_extent(s, sector_num);
+
+            n = MIN(n, extent->end - sector_num);
+            s->status = extent->status;
+        } else {
+            n = convert_block_status(s, sector_num, n, post_backing_zero,
+                                     &s->status);
+            if (n < 0) {
+                return n;
+            }
+        }
         s->sector_next_status = sector_num + n;
     }
 
@@ -1775,6 +1872,102 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
     return n;
 }
 
+static void coroutine_fn convert_co_scan(void *opaque)
+{
+    ConvertScanState *scan = opaque;
+    ImgConvertState *s = scan->s;
+
+    while (!scan->ret) {
+        int64_t chunk = scan->next_chunk;
+        int64_t sector_num = chunk * CONVERT_SCAN_CHUNK_SECTORS;
+        int64_t end;
+        GArray *extents;
+
+        if (sector_num >= s->total_sectors) {
+            break;
+        }
+        scan->next_chunk++;
+
+        end = MIN(sector_num + CONVERT_SCAN_CHUNK_SECTORS, s->total_sectors);
+        extents = g_array_new(false, false, sizeof(ConvertExtent));
+        scan->chunks[chunk] = extents;
+
+        while (sector_num < end) {
+            ConvertExtent extent;
+            bool post_backing_zero;
+            int n;
+
+            n = convert_extent_limit(s, sector_num, &post_backing_zero);
+            n = convert_block_status(s, sector_num, MIN(n, end - sector_num),
+                                     post_backing_zero, &extent.status);
+            if (n < 0) {
+                scan->ret = n;
+                break;
+            }
+            sector_num += n;
+            extent.end = sector_num;
+            g_array_append_val(extents, extent);
+        }
+    }
+
+    scan->running--;
+}
+
+/*
+ * Build s->extents, the block status map of the whole source.  The
+ * image is split into chunks that are queried by several coroutines at
+ * once, so that the block status latency of remote sources overlaps;
+ * the copy then needs no further block status queries.  Adjacent
+ * extents with the same status are merged.
+ */
+static int convert_scan_extents(ImgConvertState *s)
+{
+    ConvertScanState scan = { .s = s };
+    int64_t nb_chunks = DIV_ROUND_UP(s->total_sectors,
+                                     CONVERT_SCAN_CHUNK_SECTORS);
+    int64_t i;
+    guint j;
+
+    scan.chunks = g_new0(GArray *, nb_chunks);
+    for (i = 0; i < MIN(s->num_coroutines, nb_chunks); i++) {
+        Coroutine *co = qemu_coroutine_create(convert_co_scan, &scan);
+
+        scan.running++;
+        qemu_coroutine_enter(co);
+    }
+
+    while (scan.running) {
+        main_loop_wait(false);
+    }
+
+    if (!scan.ret) {
+        s->extents = g_array_new(false, false, sizeof(ConvertExtent));
+    }
+    for (i = 0; i < nb_chunks; i++) {
+        GArray *chunk = scan.chunks[i];
+
+        if (!chunk) {
+            continue;
+        }
+        for (j = 0; s->extents && j < chunk->len; j++) {
+            ConvertExtent *extent = &g_array_index(chunk, ConvertExtent, j);
+            ConvertExtent *last = s->extents->len ?
+                &g_array_index(s->extents, ConvertExtent,
+                               s->extents->len - 1) : NULL;
+
+            if (last && last->status == extent->status) {
+                last->end = extent->end;
+            } else {
+                g_array_append_val(s->extents, *extent);
+            }
+        }
+        g_array_free(chunk, true);
+    }
+    g_free(scan.chunks);
+
+    return scan.ret;
+}
+
 static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
                                         int nb_sectors, uint8_t *buf)
 {
@@ -1829,6 +2022,37 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
 }
 
 
+/*
+ * Compressed clusters need to be written as a whole.  Set *pnum to the
+ * number of sectors at the start of @buf, up to @nb_sectors, that belong
+ * to clusters which are either all zero or all contain data, and return
+ * true in the former case.
+ */
+static bool convert_compressed_is_zero(ImgConvertState *s, int64_t sector_num,
+                                       int nb_sectors, const uint8_t *buf,
+                                       int *pnum)
+{
+    bool zero = false;
+    int n = 0;
+
+    while (n < nb_sectors) {
+        int len = MIN(nb_sectors - n, s->cluster_sectors -
+                      (sector_num + n) % s->cluster_sectors);
+        bool cluster_zero = buffer_is_zero(buf + n * BDRV_SECTOR_SIZE,
+                                           len * BDRV_SECTOR_SIZE);
+
+        if (n == 0) {
+            zero = cluster_zero;
+        } else if (cluster_zero != zero) {
+            break;
+        }
+        n += len;
+    }
+
+    *pnum = n;
+    return zero;
+}
+
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
                                          enum ImgConvertBlockStatus status)
@@ -1852,14 +2076,13 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
              * is real non-zero data, we must write it. Otherwise we can treat
              * it as zero sectors.
              * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
+             * case we can only skip clusters that are completely zeroed. */
             if (!s->min_sparse ||
                 (!s->compressed &&
                  is_allocated_sectors_min(buf, n, &n, s->min_sparse,
                                           sector_num, s->alignment)) ||
                 (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
+                 !convert_compressed_is_zero(s, sector_num, n, buf, &n)))
             {
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
@@ -2054,14 +2277,37 @@ static int convert_do_copy(ImgConvertState *s)
         s->has_zero_init = bdrv_has_zero_init(blk_bs(s->target));
     }
 
-    /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+    /* Allocate buffer for copied data. For compressed images, the buffer
+     * must hold whole clusters. */
     if (s->compressed) {
+        BlockDriver *drv = blk_bs(s->target)->drv;
+
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        /*
+         * Drivers with .bdrv_co_pwritev_compressed_part accept compressed
+         * writes of several clusters and compress them in parallel; the
+         * others take only one cluster at a time.  With in-order writes
+         * the compression of consecutive requests is serialized, so
+         * larger requests are the only way to use more than one thread.
+         */
+        if (drv->bdrv_co_pwritev_compressed_part) {
+            /* Have enough clusters to keep all compression threads busy */
+            s->buf_sectors = MAX(s->buf_sectors,
+                                 MIN(MAX_BUF_SECTORS, 2 * s->compress_threads *
+                                                      s->cluster_sectors));
+            s->buf_sectors = QEMU_ALIGN_DOWN(s->buf_sectors,
+                                             s->cluster_sectors);
+        } else {
+            s->buf_sectors = s->cluster_sectors;
+        }
+    }
+
+    ret = convert_scan_extents(s);
+    if (ret < 0) {
+        return ret;
     }
 
     while (sector_num < s->total_sectors) {
@@ -2165,8 +2411,6 @@ static int convert_copy_bitmaps(BlockDriverState *src, BlockDriverState *dst,
     return 0;
 }
 
-#define MAX_BUF_SECTORS 32768
-
 static void set_rate_limit(BlockBackend *blk, int64_t rate_limit)
 {
     ThrottleConfig cfg;
@@ -2614,6 +2858,16 @@ static int img_convert(int argc, char **argv)
         open_opts = qdict_new();
         qemu_opt_foreach(opts, img_add_key_secrets, open_opts, &error_abort);
 
+        /*
+         * qemu-img has the host to itself, so let qcow2 compress on all
+         * CPUs instead of its default of a few threads.
+         */
+        if (s.compressed && !strcmp(drv->format_name, "qcow2")) {
+            s.compress_threads = MIN(g_get_num_processors(),
+                                     MAX_COMPRESS_THREADS);
+            qdict_put_int(open_opts, "compress-threads", s.compress_threads);
+        }
+
         /* Create the new image */
         ret = bdrv_create(drv, out_filename, opts, &local_err);
         if (ret < 0) {
@@ -2752,6 +3006,9 @@ out:
     }
     g_free(s.src_sectors);
     g_free(s.src_alignment);
+    if (s.extents) {
+        g_array_free(s.extents, true);
+    }
 fail_getopt:
     qemu_opts_del(sn_opts);
     g_free(options);
@@ -3713,6 +3970,7 @@ static int img_rebase(int argc, char **argv)
 
         for (offset = 0; offset < size; offset += n) {
             bool buf_old_is_zero = false;
+            bool buf_new_is_zero = false;
 
             /* How many bytes can we handle with the next read? */
             n = MIN(IO_BUF_SIZE, size - offset);
@@ -3750,28 +4008,62 @@ static int img_rebase(int argc, char **argv)
              * Read old and new backing file and take into consideration that
              * backing files may be smaller than the COW image.
              */
+            /*
+             * Ranges that read as zeroes according to block status are not
+             * read; if both backing files are zero there, nothing changes.
+             */
             if (offset >= old_backing_size) {
-                memset(buf_old, 0, n);
                 buf_old_is_zero = true;
             } else {
                 if (offset + n > old_backing_size) {
                     n = old_backing_size - offset;
                 }
 
-                ret = blk_pread(blk_old_backing, offset, buf_old, n);
+                ret = bdrv_block_status_above(blk_bs(blk_old_backing), NULL,
+                                              offset, n, &n, NULL, NULL);
                 if (ret < 0) {
-                    error_report("error while reading from old backing file");
+                    error_report("error while reading old backing file "
+                                 "metadata: %s", strerror(-ret));
                     goto out;
                 }
+                buf_old_is_zero = ret & BDRV_BLOCK_ZERO;
             }
 
             if (offset >= new_backing_size || !blk_new_backing) {
-                memset(buf_new, 0, n);
+                buf_new_is_zero = true;
             } else {
                 if (offset + n > new_backing_size) {
                     n = new_backing_size - offset;
                 }
 
+                ret = bdrv_block_status_above(blk_bs(blk_new_backing), NULL,
+                                              offset, n, &n, NULL, NULL);
+                if (ret < 0) {
+                    error_report("error while reading new backing file "
+                                 "metadata: %s", strerror(-ret));
+                    goto out;
+                }
+                buf_new_is_zero = ret & BDRV_BLOCK_ZERO;
+            }
+
+            if (buf_old_is_zero && buf_new_is_zero) {
+                qemu_progress_print(local_progress, 100);
+                continue;
+            }
+
+            if (buf_old_is_zero) {
+                memset(buf_old, 0, n);
+            } else {
+                ret = blk_pread(blk_old_backing, offset, buf_old, n);
+                if (ret < 0) {
+                    error_report("error while reading from old backing file");
+                    goto out;
+                }
+            }
+
+            if (buf_new_is_zero) {
+                memset(buf_new, 0, n);
+            } else {
                 ret = blk_pread(blk_new_backing, offset, buf_new, n);
                 if (ret < 0) {
                     error_report("error while reading from new backing file");
@@ -4233,6 +4525,26 @@ out_no_progress:
     return 0;
 }
 
+/*
+ * Latencies are counted in a log-linear histogram: each power of two
+ * is split into 2^BENCH_LAT_SUB_BITS buckets, for a precision of ~6%.
+ */
+#define BENCH_LAT_SUB_BITS 4
+#define BENCH_LAT_BUCKETS (64 << BENCH_LAT_SUB_BITS)
+
+typedef enum BenchOffsetMode {
+    BENCH_SEQUENTIAL,
+    BENCH_RANDOM,
+    BENCH_ZIPF,
+} BenchOffsetMode;
+
+typedef struct BenchRequest {
+    struct BenchData *b;
+    QEMUIOVector qiov;
+    bool write;
+    int64_t start_ns;
+} BenchRequest;
+
 typedef struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
@@ -4244,13 +4556,155 @@ typedef struct BenchData {
     int flush_interval;
     bool drain_on_flush;
     uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchRequest *reqs;
+    BenchRequest **free_reqs;
+    int nr_free_reqs;
+
+    BenchOffsetMode mode;
+    uint64_t nr_slots; /* number of possible random offsets */
+    GRand *rand;
+    int read_percent;
+    double zipf_theta;
+    double zipf_hx1, zipf_hxn, zipf_sdiv;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
+
+    uint64_t nr_reads;
+    uint64_t nr_writes;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t lat_sum;
+    uint64_t lat_hist[BENCH_LAT_BUCKETS];
 } BenchData;
 
+static int bench_lat_bucket(uint64_t ns)
+{
+    int shift;
+
+    if (ns < (1 << BENCH_LAT_SUB_BITS)) {
+        return ns;
+    }
+    shift = 63 - clz64(ns) - BENCH_LAT_SUB_BITS;
+    return ((shift + 1) << BENCH_LAT_SUB_BITS) |
+           ((ns >> shift) & ((1 << BENCH_LAT_SUB_BITS) - 1));
+}
+
+/* Lowest latency that falls into @bucket */
+static uint64_t bench_lat_value(int bucket)
+{
+    int exp = bucket >> BENCH_LAT_SUB_BITS;
+    uint64_t sub = bucket & ((1 << BENCH_LAT_SUB_BITS) - 1);
+
+    if (!exp) {
+        return sub;
+    }
+    return ((1 << BENCH_LAT_SUB_BITS) | sub) << (exp - 1);
+}
+
+static uint64_t bench_lat_percentile(BenchData *b, double percentile)
+{
+    uint64_t total = b->nr_reads + b->nr_writes;
+    uint64_t rank = MAX(1, (uint64_t)ceil(total * percentile / 100));
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+        seen += b->lat_hist[i];
+        if (seen >= rank) {
+            return MIN(MAX(bench_lat_value(i), b->lat_min), b->lat_max);
+        }
+    }
+    return b->lat_max;
+}
+
+/*
+ * Zipf distributed ranks are drawn with the rejection-inversion method
+ * of Hoermann and Derflinger, which needs neither a table nor a sum over
+ * all of the image's slots.
+ */
+static double bench_zipf_helper1(double x)
+{
+    /* log1p(x) / x, with its Taylor series around 0 */
+    return fabs(x) > 1e-8 ? log1p(x) / x
+                          : 1 - x * (0.5 - x * (1.0 / 3 - x / 4));
+}
+
+static double bench_zipf_helper2(double x)
+{
+    /* expm1(x) / x, with its Taylor series around 0 */
+    return fabs(x) > 1e-8 ? expm1(x) / x
+                          : 1 + x / 2 * (1 + x / 3 * (1 + x / 4));
+}
+
+static double bench_zipf_h(BenchData *b, double x)
+{
+    return exp(-b->zipf_theta * log(x));
+}
+
+static double bench_zipf_hintegral(BenchData *b, double x)
+{
+    double log_x = log(x);
+
+    return bench_zipf_helper2((1 - b->zipf_theta) * log_x) * log_x;
+}
+
+static double bench_zipf_hintegral_inverse(BenchData *b, double x)
+{
+    double t = MAX(x * (1 - b->zipf_theta), -1);
+
+    return exp(bench_zipf_helper1(t) * x);
+}
+
+static void bench_zipf_init(BenchData *b)
+{
+    b->zipf_hx1 = bench_zipf_hintegral(b, 1.5) - 1;
+    b->zipf_hxn = bench_zipf_hintegral(b, b->nr_slots + 0.5);
+    b->zipf_sdiv = 2 - bench_zipf_hintegral_inverse(b,
+                       bench_zipf_hintegral(b, 2.5) - bench_zipf_h(b, 2));
+}
+
+/* Returns a rank between 1 and b->nr_slots, 1 being the most likely */
+static uint64_t bench_zipf_next(BenchData *b)
+{
+    for (;;) {
+        double u = b->zipf_hxn +
+                   g_rand_double(b->rand) * (b->zipf_hx1 - b->zipf_hxn);
+        double x = bench_zipf_hintegral_inverse(b, u);
+        uint64_t k = MIN(MAX(x + 0.5, 1), b->nr_slots);
+
+        if (k - x <= b->zipf_sdiv ||
+            u >= bench_zipf_hintegral(b, k + 0.5) - bench_zipf_h(b, k)) {
+            return k;
+        }
+    }
+}
+
+static uint64_t bench_next_offset(BenchData *b)
+{
+    uint64_t offset, slot;
+
+    switch (b->mode) {
+    case BENCH_SEQUENTIAL:
+        offset = b->offset;
+        b->offset += b->step;
+        b->offset %= b->image_size;
+        return offset;
+    case BENCH_RANDOM:
+        slot = ((uint64_t)g_rand_int(b->rand) << 32) | g_rand_int(b->rand);
+        slot %= b->nr_slots;
+        break;
+    case BENCH_ZIPF:
+        slot = bench_zipf_next(b) - 1;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    return b->offset + slot * b->step;
+}
+
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
     if (ret < 0) {
@@ -4259,6 +4713,31 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static void bench_cb(void *opaque, int ret);
+
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchRequest *req = opaque;
+    BenchData *b = req->b;
+
+    if (ret >= 0) {
+        uint64_t lat = get_clock() - req->start_ns;
+
+        b->lat_min = MIN(b->lat_min, lat);
+        b->lat_max = MAX(b->lat_max, lat);
+        b->lat_sum += lat;
+        b->lat_hist[bench_lat_bucket(lat)]++;
+        if (req->write) {
+            b->nr_writes++;
+        } else {
+            b->nr_reads++;
+        }
+    }
+
+    b->free_reqs[b->nr_free_reqs++] = req;
+    bench_cb(b, ret);
+}
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4304,18 +4783,23 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+        BenchRequest *req = b->free_reqs[--b->nr_free_reqs];
+        int64_t offset = bench_next_offset(b);
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        req->write = b->write &&
+                     g_rand_int_range(b->rand, 0, 100) >= b->read_percent;
+        req->start_ns = get_clock();
+        if (req->write) {
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0,
+                                  bench_req_cb, req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0,
+                                 bench_req_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4324,6 +4808,61 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+static void bench_report(BenchData *b, double seconds,
+                         OutputFormat output_format)
+{
+    uint64_t nr_done = b->nr_reads + b->nr_writes;
+    uint64_t bytes = nr_done * b->bufsize;
+    static const double percentiles[] = { 50, 99, 99.9 };
+    static const char *const percentile_names[] = { "p50", "p99", "p99.9" };
+    uint64_t lat_avg = nr_done ? b->lat_sum / nr_done : 0;
+    int i;
+
+    if (!nr_done) {
+        b->lat_min = 0;
+    }
+
+    if (output_format == OFORMAT_JSON) {
+        QDict *results = qdict_new();
+        QDict *latency = qdict_new();
+        GString *str;
+
+        qdict_put_int(results, "reads", b->nr_reads);
+        qdict_put_int(results, "writes", b->nr_writes);
+        qdict_put_int(results, "bytes", bytes);
+        qdict_put(results, "seconds", qnum_from_double(seconds));
+        qdict_put(results, "iops", qnum_from_double(nr_done / seconds));
+        qdict_put(results, "bandwidth", qnum_from_double(bytes / seconds));
+
+        qdict_put_int(latency, "min", b->lat_min);
+        qdict_put_int(latency, "avg", lat_avg);
+        qdict_put_int(latency, "max", b->lat_max);
+        for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+            qdict_put_int(latency, percentile_names[i],
+                          bench_lat_percentile(b, percentiles[i]));
+        }
+        qdict_put(results, "latency-ns", latency);
+
+        str = qobject_to_json_pretty(QOBJECT(results), true);
+        printf("%s\n", str->str);
+        g_string_free(str, true);
+        qobject_unref(results);
+        return;
+    }
+
+    printf("Run completed in %3.3f seconds.\n", seconds);
+    printf("%" PRIu64 " reads, %" PRIu64 " writes: %.0f IOPS, %.3f MiB/s\n",
+           b->nr_reads, b->nr_writes, nr_done / seconds,
+           bytes / seconds / MiB);
+    printf("Latency (us): min %.1f, avg %.1f, max %.1f",
+           b->lat_min / 1000.0, lat_avg / 1000.0, b->lat_max / 1000.0);
+    for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        printf(", %s %.1f", percentile_names[i],
+               bench_lat_percentile(b, percentiles[i]) / 1000.0);
+    }
+    printf("\n");
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
@@ -4348,6 +4887,12 @@ static int img_bench(int argc, char **argv)
     int i;
     bool force_share = false;
     size_t buf_size;
+    BenchOffsetMode mode = BENCH_SEQUENTIAL;
+    double zipf_theta = 0;
+    int read_percent = 0;
+    uint32_t seed = 0;
+    const char *output = NULL;
+    OutputFormat output_format = OFORMAT_HUMAN;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4357,6 +4902,11 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"zipf", required_argument, 0, OPTION_ZIPF},
+            {"rw-mix", required_argument, 0, OPTION_RW_MIX},
+            {"seed", required_argument, 0, OPTION_SEED},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:ni:o:qs:S:t:wU", long_options,
@@ -4490,6 +5040,42 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_RANDOM:
+            mode = BENCH_RANDOM;
+            break;
+        case OPTION_ZIPF:
+            if (qemu_strtod_finite(optarg, NULL, &zipf_theta) < 0 ||
+                !(zipf_theta > 0)) {
+                error_report("Invalid Zipf exponent specified");
+                return 1;
+            }
+            mode = BENCH_ZIPF;
+            break;
+        case OPTION_RW_MIX:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid read percentage specified");
+                return 1;
+            }
+            read_percent = res;
+            break;
+        }
+        case OPTION_SEED:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > UINT32_MAX) {
+                error_report("Invalid seed specified");
+                return 1;
+            }
+            seed = res;
+            break;
+        }
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         }
     }
 
@@ -4498,6 +5084,21 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        return 1;
+    }
+
+    if (!is_write && read_percent) {
+        error_report("--rw-mix is only available in write tests");
+        ret = -1;
+        goto out;
+    }
+
     if (!is_write && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
@@ -4533,13 +5134,43 @@ static int img_bench(int argc, char **argv)
         .write          = is_write,
         .flush_interval = flush_interval,
         .drain_on_flush = drain_on_flush,
+        .mode           = mode,
+        .rand           = g_rand_new_with_seed(seed),
+        .read_percent   = read_percent,
+        .zipf_theta     = zipf_theta,
+        .lat_min        = UINT64_MAX,
     };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
+
+    if (mode != BENCH_SEQUENTIAL) {
+        /* Random requests stay within the image, aligned to the step size */
+        if (offset + data.bufsize > image_size) {
+            error_report("Offset and buffer size exceed the image size");
+            ret = -1;
+            goto out;
+        }
+        data.nr_slots = (image_size - offset - data.bufsize) / data.step + 1;
+        if (mode == BENCH_ZIPF) {
+            bench_zipf_init(&data);
+        }
+    }
+
+    if (output_format == OFORMAT_HUMAN) {
+        printf("Sending %d %s requests, %d bytes each, %d in parallel "
+               "(starting at offset %" PRId64 ", step size %d)\n",
+               data.n, data.write ? "write" : "read", data.bufsize,
+               data.nrreq, data.offset, data.step);
+        if (mode == BENCH_RANDOM) {
+            printf("Offsets are uniformly random\n");
+        } else if (mode == BENCH_ZIPF) {
+            printf("Offsets are Zipf distributed with exponent %g\n",
+                   zipf_theta);
+        }
+        if (read_percent) {
+            printf("%d%% of the requests are reads\n", read_percent);
+        }
+        if (flush_interval) {
+            printf("Sending flush every %d requests\n", flush_interval);
+        }
     }
 
     buf_size = data.nrreq * data.bufsize;
@@ -4548,11 +5179,15 @@ static int img_bench(int argc, char **argv)
 
     blk_register_buf(blk, data.buf, buf_size);
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
+    data.reqs = g_new0(BenchRequest, data.nrreq);
+    data.free_reqs = g_new(BenchRequest *, data.nrreq);
     for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
-                       data.buf + i * data.bufsize, data.bufsize);
+        BenchRequest *req = &data.reqs[i];
+
+        req->b = &data;
+        qemu_iovec_init(&req->qiov, 1);
+        qemu_iovec_add(&req->qiov, data.buf + i * data.bufsize, data.bufsize);
+        data.free_reqs[data.nr_free_reqs++] = req;
     }
 
     gettimeofday(&t1, NULL);
@@ -4563,15 +5198,25 @@ static int img_bench(int argc, char **argv)
     }
     gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    bench_report(&data, (t2.tv_sec - t1.tv_sec)
+                        + ((double)(t2.tv_usec - t1.tv_usec) / 1000000),
+                 output_format);
 
 out:
     if (data.buf) {
         blk_unregister_buf(blk, data.buf);
     }
     qemu_vfree(data.buf);
+    if (data.reqs) {
+        for (i = 0; i < data.nrreq; i++) {
+            qemu_iovec_destroy(&data.reqs[i].qiov);
+        }
+    }
+    g_free(data.reqs);
+    g_free(data.free_reqs);
+    if (data.rand) {
+        g_rand_free(data.rand);
+    }
     blk_unref(blk);
 
     if (ret) {
@@ -36,6 +36,7 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                nvdimm=on|off controls NVDIMM support (default=off)\n"
     "                memory-encryption=@var{} memory encryption object to use (default=none)\n"
     "                hmat=on|off controls ACPI HMAT support (default=off)\n"
+    "                numa-affinity=on|off binds vCPUs to the host nodes of their NUMA node (default=off)\n"
     "                memory-backend='backend-id' specifies explicitly provided backend for main RAM (default=none)\n",
     QEMU_ARCH_ALL)
 SRST
@@ -98,6 +99,15 @@ SRST
         Enables or disables ACPI Heterogeneous Memory Attribute Table
         (HMAT) support. The default is off.
 
+    ``numa-affinity=on|off``
+        Binds the thread of each vCPU to the host CPUs of the host NUMA
+        nodes that the memory of its guest NUMA node is bound to, so
+        that vCPUs access their node's memory locally. Requires every
+        ``-numa node`` to have a ``memdev`` with ``host-nodes`` and
+        ``policy`` set. Memory preallocation threads of such backends
+        are always placed on the backend's host nodes. The default is
+        off.
+
     ``memory-backend='id'``
         An alternative to legacy ``-mem-path`` and ``mem-prealloc`` options.
         Allows to use a memory backend as main RAM.
@@ -151,6 +161,8 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-exec-count=on|off (count TCG translation block executions, default=off)\n"
+    "                perf-map=on|off (write a perf map for TCG generated code, default=off)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -185,6 +197,18 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-exec-count=on|off``
+        Count how many times each TCG translation block is executed,
+        including through chained jumps, and report the hottest blocks
+        in ``info jit``.  The counters are lost when the translation
+        cache is flushed.  Default is off.
+
+    ``perf-map=on|off``
+        Write ``/tmp/perf-<pid>.map`` with one line for each translation
+        block, so that ``perf report`` can attribute samples in the
+        translated code to the guest address it came from.  Default is
+        off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -2031,7 +2055,8 @@ DEF("spice", HAS_ARG, QEMU_OPTION_spice,
     "       [,image-compression=[auto_glz|auto_lz|quic|glz|lz|off]]\n"
     "       [,jpeg-wan-compression=[auto|never|always]]\n"
     "       [,zlib-glz-wan-compression=[auto|never|always]]\n"
-    "       [,streaming-video=[off|all|filter]][,disable-copy-paste=on|off]\n"
+    "       [,streaming-video=[off|all|filter]][,video-codecs=<codec>]\n"
+    "       [,disable-copy-paste=on|off]\n"
     "       [,disable-agent-file-xfer=on|off][,agent-mouse=[on|off]]\n"
     "       [,playback-compression=[on|off]][,seamless-migration=[on|off]]\n"
     "       [,gl=[on|off]][,rendernode=<file>]\n"
@@ -2118,6 +2143,14 @@ SRST
     ``streaming-video=[off|all|filter]``
         Configure video stream detection. Default is off.
 
+    ``video-codecs=<encoder>:<codec>[;<encoder>:<codec>]``
+        Provide the preferred codecs for the video streams detected by
+        ``streaming-video``, in order of preference, for example
+        ``gstreamer:h264;spice:mjpeg``. The ``gstreamer`` encoder picks a
+        hardware accelerated element (VA-API, NVENC) when the host provides
+        one. Regions that are not detected as video keep using the lossless
+        image compression. Default is ``spice:mjpeg``.
+
     ``agent-mouse=[on|off]``
         Enable/disable passing mouse events via vdagent. Default is on.
 
@@ -2577,7 +2610,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_SLIRP
     "-netdev user,id=str[,ipv4=on|off][,net=addr[/mask]][,host=addr]\n"
     "         [,ipv6=on|off][,ipv6-net=addr[/int]][,ipv6-host=addr]\n"
-    "         [,restrict=on|off][,hostname=host][,dhcpstart=addr]\n"
+    "         [,restrict=on|off][,hostname=host][,dhcpstart=addr][,mtu=n]\n"
     "         [,dns=addr][,ipv6-dns=addr][,dnssearch=domain][,domainname=domain]\n"
     "         [,tftp=dir][,tftp-server-name=name][,bootfile=f][,hostfwd=rule][,guestfwd=rule]"
 #ifndef _WIN32
@@ -2593,7 +2626,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "-netdev tap,id=str[,fd=h][,fds=x:y:...:z][,ifname=name][,script=file][,downscript=dfile]\n"
     "         [,br=bridge][,helper=helper][,sndbuf=nbytes][,vnet_hdr=on|off][,vhost=on|off]\n"
     "         [,vhostfd=h][,vhostfds=x:y:...:z][,vhostforce=on|off][,queues=n]\n"
-    "         [,poll-us=n]\n"
+    "         [,poll-us=n][,tx-batch=on|off]\n"
     "                configure a host TAP network backend with ID 'str'\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
     "                use network scripts 'file' (default=" DEFAULT_NETWORK_SCRIPT ")\n"
@@ -2616,6 +2649,8 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                use 'queues=n' to specify the number of queues to be created for multiqueue TAP\n"
     "                use 'poll-us=n' to specify the maximum number of microseconds that could be\n"
     "                spent on busy polling for vhost net\n"
+    "                use 'tx-batch=on' to write packets from the guest to the TAP device in\n"
+    "                batches with io_uring instead of issuing one system call per packet\n"
     "-netdev bridge,id=str[,br=bridge][,helper=helper]\n"
     "                configure a host TAP network backend with ID 'str' that is\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
@@ -2670,6 +2705,15 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to the existing network interface 'name' with AF_XDP socket\n"
+    "                use 'mode=MODE' to specify an XDP program attach mode\n"
+    "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
+    "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
+    "                use 'start-queue=m' to specify the first queue that should be used\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2694,6 +2738,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -2723,7 +2770,7 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
     "                old way to initialize a host network interface\n"
     "                (use the -netdev option if possible instead)\n", QEMU_ARCH_ALL)
 SRST
-``-nic [tap|bridge|user|l2tpv3|vde|netmap|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
+``-nic [tap|bridge|user|l2tpv3|vde|netmap|af-xdp|vhost-user|socket][,...][,mac=macaddr][,model=mn]``
     This option is a shortcut for configuring both the on-board
     (default) guest NIC hardware and the host network backend in one go.
     The host backend options are the same as with the corresponding
@@ -2830,6 +2877,14 @@ SRST
         load boot files or configurations from a different server than
         the host address.
 
+    ``mtu=n``
+        Set the MTU and MRU of the link between the guest and the user
+        mode network stack (default 1500).  The guest must be configured
+        with the same MTU, for example with ``host_mtu=n`` on a
+        virtio-net device.  A large MTU such as 65520 lets the guest
+        send large TCP segments, which greatly reduces the per-packet
+        overhead of user mode networking.
+
     ``bootfile=file``
         When using the user mode network stack, broadcast file as the
         BOOTP filename. In conjunction with ``tftp``, this can be used
@@ -3137,6 +3192,28 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m]``
+    Configure AF_XDP backend to connect to a network interface 'name'
+    using AF_XDP socket.  A specific program attach mode for a default
+    XDP program can be forced with 'mode', defaults to best-effort,
+    where the likely most performant mode will be in use.  Number of
+    queues 'n' should generally match the number of queues in the
+    interface, defaults to 1.  Traffic arriving on non-configured device
+    queues will not be delivered to the network backend.  With
+    'queues=n', one AF_XDP socket is created per queue and the backend
+    is connected to 'n' queue pairs of a multiqueue frontend such as
+    virtio-net.  In native mode the kernel uses zero-copy between the
+    NIC and the socket's memory area if the driver supports it; use
+    'force-copy=on' to disable that.
+
+    .. parsed-literal::
+
+        # set number of queues to 4
+        ethtool -L eth0 combined 4
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1,mq=on \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=4
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -4339,6 +4416,8 @@ DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming exec:cmdline\n" \
     "                accept incoming migration on given file descriptor\n" \
     "                or from given external command\n" \
+    "-incoming file:filename\n" \
+    "                load the migration stream from the given file\n" \
     "-incoming defer\n" \
     "                wait for the URI to be specified via migrate_incoming\n",
     QEMU_ARCH_ALL)
@@ -4358,6 +4437,10 @@ SRST
     Accept incoming migration as an output from specified external
     command.
 
+``-incoming file:filename``
+    Load the incoming migration stream from the given file, as written
+    by ``migrate file:filename``.
+
 ``-incoming defer``
     Wait for the URI to be specified via migrate\_incoming. The monitor
     can be used to change settings (such as migration parameters) prior
@@ -4640,7 +4723,7 @@ SRST
     they are specified. Note that the 'id' property must be set. These
     objects are placed in the '/objects' path.
 
-    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,align=align,readonly=on|off``
+    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,thp=always|defer|never,align=align,readonly=on|off,rom=on|off|auto``
         Creates a memory file backend object, which can be used to back
         the guest RAM with huge pages.
 
@@ -4702,6 +4785,22 @@ SRST
             interleave memory allocations across the given host node
             list
 
+        The ``thp`` option sets the transparent huge page policy for the
+        memory to one of the following values (it has no effect on
+        hugetlbfs):
+
+        ``always``
+            advise the host to use transparent huge pages (MADV\_HUGEPAGE),
+            this is the default
+
+        ``defer``
+            follow the host's system-wide settings, so that huge pages
+            are not compacted at fault time but can be collapsed later by
+            khugepaged
+
+        ``never``
+            do not use transparent huge pages (MADV\_NOHUGEPAGE)
+
         The ``align`` option specifies the base address alignment when
         QEMU mmap(2) ``mem-path``, and accepts common suffixes, eg
         ``2M``. Some backend store specified by ``mem-path`` requires an
@@ -4726,14 +4825,23 @@ SRST
         The ``readonly`` option specifies whether the backing file is opened
         read-only or read-write (default).
 
-    ``-object memory-backend-ram,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave``
+        The ``rom`` option specifies whether to create Read Only Memory
+        (ROM) that cannot be modified by the VM. With the default ``auto``
+        it follows ``readonly``. ``readonly=on,rom=off,share=off`` opens
+        the file read-only but maps it private and writable: guest writes
+        go to copy-on-write anonymous memory and the file is left
+        untouched. Combined with the ``x-ignore-shared`` migration
+        capability this allows quickly starting many VMs from a single
+        template memory file while sharing its unmodified pages.
+
+    ``-object memory-backend-ram,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave,thp=always|defer|never``
         Creates a memory backend object, which can be used to back the
         guest RAM. Memory backend objects offer more control than the
         ``-m`` option that is traditionally used to define guest RAM.
         Please refer to ``memory-backend-file`` for a description of the
         options.
 
-    ``-object memory-backend-memfd,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave,seal=on|off,hugetlb=on|off,hugetlbsize=size``
+    ``-object memory-backend-memfd,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave,thp=always|defer|never,seal=on|off,hugetlb=on|off,hugetlbsize=size``
         Creates an anonymous memory file backend object, which allows
         QEMU to share the memory with an external process (e.g. when
         using vhost-user). The memory is allocated with memfd and
@@ -4824,7 +4932,7 @@ SRST
         recommended that a persistent set of parameters be generated up
         front and saved.
 
-    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id``
+    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id,ktls=on|off``
         Creates a TLS anonymous credentials object, which can be used to
         provide TLS support on network backends. The ``id`` parameter is
         a unique ID which network backends will use to access the
@@ -4868,6 +4976,13 @@ SRST
         string as described at
         https://gnutls.org/manual/html_node/Priority-Strings.html.
 
+        If ``ktls`` is enabled (default off), then once the handshake is
+        completed on a TCP socket, the encryption of outgoing data is
+        offloaded to the Linux kernel TLS implementation, when the host
+        supports it and an AES-GCM cipher suite was negotiated. Incoming
+        data is still decrypted by gnutls. The peer must not request
+        TLS 1.3 key updates, which QEMU never does.
+
     ``-object tls-cipher-suites,id=id,priority=priority``
         Creates a TLS cipher suites object, which can be used to control
         the TLS cipher/protocol algorithms that applications are permitted
@@ -4972,11 +5087,18 @@ SRST
         filter-redirector,id=f2,netdev=hn0,queue=rx,outdev=red1 -object
         filter-rewriter,id=rew0,netdev=hn0,queue=all
 
-    ``-object filter-dump,id=id,netdev=dev[,file=filename][,maxlen=len][,position=head|tail|id=<id>][,insert=behind|before]``
+    ``-object filter-dump,id=id,netdev=dev[,file=filename][,maxlen=len][,sample=n][,buffer-size=size][,position=head|tail|id=<id>][,insert=behind|before]``
         Dump the network traffic on netdev dev to the file specified by
         filename. At most len bytes (64k by default) per packet are
-        stored. The file format is libpcap, so it can be analyzed with
-        tools such as tcpdump or Wireshark.
+        stored; a small len such as 128 only captures the headers. The
+        file format is libpcap, so it can be analyzed with tools such as
+        tcpdump or Wireshark.
+
+        With ``sample=n`` only one out of every n packets is dumped.
+        With ``buffer-size=size``, packets are copied into an in-memory
+        buffer of that size and written to the file by a separate thread,
+        so that the packet path does not wait for the file; packets that
+        do not fit into the buffer are dropped from the dump and counted.
 
     ``-object colo-compare,id=id,primary_in=chardevid,secondary_in=chardevid,outdev=chardevid,iothread=id[,vnet_hdr_support][,notify_dev=id][,compare_timeout=@var{ms}][,expired_scan_cycle=@var{ms}][,max_queue_size=@var{size}]``
         Colo-compare gets packet from primary\_in chardevid and
@@ -5362,6 +5484,15 @@ SRST
         the polling time when the algorithm detects it is spending too
         long polling without encountering events.
 
+        For virtio devices with ``iothread=id`` the event loop polls the
+        virtqueues' available rings directly. While it polls, guest
+        notifications are suppressed, so the guest does not write to the
+        notify register and no ioeventfd wakeup happens. Notifications
+        are re-enabled when polling stops, so an idle IOThread falls back
+        to the ioeventfd. A ``poll-max-ns`` value larger than the typical
+        gap between requests keeps a busy queue entirely in polling mode,
+        at the cost of a host CPU.
+
         The ``aio-max-batch`` parameter is the maximum number of requests
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
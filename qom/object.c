@@ -1056,10 +1056,37 @@ typedef struct OCFData
 {
     void (*fn)(ObjectClass *klass, void *opaque);
     const char *implements_type;
+    TypeImpl *target_type;
     bool include_abstract;
     void *opaque;
 } OCFData;
 
+/*
+ * Whether @type can implement @target_type, looking only at the type
+ * names so that @type does not need to be initialized: @target_type must
+ * be an ancestor of @type, or of an interface declared by @type or by
+ * one of its ancestors.
+ */
+static bool type_may_implement(TypeImpl *type, TypeImpl *target_type)
+{
+    TypeImpl *iface;
+    int i;
+
+    for (; type; type = type_get_parent(type)) {
+        if (type == target_type) {
+            return true;
+        }
+        for (i = 0; i < type->num_interfaces; i++) {
+            iface = type_get_by_name(type->interfaces[i].typename);
+            /* An unknown interface makes type_initialize() complain */
+            if (!iface || type_is_ancestor(iface, target_type)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void object_class_foreach_tramp(gpointer key, gpointer value,
                                        gpointer opaque)
 {
@@ -1067,6 +1094,15 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
+    /*
+     * Listing the subclasses of one type must not run class_init for
+     * every type in the binary, most of which will never be used.
+     */
+    if (data->implements_type &&
+        (!data->target_type || !type_may_implement(type, data->target_type))) {
+        return;
+    }
+
     type_initialize(type);
     k = type->class;
 
@@ -1086,7 +1122,14 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
                           const char *implements_type, bool include_abstract,
                           void *opaque)
 {
-    OCFData data = { fn, implements_type, include_abstract, opaque };
+    OCFData data = {
+        .fn = fn,
+        .implements_type = implements_type,
+        .target_type = implements_type ? type_get_by_name(implements_type)
+                                       : NULL,
+        .include_abstract = include_abstract,
+        .opaque = opaque,
+    };
 
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
@@ -1331,18 +1374,20 @@ void object_class_property_iter_init(ObjectPropertyIterator *iter,
 
 ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name)
 {
-    ObjectClass *parent_klass;
+    ObjectProperty *prop;
 
-    parent_klass = object_class_get_parent(klass);
-    if (parent_klass) {
-        ObjectProperty *prop =
-            object_class_property_find(parent_klass, name);
+    /*
+     * A name is never registered both in a class and in one of its
+     * ancestors, so the classes can be searched in any order.  Most
+     * lookups are for properties of the concrete type, look there first.
+     */
+    for (; klass; klass = object_class_get_parent(klass)) {
+        prop = g_hash_table_lookup(klass->properties, name);
         if (prop) {
             return prop;
         }
     }
-
-    return g_hash_table_lookup(klass->properties, name);
+    return NULL;
 }
 
 ObjectProperty *object_class_property_find_err(ObjectClass *klass,
@@ -19,6 +19,7 @@
 #include "qemu/option.h"
 #include "sysemu/cpus.h"
 #include "qemu/error-report.h"
+#include "qemu/units.h"
 
 /* Current version of the replay mechanism.
    Increase it when file format changes. */
@@ -31,6 +32,9 @@ char *replay_snapshot;
 
 /* Name of replay file  */
 static char *replay_filename;
+/* Larger than the stdio default, so that the log is written in big blocks */
+#define REPLAY_FILE_BUFFER_SIZE (1 * MiB)
+static char *replay_file_buffer;
 ReplayState replay_state;
 static GSList *replay_blockers;
 
@@ -264,6 +268,8 @@ static void replay_enable(const char *fname, int mode)
         fprintf(stderr, "Replay: open %s: %s\n", fname, strerror(errno));
         exit(1);
     }
+    replay_file_buffer = g_malloc(REPLAY_FILE_BUFFER_SIZE);
+    setvbuf(replay_file, replay_file_buffer, _IOFBF, REPLAY_FILE_BUFFER_SIZE);
 
     replay_filename = g_strdup(fname);
     replay_mode = mode;
@@ -379,6 +385,8 @@ void replay_finish(void)
         fclose(replay_file);
         replay_file = NULL;
     }
+    g_free(replay_file_buffer);
+    replay_file_buffer = NULL;
     if (replay_filename) {
         g_free(replay_filename);
         replay_filename = NULL;
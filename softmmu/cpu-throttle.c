@@ -38,20 +38,49 @@ static unsigned int throttle_percentage;
 #define CPU_THROTTLE_PCT_MAX 99
 #define CPU_THROTTLE_TIMESLICE_NS 10000000
 
+/*
+ * The throttle in effect for @cpu: its own one if it has been set with
+ * cpu_throttle_set_vcpu(), or the global one if that is higher.
+ */
+static int cpu_throttle_vcpu_effective(CPUState *cpu)
+{
+    return MAX(cpu_throttle_get_percentage(),
+               cpu_throttle_get_vcpu_percentage(cpu));
+}
+
+/* The highest throttle applied to any vcpu, it sets the timer period */
+static int cpu_throttle_max_percentage(void)
+{
+    CPUState *cpu;
+    int pct = cpu_throttle_get_percentage();
+
+    CPU_FOREACH(cpu) {
+        pct = MAX(pct, cpu_throttle_get_vcpu_percentage(cpu));
+    }
+    return pct;
+}
+
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
-    double pct;
-    double throttle_ratio;
+    double pct, max_pct;
     int64_t sleeptime_ns, endtime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    if (!cpu_throttle_vcpu_effective(cpu)) {
+        qatomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage() / 100;
-    throttle_ratio = pct / (1 - pct);
-    /* Add 1ns to fix double's rounding error (like 0.9999999...) */
-    sleeptime_ns = (int64_t)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS + 1);
+    pct = (double)cpu_throttle_vcpu_effective(cpu) / 100;
+    max_pct = (double)MAX(cpu_throttle_max_percentage(),
+                          cpu_throttle_vcpu_effective(cpu)) / 100;
+    /*
+     * The timer fires every CPU_THROTTLE_TIMESLICE_NS / (1 - max_pct), sleep
+     * for our share of that period.  When every vcpu uses the same
+     * percentage this is CPU_THROTTLE_TIMESLICE_NS * pct / (1 - pct).
+     * Add 1ns to fix double's rounding error (like 0.9999999...)
+     */
+    sleeptime_ns = (int64_t)(pct / (1 - max_pct) * CPU_THROTTLE_TIMESLICE_NS
+                             + 1);
     endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
     while (sleeptime_ns > 0 && !cpu->stop) {
         if (sleeptime_ns > SCALE_MS) {
@@ -73,17 +102,20 @@ static void cpu_throttle_timer_tick(void *opaque)
     double pct;
 
     /* Stop the timer if needed */
-    if (!cpu_throttle_get_percentage()) {
+    if (!cpu_throttle_max_percentage()) {
         return;
     }
     CPU_FOREACH(cpu) {
+        if (!cpu_throttle_vcpu_effective(cpu)) {
+            continue;
+        }
         if (!qatomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
                              RUN_ON_CPU_NULL);
         }
     }
 
-    pct = (double)cpu_throttle_get_percentage() / 100;
+    pct = (double)cpu_throttle_max_percentage() / 100;
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
                                    CPU_THROTTLE_TIMESLICE_NS / (1 - pct));
 }
@@ -94,7 +126,7 @@ void cpu_throttle_set(int new_throttle_pct)
      * boolean to store whether throttle is already active or not,
      * before modifying throttle_percentage
      */
-    bool throttle_active = cpu_throttle_active();
+    bool throttle_active = cpu_throttle_max_percentage() != 0;
 
     /* Ensure throttle percentage is within valid range */
     new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
@@ -107,9 +139,30 @@ void cpu_throttle_set(int new_throttle_pct)
     }
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    bool throttle_active = cpu_throttle_max_percentage() != 0;
+
+    if (new_throttle_pct) {
+        new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+        new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
+    }
+
+    qatomic_set(&cpu->throttle_percentage, new_throttle_pct);
+
+    if (!throttle_active && new_throttle_pct) {
+        cpu_throttle_timer_tick(NULL);
+    }
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     qatomic_set(&throttle_percentage, 0);
+    CPU_FOREACH(cpu) {
+        qatomic_set(&cpu->throttle_percentage, 0);
+    }
 }
 
 bool cpu_throttle_active(void)
@@ -122,6 +175,23 @@ int cpu_throttle_get_percentage(void)
     return qatomic_read(&throttle_percentage);
 }
 
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    return qatomic_read(&cpu->throttle_percentage);
+}
+
+bool cpu_throttle_vcpu_active(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu_throttle_get_vcpu_percentage(cpu)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void cpu_throttle_init(void)
 {
     throttle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
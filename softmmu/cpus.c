@@ -34,6 +34,7 @@
 #include "sysemu/hw_accel.h"
 #include "exec/exec-all.h"
 #include "qemu/thread.h"
+#include "qemu/timer.h"
 #include "qemu/plugin.h"
 #include "sysemu/cpus.h"
 #include "qemu/guest-random.h"
@@ -44,6 +45,7 @@
 #include "sysemu/whpx.h"
 #include "hw/boards.h"
 #include "hw/hw.h"
+#include "sysemu/numa.h"
 #include "trace.h"
 
 #ifdef CONFIG_LINUX
@@ -476,6 +478,44 @@ bool qemu_in_vcpu_thread(void)
 
 static __thread bool iothread_locked = false;
 
+/*
+ * When the synchronization profiler is enabled, BQL hold times are
+ * accounted to the call site that took the lock.  Holds longer than
+ * BQL_LONG_HOLD_NS are also traced.
+ */
+#define BQL_LONG_HOLD_NS (10 * SCALE_MS)
+
+static __thread int64_t iothread_locked_since;
+static __thread const char *iothread_lock_file;
+static __thread int iothread_lock_line;
+
+static void bql_hold_begin(const char *file, int line)
+{
+    if (qsp_is_enabled()) {
+        iothread_locked_since = get_clock();
+        iothread_lock_file = file;
+        iothread_lock_line = line;
+    }
+}
+
+static void bql_hold_end(void)
+{
+    int64_t ns;
+
+    if (!iothread_locked_since) {
+        return;
+    }
+
+    ns = get_clock() - iothread_locked_since;
+    iothread_locked_since = 0;
+    qsp_bql_hold_record(&qemu_global_mutex, iothread_lock_file,
+                        iothread_lock_line, ns);
+    if (ns >= BQL_LONG_HOLD_NS) {
+        trace_qemu_mutex_iothread_long_hold(iothread_lock_file,
+                                            iothread_lock_line, ns);
+    }
+}
+
 bool qemu_mutex_iothread_locked(void)
 {
     return iothread_locked;
@@ -492,23 +532,36 @@ void qemu_mutex_lock_iothread_impl(const char *file, int line)
     g_assert(!qemu_mutex_iothread_locked());
     bql_lock(&qemu_global_mutex, file, line);
     iothread_locked = true;
+    bql_hold_begin(file, line);
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
     g_assert(qemu_mutex_iothread_locked());
+    bql_hold_end();
     iothread_locked = false;
     qemu_mutex_unlock(&qemu_global_mutex);
 }
 
+/* The BQL is not held while waiting, so keep that out of the hold time */
 void qemu_cond_wait_iothread(QemuCond *cond)
 {
+    const char *file = iothread_lock_file;
+    int line = iothread_lock_line;
+
+    bql_hold_end();
     qemu_cond_wait(cond, &qemu_global_mutex);
+    bql_hold_begin(file, line);
 }
 
 void qemu_cond_timedwait_iothread(QemuCond *cond, int ms)
 {
+    const char *file = iothread_lock_file;
+    int line = iothread_lock_line;
+
+    bql_hold_end();
     qemu_cond_timedwait(cond, &qemu_global_mutex, ms);
+    bql_hold_begin(file, line);
 }
 
 /* signal CPU creation */
@@ -632,6 +685,8 @@ void qemu_init_vcpu(CPUState *cpu)
     while (!cpu->created) {
         qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
     }
+
+    numa_set_vcpu_affinity(ms, cpu);
 }
 
 void cpu_stop_current(void)
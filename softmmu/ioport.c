@@ -287,6 +287,31 @@ void portio_list_add(PortioList *piolist,
     portio_list_add_1(piolist, pio_start, count, start, off_low, off_high);
 }
 
+/*
+ * Let the accelerator batch writes to the @len ports starting at @addr,
+ * which must be within one of the regions created by portio_list_add().
+ * This is only correct for ports whose writes have no side effect but
+ * latching a value, e.g. index registers; the list should also be set
+ * to flush coalesced writes, so that they are replayed before any other
+ * access to its ports.
+ */
+void portio_list_add_coalescing(PortioList *piolist, uint32_t addr,
+                                uint32_t len)
+{
+    unsigned i;
+
+    for (i = 0; i < piolist->nr; ++i) {
+        MemoryRegion *mr = piolist->regions[i];
+        hwaddr end = mr->addr + memory_region_size(mr);
+
+        if (addr >= mr->addr && addr + len <= end) {
+            memory_region_add_coalescing(mr, addr - mr->addr, len);
+            return;
+        }
+    }
+    g_assert_not_reached();
+}
+
 void portio_list_del(PortioList *piolist)
 {
     MemoryRegionPortioList *mrpio;
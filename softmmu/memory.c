@@ -22,6 +22,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/qemu-print.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "trace.h"
 
@@ -39,6 +40,7 @@
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
+static bool mmio_stats_enabled;
 bool global_dirty_log;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
@@ -724,11 +726,41 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+/*
+ * Unlike flatrange_equal(), this also compares the dirty log masks, so
+ * that a view is only considered unchanged if the memory listeners have
+ * nothing to do for it.
+ */
+static bool flatview_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i]) ||
+            a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render a memory topology into a list of disjoint absolute ranges.
+ *
+ * If @old_views has a view for @mr with exactly the same ranges, that
+ * view is reused instead of building a new dispatch tree for it.  Most
+ * transactions only touch one address space (for example a PCI device
+ * enabling bus mastering or moving a BAR), so this leaves the views of
+ * all the other address spaces untouched.
+ */
+static FlatView *generate_memory_topology(MemoryRegion *mr,
+                                          GHashTable *old_views)
 {
     int i;
-    FlatView *view;
+    FlatView *view, *old_view;
 
     view = flatview_new(mr);
 
@@ -739,6 +771,15 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    old_view = old_views ? g_hash_table_lookup(old_views, mr) : NULL;
+    if (old_view && flatview_equal(view, old_view)) {
+        trace_flatview_reuse(old_view, mr);
+        flatview_unref(view);
+        flatview_ref(old_view);
+        g_hash_table_replace(flat_views, mr, old_view);
+        return old_view;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -992,7 +1033,7 @@ static void flatviews_init(void)
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
     if (!empty_view) {
-        empty_view = generate_memory_topology(NULL);
+        empty_view = generate_memory_topology(NULL, NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
@@ -1003,12 +1044,10 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
@@ -1019,11 +1058,16 @@ static void flatviews_reset(void)
             continue;
         }
 
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, old_views);
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
 }
 
-static void address_space_set_flatview(AddressSpace *as)
+/* Returns true if the address space now uses a different FlatView.  */
+static bool address_space_set_flatview(AddressSpace *as)
 {
     FlatView *old_view = address_space_to_flatview(as);
     MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
@@ -1032,7 +1076,16 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
-        return;
+        /*
+         * The view was reused, but listeners such as vhost rebuild their
+         * state from scratch between begin and commit and expect to see
+         * every section again, as region_nop.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, false);
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
+        return false;
     }
 
     if (old_view) {
@@ -1066,6 +1119,7 @@ static void address_space_set_flatview(AddressSpace *as)
     if (old_view) {
         flatview_unref(old_view);
     }
+    return true;
 }
 
 static void address_space_update_topology(AddressSpace *as)
@@ -1074,7 +1128,7 @@ static void address_space_update_topology(AddressSpace *as)
 
     flatviews_init();
     if (!g_hash_table_lookup(flat_views, physmr)) {
-        generate_memory_topology(physmr);
+        generate_memory_topology(physmr, NULL);
     }
     address_space_set_flatview(as);
 }
@@ -1100,8 +1154,14 @@ void memory_region_transaction_commit(void)
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
-                address_space_set_flatview(as);
-                address_space_update_ioeventfds(as);
+                /*
+                 * The ioeventfds can only have changed if the view did,
+                 * or if some region's ioeventfd list was modified.
+                 */
+                if (address_space_set_flatview(as) ||
+                    ioeventfd_update_pending) {
+                    address_space_update_ioeventfds(as);
+                }
             }
             memory_region_update_pending = false;
             ioeventfd_update_pending = false;
@@ -1435,6 +1495,21 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
     }
 }
 
+static inline int64_t mmio_stats_start(void)
+{
+    return unlikely(qatomic_read(&mmio_stats_enabled)) ? get_clock() : 0;
+}
+
+static inline void mmio_stats_account(MemoryRegion *mr, bool is_write,
+                                      int64_t start)
+{
+    if (likely(!start)) {
+        return;
+    }
+    stat64_add(is_write ? &mr->mmio_writes : &mr->mmio_reads, 1);
+    stat64_add(&mr->mmio_time_ns, get_clock() - start);
+}
+
 MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         hwaddr addr,
                                         uint64_t *pval,
@@ -1442,6 +1517,7 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
+    int64_t start;
     MemTxResult r;
 
     if (!memory_region_access_valid(mr, addr, size, false, attrs)) {
@@ -1449,8 +1525,10 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
+    start = mmio_stats_start();
     r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
     adjust_endianness(mr, pval, op);
+    mmio_stats_account(mr, false, start);
     return r;
 }
 
@@ -1480,19 +1558,14 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
-MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
-                                         hwaddr addr,
-                                         uint64_t data,
-                                         MemOp op,
-                                         MemTxAttrs attrs)
+static MemTxResult memory_region_dispatch_write1(MemoryRegion *mr,
+                                                 hwaddr addr,
+                                                 uint64_t data,
+                                                 MemOp op,
+                                                 MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
 
-    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
-        unassigned_mem_write(mr, addr, data, size);
-        return MEMTX_DECODE_ERROR;
-    }
-
     adjust_endianness(mr, &data, op);
 
     if ((!kvm_eventfds_enabled()) &&
@@ -1516,6 +1589,27 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
     }
 }
 
+MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         uint64_t data,
+                                         MemOp op,
+                                         MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    int64_t start;
+    MemTxResult r;
+
+    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
+        unassigned_mem_write(mr, addr, data, size);
+        return MEMTX_DECODE_ERROR;
+    }
+
+    start = mmio_stats_start();
+    r = memory_region_dispatch_write1(mr, addr, data, op, attrs);
+    mmio_stats_account(mr, true, start);
+    return r;
+}
+
 void memory_region_init_io(MemoryRegion *mr,
                            Object *owner,
                            const MemoryRegionOps *ops,
@@ -3327,6 +3421,118 @@ void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
     }
 }
 
+void mmio_stats_enable(void)
+{
+    qatomic_set(&mmio_stats_enabled, true);
+}
+
+void mmio_stats_disable(void)
+{
+    qatomic_set(&mmio_stats_enabled, false);
+}
+
+bool mmio_stats_is_enabled(void)
+{
+    return qatomic_read(&mmio_stats_enabled);
+}
+
+typedef void (*MMIOStatsFunc)(MemoryRegion *mr, void *opaque);
+
+static void mmio_stats_walk_mr(MemoryRegion *mr, GHashTable *seen,
+                               MMIOStatsFunc func, void *opaque)
+{
+    MemoryRegion *submr;
+
+    if (!mr || g_hash_table_contains(seen, mr)) {
+        return;
+    }
+    g_hash_table_add(seen, mr);
+
+    func(mr, opaque);
+    mmio_stats_walk_mr(mr->alias, seen, func, opaque);
+    QTAILQ_FOREACH(submr, &mr->subregions, subregions_link) {
+        mmio_stats_walk_mr(submr, seen, func, opaque);
+    }
+}
+
+/* Call @func once for every region reachable from an address space */
+static void mmio_stats_walk(MMIOStatsFunc func, void *opaque)
+{
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    AddressSpace *as;
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        mmio_stats_walk_mr(as->root, seen, func, opaque);
+    }
+    g_hash_table_unref(seen);
+}
+
+static void mmio_stats_reset_mr(MemoryRegion *mr, void *opaque)
+{
+    stat64_init(&mr->mmio_reads, 0);
+    stat64_init(&mr->mmio_writes, 0);
+    stat64_init(&mr->mmio_time_ns, 0);
+}
+
+void mmio_stats_reset(void)
+{
+    mmio_stats_walk(mmio_stats_reset_mr, NULL);
+}
+
+static void mmio_stats_collect_mr(MemoryRegion *mr, void *opaque)
+{
+    GPtrArray *regions = opaque;
+
+    if (stat64_get(&mr->mmio_reads) || stat64_get(&mr->mmio_writes)) {
+        g_ptr_array_add(regions, mr);
+    }
+}
+
+static gint mmio_stats_cmp(gconstpointer a, gconstpointer b)
+{
+    MemoryRegion *mra = *(MemoryRegion **)a;
+    MemoryRegion *mrb = *(MemoryRegion **)b;
+    uint64_t ta = stat64_get(&mra->mmio_time_ns);
+    uint64_t tb = stat64_get(&mrb->mmio_time_ns);
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void mmio_stats_info(int64_t max)
+{
+    GPtrArray *regions = g_ptr_array_new();
+    guint i;
+
+    mmio_stats_walk(mmio_stats_collect_mr, regions);
+    g_ptr_array_sort(regions, mmio_stats_cmp);
+
+    qemu_printf("%-32s %-24s %12s %12s %14s %10s\n", "region", "owner",
+                "reads", "writes", "total (us)", "avg (ns)");
+    for (i = 0; i < regions->len && i < max; i++) {
+        MemoryRegion *mr = g_ptr_array_index(regions, i);
+        uint64_t reads = stat64_get(&mr->mmio_reads);
+        uint64_t writes = stat64_get(&mr->mmio_writes);
+        uint64_t ns = stat64_get(&mr->mmio_time_ns);
+        Object *owner = mr->owner;
+        DeviceState *dev = (DeviceState *)object_dynamic_cast(owner,
+                                                              TYPE_DEVICE);
+        g_autofree char *owner_name = NULL;
+
+        if (dev && dev->id) {
+            owner_name = g_strdup(dev->id);
+        } else if (owner) {
+            owner_name = g_strdup(object_get_typename(owner));
+        }
+
+        qemu_printf("%-32s %-24s %12" PRIu64 " %12" PRIu64 " %14.1f %10"
+                    PRIu64 "\n", memory_region_name(mr),
+                    owner_name ?: "-", reads, writes, ns / 1000.0,
+                    ns / (reads + writes));
+    }
+
+    g_ptr_array_unref(regions);
+}
+
 void memory_region_init_ram(MemoryRegion *mr,
                             Object *owner,
                             const char *name,
@@ -1156,6 +1156,12 @@ int hvf_vcpu_exec(CPUState *cpu)
                              hvf_exit->exception.physical_address, isv,
                              iswrite, s1ptw, len, srt);
 
+        /* A write to RAM that is being logged, retry it once unprotected */
+        if (iswrite &&
+            hvf_log_dirty_write(hvf_exit->exception.physical_address)) {
+            break;
+        }
+
         assert(isv);
 
         if (iswrite) {
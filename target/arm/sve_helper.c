@@ -191,6 +191,16 @@ LOGICAL_PPPP(sve_nand_pppp, DO_NAND)
 #undef DO_SEL
 #undef LOGICAL_PPPP
 
+/*
+ * The predicate bits that govern a 16-byte segment of elements of
+ * SZ bytes.  When all of them are set the segment is processed
+ * without testing each element, which the compiler can unroll and
+ * vectorize; predicates produced by PTRUE or by a WHILE comparison
+ * that has not reached the end are all-active almost everywhere.
+ */
+#define PRED_SEG_MASK(SZ) \
+    ((SZ) == 1 ? 0xffff : (SZ) == 2 ? 0x5555 : (SZ) == 4 ? 0x1111 : 0x0101)
+
 /* Fully general three-operand expander, controlled by a predicate.
  * This is complicated by the host-endian storage of the register file.
  */
@@ -205,6 +215,16 @@ void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc) \
     intptr_t i, opr_sz = simd_oprsz(desc);                              \
     for (i = 0; i < opr_sz; ) {                                         \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));                 \
+        if ((pg & PRED_SEG_MASK(sizeof(TYPE))) ==                       \
+            PRED_SEG_MASK(sizeof(TYPE))) {                              \
+            do {                                                        \
+                TYPE nn = *(TYPE *)(vn + H(i));                         \
+                TYPE mm = *(TYPE *)(vm + H(i));                         \
+                *(TYPE *)(vd + H(i)) = OP(nn, mm);                      \
+                i += sizeof(TYPE);                                      \
+            } while (i & 15);                                           \
+            continue;                                                   \
+        }                                                               \
         do {                                                            \
             if (pg & 1) {                                               \
                 TYPE nn = *(TYPE *)(vn + H(i));                         \
@@ -853,6 +873,15 @@ void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
     intptr_t i, opr_sz = simd_oprsz(desc);                      \
     for (i = 0; i < opr_sz; ) {                                 \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));         \
+        if ((pg & PRED_SEG_MASK(sizeof(TYPE))) ==               \
+            PRED_SEG_MASK(sizeof(TYPE))) {                      \
+            do {                                                \
+                TYPE nn = *(TYPE *)(vn + H(i));                 \
+                *(TYPE *)(vd + H(i)) = OP(nn);                  \
+                i += sizeof(TYPE);                              \
+            } while (i & 15);                                   \
+            continue;                                           \
+        }                                                       \
         do {                                                    \
             if (pg & 1) {                                       \
                 TYPE nn = *(TYPE *)(vn + H(i));                 \
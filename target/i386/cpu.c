@@ -4271,6 +4271,7 @@ static void max_x86_cpu_initfn(Object *obj)
 static const TypeInfo max_x86_cpu_type_info = {
     .name = X86_CPU_TYPE_NAME("max"),
     .parent = TYPE_X86_CPU,
+    .instance_align = __alignof__(X86CPU),
     .instance_init = max_x86_cpu_initfn,
     .class_init = max_x86_cpu_class_init,
 };
@@ -5126,6 +5127,7 @@ static void x86_register_cpu_model_type(const char *name, X86CPUModel *model)
     TypeInfo ti = {
         .name = typename,
         .parent = TYPE_X86_CPU,
+        .instance_align = __alignof__(X86CPU),
         .class_init = x86_cpu_cpudef_class_init,
         .class_data = model,
     };
@@ -7009,6 +7011,7 @@ static const TypeInfo x86_cpu_type_info = {
     .name = TYPE_X86_CPU,
     .parent = TYPE_CPU,
     .instance_size = sizeof(X86CPU),
+    .instance_align = __alignof__(X86CPU),
     .instance_init = x86_cpu_initfn,
     .instance_post_init = x86_cpu_post_initfn,
 
@@ -7031,6 +7034,7 @@ static void x86_cpu_base_class_init(ObjectClass *oc, void *data)
 static const TypeInfo x86_base_cpu_type_info = {
         .name = X86_CPU_TYPE_NAME("base"),
         .parent = TYPE_X86_CPU,
+        .instance_align = __alignof__(X86CPU),
         .class_init = x86_cpu_base_class_init,
 };
 
@@ -196,6 +196,7 @@ static void host_cpu_class_init(ObjectClass *oc, void *data)
 static const TypeInfo host_cpu_type_info = {
     .name = X86_CPU_TYPE_NAME("host"),
     .parent = X86_CPU_TYPE_NAME("max"),
+    .instance_align = __alignof__(X86CPU),
     .class_init = host_cpu_class_init,
 };
 
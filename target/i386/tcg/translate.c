@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg-op.h"
+#include "tcg/tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -3105,6 +3106,98 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
     [0xdf] = AESNI_OP(aeskeygenassist),
 };
 
+typedef void (*SSEGVecFn)(unsigned vece, uint32_t dofs, uint32_t aofs,
+                          uint32_t bofs, uint32_t oprsz, uint32_t maxsz);
+
+/*
+ * Expand the SSE2 integer and bitwise operations that map directly onto
+ * a tcg-op-gvec operation inline, so that the backend can emit host
+ * vector instructions instead of calling out to a helper.  Returns false
+ * if the operation has to go through sse_op_table1.
+ */
+static bool gen_sse_gvec(int b, int b1, int op1_offset, int op2_offset)
+{
+    SSEGVecFn fn;
+    TCGCond cond;
+    unsigned vece;
+
+    if (b1 != 1 && !(b1 == 0 && b >= 0x54 && b <= 0x57)) {
+        return false;
+    }
+
+    switch (b) {
+    case 0x54: /* andps, andpd */
+    case 0xdb: /* pand */
+        tcg_gen_gvec_and(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        return true;
+    case 0x55: /* andnps, andnpd */
+    case 0xdf: /* pandn */
+        tcg_gen_gvec_andc(MO_64, op1_offset, op2_offset, op1_offset, 16, 16);
+        return true;
+    case 0x56: /* orps, orpd */
+    case 0xeb: /* por */
+        tcg_gen_gvec_or(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        return true;
+    case 0x57: /* xorps, xorpd */
+    case 0xef: /* pxor */
+        tcg_gen_gvec_xor(MO_64, op1_offset, op1_offset, op2_offset, 16, 16);
+        return true;
+
+    case 0x64 ... 0x66: /* pcmpgt[bwd] */
+        cond = TCG_COND_GT;
+        vece = b - 0x64;
+        goto do_cmp;
+    case 0x74 ... 0x76: /* pcmpeq[bwd] */
+        cond = TCG_COND_EQ;
+        vece = b - 0x74;
+    do_cmp:
+        tcg_gen_gvec_cmp(cond, vece, op1_offset, op1_offset, op2_offset,
+                         16, 16);
+        return true;
+
+    case 0xd4: /* paddq */
+        fn = tcg_gen_gvec_add, vece = MO_64;
+        break;
+    case 0xfc ... 0xfe: /* padd[bwd] */
+        fn = tcg_gen_gvec_add, vece = b - 0xfc;
+        break;
+    case 0xfb: /* psubq */
+        fn = tcg_gen_gvec_sub, vece = MO_64;
+        break;
+    case 0xf8 ... 0xfa: /* psub[bwd] */
+        fn = tcg_gen_gvec_sub, vece = b - 0xf8;
+        break;
+    case 0xec ... 0xed: /* padds[bw] */
+        fn = tcg_gen_gvec_ssadd, vece = b - 0xec;
+        break;
+    case 0xdc ... 0xdd: /* paddus[bw] */
+        fn = tcg_gen_gvec_usadd, vece = b - 0xdc;
+        break;
+    case 0xe8 ... 0xe9: /* psubs[bw] */
+        fn = tcg_gen_gvec_sssub, vece = b - 0xe8;
+        break;
+    case 0xd8 ... 0xd9: /* psubus[bw] */
+        fn = tcg_gen_gvec_ussub, vece = b - 0xd8;
+        break;
+    case 0xda: /* pminub */
+        fn = tcg_gen_gvec_umin, vece = MO_8;
+        break;
+    case 0xde: /* pmaxub */
+        fn = tcg_gen_gvec_umax, vece = MO_8;
+        break;
+    case 0xea: /* pminsw */
+        fn = tcg_gen_gvec_smin, vece = MO_16;
+        break;
+    case 0xee: /* pmaxsw */
+        fn = tcg_gen_gvec_smax, vece = MO_16;
+        break;
+    default:
+        return false;
+    }
+    fn(vece, op1_offset, op1_offset, op2_offset, 16, 16);
+    return true;
+}
+
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start)
 {
@@ -4540,6 +4633,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, s->ptr0, s->ptr1, s->A0);
             break;
         default:
+            if (is_xmm && gen_sse_gvec(b, b1, op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -370,6 +370,39 @@ GEN_VEXT_ST_STRIDE(vsse_v_d, int64_t, int64_t, ste_d)
  *** unit-stride: access elements stored contiguously in memory
  */
 
+/*
+ * A unit-stride access with a single field, whose elements have the same
+ * size in memory and in the register, is a plain copy on a little-endian
+ * host.  Do it in one go when it lies within one page of host RAM; the
+ * pages have already been probed, so the TLB entry is valid.  Returns
+ * false if the caller has to fall back to the per-element loop.
+ */
+static bool vext_ldst_us_direct(CPURISCVState *env, void *vd,
+                                target_ulong base, uint32_t len,
+                                MMUAccessType access_type)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return false;
+#else
+    void *host;
+
+    if ((base & ~TARGET_PAGE_MASK) + len > TARGET_PAGE_SIZE) {
+        return false;
+    }
+    host = tlb_vaddr_to_host(env, base, access_type,
+                             cpu_mmu_index(env, false));
+    if (!host) {
+        return false;
+    }
+    if (access_type == MMU_DATA_LOAD) {
+        memcpy(vd, host, len);
+    } else {
+        memcpy(host, vd, len);
+    }
+    return true;
+#endif
+}
+
 /* unmasked unit-stride load and store operation*/
 static void
 vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
@@ -383,6 +416,10 @@ vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
 
     /* probe every access */
     probe_pages(env, base, env->vl * nf * msz, ra, access_type);
+    if (nf == 1 && esz == msz &&
+        vext_ldst_us_direct(env, vd, base, env->vl * esz, access_type)) {
+        goto clear;
+    }
     /* load bytes from guest memory */
     for (i = 0; i < env->vl; i++) {
         k = 0;
@@ -392,6 +429,7 @@ vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
             k++;
         }
     }
+ clear:
     /* clear tail elements */
     if (clear_elem) {
         for (k = 0; k < nf; k++) {
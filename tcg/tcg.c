@@ -1448,6 +1448,14 @@ bool tcg_op_supported(TCGOpcode op)
     }
 }
 
+const TCGHelperInfo *tcg_helper_info_lookup(void *func)
+{
+    const TCGHelperInfo *info = g_hash_table_lookup(helper_table, func);
+
+    tcg_debug_assert(info != NULL);
+    return info;
+}
+
 /* Note: we convert the 64 bit args to 32 bit and do some alignment
    and endian swap. Maybe it would be better to do the alignment
    and endian swap in tcg_reg_alloc_call(). */
@@ -3167,6 +3175,46 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Ahead of a helper call, move the value held in the call-clobbered
+ * register @reg into a free call-saved register, which costs a single
+ * move instead of a spill and a reload after the call.  Returns false
+ * if @reg holds a value and no suitable register is free.
+ */
+static bool tcg_reg_preserve(TCGContext *s, TCGReg reg,
+                             TCGRegSet allocated_regs)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+    int i;
+
+    if (ts == NULL) {
+        return true;
+    }
+
+    set = tcg_target_available_regs[ts->type]
+        & ~tcg_target_call_clobber_regs
+        & ~allocated_regs & ~s->reserved_regs;
+    if (set == 0) {
+        return false;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        TCGReg dst = tcg_target_reg_alloc_order[i];
+
+        if (s->reg_to_temp[dst] == NULL && tcg_regset_test_reg(set, dst)) {
+            if (!tcg_out_mov(s, ts->type, dst, reg)) {
+                return false;
+            }
+            s->reg_to_temp[reg] = NULL;
+            s->reg_to_temp[dst] = ts;
+            ts->reg = dst;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -3994,9 +4042,10 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
         }
     }
     
-    /* clobber call registers */
+    /* clobber call registers, keeping live values in call-saved ones */
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
-        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
+        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)
+            && !tcg_reg_preserve(s, i, allocated_regs)) {
             tcg_reg_free(s, i, allocated_regs);
         }
     }
@@ -0,0 +1,31 @@
+/*
+ * Reporting of benchmark results
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "bench-report.h"
+
+void bench_report(const char *name, const char *metric, const char *unit,
+                  double value)
+{
+    const char *path = g_getenv("QEMU_BENCH_JSON");
+    FILE *f;
+
+    g_test_message("%s: %s %.2f %s", name, metric, value, unit);
+
+    if (!path || !*path) {
+        return;
+    }
+    f = fopen(path, "a");
+    if (!f) {
+        g_test_message("cannot open %s: %s", path, strerror(errno));
+        return;
+    }
+    /* Names and units are plain identifiers, nothing needs escaping */
+    fprintf(f, "{\"bench\": \"%s\", \"metric\": \"%s\", \"unit\": \"%s\", "
+            "\"value\": %.6g}\n", name, metric, unit, value);
+    fclose(f);
+}
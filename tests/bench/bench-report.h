@@ -0,0 +1,24 @@
+/*
+ * Reporting of benchmark results
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#ifndef TESTS_BENCH_REPORT_H
+#define TESTS_BENCH_REPORT_H
+
+/*
+ * Print one result of benchmark @name as a test message.  If the
+ * QEMU_BENCH_JSON environment variable names a file, also append the
+ * result to it as a line of JSON:
+ *
+ *   {"bench": @name, "metric": @metric, "unit": @unit, "value": @value}
+ *
+ * so that results of different builds can be compared by scripts.
+ */
+void bench_report(const char *name, const char *metric, const char *unit,
+                  double value);
+
+#endif
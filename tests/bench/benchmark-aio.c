@@ -0,0 +1,98 @@
+/*
+ * QEMU AioContext and thread pool latency benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "block/aio.h"
+#include "block/thread-pool.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "bench-report.h"
+
+static AioContext *ctx;
+
+static void bh_cb(void *opaque)
+{
+    int *count = opaque;
+
+    (*count)++;
+}
+
+static void test_bh_speed(void)
+{
+    const int iterations = 1000000;
+    int count = 0;
+
+    /* schedule and run one BH at a time, the usual completion pattern */
+    g_test_timer_start();
+    while (count < iterations) {
+        aio_bh_schedule_oneshot(ctx, bh_cb, &count);
+        aio_poll(ctx, true);
+    }
+    g_test_timer_elapsed();
+
+    bench_report("aio/bh-schedule", "latency", "ns",
+                 g_test_timer_last() * 1e9 / iterations);
+}
+
+static int worker_cb(void *opaque)
+{
+    return 0;
+}
+
+static void done_cb(void *opaque, int ret)
+{
+    int *count = opaque;
+
+    (*count)++;
+}
+
+static void test_thread_pool_speed(const void *opaque)
+{
+    ThreadPool *pool = aio_get_thread_pool(ctx);
+    int depth = GPOINTER_TO_INT(opaque);
+    const int iterations = 200000;
+    g_autofree char *name = NULL;
+    int submitted = 0, count = 0;
+
+    /*
+     * Keep @depth requests in flight; the time per request includes the
+     * wakeup of a worker and the completion back in the AioContext.
+     */
+    g_test_timer_start();
+    while (count < iterations) {
+        while (submitted - count < depth && submitted < iterations) {
+            thread_pool_submit_aio(pool, worker_cb, NULL, done_cb, &count);
+            submitted++;
+        }
+        aio_poll(ctx, true);
+    }
+    g_test_timer_elapsed();
+
+    name = g_strdup_printf("thread-pool/submit-depth-%d", depth);
+    bench_report(name, "latency", "ns",
+                 g_test_timer_last() * 1e9 / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    static const int depths[] = { 1, 16, 64 };
+    char name[64];
+    int i;
+
+    qemu_init_main_loop(&error_abort);
+    ctx = qemu_get_current_aio_context();
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/aio/benchmark/bh-schedule", test_bh_speed);
+    for (i = 0; i < ARRAY_SIZE(depths); i++) {
+        snprintf(name, sizeof(name), "/thread-pool/benchmark/depth-%d",
+                 depths[i]);
+        g_test_add_data_func(name, GINT_TO_POINTER(depths[i]),
+                             test_thread_pool_speed);
+    }
+    return g_test_run();
+}
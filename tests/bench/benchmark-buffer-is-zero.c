@@ -0,0 +1,92 @@
+/*
+ * QEMU buffer_is_zero speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "qemu/iov.h"
+#include "bench-report.h"
+
+static void test_buffer_is_zero_speed(const void *opaque)
+{
+    size_t chunk_size = GPOINTER_TO_SIZE(opaque);
+    const size_t total = 8 * GiB;
+    g_autofree char *name = NULL;
+    size_t remain;
+    uint8_t *in;
+
+    /* zero buffers are the slow case, every byte has to be read */
+    in = g_malloc0(chunk_size);
+
+    g_test_timer_start();
+    remain = total;
+    while (remain) {
+        g_assert(buffer_is_zero(in, chunk_size));
+        remain -= chunk_size;
+    }
+    g_test_timer_elapsed();
+
+    name = g_strdup_printf("buffer-is-zero/chunk-%zu", chunk_size);
+    bench_report(name, "throughput", "MB/sec",
+                 total / MiB / g_test_timer_last());
+
+    g_free(in);
+}
+
+static void test_iov_is_zero_speed(const void *opaque)
+{
+    size_t chunk_size = GPOINTER_TO_SIZE(opaque);
+    const size_t total = 8 * GiB;
+    struct iovec iov[16];
+    g_autofree char *name = NULL;
+    size_t remain;
+    uint8_t *in;
+    int i;
+
+    /* a page split in 16 pieces, as with a scattered guest request */
+    in = g_malloc0(chunk_size);
+    for (i = 0; i < ARRAY_SIZE(iov); i++) {
+        iov[i].iov_base = in + i * (chunk_size / ARRAY_SIZE(iov));
+        iov[i].iov_len = chunk_size / ARRAY_SIZE(iov);
+    }
+
+    g_test_timer_start();
+    remain = total;
+    while (remain) {
+        g_assert(iov_is_zero(iov, ARRAY_SIZE(iov), 0, chunk_size));
+        remain -= chunk_size;
+    }
+    g_test_timer_elapsed();
+
+    name = g_strdup_printf("iov-is-zero/chunk-%zu", chunk_size);
+    bench_report(name, "throughput", "MB/sec",
+                 total / MiB / g_test_timer_last());
+
+    g_free(in);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 4 * KiB, 64 * KiB, 1 * MiB };
+    char name[64];
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        snprintf(name, sizeof(name), "/zero/benchmark/buffer/bufsize-%zu",
+                 sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]),
+                             test_buffer_is_zero_speed);
+        snprintf(name, sizeof(name), "/zero/benchmark/iov/bufsize-%zu",
+                 sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]),
+                             test_iov_is_zero_speed);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,71 @@
+/*
+ * QEMU coroutine speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "bench-report.h"
+
+#define ITERATIONS 1000000
+
+static void coroutine_fn empty_entry(void *opaque)
+{
+}
+
+static void test_coroutine_create_speed(void)
+{
+    Coroutine *co;
+    int i;
+
+    /* every iteration allocates from, and returns to, the pool */
+    g_test_timer_start();
+    for (i = 0; i < ITERATIONS; i++) {
+        co = qemu_coroutine_create(empty_entry, NULL);
+        qemu_coroutine_enter(co);
+    }
+    g_test_timer_elapsed();
+
+    bench_report("coroutine/create-enter", "latency", "ns",
+                 g_test_timer_last() * 1e9 / ITERATIONS);
+}
+
+static void coroutine_fn yield_loop(void *opaque)
+{
+    bool *done = opaque;
+
+    while (!*done) {
+        qemu_coroutine_yield();
+    }
+}
+
+static void test_coroutine_yield_speed(void)
+{
+    bool done = false;
+    Coroutine *co = qemu_coroutine_create(yield_loop, &done);
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < ITERATIONS; i++) {
+        qemu_coroutine_enter(co);
+    }
+    g_test_timer_elapsed();
+
+    done = true;
+    qemu_coroutine_enter(co);
+
+    bench_report("coroutine/enter-yield", "latency", "ns",
+                 g_test_timer_last() * 1e9 / ITERATIONS);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/coroutine/benchmark/create-enter",
+                    test_coroutine_create_speed);
+    g_test_add_func("/coroutine/benchmark/enter-yield",
+                    test_coroutine_yield_speed);
+    return g_test_run();
+}
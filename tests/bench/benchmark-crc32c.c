@@ -0,0 +1,59 @@
+/*
+ * QEMU CRC32C speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/crc32c.h"
+#include "bench-report.h"
+
+static void test_crc32c_speed(const void *opaque)
+{
+    size_t chunk_size = GPOINTER_TO_SIZE(opaque);
+    const size_t total = 2 * GiB;
+    size_t remain, i;
+    uint32_t crc = 0;
+    g_autofree char *name = NULL;
+    uint8_t *in;
+
+    in = g_new(uint8_t, chunk_size);
+    for (i = 0; i < chunk_size; i++) {
+        in[i] = g_test_rand_int();
+    }
+
+    g_test_timer_start();
+    remain = total;
+    while (remain) {
+        crc = crc32c(crc, in, chunk_size);
+        remain -= chunk_size;
+    }
+    g_test_timer_elapsed();
+
+    name = g_strdup_printf("crc32c/chunk-%zu", chunk_size);
+    bench_report(name, "throughput", "MB/sec",
+                 total / MiB / g_test_timer_last());
+    g_test_message("crc 0x%08x", crc);
+
+    g_free(in);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 512, 4 * KiB, 64 * KiB, 1 * MiB };
+    char name[64];
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        snprintf(name, sizeof(name), "/crc/benchmark/crc32c/bufsize-%zu",
+                 sizes[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(sizes[i]),
+                             test_crc32c_speed);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,87 @@
+/*
+ * QEMU HBitmap iteration speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/hbitmap.h"
+#include "bench-report.h"
+
+/* A 1 TiB disk with 64 KiB granularity, as for a dirty bitmap */
+#define BITMAP_SIZE     (1 * TiB)
+#define BITMAP_GRAN     16
+
+static void test_hbitmap_iter_speed(const void *opaque)
+{
+    uint64_t stride = GPOINTER_TO_SIZE(opaque);
+    HBitmap *hb = hbitmap_alloc(BITMAP_SIZE, BITMAP_GRAN);
+    g_autofree char *name = NULL;
+    uint64_t bits = 0, passes = 0;
+    HBitmapIter hbi;
+    uint64_t i;
+
+    for (i = 0; i < BITMAP_SIZE; i += stride) {
+        hbitmap_set(hb, i, 1);
+    }
+
+    g_test_timer_start();
+    do {
+        hbitmap_iter_init(&hbi, hb, 0);
+        while (hbitmap_iter_next(&hbi) >= 0) {
+            bits++;
+        }
+        passes++;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    name = g_strdup_printf("hbitmap/iter-stride-%" PRIu64, stride);
+    bench_report(name, "throughput", "Mbits/sec",
+                 bits / 1e6 / g_test_timer_last());
+    bench_report(name, "pass", "ms", g_test_timer_last() * 1e3 / passes);
+
+    hbitmap_free(hb);
+}
+
+static void test_hbitmap_next_dirty_speed(void)
+{
+    HBitmap *hb = hbitmap_alloc(BITMAP_SIZE, BITMAP_GRAN);
+    uint64_t lookups = 0;
+    int64_t off;
+
+    /* a single dirty cluster at the end: the sparse worst case */
+    hbitmap_set(hb, BITMAP_SIZE - 1, 1);
+
+    g_test_timer_start();
+    do {
+        off = hbitmap_next_dirty(hb, 0, BITMAP_SIZE);
+        g_assert(off >= 0);
+        lookups++;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    bench_report("hbitmap/next-dirty-sparse", "latency", "ns",
+                 g_test_timer_last() * 1e9 / lookups);
+
+    hbitmap_free(hb);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint64_t strides[] = { 64 * KiB, 1 * MiB, 64 * MiB };
+    char name[64];
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(strides); i++) {
+        snprintf(name, sizeof(name), "/hbitmap/benchmark/iter/stride-%" PRIu64,
+                 strides[i]);
+        g_test_add_data_func(name, GSIZE_TO_POINTER(strides[i]),
+                             test_hbitmap_iter_speed);
+    }
+    g_test_add_func("/hbitmap/benchmark/next-dirty",
+                    test_hbitmap_next_dirty_speed);
+
+    return g_test_run();
+}
@@ -0,0 +1,125 @@
+/*
+ * QEMU XBZRLE encode and decode speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+#include "bench-report.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+
+/* Change one byte every @stride bytes, as a guest dirtying a page would */
+static void fill_pages(uint8_t *old_page, uint8_t *new_page, int stride)
+{
+    int i;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i++) {
+        old_page[i] = g_test_rand_int();
+    }
+    memcpy(new_page, old_page, XBZRLE_PAGE_SIZE);
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i += stride) {
+        new_page[i] ^= 0xff;
+    }
+}
+
+static const int strides[] = { 8, 64, 512 };
+
+static void test_xbzrle_encode_speed(void)
+{
+    const size_t total = 1 * GiB;
+    uint8_t *old_page = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new_page = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *encoded = g_malloc(XBZRLE_PAGE_SIZE);
+    size_t remain;
+    int impl = 0, i, dlen;
+
+    /*
+     * Each vector implementation of the encoder, down to the scalar one.
+     * Switching implementation cannot be undone, so all strides are
+     * measured before moving to the next one.
+     */
+    do {
+        for (i = 0; i < ARRAY_SIZE(strides); i++) {
+            g_autofree char *name = NULL;
+
+            fill_pages(old_page, new_page, strides[i]);
+            g_test_timer_start();
+            for (remain = total; remain; remain -= XBZRLE_PAGE_SIZE) {
+                dlen = xbzrle_encode_buffer(old_page, new_page,
+                                            XBZRLE_PAGE_SIZE,
+                                            encoded, XBZRLE_PAGE_SIZE);
+            }
+            g_test_timer_elapsed();
+            g_assert(dlen > 0);
+
+            name = g_strdup_printf("xbzrle/encode-stride-%d-impl-%d",
+                                   strides[i], impl);
+            bench_report(name, "throughput", "MB/sec",
+                         total / MiB / g_test_timer_last());
+        }
+        impl++;
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(old_page);
+    g_free(new_page);
+    g_free(encoded);
+}
+
+static void test_xbzrle_decode_speed(const void *opaque)
+{
+    int stride = GPOINTER_TO_INT(opaque);
+    const size_t total = 1 * GiB;
+    uint8_t *old_page = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new_page = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *encoded = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *decoded = g_malloc(XBZRLE_PAGE_SIZE);
+    g_autofree char *name = NULL;
+    size_t remain;
+    int dlen;
+
+    fill_pages(old_page, new_page, stride);
+    dlen = xbzrle_encode_buffer(old_page, new_page, XBZRLE_PAGE_SIZE,
+                                encoded, XBZRLE_PAGE_SIZE);
+    g_assert(dlen > 0);
+
+    g_test_timer_start();
+    for (remain = total; remain; remain -= XBZRLE_PAGE_SIZE) {
+        memcpy(decoded, old_page, XBZRLE_PAGE_SIZE);
+        g_assert(xbzrle_decode_buffer(encoded, dlen, decoded,
+                                      XBZRLE_PAGE_SIZE) > 0);
+    }
+    g_test_timer_elapsed();
+    g_assert(memcmp(decoded, new_page, XBZRLE_PAGE_SIZE) == 0);
+
+    name = g_strdup_printf("xbzrle/decode-stride-%d", stride);
+    bench_report(name, "throughput", "MB/sec",
+                 total / MiB / g_test_timer_last());
+
+    g_free(old_page);
+    g_free(new_page);
+    g_free(encoded);
+    g_free(decoded);
+}
+
+int main(int argc, char **argv)
+{
+    char name[64];
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(strides); i++) {
+        snprintf(name, sizeof(name), "/xbzrle/benchmark/decode/stride-%d",
+                 strides[i]);
+        g_test_add_data_func(name, GINT_TO_POINTER(strides[i]),
+                             test_xbzrle_decode_speed);
+    }
+    /* last, as it leaves the scalar encoder selected */
+    g_test_add_func("/xbzrle/benchmark/encode", test_xbzrle_encode_speed);
+
+    return g_test_run();
+}
@@ -60,6 +60,9 @@ static double resize_rate; /* 0.0 to 1.0 */
 static unsigned int n_rz_threads = 1;
 static QemuThread *rz_threads;
 static bool precompute_hash;
+static unsigned int lookup_batch = 1;
+
+#define MAX_LOOKUP_BATCH 64
 
 static double update_rate; /* 0.0 to 1.0 */
 static uint64_t update_threshold;
@@ -79,6 +82,7 @@ static const char commands_string[] =
     "\n"
     " -o = offset at which keys start\n"
     " -p = precompute hashes\n"
+    " -b = number of lookups per qht_lookup_batch() call (1 = qht_lookup)\n"
     "\n"
     " -g = set -s,-k,-K,-l,-r to the same value\n"
     " -s = initial size hint\n"
@@ -155,6 +159,30 @@ static void do_rz(struct thread_info *info)
     g_usleep(resize_delay);
 }
 
+static void do_lookup_batch(struct thread_info *info)
+{
+    struct thread_stats *stats = &info->stats;
+    const void *userps[MAX_LOOKUP_BATCH];
+    uint32_t hashes[MAX_LOOKUP_BATCH];
+    void *results[MAX_LOOKUP_BATCH];
+    uint64_t r = info->seed - 1;
+    size_t found;
+    unsigned int i;
+
+    for (i = 0; i < lookup_batch; i++) {
+        long *p = &keys[r & (lookup_range - 1)];
+
+        userps[i] = p;
+        hashes[i] = hfunc(*p);
+        r = xorshift64star(r + 1) - 1;
+    }
+    info->seed = r + 1;
+
+    found = qht_lookup_batch(&ht, userps, hashes, results, lookup_batch);
+    stats->rd += found;
+    stats->not_rd += lookup_batch - found;
+}
+
 static void do_rw(struct thread_info *info)
 {
     struct thread_stats *stats = &info->stats;
@@ -162,7 +190,9 @@ static void do_rw(struct thread_info *info)
     uint32_t hash;
     long *p;
 
-    if (r >= update_threshold) {
+    if (r >= update_threshold && lookup_batch > 1) {
+        do_lookup_batch(info);
+    } else if (r >= update_threshold) {
         bool read;
 
         p = &keys[r & (lookup_range - 1)];
@@ -281,6 +311,7 @@ static void pr_params(void)
         printf(" # resize threads   %u\n", n_rz_threads);
     }
     printf(" update rate:       %f%%\n", update_rate * 100.0);
+    printf(" lookup batch:      %u\n", lookup_batch);
     printf(" offset:            %ld\n", populate_offset);
     printf(" initial key range: %zu\n", init_range);
     printf(" lookup range:      %lu\n", lookup_range);
@@ -444,11 +475,14 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:pr:Rs:S:u:");
+        c = getopt(argc, argv, "b:d:D:g:k:K:l:hn:N:o:pr:Rs:S:u:");
         if (c < 0) {
             break;
         }
         switch (c) {
+        case 'b':
+            lookup_batch = MAX(1, MIN(atoi(optarg), MAX_LOOKUP_BATCH));
+            break;
         case 'd':
             duration = atoi(optarg);
             break;
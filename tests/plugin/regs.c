@@ -0,0 +1,112 @@
+/*
+ * Exercise the register and memory read APIs from vCPU callbacks: every
+ * register of the vCPU is read at the start of each translation block, and
+ * the instruction bytes read back from guest memory are compared with the
+ * ones that were translated.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t vaddr;     /* the PC read as a register may be stale */
+    size_t size;
+    uint8_t data[16];
+} InsnInfo;
+
+static GMutex lock;
+static GPtrArray *insns;
+static uint64_t insn_count;
+static uint64_t reg_bytes;
+static uint64_t mem_mismatches;
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    uint8_t buf[64];
+    int n = qemu_plugin_n_registers();
+    uint64_t bytes = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        int size = qemu_plugin_read_register(i, buf, sizeof(buf));
+
+        g_assert(size >= 0);
+        bytes += size;
+    }
+    g_assert(qemu_plugin_read_register(n, buf, sizeof(buf)) == -1);
+
+    g_mutex_lock(&lock);
+    reg_bytes += bytes;
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    InsnInfo *info = udata;
+    uint8_t buf[sizeof(info->data)];
+    bool mismatch;
+
+    /* Self-modifying code can legitimately cause a mismatch */
+    mismatch = !qemu_plugin_read_memory_vaddr(info->vaddr, buf, info->size) ||
+               memcmp(buf, info->data, info->size) != 0;
+
+    g_mutex_lock(&lock);
+    insn_count++;
+    mem_mismatches += mismatch;
+    g_mutex_unlock(&lock);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_R_REGS, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+        InsnInfo *info = g_new0(InsnInfo, 1);
+
+        info->vaddr = qemu_plugin_insn_vaddr(insn);
+        info->size = MIN(qemu_plugin_insn_size(insn), sizeof(info->data));
+        memcpy(info->data, qemu_plugin_insn_data(insn), info->size);
+
+        g_mutex_lock(&lock);
+        g_ptr_array_add(insns, info);
+        g_mutex_unlock(&lock);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, info);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autofree gchar *out = g_strdup_printf("insns: %" PRIu64
+                                            ", register bytes: %" PRIu64
+                                            ", memory mismatches: %" PRIu64
+                                            "\n", insn_count, reg_bytes,
+                                            mem_mismatches);
+    qemu_plugin_outs(out);
+    g_ptr_array_free(insns, true);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    insns = g_ptr_array_new_with_free_func(g_free);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
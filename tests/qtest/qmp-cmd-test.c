@@ -15,6 +15,7 @@
 #include "qapi/error.h"
 #include "qapi/qapi-visit-introspect.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "qapi/qobject-input-visitor.h"
 
 const char common_args[] = "-nodefaults -machine none";
@@ -331,6 +332,62 @@ static void test_object_add_failure_modes(void)
     qtest_quit(qts);
 }
 
+/* Count the aio-context statistics of @instance, checking the others */
+static int query_stats_count(QTestState *qts, const char *instance)
+{
+    QDict *resp;
+    QList *list;
+    QListEntry *entry;
+    int n = 0;
+
+    resp = qtest_qmp(qts, "{'execute': 'query-stats', 'arguments':"
+                     " {'provider': 'aio-context'} }");
+    list = qdict_get_qlist(resp, "return");
+    g_assert(list);
+
+    QLIST_FOREACH_ENTRY(list, entry) {
+        QDict *stat = qobject_to(QDict, qlist_entry_obj(entry));
+
+        g_assert_cmpstr(qdict_get_str(stat, "provider"), ==, "aio-context");
+        g_assert(qdict_haskey(stat, "name"));
+        g_assert(qdict_haskey(stat, "value"));
+        g_assert(!qdict_haskey(stat, "histogram"));
+        if (!g_strcmp0(qdict_get_try_str(stat, "instance"), instance)) {
+            n++;
+        }
+    }
+
+    qobject_unref(resp);
+    return n;
+}
+
+static void test_query_stats(void)
+{
+    QTestState *qts;
+    QDict *resp;
+
+    qts = qtest_initf("%s -object iothread,id=iot0", common_args);
+
+    g_assert_cmpint(query_stats_count(qts, "main-loop"), ==, 3);
+    g_assert_cmpint(query_stats_count(qts, "iot0"), ==, 3);
+
+    /* Statistics go away with their object */
+    resp = qtest_qmp(qts, "{'execute': 'object-del', 'arguments':"
+                     " {'id': 'iot0'} }");
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+    g_assert_cmpint(query_stats_count(qts, "iot0"), ==, 0);
+    g_assert_cmpint(query_stats_count(qts, "main-loop"), ==, 3);
+
+    /* Unknown providers have no statistics */
+    resp = qtest_qmp(qts, "{'execute': 'query-stats', 'arguments':"
+                     " {'provider': 'no-such-provider'} }");
+    g_assert(!qlist_size(qdict_get_qlist(resp, "return")));
+    qobject_unref(resp);
+
+    qtest_quit(qts);
+}
+
 int main(int argc, char *argv[])
 {
     QmpSchema schema;
@@ -343,6 +400,7 @@ int main(int argc, char *argv[])
 
     qtest_add_func("qmp/object-add-failure-modes",
                    test_object_add_failure_modes);
+    qtest_add_func("qmp/query-stats", test_query_stats);
 
     ret = g_test_run();
 
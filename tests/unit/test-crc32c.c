@@ -0,0 +1,92 @@
+/*
+ * QEMU CRC32C test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+
+static const uint32_t crc32c_poly = 0x82f63b78;
+
+static uint32_t crc32c_ref(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    int i;
+
+    while (len--) {
+        crc ^= *buf++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (crc & 1 ? crc32c_poly : 0);
+        }
+    }
+    return crc ^ 0xffffffff;
+}
+
+static void test_crc32c_check(void)
+{
+    const uint8_t check[] = "123456789";
+    uint8_t buf[32];
+
+    g_assert_cmphex(crc32c(0xffffffff, check, 9), ==, 0xe3069283);
+
+    /* Test vectors from RFC 3720, section B.4 */
+    memset(buf, 0, sizeof(buf));
+    g_assert_cmphex(crc32c(0xffffffff, buf, sizeof(buf)), ==, 0x8a9136aa);
+    memset(buf, 0xff, sizeof(buf));
+    g_assert_cmphex(crc32c(0xffffffff, buf, sizeof(buf)), ==, 0x62a8ab43);
+}
+
+/*
+ * The accelerated routines must agree with the bitwise definition for any
+ * length, alignment and seed, including the tails of their main loops.
+ */
+static void test_crc32c_ref(void)
+{
+    const size_t size = 8192 + 64;
+    g_autofree uint8_t *buf = g_malloc(size);
+    size_t i, off, len;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = g_test_rand_int();
+    }
+
+    for (off = 0; off < 16; off++) {
+        for (len = 0; len + off <= size; len += 1 + len / 8) {
+            uint32_t seed = g_test_rand_int();
+
+            g_assert_cmphex(crc32c(seed, buf + off, len), ==,
+                            crc32c_ref(seed, buf + off, len));
+        }
+    }
+}
+
+/* Checksumming a buffer in pieces gives the same result as all at once */
+static void test_crc32c_split(void)
+{
+    const size_t size = 8192;
+    g_autofree uint8_t *buf = g_malloc(size);
+    uint32_t whole;
+    size_t i, split;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = g_test_rand_int();
+    }
+    whole = crc32c(0xffffffff, buf, size);
+
+    for (split = 1; split < size; split += 97) {
+        uint32_t crc = crc32c(0xffffffff, buf, split) ^ 0xffffffff;
+
+        g_assert_cmphex(crc32c(crc, buf + split, size - split), ==, whole);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crc32c/check", test_crc32c_check);
+    g_test_add_func("/crc32c/ref", test_crc32c_ref);
+    g_test_add_func("/crc32c/split", test_crc32c_split);
+    return g_test_run();
+}
@@ -398,6 +398,30 @@ static void test_hbitmap_reset_all(TestHBitmapData *data,
     hbitmap_test_reset_all(data);
 }
 
+static void test_hbitmap_merge(TestHBitmapData *data,
+                               const void *unused)
+{
+    static const uint64_t ranges[][2] = {
+        { 0, 1 }, { L1 - 1, 2 }, { L2 + 3, L1 * 2 }, { L3 - 1, 1 },
+    };
+    HBitmap *b;
+    int i;
+
+    hbitmap_test_init(data, L3 * 2, 0);
+    hbitmap_test_set(data, 1, L1);
+    hbitmap_test_set(data, L3, L2);
+
+    b = hbitmap_alloc(data->size, 0);
+    for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+        hbitmap_set(b, ranges[i][0], ranges[i][1]);
+        bitmap_set(data->bits, ranges[i][0], ranges[i][1]);
+    }
+
+    g_assert(hbitmap_merge(data->hb, b, data->hb));
+    hbitmap_test_check(data, 0);
+    hbitmap_free(b);
+}
+
 static void test_hbitmap_granularity(TestHBitmapData *data,
                                      const void *unused)
 {
@@ -1061,6 +1085,7 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/reset/empty", test_hbitmap_reset_empty);
     hbitmap_test_add("/hbitmap/reset/general", test_hbitmap_reset);
     hbitmap_test_add("/hbitmap/reset/all", test_hbitmap_reset_all);
+    hbitmap_test_add("/hbitmap/merge", test_hbitmap_merge);
     hbitmap_test_add("/hbitmap/granularity", test_hbitmap_granularity);
 
     hbitmap_test_add("/hbitmap/truncate/nop", test_hbitmap_truncate_nop);
@@ -444,7 +444,7 @@ static void test_io_channel_unix_fd_pass(void)
                             G_N_ELEMENTS(iosend),
                             fdsend,
                             G_N_ELEMENTS(fdsend),
-                            &error_abort);
+                            0, &error_abort);
 
     qio_channel_readv_full(dst,
                            iorecv,
@@ -491,6 +491,64 @@ static void test_io_channel_unix_fd_pass(void)
     g_free(fdrecv);
 }
 
+static void test_io_channel_unix_write_buffer(void)
+{
+    SocketAddress *listen_addr = g_new0(SocketAddress, 1);
+    SocketAddress *connect_addr = g_new0(SocketAddress, 1);
+    QIOChannel *src, *dst, *srv;
+    char big[100], bufrecv[128], expect[128];
+    struct iovec iov = { .iov_base = (char *)"World", .iov_len = 5 };
+
+#define TEST_SOCKET "test-io-channel-socket.sock"
+
+    listen_addr->type = SOCKET_ADDRESS_TYPE_UNIX;
+    listen_addr->u.q_unix.path = g_strdup(TEST_SOCKET);
+
+    connect_addr->type = SOCKET_ADDRESS_TYPE_UNIX;
+    connect_addr->u.q_unix.path = g_strdup(TEST_SOCKET);
+
+    test_io_channel_setup_sync(listen_addr, connect_addr, &srv, &src, &dst);
+    qio_channel_set_blocking(dst, false, &error_abort);
+    qio_channel_set_write_buffer(src, 64);
+
+    /* Small writes stay in the buffer */
+    g_assert_cmpint(qio_channel_write_all(src, "Hello", 5, &error_abort),
+                    ==, 0);
+    g_assert_cmpint(qio_channel_writev_full_all(src, &iov, 1, NULL, 0,
+                                                QIO_CHANNEL_WRITE_FLAG_MORE,
+                                                &error_abort), ==, 0);
+    g_assert_cmpint(qio_channel_read(dst, bufrecv, sizeof(bufrecv), NULL),
+                    ==, QIO_CHANNEL_ERR_BLOCK);
+
+    /* A write that does not fit pushes out the buffer, in order */
+    memset(big, 'x', sizeof(big));
+    g_assert_cmpint(qio_channel_write_all(src, big, sizeof(big),
+                                          &error_abort), ==, 0);
+    g_assert_cmpint(qio_channel_flush(src, &error_abort), ==, 0);
+
+    memcpy(expect, "HelloWorld", 10);
+    memcpy(expect + 10, big, sizeof(big));
+    qio_channel_set_blocking(dst, true, &error_abort);
+    g_assert_cmpint(qio_channel_read_all(dst, bufrecv, 10 + sizeof(big),
+                                         &error_abort), ==, 0);
+    g_assert(memcmp(bufrecv, expect, 10 + sizeof(big)) == 0);
+
+    /* Closing the channel sends what is still buffered */
+    g_assert_cmpint(qio_channel_write_all(src, "Bye", 3, &error_abort),
+                    ==, 0);
+    qio_channel_close(src, &error_abort);
+    g_assert_cmpint(qio_channel_read_all(dst, bufrecv, 3, &error_abort),
+                    ==, 0);
+    g_assert(memcmp(bufrecv, "Bye", 3) == 0);
+
+    object_unref(OBJECT(src));
+    object_unref(OBJECT(dst));
+    object_unref(OBJECT(srv));
+    qapi_free_SocketAddress(listen_addr);
+    qapi_free_SocketAddress(connect_addr);
+    unlink(TEST_SOCKET);
+}
+
 static void test_io_channel_unix_listen_cleanup(void)
 {
     QIOChannelSocket *ioc;
@@ -594,6 +652,8 @@ int main(int argc, char **argv)
                     test_io_channel_unix_async);
     g_test_add_func("/io/channel/socket/unix-fd-pass",
                     test_io_channel_unix_fd_pass);
+    g_test_add_func("/io/channel/socket/unix-write-buffer",
+                    test_io_channel_unix_write_buffer);
     g_test_add_func("/io/channel/socket/unix-listen-cleanup",
                     test_io_channel_unix_listen_cleanup);
 #endif /* _WIN32 */
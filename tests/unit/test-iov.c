@@ -564,6 +564,60 @@ static void test_discard_back_undo(void)
     iov_free(iov, iov_cnt);
 }
 
+static void test_is_zero(void)
+{
+    struct iovec *iov;
+    unsigned iov_cnt, i;
+    size_t size, pos;
+
+    iov_random(&iov, &iov_cnt);
+    size = iov_size(iov, iov_cnt);
+    iov_memset(iov, iov_cnt, 0, 0, size);
+    g_assert(iov_is_zero(iov, iov_cnt, 0, size));
+
+    /* a non-zero byte is only seen by ranges that include it */
+    for (i = 0; i < 20; i++) {
+        pos = g_test_rand_int_range(0, size);
+        iov_memset(iov, iov_cnt, pos, 1, 1);
+        g_assert(!iov_is_zero(iov, iov_cnt, 0, size));
+        g_assert(!iov_is_zero(iov, iov_cnt, pos, size - pos));
+        g_assert(iov_is_zero(iov, iov_cnt, 0, pos));
+        g_assert(iov_is_zero(iov, iov_cnt, pos + 1, size - pos - 1));
+        iov_memset(iov, iov_cnt, pos, 0, 1);
+    }
+
+    iov_free(iov, iov_cnt);
+}
+
+static void test_init_storage(void)
+{
+    struct iovec storage[2];
+    QEMUIOVector qiov;
+    char buf[8];
+    int i;
+
+    qemu_iovec_init_storage(&qiov, storage, ARRAY_SIZE(storage));
+    qemu_iovec_add(&qiov, buf, 1);
+    qemu_iovec_add(&qiov, buf + 1, 2);
+    g_assert(qiov.iov == storage);
+
+    /* growing past the storage moves the elements to the heap */
+    qemu_iovec_add(&qiov, buf + 3, 5);
+    g_assert(qiov.iov != storage);
+    g_assert_cmpint(qiov.niov, ==, 3);
+    g_assert_cmpuint(qiov.size, ==, sizeof(buf));
+    for (i = 0; i < qiov.niov; i++) {
+        g_assert(qiov.iov[i].iov_base == buf + (i ? 2 * i - 1 : 0));
+    }
+    qemu_iovec_destroy(&qiov);
+
+    qemu_iovec_init_storage(&qiov, storage, ARRAY_SIZE(storage));
+    qemu_iovec_add(&qiov, buf, sizeof(buf));
+    qemu_iovec_reset(&qiov);
+    g_assert(qiov.iov == storage && qiov.niov == 0 && qiov.size == 0);
+    qemu_iovec_destroy(&qiov);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -574,5 +628,7 @@ int main(int argc, char **argv)
     g_test_add_func("/basic/iov/discard-back", test_discard_back);
     g_test_add_func("/basic/iov/discard-front-undo", test_discard_front_undo);
     g_test_add_func("/basic/iov/discard-back-undo", test_discard_back_undo);
+    g_test_add_func("/basic/iov/is-zero", test_is_zero);
+    g_test_add_func("/basic/iov/init-storage", test_init_storage);
     return g_test_run();
 }
@@ -0,0 +1,119 @@
+/*
+ * Registry of performance counters test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/stats.h"
+
+typedef struct {
+    GString *out;
+    const StatsHistogram *hist;
+} StatsDump;
+
+static void stats_dump_one(const char *provider, const char *instance,
+                           const char *name, const uint64_t *value,
+                           const StatsHistogram *hist, void *opaque)
+{
+    StatsDump *d = opaque;
+
+    g_assert(!value != !hist);
+    g_string_append_printf(d->out, "%s/%s/%s", provider,
+                           instance ? instance : "-", name);
+    if (value) {
+        g_string_append_printf(d->out, "=%" PRIu64 ";", *value);
+    } else {
+        g_string_append(d->out, "=hist;");
+        d->hist = hist;
+    }
+}
+
+static char *stats_dump(const StatsHistogram **hist)
+{
+    StatsDump d = { .out = g_string_new("") };
+
+    stats_foreach(stats_dump_one, &d);
+    if (hist) {
+        *hist = d.hist;
+    }
+    return g_string_free(d.out, false);
+}
+
+static uint64_t get_answer(void *opaque)
+{
+    return *(uint64_t *)opaque;
+}
+
+static void test_stats_register(void)
+{
+    Stat64 a, b;
+    uint64_t answer = 42;
+    g_autofree char *all = NULL;
+    g_autofree char *one = NULL;
+    g_autofree char *none = NULL;
+
+    stat64_init(&a, 1);
+    stat64_init(&b, 2);
+
+    stats_register_counter("test", NULL, "a", &a);
+    stats_register_counter("test", "x", "b", &b);
+    stats_register_func("test", "x", "c", get_answer, &answer);
+
+    /* Values are read when the registry is walked, in registration order */
+    stat64_add(&a, 10);
+    answer = 43;
+    all = stats_dump(NULL);
+    g_assert_cmpstr(all, ==, "test/-/a=11;test/x/b=2;test/x/c=43;");
+
+    stats_unregister("test", "x");
+    one = stats_dump(NULL);
+    g_assert_cmpstr(one, ==, "test/-/a=11;");
+
+    stats_unregister("test", NULL);
+    none = stats_dump(NULL);
+    g_assert_cmpstr(none, ==, "");
+}
+
+static void test_stats_histogram(void)
+{
+    StatsHistogram hist;
+    const StatsHistogram *found;
+    g_autofree char *all = NULL;
+
+    stats_histogram_reset(&hist);
+    g_assert_cmpuint(stat64_get(&hist.min), ==, UINT64_MAX);
+
+    stats_histogram_add(&hist, 500);            /* below 1us */
+    stats_histogram_add(&hist, 1000);           /* 1us */
+    stats_histogram_add(&hist, 3500);           /* 3us */
+    stats_histogram_add(&hist, UINT64_MAX / 2); /* clamped to the last */
+
+    g_assert_cmpuint(stat64_get(&hist.count), ==, 4);
+    g_assert_cmpuint(stat64_get(&hist.min), ==, 500);
+    g_assert_cmpuint(stat64_get(&hist.max), ==, UINT64_MAX / 2);
+    g_assert_cmpuint(stat64_get(&hist.buckets[0]), ==, 1);
+    g_assert_cmpuint(stat64_get(&hist.buckets[1]), ==, 1);
+    g_assert_cmpuint(stat64_get(&hist.buckets[2]), ==, 1);
+    g_assert_cmpuint(stat64_get(&hist.buckets[STATS_HISTOGRAM_BUCKETS - 1]),
+                     ==, 1);
+
+    stats_register_histogram("test", NULL, "latency", &hist);
+    all = stats_dump(&found);
+    g_assert_cmpstr(all, ==, "test/-/latency=hist;");
+    g_assert(found == &hist);
+    stats_unregister("test", NULL);
+
+    stats_histogram_reset(&hist);
+    g_assert_cmpuint(stat64_get(&hist.count), ==, 0);
+    g_assert_cmpuint(stat64_get(&hist.buckets[0]), ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/stats/register", test_stats_register);
+    g_test_add_func("/stats/histogram", test_stats_histogram);
+    return g_test_run();
+}
@@ -285,12 +285,18 @@ static void test_enabled(void)
 
     throttle_config_init(&cfg);
     g_assert(!throttle_enabled(&cfg));
+    g_assert(!throttle_enabled_for(&cfg, false));
+    g_assert(!throttle_enabled_for(&cfg, true));
 
     for (i = 0; i < BUCKETS_COUNT; i++) {
         throttle_config_init(&cfg);
         set_cfg_value(false, i, 150);
         g_assert(throttle_is_valid(&cfg, NULL));
         g_assert(throttle_enabled(&cfg));
+        g_assert(throttle_enabled_for(&cfg, false) ==
+                 (i != THROTTLE_BPS_WRITE && i != THROTTLE_OPS_WRITE));
+        g_assert(throttle_enabled_for(&cfg, true) ==
+                 (i != THROTTLE_BPS_READ && i != THROTTLE_OPS_READ));
     }
 
     for (i = 0; i < BUCKETS_COUNT; i++) {
@@ -174,6 +174,58 @@ static void test_encode_decode(void)
     }
 }
 
+#define XBZRLE_ACCEL_CASES 200
+
+static void test_encode_accel(void)
+{
+    uint8_t *old_buf = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf[XBZRLE_ACCEL_CASES];
+    uint8_t *ref[XBZRLE_ACCEL_CASES];
+    uint8_t *out = g_malloc(XBZRLE_PAGE_SIZE);
+    int ref_len[XBZRLE_ACCEL_CASES];
+    int i, j, dlen;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i++) {
+        old_buf[i] = g_test_rand_int();
+    }
+
+    /*
+     * Growing sets of sparse changes, with runs crossing the vector
+     * boundaries; the fastest encoder gives the reference output.
+     */
+    for (i = 0; i < XBZRLE_ACCEL_CASES; i++) {
+        int start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+        int len = g_test_rand_int_range(1, 80);
+
+        new_buf[i] = g_memdup(i ? new_buf[i - 1] : old_buf, XBZRLE_PAGE_SIZE);
+        for (j = start; j < start + len && j < XBZRLE_PAGE_SIZE; j++) {
+            new_buf[i][j] = old_buf[j] + 1;
+        }
+        ref[i] = g_malloc(XBZRLE_PAGE_SIZE);
+        ref_len[i] = xbzrle_encode_buffer(old_buf, new_buf[i],
+                                          XBZRLE_PAGE_SIZE, ref[i],
+                                          XBZRLE_PAGE_SIZE);
+    }
+
+    while (test_xbzrle_encode_next_accel()) {
+        for (i = 0; i < XBZRLE_ACCEL_CASES; i++) {
+            dlen = xbzrle_encode_buffer(old_buf, new_buf[i], XBZRLE_PAGE_SIZE,
+                                        out, XBZRLE_PAGE_SIZE);
+            g_assert_cmpint(dlen, ==, ref_len[i]);
+            if (dlen > 0) {
+                g_assert(memcmp(out, ref[i], dlen) == 0);
+            }
+        }
+    }
+
+    for (i = 0; i < XBZRLE_ACCEL_CASES; i++) {
+        g_free(new_buf[i]);
+        g_free(ref[i]);
+    }
+    g_free(old_buf);
+    g_free(out);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +238,7 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
@@ -1009,7 +1009,7 @@ static int lo_do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name,
                         struct fuse_entry_param *e,
                         struct lo_inode **inodep)
 {
-    int newfd;
+    int newfd = -1;
     int res;
     int saverr;
     uint64_t mnt_id;
@@ -1039,15 +1039,30 @@ static int lo_do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name,
         name = ".";
     }
 
-    newfd = openat(dir->fd, name, O_PATH | O_NOFOLLOW);
-    if (newfd == -1) {
+    /*
+     * Most lookups are for inodes that we already hold an O_PATH fd for, so
+     * stat by name first and only open the entry if it is a new one.
+     */
+    res = do_statx(lo, dir->fd, name, &e->attr, AT_SYMLINK_NOFOLLOW, &mnt_id);
+    if (res == -1) {
         goto out_err;
     }
 
-    res = do_statx(lo, newfd, "", &e->attr, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW,
-                   &mnt_id);
-    if (res == -1) {
-        goto out_err;
+    inode = lo_find(lo, &e->attr, mnt_id);
+    if (!inode) {
+        newfd = openat(dir->fd, name, O_PATH | O_NOFOLLOW);
+        if (newfd == -1) {
+            goto out_err;
+        }
+
+        /* The name may have been replaced in the meantime, stat what we got */
+        res = do_statx(lo, newfd, "", &e->attr,
+                       AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW, &mnt_id);
+        if (res == -1) {
+            goto out_err;
+        }
+
+        inode = lo_find(lo, &e->attr, mnt_id);
     }
 
     if (S_ISDIR(e->attr.st_mode) && lo->announce_submounts &&
@@ -1055,9 +1070,10 @@ static int lo_do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name,
         e->attr_flags |= FUSE_ATTR_SUBMOUNT;
     }
 
-    inode = lo_find(lo, &e->attr, mnt_id);
     if (inode) {
-        close(newfd);
+        if (newfd != -1) {
+            close(newfd);
+        }
     } else {
         inode = calloc(1, sizeof(struct lo_inode));
         if (!inode) {
@@ -1137,7 +1153,16 @@ static void lo_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
     }
 
     err = lo_do_lookup(req, parent, name, &e, NULL);
-    if (err) {
+    if (err == ENOENT && lo_data(req)->timeout > 0) {
+        /*
+         * Let the client cache the negative dentry for as long as it would
+         * cache a positive one, so that repeated lookups of missing names
+         * (search paths, node_modules resolution) are answered by the guest.
+         */
+        memset(&e, 0, sizeof(e));
+        e.entry_timeout = lo_data(req)->timeout;
+        fuse_reply_entry(req, &e);
+    } else if (err) {
         fuse_reply_err(req, err);
     } else {
         fuse_reply_entry(req, &e);
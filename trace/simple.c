@@ -43,6 +43,8 @@ static GCond trace_empty_cond;
 
 static bool trace_available;
 static bool trace_writeout_enabled;
+/* Set by the first producer to kick the writeout thread, until it runs */
+static volatile gint trace_kicked;
 
 enum {
     TRACE_BUF_LEN = 4096 * 64,
@@ -81,14 +83,12 @@ static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size
 
 static void clear_buffer_range(unsigned int idx, size_t len)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
-    }
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(len, TRACE_BUF_LEN - idx);
+    memset(&trace_buf[idx], 0, first);
+    memset(trace_buf, 0, len - first);
 }
 /**
  * Read a trace record from the trace buffer
@@ -168,6 +168,7 @@ static gpointer writeout_thread(gpointer opaque)
 
     for (;;) {
         wait_for_trace_records_available();
+        g_atomic_int_set(&trace_kicked, 0);
 
         if (g_atomic_int_get(&dropped_events)) {
             dropped.rec.event = DROPPED_EVENT_ID;
@@ -241,29 +242,29 @@ int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
     return 0;
 }
 
+/* Records are never larger than the buffer, so they wrap at most once. */
 static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(size, TRACE_BUF_LEN - idx);
+    memcpy(data_ptr, &trace_buf[idx], first);
+    memcpy(data_ptr + first, trace_buf, size - first);
 }
 
 static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
-    }
-    return idx; /* most callers wants to know where to write next */
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(size, TRACE_BUF_LEN - idx);
+    memcpy(&trace_buf[idx], data_ptr, first);
+    memcpy(trace_buf, data_ptr + first, size - first);
+    /* most callers wants to know where to write next */
+    return (idx + size) % TRACE_BUF_LEN;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
@@ -274,8 +275,13 @@ void trace_record_finish(TraceBufferRecord *rec)
     record.event |= TRACE_RECORD_VALID;
     write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
 
+    /*
+     * Only the first producer past the threshold takes trace_lock to wake
+     * the writeout thread; the others would just contend on the lock.
+     */
     if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+        > TRACE_BUF_FLUSH_THRESHOLD &&
+        g_atomic_int_compare_and_exchange(&trace_kicked, 0, 1)) {
         flush_trace_file(false);
     }
 }
@@ -1648,6 +1648,16 @@ void dpy_gfx_update(QemuConsole *con, int x, int y, int w, int h)
         if (dcl->ops->dpy_gfx_update) {
             dcl->ops->dpy_gfx_update(dcl, x, y, w, h);
         }
+        /*
+         * A frame submitted by the guest outside of a refresh (e.g. a
+         * virtio-gpu resource flush) wakes up listeners that backed off
+         * while the display was idle, so they can idle at a long interval
+         * without adding latency to the next update.
+         */
+        if (!s->refreshing && dcl->ops->dpy_refresh &&
+            dcl->update_interval > GUI_REFRESH_INTERVAL_DEFAULT) {
+            update_displaychangelistener(dcl, GUI_REFRESH_INTERVAL_DEFAULT);
+        }
     }
 }
 
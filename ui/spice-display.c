@@ -184,14 +184,54 @@ static void qemu_spice_create_one_update(SimpleSpiceDisplay *ssd,
     QTAILQ_INSERT_TAIL(&ssd->updates, update, next);
 }
 
+/*
+ * Emit the updates for the columns whose dirty run ends at @bottom (marked
+ * in @ended), merging neighbouring columns that started at the same line
+ * into a single rectangle.  Every update is compressed and sent on its own
+ * by spice-server, so fewer and larger rectangles are much cheaper.
+ */
+static void qemu_spice_flush_columns(SimpleSpiceDisplay *ssd, int *dirty_top,
+                                     bool *ended, int blksize, int bottom)
+{
+    int blocks = DIV_ROUND_UP(ssd->dirty.right - ssd->dirty.left, blksize);
+    int blk, last;
+    QXLRect update;
+
+    for (blk = 0; blk < blocks; blk++) {
+        if (!ended[blk]) {
+            continue;
+        }
+        for (last = blk; last + 1 < blocks; last++) {
+            if (!ended[last + 1] || dirty_top[last + 1] != dirty_top[blk]) {
+                break;
+            }
+        }
+
+        update.top = dirty_top[blk];
+        update.bottom = bottom;
+        update.left = ssd->dirty.left + blk * blksize;
+        update.right = MIN(ssd->dirty.left + (last + 1) * blksize,
+                           ssd->dirty.right);
+        qemu_spice_create_one_update(ssd, &update);
+
+        for (; blk <= last; blk++) {
+            dirty_top[blk] = -1;
+            ended[blk] = false;
+        }
+        blk = last;
+    }
+}
+
 static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
 {
     static const int blksize = 32;
     int blocks = DIV_ROUND_UP(surface_width(ssd->ds), blksize);
     int dirty_top[blocks];
+    bool ended[blocks];
     int y, yoff1, yoff2, x, xoff, blk, bw;
     int bpp = surface_bytes_per_pixel(ssd->ds);
     uint8_t *guest, *mirror;
+    bool flush;
 
     if (qemu_spice_rect_is_empty(&ssd->dirty)) {
         return;
@@ -199,6 +239,7 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
 
     for (blk = 0; blk < blocks; blk++) {
         dirty_top[blk] = -1;
+        ended[blk] = false;
     }
 
     guest = surface_data(ssd->ds);
@@ -206,22 +247,17 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
     for (y = ssd->dirty.top; y < ssd->dirty.bottom; y++) {
         yoff1 = y * surface_stride(ssd->ds);
         yoff2 = y * pixman_image_get_stride(ssd->mirror);
+        flush = false;
         for (x = ssd->dirty.left; x < ssd->dirty.right; x += blksize) {
             xoff = x * bpp;
-            blk = x / blksize;
+            blk = (x - ssd->dirty.left) / blksize;
             bw = MIN(blksize, ssd->dirty.right - x);
             if (memcmp(guest + yoff1 + xoff,
                        mirror + yoff2 + xoff,
                        bw * bpp) == 0) {
                 if (dirty_top[blk] != -1) {
-                    QXLRect update = {
-                        .top    = dirty_top[blk],
-                        .bottom = y,
-                        .left   = x,
-                        .right  = x + bw,
-                    };
-                    qemu_spice_create_one_update(ssd, &update);
-                    dirty_top[blk] = -1;
+                    ended[blk] = true;
+                    flush = true;
                 }
             } else {
                 if (dirty_top[blk] == -1) {
@@ -229,22 +265,17 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
                 }
             }
         }
+        if (flush) {
+            qemu_spice_flush_columns(ssd, dirty_top, ended, blksize, y);
+        }
     }
 
     for (x = ssd->dirty.left; x < ssd->dirty.right; x += blksize) {
-        blk = x / blksize;
-        bw = MIN(blksize, ssd->dirty.right - x);
-        if (dirty_top[blk] != -1) {
-            QXLRect update = {
-                .top    = dirty_top[blk],
-                .bottom = ssd->dirty.bottom,
-                .left   = x,
-                .right  = x + bw,
-            };
-            qemu_spice_create_one_update(ssd, &update);
-            dirty_top[blk] = -1;
-        }
+        blk = (x - ssd->dirty.left) / blksize;
+        ended[blk] = dirty_top[blk] != -1;
     }
+    qemu_spice_flush_columns(ssd, dirty_top, ended, blksize,
+                             ssd->dirty.bottom);
 
     memset(&ssd->dirty, 0, sizeof(ssd->dirty));
 }
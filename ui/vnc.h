@@ -158,6 +158,7 @@ struct VncDisplay
     int ledstate;
     QKbdState *kbd;
     QemuMutex mutex;
+    int encoders; /* worker threads reading the server surface, see vnc-jobs.h */
 
     QEMUCursor *cursor;
     int cursor_msize;
@@ -250,6 +251,7 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    bool in_progress; /* being encoded by a worker thread */
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
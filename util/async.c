@@ -32,6 +32,7 @@
 #include "qemu/rcu_queue.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/stats.h"
 #include "trace.h"
 
 /***********************************************************/
@@ -669,6 +670,21 @@ void aio_context_release(AioContext *ctx)
     qemu_rec_mutex_unlock(&ctx->lock);
 }
 
+void aio_context_register_stats(AioContext *ctx, const char *name)
+{
+    stats_register_counter("aio-context", name, "poll-hits",
+                           &ctx->poll_hits);
+    stats_register_counter("aio-context", name, "poll-misses",
+                           &ctx->poll_misses);
+    stats_register_counter("aio-context", name, "poll-time-ns",
+                           &ctx->poll_time_ns);
+}
+
+void aio_context_unregister_stats(const char *name)
+{
+    stats_unregister("aio-context", name);
+}
+
 static __thread AioContext *my_aiocontext;
 
 AioContext *qemu_get_current_aio_context(void)
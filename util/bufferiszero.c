@@ -329,6 +329,47 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* Advanced SIMD is part of the base ARMv8-A architecture */
+static bool buffer_zero_neon(const void *buf, size_t len)
+{
+    uint8x16_t t = vld1q_u8(buf);
+    const uint8x16_t *p = (uint8x16_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint8x16_t *e = (uint8x16_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u8(t))) {
+            return false;
+        }
+        t = vorrq_u8(vorrq_u8(p[-4], p[-3]), vorrq_u8(p[-2], p[-1]));
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t = vorrq_u8(t, vorrq_u8(e[-3], vorrq_u8(e[-2], e[-1])));
+
+    /* Finish the unaligned tail.  */
+    t = vorrq_u8(t, vld1q_u8(buf + len - 16));
+
+    return vmaxvq_u8(t) == 0;
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= 64)) {
+        return buffer_zero_neon(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    return false;
+}
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
@@ -0,0 +1,235 @@
+/*
+ * Host-specific assembly coroutine switching
+ *
+ * Copyright (C) 2006  Anthony Liguori <anthony@codemonkey.ws>
+ * Copyright (C) 2011  Kevin Wolf <kwolf@redhat.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/coroutine_int.h"
+
+#ifdef CONFIG_VALGRIND_H
+#include <valgrind/valgrind.h>
+#endif
+
+typedef struct {
+    Coroutine base;
+    void *sp;
+
+    void *stack;
+    size_t stack_size;
+
+#ifdef CONFIG_VALGRIND_H
+    unsigned int valgrind_stack_id;
+#endif
+} CoroutineAsm;
+
+/**
+ * Per-thread coroutine bookkeeping
+ */
+static __thread CoroutineAsm leader;
+static __thread Coroutine *current;
+
+static void coroutine_trampoline(CoroutineAsm *self);
+
+/*
+ * CO_SWITCH(from, to, action) saves the stack pointer of the running
+ * coroutine in from->sp, loads to->sp and resumes there, passing @action
+ * to the other side.  It evaluates to the action that was passed by
+ * whoever switches back to us.
+ *
+ * Instead of saving all registers, the asm statement lists every register
+ * that is not preserved across the switch as clobbered, so that the
+ * compiler only spills what is actually live.  The frame pointer cannot
+ * be clobbered, so it is saved on the stack explicitly; the only other
+ * state kept on the stack is the address at which to resume.
+ *
+ * A new coroutine's stack is prepared so that resuming it "returns" into
+ * coroutine_trampoline() with the coroutine as the first argument.
+ */
+#if defined(__x86_64__)
+
+/*
+ * The switch pushes data on the stack, so skip the 128-byte red zone
+ * in which the compiler could be keeping temporaries.
+ */
+#define CO_SWITCH(from, to, action) ({                                      \
+    register uintptr_t action_ asm("rax") = (action);                      \
+    register void *from_ asm("rbx") = (from);                              \
+    register void *to_ asm("rdi") = (to);                                  \
+    asm volatile(                                                           \
+        "leaq -128(%%rsp), %%rsp\n"                                         \
+        "pushq %%rbp\n"                                                     \
+        "call 1f\n"                 /* push the resume address */           \
+        "jmp 2f\n"                                                          \
+        "1: movq %%rsp, %c[SP](%[FROM])\n"                                  \
+        "movq %c[SP](%[TO]), %%rsp\n"                                       \
+        "ret\n"                                                             \
+        "2: popq %%rbp\n"                                                   \
+        "leaq 128(%%rsp), %%rsp\n"                                          \
+        : "+r" (action_), [FROM] "+r" (from_), [TO] "+r" (to_)              \
+        : [SP] "i" (offsetof(CoroutineAsm, sp))                             \
+        : "rcx", "rdx", "rsi", "r8", "r9", "r10", "r11",                    \
+          "r12", "r13", "r14", "r15",                                       \
+          "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",   \
+          "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14",      \
+          "xmm15", "cc", "memory");                                         \
+    (CoroutineAction)action_;                                               \
+})
+
+static void *coroutine_init_stack(CoroutineAsm *co)
+{
+    void **sp = co->stack + co->stack_size;
+
+    /*
+     * "ret" pops the trampoline's address, leaving the stack pointer
+     * where a call instruction would have: 8 bytes below a 16-byte
+     * boundary.  The trampoline never returns, its return address is 0.
+     */
+    *--sp = NULL;
+    *--sp = (void *)coroutine_trampoline;
+    return sp;
+}
+
+#elif defined(__aarch64__)
+
+#define CO_SWITCH(from, to, action) ({                                      \
+    register void *to_ asm("x0") = (to);                                   \
+    register uintptr_t action_ asm("x1") = (action);                       \
+    register void *from_ asm("x2") = (from);                               \
+    asm volatile(                                                           \
+        "adr x30, 1f\n"             /* resume address */                    \
+        "stp x29, x30, [sp, #-16]!\n"                                       \
+        "mov x3, sp\n"                                                      \
+        "str x3, [%[FROM], %[SP]]\n"                                        \
+        "ldr x3, [%[TO], %[SP]]\n"                                          \
+        "mov sp, x3\n"                                                      \
+        "ldp x29, x30, [sp], #16\n"                                         \
+        "ret\n"                     /* not subject to BTI checks */         \
+        "1:\n"                                                              \
+        : "+r" (action_), [FROM] "+r" (from_), [TO] "+r" (to_)              \
+        : [SP] "i" (offsetof(CoroutineAsm, sp))                             \
+        : "x3", "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11", "x12",    \
+          "x13", "x14", "x15", "x16", "x17", "x18", "x19", "x20", "x21",    \
+          "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x30",           \
+          "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7",                   \
+          "v8", "v9", "v10", "v11", "v12", "v13", "v14", "v15",             \
+          "v16", "v17", "v18", "v19", "v20", "v21", "v22", "v23",           \
+          "v24", "v25", "v26", "v27", "v28", "v29", "v30", "v31",           \
+          "cc", "memory");                                                  \
+    (CoroutineAction)action_;                                               \
+})
+
+static void *coroutine_init_stack(CoroutineAsm *co)
+{
+    void **sp = co->stack + co->stack_size;
+
+    /* Popped into x29 and x30 by the first switch.  */
+    *--sp = (void *)coroutine_trampoline;
+    *--sp = NULL;
+    return sp;
+}
+
+#else
+#error "The asm coroutine backend does not support this host"
+#endif
+
+static void __attribute__((used)) QEMU_NORETURN
+coroutine_trampoline(CoroutineAsm *self)
+{
+    Coroutine *co = &self->base;
+
+    while (true) {
+        co->entry(co->entry_arg);
+        qemu_coroutine_switch(co, co->caller, COROUTINE_TERMINATE);
+    }
+}
+
+Coroutine *qemu_coroutine_new(void)
+{
+    CoroutineAsm *co;
+
+    co = g_malloc0(sizeof(*co));
+    co->stack_size = COROUTINE_STACK_SIZE;
+    co->stack = qemu_alloc_stack(&co->stack_size);
+    co->sp = coroutine_init_stack(co);
+
+#ifdef CONFIG_VALGRIND_H
+    co->valgrind_stack_id =
+        VALGRIND_STACK_REGISTER(co->stack, co->stack + co->stack_size);
+#endif
+
+    return &co->base;
+}
+
+#ifdef CONFIG_VALGRIND_H
+/* Work around an unused variable in the valgrind.h macro... */
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+static inline void valgrind_stack_deregister(CoroutineAsm *co)
+{
+    VALGRIND_STACK_DEREGISTER(co->valgrind_stack_id);
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+void qemu_coroutine_delete(Coroutine *co_)
+{
+    CoroutineAsm *co = DO_UPCAST(CoroutineAsm, base, co_);
+
+#ifdef CONFIG_VALGRIND_H
+    valgrind_stack_deregister(co);
+#endif
+
+    qemu_free_stack(co->stack, co->stack_size);
+    g_free(co);
+}
+
+/* This function is marked noinline to prevent GCC from inlining it
+ * into coroutine_trampoline(). If we allow it to do that then it
+ * hoists the code to get the address of the TLS variable "current"
+ * out of the while() loop. This is an invalid transformation because
+ * the switch may be called when running thread A but return in
+ * thread B, and so we might be in a different thread context each
+ * time round the loop.
+ */
+CoroutineAction __attribute__((noinline))
+qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
+                      CoroutineAction action)
+{
+    CoroutineAsm *from = DO_UPCAST(CoroutineAsm, base, from_);
+    CoroutineAsm *to = DO_UPCAST(CoroutineAsm, base, to_);
+
+    current = to_;
+    return CO_SWITCH(from, to, action);
+}
+
+Coroutine *qemu_coroutine_self(void)
+{
+    if (!current) {
+        current = &leader.base;
+    }
+    return current;
+}
+
+bool qemu_in_coroutine(void)
+{
+    return current && current->caller;
+}
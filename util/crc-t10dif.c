@@ -0,0 +1,229 @@
+/*
+ * CRC16 (T10 DIF) Checksum Algorithm
+ *
+ * Copyright (c) 2021 Samsung Electronics Co., Ltd.
+ *
+ * Authors:
+ *   Klaus Jensen           <k.jensen@samsung.com>
+ *   Gollu Appalanaidu      <anaidu.gollu@samsung.com>
+ *
+ * The table is from Linux kernel crypto/crct10dif_common.c; the carry-less
+ * multiplication folding follows Intel's white paper "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction".
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc-t10dif.h"
+
+/* Polynomial x^16 + x^15 + x^11 + x^9 + x^8 + x^7 + x^5 + x^4 + x^2 + x + 1 */
+#define CRC_T10DIF_POLY 0x8bb7
+
+uint16_t const crc_t10dif_table[256] = {
+    0x0000, 0x8BB7, 0x9CD9, 0x176E, 0xB205, 0x39B2, 0x2EDC, 0xA56B,
+    0xEFBD, 0x640A, 0x7364, 0xF8D3, 0x5DB8, 0xD60F, 0xC161, 0x4AD6,
+    0x54CD, 0xDF7A, 0xC814, 0x43A3, 0xE6C8, 0x6D7F, 0x7A11, 0xF1A6,
+    0xBB70, 0x30C7, 0x27A9, 0xAC1E, 0x0975, 0x82C2, 0x95AC, 0x1E1B,
+    0xA99A, 0x222D, 0x3543, 0xBEF4, 0x1B9F, 0x9028, 0x8746, 0x0CF1,
+    0x4627, 0xCD90, 0xDAFE, 0x5149, 0xF422, 0x7F95, 0x68FB, 0xE34C,
+    0xFD57, 0x76E0, 0x618E, 0xEA39, 0x4F52, 0xC4E5, 0xD38B, 0x583C,
+    0x12EA, 0x995D, 0x8E33, 0x0584, 0xA0EF, 0x2B58, 0x3C36, 0xB781,
+    0xD883, 0x5334, 0x445A, 0xCFED, 0x6A86, 0xE131, 0xF65F, 0x7DE8,
+    0x373E, 0xBC89, 0xABE7, 0x2050, 0x853B, 0x0E8C, 0x19E2, 0x9255,
+    0x8C4E, 0x07F9, 0x1097, 0x9B20, 0x3E4B, 0xB5FC, 0xA292, 0x2925,
+    0x63F3, 0xE844, 0xFF2A, 0x749D, 0xD1F6, 0x5A41, 0x4D2F, 0xC698,
+    0x7119, 0xFAAE, 0xEDC0, 0x6677, 0xC31C, 0x48AB, 0x5FC5, 0xD472,
+    0x9EA4, 0x1513, 0x027D, 0x89CA, 0x2CA1, 0xA716, 0xB078, 0x3BCF,
+    0x25D4, 0xAE63, 0xB90D, 0x32BA, 0x97D1, 0x1C66, 0x0B08, 0x80BF,
+    0xCA69, 0x41DE, 0x56B0, 0xDD07, 0x786C, 0xF3DB, 0xE4B5, 0x6F02,
+    0x3AB1, 0xB106, 0xA668, 0x2DDF, 0x88B4, 0x0303, 0x146D, 0x9FDA,
+    0xD50C, 0x5EBB, 0x49D5, 0xC262, 0x6709, 0xECBE, 0xFBD0, 0x7067,
+    0x6E7C, 0xE5CB, 0xF2A5, 0x7912, 0xDC79, 0x57CE, 0x40A0, 0xCB17,
+    0x81C1, 0x0A76, 0x1D18, 0x96AF, 0x33C4, 0xB873, 0xAF1D, 0x24AA,
+    0x932B, 0x189C, 0x0FF2, 0x8445, 0x212E, 0xAA99, 0xBDF7, 0x3640,
+    0x7C96, 0xF721, 0xE04F, 0x6BF8, 0xCE93, 0x4524, 0x524A, 0xD9FD,
+    0xC7E6, 0x4C51, 0x5B3F, 0xD088, 0x75E3, 0xFE54, 0xE93A, 0x628D,
+    0x285B, 0xA3EC, 0xB482, 0x3F35, 0x9A5E, 0x11E9, 0x0687, 0x8D30,
+    0xE232, 0x6985, 0x7EEB, 0xF55C, 0x5037, 0xDB80, 0xCCEE, 0x4759,
+    0x0D8F, 0x8638, 0x9156, 0x1AE1, 0xBF8A, 0x343D, 0x2353, 0xA8E4,
+    0xB6FF, 0x3D48, 0x2A26, 0xA191, 0x04FA, 0x8F4D, 0x9823, 0x1394,
+    0x5942, 0xD2F5, 0xC59B, 0x4E2C, 0xEB47, 0x60F0, 0x779E, 0xFC29,
+    0x4BA8, 0xC01F, 0xD771, 0x5CC6, 0xF9AD, 0x721A, 0x6574, 0xEEC3,
+    0xA415, 0x2FA2, 0x38CC, 0xB37B, 0x1610, 0x9DA7, 0x8AC9, 0x017E,
+    0x1F65, 0x94D2, 0x83BC, 0x080B, 0xAD60, 0x26D7, 0x31B9, 0xBA0E,
+    0xF0D8, 0x7B6F, 0x6C01, 0xE7B6, 0x42DD, 0xC96A, 0xDE04, 0x55B3
+};
+
+/*
+ * crc_t10dif_slice[k][b] is the CRC of byte b followed by k zero bytes, so
+ * that eight bytes can be folded into the CRC with eight independent lookups.
+ */
+static uint16_t crc_t10dif_slice[8][256];
+
+static void __attribute__((constructor)) crc_t10dif_init_slice(void)
+{
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        crc_t10dif_slice[0][i] = crc_t10dif_table[i];
+    }
+    for (k = 1; k < 8; k++) {
+        for (i = 0; i < 256; i++) {
+            uint16_t crc = crc_t10dif_slice[k - 1][i];
+
+            crc_t10dif_slice[k][i] = (crc << 8) ^ crc_t10dif_table[crc >> 8];
+        }
+    }
+}
+
+static uint16_t crc_t10dif_bytes(uint16_t crc, const uint8_t *buffer,
+                                 size_t len)
+{
+    while (len--) {
+        crc = crc_t10dif_byte(crc, *buffer++);
+    }
+    return crc;
+}
+
+static uint16_t crc_t10dif_generic(uint16_t crc, const uint8_t *buffer,
+                                   size_t len)
+{
+    for (; len >= 8; buffer += 8, len -= 8) {
+        crc = crc_t10dif_slice[7][buffer[0] ^ (crc >> 8)] ^
+              crc_t10dif_slice[6][buffer[1] ^ (crc & 0xff)] ^
+              crc_t10dif_slice[5][buffer[2]] ^
+              crc_t10dif_slice[4][buffer[3]] ^
+              crc_t10dif_slice[3][buffer[4]] ^
+              crc_t10dif_slice[2][buffer[5]] ^
+              crc_t10dif_slice[1][buffer[6]] ^
+              crc_t10dif_slice[0][buffer[7]];
+    }
+
+    return crc_t10dif_bytes(crc, buffer, len);
+}
+
+static uint16_t (*crc_t10dif_accel)(uint16_t, const uint8_t *, size_t) =
+    crc_t10dif_generic;
+
+#ifdef CONFIG_PCLMUL_OPT
+#pragma GCC push_options
+#pragma GCC target("ssse3,pclmul")
+#include <immintrin.h>
+#include "qemu/cpuid.h"
+
+/* x^n mod P, for the folding constants */
+static uint64_t crc_t10dif_xpow_mod(int n)
+{
+    uint32_t r = 1;
+
+    while (n--) {
+        r <<= 1;
+        if (r & 0x10000) {
+            r ^= 0x10000 | CRC_T10DIF_POLY;
+        }
+    }
+    return r;
+}
+
+static __m128i crc_t10dif_fold_k128, crc_t10dif_fold_k512;
+
+/*
+ * Each 16 byte block is loaded byte-reversed, so that bit 127 of the vector
+ * is the coefficient of the highest power of x.  The accumulator is kept
+ * congruent, modulo P, to the data processed so far: moving it over the next
+ * n bits of data is a multiplication by x^n, which is done separately for
+ * both halves with the constants x^(n + 64) mod P and x^n mod P.
+ */
+static inline __m128i crc_t10dif_fold(__m128i x, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+                         _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+static uint16_t crc_t10dif_pclmul(uint16_t crc, const uint8_t *buffer,
+                                  size_t len)
+{
+    const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                        7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i x0, x1, x2, x3;
+    uint8_t rem[16];
+
+    if (len < 64) {
+        return crc_t10dif_generic(crc, buffer, len);
+    }
+
+    /* The initial CRC is added to the first 16 bits of the message */
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer), bswap);
+    x0 = _mm_xor_si128(x0, _mm_insert_epi16(_mm_setzero_si128(), crc, 7));
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer + 1), bswap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer + 2), bswap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer + 3), bswap);
+    buffer += 64;
+    len -= 64;
+
+    for (; len >= 64; buffer += 64, len -= 64) {
+        const __m128i *p = (const __m128i *)buffer;
+
+        x0 = _mm_xor_si128(crc_t10dif_fold(x0, crc_t10dif_fold_k512),
+                           _mm_shuffle_epi8(_mm_loadu_si128(p), bswap));
+        x1 = _mm_xor_si128(crc_t10dif_fold(x1, crc_t10dif_fold_k512),
+                           _mm_shuffle_epi8(_mm_loadu_si128(p + 1), bswap));
+        x2 = _mm_xor_si128(crc_t10dif_fold(x2, crc_t10dif_fold_k512),
+                           _mm_shuffle_epi8(_mm_loadu_si128(p + 2), bswap));
+        x3 = _mm_xor_si128(crc_t10dif_fold(x3, crc_t10dif_fold_k512),
+                           _mm_shuffle_epi8(_mm_loadu_si128(p + 3), bswap));
+    }
+
+    x0 = _mm_xor_si128(crc_t10dif_fold(x0, crc_t10dif_fold_k128), x1);
+    x0 = _mm_xor_si128(crc_t10dif_fold(x0, crc_t10dif_fold_k128), x2);
+    x0 = _mm_xor_si128(crc_t10dif_fold(x0, crc_t10dif_fold_k128), x3);
+
+    for (; len >= 16; buffer += 16, len -= 16) {
+        x0 = _mm_xor_si128(crc_t10dif_fold(x0, crc_t10dif_fold_k128),
+                           _mm_shuffle_epi8(
+                               _mm_loadu_si128((const __m128i *)buffer),
+                               bswap));
+    }
+
+    /* The CRC of the accumulator is the CRC of everything so far */
+    _mm_storeu_si128((__m128i *)rem, _mm_shuffle_epi8(x0, bswap));
+    crc = crc_t10dif_generic(0, rem, sizeof(rem));
+
+    return crc_t10dif_generic(crc, buffer, len);
+}
+
+static void __attribute__((constructor)) crc_t10dif_init_accel(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+
+    if (max < 1) {
+        return;
+    }
+
+    __cpuid(1, a, b, c, d);
+    if ((c & bit_PCLMUL) && (c & bit_SSSE3)) {
+        crc_t10dif_fold_k128 = _mm_set_epi64x(crc_t10dif_xpow_mod(128 + 64),
+                                              crc_t10dif_xpow_mod(128));
+        crc_t10dif_fold_k512 = _mm_set_epi64x(crc_t10dif_xpow_mod(512 + 64),
+                                              crc_t10dif_xpow_mod(512));
+        crc_t10dif_accel = crc_t10dif_pclmul;
+    }
+}
+
+#pragma GCC pop_options
+#endif /* CONFIG_PCLMUL_OPT */
+
+/**
+ * crc_t10dif - recompute the T10 DIF CRC for the data buffer
+ *
+ * @crc: previous CRC value
+ * @buffer: data pointer
+ * @len: number of bytes in the buffer
+ */
+uint16_t crc_t10dif(uint16_t crc, const uint8_t *buffer, size_t len)
+{
+    return crc_t10dif_accel(crc, buffer, len);
+}
@@ -26,6 +26,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/crc32c.h"
 
 /*
@@ -105,11 +106,140 @@ static const uint32_t crc32c_table[256] = {
 };
 
 
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+static uint32_t crc32c_generic(uint32_t crc, const uint8_t *data, size_t length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
     }
-    return crc^0xffffffff;
+    return crc;
+}
+
+static uint32_t (*crc32c_accel)(uint32_t, const uint8_t *, size_t) =
+    crc32c_generic;
+
+#ifdef CONFIG_PCLMUL_OPT
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#include <immintrin.h>
+#include "qemu/cpuid.h"
+
+#ifdef __x86_64__
+/*
+ * Large buffers are processed as three interleaved streams of
+ * CRC32C_BLOCK bytes, which hides the latency of the CRC32 instruction.
+ * crc32c_shift_table[k][b] is the CRC state reached from b << 8k after
+ * CRC32C_BLOCK zero bytes, so that the streams can be chained together.
+ */
+#define CRC32C_BLOCK 512
+
+static uint32_t crc32c_shift_table[4][256];
+
+static uint32_t crc32c_shift(uint32_t crc)
+{
+    return crc32c_shift_table[0][crc & 0xff] ^
+           crc32c_shift_table[1][(crc >> 8) & 0xff] ^
+           crc32c_shift_table[2][(crc >> 16) & 0xff] ^
+           crc32c_shift_table[3][crc >> 24];
+}
+
+static void crc32c_init_shift_table(void)
+{
+    uint64_t crc;
+    int i, k, n;
+
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < 256; i++) {
+            crc = (uint32_t)i << (8 * k);
+            for (n = 0; n < CRC32C_BLOCK; n += 8) {
+                crc = _mm_crc32_u64(crc, 0);
+            }
+            crc32c_shift_table[k][i] = crc;
+        }
+    }
+}
+#endif
+
+/* The CRC32 instruction implements exactly the CRC-32C polynomial */
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length)
+{
+#ifdef __x86_64__
+    uint64_t crc64, b, c;
+    const uint8_t *end;
+#endif
+
+    for (; length && ((uintptr_t)data & 7); length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+#ifdef __x86_64__
+    crc64 = crc;
+    for (; length >= 3 * CRC32C_BLOCK; length -= 3 * CRC32C_BLOCK) {
+        b = c = 0;
+        for (end = data + CRC32C_BLOCK; data < end; data += 8) {
+            crc64 = _mm_crc32_u64(crc64, ldq_le_p(data));
+            b = _mm_crc32_u64(b, ldq_le_p(data + CRC32C_BLOCK));
+            c = _mm_crc32_u64(c, ldq_le_p(data + 2 * CRC32C_BLOCK));
+        }
+        crc64 = crc32c_shift(crc32c_shift(crc64) ^ b) ^ c;
+        data += 2 * CRC32C_BLOCK;
+    }
+    for (; length >= 8; data += 8, length -= 8) {
+        crc64 = _mm_crc32_u64(crc64, ldq_le_p(data));
+    }
+    crc = crc64;
+#endif
+    for (; length >= 4; data += 4, length -= 4) {
+        crc = _mm_crc32_u32(crc, ldl_le_p(data));
+    }
+    for (; length; length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+static void __attribute__((constructor)) crc32c_init_accel(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+
+    if (max < 1) {
+        return;
+    }
+
+    __cpuid(1, a, b, c, d);
+    if (c & bit_SSE4_2) {
+#ifdef __x86_64__
+        crc32c_init_shift_table();
+#endif
+        crc32c_accel = crc32c_sse42;
+    }
+}
+
+#pragma GCC pop_options
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *data, size_t length)
+{
+    for (; length && ((uintptr_t)data & 7); length--) {
+        crc = __crc32cb(crc, *data++);
+    }
+    for (; length >= 8; data += 8, length -= 8) {
+        crc = __crc32cd(crc, ldq_le_p(data));
+    }
+    for (; length; length--) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+
+static void __attribute__((constructor)) crc32c_init_accel(void)
+{
+    crc32c_accel = crc32c_armv8;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length) ^ 0xffffffff;
 }
 
@@ -34,6 +34,14 @@
  *    for events.  This operation self-cancels if another event completes
  *    before the timeout.
  *
+ * IORING_OP_POLL_ADD is one-shot and has to be re-armed after every event.
+ * Event notifiers use multishot polling (IORING_POLL_ADD_MULTI) instead when
+ * the kernel supports it, which saves an sqe and a re-arm in the kernel for
+ * every ioeventfd kick.  Multishot polling only reports new wakeups, so it is
+ * not used for arbitrary fds whose io_read handler may leave data behind; an
+ * event notifier handler always drains its eventfd.  A multishot poll stays
+ * armed as long as its cqes carry IORING_CQE_F_MORE.
+ *
  * io_uring calls the submission queue the "sq ring" and the completion queue
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
@@ -57,6 +65,21 @@ enum {
     FDMON_IO_URING_REMOVE   = (1 << 2),
 };
 
+#ifdef IORING_POLL_ADD_MULTI
+/* Cleared the first time the kernel rejects a multishot IORING_OP_POLL_ADD */
+static bool poll_multishot = true;
+
+static bool cqe_more(struct io_uring_cqe *cqe)
+{
+    return cqe->flags & IORING_CQE_F_MORE;
+}
+#else
+static bool cqe_more(struct io_uring_cqe *cqe)
+{
+    return false;
+}
+#endif
+
 static inline int poll_events_from_pfd(int pfd_events)
 {
     return (pfd_events & G_IO_IN ? POLLIN : 0) |
@@ -172,6 +195,11 @@ static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
     int events = poll_events_from_pfd(node->pfd.events);
 
     io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#ifdef IORING_POLL_ADD_MULTI
+    if (node->is_event_notifier && qatomic_read(&poll_multishot)) {
+        sqe->len |= IORING_POLL_ADD_MULTI;
+    }
+#endif
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -228,6 +256,19 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    if (cqe_more(cqe)) {
+        /*
+         * The multishot poll is still armed; if the handler is being
+         * removed, the IORING_OP_POLL_REMOVE will produce a final cqe.
+         */
+        if (qatomic_read(&node->flags) & FDMON_IO_URING_REMOVE) {
+            return false;
+        }
+        aio_add_ready_handler(ready_list, node,
+                              pfd_events_from_poll(cqe->res));
+        return true;
+    }
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -239,9 +280,22 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+#ifdef IORING_POLL_ADD_MULTI
+    if (cqe->res == -EINVAL && node->is_event_notifier &&
+        qatomic_read(&poll_multishot)) {
+        /* Kernels before 5.13 do not know about IORING_POLL_ADD_MULTI */
+        qatomic_set(&poll_multishot, false);
+        add_poll_add_sqe(ctx, node);
+        return false;
+    }
+#endif
+
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
+    /*
+     * IORING_OP_POLL_ADD is one-shot, and the kernel may also terminate a
+     * multishot poll, so we must re-arm it
+     */
     add_poll_add_sqe(ctx, node);
     return true;
 }
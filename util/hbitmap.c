@@ -864,6 +864,42 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/*
+ * In-place merge of @src into @dst, which must have the same size and
+ * granularity.  The upper levels are small and simply ORed together; words
+ * of the last level are only visited if the level above says they are
+ * non-zero in @src, so merging a sparse bitmap into a large one is cheap.
+ */
+static void hbitmap_merge_into(HBitmap *dst, const HBitmap *src)
+{
+    const int last = HBITMAP_LEVELS - 1;
+    uint64_t i, j;
+    int lvl;
+
+    for (lvl = 0; lvl < last; lvl++) {
+        for (i = 0; i < src->sizes[lvl]; i++) {
+            dst->levels[lvl][i] |= src->levels[lvl][i];
+        }
+    }
+
+    for (i = 0; i < src->sizes[last - 1]; i++) {
+        unsigned long parent = src->levels[last - 1][i];
+
+        while (parent) {
+            unsigned long old;
+
+            j = i * BITS_PER_LONG + ctzl(parent);
+            parent &= parent - 1;
+            if (j >= src->sizes[last]) {
+                break;
+            }
+            old = dst->levels[last][j];
+            dst->levels[last][j] |= src->levels[last][j];
+            dst->count += ctpopl(dst->levels[last][j] & ~old);
+        }
+    }
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -905,11 +941,16 @@ bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return true;
     }
 
+    assert(a->size == b->size);
+    if (result == a || result == b) {
+        hbitmap_merge_into(result, result == a ? b : a);
+        return true;
+    }
+
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
      * It may be possible to improve running times for sparsely populated maps
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
-    assert(a->size == b->size);
     for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
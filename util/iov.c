@@ -79,6 +79,27 @@ size_t iov_memset(const struct iovec *iov, const unsigned int iov_cnt,
     return done;
 }
 
+bool iov_is_zero(const struct iovec *iov, const unsigned int iov_cnt,
+                 size_t offset, size_t bytes)
+{
+    size_t done;
+    unsigned int i;
+    for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
+        if (offset < iov[i].iov_len) {
+            size_t len = MIN(iov[i].iov_len - offset, bytes - done);
+            if (!buffer_is_zero(iov[i].iov_base + offset, len)) {
+                return false;
+            }
+            done += len;
+            offset = 0;
+        } else {
+            offset -= iov[i].iov_len;
+        }
+    }
+    assert(offset == 0);
+    return true;
+}
+
 size_t iov_size(const struct iovec *iov, const unsigned int iov_cnt)
 {
     size_t len;
@@ -272,9 +293,28 @@ void qemu_iovec_init(QEMUIOVector *qiov, int alloc_hint)
     qiov->iov = g_new(struct iovec, alloc_hint);
     qiov->niov = 0;
     qiov->nalloc = alloc_hint;
+    qiov->local_iov.iov_base = NULL;
+    qiov->size = 0;
+}
+
+void qemu_iovec_init_storage(QEMUIOVector *qiov,
+                             struct iovec *storage, int nstorage)
+{
+    assert(nstorage > 0);
+
+    qiov->iov = storage;
+    qiov->niov = 0;
+    qiov->nalloc = nstorage;
+    qiov->local_iov.iov_base = storage;
     qiov->size = 0;
 }
 
+/* Whether @iov of an allocated QEMUIOVector is still the caller's storage */
+static bool qiov_uses_storage(QEMUIOVector *qiov)
+{
+    return qiov->iov == qiov->local_iov.iov_base;
+}
+
 void qemu_iovec_init_external(QEMUIOVector *qiov, struct iovec *iov, int niov)
 {
     int i;
@@ -293,7 +333,15 @@ void qemu_iovec_add(QEMUIOVector *qiov, void *base, size_t len)
 
     if (qiov->niov == qiov->nalloc) {
         qiov->nalloc = 2 * qiov->nalloc + 1;
-        qiov->iov = g_renew(struct iovec, qiov->iov, qiov->nalloc);
+        if (qiov_uses_storage(qiov)) {
+            struct iovec *storage = qiov->iov;
+
+            qiov->iov = g_new(struct iovec, qiov->nalloc);
+            memcpy(qiov->iov, storage, qiov->niov * sizeof(*storage));
+            qiov->local_iov.iov_base = NULL;
+        } else {
+            qiov->iov = g_renew(struct iovec, qiov->iov, qiov->nalloc);
+        }
     }
     qiov->iov[qiov->niov].iov_base = base;
     qiov->iov[qiov->niov].iov_len = len;
@@ -448,6 +496,7 @@ int qemu_iovec_init_extended(
         p = &qiov->local_iov;
     } else {
         qiov->niov = qiov->nalloc = total_niov;
+        qiov->local_iov.iov_base = NULL;
         qiov->size = head_len + mid_len + tail_len;
         p = qiov->iov = g_new(struct iovec, qiov->niov);
     }
@@ -480,27 +529,9 @@ int qemu_iovec_init_extended(
  */
 bool qemu_iovec_is_zero(QEMUIOVector *qiov, size_t offset, size_t bytes)
 {
-    struct iovec *iov;
-    size_t current_offset;
-
     assert(offset + bytes <= qiov->size);
 
-    iov = iov_skip_offset(qiov->iov, offset, &current_offset);
-
-    while (bytes) {
-        uint8_t *base = (uint8_t *)iov->iov_base + current_offset;
-        size_t len = MIN(iov->iov_len - current_offset, bytes);
-
-        if (!buffer_is_zero(base, len)) {
-            return false;
-        }
-
-        current_offset = 0;
-        bytes -= len;
-        iov++;
-    }
-
-    return true;
+    return iov_is_zero(qiov->iov, qiov->niov, offset, bytes);
 }
 
 void qemu_iovec_init_slice(QEMUIOVector *qiov, QEMUIOVector *source,
@@ -518,7 +549,7 @@ void qemu_iovec_init_slice(QEMUIOVector *qiov, QEMUIOVector *source,
 
 void qemu_iovec_destroy(QEMUIOVector *qiov)
 {
-    if (qiov->nalloc != -1) {
+    if (qiov->nalloc != -1 && !qiov_uses_storage(qiov)) {
         g_free(qiov->iov);
     }
 
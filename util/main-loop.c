@@ -171,6 +171,7 @@ int qemu_init_main_loop(Error **errp)
         return -EMFILE;
     }
     qemu_set_current_aio_context(qemu_aio_context);
+    aio_context_register_stats(qemu_aio_context, "main-loop");
     qemu_notify_bh = qemu_bh_new(notify_event_cb, NULL);
     gpollfds = g_array_new(FALSE, FALSE, sizeof(GPollFD));
     src = aio_get_g_source(qemu_aio_context);
@@ -40,9 +40,11 @@
 #include <libgen.h>
 #include "qemu/cutils.h"
 #include "qemu/compiler.h"
+#include "qemu/bitops.h"
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
+#include <sched.h>
 #endif
 
 #ifdef __FreeBSD__
@@ -77,6 +79,9 @@ struct MemsetThread {
     char *addr;
     size_t numpages;
     size_t hpagesize;
+#ifdef CONFIG_LINUX
+    cpu_set_t *cpus;
+#endif
     QemuThread pgthread;
     sigjmp_buf env;
 };
@@ -85,6 +90,7 @@ typedef struct MemsetThread MemsetThread;
 static MemsetThread *memset_thread;
 static int memset_num_threads;
 static bool memset_thread_failed;
+static struct sigaction sigbus_oldact;
 
 static QemuMutex page_mutex;
 static QemuCond page_cond;
@@ -436,7 +442,7 @@ const char *qemu_get_exec_dir(void)
     return exec_dir;
 }
 
-static void sigbus_handler(int signal)
+static void sigbus_handler(int signal, siginfo_t *siginfo, void *ctx)
 {
     int i;
     if (memset_thread) {
@@ -446,6 +452,24 @@ static void sigbus_handler(int signal)
             }
         }
     }
+
+    /*
+     * os_mem_prealloc() can run while the guest is running, e.g. for
+     * virtio-mem.  A SIGBUS in another thread, such as a machine check
+     * on a vCPU thread, belongs to the handler that was installed before.
+     */
+    if (sigbus_oldact.sa_flags & SA_SIGINFO) {
+        sigbus_oldact.sa_sigaction(signal, siginfo, ctx);
+    } else if (sigbus_oldact.sa_handler == SIG_DFL) {
+        struct sigaction act;
+
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = SIG_DFL;
+        sigaction(SIGBUS, &act, NULL);
+        raise(SIGBUS);
+    } else if (sigbus_oldact.sa_handler != SIG_IGN) {
+        sigbus_oldact.sa_handler(signal);
+    }
 }
 
 static void *do_touch_pages(void *arg)
@@ -453,6 +477,17 @@ static void *do_touch_pages(void *arg)
     MemsetThread *memset_args = (MemsetThread *)arg;
     sigset_t set, oldset;
 
+#ifdef CONFIG_LINUX
+    /*
+     * Run on the host nodes the memory is bound to, so that the pages
+     * are cleared by a local CPU.  This is only an optimization, so
+     * errors are ignored.
+     */
+    if (memset_args->cpus) {
+        sched_setaffinity(0, sizeof(cpu_set_t), memset_args->cpus);
+    }
+#endif
+
     /*
      * On Linux, the page faults from the loop below can cause mmap_sem
      * contention with allocation of the thread stacks.  Do not start
@@ -509,13 +544,94 @@ static inline int get_memset_num_threads(int smp_cpus)
     return ret;
 }
 
+#ifdef CONFIG_LINUX
+/*
+ * Fill @cpus with the host CPUs of the NUMA nodes set in @host_nodes
+ * that QEMU is allowed to run on.  Returns false if there are none,
+ * e.g. because the nodes only have memory, sysfs is not available or
+ * QEMU was started with an affinity that excludes them.
+ */
+static bool get_host_node_cpus(const unsigned long *host_nodes,
+                               unsigned long max_node, cpu_set_t *cpus)
+{
+    cpu_set_t allowed;
+    unsigned long node;
+
+    CPU_ZERO(cpus);
+    for (node = find_first_bit(host_nodes, max_node); node < max_node;
+         node = find_next_bit(host_nodes, max_node, node + 1)) {
+        g_autofree char *path = NULL;
+        g_autofree char *cpulist = NULL;
+        g_auto(GStrv) ranges = NULL;
+        int i;
+
+        path = g_strdup_printf("/sys/devices/system/node/node%lu/cpulist",
+                               node);
+        if (!g_file_get_contents(path, &cpulist, NULL, NULL)) {
+            continue;
+        }
+
+        /* The format is a comma-separated list of CPUs or CPU ranges */
+        ranges = g_strsplit(g_strstrip(cpulist), ",", -1);
+        for (i = 0; ranges[i]; i++) {
+            const char *end;
+            unsigned long first, last, cpu;
+
+            if (qemu_strtoul(ranges[i], &end, 10, &first) < 0) {
+                continue;
+            }
+            last = first;
+            if (*end == '-' && qemu_strtoul(end + 1, NULL, 10, &last) < 0) {
+                continue;
+            }
+            for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, cpus);
+            }
+        }
+    }
+
+    /* Do not widen an affinity set up by the user, e.g. with taskset */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        CPU_AND(cpus, cpus, &allowed);
+    }
+
+    return CPU_COUNT(cpus) > 0;
+}
+#endif
+
+int os_thread_set_node_affinity(QemuThread *thread,
+                                const unsigned long *host_nodes,
+                                unsigned long max_node)
+{
+#ifdef CONFIG_LINUX
+    cpu_set_t cpus;
+
+    if (!get_host_node_cpus(host_nodes, max_node, &cpus)) {
+        return -ENOENT;
+    }
+    return -pthread_setaffinity_np(thread->thread, sizeof(cpus), &cpus);
+#else
+    return -ENOSYS;
+#endif
+}
+
 static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                            int smp_cpus)
+                            int smp_cpus, const unsigned long *host_nodes,
+                            unsigned long max_node)
 {
     static gsize initialized = 0;
     size_t numpages_per_thread, leftover;
     char *addr = area;
     int i = 0;
+#ifdef CONFIG_LINUX
+    cpu_set_t cpus, *memset_cpus = NULL;
+
+    if (host_nodes && get_host_node_cpus(host_nodes, max_node, &cpus)) {
+        memset_cpus = &cpus;
+        /* More threads than CPUs would only compete for them */
+        smp_cpus = MIN(smp_cpus, CPU_COUNT(&cpus));
+    }
+#endif
 
     if (g_once_init_enter(&initialized)) {
         qemu_mutex_init(&page_mutex);
@@ -533,6 +649,9 @@ static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         memset_thread[i].addr = addr;
         memset_thread[i].numpages = numpages_per_thread + (i < leftover);
         memset_thread[i].hpagesize = hpagesize;
+#ifdef CONFIG_LINUX
+        memset_thread[i].cpus = memset_cpus;
+#endif
         qemu_thread_create(&memset_thread[i].pgthread, "touch_pages",
                            do_touch_pages, &memset_thread[i],
                            QEMU_THREAD_JOINABLE);
@@ -554,18 +673,19 @@ static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
 }
 
 void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+                     const unsigned long *host_nodes, unsigned long max_node,
                      Error **errp)
 {
     int ret;
-    struct sigaction act, oldact;
+    struct sigaction act;
     size_t hpagesize = qemu_fd_getpagesize(fd);
     size_t numpages = DIV_ROUND_UP(memory, hpagesize);
 
     memset(&act, 0, sizeof(act));
-    act.sa_handler = &sigbus_handler;
-    act.sa_flags = 0;
+    act.sa_sigaction = &sigbus_handler;
+    act.sa_flags = SA_SIGINFO;
 
-    ret = sigaction(SIGBUS, &act, &oldact);
+    ret = sigaction(SIGBUS, &act, &sigbus_oldact);
     if (ret) {
         error_setg_errno(errp, errno,
             "os_mem_prealloc: failed to install signal handler");
@@ -573,12 +693,13 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 
     /* touch pages simultaneously */
-    if (touch_all_pages(area, hpagesize, numpages, smp_cpus)) {
+    if (touch_all_pages(area, hpagesize, numpages, smp_cpus,
+                        host_nodes, max_node)) {
         error_setg(errp, "os_mem_prealloc: Insufficient free host memory "
             "pages available to allocate guest RAM");
     }
 
-    ret = sigaction(SIGBUS, &oldact, NULL);
+    ret = sigaction(SIGBUS, &sigbus_oldact, NULL);
     if (ret) {
         /* Terminate QEMU since it can't recover from error */
         perror("os_mem_prealloc: failed to reinstall signal handler");
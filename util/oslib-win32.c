@@ -371,6 +371,7 @@ int getpagesize(void)
 }
 
 void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+                     const unsigned long *host_nodes, unsigned long max_node,
                      Error **errp)
 {
     int i;
@@ -382,6 +383,13 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+int os_thread_set_node_affinity(struct QemuThread *thread,
+                                const unsigned long *host_nodes,
+                                unsigned long max_node)
+{
+    return -ENOSYS;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     /* XXX Implement me */
@@ -31,6 +31,8 @@
 #include "qemu/coroutine_int.h"
 #include "qemu/processor.h"
 #include "qemu/queue.h"
+#include "qemu/qsp.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
 #include "trace.h"
 
@@ -232,7 +234,8 @@ static void coroutine_fn qemu_co_mutex_lock_slowpath(AioContext *ctx,
     trace_qemu_co_mutex_lock_return(mutex, self);
 }
 
-void coroutine_fn qemu_co_mutex_lock(CoMutex *mutex)
+void coroutine_fn qemu_co_mutex_lock_impl(CoMutex *mutex,
+                                          const char *file, int line)
 {
     AioContext *ctx = qemu_get_current_aio_context();
     Coroutine *self = qemu_coroutine_self();
@@ -265,6 +268,11 @@ retry_fast_path:
         /* Uncontended.  */
         trace_qemu_co_mutex_lock_uncontended(mutex, self);
         mutex->ctx = ctx;
+    } else if (unlikely(qsp_is_enabled())) {
+        int64_t t0 = get_clock();
+
+        qemu_co_mutex_lock_slowpath(ctx, mutex);
+        qsp_co_mutex_record(mutex, file, line, get_clock() - t0);
     } else {
         qemu_co_mutex_lock_slowpath(ctx, mutex);
     }
@@ -272,6 +280,11 @@ retry_fast_path:
     self->locks_held++;
 }
 
+void coroutine_fn (qemu_co_mutex_lock)(CoMutex *mutex)
+{
+    qemu_co_mutex_lock(mutex);
+}
+
 void coroutine_fn qemu_co_mutex_unlock(CoMutex *mutex)
 {
     Coroutine *self = qemu_coroutine_self();
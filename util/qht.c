@@ -525,15 +525,14 @@ void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
-void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
-                        qht_lookup_func_t func)
+static inline void *qht_map_lookup(const struct qht_map *map,
+                                   const void *userp, uint32_t hash,
+                                   qht_lookup_func_t func)
 {
     const struct qht_bucket *b;
-    const struct qht_map *map;
     unsigned int version;
     void *ret;
 
-    map = qatomic_rcu_read(&ht->map);
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -548,11 +547,35 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
     return qht_lookup__slowpath(b, func, userp, hash);
 }
 
+void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
+                        qht_lookup_func_t func)
+{
+    return qht_map_lookup(qatomic_rcu_read(&ht->map), userp, hash, func);
+}
+
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash)
 {
     return qht_lookup_custom(ht, userp, hash, ht->cmp);
 }
 
+size_t qht_lookup_batch(const struct qht *ht, const void *const *userps,
+                        const uint32_t *hashes, void **results, size_t n)
+{
+    const struct qht_map *map;
+    size_t found = 0;
+    size_t i;
+
+    map = qatomic_rcu_read(&ht->map);
+    for (i = 0; i < n; i++) {
+        __builtin_prefetch(qht_map_to_bucket(map, hashes[i]));
+    }
+    for (i = 0; i < n; i++) {
+        results[i] = qht_map_lookup(map, userps[i], hashes[i], ht->cmp);
+        found += !!results[i];
+    }
+    return found;
+}
+
 /*
  * call with head->lock held
  * @ht is const since it is only used for ht->cmp()
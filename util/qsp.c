@@ -70,6 +70,8 @@ enum QSPType {
     QSP_BQL_MUTEX,
     QSP_REC_MUTEX,
     QSP_CONDVAR,
+    QSP_CO_MUTEX,
+    QSP_BQL_HOLD,
 };
 
 struct QSPCallSite {
@@ -122,6 +124,8 @@ static const char * const qsp_typenames[] = {
     [QSP_BQL_MUTEX] = "BQL mutex",
     [QSP_REC_MUTEX] = "rec_mutex",
     [QSP_CONDVAR]   = "condvar",
+    [QSP_CO_MUTEX]  = "co_mutex",
+    [QSP_BQL_HOLD]  = "BQL hold",
 };
 
 QemuMutexLockFunc qemu_bql_mutex_lock_func = qemu_mutex_lock_impl;
@@ -430,6 +434,31 @@ qsp_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms,
     return ret;
 }
 
+/*
+ * Coroutine mutexes are not wrapped through a function pointer like the
+ * thread primitives: the fast path stays untouched, and only waits for a
+ * contended CoMutex are recorded.
+ */
+void qsp_co_mutex_record(const void *mutex, const char *file, int line,
+                         int64_t ns)
+{
+    QSPEntry *e = qsp_entry_get(mutex, file, line, QSP_CO_MUTEX);
+
+    qsp_entry_record(e, ns);
+}
+
+/*
+ * For this type the recorded time is how long the lock was held rather
+ * than how long it took to acquire it.
+ */
+void qsp_bql_hold_record(const void *mutex, const char *file, int line,
+                         int64_t ns)
+{
+    QSPEntry *e = qsp_entry_get(mutex, file, line, QSP_BQL_HOLD);
+
+    qsp_entry_record(e, ns);
+}
+
 bool qsp_is_enabled(void)
 {
     return qatomic_read(&qemu_mutex_lock_func) == qsp_mutex_lock;
@@ -0,0 +1,146 @@
+/*
+ * Registry of performance counters
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/stats.h"
+
+typedef struct StatsEntry {
+    char *provider;
+    char *instance;
+    char *name;
+    Stat64 *counter;
+    StatsHistogram *hist;
+    StatsGetFunc *get;
+    void *opaque;
+    QTAILQ_ENTRY(StatsEntry) next;
+} StatsEntry;
+
+static QemuMutex stats_lock;
+static QTAILQ_HEAD(, StatsEntry) stats_entries =
+    QTAILQ_HEAD_INITIALIZER(stats_entries);
+
+static unsigned int stats_histogram_bucket(uint64_t ns)
+{
+    uint64_t us = ns / SCALE_US;
+
+    if (!us) {
+        return 0;
+    }
+    return MIN(64 - clz64(us), STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void stats_histogram_add(StatsHistogram *hist, uint64_t ns)
+{
+    stat64_add(&hist->count, 1);
+    stat64_add(&hist->total, ns);
+    stat64_min(&hist->min, ns);
+    stat64_max(&hist->max, ns);
+    stat64_add(&hist->buckets[stats_histogram_bucket(ns)], 1);
+}
+
+void stats_histogram_reset(StatsHistogram *hist)
+{
+    int i;
+
+    stat64_init(&hist->count, 0);
+    stat64_init(&hist->total, 0);
+    stat64_init(&hist->min, UINT64_MAX);
+    stat64_init(&hist->max, 0);
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        stat64_init(&hist->buckets[i], 0);
+    }
+}
+
+static StatsEntry *stats_entry_new(const char *provider,
+                                   const char *instance, const char *name)
+{
+    StatsEntry *e = g_new0(StatsEntry, 1);
+
+    e->provider = g_strdup(provider);
+    e->instance = g_strdup(instance);
+    e->name = g_strdup(name);
+    return e;
+}
+
+static void stats_insert(StatsEntry *e)
+{
+    qemu_mutex_lock(&stats_lock);
+    QTAILQ_INSERT_TAIL(&stats_entries, e, next);
+    qemu_mutex_unlock(&stats_lock);
+}
+
+void stats_register_counter(const char *provider, const char *instance,
+                            const char *name, Stat64 *counter)
+{
+    StatsEntry *e = stats_entry_new(provider, instance, name);
+
+    e->counter = counter;
+    stats_insert(e);
+}
+
+void stats_register_histogram(const char *provider, const char *instance,
+                              const char *name, StatsHistogram *hist)
+{
+    StatsEntry *e = stats_entry_new(provider, instance, name);
+
+    e->hist = hist;
+    stats_insert(e);
+}
+
+void stats_register_func(const char *provider, const char *instance,
+                         const char *name, StatsGetFunc *get, void *opaque)
+{
+    StatsEntry *e = stats_entry_new(provider, instance, name);
+
+    e->get = get;
+    e->opaque = opaque;
+    stats_insert(e);
+}
+
+void stats_unregister(const char *provider, const char *instance)
+{
+    StatsEntry *e, *next;
+
+    qemu_mutex_lock(&stats_lock);
+    QTAILQ_FOREACH_SAFE(e, &stats_entries, next, next) {
+        if (g_str_equal(e->provider, provider) &&
+            g_strcmp0(e->instance, instance) == 0) {
+            QTAILQ_REMOVE(&stats_entries, e, next);
+            g_free(e->provider);
+            g_free(e->instance);
+            g_free(e->name);
+            g_free(e);
+        }
+    }
+    qemu_mutex_unlock(&stats_lock);
+}
+
+void stats_foreach(StatsForeachFunc *fn, void *opaque)
+{
+    StatsEntry *e;
+    uint64_t value;
+
+    qemu_mutex_lock(&stats_lock);
+    QTAILQ_FOREACH(e, &stats_entries, next) {
+        if (e->hist) {
+            fn(e->provider, e->instance, e->name, NULL, e->hist, opaque);
+            continue;
+        }
+        value = e->counter ? stat64_get(e->counter) : e->get(e->opaque);
+        fn(e->provider, e->instance, e->name, &value, NULL, opaque);
+    }
+    qemu_mutex_unlock(&stats_lock);
+}
+
+static void __attribute__((__constructor__)) stats_init(void)
+{
+    qemu_mutex_init(&stats_lock);
+}
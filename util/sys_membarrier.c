@@ -19,6 +19,13 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+/*
+ * MEMBARRIER_CMD_SHARED waits for a scheduler grace period, which can take
+ * milliseconds.  The private expedited command instead sends IPIs to the
+ * CPUs running this process, so use it whenever the kernel has it.
+ */
+static int membarrier_cmd = MEMBARRIER_CMD_SHARED;
 #endif
 
 void smp_mb_global(void)
@@ -26,7 +33,12 @@ void smp_mb_global(void)
 #if defined CONFIG_WIN32
     FlushProcessWriteBuffers();
 #elif defined CONFIG_LINUX
-    membarrier(MEMBARRIER_CMD_SHARED, 0);
+    if (membarrier(membarrier_cmd, 0) < 0 &&
+        membarrier_cmd != MEMBARRIER_CMD_SHARED) {
+        /* Not registered, e.g. in a child process; use the slow path.  */
+        membarrier_cmd = MEMBARRIER_CMD_SHARED;
+        membarrier(MEMBARRIER_CMD_SHARED, 0);
+    }
 #else
 #error --enable-membarrier is not supported on this operating system.
 #endif
@@ -41,6 +53,13 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+#ifdef CONFIG_MEMBARRIER_PRIVATE_EXPEDITED
+    if ((ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+        return;
+    }
+#endif
     if (!(ret & MEMBARRIER_CMD_SHARED)) {
         error_report("This QEMU binary requires MEMBARRIER_CMD_SHARED support.");
         error_report("Please upgrade your system to a newer version of Linux");
@@ -50,6 +50,9 @@ struct ThreadPoolElement {
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
+
+    /* Linked into completed_list once the element reaches THREAD_DONE.  */
+    QSLIST_ENTRY(ThreadPoolElement) completed;
 };
 
 struct ThreadPool {
@@ -63,6 +66,10 @@ struct ThreadPool {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    QSLIST_HEAD(, ThreadPoolElement) completion_batch;
+
+    /* Requests that are done, pushed without taking the lock.  */
+    QSLIST_HEAD(, ThreadPoolElement) completed_list;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
@@ -107,10 +114,10 @@ static void *worker_thread(void *opaque)
         /* Write ret before state.  */
         smp_wmb();
         req->state = THREAD_DONE;
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->completed_list, req, completed);
+        qemu_bh_schedule(pool->completion_bh);
 
         qemu_mutex_lock(&pool->lock);
-
-        qemu_bh_schedule(pool->completion_bh);
     }
 
     pool->cur_threads--;
@@ -159,17 +166,37 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+/*
+ * Grab everything the workers have finished in one go.  The batch lives in
+ * the pool rather than on the stack so that a nested invocation (from a
+ * callback that calls aio_poll()) keeps draining it.
+ */
+static bool thread_pool_fill_completion_batch(ThreadPool *pool)
+{
+    QSLIST_HEAD(, ThreadPoolElement) done;
+    ThreadPoolElement *elem;
+
+    QSLIST_MOVE_ATOMIC(&done, &pool->completed_list);
+
+    /* Workers push to the head; reverse to complete in FIFO order.  */
+    while ((elem = QSLIST_FIRST(&done)) != NULL) {
+        QSLIST_REMOVE_HEAD(&done, completed);
+        QSLIST_INSERT_HEAD(&pool->completion_batch, elem, completed);
+    }
+    return !QSLIST_EMPTY(&pool->completion_batch);
+}
+
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     aio_context_acquire(pool->ctx);
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
-        }
+    while (!QSLIST_EMPTY(&pool->completion_batch) ||
+           thread_pool_fill_completion_batch(pool)) {
+        elem = QSLIST_FIRST(&pool->completion_batch);
+        QSLIST_REMOVE_HEAD(&pool->completion_batch, completed);
+        assert(elem->state == THREAD_DONE);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -189,16 +216,12 @@ restart:
             aio_context_acquire(pool->ctx);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because we keep looping
+             * until completed_list is empty.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
     aio_context_release(pool->ctx);
 }
@@ -219,10 +242,11 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->completed_list, elem, completed);
+        qemu_bh_schedule(pool->completion_bh);
     }
 
 }
@@ -310,6 +334,8 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
+    QSLIST_INIT(&pool->completion_batch);
+    QSLIST_INIT(&pool->completed_list);
     QTAILQ_INIT(&pool->request_list);
 }
 
@@ -28,6 +28,23 @@
 #include "qemu/timer.h"
 #include "block/aio.h"
 
+/*
+ * A throttled request never waits less than this.  With high limits the
+ * exact wait would be a few microseconds, and the timer would then fire
+ * once per request; rounding it up lets the bucket leak enough for a
+ * batch of queued requests to go through on each wakeup.  The average
+ * rate is unaffected since the bucket leaks continuously.
+ */
+#define THROTTLE_TIMER_SLACK_NS (1 * SCALE_MS)
+
+/* the buckets that apply to each type of operation (read/write) */
+static const BucketType throttle_buckets_for[2][4] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_OPS_TOTAL,
+      THROTTLE_BPS_READ, THROTTLE_OPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_OPS_TOTAL,
+      THROTTLE_BPS_WRITE, THROTTLE_OPS_WRITE },
+};
+
 /* This function make a bucket leak
  *
  * @bkt:   the bucket to make leak
@@ -142,19 +159,11 @@ int64_t throttle_compute_wait(LeakyBucket *bkt)
 static int64_t throttle_compute_wait_for(ThrottleState *ts,
                                          bool is_write)
 {
-    BucketType to_check[2][4] = { {THROTTLE_BPS_TOTAL,
-                                   THROTTLE_OPS_TOTAL,
-                                   THROTTLE_BPS_READ,
-                                   THROTTLE_OPS_READ},
-                                  {THROTTLE_BPS_TOTAL,
-                                   THROTTLE_OPS_TOTAL,
-                                   THROTTLE_BPS_WRITE,
-                                   THROTTLE_OPS_WRITE}, };
     int64_t wait, max_wait = 0;
     int i;
 
     for (i = 0; i < 4; i++) {
-        BucketType index = to_check[is_write][i];
+        BucketType index = throttle_buckets_for[is_write][i];
         wait = throttle_compute_wait(&ts->cfg.buckets[index]);
         if (wait > max_wait) {
             max_wait = wait;
@@ -186,7 +195,7 @@ static bool throttle_compute_timer(ThrottleState *ts,
 
     /* if the code must wait compute when the next timer should fire */
     if (wait) {
-        *next_timestamp = now + wait;
+        *next_timestamp = now + MAX(wait, THROTTLE_TIMER_SLACK_NS);
         return true;
     }
 
@@ -295,6 +304,25 @@ bool throttle_enabled(ThrottleConfig *cfg)
     return false;
 }
 
+/* Does any throttling must be done for one type of operation
+ *
+ * @cfg:      the throttling configuration to inspect
+ * @is_write: the type of operation (read/write)
+ * @ret:      true if operations of this type can be throttled else false
+ */
+bool throttle_enabled_for(ThrottleConfig *cfg, bool is_write)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (cfg->buckets[throttle_buckets_for[is_write][i]].avg > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /* check if a throttling configuration is valid
  * @cfg: the throttling configuration to inspect
  * @ret: true if valid else false
@@ -8,6 +8,8 @@
  * later.  See the COPYING file in the top-level directory.
  */
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/host-utils.h"
 #include "qemu/main-loop.h"
 #include "qemu/vhost-user-server.h"
 #include "block/aio-wait.h"
@@ -39,6 +41,12 @@
  * When vu_client_trip() has finished cleaning up it schedules a BH in the main
  * loop thread to accept the next client connection.
  *
+ * While the AioContext is in polling mode (see the poll-max-ns property of
+ * IOThreads), virtqueues are polled for new requests instead of waiting for
+ * kicks, and kicks are suppressed.  Completions are signalled to the client
+ * with vhost_user_server_queue_notify(), which coalesces the call fd writes
+ * of all completions in one event loop iteration.
+ *
  * When libvhost-user detects an error it calls panic_cb() and sets the
  * dev->broken flag. Both vu_client_trip() and kick fd processing stop when
  * the dev->broken flag is set.
@@ -168,6 +176,41 @@ fail:
     return false;
 }
 
+static void vu_notify_bh(void *opaque)
+{
+    VuServer *server = opaque;
+    VuDev *vu_dev = &server->vu_dev;
+    unsigned nvqs = server->max_queues;
+    unsigned long bitmap[BITS_TO_LONGS(nvqs)];
+    unsigned j;
+
+    memcpy(bitmap, server->notify_vqs, sizeof(bitmap));
+    memset(server->notify_vqs, 0, sizeof(bitmap));
+
+    for (j = 0; j < nvqs; j += BITS_PER_LONG) {
+        unsigned long bits = bitmap[j / BITS_PER_LONG];
+
+        while (bits != 0) {
+            unsigned i = j + ctzl(bits);
+
+            vu_queue_notify(vu_dev, vu_get_queue(vu_dev, i));
+
+            bits &= bits - 1; /* clear right-most bit */
+        }
+    }
+}
+
+void vhost_user_server_queue_notify(VuServer *server, VuVirtq *vq)
+{
+    /* The client is already gone */
+    if (!server->notify_bh) {
+        return;
+    }
+
+    set_bit(vq - server->vu_dev.vq, server->notify_vqs);
+    qemu_bh_schedule(server->notify_bh);
+}
+
 static coroutine_fn void vu_client_trip(void *opaque)
 {
     VuServer *server = opaque;
@@ -177,6 +220,11 @@ static coroutine_fn void vu_client_trip(void *opaque)
         /* Keep running */
     }
 
+    /* Final chance to notify the client */
+    qemu_bh_delete(server->notify_bh);
+    server->notify_bh = NULL;
+    vu_notify_bh(server);
+
     vu_deinit(vu_dev);
 
     /* vu_deinit() should have called remove_watch() */
@@ -217,6 +265,60 @@ static void kick_handler(void *opaque)
     }
 }
 
+/*
+ * libvhost-user only watches kick fds, and passes the virtqueue index as
+ * the opaque pointer.
+ */
+static VuVirtq *vu_fd_watch_get_queue(VuFdWatch *vu_fd_watch)
+{
+    return vu_get_queue(vu_fd_watch->vu_dev, (intptr_t)vu_fd_watch->pvt);
+}
+
+static bool kick_poll_handler(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+    VuVirtq *vq = vu_fd_watch_get_queue(vu_fd_watch);
+
+    if (!vq->handler || vu_queue_empty(vu_dev, vq)) {
+        return false;
+    }
+
+    vq->handler(vu_dev, (intptr_t)vu_fd_watch->pvt);
+
+    if (vu_dev->broken) {
+        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+
+        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    }
+    return true;
+}
+
+static void kick_poll_begin(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+
+    vu_queue_set_notification(vu_fd_watch->vu_dev,
+                              vu_fd_watch_get_queue(vu_fd_watch), 0);
+}
+
+static void kick_poll_end(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+
+    /* Caller polls once more after this to catch requests that race with us */
+    vu_queue_set_notification(vu_fd_watch->vu_dev,
+                              vu_fd_watch_get_queue(vu_fd_watch), 1);
+}
+
+static void vu_fd_watch_attach(VuFdWatch *vu_fd_watch, AioContext *ctx)
+{
+    aio_set_fd_handler(ctx, vu_fd_watch->fd, true, kick_handler, NULL,
+                       kick_poll_handler, vu_fd_watch);
+    aio_set_fd_poll(ctx, vu_fd_watch->fd, kick_poll_begin, kick_poll_end);
+}
+
+
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
 {
 
@@ -249,10 +351,9 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
         qemu_set_nonblock(fd);
-        aio_set_fd_handler(server->ioc->ctx, fd, true, kick_handler,
-                           NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        vu_fd_watch_attach(vu_fd_watch, server->ioc->ctx);
     }
 }
 
@@ -348,6 +449,9 @@ void vhost_user_server_stop(VuServer *server)
         qio_net_listener_disconnect(server->listener);
         object_unref(OBJECT(server->listener));
     }
+
+    g_free(server->notify_vqs);
+    server->notify_vqs = NULL;
 }
 
 /*
@@ -375,9 +479,10 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
 
     qio_channel_attach_aio_context(server->ioc, ctx);
 
+    server->notify_bh = aio_bh_new(ctx, vu_notify_bh, server);
+
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, true, kick_handler, NULL,
-                           NULL, vu_fd_watch);
+        vu_fd_watch_attach(vu_fd_watch, ctx);
     }
 
     aio_co_schedule(ctx, server->co_trip);
@@ -394,6 +499,11 @@ void vhost_user_server_detach_aio_context(VuServer *server)
                                NULL, NULL, NULL, vu_fd_watch);
         }
 
+        /* Send pending notifications before the BH goes away */
+        qemu_bh_delete(server->notify_bh);
+        server->notify_bh = NULL;
+        vu_notify_bh(server);
+
         qio_channel_detach_aio_context(server->ioc);
     }
 
@@ -432,6 +542,7 @@ bool vhost_user_server_start(VuServer *server,
         .vu_iface              = vu_iface,
         .max_queues            = max_queues,
         .ctx                   = ctx,
+        .notify_vqs            = bitmap_new(max_queues),
     };
 
     qio_net_listener_set_name(server->listener, "vhost-user-backend-listener");